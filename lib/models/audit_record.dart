@@ -0,0 +1,99 @@
+/// One overwrite or discard pass recorded in the audit log
+class AuditPass {
+  final String pattern;
+  final DateTime started;
+  final DateTime finished;
+  final int bytes;
+  final int throughputBps;
+
+  /// "passed", "failed" or "none" when the pass was not verified
+  final String verify;
+  final int verifyErrors;
+
+  AuditPass({
+    required this.pattern,
+    required this.started,
+    required this.finished,
+    required this.bytes,
+    required this.throughputBps,
+    required this.verify,
+    required this.verifyErrors,
+  });
+
+  factory AuditPass.fromMap(Map<dynamic, dynamic> map) {
+    return AuditPass(
+      pattern: map['pattern'] as String? ?? '',
+      started: DateTime.fromMicrosecondsSinceEpoch(map['startedUs'] as int? ?? 0),
+      finished:
+          DateTime.fromMicrosecondsSinceEpoch(map['finishedUs'] as int? ?? 0),
+      bytes: map['bytes'] as int? ?? 0,
+      throughputBps: map['throughputBps'] as int? ?? 0,
+      verify: map['verify'] as String? ?? 'none',
+      verifyErrors: map['verifyErrors'] as int? ?? 0,
+    );
+  }
+
+  Duration get duration => finished.difference(started);
+}
+
+/// Entry of the native hash-chained audit log
+///
+/// [hash] is the SHA-256 of the record including the hash of its
+/// predecessor; the whole chain is checked with
+/// `DiskOperationsService.verifyAuditLog`.
+class AuditRecord {
+  final int sequence;
+  final String hash;
+  final String devicePath;
+  final String serialNumber;
+  final String model;
+  final String firmware;
+  final int capacityBytes;
+  final String method;
+
+  /// "completed", "failed" or "cancelled"
+  final String status;
+  final String message;
+  final DateTime started;
+  final DateTime finished;
+  final List<AuditPass> passes;
+
+  AuditRecord({
+    required this.sequence,
+    required this.hash,
+    required this.devicePath,
+    required this.serialNumber,
+    required this.model,
+    required this.firmware,
+    required this.capacityBytes,
+    required this.method,
+    required this.status,
+    required this.message,
+    required this.started,
+    required this.finished,
+    required this.passes,
+  });
+
+  factory AuditRecord.fromMap(Map<dynamic, dynamic> map) {
+    return AuditRecord(
+      sequence: map['sequence'] as int? ?? 0,
+      hash: map['hash'] as String? ?? '',
+      devicePath: map['devicePath'] as String? ?? '',
+      serialNumber: map['serialNumber'] as String? ?? '',
+      model: map['model'] as String? ?? '',
+      firmware: map['firmware'] as String? ?? '',
+      capacityBytes: map['capacityBytes'] as int? ?? 0,
+      method: map['method'] as String? ?? '',
+      status: map['status'] as String? ?? '',
+      message: map['message'] as String? ?? '',
+      started: DateTime.fromMicrosecondsSinceEpoch(map['startedUs'] as int? ?? 0),
+      finished:
+          DateTime.fromMicrosecondsSinceEpoch(map['finishedUs'] as int? ?? 0),
+      passes: (map['passes'] as List<dynamic>? ?? [])
+          .map((pass) => AuditPass.fromMap(pass as Map))
+          .toList(),
+    );
+  }
+
+  bool get succeeded => status == 'completed';
+}
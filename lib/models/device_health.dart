@@ -0,0 +1,61 @@
+/// Periodic drive health reading from the native health sampler
+///
+/// NVMe drives report the SMART / Health Information log page, SATA drives
+/// the ATA SMART attribute table. Counters a protocol does not report are 0.
+class DeviceHealthSample {
+  final String devicePath;
+  final DateTime timestamp;
+  final int? temperatureCelsius;
+  final int criticalWarning;
+  final int availableSpare;
+  final int percentageUsed;
+  final int powerOnHours;
+  final int unsafeShutdowns;
+  final int mediaErrors;
+  final int errorLogEntries;
+  final int reallocatedSectors;
+  final int pendingSectors;
+  final int uncorrectableSectors;
+
+  DeviceHealthSample({
+    required this.devicePath,
+    required this.timestamp,
+    required this.temperatureCelsius,
+    required this.criticalWarning,
+    required this.availableSpare,
+    required this.percentageUsed,
+    required this.powerOnHours,
+    required this.unsafeShutdowns,
+    required this.mediaErrors,
+    required this.errorLogEntries,
+    required this.reallocatedSectors,
+    required this.pendingSectors,
+    required this.uncorrectableSectors,
+  });
+
+  factory DeviceHealthSample.fromMap(Map<dynamic, dynamic> map) {
+    return DeviceHealthSample(
+      devicePath: map['devicePath'] as String? ?? '',
+      timestamp: DateTime.fromMicrosecondsSinceEpoch(
+          map['timestampUs'] as int? ?? 0),
+      temperatureCelsius: map['temperatureCelsius'] as int?,
+      criticalWarning: map['criticalWarning'] as int? ?? 0,
+      availableSpare: map['availableSpare'] as int? ?? 0,
+      percentageUsed: map['percentageUsed'] as int? ?? 0,
+      powerOnHours: map['powerOnHours'] as int? ?? 0,
+      unsafeShutdowns: map['unsafeShutdowns'] as int? ?? 0,
+      mediaErrors: map['mediaErrors'] as int? ?? 0,
+      errorLogEntries: map['errorLogEntries'] as int? ?? 0,
+      reallocatedSectors: map['reallocatedSectors'] as int? ?? 0,
+      pendingSectors: map['pendingSectors'] as int? ?? 0,
+      uncorrectableSectors: map['uncorrectableSectors'] as int? ?? 0,
+    );
+  }
+
+  /// Any media error or NVMe critical warning bit set
+  bool get hasMediaProblems =>
+      criticalWarning != 0 ||
+      mediaErrors > 0 ||
+      pendingSectors > 0 ||
+      uncorrectableSectors > 0;
+}
@@ -0,0 +1,77 @@
+import 'dart:typed_data';
+
+/// One metric of a device's history, reduced to buckets natively
+///
+/// The lists are parallel: bucket `i` starts at `timestamps[i]` (ms since
+/// the epoch) and summarises `counts[i]` samples. Buckets without samples
+/// are left out, so gaps in the timestamps mark gaps in the recording.
+class HistorySeries {
+  final Int64List timestamps;
+  final Int64List counts;
+  final Float64List min;
+  final Float64List max;
+  final Float64List avg;
+
+  HistorySeries({
+    required this.timestamps,
+    required this.counts,
+    required this.min,
+    required this.max,
+    required this.avg,
+  });
+
+  factory HistorySeries.fromMap(Map<dynamic, dynamic> map) {
+    return HistorySeries(
+      timestamps: map['timestamps'] as Int64List? ?? Int64List(0),
+      counts: map['counts'] as Int64List? ?? Int64List(0),
+      min: map['min'] as Float64List? ?? Float64List(0),
+      max: map['max'] as Float64List? ?? Float64List(0),
+      avg: map['avg'] as Float64List? ?? Float64List(0),
+    );
+  }
+
+  int get length => timestamps.length;
+  bool get isEmpty => timestamps.isEmpty;
+
+  DateTime timeAt(int index) =>
+      DateTime.fromMillisecondsSinceEpoch(timestamps[index]);
+}
+
+/// Usage and throughput history of one device from the native store
+///
+/// Metrics are `readBytesPerSec`, `writeBytesPerSec`, `readIops`,
+/// `writeIops` and `utilization`, recorded every second from
+/// /proc/diskstats, and `usedBytes`, recorded whenever the disk list is
+/// checked.
+class DiskHistory {
+  final String device;
+  final DateTime from;
+  final DateTime to;
+  final Duration bucket;
+  final Map<String, HistorySeries> series;
+
+  DiskHistory({
+    required this.device,
+    required this.from,
+    required this.to,
+    required this.bucket,
+    required this.series,
+  });
+
+  factory DiskHistory.fromMap(Map<dynamic, dynamic> map) {
+    final series = <String, HistorySeries>{};
+    (map['series'] as Map<dynamic, dynamic>? ?? {}).forEach((metric, value) {
+      series[metric as String] =
+          HistorySeries.fromMap(value as Map<dynamic, dynamic>);
+    });
+    return DiskHistory(
+      device: map['device'] as String? ?? '',
+      from: DateTime.fromMillisecondsSinceEpoch(map['fromMs'] as int? ?? 0),
+      to: DateTime.fromMillisecondsSinceEpoch(map['toMs'] as int? ?? 0),
+      bucket: Duration(milliseconds: map['bucketMs'] as int? ?? 0),
+      series: series,
+    );
+  }
+
+  HistorySeries? operator [](String metric) => series[metric];
+}
@@ -32,6 +32,9 @@ class DiskInfo {
     );
   }
 
+  /// LUKS volumes can be erased by destroying their headers alone
+  bool get isLuks => fstype == 'crypto_LUKS';
+
   String get sizeFormatted => _formatBytes(size);
   String get usedFormatted => _formatBytes(used);
   String get availableFormatted => _formatBytes(available);
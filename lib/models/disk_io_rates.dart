@@ -0,0 +1,60 @@
+/// Per-device I/O rates computed natively from /proc/diskstats deltas
+///
+/// Values cover the interval between the last two samples and use the same
+/// definitions as `iostat -x`.
+class DiskIoRates {
+  final String name;
+  final int major;
+  final int minor;
+  final double readBytesPerSec;
+  final double writeBytesPerSec;
+  final double readIops;
+  final double writeIops;
+  final double readAwaitMs;
+  final double writeAwaitMs;
+  final double serviceTimeMs;
+  final double queueDepth;
+  final double utilization;
+  final int inFlight;
+
+  DiskIoRates({
+    required this.name,
+    required this.major,
+    required this.minor,
+    required this.readBytesPerSec,
+    required this.writeBytesPerSec,
+    required this.readIops,
+    required this.writeIops,
+    required this.readAwaitMs,
+    required this.writeAwaitMs,
+    required this.serviceTimeMs,
+    required this.queueDepth,
+    required this.utilization,
+    required this.inFlight,
+  });
+
+  factory DiskIoRates.fromMap(Map<dynamic, dynamic> map) {
+    double toDouble(String key) => (map[key] as num?)?.toDouble() ?? 0.0;
+    return DiskIoRates(
+      name: map['name'] as String? ?? '',
+      major: map['major'] as int? ?? 0,
+      minor: map['minor'] as int? ?? 0,
+      readBytesPerSec: toDouble('readBytesPerSec'),
+      writeBytesPerSec: toDouble('writeBytesPerSec'),
+      readIops: toDouble('readIops'),
+      writeIops: toDouble('writeIops'),
+      readAwaitMs: toDouble('readAwaitMs'),
+      writeAwaitMs: toDouble('writeAwaitMs'),
+      serviceTimeMs: toDouble('serviceTimeMs'),
+      queueDepth: toDouble('queueDepth'),
+      utilization: toDouble('utilization'),
+      inFlight: map['inFlight'] as int? ?? 0,
+    );
+  }
+
+  double get readMBps => readBytesPerSec / (1024 * 1024);
+  double get writeMBps => writeBytesPerSec / (1024 * 1024);
+
+  /// Any request completed or outstanding during the interval
+  bool get isActive => readIops > 0 || writeIops > 0 || inFlight > 0;
+}
@@ -1,9 +1,55 @@
 import 'package:flutter/material.dart';
 import 'package:swipe/theme/theme.dart';
+import '../models/audit_record.dart';
+import '../services/disk_operations_service.dart';
 
-class LogsTab extends StatelessWidget {
+class LogsTab extends StatefulWidget {
   const LogsTab({super.key});
 
+  @override
+  State<LogsTab> createState() => _LogsTabState();
+}
+
+class _LogsTabState extends State<LogsTab> {
+  final TextEditingController _serialController = TextEditingController();
+  late Future<List<AuditRecord>> _records;
+  String? _chainStatus;
+
+  @override
+  void initState() {
+    super.initState();
+    _records = diskOperationsService.getAuditLog();
+  }
+
+  @override
+  void dispose() {
+    _serialController.dispose();
+    super.dispose();
+  }
+
+  void _search() {
+    final serial = _serialController.text.trim();
+    setState(() {
+      _records = serial.isEmpty
+          ? diskOperationsService.getAuditLog()
+          : diskOperationsService.findAuditRecords(serial);
+    });
+  }
+
+  Future<void> _verifyChain() async {
+    setState(() => _chainStatus = 'Verifying...');
+    try {
+      final result = await diskOperationsService.verifyAuditLog();
+      setState(() {
+        _chainStatus = result['valid'] == true
+            ? 'Hash chain intact (${result['records']} records)'
+            : 'Hash chain broken: ${result['error']}';
+      });
+    } catch (e) {
+      setState(() => _chainStatus = 'Verification failed: $e');
+    }
+  }
+
   @override
   Widget build(BuildContext context) {
     return Center(
@@ -20,15 +66,135 @@ class LogsTab extends StatelessWidget {
               ),
             ),
             AppSpacing.gapVerticalLG,
-            Text(
-              'Log viewer coming soon...',
-              style: AppTypography.bodyMedium.withColor(
-                Theme.of(context).textTheme.bodyMedium!.color!,
+            _buildToolbar(context),
+            if (_chainStatus != null) ...[
+              AppSpacing.gapVerticalMD,
+              Text(
+                _chainStatus!,
+                style: AppTypography.bodyMedium.withColor(
+                  Theme.of(context).textTheme.bodyMedium!.color!,
+                ),
               ),
-            ),
+            ],
+            AppSpacing.gapVerticalLG,
+            Expanded(child: _buildRecordList(context)),
           ],
         ),
       ),
     );
   }
+
+  Widget _buildToolbar(BuildContext context) {
+    return Row(
+      children: [
+        SizedBox(
+          width: 320,
+          child: TextField(
+            controller: _serialController,
+            decoration: const InputDecoration(
+              hintText: 'Filter by serial number',
+              prefixIcon: Icon(Icons.search),
+            ),
+            onSubmitted: (_) => _search(),
+          ),
+        ),
+        AppSpacing.gapHorizontalMD,
+        OutlinedButton.icon(
+          onPressed: _search,
+          icon: const Icon(Icons.refresh),
+          label: const Text('Refresh'),
+        ),
+        AppSpacing.gapHorizontalMD,
+        OutlinedButton.icon(
+          onPressed: _verifyChain,
+          icon: const Icon(Icons.verified_user),
+          label: const Text('Verify chain'),
+        ),
+      ],
+    );
+  }
+
+  Widget _buildRecordList(BuildContext context) {
+    return FutureBuilder<List<AuditRecord>>(
+      future: _records,
+      builder: (context, snapshot) {
+        if (snapshot.connectionState != ConnectionState.done) {
+          return const Center(child: CircularProgressIndicator());
+        }
+        if (snapshot.hasError) {
+          return Text(
+            'Failed to read audit log: ${snapshot.error}',
+            style: AppTypography.bodyMedium.withColor(AppColors.error),
+          );
+        }
+        final records = snapshot.data ?? [];
+        if (records.isEmpty) {
+          return Text(
+            'No operations recorded yet.',
+            style: AppTypography.bodyMedium.withColor(
+              Theme.of(context).textTheme.bodyMedium!.color!,
+            ),
+          );
+        }
+        return Container(
+          decoration: BoxDecoration(
+            color: Theme.of(context).cardTheme.color,
+            borderRadius: AppSpacing.borderRadiusLG,
+            border: Border.all(
+              color: Theme.of(context).dividerColor,
+              width: 1,
+            ),
+          ),
+          child: ListView.separated(
+            itemCount: records.length,
+            separatorBuilder: (context, index) =>
+                Divider(height: 1, color: Theme.of(context).dividerColor),
+            itemBuilder: (context, index) =>
+                _buildRecordTile(context, records[index]),
+          ),
+        );
+      },
+    );
+  }
+
+  Widget _buildRecordTile(BuildContext context, AuditRecord record) {
+    final statusColor = record.succeeded
+        ? AppColors.success
+        : record.status == 'cancelled'
+            ? AppColors.warning
+            : AppColors.error;
+    final bytes = record.passes.fold<int>(0, (sum, pass) => sum + pass.bytes);
+
+    return ListTile(
+      leading: Icon(
+        record.succeeded ? Icons.check_circle : Icons.error,
+        color: statusColor,
+      ),
+      title: Text(
+        '#${record.sequence}  ${record.method} on ${record.devicePath}',
+        style: AppTypography.titleSmall.withColor(
+          Theme.of(context).textTheme.bodyLarge!.color!,
+        ),
+      ),
+      subtitle: Text(
+        [
+          '${record.model} ${record.serialNumber}'.trim(),
+          '${record.status}, ${record.passes.length} pass(es), '
+              '${(bytes / (1 << 20)).toStringAsFixed(1)} MiB',
+          record.started.toLocal().toString(),
+          if (record.message.isNotEmpty) record.message,
+        ].where((line) => line.isNotEmpty).join('\n'),
+        style: AppTypography.bodySmall.withColor(
+          Theme.of(context).textTheme.bodyMedium!.color!,
+        ),
+      ),
+      trailing: Text(
+        record.hash.substring(0, record.hash.length < 12 ? record.hash.length : 12),
+        style: AppTypography.monospace.withColor(
+          Theme.of(context).textTheme.bodyMedium!.color!,
+        ),
+      ),
+      isThreeLine: true,
+    );
+  }
 }
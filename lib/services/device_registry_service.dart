@@ -1,6 +1,7 @@
 import 'dart:async';
 import 'dart:isolate';
 import 'package:flutter/services.dart';
+import '../models/device_health.dart';
 import '../models/storage_device_model.dart';
 
 /// Device Registry Service
@@ -10,6 +11,8 @@ import '../models/storage_device_model.dart';
 class DeviceRegistryService {
   static const MethodChannel _channel =
       MethodChannel('com.swipe.device/registry');
+  static const EventChannel _healthChannel =
+      EventChannel('com.swipe.device/health');
 
   Isolate? _workerIsolate;
   SendPort? _workerSendPort;
@@ -80,6 +83,142 @@ class DeviceRegistryService {
     }
   }
 
+  /// Device maps with only the requested field groups
+  ///
+  /// Every map has the sysfs fields `devicePath`, `deviceName`,
+  /// `deviceType`, `transport`, `totalBytes`, `removable`, `rotational`,
+  /// `modelName` and `serialNumber`; [fields] adds any of `geometry`,
+  /// `discard`, `identity`, `security` and `partitions` (all when null).
+  /// `identity` and `security` send IDENTIFY to the drive and may spin up a
+  /// sleeping disk. [paths], [types] and [transports] restrict the devices.
+  /// Results are memoized until a uevent reports a change, unless [refresh]
+  /// is set.
+  Future<List<Map<dynamic, dynamic>>> queryDevices({
+    List<String>? fields,
+    List<String>? paths,
+    List<String>? types,
+    List<String>? transports,
+    bool refresh = false,
+  }) async {
+    try {
+      final List<dynamic> result = await _channel.invokeMethod(
+        'getDeviceList',
+        {
+          'fields': fields ?? ['all'],
+          if (paths != null) 'paths': paths,
+          if (types != null) 'types': types,
+          if (transports != null) 'transports': transports,
+          if (refresh) 'refresh': true,
+        },
+      );
+      return result.cast<Map<dynamic, dynamic>>();
+    } on PlatformException catch (e) {
+      throw Exception('Failed to query devices: ${e.message}');
+    }
+  }
+
+  /// Startup milestones in milliseconds since launch
+  ///
+  /// Includes `devicesReady` (background enumeration finished),
+  /// `engineReady`, `firstFrame` and `firstDeviceList`; milestones not
+  /// reached yet are absent.
+  Future<Map<String, double>> getStartupTimings() async {
+    try {
+      final Map<dynamic, dynamic> result =
+          await _channel.invokeMethod('getStartupTimings');
+      return result.map((key, value) =>
+          MapEntry(key as String, (value as num).toDouble()));
+    } on PlatformException catch (e) {
+      throw Exception('Failed to get startup timings: ${e.message}');
+    }
+  }
+
+  /// Stream of periodic health samples (temperature, media errors)
+  ///
+  /// Each event carries the latest sample of every sampled drive.
+  Stream<List<DeviceHealthSample>> get healthStream {
+    return _healthChannel.receiveBroadcastStream().map((event) {
+      if (event is List) {
+        return event
+            .map((sample) => DeviceHealthSample.fromMap(sample as Map))
+            .toList();
+      }
+      return <DeviceHealthSample>[];
+    });
+  }
+
+  /// Get the recorded health history of one device, oldest first
+  Future<List<DeviceHealthSample>> getHealthHistory(String devicePath) async {
+    try {
+      final List<dynamic> result = await _channel.invokeMethod(
+        'getHealthHistory',
+        {'devicePath': devicePath},
+      );
+      return result
+          .map((sample) => DeviceHealthSample.fromMap(sample as Map))
+          .toList();
+    } on PlatformException catch (e) {
+      throw Exception('Failed to get health history: ${e.message}');
+    }
+  }
+
+  /// Block device dependency graph (partitions, dm, md, LVM, dm-crypt)
+  ///
+  /// Returns a map with a `generation` counter that changes whenever a
+  /// device is added, changed or removed, and `nodes`, each listing its
+  /// `lowers` (devices it is built on) and `uppers` (devices built on it).
+  Future<Map<dynamic, dynamic>> getTopology() async {
+    try {
+      final result = await _channel.invokeMethod('getTopology');
+      return result as Map<dynamic, dynamic>;
+    } on PlatformException catch (e) {
+      throw Exception('Failed to get topology: ${e.message}');
+    }
+  }
+
+  /// NVMe controllers with the namespaces they serve
+  ///
+  /// Each map has the controller `name` (`nvme0`), `devicePath`, identity
+  /// fields, the `adminCommands` its probe issued and `namespaces`, each
+  /// with `namespaceId`, `deviceName` (when it has a block device),
+  /// `blockSize` and `sizeBytes`.
+  Future<List<Map<dynamic, dynamic>>> getNvmeControllers() async {
+    try {
+      final List<dynamic> result =
+          await _channel.invokeMethod('getNvmeControllers');
+      return result.cast<Map<dynamic, dynamic>>();
+    } on PlatformException catch (e) {
+      throw Exception('Failed to get NVMe controllers: ${e.message}');
+    }
+  }
+
+  /// Physical devices backing a device or mount point
+  ///
+  /// Pass a kernel name or node path as [device] (`dm-0`,
+  /// `/dev/mapper/vg-root`) or a [mountPoint].
+  Future<List<Map<dynamic, dynamic>>> getBackingDevices(
+      {String? device, String? mountPoint}) async {
+    return _invokeTopologyWalk('getBackingDevices', device, mountPoint);
+  }
+
+  /// Everything stacked on [device], i.e. what breaks if it is wiped
+  Future<List<Map<dynamic, dynamic>>> getDependents(String device) async {
+    return _invokeTopologyWalk('getDependents', device, null);
+  }
+
+  Future<List<Map<dynamic, dynamic>>> _invokeTopologyWalk(
+      String method, String? device, String? mountPoint) async {
+    try {
+      final List<dynamic> result = await _channel.invokeMethod(method, {
+        if (device != null) 'device': device,
+        if (mountPoint != null) 'mountPoint': mountPoint,
+      });
+      return result.cast<Map<dynamic, dynamic>>();
+    } on PlatformException catch (e) {
+      throw Exception('$method failed: ${e.message}');
+    }
+  }
+
   /// Dispose resources
   void dispose() {
     _workerIsolate?.kill(priority: Isolate.immediate);
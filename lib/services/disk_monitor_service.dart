@@ -1,16 +1,25 @@
 import 'package:flutter/services.dart';
+import '../models/disk_history.dart';
 import '../models/disk_info.dart';
+import '../models/disk_io_rates.dart';
 
 class DiskMonitorService {
   static const MethodChannel _methodChannel =
       MethodChannel('disk_monitor/method');
   static const EventChannel _eventChannel =
       EventChannel('disk_monitor/event');
+  static const EventChannel _ioStatsChannel =
+      EventChannel('disk_monitor/iostats');
 
   /// Fetch disk information once
-  Future<List<DiskInfo>> getDiskInfo() async {
+  ///
+  /// Answered from the latest snapshot collected in the background. When the
+  /// snapshot is older than [maxAgeMs] it is still returned, and a refresh is
+  /// started so the next call and [diskInfoStream] see current data.
+  Future<List<DiskInfo>> getDiskInfo({int? maxAgeMs}) async {
     try {
-      final List<dynamic> result = await _methodChannel.invokeMethod('getDiskInfo');
+      final List<dynamic> result = await _methodChannel.invokeMethod(
+          'getDiskInfo', {if (maxAgeMs != null) 'maxAgeMs': maxAgeMs});
       return result.map((disk) => DiskInfo.fromMap(disk)).toList();
     } on PlatformException catch (e) {
       print('Failed to get disk info: ${e.message}');
@@ -18,6 +27,42 @@ class DiskMonitorService {
     }
   }
 
+  /// Usage and throughput history of [device] (kernel name, e.g. `sda`)
+  ///
+  /// Defaults to every recorded metric over the whole retention window.
+  /// Samples are reduced natively to min/max/avg buckets of [bucketMs], or
+  /// to at most [maxPoints] buckets when no width is given.
+  Future<DiskHistory?> getHistory(
+    String device, {
+    List<String>? metrics,
+    DateTime? from,
+    DateTime? to,
+    int? bucketMs,
+    int? maxPoints,
+  }) async {
+    try {
+      final Map<dynamic, dynamic> result =
+          await _methodChannel.invokeMethod('getHistory', {
+        'device': device,
+        if (metrics != null) 'metrics': metrics,
+        if (from != null) 'fromMs': from.millisecondsSinceEpoch,
+        if (to != null) 'toMs': to.millisecondsSinceEpoch,
+        if (bucketMs != null) 'bucketMs': bucketMs,
+        if (maxPoints != null) 'maxPoints': maxPoints,
+      });
+      return DiskHistory.fromMap(result);
+    } on PlatformException catch (e) {
+      print('Failed to get disk history: ${e.message}');
+      return null;
+    }
+  }
+
+  /// Size of the native history: series, samples, bytes and bitsPerSample
+  Future<Map<dynamic, dynamic>> getHistoryStats() async {
+    final result = await _methodChannel.invokeMethod('getHistoryStats');
+    return result as Map<dynamic, dynamic>;
+  }
+
   /// Stream real-time disk information updates
   Stream<List<DiskInfo>> get diskInfoStream {
     return _eventChannel.receiveBroadcastStream().map((event) {
@@ -27,4 +72,17 @@ class DiskMonitorService {
       return <DiskInfo>[];
     });
   }
+
+  /// Stream per-device I/O rates sampled every [intervalMs]
+  ///
+  /// The first event arrives after two samples, once there is a delta.
+  Stream<List<DiskIoRates>> ioStatsStream({int intervalMs = 1000}) {
+    return _ioStatsChannel
+        .receiveBroadcastStream({'intervalMs': intervalMs}).map((event) {
+      if (event is List) {
+        return event.map((rates) => DiskIoRates.fromMap(rates)).toList();
+      }
+      return <DiskIoRates>[];
+    });
+  }
 }
@@ -0,0 +1,391 @@
+import 'dart:typed_data';
+
+import 'package:flutter/services.dart';
+import '../models/audit_record.dart';
+
+/// Progress update for a long-running native disk operation
+class DiskOperationProgress {
+  final String operation;
+  final String devicePath;
+  final int bytesDone;
+  final int bytesTotal;
+
+  /// Bytes read back and matched so far by a verifying overwrite
+  final int bytesVerified;
+  final Duration elapsed;
+  final Map<dynamic, dynamic>? throttle;
+
+  /// Surface scans only: one byte per [cellSize] bytes of the device, 0 for
+  /// not yet read, 1 + the latency class of the slowest read in the cell
+  /// (class n is roughly 64 << n microseconds), or 255 when unreadable
+  final Uint8List? heatmap;
+  final int cellSize;
+  final int badSectors;
+
+  DiskOperationProgress({
+    required this.operation,
+    required this.devicePath,
+    required this.bytesDone,
+    required this.bytesTotal,
+    this.bytesVerified = 0,
+    required this.elapsed,
+    this.throttle,
+    this.heatmap,
+    this.cellSize = 0,
+    this.badSectors = 0,
+  });
+
+  factory DiskOperationProgress.fromMap(Map<dynamic, dynamic> map) {
+    return DiskOperationProgress(
+      operation: map['operation'] as String? ?? '',
+      devicePath: map['devicePath'] as String? ?? '',
+      bytesDone: map['bytesDone'] as int? ?? 0,
+      bytesTotal: map['bytesTotal'] as int? ?? 0,
+      bytesVerified: map['bytesVerified'] as int? ?? 0,
+      elapsed: Duration(microseconds: map['elapsedUs'] as int? ?? 0),
+      throttle: map['throttle'] as Map<dynamic, dynamic>?,
+      heatmap: map['heatmap'] as Uint8List?,
+      cellSize: map['cellSize'] as int? ?? 0,
+      badSectors: map['badSectors'] as int? ?? 0,
+    );
+  }
+
+  double get fraction => bytesTotal > 0 ? bytesDone / bytesTotal : 0.0;
+}
+
+/// Block-layer discard operation
+enum DiscardMode { discard, secureDiscard, zeroOut }
+
+/// Fill pattern for overwrite operations
+enum WipePattern { zeros, ones, random }
+
+/// Disk Operations Service
+///
+/// Starts destructive and read-only bulk operations in native code. Each call
+/// completes when the operation ends; progress arrives on [progressStream].
+class DiskOperationsService {
+  static const MethodChannel _channel =
+      MethodChannel('com.swipe.device/operations');
+  static const EventChannel _progressChannel =
+      EventChannel('com.swipe.device/operations/progress');
+
+  /// Stream of progress updates for all running operations
+  Stream<DiskOperationProgress> get progressStream {
+    return _progressChannel
+        .receiveBroadcastStream()
+        .map((event) => DiskOperationProgress.fromMap(event as Map));
+  }
+
+  /// Discard/TRIM or zero a device range using block-layer offloads
+  ///
+  /// When [fallbackToOverwrite] is set, devices without the offload are
+  /// overwritten with zeros instead of failing.
+  Future<Map<dynamic, dynamic>> discard(
+    String devicePath, {
+    DiscardMode mode = DiscardMode.discard,
+    int? offset,
+    int? length,
+    bool fallbackToOverwrite = false,
+  }) async {
+    return _invoke('discard', {
+      'devicePath': devicePath,
+      'mode': mode.name,
+      if (offset != null) 'offset': offset,
+      if (length != null) 'length': length,
+      'fallbackToOverwrite': fallbackToOverwrite,
+    });
+  }
+
+  /// Read discard and write-zeroes limits of a device
+  Future<Map<dynamic, dynamic>> getDiscardCapabilities(
+      String devicePath) async {
+    return _invoke('getDiscardCapabilities', {'devicePath': devicePath});
+  }
+
+  /// NUMA node, CPUs and interrupt routing of a device's I/O
+  ///
+  /// Returns `numaNode` (-1 when the device reports none), the node's
+  /// `cpuList` and `cpuCount` that [wipePartitions] and [surfaceScan] pin
+  /// their threads to, and the `irqCpuList` its `irqCount` MSI vectors are
+  /// routed to; `irqsLocal` is false when some interrupts land on another
+  /// node.
+  Future<Map<dynamic, dynamic>> getIoPlacement(String devicePath) async {
+    return _invoke('getIoPlacement', {'devicePath': devicePath});
+  }
+
+  /// Partitions of a whole-disk node with their start and size in sectors
+  Future<List<Map<dynamic, dynamic>>> listPartitionExtents(
+      String devicePath) async {
+    try {
+      final result = await _channel
+          .invokeMethod('listPartitionExtents', {'devicePath': devicePath});
+      return (result as List).cast<Map<dynamic, dynamic>>();
+    } on PlatformException catch (e) {
+      throw Exception('listPartitionExtents failed: ${e.message}');
+    }
+  }
+
+  /// Overwrite selected partitions (by name) or raw sector [extents]
+  ///
+  /// Each extent is a map with `startSector` and `sizeSectors`. Mounted or
+  /// overlapping ranges are rejected before anything is written. SSD ranges
+  /// are wiped in parallel; rotational disks are wiped one range at a time.
+  ///
+  /// With [verify], every chunk is read back with O_DIRECT [verifyLag]
+  /// chunks (8 by default) behind the writes, in the same sweep rather than
+  /// a second pass; the result then has `bytesVerified` and the call fails
+  /// if anything read back differently.
+  ///
+  /// Unless [numaPlacement] is false, the I/O threads run on the device's
+  /// NUMA node with node-local buffers, backed by huge pages with
+  /// [hugePages]; the result's `placement` reports what was applied.
+  ///
+  /// With [autotune], a short write probe in the first range picks the
+  /// transfer size and per-range queue depth (see [autotuneDevice]); the
+  /// choice is reported as `autotune`.
+  ///
+  /// Unless [throttle] is false, a disk's queue depth and write rate follow
+  /// its temperature (hwmon sensor, else SMART or the NVMe health log): the
+  /// rate is shaped above [temperatureTargetCelsius] and floored above
+  /// [temperatureCriticalCelsius]. [maxRateBps] caps it outright. Progress
+  /// events and the result carry the controller state as `throttle`.
+  Future<Map<dynamic, dynamic>> wipePartitions(
+    String devicePath, {
+    List<String>? partitions,
+    List<Map<String, int>>? extents,
+    WipePattern pattern = WipePattern.zeros,
+    int? maxParallelRanges,
+    bool verify = false,
+    int? verifyLag,
+    bool numaPlacement = true,
+    bool hugePages = false,
+    bool autotune = false,
+    bool throttle = true,
+    int? temperatureTargetCelsius,
+    int? temperatureCriticalCelsius,
+    int? maxRateBps,
+  }) async {
+    return _invoke('wipePartitions', {
+      'devicePath': devicePath,
+      if (partitions != null) 'partitions': partitions,
+      if (extents != null) 'extents': extents,
+      'pattern': pattern.name,
+      if (maxParallelRanges != null) 'maxParallelRanges': maxParallelRanges,
+      if (verify) 'verify': true,
+      if (verifyLag != null) 'verifyLag': verifyLag,
+      if (!numaPlacement) 'numaPlacement': false,
+      if (hugePages) 'hugePages': true,
+      if (autotune) 'autotune': true,
+      if (!throttle) 'throttle': false,
+      if (temperatureTargetCelsius != null)
+        'temperatureTargetCelsius': temperatureTargetCelsius,
+      if (temperatureCriticalCelsius != null)
+        'temperatureCriticalCelsius': temperatureCriticalCelsius,
+      if (maxRateBps != null) 'maxRateBps': maxRateBps,
+    });
+  }
+
+  /// Cryptographically erase a LUKS1/LUKS2 volume (`fstype` `crypto_LUKS`)
+  ///
+  /// Overwrites only the headers and keyslot areas with random data, which
+  /// leaves the payload undecryptable in milliseconds. The volume must be
+  /// locked. Returns the erased `layout`, `bytesWritten` and `verified`.
+  Future<Map<dynamic, dynamic>> cryptoErase(String devicePath) async {
+    return _invoke('cryptoErase', {'devicePath': devicePath});
+  }
+
+  /// Read the whole device (or [offset]/[length]) looking for slow and
+  /// unreadable blocks, without writing anything
+  ///
+  /// [regions] stripes are read concurrently, each front to back; the
+  /// default is 4 on SSDs and 1 on rotational disks. Reads slower than
+  /// [slowThreshold] are listed in `slowExtents`. The result has per-region
+  /// latency `histogram`s, the unreadable `badExtents` in bytes and the final
+  /// `heatmap`; progress events carry the heatmap as it fills in. Threads
+  /// are placed as in [wipePartitions]. With [autotune], the transfer size
+  /// and (on SSDs) the number of regions come from a read probe.
+  Future<Map<dynamic, dynamic>> surfaceScan(
+    String devicePath, {
+    int? offset,
+    int? length,
+    int? regions,
+    int? cells,
+    Duration? slowThreshold,
+    bool numaPlacement = true,
+    bool hugePages = false,
+    bool autotune = false,
+  }) async {
+    return _invoke('surfaceScan', {
+      'devicePath': devicePath,
+      if (offset != null) 'offset': offset,
+      if (length != null) 'length': length,
+      if (regions != null) 'regions': regions,
+      if (cells != null) 'cells': cells,
+      if (slowThreshold != null) 'slowThresholdUs': slowThreshold.inMicroseconds,
+      if (!numaPlacement) 'numaPlacement': false,
+      if (hugePages) 'hugePages': true,
+      if (autotune) 'autotune': true,
+    });
+  }
+
+  /// Best transfer size and queue depth for reading [devicePath]
+  ///
+  /// Reads for a few seconds at most, sweeping block sizes up to the
+  /// device's `max_hw_sectors_kb` (stripe multiples when it reports an
+  /// `optimal_io_size`) and doubling the queue depth until throughput stops
+  /// improving. The chosen `blockSize` and `queueDepth` are the cheapest
+  /// pair within 90% of the best `bytesPerSecond`; every measured pair is in
+  /// `samples`. Results are cached per model and firmware (`cached` is then
+  /// true and nothing is read) unless [refresh] is set.
+  Future<Map<dynamic, dynamic>> autotuneDevice(
+    String devicePath, {
+    int? offset,
+    int? length,
+    bool refresh = false,
+  }) async {
+    return _invoke('autotuneDevice', {
+      'devicePath': devicePath,
+      if (offset != null) 'offset': offset,
+      if (length != null) 'length': length,
+      if (refresh) 'autotuneRefresh': true,
+    });
+  }
+
+  /// SHA-256 Merkle root of the device content, e.g. after a wipe
+  ///
+  /// Leaves are [leafSize] bytes (default 1 MiB) hashed on all cores; the
+  /// result has the `root` and the `regionRoots` of each [regionSize] run
+  /// (default 1 GiB). Hashing one region again with `offset` =
+  /// index * regionSize and `length` = regionSize returns that region's root
+  /// as `root`, so a stored certificate can be spot-checked.
+  Future<Map<dynamic, dynamic>> hashDevice(
+    String devicePath, {
+    int? offset,
+    int? length,
+    int? leafSize,
+    int? regionSize,
+  }) async {
+    return _invoke('hashDevice', {
+      'devicePath': devicePath,
+      if (offset != null) 'offset': offset,
+      if (length != null) 'length': length,
+      if (leafSize != null) 'leafSize': leafSize,
+      if (regionSize != null) 'regionSize': regionSize,
+    });
+  }
+
+  /// Classify a random sample of blocks as zero, ones, constant, structured
+  /// or random (encrypted/compressed) without reading the whole device
+  ///
+  /// The device is cut into [regions] strata that are sampled evenly. The
+  /// sample size follows from [margin], the wanted 95% error of the class
+  /// fractions (0.02 by default, about 2400 blocks), unless [samples] is
+  /// given. The result has class `counts`, the achieved `margin` and an
+  /// occupancy map of `regionClasses` (index into the class list, 255 when
+  /// unsampled) and `regionEntropy` in bits per byte.
+  Future<Map<dynamic, dynamic>> profileDevice(
+    String devicePath, {
+    int? regions,
+    int? samples,
+    double? margin,
+    int? blockSize,
+  }) async {
+    return _invoke('profileDevice', {
+      'devicePath': devicePath,
+      if (regions != null) 'regions': regions,
+      if (samples != null) 'samples': samples,
+      if (margin != null) 'margin': margin,
+      if (blockSize != null) 'blockSize': blockSize,
+    });
+  }
+
+  /// Overwrite the free space of a mounted filesystem without unmounting it
+  ///
+  /// Free space is claimed by unnamed fill files that the kernel releases
+  /// on completion, cancel or crash, leaving at least [minFreeBytes]
+  /// (256 MiB by default) for other writers. Writes back off when their
+  /// latency exceeds [latencyTargetMs]. SSD-backed filesystems are trimmed
+  /// afterwards unless [trim] is false. Pass [devicePath] to record the run
+  /// in the audit log. The result's `stopReason` is `filled`, or `margin`
+  /// when other writers used up the headroom first.
+  Future<Map<dynamic, dynamic>> wipeFreeSpace(
+    String mountPoint, {
+    String? devicePath,
+    String? pattern,
+    int? minFreeBytes,
+    int? latencyTargetMs,
+    int? maxRateBps,
+    bool? trim,
+  }) async {
+    return _invoke('wipeFreeSpace', {
+      'mountPoint': mountPoint,
+      if (devicePath != null) 'devicePath': devicePath,
+      if (pattern != null) 'pattern': pattern,
+      if (minFreeBytes != null) 'minFreeBytes': minFreeBytes,
+      if (latencyTargetMs != null) 'latencyTargetMs': latencyTargetMs,
+      if (maxRateBps != null) 'maxRateBps': maxRateBps,
+      if (trim != null) 'trim': trim,
+    });
+  }
+
+  /// Find everything holding [devicePaths] or their partitions
+  ///
+  /// Returns a map whose `devices` list has, per path, `busy` and the
+  /// `mounts`, `swaps`, `holders` (dm/md/LVM) and `processes` with open
+  /// descriptors that would make a wipe unsafe.
+  Future<Map<dynamic, dynamic>> getBusyReport(List<String> devicePaths) async {
+    return _invoke('getBusyReport', {'devicePaths': devicePaths});
+  }
+
+  /// Newest audit log entries, newest first
+  Future<List<AuditRecord>> getAuditLog({int limit = 100}) async {
+    return _invokeAudit('getAuditLog', {'limit': limit});
+  }
+
+  /// Audit log entries for a drive serial number, newest first
+  Future<List<AuditRecord>> findAuditRecords(String serialNumber,
+      {int limit = 100}) async {
+    return _invokeAudit(
+        'findAuditRecords', {'serialNumber': serialNumber, 'limit': limit});
+  }
+
+  /// Recompute the audit log hash chain
+  ///
+  /// Returns `valid`, the number of `records` checked and, for a broken
+  /// chain, an `error` naming the first bad record.
+  Future<Map<dynamic, dynamic>> verifyAuditLog() async {
+    return _invoke('verifyAuditLog', {});
+  }
+
+  /// Cancel running operations on [devicePath], or all when null
+  Future<void> cancel([String? devicePath]) async {
+    await _channel.invokeMethod('cancel', {
+      if (devicePath != null) 'devicePath': devicePath,
+    });
+  }
+
+  Future<List<AuditRecord>> _invokeAudit(
+      String method, Map<String, dynamic> args) async {
+    try {
+      final result = await _channel.invokeMethod(method, args);
+      return (result as List)
+          .map((record) => AuditRecord.fromMap(record as Map))
+          .toList();
+    } on PlatformException catch (e) {
+      throw Exception('$method failed: ${e.message}');
+    }
+  }
+
+  Future<Map<dynamic, dynamic>> _invoke(
+      String method, Map<String, dynamic> args) async {
+    try {
+      final result = await _channel.invokeMethod(method, args);
+      return result as Map<dynamic, dynamic>;
+    } on PlatformException catch (e) {
+      throw Exception('$method failed: ${e.message}');
+    }
+  }
+}
+
+/// Singleton instance
+final diskOperationsService = DiskOperationsService();
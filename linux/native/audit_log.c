@@ -0,0 +1,1035 @@
+#include "audit_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/*
+ * File layout
+ *
+ *   file header   "SWAUDLOG" u32 version u32 reserved
+ *   record        u32 magic u32 length u64 sequence u8 prev_hash[32]
+ *                 payload
+ *                 u8 hash[32]   SHA-256 over everything above in the record
+ *                 u32 length    repeated so the log can be walked backwards
+ *
+ * The first record links to the SHA-256 of the file header. All integers are
+ * little-endian.
+ *
+ * Index layout
+ *
+ *   header        "SWAUDIDX" u32 version u32 reserved
+ *   entry         u64 serial_key u64 offset u32 length u32 reserved
+ */
+
+#define AUDIT_FILE_MAGIC "SWAUDLOG"
+#define AUDIT_INDEX_MAGIC "SWAUDIDX"
+#define AUDIT_VERSION 1
+#define AUDIT_FILE_HEADER_SIZE 16
+#define AUDIT_RECORD_MAGIC 0x43455241u  // "AREC"
+#define AUDIT_RECORD_HEADER_SIZE (4 + 4 + 8 + SHA256_DIGEST_SIZE)
+#define AUDIT_RECORD_TRAILER_SIZE (SHA256_DIGEST_SIZE + 4)
+#define AUDIT_RECORD_MIN_SIZE (AUDIT_RECORD_HEADER_SIZE + AUDIT_RECORD_TRAILER_SIZE)
+#define AUDIT_RECORD_MAX_SIZE (64 * 1024)
+#define AUDIT_INDEX_ENTRY_SIZE 24
+#define AUDIT_WRITE_RETRY_MS 1000
+
+// Serialization helpers
+
+typedef struct {
+    uint8_t* data;
+    size_t length;
+    size_t capacity;
+} AuditBuffer;
+
+static void buffer_put(AuditBuffer* buffer, const void* data, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 512;
+        while (capacity < buffer->length + length) capacity *= 2;
+        buffer->data = g_realloc(buffer->data, capacity);
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+static void buffer_put_u32(AuditBuffer* buffer, uint32_t value) {
+    value = htole32(value);
+    buffer_put(buffer, &value, sizeof(value));
+}
+
+static void buffer_put_u64(AuditBuffer* buffer, uint64_t value) {
+    value = htole64(value);
+    buffer_put(buffer, &value, sizeof(value));
+}
+
+static void buffer_put_string(AuditBuffer* buffer, const char* value, size_t max_length) {
+    uint16_t length = (uint16_t)strnlen(value, max_length);
+    uint16_t encoded = htole16(length);
+    buffer_put(buffer, &encoded, sizeof(encoded));
+    buffer_put(buffer, value, length);
+}
+
+static uint32_t get_u32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return le32toh(value);
+}
+
+static uint64_t get_u64(const uint8_t* data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return le64toh(value);
+}
+
+static void set_u32(uint8_t* data, uint32_t value) {
+    value = htole32(value);
+    memcpy(data, &value, sizeof(value));
+}
+
+static void set_u64(uint8_t* data, uint64_t value) {
+    value = htole64(value);
+    memcpy(data, &value, sizeof(value));
+}
+
+typedef struct {
+    const uint8_t* data;
+    size_t length;
+    size_t position;
+    gboolean overrun;
+} AuditCursor;
+
+static const uint8_t* cursor_take(AuditCursor* cursor, size_t length) {
+    if (cursor->overrun || cursor->position + length > cursor->length) {
+        cursor->overrun = TRUE;
+        return NULL;
+    }
+    const uint8_t* data = cursor->data + cursor->position;
+    cursor->position += length;
+    return data;
+}
+
+static uint32_t cursor_u32(AuditCursor* cursor) {
+    const uint8_t* data = cursor_take(cursor, 4);
+    return data ? get_u32(data) : 0;
+}
+
+static uint64_t cursor_u64(AuditCursor* cursor) {
+    const uint8_t* data = cursor_take(cursor, 8);
+    return data ? get_u64(data) : 0;
+}
+
+static void cursor_string(AuditCursor* cursor, char* out, size_t size) {
+    const uint8_t* prefix = cursor_take(cursor, 2);
+    uint16_t length = prefix ? (uint16_t)(prefix[0] | prefix[1] << 8) : 0;
+    const uint8_t* data = cursor_take(cursor, length);
+    size_t copy = data ? MIN((size_t)length, size - 1) : 0;
+    if (copy > 0) memcpy(out, data, copy);
+    out[copy] = '\0';
+}
+
+static void encode_payload(const AuditRecord* record, AuditBuffer* buffer) {
+    buffer_put_string(buffer, record->device_path, sizeof(record->device_path));
+    buffer_put_string(buffer, record->serial, sizeof(record->serial));
+    buffer_put_string(buffer, record->model, sizeof(record->model));
+    buffer_put_string(buffer, record->firmware, sizeof(record->firmware));
+    buffer_put_u64(buffer, record->capacity_bytes);
+    buffer_put_string(buffer, record->method, sizeof(record->method));
+    buffer_put_string(buffer, record->status, sizeof(record->status));
+    buffer_put_string(buffer, record->message, sizeof(record->message));
+    buffer_put_u64(buffer, (uint64_t)record->started_us);
+    buffer_put_u64(buffer, (uint64_t)record->finished_us);
+
+    guint pass_count = MIN(record->pass_count, AUDIT_MAX_PASSES);
+    buffer_put_u32(buffer, pass_count);
+    for (guint i = 0; i < pass_count; i++) {
+        const AuditPass* pass = &record->passes[i];
+        buffer_put_string(buffer, pass->pattern, sizeof(pass->pattern));
+        buffer_put_u64(buffer, (uint64_t)pass->started_us);
+        buffer_put_u64(buffer, (uint64_t)pass->finished_us);
+        buffer_put_u64(buffer, pass->bytes);
+        buffer_put_u64(buffer, pass->throughput_bps);
+        buffer_put_u32(buffer, pass->verify);
+        buffer_put_u64(buffer, pass->verify_errors);
+    }
+}
+
+static gboolean decode_payload(const uint8_t* data, size_t length, AuditRecord* record) {
+    AuditCursor cursor = { data, length, 0, FALSE };
+    memset(record, 0, sizeof(*record));
+
+    cursor_string(&cursor, record->device_path, sizeof(record->device_path));
+    cursor_string(&cursor, record->serial, sizeof(record->serial));
+    cursor_string(&cursor, record->model, sizeof(record->model));
+    cursor_string(&cursor, record->firmware, sizeof(record->firmware));
+    record->capacity_bytes = cursor_u64(&cursor);
+    cursor_string(&cursor, record->method, sizeof(record->method));
+    cursor_string(&cursor, record->status, sizeof(record->status));
+    cursor_string(&cursor, record->message, sizeof(record->message));
+    record->started_us = (gint64)cursor_u64(&cursor);
+    record->finished_us = (gint64)cursor_u64(&cursor);
+
+    guint pass_count = cursor_u32(&cursor);
+    record->pass_count = MIN(pass_count, AUDIT_MAX_PASSES);
+    for (guint i = 0; i < record->pass_count; i++) {
+        AuditPass* pass = &record->passes[i];
+        cursor_string(&cursor, pass->pattern, sizeof(pass->pattern));
+        pass->started_us = (gint64)cursor_u64(&cursor);
+        pass->finished_us = (gint64)cursor_u64(&cursor);
+        pass->bytes = cursor_u64(&cursor);
+        pass->throughput_bps = cursor_u64(&cursor);
+        pass->verify = (AuditVerifyResult)cursor_u32(&cursor);
+        pass->verify_errors = cursor_u64(&cursor);
+    }
+    return !cursor.overrun;
+}
+
+// FNV-1a; collisions are resolved by comparing the decoded serial
+static uint64_t serial_key(const char* serial) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const unsigned char* p = (const unsigned char*)serial; *p; p++) {
+        hash ^= *p;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static void file_header(const char* magic, uint8_t header[AUDIT_FILE_HEADER_SIZE]) {
+    memcpy(header, magic, 8);
+    set_u32(header + 8, AUDIT_VERSION);
+    set_u32(header + 12, 0);
+}
+
+static gboolean pwrite_all(int fd, const void* data, size_t length, uint64_t offset) {
+    const uint8_t* bytes = data;
+    while (length > 0) {
+        ssize_t n = pwrite(fd, bytes, length, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return FALSE;
+        }
+        bytes += n;
+        length -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return TRUE;
+}
+
+static gboolean pread_all(int fd, void* data, size_t length, uint64_t offset) {
+    uint8_t* bytes = data;
+    while (length > 0) {
+        ssize_t n = pread(fd, bytes, length, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return FALSE;
+        bytes += n;
+        length -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return TRUE;
+}
+
+/*
+ * Read the record at @offset into @buffer (at least AUDIT_RECORD_MAX_SIZE
+ * bytes). Checks framing and the record's own hash, not the link to its
+ * predecessor.
+ */
+static gboolean read_record(int fd, uint64_t offset, uint64_t file_size,
+                            uint8_t* buffer, uint32_t* length) {
+    if (offset + AUDIT_RECORD_MIN_SIZE > file_size) return FALSE;
+    if (!pread_all(fd, buffer, 8, offset)) return FALSE;
+
+    uint32_t record_length = get_u32(buffer + 4);
+    if (get_u32(buffer) != AUDIT_RECORD_MAGIC ||
+        record_length < AUDIT_RECORD_MIN_SIZE ||
+        record_length > AUDIT_RECORD_MAX_SIZE ||
+        offset + record_length > file_size) {
+        return FALSE;
+    }
+    if (!pread_all(fd, buffer, record_length, offset)) return FALSE;
+    if (get_u32(buffer + record_length - 4) != record_length) return FALSE;
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256_digest(buffer, record_length - AUDIT_RECORD_TRAILER_SIZE, digest);
+    if (memcmp(digest, buffer + record_length - AUDIT_RECORD_TRAILER_SIZE, SHA256_DIGEST_SIZE) != 0) {
+        return FALSE;
+    }
+
+    *length = record_length;
+    return TRUE;
+}
+
+static const uint8_t* record_payload(const uint8_t* record, uint32_t length, size_t* payload_length) {
+    *payload_length = length - AUDIT_RECORD_MIN_SIZE;
+    return record + AUDIT_RECORD_HEADER_SIZE;
+}
+
+static gboolean check_file_header(int fd, const char* magic, GError** error) {
+    uint8_t header[AUDIT_FILE_HEADER_SIZE];
+    if (!pread_all(fd, header, sizeof(header), 0) ||
+        memcmp(header, magic, 8) != 0 ||
+        get_u32(header + 8) != AUDIT_VERSION) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Not an audit log (bad header)");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void audit_read_identity(const char* device_path, AuditRecord* record) {
+    snprintf(record->device_path, sizeof(record->device_path), "%s", device_path);
+
+    const char* slash = strrchr(device_path, '/');
+    const char* name = slash ? slash + 1 : device_path;
+
+    // Partitions keep identity on the parent disk
+    char base[512];
+    char path[640];
+    snprintf(base, sizeof(base), "/sys/class/block/%s", name);
+    snprintf(path, sizeof(path), "%s/partition", base);
+    if (access(path, F_OK) == 0) {
+        snprintf(path, sizeof(path), "/sys/class/block/%s/..", name);
+        char* parent = realpath(path, NULL);
+        if (parent) {
+            snprintf(base, sizeof(base), "%s", parent);
+            free(parent);
+        }
+    }
+
+    struct {
+        const char* attr;
+        char* out;
+        size_t size;
+    } fields[] = {
+        { "device/serial", record->serial, sizeof(record->serial) },
+        { "device/model", record->model, sizeof(record->model) },
+        { "device/firmware_rev", record->firmware, sizeof(record->firmware) },
+        { "device/rev", record->firmware, sizeof(record->firmware) },
+    };
+    for (size_t i = 0; i < G_N_ELEMENTS(fields); i++) {
+        if (fields[i].out[0]) continue;
+        snprintf(path, sizeof(path), "%s/%s", base, fields[i].attr);
+        FILE* f = fopen(path, "r");
+        if (!f) continue;
+        if (fgets(fields[i].out, (int)fields[i].size, f)) {
+            g_strstrip(fields[i].out);
+        }
+        fclose(f);
+    }
+
+    // SCSI/SATA disks expose the unit serial number only through VPD page 0x80
+    if (!record->serial[0]) {
+        snprintf(path, sizeof(path), "%s/device/vpd_pg80", base);
+        FILE* f = fopen(path, "rb");
+        if (f) {
+            uint8_t page[4 + 255];
+            size_t n = fread(page, 1, sizeof(page), f);
+            fclose(f);
+            if (n > 4) {
+                size_t length = MIN((size_t)page[3], n - 4);
+                length = MIN(length, sizeof(record->serial) - 1);
+                memcpy(record->serial, page + 4, length);
+                record->serial[length] = '\0';
+                g_strstrip(record->serial);
+            }
+        }
+    }
+
+    snprintf(path, sizeof(path), "/sys/class/block/%s/size", name);
+    FILE* f = fopen(path, "r");
+    if (f) {
+        unsigned long long sectors;
+        if (fscanf(f, "%llu", &sectors) == 1) record->capacity_bytes = sectors * 512;
+        fclose(f);
+    }
+}
+
+// Writer
+
+typedef struct AuditPending {
+    struct AuditPending* next;
+    uint64_t key;
+    size_t length;
+    uint8_t payload[];
+} AuditPending;
+
+struct AuditLog {
+    int fd;
+    int index_fd;
+    uint64_t end_offset;
+    uint64_t index_end;
+    uint64_t next_sequence;
+    uint8_t last_hash[SHA256_DIGEST_SIZE];
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t written_cond;
+    AuditPending* head;
+    AuditPending** tail;
+    uint64_t queued;
+    uint64_t written;
+    int write_errno;
+    gboolean stopping;
+};
+
+static void append_index_entry(AuditLog* log, uint64_t key, uint64_t offset, uint32_t length) {
+    if (log->index_fd < 0) return;
+    uint8_t entry[AUDIT_INDEX_ENTRY_SIZE];
+    set_u64(entry, key);
+    set_u64(entry + 8, offset);
+    set_u32(entry + 16, length);
+    set_u32(entry + 20, 0);
+    if (pwrite_all(log->index_fd, entry, sizeof(entry), log->index_end)) {
+        log->index_end += sizeof(entry);
+    }
+}
+
+// Write a batch as one contiguous append; returns FALSE with errno set
+static gboolean write_batch(AuditLog* log, AuditPending* batch, uint64_t* count) {
+    AuditBuffer buffer = { NULL, 0, 0 };
+    uint8_t hash[SHA256_DIGEST_SIZE];
+    memcpy(hash, log->last_hash, sizeof(hash));
+    uint64_t sequence = log->next_sequence;
+    *count = 0;
+
+    for (AuditPending* item = batch; item; item = item->next) {
+        uint32_t length = (uint32_t)(AUDIT_RECORD_MIN_SIZE + item->length);
+        size_t start = buffer.length;
+        buffer_put_u32(&buffer, AUDIT_RECORD_MAGIC);
+        buffer_put_u32(&buffer, length);
+        buffer_put_u64(&buffer, sequence++);
+        buffer_put(&buffer, hash, sizeof(hash));
+        buffer_put(&buffer, item->payload, item->length);
+        sha256_digest(buffer.data + start, buffer.length - start, hash);
+        buffer_put(&buffer, hash, sizeof(hash));
+        buffer_put_u32(&buffer, length);
+        (*count)++;
+    }
+
+    if (!pwrite_all(log->fd, buffer.data, buffer.length, log->end_offset) || fdatasync(log->fd) < 0) {
+        int saved = errno;
+        if (ftruncate(log->fd, (off_t)log->end_offset) < 0) {
+            g_warning("Failed to roll back partial audit write: %s", strerror(errno));
+        }
+        g_free(buffer.data);
+        errno = saved;
+        return FALSE;
+    }
+
+    // The index trails the log; readers scan any records it does not cover
+    uint64_t offset = log->end_offset;
+    for (AuditPending* item = batch; item; item = item->next) {
+        uint32_t length = (uint32_t)(AUDIT_RECORD_MIN_SIZE + item->length);
+        append_index_entry(log, item->key, offset, length);
+        offset += length;
+    }
+
+    log->end_offset += buffer.length;
+    log->next_sequence = sequence;
+    memcpy(log->last_hash, hash, sizeof(hash));
+    g_free(buffer.data);
+    return TRUE;
+}
+
+static void free_pending(AuditPending* item) {
+    while (item) {
+        AuditPending* next = item->next;
+        g_free(item);
+        item = next;
+    }
+}
+
+static void* audit_writer_thread(void* data) {
+    AuditLog* log = data;
+
+    pthread_mutex_lock(&log->lock);
+    for (;;) {
+        while (!log->head && !log->stopping) {
+            pthread_cond_wait(&log->wake, &log->lock);
+        }
+        if (!log->head) break;
+
+        // Everything queued so far goes out as one write and one sync
+        AuditPending* batch = log->head;
+        log->head = NULL;
+        log->tail = &log->head;
+        pthread_mutex_unlock(&log->lock);
+
+        uint64_t count;
+        gboolean ok = write_batch(log, batch, &count);
+        int saved = errno;
+
+        pthread_mutex_lock(&log->lock);
+        if (ok) {
+            free_pending(batch);
+            log->written += count;
+            log->write_errno = 0;
+            pthread_cond_broadcast(&log->written_cond);
+            continue;
+        }
+
+        // Put the batch back in front and retry later
+        g_warning("Audit log write failed: %s", strerror(saved));
+        AuditPending* last = batch;
+        while (last->next) last = last->next;
+        last->next = log->head;
+        if (!log->head) log->tail = &last->next;
+        log->head = batch;
+        log->write_errno = saved;
+        pthread_cond_broadcast(&log->written_cond);
+        if (log->stopping) break;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += AUDIT_WRITE_RETRY_MS / 1000;
+        pthread_cond_timedwait(&log->wake, &log->lock, &deadline);
+    }
+    pthread_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+// Find the chain tail. Returns FALSE when the log is damaged beyond a torn
+// final record.
+static gboolean recover_tail(AuditLog* log, uint64_t size, GError** error) {
+    uint8_t* buffer = g_malloc(AUDIT_RECORD_MAX_SIZE);
+    gboolean ok = TRUE;
+
+    // Fast path: the trailer of the last record points at its start
+    uint8_t trailer[4];
+    uint32_t length;
+    if (size >= AUDIT_FILE_HEADER_SIZE + AUDIT_RECORD_MIN_SIZE &&
+        pread_all(log->fd, trailer, sizeof(trailer), size - 4)) {
+        uint32_t claimed = get_u32(trailer);
+        if (claimed <= size - AUDIT_FILE_HEADER_SIZE &&
+            read_record(log->fd, size - claimed, size, buffer, &length)) {
+            memcpy(log->last_hash, buffer + length - AUDIT_RECORD_TRAILER_SIZE, SHA256_DIGEST_SIZE);
+            log->next_sequence = get_u64(buffer + 8) + 1;
+            log->end_offset = size;
+            g_free(buffer);
+            return TRUE;
+        }
+    }
+
+    // Slow path: walk forward to the last intact record
+    uint64_t offset = AUDIT_FILE_HEADER_SIZE;
+    while (offset < size && read_record(log->fd, offset, size, buffer, &length)) {
+        memcpy(log->last_hash, buffer + length - AUDIT_RECORD_TRAILER_SIZE, SHA256_DIGEST_SIZE);
+        log->next_sequence = get_u64(buffer + 8) + 1;
+        offset += length;
+    }
+
+    if (offset < size) {
+        if (size - offset > AUDIT_RECORD_MAX_SIZE) {
+            // More than one record's worth of damage is not a torn write
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "Audit log is corrupt at offset %llu", (unsigned long long)offset);
+            ok = FALSE;
+        } else {
+            g_warning("Truncating torn audit record at offset %llu", (unsigned long long)offset);
+            if (ftruncate(log->fd, (off_t)offset) < 0) {
+                g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno),
+                            "Failed to truncate audit log: %s", strerror(errno));
+                ok = FALSE;
+            }
+        }
+    }
+
+    log->end_offset = offset;
+    g_free(buffer);
+    return ok;
+}
+
+// Bring the index up to date with records it missed (crash between the log
+// sync and the index write)
+static void catch_up_index(AuditLog* log, const char* index_path) {
+    log->index_fd = open(index_path, O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+    if (log->index_fd < 0) {
+        g_warning("Failed to open audit index %s: %s", index_path, strerror(errno));
+        return;
+    }
+
+    struct stat st;
+    uint8_t header[AUDIT_FILE_HEADER_SIZE];
+    if (fstat(log->index_fd, &st) < 0 || st.st_size < AUDIT_FILE_HEADER_SIZE ||
+        !check_file_header(log->index_fd, AUDIT_INDEX_MAGIC, NULL)) {
+        file_header(AUDIT_INDEX_MAGIC, header);
+        if (ftruncate(log->index_fd, 0) < 0 ||
+            !pwrite_all(log->index_fd, header, sizeof(header), 0)) {
+            close(log->index_fd);
+            log->index_fd = -1;
+            return;
+        }
+        st.st_size = AUDIT_FILE_HEADER_SIZE;
+    }
+
+    // Drop a partial trailing entry
+    uint64_t entries = ((uint64_t)st.st_size - AUDIT_FILE_HEADER_SIZE) / AUDIT_INDEX_ENTRY_SIZE;
+    log->index_end = AUDIT_FILE_HEADER_SIZE + entries * AUDIT_INDEX_ENTRY_SIZE;
+
+    uint64_t covered = AUDIT_FILE_HEADER_SIZE;
+    if (entries > 0) {
+        uint8_t entry[AUDIT_INDEX_ENTRY_SIZE];
+        if (pread_all(log->index_fd, entry, sizeof(entry), log->index_end - sizeof(entry))) {
+            covered = get_u64(entry + 8) + get_u32(entry + 16);
+        }
+    }
+    if (covered > log->end_offset) {
+        // Index refers to records that no longer exist; rebuild it
+        if (ftruncate(log->index_fd, AUDIT_FILE_HEADER_SIZE) == 0) {
+            log->index_end = AUDIT_FILE_HEADER_SIZE;
+            covered = AUDIT_FILE_HEADER_SIZE;
+        }
+    }
+
+    uint8_t* buffer = g_malloc(AUDIT_RECORD_MAX_SIZE);
+    uint32_t length;
+    while (covered < log->end_offset &&
+           read_record(log->fd, covered, log->end_offset, buffer, &length)) {
+        AuditRecord* record = g_new(AuditRecord, 1);
+        size_t payload_length;
+        const uint8_t* payload = record_payload(buffer, length, &payload_length);
+        if (decode_payload(payload, payload_length, record)) {
+            append_index_entry(log, serial_key(record->serial), covered, length);
+        }
+        g_free(record);
+        covered += length;
+    }
+    g_free(buffer);
+}
+
+AuditLog* audit_log_open(const char* path, GError** error) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno),
+                    "Failed to open audit log %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    AuditLog* log = g_new0(AuditLog, 1);
+    log->fd = fd;
+    log->index_fd = -1;
+    log->tail = &log->head;
+
+    uint8_t header[AUDIT_FILE_HEADER_SIZE];
+    file_header(AUDIT_FILE_MAGIC, header);
+    sha256_digest(header, sizeof(header), log->last_hash);
+
+    struct stat st;
+    gboolean ok = fstat(fd, &st) == 0;
+    if (ok && st.st_size == 0) {
+        ok = pwrite_all(fd, header, sizeof(header), 0) && fdatasync(fd) == 0;
+        log->end_offset = AUDIT_FILE_HEADER_SIZE;
+        if (!ok) {
+            g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno),
+                        "Failed to initialize audit log: %s", strerror(errno));
+        }
+    } else if (ok) {
+        ok = check_file_header(fd, AUDIT_FILE_MAGIC, error) &&
+             recover_tail(log, (uint64_t)st.st_size, error);
+    } else {
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno),
+                    "Failed to stat audit log: %s", strerror(errno));
+    }
+
+    if (!ok) {
+        close(fd);
+        g_free(log);
+        return NULL;
+    }
+
+    char* index_path = g_strdup_printf("%s.idx", path);
+    catch_up_index(log, index_path);
+    g_free(index_path);
+
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->wake, NULL);
+    pthread_cond_init(&log->written_cond, NULL);
+    if (pthread_create(&log->thread, NULL, audit_writer_thread, log) != 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to start audit writer");
+        pthread_cond_destroy(&log->written_cond);
+        pthread_cond_destroy(&log->wake);
+        pthread_mutex_destroy(&log->lock);
+        if (log->index_fd >= 0) close(log->index_fd);
+        close(fd);
+        g_free(log);
+        return NULL;
+    }
+    return log;
+}
+
+void audit_log_append(AuditLog* log, const AuditRecord* record) {
+    AuditBuffer buffer = { NULL, 0, 0 };
+    encode_payload(record, &buffer);
+
+    AuditPending* item = g_malloc(sizeof(AuditPending) + buffer.length);
+    item->next = NULL;
+    item->key = serial_key(record->serial);
+    item->length = buffer.length;
+    memcpy(item->payload, buffer.data, buffer.length);
+    g_free(buffer.data);
+
+    pthread_mutex_lock(&log->lock);
+    *log->tail = item;
+    log->tail = &item->next;
+    log->queued++;
+    pthread_cond_signal(&log->wake);
+    pthread_mutex_unlock(&log->lock);
+}
+
+gboolean audit_log_flush(AuditLog* log, GError** error) {
+    pthread_mutex_lock(&log->lock);
+    uint64_t target = log->queued;
+    while (log->written < target && log->write_errno == 0) {
+        pthread_cond_wait(&log->written_cond, &log->lock);
+    }
+    int saved = log->write_errno;
+    gboolean ok = log->written >= target;
+    pthread_mutex_unlock(&log->lock);
+
+    if (!ok) {
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Audit log write failed: %s", strerror(saved));
+    }
+    return ok;
+}
+
+void audit_log_close(AuditLog* log) {
+    if (!log) return;
+
+    pthread_mutex_lock(&log->lock);
+    log->stopping = TRUE;
+    pthread_cond_signal(&log->wake);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->thread, NULL);
+
+    if (log->head) {
+        g_warning("Dropping %llu unwritten audit records",
+                  (unsigned long long)(log->queued - log->written));
+        free_pending(log->head);
+    }
+
+    pthread_cond_destroy(&log->written_cond);
+    pthread_cond_destroy(&log->wake);
+    pthread_mutex_destroy(&log->lock);
+    if (log->index_fd >= 0) close(log->index_fd);
+    close(log->fd);
+    g_free(log);
+}
+
+gboolean audit_log_verify(const char* path, uint64_t* records, GError** error) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno),
+                    "Failed to open audit log %s: %s", path, strerror(errno));
+        return FALSE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !check_file_header(fd, AUDIT_FILE_MAGIC, error)) {
+        if (error && !*error) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to stat audit log");
+        }
+        close(fd);
+        return FALSE;
+    }
+
+    uint8_t header[AUDIT_FILE_HEADER_SIZE];
+    uint8_t expected[SHA256_DIGEST_SIZE];
+    file_header(AUDIT_FILE_MAGIC, header);
+    sha256_digest(header, sizeof(header), expected);
+
+    uint8_t* buffer = g_malloc(AUDIT_RECORD_MAX_SIZE);
+    uint64_t offset = AUDIT_FILE_HEADER_SIZE;
+    uint64_t size = (uint64_t)st.st_size;
+    uint64_t count = 0;
+    gboolean ok = TRUE;
+
+    while (ok && offset < size) {
+        uint32_t length;
+        if (!read_record(fd, offset, size, buffer, &length)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "Record %llu at offset %llu is damaged or altered",
+                        (unsigned long long)count, (unsigned long long)offset);
+            ok = FALSE;
+        } else if (get_u64(buffer + 8) != count ||
+                   memcmp(buffer + 16, expected, SHA256_DIGEST_SIZE) != 0) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "Hash chain broken at record %llu (offset %llu)",
+                        (unsigned long long)count, (unsigned long long)offset);
+            ok = FALSE;
+        } else {
+            memcpy(expected, buffer + length - AUDIT_RECORD_TRAILER_SIZE, SHA256_DIGEST_SIZE);
+            offset += length;
+            count++;
+        }
+    }
+
+    g_free(buffer);
+    close(fd);
+    if (records) *records = count;
+    return ok;
+}
+
+// Reader
+
+typedef struct {
+    uint64_t key;
+    uint64_t offset;
+} AuditIndexEntry;
+
+struct AuditReader {
+    int fd;
+    int index_fd;
+    AuditIndexEntry* entries;         // sorted by (key, offset)
+    size_t count;
+    size_t capacity;
+    uint64_t index_loaded;            // bytes of the index consumed
+    uint64_t indexed_end;             // log offset covered by entries
+    uint8_t* buffer;                  // AUDIT_RECORD_MAX_SIZE scratch
+};
+
+static int compare_index_entries(const void* a, const void* b) {
+    const AuditIndexEntry* x = a;
+    const AuditIndexEntry* y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    if (x->offset != y->offset) return x->offset < y->offset ? -1 : 1;
+    return 0;
+}
+
+static void reader_add(AuditReader* reader, uint64_t key, uint64_t offset) {
+    if (reader->count == reader->capacity) {
+        reader->capacity = reader->capacity ? reader->capacity * 2 : 1024;
+        reader->entries = g_realloc(reader->entries, reader->capacity * sizeof(AuditIndexEntry));
+    }
+    reader->entries[reader->count].key = key;
+    reader->entries[reader->count].offset = offset;
+    reader->count++;
+}
+
+// Sort entries added since @sorted and merge them into the sorted prefix
+static void reader_merge(AuditReader* reader, size_t sorted) {
+    size_t added = reader->count - sorted;
+    if (added == 0) return;
+
+    AuditIndexEntry* entries = reader->entries;
+    qsort(entries + sorted, added, sizeof(AuditIndexEntry), compare_index_entries);
+    if (sorted == 0 || compare_index_entries(&entries[sorted - 1], &entries[sorted]) <= 0) return;
+
+    AuditIndexEntry* tail = g_new(AuditIndexEntry, added);
+    memcpy(tail, entries + sorted, added * sizeof(AuditIndexEntry));
+    size_t i = sorted, j = added, k = reader->count;
+    while (j > 0) {
+        if (i > 0 && compare_index_entries(&entries[i - 1], &tail[j - 1]) > 0) {
+            entries[--k] = entries[--i];
+        } else {
+            entries[--k] = tail[--j];
+        }
+    }
+    g_free(tail);
+}
+
+AuditReader* audit_reader_open(const char* path, GError** error) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno),
+                    "Failed to open audit log %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    if (!check_file_header(fd, AUDIT_FILE_MAGIC, error)) {
+        close(fd);
+        return NULL;
+    }
+
+    AuditReader* reader = g_new0(AuditReader, 1);
+    reader->fd = fd;
+    reader->buffer = g_malloc(AUDIT_RECORD_MAX_SIZE);
+    reader->indexed_end = AUDIT_FILE_HEADER_SIZE;
+    reader->index_loaded = AUDIT_FILE_HEADER_SIZE;
+
+    char* index_path = g_strdup_printf("%s.idx", path);
+    reader->index_fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    g_free(index_path);
+    if (reader->index_fd >= 0 && !check_file_header(reader->index_fd, AUDIT_INDEX_MAGIC, NULL)) {
+        close(reader->index_fd);
+        reader->index_fd = -1;
+    }
+
+    if (!audit_reader_refresh(reader, error)) {
+        audit_reader_free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+void audit_reader_free(AuditReader* reader) {
+    if (!reader) return;
+    if (reader->index_fd >= 0) close(reader->index_fd);
+    close(reader->fd);
+    g_free(reader->entries);
+    g_free(reader->buffer);
+    g_free(reader);
+}
+
+gboolean audit_reader_refresh(AuditReader* reader, GError** error) {
+    size_t sorted = reader->count;
+
+    // Entries the writer has indexed since the last refresh
+    struct stat st;
+    if (reader->index_fd >= 0 && fstat(reader->index_fd, &st) == 0) {
+        uint8_t chunk[AUDIT_INDEX_ENTRY_SIZE * 1024];
+        uint64_t end = AUDIT_FILE_HEADER_SIZE +
+            ((uint64_t)st.st_size - AUDIT_FILE_HEADER_SIZE) / AUDIT_INDEX_ENTRY_SIZE * AUDIT_INDEX_ENTRY_SIZE;
+        while (reader->index_loaded < end) {
+            size_t want = (size_t)MIN((uint64_t)sizeof(chunk), end - reader->index_loaded);
+            if (!pread_all(reader->index_fd, chunk, want, reader->index_loaded)) break;
+            for (size_t i = 0; i < want; i += AUDIT_INDEX_ENTRY_SIZE) {
+                uint64_t offset = get_u64(chunk + i + 8);
+                if (offset < reader->indexed_end) continue;
+                reader_add(reader, get_u64(chunk + i), offset);
+                reader->indexed_end = offset + get_u32(chunk + i + 16);
+            }
+            reader->index_loaded += want;
+        }
+    }
+
+    // Records written but not yet indexed
+    if (fstat(reader->fd, &st) < 0) {
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno),
+                    "Failed to stat audit log: %s", strerror(errno));
+        reader_merge(reader, sorted);
+        return FALSE;
+    }
+    uint32_t length;
+    AuditRecord* record = g_new(AuditRecord, 1);
+    while (read_record(reader->fd, reader->indexed_end, (uint64_t)st.st_size, reader->buffer, &length)) {
+        size_t payload_length;
+        const uint8_t* payload = record_payload(reader->buffer, length, &payload_length);
+        if (decode_payload(payload, payload_length, record)) {
+            reader_add(reader, serial_key(record->serial), reader->indexed_end);
+        }
+        reader->indexed_end += length;
+    }
+    g_free(record);
+
+    reader_merge(reader, sorted);
+    return TRUE;
+}
+
+uint64_t audit_reader_count(AuditReader* reader) {
+    return reader->count;
+}
+
+static FlValue* record_to_fl_value(const uint8_t* data, uint32_t length) {
+    AuditRecord* record = g_new(AuditRecord, 1);
+    size_t payload_length;
+    const uint8_t* payload = record_payload(data, length, &payload_length);
+    if (!decode_payload(payload, payload_length, record)) {
+        g_free(record);
+        return NULL;
+    }
+
+    char hash[SHA256_DIGEST_SIZE * 2 + 1];
+    sha256_to_hex(data + length - AUDIT_RECORD_TRAILER_SIZE, hash);
+
+    FlValue* value = fl_value_new_map();
+    fl_value_set_string_take(value, "sequence", fl_value_new_int((int64_t)get_u64(data + 8)));
+    fl_value_set_string_take(value, "hash", fl_value_new_string(hash));
+    fl_value_set_string_take(value, "devicePath", fl_value_new_string(record->device_path));
+    fl_value_set_string_take(value, "serialNumber", fl_value_new_string(record->serial));
+    fl_value_set_string_take(value, "model", fl_value_new_string(record->model));
+    fl_value_set_string_take(value, "firmware", fl_value_new_string(record->firmware));
+    fl_value_set_string_take(value, "capacityBytes", fl_value_new_int((int64_t)record->capacity_bytes));
+    fl_value_set_string_take(value, "method", fl_value_new_string(record->method));
+    fl_value_set_string_take(value, "status", fl_value_new_string(record->status));
+    fl_value_set_string_take(value, "message", fl_value_new_string(record->message));
+    fl_value_set_string_take(value, "startedUs", fl_value_new_int(record->started_us));
+    fl_value_set_string_take(value, "finishedUs", fl_value_new_int(record->finished_us));
+
+    FlValue* passes = fl_value_new_list();
+    for (guint i = 0; i < record->pass_count; i++) {
+        const AuditPass* pass = &record->passes[i];
+        FlValue* item = fl_value_new_map();
+        fl_value_set_string_take(item, "pattern", fl_value_new_string(pass->pattern));
+        fl_value_set_string_take(item, "startedUs", fl_value_new_int(pass->started_us));
+        fl_value_set_string_take(item, "finishedUs", fl_value_new_int(pass->finished_us));
+        fl_value_set_string_take(item, "bytes", fl_value_new_int((int64_t)pass->bytes));
+        fl_value_set_string_take(item, "throughputBps", fl_value_new_int((int64_t)pass->throughput_bps));
+        fl_value_set_string_take(item, "verify", fl_value_new_string(
+            pass->verify == AUDIT_VERIFY_PASSED ? "passed" :
+            pass->verify == AUDIT_VERIFY_FAILED ? "failed" : "none"));
+        fl_value_set_string_take(item, "verifyErrors", fl_value_new_int((int64_t)pass->verify_errors));
+        fl_value_append_take(passes, item);
+    }
+    fl_value_set_string_take(value, "passes", passes);
+
+    g_free(record);
+    return value;
+}
+
+FlValue* audit_reader_find_serial(AuditReader* reader, const char* serial, guint limit) {
+    FlValue* list = fl_value_new_list();
+    uint64_t key = serial_key(serial);
+
+    // Upper bound of @key; offsets ascend within a key, so walk down for newest first
+    size_t lo = 0, hi = reader->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (reader->entries[mid].key <= key) lo = mid + 1;
+        else hi = mid;
+    }
+
+    struct stat st;
+    if (fstat(reader->fd, &st) < 0) return list;
+
+    guint found = 0;
+    AuditRecord* record = g_new(AuditRecord, 1);
+    for (size_t i = lo; i > 0 && reader->entries[i - 1].key == key && found < limit; i--) {
+        uint32_t length;
+        uint64_t offset = reader->entries[i - 1].offset;
+        if (!read_record(reader->fd, offset, (uint64_t)st.st_size, reader->buffer, &length)) continue;
+
+        size_t payload_length;
+        const uint8_t* payload = record_payload(reader->buffer, length, &payload_length);
+        if (!decode_payload(payload, payload_length, record) || strcmp(record->serial, serial) != 0) {
+            continue;
+        }
+
+        FlValue* value = record_to_fl_value(reader->buffer, length);
+        if (value) {
+            fl_value_append_take(list, value);
+            found++;
+        }
+    }
+    g_free(record);
+    return list;
+}
+
+FlValue* audit_reader_recent(AuditReader* reader, guint limit) {
+    FlValue* list = fl_value_new_list();
+
+    // Stop at the last complete record seen by audit_reader_refresh()
+    uint64_t position = reader->indexed_end;
+    guint found = 0;
+    while (found < limit && position >= AUDIT_FILE_HEADER_SIZE + AUDIT_RECORD_MIN_SIZE) {
+        uint8_t trailer[4];
+        uint32_t length;
+        if (!pread_all(reader->fd, trailer, sizeof(trailer), position - 4)) break;
+        uint32_t claimed = get_u32(trailer);
+        if (claimed > position - AUDIT_FILE_HEADER_SIZE ||
+            !read_record(reader->fd, position - claimed, position, reader->buffer, &length)) {
+            break;
+        }
+
+        FlValue* value = record_to_fl_value(reader->buffer, length);
+        if (value) {
+            fl_value_append_take(list, value);
+            found++;
+        }
+        position -= length;
+    }
+    return list;
+}
@@ -0,0 +1,131 @@
+#ifndef AUDIT_LOG_H
+#define AUDIT_LOG_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdint.h>
+#include "sha256.h"
+
+G_BEGIN_DECLS
+
+#define AUDIT_MAX_PASSES 16
+
+typedef enum {
+    AUDIT_VERIFY_NONE = 0,
+    AUDIT_VERIFY_PASSED = 1,
+    AUDIT_VERIFY_FAILED = 2,
+} AuditVerifyResult;
+
+typedef struct {
+    char pattern[32];                 // e.g. "zeros", "random", "discard"
+    gint64 started_us;                // wall clock, microseconds since the epoch
+    gint64 finished_us;
+    uint64_t bytes;
+    uint64_t throughput_bps;
+    AuditVerifyResult verify;
+    uint64_t verify_errors;
+} AuditPass;
+
+typedef struct {
+    char device_path[64];
+    char serial[64];
+    char model[64];
+    char firmware[32];
+    uint64_t capacity_bytes;
+    char method[32];                  // operation name
+    char status[16];                  // "completed", "failed" or "cancelled"
+    char message[256];                // error text for failed operations
+    gint64 started_us;
+    gint64 finished_us;
+    guint pass_count;
+    AuditPass passes[AUDIT_MAX_PASSES];
+} AuditRecord;
+
+/**
+ * audit_read_identity:
+ * @device_path: device node; partitions resolve to their parent disk
+ *
+ * Fills serial, model, firmware and capacity of @record from sysfs.
+ */
+void audit_read_identity(const char* device_path, AuditRecord* record);
+
+/*
+ * Writer
+ *
+ * The log is an append-only binary file. Every record carries the SHA-256 of
+ * its predecessor and its own SHA-256 over header and payload, so editing,
+ * removing or reordering records breaks the chain. A sidecar "<path>.idx"
+ * maps serial-number hashes to record offsets for the reader.
+ */
+
+typedef struct AuditLog AuditLog;
+
+/**
+ * audit_log_open:
+ * @path: log file, created when missing
+ *
+ * Recovers the chain tail from the last record (a torn final record left by
+ * a crash is truncated away) and starts the background writer.
+ *
+ * Returns: (transfer full): the log, or NULL with @error set
+ */
+AuditLog* audit_log_open(const char* path, GError** error);
+
+// Flushes pending records and stops the writer
+void audit_log_close(AuditLog* log);
+
+/**
+ * audit_log_append:
+ *
+ * Serializes @record and queues it for the writer thread. Never blocks on
+ * disk I/O, so it is safe to call from the data path.
+ */
+void audit_log_append(AuditLog* log, const AuditRecord* record);
+
+/**
+ * audit_log_flush:
+ *
+ * Waits until every record queued so far is on stable storage.
+ *
+ * Returns: FALSE when the writer has hit an I/O error
+ */
+gboolean audit_log_flush(AuditLog* log, GError** error);
+
+/**
+ * audit_log_verify:
+ * @records: (out) (optional): number of records checked
+ *
+ * Walks the whole log recomputing every hash and link.
+ *
+ * Returns: TRUE when the chain is intact
+ */
+gboolean audit_log_verify(const char* path, uint64_t* records, GError** error);
+
+/*
+ * Reader
+ */
+
+typedef struct AuditReader AuditReader;
+
+AuditReader* audit_reader_open(const char* path, GError** error);
+void audit_reader_free(AuditReader* reader);
+
+// Picks up records appended since the last call
+gboolean audit_reader_refresh(AuditReader* reader, GError** error);
+
+uint64_t audit_reader_count(AuditReader* reader);
+
+/**
+ * audit_reader_find_serial:
+ *
+ * Index lookup, O(log n) in the number of records plus one read per match.
+ *
+ * Returns: (transfer full): list of record maps, newest first
+ */
+FlValue* audit_reader_find_serial(AuditReader* reader, const char* serial, guint limit);
+
+// Returns: (transfer full): the newest @limit records, newest first
+FlValue* audit_reader_recent(AuditReader* reader, guint limit);
+
+G_END_DECLS
+
+#endif // AUDIT_LOG_H
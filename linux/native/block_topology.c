@@ -0,0 +1,593 @@
+#define _GNU_SOURCE
+#include "block_topology.h"
+#include "sysfs_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#define TOPOLOGY_NAME_MAX 64
+#define TOPOLOGY_INITIAL_BUCKETS 64
+
+typedef struct TopologyNode {
+    struct TopologyNode* next_by_name;
+    struct TopologyNode* next_by_dev;
+    char name[TOPOLOGY_NAME_MAX];
+    dev_t dev;
+    TopologyKind kind;
+    uint64_t size_bytes;
+    char label[128];          // dm name, md level or partition parent
+    struct TopologyNode** lowers;
+    guint lower_count;
+    guint lower_capacity;
+    struct TopologyNode** uppers;
+    guint upper_count;
+    guint upper_capacity;
+    guint64 visit;            // traversal epoch
+    guint depth;
+} TopologyNode;
+
+struct BlockTopology {
+    char class_path[PATH_MAX];    // <sysfs>/class/block
+    pthread_mutex_t lock;
+    TopologyNode** by_name;
+    TopologyNode** by_dev;
+    size_t bucket_count;
+    size_t node_count;
+    guint64 generation;
+    guint64 epoch;
+};
+
+static const char* const kind_names[] = {
+    "disk", "partition", "dm", "lvm", "crypt", "multipath", "md", "loop", "virtual",
+};
+
+static uint32_t hash_name(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t hash_dev(dev_t dev) {
+    uint64_t value = (uint64_t)dev * 0x9E3779B97F4A7C15ull;
+    return (uint32_t)(value >> 32);
+}
+
+// Index maintenance (called with the lock held)
+
+static TopologyNode* find_by_name(BlockTopology* topology, const char* name) {
+    size_t slot = hash_name(name) & (topology->bucket_count - 1);
+    for (TopologyNode* node = topology->by_name[slot]; node; node = node->next_by_name) {
+        if (strcmp(node->name, name) == 0) return node;
+    }
+    return NULL;
+}
+
+static TopologyNode* find_by_dev(BlockTopology* topology, dev_t dev) {
+    size_t slot = hash_dev(dev) & (topology->bucket_count - 1);
+    for (TopologyNode* node = topology->by_dev[slot]; node; node = node->next_by_dev) {
+        if (node->dev == dev) return node;
+    }
+    return NULL;
+}
+
+static void insert_indexes(BlockTopology* topology, TopologyNode* node) {
+    size_t name_slot = hash_name(node->name) & (topology->bucket_count - 1);
+    node->next_by_name = topology->by_name[name_slot];
+    topology->by_name[name_slot] = node;
+
+    size_t dev_slot = hash_dev(node->dev) & (topology->bucket_count - 1);
+    node->next_by_dev = topology->by_dev[dev_slot];
+    topology->by_dev[dev_slot] = node;
+}
+
+static void grow_buckets(BlockTopology* topology) {
+    TopologyNode** old_names = topology->by_name;
+    size_t old_count = topology->bucket_count;
+
+    topology->bucket_count *= 2;
+    topology->by_name = g_new0(TopologyNode*, topology->bucket_count);
+    g_free(topology->by_dev);
+    topology->by_dev = g_new0(TopologyNode*, topology->bucket_count);
+
+    for (size_t i = 0; i < old_count; i++) {
+        TopologyNode* node = old_names[i];
+        while (node) {
+            TopologyNode* next = node->next_by_name;
+            insert_indexes(topology, node);
+            node = next;
+        }
+    }
+    g_free(old_names);
+}
+
+static void remove_indexes(BlockTopology* topology, TopologyNode* node) {
+    size_t name_slot = hash_name(node->name) & (topology->bucket_count - 1);
+    for (TopologyNode** link = &topology->by_name[name_slot]; *link; link = &(*link)->next_by_name) {
+        if (*link == node) {
+            *link = node->next_by_name;
+            break;
+        }
+    }
+    size_t dev_slot = hash_dev(node->dev) & (topology->bucket_count - 1);
+    for (TopologyNode** link = &topology->by_dev[dev_slot]; *link; link = &(*link)->next_by_dev) {
+        if (*link == node) {
+            *link = node->next_by_dev;
+            break;
+        }
+    }
+}
+
+// Edges (called with the lock held)
+
+static void list_add(TopologyNode*** list, guint* count, guint* capacity, TopologyNode* node) {
+    for (guint i = 0; i < *count; i++) {
+        if ((*list)[i] == node) return;
+    }
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 4;
+        *list = g_realloc(*list, *capacity * sizeof(TopologyNode*));
+    }
+    (*list)[(*count)++] = node;
+}
+
+static void list_remove(TopologyNode** list, guint* count, TopologyNode* node) {
+    for (guint i = 0; i < *count; i++) {
+        if (list[i] == node) {
+            list[i] = list[--*count];
+            return;
+        }
+    }
+}
+
+static void add_edge(TopologyNode* lower, TopologyNode* upper) {
+    if (lower == upper) return;
+    list_add(&upper->lowers, &upper->lower_count, &upper->lower_capacity, lower);
+    list_add(&lower->uppers, &lower->upper_count, &lower->upper_capacity, upper);
+}
+
+static void clear_lowers(TopologyNode* node) {
+    for (guint i = 0; i < node->lower_count; i++) {
+        TopologyNode* lower = node->lowers[i];
+        list_remove(lower->uppers, &lower->upper_count, node);
+    }
+    node->lower_count = 0;
+}
+
+static void clear_uppers(TopologyNode* node) {
+    for (guint i = 0; i < node->upper_count; i++) {
+        TopologyNode* upper = node->uppers[i];
+        list_remove(upper->lowers, &upper->lower_count, node);
+    }
+    node->upper_count = 0;
+}
+
+static void free_node(TopologyNode* node) {
+    g_free(node->lowers);
+    g_free(node->uppers);
+    g_free(node);
+}
+
+// sysfs
+
+static gssize read_attr(int dirfd, const char* attr, char* buffer, size_t size) {
+    int fd = openat(dirfd, attr, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buffer, size - 1);
+    close(fd);
+    if (n < 0) return -1;
+    while (n > 0 && (buffer[n - 1] == '\n' || buffer[n - 1] == ' ')) n--;
+    buffer[n] = '\0';
+    return n;
+}
+
+static TopologyKind classify(int dirfd, const char* name, char* label, size_t label_size) {
+    char value[128];
+    label[0] = '\0';
+
+    if (faccessat(dirfd, "partition", F_OK, 0) == 0) return TOPOLOGY_PARTITION;
+
+    if (read_attr(dirfd, "dm/uuid", value, sizeof(value)) >= 0) {
+        char dm_name[128];
+        if (read_attr(dirfd, "dm/name", dm_name, sizeof(dm_name)) >= 0) {
+            g_strlcpy(label, dm_name, label_size);
+        }
+        // The owning tool prefixes the uuid: "LVM-", "CRYPT-LUKS2-", "mpath-"
+        if (strncmp(value, "LVM-", 4) == 0) return TOPOLOGY_LVM;
+        if (strncmp(value, "CRYPT-", 6) == 0) return TOPOLOGY_CRYPT;
+        if (strncmp(value, "mpath-", 6) == 0) return TOPOLOGY_MULTIPATH;
+        return TOPOLOGY_DM;
+    }
+
+    if (read_attr(dirfd, "md/level", value, sizeof(value)) >= 0) {
+        g_strlcpy(label, value, label_size);
+        return TOPOLOGY_MD;
+    }
+
+    if (strncmp(name, "loop", 4) == 0) {
+        if (read_attr(dirfd, "loop/backing_file", value, sizeof(value)) >= 0) {
+            g_strlcpy(label, value, label_size);
+        }
+        return TOPOLOGY_LOOP;
+    }
+    if (strncmp(name, "ram", 3) == 0 || strncmp(name, "zram", 4) == 0) return TOPOLOGY_VIRTUAL;
+    return TOPOLOGY_DISK;
+}
+
+// Reads a node's attributes from sysfs into @node. Returns FALSE if the
+// device is gone.
+static gboolean load_node(BlockTopology* topology, TopologyNode* node) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", topology->class_path, node->name);
+    int dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) return FALSE;
+
+    char value[64];
+    uint64_t major = 0, minor = 0, sectors = 0;
+    const char* end;
+    if (read_attr(dirfd, "dev", value, sizeof(value)) >= 0 &&
+        sysfs_parse_u64(value, &end, &major) && *end == ':') {
+        sysfs_parse_u64(end + 1, NULL, &minor);
+    }
+    node->dev = makedev((unsigned)major, (unsigned)minor);
+    if (read_attr(dirfd, "size", value, sizeof(value)) >= 0 &&
+        sysfs_parse_u64(value, NULL, &sectors)) {
+        node->size_bytes = sectors * 512;
+    }
+    node->kind = classify(dirfd, node->name, node->label, sizeof(node->label));
+
+    if (node->kind == TOPOLOGY_PARTITION) {
+        // The class entry links to .../block/<disk>/<partition>
+        char target[PATH_MAX];
+        ssize_t n = readlink(path, target, sizeof(target) - 1);
+        if (n > 0) {
+            target[n] = '\0';
+            char* slash = strrchr(target, '/');
+            if (slash) {
+                *slash = '\0';
+                const char* parent = strrchr(target, '/');
+                g_strlcpy(node->label, parent ? parent + 1 : target, sizeof(node->label));
+            }
+        }
+    }
+
+    close(dirfd);
+    return TRUE;
+}
+
+// Applies every edge sysfs reports for @node; neighbours that are not in the
+// graph yet are linked when their own entry is loaded
+static void link_node(BlockTopology* topology, TopologyNode* node) {
+    if (node->kind == TOPOLOGY_PARTITION) {
+        TopologyNode* parent = find_by_name(topology, node->label);
+        if (parent) add_edge(parent, node);
+    }
+
+    static const char* const dirs[] = {"slaves", "holders"};
+    for (int d = 0; d < 2; d++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s/%s", topology->class_path, node->name, dirs[d]);
+        DIR* dir = opendir(path);
+        if (!dir) continue;
+
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+            TopologyNode* other = find_by_name(topology, entry->d_name);
+            if (!other) continue;
+            if (d == 0) add_edge(other, node);
+            else add_edge(node, other);
+        }
+        closedir(dir);
+    }
+
+    // Partitions already in the graph when their disk is (re)loaded are
+    // subdirectories of the disk's entry
+    if (node->kind != TOPOLOGY_PARTITION && node->upper_count == 0) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", topology->class_path, node->name);
+        DIR* dir = opendir(path);
+        if (!dir) return;
+
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strncmp(entry->d_name, node->name, strlen(node->name)) != 0) continue;
+            TopologyNode* child = find_by_name(topology, entry->d_name);
+            if (child && child->kind == TOPOLOGY_PARTITION) add_edge(node, child);
+        }
+        closedir(dir);
+    }
+}
+
+static TopologyNode* add_node(BlockTopology* topology, const char* name) {
+    if (strlen(name) >= TOPOLOGY_NAME_MAX) return NULL;
+
+    TopologyNode* node = g_new0(TopologyNode, 1);
+    g_strlcpy(node->name, name, sizeof(node->name));
+    if (!load_node(topology, node)) {
+        free_node(node);
+        return NULL;
+    }
+
+    if (topology->node_count + 1 > topology->bucket_count) grow_buckets(topology);
+    insert_indexes(topology, node);
+    topology->node_count++;
+    return node;
+}
+
+static void remove_node(BlockTopology* topology, TopologyNode* node) {
+    clear_lowers(node);
+    clear_uppers(node);
+    remove_indexes(topology, node);
+    topology->node_count--;
+    free_node(node);
+}
+
+static void clear_all(BlockTopology* topology) {
+    for (size_t i = 0; i < topology->bucket_count; i++) {
+        TopologyNode* node = topology->by_name[i];
+        while (node) {
+            TopologyNode* next = node->next_by_name;
+            free_node(node);
+            node = next;
+        }
+        topology->by_name[i] = NULL;
+        topology->by_dev[i] = NULL;
+    }
+    topology->node_count = 0;
+}
+
+static void rescan_locked(BlockTopology* topology) {
+    clear_all(topology);
+
+    DIR* dir = opendir(topology->class_path);
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+            add_node(topology, entry->d_name);
+        }
+        closedir(dir);
+    }
+
+    // Edges once every endpoint exists
+    for (size_t i = 0; i < topology->bucket_count; i++) {
+        for (TopologyNode* node = topology->by_name[i]; node; node = node->next_by_name) {
+            link_node(topology, node);
+        }
+    }
+    topology->generation++;
+}
+
+BlockTopology* block_topology_new(const char* sysfs_root) {
+    BlockTopology* topology = g_new0(BlockTopology, 1);
+    snprintf(topology->class_path, sizeof(topology->class_path), "%s/class/block",
+             sysfs_root ? sysfs_root : "/sys");
+    topology->bucket_count = TOPOLOGY_INITIAL_BUCKETS;
+    topology->by_name = g_new0(TopologyNode*, topology->bucket_count);
+    topology->by_dev = g_new0(TopologyNode*, topology->bucket_count);
+    pthread_mutex_init(&topology->lock, NULL);
+    rescan_locked(topology);
+    return topology;
+}
+
+void block_topology_free(BlockTopology* topology) {
+    if (!topology) return;
+    clear_all(topology);
+    g_free(topology->by_name);
+    g_free(topology->by_dev);
+    pthread_mutex_destroy(&topology->lock);
+    g_free(topology);
+}
+
+void block_topology_rescan(BlockTopology* topology) {
+    pthread_mutex_lock(&topology->lock);
+    rescan_locked(topology);
+    pthread_mutex_unlock(&topology->lock);
+}
+
+void block_topology_apply_uevent(const Uevent* event, void* user_data) {
+    BlockTopology* topology = user_data;
+
+    if (!event || strcmp(event->action, "move") == 0) {
+        block_topology_rescan(topology);
+        return;
+    }
+    if (strcmp(event->subsystem, "block") != 0 || event->devname[0] == '\0') return;
+
+    pthread_mutex_lock(&topology->lock);
+    TopologyNode* node = find_by_name(topology, event->devname);
+
+    if (strcmp(event->action, "remove") == 0) {
+        if (node) {
+            remove_node(topology, node);
+            topology->generation++;
+        }
+    } else if (strcmp(event->action, "add") == 0 || strcmp(event->action, "change") == 0) {
+        if (node) {
+            // A dm table load or md assembly arrives as "change"; the
+            // device number stays but the slaves and kind may not
+            remove_indexes(topology, node);
+            topology->node_count--;
+            clear_lowers(node);
+            if (!load_node(topology, node)) {
+                clear_uppers(node);
+                free_node(node);
+                node = NULL;
+            } else {
+                if (topology->node_count + 1 > topology->bucket_count) grow_buckets(topology);
+                insert_indexes(topology, node);
+                topology->node_count++;
+            }
+        } else {
+            node = add_node(topology, event->devname);
+        }
+
+        if (node) link_node(topology, node);
+        topology->generation++;
+    }
+    pthread_mutex_unlock(&topology->lock);
+}
+
+guint64 block_topology_generation(BlockTopology* topology) {
+    pthread_mutex_lock(&topology->lock);
+    guint64 generation = topology->generation;
+    pthread_mutex_unlock(&topology->lock);
+    return generation;
+}
+
+// Queries
+
+static FlValue* names_to_fl_value(TopologyNode** nodes, guint count) {
+    FlValue* list = fl_value_new_list();
+    for (guint i = 0; i < count; i++) {
+        fl_value_append_take(list, fl_value_new_string(nodes[i]->name));
+    }
+    return list;
+}
+
+FlValue* block_topology_to_fl_value(BlockTopology* topology) {
+    FlValue* nodes = fl_value_new_list();
+
+    pthread_mutex_lock(&topology->lock);
+    for (size_t i = 0; i < topology->bucket_count; i++) {
+        for (TopologyNode* node = topology->by_name[i]; node; node = node->next_by_name) {
+            char dev[32];
+            snprintf(dev, sizeof(dev), "%u:%u", major(node->dev), minor(node->dev));
+
+            FlValue* map = fl_value_new_map();
+            fl_value_set_string_take(map, "name", fl_value_new_string(node->name));
+            fl_value_set_string_take(map, "kind", fl_value_new_string(kind_names[node->kind]));
+            fl_value_set_string_take(map, "dev", fl_value_new_string(dev));
+            fl_value_set_string_take(map, "sizeBytes", fl_value_new_int((int64_t)node->size_bytes));
+            fl_value_set_string_take(map, "label", fl_value_new_string(node->label));
+            fl_value_set_string_take(map, "lowers", names_to_fl_value(node->lowers, node->lower_count));
+            fl_value_set_string_take(map, "uppers", names_to_fl_value(node->uppers, node->upper_count));
+            fl_value_append_take(nodes, map);
+        }
+    }
+    guint64 generation = topology->generation;
+    pthread_mutex_unlock(&topology->lock);
+
+    FlValue* result = fl_value_new_map();
+    fl_value_set_string_take(result, "generation", fl_value_new_int((int64_t)generation));
+    fl_value_set_string_take(result, "nodes", nodes);
+    return result;
+}
+
+// Called with the lock held
+static TopologyNode* resolve_device(BlockTopology* topology, const char* device) {
+    if (device[0] != '/') return find_by_name(topology, device);
+
+    struct stat st;
+    if (stat(device, &st) < 0 || !S_ISBLK(st.st_mode)) return NULL;
+    return find_by_dev(topology, st.st_rdev);
+}
+
+FlValue* block_topology_walk(BlockTopology* topology,
+                             const char* device,
+                             TopologyDirection direction,
+                             gboolean transitive,
+                             gboolean leaves_only) {
+    pthread_mutex_lock(&topology->lock);
+    TopologyNode* start = resolve_device(topology, device);
+    if (!start) {
+        pthread_mutex_unlock(&topology->lock);
+        return NULL;
+    }
+
+    // Breadth-first; nodes are marked with a fresh epoch instead of a
+    // visited set, so the walk costs only the edges it follows
+    guint64 epoch = ++topology->epoch;
+    start->visit = epoch;
+    start->depth = 0;
+
+    TopologyNode** queue = g_new(TopologyNode*, topology->node_count + 1);
+    size_t head = 0, tail = 0;
+    queue[tail++] = start;
+
+    FlValue* result = fl_value_new_list();
+    while (head < tail) {
+        TopologyNode* node = queue[head++];
+        TopologyNode** next = direction == TOPOLOGY_DOWN ? node->lowers : node->uppers;
+        guint next_count = direction == TOPOLOGY_DOWN ? node->lower_count : node->upper_count;
+
+        if (node != start && (!leaves_only || next_count == 0)) {
+            FlValue* map = fl_value_new_map();
+            fl_value_set_string_take(map, "name", fl_value_new_string(node->name));
+            fl_value_set_string_take(map, "kind", fl_value_new_string(kind_names[node->kind]));
+            fl_value_set_string_take(map, "label", fl_value_new_string(node->label));
+            fl_value_set_string_take(map, "depth", fl_value_new_int(node->depth));
+            fl_value_append_take(result, map);
+        }
+        if (node != start && !transitive) continue;
+
+        for (guint i = 0; i < next_count; i++) {
+            TopologyNode* neighbour = next[i];
+            if (neighbour->visit == epoch) continue;
+            neighbour->visit = epoch;
+            neighbour->depth = node->depth + 1;
+            queue[tail++] = neighbour;
+        }
+    }
+
+    g_free(queue);
+    pthread_mutex_unlock(&topology->lock);
+    return result;
+}
+
+gboolean block_topology_mount_source(BlockTopology* topology,
+                                     const char* mount_point,
+                                     char* name,
+                                     size_t size) {
+    FILE* file = fopen("/proc/self/mountinfo", "re");
+    if (!file) return FALSE;
+
+    gboolean found = FALSE;
+    char* line = NULL;
+    size_t line_size = 0;
+    while (!found && getline(&line, &line_size, file) > 0) {
+        // id parent maj:min root mountpoint options [optional...] - fstype source super
+        char* save = NULL;
+        strtok_r(line, " ", &save);
+        strtok_r(NULL, " ", &save);
+        char* devno = strtok_r(NULL, " ", &save);
+        strtok_r(NULL, " ", &save);
+        char* point = strtok_r(NULL, " ", &save);
+        if (!devno || !point || strcmp(point, mount_point) != 0) continue;
+
+        char* token;
+        while ((token = strtok_r(NULL, " ", &save)) != NULL && strcmp(token, "-") != 0) {
+        }
+        strtok_r(NULL, " ", &save);
+        char* source = strtok_r(NULL, " ", &save);
+
+        unsigned major_number, minor_number;
+        pthread_mutex_lock(&topology->lock);
+        TopologyNode* node = NULL;
+        if (sscanf(devno, "%u:%u", &major_number, &minor_number) == 2) {
+            node = find_by_dev(topology, makedev(major_number, minor_number));
+        }
+        // btrfs reports an anonymous device number; the source names the node
+        if (!node && source && source[0] == '/') node = resolve_device(topology, source);
+        if (node) {
+            g_strlcpy(name, node->name, size);
+            found = TRUE;
+        }
+        pthread_mutex_unlock(&topology->lock);
+    }
+
+    free(line);
+    fclose(file);
+    return found;
+}
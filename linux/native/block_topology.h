@@ -0,0 +1,104 @@
+#ifndef BLOCK_TOPOLOGY_H
+#define BLOCK_TOPOLOGY_H
+
+#include <flutter_linux/flutter_linux.h>
+#include "uevent_monitor.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Block device dependency graph.
+ *
+ * Every block device is a node; an edge runs from a lower device to the
+ * device stacked on it: disk -> partition, and slave -> holder for dm
+ * (LVM, dm-crypt, multipath) and md arrays. Each node keeps both adjacency
+ * lists, so direct neighbours cost O(degree) and transitive walks only touch
+ * the affected subgraph. The graph is built once from sysfs and then kept
+ * current from uevents, re-reading only the device an event names.
+ */
+
+typedef enum {
+    TOPOLOGY_DISK = 0,
+    TOPOLOGY_PARTITION,
+    TOPOLOGY_DM,              // device-mapper target without a known owner
+    TOPOLOGY_LVM,
+    TOPOLOGY_CRYPT,
+    TOPOLOGY_MULTIPATH,
+    TOPOLOGY_MD,
+    TOPOLOGY_LOOP,
+    TOPOLOGY_VIRTUAL,         // ram, zram and other memory-backed devices
+} TopologyKind;
+
+typedef enum {
+    TOPOLOGY_DOWN = 0,        // towards the devices a node is built on
+    TOPOLOGY_UP = 1,          // towards the devices built on a node
+} TopologyDirection;
+
+typedef struct BlockTopology BlockTopology;
+
+/**
+ * block_topology_new:
+ * @sysfs_root: (nullable): sysfs mount point, NULL for "/sys"
+ *
+ * Returns: (transfer full): a graph populated from @sysfs_root/class/block
+ */
+BlockTopology* block_topology_new(const char* sysfs_root);
+void block_topology_free(BlockTopology* topology);
+
+// Rebuilds the whole graph from sysfs
+void block_topology_rescan(BlockTopology* topology);
+
+/**
+ * block_topology_apply_uevent:
+ * @event: (nullable): a block uevent, or NULL after lost events
+ *
+ * Adds, refreshes or removes the node the event names together with its
+ * edges. NULL triggers a full rescan. Usable directly as a UeventCallback.
+ */
+void block_topology_apply_uevent(const Uevent* event, void* topology);
+
+// Incremented on every change; lets callers skip re-rendering
+guint64 block_topology_generation(BlockTopology* topology);
+
+/**
+ * block_topology_to_fl_value:
+ *
+ * Returns: (transfer full): a map with "generation" and "nodes", one map per
+ * device holding "name", "kind", "dev", "sizeBytes", "label", "lowers" and
+ * "uppers"
+ */
+FlValue* block_topology_to_fl_value(BlockTopology* topology);
+
+/**
+ * block_topology_walk:
+ * @device: kernel name ("sda2", "dm-0") or a node path ("/dev/mapper/x")
+ * @transitive: follow edges past the direct neighbours
+ * @leaves_only: only report nodes with no further edges in @direction
+ *
+ * Answers "which physical disks back this volume" (DOWN, leaves only) and
+ * "what breaks if this disk goes" (UP, transitive).
+ *
+ * Returns: (transfer full) (nullable): a list of {name, kind, label, depth}
+ * maps in breadth-first order, or NULL when @device is unknown
+ */
+FlValue* block_topology_walk(BlockTopology* topology,
+                             const char* device,
+                             TopologyDirection direction,
+                             gboolean transitive,
+                             gboolean leaves_only);
+
+/**
+ * block_topology_mount_source:
+ * @mount_point: an exact mount point from /proc/self/mountinfo
+ * @name: (out caller-allocates): receives the kernel name of its device
+ *
+ * Returns: TRUE if @mount_point is mounted from a known block device
+ */
+gboolean block_topology_mount_source(BlockTopology* topology,
+                                     const char* mount_point,
+                                     char* name,
+                                     size_t size);
+
+G_END_DECLS
+
+#endif // BLOCK_TOPOLOGY_H
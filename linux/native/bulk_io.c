@@ -0,0 +1,501 @@
+#include "bulk_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+// Attempts per request before the write is abandoned
+#define BULK_IO_MAX_ATTEMPTS 3
+// Back-off between attempts, multiplied by the attempt number
+#define BULK_IO_RETRY_DELAY_US 100000
+// How long a parked worker waits before re-checking the queue depth
+#define BULK_IO_PARK_US 5000
+// Control loop tick when no throttle is attached
+#define BULK_IO_PROGRESS_INTERVAL_MS 500
+// How often the control loop checks whether the workers have finished
+#define BULK_IO_POLL_US 5000
+
+typedef struct {
+    int fd;
+    const BulkWriteOptions* options;
+    const DeviceBackend* backend;
+    size_t chunk_size;
+    uint64_t end;
+
+    uint64_t next_offset;     // atomic
+    uint64_t bytes_written;   // atomic
+    uint64_t errors;          // atomic
+    gint active_workers;      // atomic
+    gint failed;              // atomic
+    int failed_errno;
+    uint64_t seed;            // random pattern: chunk i is filled from chunk_seed(i)
+
+    // Read-behind verification; the fronts are guarded by verify_lock
+    uint64_t total_chunks;
+    guint window;             // completion slots: verify lag + workers + 1
+    uint8_t* written;         // per slot: the chunk in it has been written
+    uint64_t write_front;     // chunks [0, write_front) are all written
+    uint64_t verify_front;    // chunks [0, verify_front) have been read back
+    gboolean write_through;   // O_DSYNC writes, no flush barrier needed
+    uint64_t bytes_verified;  // atomic
+    uint64_t mismatches;
+    uint64_t first_mismatch;
+    pthread_mutex_t verify_lock;
+    pthread_cond_t verify_cond;
+} BulkJob;
+
+typedef struct {
+    BulkJob* job;
+    guint index;
+} BulkWorker;
+
+static gint64 monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_us(gint64 us) {
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+static bool is_cancelled(const BulkJob* job) {
+    return (job->options->cancel && *job->options->cancel) ||
+           __atomic_load_n(&job->failed, __ATOMIC_RELAXED);
+}
+
+void bulk_io_default_options(BulkWriteOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->chunk_size = BULK_IO_DEFAULT_CHUNK_SIZE;
+    options->pattern = BULK_PATTERN_ZEROS;
+    options->max_workers = 4;
+    options->verify_lag = BULK_IO_DEFAULT_VERIFY_LAG;
+    options->verify_fd = -1;
+}
+
+// Random content depends only on the chunk, so the verifier can regenerate it
+static uint64_t chunk_seed(const BulkJob* job, uint64_t chunk) {
+    return (job->seed ^ ((chunk + 1) * 0x9E3779B97F4A7C15ull)) | 1;
+}
+
+static void fill_chunk(const BulkJob* job, uint8_t* buffer, size_t length, uint64_t chunk) {
+    uint64_t seed = chunk_seed(job, chunk);
+    bulk_io_fill_pattern(buffer, length, job->options->pattern, &seed);
+}
+
+// Waits on the verify condition for at most one park interval, so waiters
+// notice cancellation. Called with verify_lock held.
+static void verify_wait(BulkJob* job) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += BULK_IO_PARK_US * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&job->verify_cond, &job->verify_lock, &deadline);
+}
+
+gboolean bulk_io_device_size(int fd, uint64_t* size) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) return FALSE;
+
+    if (S_ISBLK(st.st_mode)) {
+        return ioctl(fd, BLKGETSIZE64, size) == 0;
+    }
+    *size = (uint64_t)st.st_size;
+    return TRUE;
+}
+
+void bulk_io_fill_pattern(uint8_t* buffer, size_t size, BulkPattern pattern, uint64_t* seed) {
+    switch (pattern) {
+        case BULK_PATTERN_ZEROS:
+            memset(buffer, 0x00, size);
+            break;
+        case BULK_PATTERN_ONES:
+            memset(buffer, 0xFF, size);
+            break;
+        case BULK_PATTERN_RANDOM: {
+            // xorshift64*: not cryptographic, but incompressible and fast
+            // enough to keep up with NVMe writes
+            uint64_t x = *seed ? *seed : 0x9E3779B97F4A7C15ull;
+            size_t i = 0;
+            for (; i + 8 <= size; i += 8) {
+                x ^= x >> 12;
+                x ^= x << 25;
+                x ^= x >> 27;
+                uint64_t v = x * 0x2545F4914F6CDD1Dull;
+                memcpy(buffer + i, &v, 8);
+            }
+            for (; i < size; i++) {
+                x ^= x >> 12;
+                x ^= x << 25;
+                x ^= x >> 27;
+                buffer[i] = (uint8_t)((x * 0x2545F4914F6CDD1Dull) >> 56);
+            }
+            *seed = x;
+            break;
+        }
+    }
+}
+
+// pread the whole buffer, retrying short reads and EINTR
+static ssize_t pread_full(const DeviceBackend* backend, int fd,
+                          uint8_t* buffer, size_t size, uint64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = backend->pread(fd, buffer + done, size - done, offset + done, backend->ctx);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) {
+            errno = EIO;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+// pwrite the whole buffer, retrying short writes and EINTR
+static ssize_t pwrite_full(const DeviceBackend* backend, int fd,
+                           const uint8_t* buffer, size_t size, uint64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = backend->pwrite(fd, buffer + done, size - done, offset + done, backend->ctx);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) {
+            errno = ENOSPC;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+static void* worker_func(void* data) {
+    BulkWorker* worker = data;
+    BulkJob* job = worker->job;
+    const BulkWriteOptions* options = job->options;
+    IoThrottle* throttle = options->throttle;
+
+    numa_placement_bind_thread(options->placement, options->placement_stats);
+    uint8_t* buffer = numa_placement_alloc(options->placement, job->chunk_size,
+                                           options->placement_stats);
+    if (!buffer) {
+        job->failed_errno = ENOMEM;
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        goto out;
+    }
+
+    if (options->pattern != BULK_PATTERN_RANDOM) {
+        fill_chunk(job, buffer, job->chunk_size, 0);
+    }
+
+    while (!is_cancelled(job)) {
+        // Workers beyond the current queue depth stay parked
+        if (throttle && worker->index >= io_throttle_queue_depth(throttle)) {
+            if (__atomic_load_n(&job->next_offset, __ATOMIC_RELAXED) >= job->end) break;
+            sleep_us(BULK_IO_PARK_US);
+            continue;
+        }
+
+        uint64_t offset = __atomic_fetch_add(&job->next_offset, job->chunk_size, __ATOMIC_RELAXED);
+        if (offset >= job->end) break;
+        size_t length = job->end - offset < job->chunk_size ? (size_t)(job->end - offset) : job->chunk_size;
+        uint64_t chunk = (offset - options->offset) / job->chunk_size;
+
+        // Stay within the window the verifier has not read back yet
+        if (options->verify) {
+            pthread_mutex_lock(&job->verify_lock);
+            while (chunk >= job->verify_front + job->window && !is_cancelled(job)) {
+                verify_wait(job);
+            }
+            pthread_mutex_unlock(&job->verify_lock);
+            if (is_cancelled(job)) break;
+        }
+
+        if (options->pattern == BULK_PATTERN_RANDOM) {
+            fill_chunk(job, buffer, length, chunk);
+        }
+
+        if (throttle && !io_throttle_acquire(throttle, length, options->cancel)) break;
+
+        bool written = false;
+        for (int attempt = 1; attempt <= BULK_IO_MAX_ATTEMPTS && !written; attempt++) {
+            gint64 start = monotonic_us();
+            written = pwrite_full(job->backend, job->fd, buffer, length, offset) >= 0;
+            int write_errno = errno;
+            gint64 latency = monotonic_us() - start;
+
+            if (throttle) io_throttle_record_io(throttle, length, latency, !written);
+            if (written) break;
+
+            __atomic_fetch_add(&job->errors, 1, __ATOMIC_RELAXED);
+            if (attempt == BULK_IO_MAX_ATTEMPTS || is_cancelled(job)) {
+                job->failed_errno = write_errno;
+                __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+                break;
+            }
+            sleep_us((gint64)BULK_IO_RETRY_DELAY_US * attempt);
+        }
+
+        if (written) {
+            __atomic_fetch_add(&job->bytes_written, length, __ATOMIC_RELAXED);
+            if (options->verify) {
+                pthread_mutex_lock(&job->verify_lock);
+                job->written[chunk % job->window] = 1;
+                while (job->write_front < job->total_chunks &&
+                       job->written[job->write_front % job->window]) {
+                    job->written[job->write_front % job->window] = 0;
+                    job->write_front++;
+                }
+                pthread_cond_broadcast(&job->verify_cond);
+                pthread_mutex_unlock(&job->verify_lock);
+            }
+        }
+    }
+
+out:
+    numa_placement_free(buffer, job->chunk_size);
+    __atomic_fetch_sub(&job->active_workers, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void fail_verify(BulkJob* job, int error_number) {
+    job->failed_errno = error_number;
+    __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+}
+
+// Reads chunk N back once chunk N + lag is written, trailing the writers
+static void* verify_func(void* data) {
+    BulkJob* job = data;
+    const BulkWriteOptions* options = job->options;
+    const DeviceBackend* backend = job->backend;
+    int read_fd = options->verify_fd >= 0 ? options->verify_fd : job->fd;
+    uint64_t durable_front = 0;   // chunks [0, durable_front) have been flushed
+
+    numa_placement_bind_thread(options->placement, options->placement_stats);
+    uint8_t* buffer = numa_placement_alloc(options->placement, job->chunk_size,
+                                           options->placement_stats);
+    uint8_t* expected = numa_placement_alloc(options->placement, job->chunk_size,
+                                             options->placement_stats);
+    if (!buffer || !expected) {
+        fail_verify(job, ENOMEM);
+        goto out;
+    }
+    if (options->pattern != BULK_PATTERN_RANDOM) {
+        fill_chunk(job, expected, job->chunk_size, 0);
+    }
+
+    for (uint64_t chunk = 0; chunk < job->total_chunks; chunk++) {
+        pthread_mutex_lock(&job->verify_lock);
+        while (job->write_front <= chunk + options->verify_lag &&
+               job->write_front < job->total_chunks && !is_cancelled(job)) {
+            verify_wait(job);
+        }
+        uint64_t write_front = job->write_front;
+        pthread_mutex_unlock(&job->verify_lock);
+        if (write_front <= chunk) break;  // cancelled before it was written
+
+        // One barrier makes everything written so far durable
+        if (!job->write_through && durable_front <= chunk) {
+            if (backend->sync(job->fd, backend->ctx) < 0) {
+                fail_verify(job, errno);
+                break;
+            }
+            durable_front = write_front;
+        }
+
+        uint64_t offset = options->offset + chunk * job->chunk_size;
+        size_t length = job->end - offset < job->chunk_size ? (size_t)(job->end - offset) : job->chunk_size;
+        bool read = false;
+        for (int attempt = 1; attempt <= BULK_IO_MAX_ATTEMPTS && !read && !is_cancelled(job); attempt++) {
+            read = pread_full(backend, read_fd, buffer, length, offset) >= 0;
+            if (!read) {
+                __atomic_fetch_add(&job->errors, 1, __ATOMIC_RELAXED);
+                if (attempt < BULK_IO_MAX_ATTEMPTS) sleep_us((gint64)BULK_IO_RETRY_DELAY_US * attempt);
+            }
+        }
+        if (options->pattern == BULK_PATTERN_RANDOM) {
+            fill_chunk(job, expected, length, chunk);
+        }
+
+        pthread_mutex_lock(&job->verify_lock);
+        if (read && memcmp(buffer, expected, length) == 0) {
+            __atomic_fetch_add(&job->bytes_verified, length, __ATOMIC_RELAXED);
+        } else if (!is_cancelled(job)) {
+            if (job->mismatches++ == 0) job->first_mismatch = offset;
+        }
+        job->verify_front = chunk + 1;
+        pthread_cond_broadcast(&job->verify_cond);
+        pthread_mutex_unlock(&job->verify_lock);
+    }
+
+out:
+    numa_placement_free(buffer, job->chunk_size);
+    numa_placement_free(expected, job->chunk_size);
+    __atomic_fetch_sub(&job->active_workers, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+gboolean bulk_io_write(int fd,
+                       const BulkWriteOptions* options,
+                       BulkWriteResult* result,
+                       GError** error) {
+    if (result) memset(result, 0, sizeof(*result));
+    BulkJob job;
+    memset(&job, 0, sizeof(job));
+    job.fd = fd;
+    job.options = options;
+    job.backend = options->backend ? options->backend : device_backend_linux();
+    job.chunk_size = options->chunk_size ? options->chunk_size : BULK_IO_DEFAULT_CHUNK_SIZE;
+    job.next_offset = options->offset;
+    job.end = options->offset + options->length;
+    job.seed = 0x9E3779B97F4A7C15ull ^ (uint64_t)monotonic_us();
+
+    guint worker_count = options->max_workers ? options->max_workers : 1;
+    if (worker_count > BULK_IO_MAX_WORKERS) worker_count = BULK_IO_MAX_WORKERS;
+
+    pthread_t threads[BULK_IO_MAX_WORKERS];
+    BulkWorker workers[BULK_IO_MAX_WORKERS];
+    pthread_t verify_thread;
+    gboolean verifying = FALSE;
+    guint started = 0;
+
+    if (options->verify) {
+        job.total_chunks = (options->length + job.chunk_size - 1) / job.chunk_size;
+        job.window = options->verify_lag + worker_count + 1;
+        job.written = g_malloc0(job.window);
+        if (job.backend == device_backend_linux()) {
+            int flags = fcntl(fd, F_GETFL);
+            job.write_through = flags >= 0 && (flags & O_DSYNC) == O_DSYNC;
+        }
+        pthread_mutex_init(&job.verify_lock, NULL);
+        pthread_cond_init(&job.verify_cond, NULL);
+    }
+
+    gint64 start_us = monotonic_us();
+    job.active_workers = (gint)worker_count;
+
+    for (guint i = 0; i < worker_count; i++) {
+        workers[i].job = &job;
+        workers[i].index = i;
+        if (pthread_create(&threads[i], NULL, worker_func, &workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    // Threads that failed to start never decrement the counter
+    __atomic_fetch_sub(&job.active_workers, (gint)(worker_count - started), __ATOMIC_RELAXED);
+
+    if (started > 0 && options->verify) {
+        __atomic_fetch_add(&job.active_workers, 1, __ATOMIC_RELAXED);
+        verifying = pthread_create(&verify_thread, NULL, verify_func, &job) == 0;
+        if (!verifying) {
+            __atomic_fetch_sub(&job.active_workers, 1, __ATOMIC_RELAXED);
+            fail_verify(&job, EAGAIN);
+        }
+    }
+
+    if (started == 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to start I/O workers");
+        if (options->verify) {
+            pthread_mutex_destroy(&job.verify_lock);
+            pthread_cond_destroy(&job.verify_cond);
+            g_free(job.written);
+        }
+        return FALSE;
+    }
+
+    // Control loop: feed temperature into the throttle and report progress
+    // Ticks are polled in short steps so the call returns soon after the
+    // last worker finishes. A shared throttle's window may be closed by
+    // another caller, so progress is reported on its own interval and
+    // only the throttle state waits for a window this loop evaluated.
+    gint64 tick_us = (gint64)(options->throttle ? 100 : BULK_IO_PROGRESS_INTERVAL_MS) * 1000;
+    gint64 last_progress_us = start_us;
+    gint64 next_tick_us = start_us + tick_us;
+    IoThrottleState state;
+    if (options->throttle) io_throttle_get_state(options->throttle, &state);
+    while (__atomic_load_n(&job.active_workers, __ATOMIC_ACQUIRE) > 0) {
+        sleep_us(BULK_IO_POLL_US);
+        gint64 now = monotonic_us();
+        if (now < next_tick_us) continue;
+        next_tick_us = now + tick_us;
+
+        bool report = now - last_progress_us >= (gint64)BULK_IO_PROGRESS_INTERVAL_MS * 1000;
+        if (options->throttle) {
+            if (options->temperature) {
+                io_throttle_set_temperature(options->throttle,
+                                            options->temperature(options->temperature_ctx));
+            }
+            if (io_throttle_update(options->throttle, now)) {
+                io_throttle_get_state(options->throttle, &state);
+                report = true;
+            }
+        }
+
+        if (report && options->progress) {
+            BulkProgress progress = {
+                .bytes_done = __atomic_load_n(&job.bytes_written, __ATOMIC_RELAXED),
+                .bytes_total = options->length,
+                .bytes_verified = __atomic_load_n(&job.bytes_verified, __ATOMIC_RELAXED),
+                .elapsed_us = now - start_us,
+                .throttle = options->throttle ? &state : NULL,
+            };
+            options->progress(&progress, options->user_data);
+            last_progress_us = now;
+        }
+    }
+
+    for (guint i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (verifying) {
+        pthread_join(verify_thread, NULL);
+    }
+    if (options->verify) {
+        pthread_mutex_destroy(&job.verify_lock);
+        pthread_cond_destroy(&job.verify_cond);
+        g_free(job.written);
+    }
+
+    if (result) {
+        result->bytes_written = job.bytes_written;
+        result->errors = job.errors;
+        result->bytes_verified = job.bytes_verified;
+        result->verify_mismatches = job.mismatches;
+        result->first_mismatch_offset = job.first_mismatch;
+        result->elapsed_us = monotonic_us() - start_us;
+    }
+
+    if (job.failed) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                    "Write failed: %s", strerror(job.failed_errno));
+        return FALSE;
+    }
+    if (options->cancel && *options->cancel) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Write cancelled");
+        return FALSE;
+    }
+    if (job.mismatches > 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                    "Verification failed: %llu chunks differ, first at byte %llu",
+                    (unsigned long long)job.mismatches, (unsigned long long)job.first_mismatch);
+        return FALSE;
+    }
+    return TRUE;
+}
@@ -0,0 +1,120 @@
+#ifndef BULK_IO_H
+#define BULK_IO_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdint.h>
+#include "device_backend.h"
+#include "io_throttle.h"
+#include "numa_placement.h"
+
+G_BEGIN_DECLS
+
+#define BULK_IO_DEFAULT_CHUNK_SIZE (4u * 1024 * 1024)
+#define BULK_IO_MAX_WORKERS 64
+// Chunks the read-back trails the write front by when verifying
+#define BULK_IO_DEFAULT_VERIFY_LAG 8
+
+typedef enum {
+    BULK_PATTERN_ZEROS,
+    BULK_PATTERN_ONES,
+    BULK_PATTERN_RANDOM,
+} BulkPattern;
+
+typedef struct {
+    uint64_t bytes_done;
+    uint64_t bytes_total;
+    uint64_t bytes_verified;          // read back and matched, when verifying
+    gint64 elapsed_us;
+    const IoThrottleState* throttle;  // NULL when running unthrottled
+} BulkProgress;
+
+/**
+ * BulkProgressCallback:
+ *
+ * Invoked from the calling thread after every throttle window it evaluates
+ * and at least every half second, whoever evaluates a shared throttle.
+ */
+typedef void (*BulkProgressCallback)(const BulkProgress* progress, void* user_data);
+
+typedef struct {
+    uint64_t offset;                  // byte offset of the range to write
+    uint64_t length;                  // byte length of the range to write
+    size_t chunk_size;                // bytes per request, 0 for the default
+    BulkPattern pattern;
+    guint max_workers;                // upper bound on concurrent requests
+    IoThrottle* throttle;             // optional, controls queue depth and rate
+    IoTemperatureSource temperature;  // optional, fed into the throttle
+    void* temperature_ctx;
+    BulkProgressCallback progress;
+    void* user_data;
+    const volatile gint* cancel;      // optional, non-zero aborts the write
+    const DeviceBackend* backend;     // optional, NULL writes through the kernel
+    gboolean verify;                  // read every chunk back while later ones are written
+    guint verify_lag;                 // chunks between the write front and the read-back
+    int verify_fd;                    // descriptor for the read-back (O_DIRECT), -1 for @fd
+    const NumaPlacement* placement;   // optional, pins the threads and places their buffers
+    NumaPlacementStats* placement_stats;  // optional, accumulates what placement achieved
+} BulkWriteOptions;
+
+typedef struct {
+    uint64_t bytes_written;
+    uint64_t errors;
+    uint64_t bytes_verified;
+    uint64_t verify_mismatches;       // chunks that read back differently or not at all
+    uint64_t first_mismatch_offset;   // byte offset of the first such chunk
+    gint64 elapsed_us;
+} BulkWriteResult;
+
+void bulk_io_default_options(BulkWriteOptions* options);
+
+/**
+ * bulk_io_write:
+ * @fd: open, writable device or file descriptor (from the options' backend
+ *   when one is set). Offsets and chunk size must be aligned to the logical
+ *   block size when it was opened O_DIRECT.
+ *
+ * Overwrites [offset, offset + length) with the pattern using a pool of
+ * worker threads. When a throttle is given, the number of workers issuing
+ * requests and the aggregate rate follow its decisions; the calling thread
+ * runs the control loop and reports progress.
+ *
+ * With @verify set, a reader thread follows the writers in the same sweep:
+ * once chunk N + @verify_lag has been written, chunk N is flushed (a single
+ * fdatasync covers every chunk written so far; none is needed when @fd was
+ * opened O_DSYNC, whose writes are FUA), read back through @verify_fd and
+ * compared with the pattern. Writers stall when they get more than
+ * @verify_lag + @max_workers chunks ahead of the reader, which bounds memory
+ * to two chunk buffers. Reading back through a buffered @fd only checks the
+ * page cache; pass an O_DIRECT @verify_fd to check the media.
+ *
+ * With @placement, every thread pins itself to the device's node before
+ * allocating its buffers, so they are node-local whether or not mbind is
+ * permitted.
+ *
+ * Returns: TRUE when the whole range was written (and, when verifying, read
+ *   back unchanged)
+ */
+gboolean bulk_io_write(int fd,
+                       const BulkWriteOptions* options,
+                       BulkWriteResult* result,
+                       GError** error);
+
+/**
+ * bulk_io_device_size:
+ *
+ * Size in bytes of an open block device (BLKGETSIZE64) or regular file.
+ *
+ * Returns: TRUE on success
+ */
+gboolean bulk_io_device_size(int fd, uint64_t* size);
+
+/**
+ * bulk_io_fill_pattern:
+ *
+ * Fills @buffer with @pattern. @seed advances for BULK_PATTERN_RANDOM.
+ */
+void bulk_io_fill_pattern(uint8_t* buffer, size_t size, BulkPattern pattern, uint64_t* seed);
+
+G_END_DECLS
+
+#endif // BULK_IO_H
@@ -0,0 +1,607 @@
+#define _GNU_SOURCE
+#include "busy_scan.h"
+#include "sysfs_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#define BUSY_MAX_WORKERS 8
+// Processes a worker claims at a time from the shared pid list
+#define BUSY_PID_BATCH 32
+#define BUSY_DENTS_BUFFER (32 * 1024)
+// Directory levels below /dev searched for nodes of the targets
+#define BUSY_DEV_DEPTH 3
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef struct {
+    dev_t dev;
+    guint target;
+    char name[64];
+} BusyDevice;
+
+// A path under /dev whose node is one of the targets
+typedef struct {
+    char path[128];
+    size_t length;
+    const BusyDevice* device;
+} BusyAlias;
+
+typedef struct {
+    BusyDevice* devices;      // sorted by dev
+    size_t count;
+    BusyAlias* aliases;
+    size_t alias_count;
+} BusyDeviceSet;
+
+static int compare_devices(const void* a, const void* b) {
+    dev_t left = ((const BusyDevice*)a)->dev;
+    dev_t right = ((const BusyDevice*)b)->dev;
+    return left < right ? -1 : left > right;
+}
+
+static const BusyDevice* find_device(const BusyDeviceSet* set, dev_t dev) {
+    size_t low = 0, high = set->count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (set->devices[mid].dev == dev) return &set->devices[mid];
+        if (set->devices[mid].dev < dev) low = mid + 1;
+        else high = mid;
+    }
+    return NULL;
+}
+
+static void report_add(BusyReport* report, BusyKind kind, const BusyDevice* device,
+                       const char* detail, pid_t pid, int fd) {
+    if (report->count == report->capacity) {
+        report->capacity = report->capacity ? report->capacity * 2 : 16;
+        report->entries = g_realloc(report->entries, report->capacity * sizeof(BusyEntry));
+    }
+    BusyEntry* entry = &report->entries[report->count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->kind = kind;
+    entry->target = device->target;
+    g_strlcpy(entry->device, device->name, sizeof(entry->device));
+    g_strlcpy(entry->detail, detail, sizeof(entry->detail));
+    entry->pid = pid;
+    entry->fd = fd;
+}
+
+void busy_report_clear(BusyReport* report) {
+    g_free(report->entries);
+    memset(report, 0, sizeof(*report));
+}
+
+// Targets
+
+static gboolean parse_dev(const char* text, dev_t* dev) {
+    uint64_t major, minor;
+    const char* end;
+    if (!sysfs_parse_u64(text, &end, &major) || *end != ':') return FALSE;
+    if (!sysfs_parse_u64(end + 1, NULL, &minor)) return FALSE;
+    *dev = makedev((unsigned)major, (unsigned)minor);
+    return TRUE;
+}
+
+static void add_device(GArray* devices, dev_t dev, guint target, const char* name) {
+    BusyDevice device = {.dev = dev, .target = target};
+    g_strlcpy(device.name, name, sizeof(device.name));
+    g_array_append_val(devices, device);
+}
+
+// Adds the node behind @path and, for a whole disk, all of its partitions
+static gboolean add_target(GArray* devices, const char* path, guint target, GError** error) {
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        int saved = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Cannot stat %s: %s", path, g_strerror(saved));
+        return FALSE;
+    }
+    if (!S_ISBLK(st.st_mode)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "%s is not a block device", path);
+        return FALSE;
+    }
+
+    // /sys/dev/block/M:m links to the kernel's name for the node, which also
+    // covers /dev/disk/by-id paths and renamed nodes
+    char link[64], resolved[PATH_MAX];
+    snprintf(link, sizeof(link), "/sys/dev/block/%u:%u", major(st.st_rdev), minor(st.st_rdev));
+    ssize_t n = readlink(link, resolved, sizeof(resolved) - 1);
+    if (n < 0) {
+        add_device(devices, st.st_rdev, target, path);
+        return TRUE;
+    }
+    resolved[n] = '\0';
+    const char* slash = strrchr(resolved, '/');
+    add_device(devices, st.st_rdev, target, slash ? slash + 1 : resolved);
+
+    int dirfd = open(link, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) return TRUE;
+    DIR* dir = fdopendir(dirfd);
+    if (!dir) {
+        close(dirfd);
+        return TRUE;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        char attr[NAME_MAX + 16], value[32];
+        snprintf(attr, sizeof(attr), "%s/partition", entry->d_name);
+        if (faccessat(dirfd, attr, F_OK, 0) < 0) continue;
+
+        snprintf(attr, sizeof(attr), "%s/dev", entry->d_name);
+        int fd = openat(dirfd, attr, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        ssize_t len = read(fd, value, sizeof(value) - 1);
+        close(fd);
+        if (len <= 0) continue;
+        value[len] = '\0';
+
+        dev_t dev;
+        if (parse_dev(value, &dev)) add_device(devices, dev, target, entry->d_name);
+    }
+    closedir(dir);
+    return TRUE;
+}
+
+// Mounts, swap and holders
+
+// Undoes the octal escaping /proc uses for blanks in paths
+static void unescape_path(char* path) {
+    char* out = path;
+    for (char* in = path; *in; in++) {
+        if (in[0] == '\\' && in[1] >= '0' && in[1] <= '3' && in[2] >= '0' && in[2] <= '7' &&
+            in[3] >= '0' && in[3] <= '7') {
+            *out++ = (char)((in[1] - '0') * 64 + (in[2] - '0') * 8 + (in[3] - '0'));
+            in += 3;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+}
+
+static void scan_mounts(const BusyDeviceSet* set, BusyReport* report) {
+    FILE* file = fopen("/proc/self/mountinfo", "re");
+    if (!file) return;
+
+    char* line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, file) > 0) {
+        // id parent maj:min root mountpoint options [optional...] - fstype source super
+        char* save = NULL;
+        strtok_r(line, " ", &save);
+        strtok_r(NULL, " ", &save);
+        char* devno = strtok_r(NULL, " ", &save);
+        strtok_r(NULL, " ", &save);
+        char* mountpoint = strtok_r(NULL, " ", &save);
+        if (!devno || !mountpoint) continue;
+
+        char* token;
+        while ((token = strtok_r(NULL, " ", &save)) != NULL && strcmp(token, "-") != 0) {
+        }
+        strtok_r(NULL, " ", &save);
+        char* source = strtok_r(NULL, " ", &save);
+
+        dev_t dev;
+        const BusyDevice* device = parse_dev(devno, &dev) ? find_device(set, dev) : NULL;
+
+        // btrfs and some stacked filesystems report an anonymous device
+        // number; their source path still names the block device
+        struct stat st;
+        if (!device && source && strncmp(source, "/dev/", 5) == 0 &&
+            stat(source, &st) == 0 && S_ISBLK(st.st_mode)) {
+            device = find_device(set, st.st_rdev);
+        }
+
+        if (device) {
+            unescape_path(mountpoint);
+            report_add(report, BUSY_MOUNT, device, mountpoint, 0, -1);
+        }
+    }
+    free(line);
+    fclose(file);
+}
+
+static void scan_swaps(const BusyDeviceSet* set, BusyReport* report) {
+    FILE* file = fopen("/proc/swaps", "re");
+    if (!file) return;
+
+    char* line = NULL;
+    size_t size = 0;
+    gboolean header = TRUE;
+    while (getline(&line, &size, file) > 0) {
+        if (header) {
+            header = FALSE;
+            continue;
+        }
+        char* save = NULL;
+        char* path = strtok_r(line, " \t", &save);
+        if (!path) continue;
+        unescape_path(path);
+
+        // A swap partition is the device itself; a swap file pins the
+        // filesystem it lives on
+        struct stat st;
+        if (stat(path, &st) < 0) continue;
+        const BusyDevice* device = find_device(set, S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev);
+        if (device) report_add(report, BUSY_SWAP, device, path, 0, -1);
+    }
+    free(line);
+    fclose(file);
+}
+
+static void scan_holders(const BusyDeviceSet* set, BusyReport* report) {
+    for (size_t i = 0; i < set->count; i++) {
+        const BusyDevice* device = &set->devices[i];
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/class/block/%s/holders", device->name);
+
+        DIR* dir = opendir(path);
+        if (!dir) continue;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+            report_add(report, BUSY_HOLDER, device, entry->d_name, 0, -1);
+        }
+        closedir(dir);
+    }
+}
+
+// Collects every block node under /dev that belongs to a target. With
+// these known, an fd link can be matched by its text alone and the sweep
+// needs no stat() per descriptor.
+static void collect_aliases(const BusyDeviceSet* set, int dir_fd, const char* prefix,
+                            int depth, GArray* aliases) {
+    DIR* dir = fdopendir(dir_fd);
+    if (!dir) {
+        close(dir_fd);
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        char path[128];
+        if ((size_t)snprintf(path, sizeof(path), "%s/%s", prefix, entry->d_name) >= sizeof(path)) {
+            continue;
+        }
+
+        struct stat st;
+        if (fstatat(dir_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) continue;
+
+        if (S_ISBLK(st.st_mode)) {
+            const BusyDevice* device = find_device(set, st.st_rdev);
+            if (device) {
+                BusyAlias alias = {.length = strlen(path), .device = device};
+                memcpy(alias.path, path, alias.length + 1);
+                g_array_append_val(aliases, alias);
+            }
+        } else if (S_ISDIR(st.st_mode) && depth > 1 &&
+                   strcmp(entry->d_name, "shm") != 0 && strcmp(entry->d_name, "pts") != 0) {
+            int child = openat(dir_fd, entry->d_name,
+                               O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (child >= 0) collect_aliases(set, child, path, depth - 1, aliases);
+        }
+    }
+    closedir(dir);
+}
+
+static const BusyDevice* find_alias(const BusyDeviceSet* set, const char* path, size_t length) {
+    for (size_t i = 0; i < set->alias_count; i++) {
+        const BusyAlias* alias = &set->aliases[i];
+        if (alias->length == length && memcmp(alias->path, path, length) == 0) {
+            return alias->device;
+        }
+    }
+    return NULL;
+}
+
+// A live node under /dev that matched no alias is not a target
+static gboolean is_plain_dev_path(const char* path, size_t length) {
+    static const char deleted[] = " (deleted)";
+    if (length < 5 || memcmp(path, "/dev/", 5) != 0) return FALSE;
+    return length < sizeof(deleted) - 1 ||
+           memcmp(path + length - (sizeof(deleted) - 1), deleted, sizeof(deleted) - 1) != 0;
+}
+
+// Process sweep
+
+typedef struct {
+    const BusyDeviceSet* set;
+    int proc_fd;
+    const pid_t* pids;
+    size_t pid_count;
+    size_t next;              // atomic cursor into pids
+    guint fds_scanned;        // atomic
+    guint processes_scanned;  // atomic
+} SweepContext;
+
+typedef struct {
+    SweepContext* context;
+    BusyReport report;
+} SweepWorker;
+
+static gboolean parse_decimal(const char* text, long* value) {
+    if (*text < '0' || *text > '9') return FALSE;
+    long result = 0;
+    for (; *text; text++) {
+        if (*text < '0' || *text > '9') return FALSE;
+        result = result * 10 + (*text - '0');
+    }
+    *value = result;
+    return TRUE;
+}
+
+static void read_comm(int proc_fd, pid_t pid, char* comm, size_t size) {
+    char path[32];
+    snprintf(path, sizeof(path), "%d/comm", (int)pid);
+    comm[0] = '\0';
+    int fd = openat(proc_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    ssize_t n = read(fd, comm, size - 1);
+    close(fd);
+    if (n < 0) n = 0;
+    while (n > 0 && comm[n - 1] == '\n') n--;
+    comm[n] = '\0';
+}
+
+static void sweep_process(SweepContext* context, pid_t pid, char* dents, BusyReport* report) {
+    char path[32];
+    snprintf(path, sizeof(path), "%d/fd", (int)pid);
+    int dirfd = openat(context->proc_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) return;  // exited, or not ours to inspect
+
+    guint fds = 0;
+    char comm[64] = "";
+    for (;;) {
+        long n = syscall(SYS_getdents64, dirfd, dents, BUSY_DENTS_BUFFER);
+        if (n <= 0) break;
+
+        for (long offset = 0; offset < n;) {
+            struct linux_dirent64* entry = (struct linux_dirent64*)(dents + offset);
+            offset += entry->d_reclen;
+
+            long fd;
+            if (!parse_decimal(entry->d_name, &fd)) continue;
+            fds++;
+
+            // Sockets, pipes and anon inodes resolve to "type:[inode]" and
+            // can never be block devices
+            char target[PATH_MAX];
+            ssize_t len = readlinkat(dirfd, entry->d_name, target, sizeof(target) - 1);
+            if (len <= 0 || target[0] != '/') continue;
+            target[len] = '\0';
+
+            const BusyDevice* device = find_alias(context->set, target, (size_t)len);
+            if (!device && !is_plain_dev_path(target, (size_t)len)) {
+                // A node outside /dev (mknod'ed elsewhere, another mount
+                // namespace's /dev) or one removed since it was opened: only
+                // the inode can tell which device it is. AT_STATX_DONT_SYNC
+                // answers from cached attributes, so a hung network
+                // filesystem cannot stall the sweep.
+                struct statx stx;
+                if (statx(dirfd, entry->d_name, AT_STATX_DONT_SYNC, STATX_TYPE, &stx) == 0 &&
+                    S_ISBLK(stx.stx_mode)) {
+                    device = find_device(context->set,
+                                         makedev(stx.stx_rdev_major, stx.stx_rdev_minor));
+                }
+            }
+            if (!device) continue;
+
+            if (comm[0] == '\0') read_comm(context->proc_fd, pid, comm, sizeof(comm));
+            report_add(report, BUSY_PROCESS, device, comm, pid, (int)fd);
+        }
+    }
+    close(dirfd);
+
+    __atomic_add_fetch(&context->fds_scanned, fds, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&context->processes_scanned, 1, __ATOMIC_RELAXED);
+}
+
+static void* sweep_thread_func(void* data) {
+    SweepWorker* worker = data;
+    SweepContext* context = worker->context;
+    char* dents = g_malloc(BUSY_DENTS_BUFFER);
+
+    for (;;) {
+        size_t start = __atomic_fetch_add(&context->next, BUSY_PID_BATCH, __ATOMIC_RELAXED);
+        if (start >= context->pid_count) break;
+        size_t end = MIN(start + BUSY_PID_BATCH, context->pid_count);
+        for (size_t i = start; i < end; i++) {
+            sweep_process(context, context->pids[i], dents, &worker->report);
+        }
+    }
+
+    g_free(dents);
+    return NULL;
+}
+
+static GArray* list_pids(int proc_fd) {
+    GArray* pids = g_array_new(FALSE, FALSE, sizeof(pid_t));
+    int dirfd = openat(proc_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) return pids;
+
+    char* dents = g_malloc(BUSY_DENTS_BUFFER);
+    pid_t self = getpid();
+    for (;;) {
+        long n = syscall(SYS_getdents64, dirfd, dents, BUSY_DENTS_BUFFER);
+        if (n <= 0) break;
+        for (long offset = 0; offset < n;) {
+            struct linux_dirent64* entry = (struct linux_dirent64*)(dents + offset);
+            offset += entry->d_reclen;
+            long pid;
+            if (entry->d_type == DT_DIR && parse_decimal(entry->d_name, &pid) && pid != self) {
+                pid_t value = (pid_t)pid;
+                g_array_append_val(pids, value);
+            }
+        }
+    }
+    g_free(dents);
+    close(dirfd);
+    return pids;
+}
+
+static void sweep_processes(const BusyDeviceSet* set, guint workers, BusyReport* report) {
+    int proc_fd = open("/proc", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (proc_fd < 0) return;
+
+    GArray* pids = list_pids(proc_fd);
+    SweepContext context = {
+        .set = set,
+        .proc_fd = proc_fd,
+        .pids = (const pid_t*)pids->data,
+        .pid_count = pids->len,
+    };
+
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (guint)cpus : 1;
+    }
+    workers = MIN(workers, BUSY_MAX_WORKERS);
+    workers = MAX(1u, MIN(workers, (guint)((pids->len + BUSY_PID_BATCH - 1) / BUSY_PID_BATCH)));
+
+    SweepWorker* pool = g_new0(SweepWorker, workers);
+    pthread_t* threads = g_new0(pthread_t, workers);
+    guint started = 0;
+    for (guint i = 0; i < workers; i++) {
+        pool[i].context = &context;
+        // Worker 0 runs on the calling thread
+        if (i > 0 && pthread_create(&threads[i], NULL, sweep_thread_func, &pool[i]) == 0) {
+            started |= 1u << i;
+        }
+    }
+    sweep_thread_func(&pool[0]);
+
+    for (guint i = 0; i < workers; i++) {
+        if (started & (1u << i)) pthread_join(threads[i], NULL);
+        for (size_t j = 0; j < pool[i].report.count; j++) {
+            const BusyEntry* entry = &pool[i].report.entries[j];
+            BusyDevice device = {.target = entry->target};
+            g_strlcpy(device.name, entry->device, sizeof(device.name));
+            report_add(report, entry->kind, &device, entry->detail, entry->pid, entry->fd);
+        }
+        busy_report_clear(&pool[i].report);
+    }
+
+    report->processes_scanned = context.processes_scanned;
+    report->fds_scanned = context.fds_scanned;
+
+    g_free(threads);
+    g_free(pool);
+    g_array_free(pids, TRUE);
+    close(proc_fd);
+}
+
+gboolean busy_scan(const char* const* device_paths,
+                   guint count,
+                   guint workers,
+                   BusyReport* report,
+                   GError** error) {
+    memset(report, 0, sizeof(*report));
+    gint64 started = g_get_monotonic_time();
+
+    GArray* devices = g_array_new(FALSE, FALSE, sizeof(BusyDevice));
+    for (guint i = 0; i < count; i++) {
+        if (!add_target(devices, device_paths[i], i, error)) {
+            g_array_free(devices, TRUE);
+            return FALSE;
+        }
+    }
+    qsort(devices->data, devices->len, sizeof(BusyDevice), compare_devices);
+    BusyDeviceSet set = {(BusyDevice*)devices->data, devices->len, NULL, 0};
+
+    GArray* aliases = g_array_new(FALSE, FALSE, sizeof(BusyAlias));
+    int dev_fd = open("/dev", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dev_fd >= 0) collect_aliases(&set, dev_fd, "/dev", BUSY_DEV_DEPTH, aliases);
+    set.aliases = (BusyAlias*)aliases->data;
+    set.alias_count = aliases->len;
+
+    scan_mounts(&set, report);
+    scan_swaps(&set, report);
+    scan_holders(&set, report);
+    sweep_processes(&set, workers, report);
+
+    report->elapsed_us = g_get_monotonic_time() - started;
+    g_array_free(aliases, TRUE);
+    g_array_free(devices, TRUE);
+    return TRUE;
+}
+
+// FlValue conversion
+
+static FlValue* entry_to_fl_value(const BusyEntry* entry) {
+    FlValue* map = fl_value_new_map();
+    fl_value_set_string_take(map, "device", fl_value_new_string(entry->device));
+    switch (entry->kind) {
+    case BUSY_MOUNT:
+        fl_value_set_string_take(map, "mountPoint", fl_value_new_string(entry->detail));
+        break;
+    case BUSY_SWAP:
+        fl_value_set_string_take(map, "path", fl_value_new_string(entry->detail));
+        break;
+    case BUSY_HOLDER:
+        fl_value_set_string_take(map, "holder", fl_value_new_string(entry->detail));
+        break;
+    case BUSY_PROCESS:
+        fl_value_set_string_take(map, "pid", fl_value_new_int(entry->pid));
+        fl_value_set_string_take(map, "fd", fl_value_new_int(entry->fd));
+        fl_value_set_string_take(map, "command", fl_value_new_string(entry->detail));
+        break;
+    }
+    return map;
+}
+
+FlValue* busy_report_to_fl_value(const BusyReport* report,
+                                 const char* const* device_paths,
+                                 guint count) {
+    static const char* const kind_keys[] = {"mounts", "swaps", "holders", "processes"};
+
+    FlValue* devices = fl_value_new_list();
+    for (guint i = 0; i < count; i++) {
+        FlValue* lists[G_N_ELEMENTS(kind_keys)];
+        for (size_t k = 0; k < G_N_ELEMENTS(kind_keys); k++) lists[k] = fl_value_new_list();
+
+        gboolean busy = FALSE;
+        for (size_t j = 0; j < report->count; j++) {
+            const BusyEntry* entry = &report->entries[j];
+            if (entry->target != i) continue;
+            busy = TRUE;
+            fl_value_append_take(lists[entry->kind], entry_to_fl_value(entry));
+        }
+
+        FlValue* device = fl_value_new_map();
+        fl_value_set_string_take(device, "devicePath", fl_value_new_string(device_paths[i]));
+        fl_value_set_string_take(device, "busy", fl_value_new_bool(busy));
+        for (size_t k = 0; k < G_N_ELEMENTS(kind_keys); k++) {
+            fl_value_set_string_take(device, kind_keys[k], lists[k]);
+        }
+        fl_value_append_take(devices, device);
+    }
+
+    FlValue* result = fl_value_new_map();
+    fl_value_set_string_take(result, "devices", devices);
+    fl_value_set_string_take(result, "processesScanned", fl_value_new_int(report->processes_scanned));
+    fl_value_set_string_take(result, "fdsScanned", fl_value_new_int(report->fds_scanned));
+    fl_value_set_string_take(result, "elapsedUs", fl_value_new_int(report->elapsed_us));
+    return result;
+}
@@ -0,0 +1,76 @@
+#ifndef BUSY_SCAN_H
+#define BUSY_SCAN_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <sys/types.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+    BUSY_MOUNT = 0,           // mounted filesystem (/proc/self/mountinfo)
+    BUSY_SWAP = 1,            // active swap area (/proc/swaps)
+    BUSY_HOLDER = 2,          // dm, md or LVM device stacked on top (sysfs holders)
+    BUSY_PROCESS = 3,         // open file descriptor of a process
+} BusyKind;
+
+typedef struct {
+    BusyKind kind;
+    guint target;             // index into the scanned device paths
+    char device[64];          // the disk or partition that is held, e.g. "sda2"
+    char detail[256];         // mount point, swap file, holder name or command
+    pid_t pid;                // BUSY_PROCESS only
+    int fd;                   // BUSY_PROCESS only
+} BusyEntry;
+
+typedef struct {
+    BusyEntry* entries;
+    size_t count;
+    size_t capacity;
+    guint processes_scanned;
+    guint fds_scanned;
+    gint64 elapsed_us;
+} BusyReport;
+
+/**
+ * busy_scan:
+ * @device_paths: block device nodes to check (e.g. "/dev/sda")
+ * @workers: threads sweeping /proc/<pid>/fd, 0 for one per CPU (capped at 8)
+ * @report: (out caller-allocates): filled on success, release with
+ *   busy_report_clear()
+ *
+ * Reports everything that holds a target disk or any of its partitions.
+ * Devices are matched by device number, so a node reached through a
+ * symlink, another mount namespace or a renamed path is still found. The
+ * fd sweep reads each /proc/<pid>/fd directory with getdents64() and
+ * resolves links with readlinkat(); the result is compared with the target
+ * nodes found under /dev up front. Only links to paths outside /dev, or to
+ * nodes deleted since, are stat()ed, from cached attributes so a hung
+ * network filesystem cannot stall the sweep. Processes whose fd directory
+ * is not readable (other users without CAP_SYS_PTRACE) are skipped, and
+ * so is the calling process, whose own descriptors (health sampling, the
+ * operation about to run) are not a reason to refuse a wipe.
+ *
+ * Returns: TRUE on success
+ */
+gboolean busy_scan(const char* const* device_paths,
+                   guint count,
+                   guint workers,
+                   BusyReport* report,
+                   GError** error);
+
+void busy_report_clear(BusyReport* report);
+
+/**
+ * busy_report_to_fl_value:
+ *
+ * Returns: (transfer full): a map with "devices", one map per scanned path
+ * holding "devicePath", "busy" and lists of "mounts", "swaps", "holders" and
+ * "processes", plus the sweep counters and "elapsedUs"
+ */
+FlValue* busy_report_to_fl_value(const BusyReport* report,
+                                 const char* const* device_paths,
+                                 guint count);
+
+G_END_DECLS
+
+#endif // BUSY_SCAN_H
@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+#include "device_backend.h"
+#include "bulk_io.h"
+#include "sysfs_cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+static char** linux_list_devices(void* ctx) {
+    DIR* dir = opendir("/sys/block");
+    if (!dir) return NULL;
+
+    GPtrArray* names = g_ptr_array_new();
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        g_ptr_array_add(names, g_strdup(entry->d_name));
+    }
+    closedir(dir);
+    g_ptr_array_add(names, NULL);
+    return (char**)g_ptr_array_free(names, FALSE);
+}
+
+static gssize linux_read_attr(const char* device, const char* attr,
+                              char* buffer, size_t size, void* ctx) {
+    return sysfs_cache_read(sysfs_cache_default(), device, attr, buffer, size);
+}
+
+static gboolean is_controller_name(const char* name) {
+    unsigned int instance;
+    int length = 0;
+    return sscanf(name, "nvme%u%n", &instance, &length) == 1 && name[length] == '\0';
+}
+
+static char* linux_nvme_controller(const char* device, void* ctx) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/sys/block/%s/device", device);
+    char* target = g_file_read_link(path, NULL);
+    if (!target) return NULL;
+
+    char* base = g_path_get_basename(target);
+    g_free(target);
+    if (is_controller_name(base)) return base;
+    if (!g_str_has_prefix(base, "nvme-subsys")) {
+        g_free(base);
+        return NULL;
+    }
+
+    // Multipath head: any controller of the subsystem reaches the
+    // namespace, so prefer one whose state is "live"
+    snprintf(path, sizeof(path), "/sys/class/nvme-subsystem/%s", base);
+    g_free(base);
+    DIR* dir = opendir(path);
+    if (!dir) return NULL;
+
+    char* fallback = NULL;
+    char* live = NULL;
+    struct dirent* entry;
+    while (!live && (entry = readdir(dir)) != NULL) {
+        if (!is_controller_name(entry->d_name)) continue;
+
+        char state[32] = "";
+        char state_path[PATH_MAX];
+        snprintf(state_path, sizeof(state_path), "/sys/class/nvme/%s/state", entry->d_name);
+        FILE* file = fopen(state_path, "re");
+        if (file) {
+            if (!fgets(state, sizeof(state), file)) state[0] = '\0';
+            fclose(file);
+        }
+        if (g_str_has_prefix(state, "live")) {
+            live = g_strdup(entry->d_name);
+        } else if (!fallback) {
+            fallback = g_strdup(entry->d_name);
+        }
+    }
+    closedir(dir);
+
+    if (live) {
+        g_free(fallback);
+        return live;
+    }
+    return fallback;
+}
+
+static char* linux_sysfs_path(const char* device, void* ctx) {
+    char path[PATH_MAX];
+    char resolved[PATH_MAX];
+    snprintf(path, sizeof(path), "/sys/block/%s", device);
+    if (!realpath(path, resolved) || !g_str_has_prefix(resolved, "/sys/")) return NULL;
+    return g_strdup(resolved + 4);
+}
+
+static int linux_open_device(const char* path, int flags, void* ctx) {
+    return open(path, flags | O_CLOEXEC);
+}
+
+static void linux_close_device(int fd, void* ctx) {
+    close(fd);
+}
+
+static int linux_ata_identify(int fd, struct hd_driveid* id, void* ctx) {
+    return ioctl(fd, HDIO_GET_IDENTITY, id);
+}
+
+static int linux_nvme_admin(int fd, struct nvme_admin_cmd* cmd, void* ctx) {
+    return ioctl(fd, NVME_IOCTL_ADMIN_CMD, cmd);
+}
+
+static int linux_device_size(int fd, uint64_t* size, void* ctx) {
+    return bulk_io_device_size(fd, size) ? 0 : -1;
+}
+
+static ssize_t linux_pread(int fd, void* buffer, size_t size, uint64_t offset, void* ctx) {
+    return pread(fd, buffer, size, (off_t)offset);
+}
+
+static ssize_t linux_pwrite(int fd, const void* buffer, size_t size, uint64_t offset, void* ctx) {
+    return pwrite(fd, buffer, size, (off_t)offset);
+}
+
+static int linux_sync(int fd, void* ctx) {
+    return fdatasync(fd);
+}
+
+static int linux_discard(int fd, unsigned long request, uint64_t offset, uint64_t length, void* ctx) {
+    uint64_t range[2] = { offset, length };
+    return ioctl(fd, request, range);
+}
+
+static const DeviceBackend linux_backend = {
+    .list_devices = linux_list_devices,
+    .read_attr = linux_read_attr,
+    .nvme_controller = linux_nvme_controller,
+    .sysfs_path = linux_sysfs_path,
+    .open_device = linux_open_device,
+    .close_device = linux_close_device,
+    .ata_identify = linux_ata_identify,
+    .nvme_admin = linux_nvme_admin,
+    .device_size = linux_device_size,
+    .pread = linux_pread,
+    .pwrite = linux_pwrite,
+    .sync = linux_sync,
+    .discard = linux_discard,
+    .ctx = NULL,
+};
+
+const DeviceBackend* device_backend_linux(void) {
+    return &linux_backend;
+}
+
+gboolean device_backend_read_u64(const DeviceBackend* backend,
+                                 const char* device,
+                                 const char* attr,
+                                 uint64_t* value) {
+    char buffer[32];
+    if (backend->read_attr(device, attr, buffer, sizeof(buffer), backend->ctx) <= 0) return FALSE;
+    return sysfs_parse_u64(buffer, NULL, value);
+}
@@ -0,0 +1,68 @@
+#ifndef DEVICE_BACKEND_H
+#define DEVICE_BACKEND_H
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/hdreg.h>
+#include <linux/nvme_ioctl.h>
+
+G_BEGIN_DECLS
+
+/**
+ * DeviceBackend:
+ *
+ * Indirection over everything the probing and bulk I/O code asks of the
+ * system: the block device list, sysfs attributes, identity ioctls and
+ * positional I/O. device_backend_linux() talks to the kernel; a simulated
+ * backend (see device_sim.h) lets the same code run against modelled
+ * devices. Every callback receives @ctx. Return values follow the syscall
+ * they replace (-1 with errno set on error).
+ */
+typedef struct {
+    // Kernel names of the block devices present ("sda", "nvme0n1");
+    // NULL-terminated, free with g_strfreev(); NULL if the list is unreadable
+    char** (*list_devices)(void* ctx);
+    // Attribute below /sys/block/<device>, e.g. "size" or "queue/rotational";
+    // same contract as sysfs_cache_read()
+    gssize (*read_attr)(const char* device, const char* attr,
+                        char* buffer, size_t size, void* ctx);
+    // Kernel name of the NVMe controller ("nvme0") that admin commands for
+    // namespace @device go to; a live path for multipath heads. Free with
+    // g_free(); NULL if @device is not an NVMe namespace
+    char* (*nvme_controller)(const char* device, void* ctx);
+    // Resolved sysfs directory of @device below /sys, e.g.
+    // "/devices/pci0000:00/0000:00:17.0/ata1/host0/.../block/sda", which
+    // names the bus it hangs off. Free with g_free(); NULL if unknown
+    char* (*sysfs_path)(const char* device, void* ctx);
+    int (*open_device)(const char* path, int flags, void* ctx);
+    void (*close_device)(int fd, void* ctx);
+    int (*ata_identify)(int fd, struct hd_driveid* id, void* ctx);     // HDIO_GET_IDENTITY
+    int (*nvme_admin)(int fd, struct nvme_admin_cmd* cmd, void* ctx);  // NVME_IOCTL_ADMIN_CMD
+    int (*device_size)(int fd, uint64_t* size, void* ctx);             // BLKGETSIZE64
+    ssize_t (*pread)(int fd, void* buffer, size_t size, uint64_t offset, void* ctx);
+    ssize_t (*pwrite)(int fd, const void* buffer, size_t size, uint64_t offset, void* ctx);
+    int (*sync)(int fd, void* ctx);                                    // fdatasync
+    // BLKDISCARD, BLKSECDISCARD or BLKZEROOUT over @length bytes at @offset
+    int (*discard)(int fd, unsigned long request, uint64_t offset, uint64_t length, void* ctx);
+    void* ctx;
+} DeviceBackend;
+
+const DeviceBackend* device_backend_linux(void);
+
+/**
+ * device_backend_read_u64:
+ *
+ * Reads a numeric sysfs attribute through @backend.
+ *
+ * Returns: TRUE if the attribute exists and starts with a number
+ */
+gboolean device_backend_read_u64(const DeviceBackend* backend,
+                                 const char* device,
+                                 const char* attr,
+                                 uint64_t* value);
+
+G_END_DECLS
+
+#endif // DEVICE_BACKEND_H
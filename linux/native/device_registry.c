@@ -1,73 +1,18 @@
 #include "device_registry.h"
+#include "discard.h"
+#include "identify_decode.h"
+#include "range_wipe.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
-#include <linux/hdreg.h>
-#include <linux/nvme_ioctl.h>
-#include <dirent.h>
 #include <blkid/blkid.h>
 #include <endian.h>
 
-// ATA IDENTIFY DEVICE structure (simplified)
-#define ATA_ID_WORDS 256
-#define ATA_ID_SERNO 10
-#define ATA_ID_FW_REV 23
-#define ATA_ID_PROD 27
-#define ATA_ID_COMMAND_SET_2 83
-#define ATA_ID_SECURITY 128
-
-// Helper function to read sysfs attribute
-static char* read_sysfs_attr(const char* path) {
-    FILE* f = fopen(path, "r");
-    if (!f) return NULL;
-    
-    char* buffer = malloc(256);
-    if (!buffer) {
-        fclose(f);
-        return NULL;
-    }
-    
-    if (fgets(buffer, 256, f) == NULL) {
-        free(buffer);
-        fclose(f);
-        return NULL;
-    }
-    
-    // Remove trailing newline
-    size_t len = strlen(buffer);
-    if (len > 0 && buffer[len-1] == '\n') {
-        buffer[len-1] = '\0';
-    }
-    
-    fclose(f);
-    return buffer;
-}
-
-// Helper function to convert ATA string (word-swapped)
-static void ata_string_to_c_string(const uint16_t* ata_string, char* c_string, int words) {
-    for (int i = 0; i < words; i++) {
-        uint16_t word = le16toh(ata_string[i]);
-        c_string[i*2] = (word >> 8) & 0xFF;
-        c_string[i*2 + 1] = word & 0xFF;
-    }
-    c_string[words * 2] = '\0';
-    
-    // Trim trailing spaces
-    for (int i = words * 2 - 1; i >= 0 && c_string[i] == ' '; i--) {
-        c_string[i] = '\0';
-    }
-}
-
 // Get device type from sysfs
-static const char* get_device_type(const char* device_name) {
-    char path[512];
-    snprintf(path, sizeof(path), "/sys/block/%s/device/type", device_name);
-    
-    char* type_str = read_sysfs_attr(path);
-    if (!type_str) {
+static const char* get_device_type(const DeviceBackend* backend, const char* device_name) {
+    uint64_t type;
+    if (!device_backend_read_u64(backend, device_name, "device/type", &type)) {
         // Check if it's NVMe
         if (strncmp(device_name, "nvme", 4) == 0) {
             return "nvme";
@@ -75,9 +20,6 @@ static const char* get_device_type(const char* device_name) {
         return "unknown";
     }
     
-    int type = atoi(type_str);
-    free(type_str);
-    
     // SCSI device types
     switch (type) {
         case 0: return "sata";  // Direct access device
@@ -87,8 +29,8 @@ static const char* get_device_type(const char* device_name) {
 }
 
 // Get ATA identity information
-FlValue* device_registry_get_ata_identity(const char* device_path, GError** error) {
-    int fd = open(device_path, O_RDONLY | O_NONBLOCK);
+static FlValue* get_ata_identity(const DeviceBackend* backend, const char* device_path, GError** error) {
+    int fd = backend->open_device(device_path, O_RDONLY | O_NONBLOCK, backend->ctx);
     if (fd < 0) {
         g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
                     "Failed to open device: %s", device_path);
@@ -96,218 +38,960 @@ FlValue* device_registry_get_ata_identity(const char* device_path, GError** erro
     }
     
     struct hd_driveid id;
-    if (ioctl(fd, HDIO_GET_IDENTITY, &id) < 0) {
-        close(fd);
+    if (backend->ata_identify(fd, &id, backend->ctx) < 0) {
+        backend->close_device(fd, backend->ctx);
         g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
                     "HDIO_GET_IDENTITY ioctl failed");
         return NULL;
     }
     
-    close(fd);
+    backend->close_device(fd, backend->ctx);
+    
+    // The kernel hands back host-order words; the decoder reads the
+    // little-endian layout the device sent
+    uint8_t data[IDENTIFY_ATA_SIZE];
+    const uint16_t* words = (const uint16_t*)&id;
+    for (int i = 0; i < IDENTIFY_ATA_SIZE / 2; i++) {
+        uint16_t word = htole16(words[i]);
+        memcpy(data + i * 2, &word, 2);
+    }
     
-    // Parse ATA identity data
-    char model[41], serial[21], firmware[9];
-    ata_string_to_c_string((uint16_t*)&id.model, model, 20);
-    ata_string_to_c_string((uint16_t*)&id.serial_no, serial, 10);
-    ata_string_to_c_string((uint16_t*)&id.fw_rev, firmware, 4);
+    const IdentifyField* f = identify_ata_table.fields;
+    char model[IDENTIFY_TEXT_MAX], serial[IDENTIFY_TEXT_MAX], firmware[IDENTIFY_TEXT_MAX];
+    identify_read_text(&f[ID_ATA_MODEL], data, model, sizeof(model));
+    identify_read_text(&f[ID_ATA_SERIAL], data, serial, sizeof(serial));
+    identify_read_text(&f[ID_ATA_FIRMWARE], data, firmware, sizeof(firmware));
     
-    // Security status (Word 128)
-    uint16_t security_word = le16toh(id.command_set_2);
-    bool security_supported = (security_word & 0x0002) != 0;
-    bool security_enabled = (security_word & 0x0004) != 0;
-    bool security_locked = (security_word & 0x0008) != 0;
-    bool security_frozen = (security_word & 0x0010) != 0;
-    bool enhanced_erase_supported = (security_word & 0x0020) != 0;
+    // Erase times are in units of 2 minutes; 0 means not reported
+    uint64_t enhanced_erase_time = identify_read(&f[ID_ATA_ENH_ERASE_TIME], data);
+    if (!identify_read(&f[ID_ATA_ENH_ERASE_TIME_EXT], data)) {
+        enhanced_erase_time &= 0xFF;
+    }
     
     // Build FlValue map
     FlValue* result = fl_value_new_map();
     fl_value_set_string_take(result, "modelName", fl_value_new_string(model));
     fl_value_set_string_take(result, "serialNumber", fl_value_new_string(serial));
     fl_value_set_string_take(result, "firmwareRevision", fl_value_new_string(firmware));
-    fl_value_set_string_take(result, "dmaSupport", fl_value_new_bool(true));
-    fl_value_set_string_take(result, "enhancedSecurityEraseTimeMinutes", fl_value_new_int(0));
+    fl_value_set_string_take(result, "dmaSupport",
+                             fl_value_new_bool(identify_read(&f[ID_ATA_CAP_DMA], data) != 0));
+    fl_value_set_string_take(result, "enhancedSecurityEraseTimeMinutes",
+                             fl_value_new_int((int64_t)enhanced_erase_time * 2));
     
-    // Security information
+    // Security information (word 128)
     FlValue* security = fl_value_new_map();
-    fl_value_set_string_take(security, "isSecuritySupported", fl_value_new_bool(security_supported));
-    fl_value_set_string_take(security, "isSecurityEnabled", fl_value_new_bool(security_enabled));
-    fl_value_set_string_take(security, "isSecurityLocked", fl_value_new_bool(security_locked));
-    fl_value_set_string_take(security, "isSecurityFrozen", fl_value_new_bool(security_frozen));
-    fl_value_set_string_take(security, "isEnhancedEraseSupported", fl_value_new_bool(enhanced_erase_supported));
+    fl_value_set_string_take(security, "isSecuritySupported",
+                             fl_value_new_bool(identify_read(&f[ID_ATA_SEC_SUPPORTED], data) != 0));
+    fl_value_set_string_take(security, "isSecurityEnabled",
+                             fl_value_new_bool(identify_read(&f[ID_ATA_SEC_ENABLED], data) != 0));
+    fl_value_set_string_take(security, "isSecurityLocked",
+                             fl_value_new_bool(identify_read(&f[ID_ATA_SEC_LOCKED], data) != 0));
+    fl_value_set_string_take(security, "isSecurityFrozen",
+                             fl_value_new_bool(identify_read(&f[ID_ATA_SEC_FROZEN], data) != 0));
+    fl_value_set_string_take(security, "isEnhancedEraseSupported",
+                             fl_value_new_bool(identify_read(&f[ID_ATA_SEC_ENHANCED], data) != 0));
     
     fl_value_set_string_take(result, "security", security);
     
+    // Every decoded word, for callers that need more than the summary
+    fl_value_set_string_take(result, "identify",
+                             identify_to_fl_value(&identify_ata_table, data, sizeof(data)));
+    fl_value_set_string_take(result, "checksumValid",
+                             fl_value_new_bool(identify_ata_checksum_valid(data)));
+    
     return result;
 }
 
-// Get NVMe identity information
-FlValue* device_registry_get_nvme_identity(const char* device_path, GError** error) {
-    int fd = open(device_path, O_RDONLY);
-    if (fd < 0) {
-        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                    "Failed to open NVMe device: %s", device_path);
-        return NULL;
+FlValue* device_registry_get_ata_identity(const char* device_path, GError** error) {
+    return get_ata_identity(device_backend_linux(), device_path, error);
+}
+
+// Namespace ID from a namespace node such as /dev/nvme0n1; 1 otherwise
+static uint32_t nvme_namespace_id(const char* device_path) {
+    const char* name = strrchr(device_path, '/');
+    name = name ? name + 1 : device_path;
+    
+    unsigned int controller = 0, nsid = 0;
+    if (sscanf(name, "nvme%un%u", &controller, &nsid) == 2 && nsid > 0) {
+        return nsid;
     }
-    
-    // Prepare NVMe admin command for Identify Controller
+    return 1;
+}
+
+static int nvme_identify(const DeviceBackend* backend, int fd, uint32_t cns, uint32_t nsid,
+                         uint8_t* data) {
     struct nvme_admin_cmd cmd = {
         .opcode = 0x06,  // Identify command
-        .nsid = 0,
-        .addr = 0,
-        .data_len = 4096,
-        .cdw10 = 1,  // Identify Controller
+        .nsid = nsid,
+        .addr = (uint64_t)(uintptr_t)data,
+        .data_len = IDENTIFY_NVME_SIZE,
+        .cdw10 = cns,
     };
-    
-    uint8_t data[4096];
-    cmd.addr = (uint64_t)data;
-    
-    if (ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd) < 0) {
-        close(fd);
-        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                    "NVME_IOCTL_ADMIN_CMD failed");
-        return NULL;
+    return backend->nvme_admin(fd, &cmd, backend->ctx);
+}
+
+// Identity map from Identify Controller data and, if available, the
+// device's Identify Namespace data
+static FlValue* nvme_identity_to_fl_value(const uint8_t* controller, const uint8_t* ns) {
+    const IdentifyField* f = identify_nvme_controller_table.fields;
+    char serial[IDENTIFY_TEXT_MAX], model[IDENTIFY_TEXT_MAX];
+    identify_read_text(&f[ID_CTRL_SN], controller, serial, sizeof(serial));
+    identify_read_text(&f[ID_CTRL_MN], controller, model, sizeof(model));
+    
+    // Critical Composite Temperature Threshold, Kelvin
+    uint64_t cctemp_kelvin = identify_read(&f[ID_CTRL_CCTEMP], controller);
+    int cctemp_celsius = cctemp_kelvin ? (int)cctemp_kelvin - 273 : 0;
+    
+    // VER is 0 on controllers older than NVMe 1.2
+    char version[32];
+    if (identify_read(&f[ID_CTRL_VER], controller) == 0) {
+        snprintf(version, sizeof(version), "1.0");
+    } else {
+        snprintf(version, sizeof(version), "%u.%u.%u",
+                 (unsigned)identify_read(&f[ID_CTRL_VER_MAJOR], controller),
+                 (unsigned)identify_read(&f[ID_CTRL_VER_MINOR], controller),
+                 (unsigned)identify_read(&f[ID_CTRL_VER_TERTIARY], controller));
     }
     
-    close(fd);
-    
-    // Parse NVMe Identify Controller data
-    char serial[21], model[41];
-    memcpy(serial, data + 4, 20);
-    serial[20] = '\0';
-    memcpy(model, data + 24, 40);
-    model[40] = '\0';
-    
-    // Trim spaces
-    for (int i = 19; i >= 0 && serial[i] == ' '; i--) serial[i] = '\0';
-    for (int i = 39; i >= 0 && model[i] == ' '; i--) model[i] = '\0';
-    
-    // Vendor ID (bytes 0-1)
-    uint16_t vendor_id = *(uint16_t*)data;
-    
-    // Sanitize Capabilities (byte 328)
-    uint32_t sanicap = *(uint32_t*)(data + 328);
-    bool crypto_erase = (sanicap & 0x01) != 0;
-    bool block_erase = (sanicap & 0x02) != 0;
-    bool overwrite = (sanicap & 0x04) != 0;
-    
     // Build FlValue map
     FlValue* result = fl_value_new_map();
     fl_value_set_string_take(result, "serialNumber", fl_value_new_string(serial));
     fl_value_set_string_take(result, "modelName", fl_value_new_string(model));
     
     char vendor_str[16];
-    snprintf(vendor_str, sizeof(vendor_str), "0x%04X", vendor_id);
+    snprintf(vendor_str, sizeof(vendor_str), "0x%04X",
+             (unsigned)identify_read(&f[ID_CTRL_VID], controller));
     fl_value_set_string_take(result, "vendorId", fl_value_new_string(vendor_str));
-    fl_value_set_string_take(result, "controllerId", fl_value_new_string("0"));
-    fl_value_set_string_take(result, "nvmeVersion", fl_value_new_string("1.0"));
-    fl_value_set_string_take(result, "criticalCompositeTemperature", fl_value_new_int(0));
-    fl_value_set_string_take(result, "hostMemoryBufferPreferredSize", fl_value_new_int(0));
+    
+    char controller_id[16];
+    snprintf(controller_id, sizeof(controller_id), "%u",
+             (unsigned)identify_read(&f[ID_CTRL_CNTLID], controller));
+    fl_value_set_string_take(result, "controllerId", fl_value_new_string(controller_id));
+    fl_value_set_string_take(result, "nvmeVersion", fl_value_new_string(version));
+    fl_value_set_string_take(result, "criticalCompositeTemperature", fl_value_new_int(cctemp_celsius));
+    
+    // HMPRE is in 4 KiB units
+    fl_value_set_string_take(result, "hostMemoryBufferPreferredSize",
+                             fl_value_new_int((int64_t)identify_read(&f[ID_CTRL_HMPRE], controller) * 4096));
     
     // Sanitize capabilities
     FlValue* sanitize_methods = fl_value_new_list();
-    if (crypto_erase) {
+    if (identify_read(&f[ID_CTRL_SANICAP_CRYPTO], controller)) {
         fl_value_append_take(sanitize_methods, fl_value_new_string("nvme_sanitize"));
     }
-    if (block_erase || overwrite) {
+    if (identify_read(&f[ID_CTRL_SANICAP_BLOCK], controller) ||
+        identify_read(&f[ID_CTRL_SANICAP_OVERWRITE], controller)) {
         fl_value_append_take(sanitize_methods, fl_value_new_string("nvme_format_nvm"));
     }
     
     fl_value_set_string_take(result, "supportedSanitizationMethods", sanitize_methods);
     
+    // Full Identify Controller and Namespace data structures
+    fl_value_set_string_take(result, "controller",
+                             identify_to_fl_value(&identify_nvme_controller_table,
+                                                  controller, IDENTIFY_NVME_SIZE));
+    if (ns) {
+        fl_value_set_string_take(result, "namespace",
+                                 identify_to_fl_value(&identify_nvme_namespace_table, ns, IDENTIFY_NVME_SIZE));
+    }
+    
+    return result;
+}
+
+// Get NVMe identity information
+static FlValue* get_nvme_identity(const DeviceBackend* backend, const char* device_path, GError** error) {
+    int fd = backend->open_device(device_path, O_RDONLY, backend->ctx);
+    if (fd < 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                    "Failed to open NVMe device: %s", device_path);
+        return NULL;
+    }
+    
+    uint8_t controller[IDENTIFY_NVME_SIZE];
+    uint8_t ns[IDENTIFY_NVME_SIZE];
+    
+    if (nvme_identify(backend, fd, 1, 0, controller) < 0) {
+        backend->close_device(fd, backend->ctx);
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                    "NVME_IOCTL_ADMIN_CMD failed");
+        return NULL;
+    }
+    
+    // Namespace data is optional: controller nodes may not accept it
+    gboolean have_ns = nvme_identify(backend, fd, 0, nvme_namespace_id(device_path), ns) >= 0;
+    
+    backend->close_device(fd, backend->ctx);
+    
+    return nvme_identity_to_fl_value(controller, have_ns ? ns : NULL);
+}
+
+FlValue* device_registry_get_nvme_identity(const char* device_path, GError** error) {
+    return get_nvme_identity(device_backend_linux(), device_path, error);
+}
+
+// NVMe controllers are the parents of their namespaces: each gets one
+// Identify Controller and one Active Namespace ID List on /dev/nvmeX,
+// then Identify Namespace for each active ID, instead of repeating
+// Identify Controller on every namespace node
+typedef struct {
+    char name[32];              // controller kernel name, "nvme0"
+    gboolean probed;            // Identify Controller succeeded on the controller node
+    uint8_t identify[IDENTIFY_NVME_SIZE];
+    GArray* active;             // uint32_t namespace IDs, increasing
+    GHashTable* namespaces;     // namespace ID -> Identify Namespace data
+    GPtrArray* devices;         // block devices served through this controller
+    guint admin_commands;
+} NvmeController;
+
+#define NVME_ACTIVE_LIST_ENTRIES (IDENTIFY_NVME_SIZE / 4)
+
+static void nvme_controller_free(gpointer data) {
+    NvmeController* controller = data;
+    g_array_free(controller->active, TRUE);
+    g_hash_table_destroy(controller->namespaces);
+    g_ptr_array_free(controller->devices, TRUE);
+    g_free(controller);
+}
+
+// Namespace nodes only: multipath path nodes (nvme0c0n1) have no /dev entry
+static gboolean is_nvme_namespace(const char* device_name) {
+    unsigned int a, b, c;
+    return strncmp(device_name, "nvme", 4) == 0 &&
+           sscanf(device_name, "nvme%uc%un%u", &a, &b, &c) != 3;
+}
+
+static uint32_t nvme_device_nsid(const DeviceBackend* backend, const char* device_name) {
+    uint64_t nsid;
+    if (device_backend_read_u64(backend, device_name, "nsid", &nsid) && nsid > 0 && nsid <= G_MAXUINT32) {
+        return (uint32_t)nsid;
+    }
+    return nvme_namespace_id(device_name);
+}
+
+static char* nvme_controller_name(const DeviceBackend* backend, const char* device_name) {
+    if (backend->nvme_controller) {
+        char* name = backend->nvme_controller(device_name, backend->ctx);
+        if (name) return name;
+    }
+    // Without sysfs links, nvmeXnY belongs to nvmeX unless multipath renumbered it
+    unsigned int instance;
+    if (sscanf(device_name, "nvme%u", &instance) == 1) {
+        return g_strdup_printf("nvme%u", instance);
+    }
+    return NULL;
+}
+
+static int compare_nsid(gconstpointer a, gconstpointer b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void nvme_controller_probe(const DeviceBackend* backend, NvmeController* controller,
+                                  const uint32_t* fallback_nsids, guint fallback_count) {
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/%s", controller->name);
+    int fd = backend->open_device(path, O_RDONLY, backend->ctx);
+    if (fd < 0) return;
+
+    controller->admin_commands++;
+    if (nvme_identify(backend, fd, 1, 0, controller->identify) < 0) {
+        backend->close_device(fd, backend->ctx);
+        return;
+    }
+    controller->probed = TRUE;
+
+    // Active Namespace ID List (CNS 02h) returns up to 1024 IDs above the
+    // given one; a full page means there may be more
+    uint8_t list[IDENTIFY_NVME_SIZE];
+    uint32_t after = 0;
+    gboolean listed = TRUE;
+    for (;;) {
+        controller->admin_commands++;
+        if (nvme_identify(backend, fd, 2, after, list) < 0) {
+            listed = after > 0;     // controllers before NVMe 1.1 lack CNS 02h
+            break;
+        }
+        guint entries = 0;
+        for (; entries < NVME_ACTIVE_LIST_ENTRIES; entries++) {
+            uint32_t nsid;
+            memcpy(&nsid, list + entries * 4, sizeof(nsid));
+            nsid = le32toh(nsid);
+            if (nsid == 0 || nsid <= after) break;
+            g_array_append_val(controller->active, nsid);
+            after = nsid;
+        }
+        if (entries < NVME_ACTIVE_LIST_ENTRIES) break;
+    }
+    if (!listed) {
+        // Fall back to the namespaces that have block devices
+        g_array_append_vals(controller->active, fallback_nsids, fallback_count);
+        g_array_sort(controller->active, compare_nsid);
+        guint unique = 0;
+        for (guint i = 0; i < controller->active->len; i++) {
+            uint32_t nsid = g_array_index(controller->active, uint32_t, i);
+            if (unique == 0 || g_array_index(controller->active, uint32_t, unique - 1) != nsid) {
+                g_array_index(controller->active, uint32_t, unique++) = nsid;
+            }
+        }
+        g_array_set_size(controller->active, unique);
+    }
+
+    // Identify Namespace for every active ID, back to back on one descriptor
+    for (guint i = 0; i < controller->active->len; i++) {
+        uint32_t nsid = g_array_index(controller->active, uint32_t, i);
+        if (g_hash_table_contains(controller->namespaces, GUINT_TO_POINTER(nsid))) continue;
+
+        uint8_t* ns = g_malloc(IDENTIFY_NVME_SIZE);
+        controller->admin_commands++;
+        if (nvme_identify(backend, fd, 0, nsid, ns) < 0) {
+            g_free(ns);
+            continue;
+        }
+        g_hash_table_insert(controller->namespaces, GUINT_TO_POINTER(nsid), ns);
+    }
+
+    backend->close_device(fd, backend->ctx);
+}
+
+// Groups the NVMe namespaces among @names by controller and probes each
+// controller once
+static GPtrArray* nvme_topology_probe(const DeviceBackend* backend, char** names) {
+    GPtrArray* controllers = g_ptr_array_new_with_free_func(nvme_controller_free);
+
+    for (char** name = names; *name; name++) {
+        if (!is_nvme_namespace(*name)) continue;
+        char* controller_name = nvme_controller_name(backend, *name);
+        if (!controller_name) continue;
+
+        NvmeController* controller = NULL;
+        for (guint i = 0; i < controllers->len && !controller; i++) {
+            NvmeController* candidate = g_ptr_array_index(controllers, i);
+            if (strcmp(candidate->name, controller_name) == 0) controller = candidate;
+        }
+        if (!controller) {
+            controller = g_new0(NvmeController, 1);
+            g_strlcpy(controller->name, controller_name, sizeof(controller->name));
+            controller->active = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+            controller->namespaces = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+            controller->devices = g_ptr_array_new_with_free_func(g_free);
+            g_ptr_array_add(controllers, controller);
+        }
+        g_ptr_array_add(controller->devices, g_strdup(*name));
+        g_free(controller_name);
+    }
+
+    for (guint i = 0; i < controllers->len; i++) {
+        NvmeController* controller = g_ptr_array_index(controllers, i);
+        uint32_t* fallback = g_new(uint32_t, controller->devices->len);
+        for (guint d = 0; d < controller->devices->len; d++) {
+            fallback[d] = nvme_device_nsid(backend, g_ptr_array_index(controller->devices, d));
+        }
+        nvme_controller_probe(backend, controller, fallback, controller->devices->len);
+        g_free(fallback);
+    }
+    return controllers;
+}
+
+static NvmeController* nvme_topology_find(GPtrArray* controllers, const char* device_name) {
+    for (guint i = 0; i < controllers->len; i++) {
+        NvmeController* controller = g_ptr_array_index(controllers, i);
+        for (guint d = 0; d < controller->devices->len; d++) {
+            if (strcmp(g_ptr_array_index(controller->devices, d), device_name) == 0) return controller;
+        }
+    }
+    return NULL;
+}
+
+static FlValue* nvme_controller_to_fl_value(const DeviceBackend* backend, const NvmeController* controller) {
+    FlValue* result = fl_value_new_map();
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/%s", controller->name);
+    fl_value_set_string_take(result, "name", fl_value_new_string(controller->name));
+    fl_value_set_string_take(result, "devicePath", fl_value_new_string(path));
+    fl_value_set_string_take(result, "probed", fl_value_new_bool(controller->probed));
+    fl_value_set_string_take(result, "adminCommands", fl_value_new_int(controller->admin_commands));
+
+    if (controller->probed) {
+        const IdentifyField* f = identify_nvme_controller_table.fields;
+        char text[IDENTIFY_TEXT_MAX];
+        identify_read_text(&f[ID_CTRL_SN], controller->identify, text, sizeof(text));
+        fl_value_set_string_take(result, "serialNumber", fl_value_new_string(text));
+        identify_read_text(&f[ID_CTRL_MN], controller->identify, text, sizeof(text));
+        fl_value_set_string_take(result, "modelName", fl_value_new_string(text));
+        identify_read_text(&f[ID_CTRL_FR], controller->identify, text, sizeof(text));
+        fl_value_set_string_take(result, "firmwareRevision", fl_value_new_string(text));
+        fl_value_set_string_take(result, "controllerId",
+                                 fl_value_new_int((int64_t)identify_read(&f[ID_CTRL_CNTLID], controller->identify)));
+        fl_value_set_string_take(result, "maxNamespaces",
+                                 fl_value_new_int((int64_t)identify_read(&f[ID_CTRL_NN], controller->identify)));
+    }
+
+    // Active namespaces, with the block device each one appears as
+    FlValue* namespaces = fl_value_new_list();
+    const IdentifyField* nsf = identify_nvme_namespace_table.fields;
+    const IdentifyField* lbaf = identify_nvme_lba_format_table.fields;
+    for (guint i = 0; i < controller->active->len; i++) {
+        uint32_t nsid = g_array_index(controller->active, uint32_t, i);
+        FlValue* entry = fl_value_new_map();
+        fl_value_set_string_take(entry, "namespaceId", fl_value_new_int(nsid));
+
+        for (guint d = 0; d < controller->devices->len; d++) {
+            const char* device_name = g_ptr_array_index(controller->devices, d);
+            if (nvme_device_nsid(backend, device_name) == nsid) {
+                fl_value_set_string_take(entry, "deviceName", fl_value_new_string(device_name));
+                break;
+            }
+        }
+
+        const uint8_t* ns = g_hash_table_lookup(controller->namespaces, GUINT_TO_POINTER(nsid));
+        if (ns) {
+            // Block size of the format in use (FLBAS bits 3:0, 6:5)
+            guint format = (guint)(identify_read(&nsf[ID_NS_FLBAS_INDEX_LO], ns) |
+                                   identify_read(&nsf[ID_NS_FLBAS_INDEX_HI], ns) << 4);
+            guint lbads = format < IDENTIFY_LBAF_MAX
+                ? (guint)identify_read(&lbaf[ID_LBAF_LBADS], ns + IDENTIFY_LBAF_OFFSET + format * 4)
+                : 0;
+            uint64_t block_size = lbads >= 9 && lbads < 32 ? (uint64_t)1 << lbads : 0;
+            fl_value_set_string_take(entry, "blockSize", fl_value_new_int((int64_t)block_size));
+            fl_value_set_string_take(entry, "sizeBytes",
+                                     fl_value_new_int((int64_t)(identify_read(&nsf[ID_NS_NSZE], ns) * block_size)));
+        }
+        fl_value_append_take(namespaces, entry);
+    }
+    fl_value_set_string_take(result, "namespaces", namespaces);
+    return result;
+}
+
+FlValue* device_registry_get_nvme_controllers(const DeviceBackend* backend, GError** error) {
+    char** names = backend->list_devices(backend->ctx);
+    if (!names) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                    "Failed to open /sys/block");
+        return NULL;
+    }
+
+    GPtrArray* controllers = nvme_topology_probe(backend, names);
+    FlValue* result = fl_value_new_list();
+    for (guint i = 0; i < controllers->len; i++) {
+        fl_value_append_take(result, nvme_controller_to_fl_value(backend, g_ptr_array_index(controllers, i)));
+    }
+    g_ptr_array_free(controllers, TRUE);
+    g_strfreev(names);
     return result;
 }
 
 // Enumerate all devices
 FlValue* device_registry_enumerate_all_devices(GError** error) {
-    FlValue* devices = fl_value_new_list();
-    
-    DIR* dir = opendir("/sys/block");
-    if (!dir) {
+    return device_registry_enumerate_devices(device_backend_linux(), error);
+}
+
+FlValue* device_registry_enumerate_devices(const DeviceBackend* backend, GError** error) {
+    DeviceQuery query = { .fields = DEVICE_FIELDS_ALL };
+    FlValue* devices = device_registry_query(backend, NULL, &query, error);
+    return devices ? devices : fl_value_new_list();
+}
+
+// Field groups: the always-present basic fields plus one per DeviceFields bit
+enum {
+    GROUP_BASIC,
+    GROUP_GEOMETRY,
+    GROUP_DISCARD,
+    GROUP_IDENTITY,
+    GROUP_SECURITY,
+    GROUP_PARTITIONS,
+    GROUP_COUNT
+};
+
+static const char* const group_names[GROUP_COUNT] = {
+    [GROUP_GEOMETRY] = "geometry",
+    [GROUP_DISCARD] = "discard",
+    [GROUP_IDENTITY] = "identity",
+    [GROUP_SECURITY] = "security",
+    [GROUP_PARTITIONS] = "partitions",
+};
+
+#define GROUP_BIT(group) (1u << ((group) - 1))
+
+guint device_fields_from_name(const char* name) {
+    if (strcmp(name, "all") == 0) return DEVICE_FIELDS_ALL;
+    for (int group = GROUP_BASIC + 1; group < GROUP_COUNT; group++) {
+        if (strcmp(name, group_names[group]) == 0) return GROUP_BIT(group);
+    }
+    return 0;
+}
+
+// Each group is a map of the keys it contributes to the device map
+typedef struct {
+    FlValue* groups[GROUP_COUNT];
+} DeviceEntry;
+
+struct DeviceRegistryCache {
+    GMutex lock;
+    GHashTable* entries;    // device name -> DeviceEntry
+    guint64 generation;     // bumped by every invalidation
+};
+
+static void device_entry_free(gpointer data) {
+    DeviceEntry* entry = data;
+    for (int group = 0; group < GROUP_COUNT; group++) {
+        if (entry->groups[group]) fl_value_unref(entry->groups[group]);
+    }
+    g_free(entry);
+}
+
+DeviceRegistryCache* device_registry_cache_new(void) {
+    DeviceRegistryCache* cache = g_new0(DeviceRegistryCache, 1);
+    g_mutex_init(&cache->lock);
+    cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, device_entry_free);
+    return cache;
+}
+
+void device_registry_cache_free(DeviceRegistryCache* cache) {
+    if (!cache) return;
+    g_hash_table_destroy(cache->entries);
+    g_mutex_clear(&cache->lock);
+    g_free(cache);
+}
+
+void device_registry_cache_invalidate(DeviceRegistryCache* cache, const char* device_name) {
+    g_mutex_lock(&cache->lock);
+    if (device_name) {
+        g_hash_table_remove(cache->entries, device_name);
+    } else {
+        g_hash_table_remove_all(cache->entries);
+    }
+    cache->generation++;
+    g_mutex_unlock(&cache->lock);
+}
+
+void device_registry_cache_apply_uevent(const Uevent* event, void* user_data) {
+    DeviceRegistryCache* cache = user_data;
+
+    if (!event) {
+        device_registry_cache_invalidate(cache, NULL);
+        return;
+    }
+    if (strcmp(event->subsystem, "block") != 0 || event->devname[0] == '\0') return;
+
+    if (strcmp(event->devtype, "partition") != 0) {
+        device_registry_cache_invalidate(cache, event->devname);
+        return;
+    }
+
+    // A partition appeared, changed or went away: only the disk's partition
+    // list is stale. The disk is the parent directory in the devpath.
+    const char* end = strrchr(event->devpath, '/');
+    if (!end || end == event->devpath) return;
+    const char* start = end - 1;
+    while (start > event->devpath && *start != '/') start--;
+    char disk[64];
+    g_strlcpy(disk, start + 1, MIN(sizeof(disk), (size_t)(end - start)));
+
+    g_mutex_lock(&cache->lock);
+    DeviceEntry* entry = g_hash_table_lookup(cache->entries, disk);
+    if (entry && entry->groups[GROUP_PARTITIONS]) {
+        fl_value_unref(entry->groups[GROUP_PARTITIONS]);
+        entry->groups[GROUP_PARTITIONS] = NULL;
+    }
+    cache->generation++;
+    g_mutex_unlock(&cache->lock);
+}
+
+static gboolean read_text_attr(const DeviceBackend* backend, const char* device_name,
+                               const char* attr, char* buffer, size_t size) {
+    if (backend->read_attr(device_name, attr, buffer, size, backend->ctx) < 0) return FALSE;
+    g_strstrip(buffer);
+    return buffer[0] != '\0';
+}
+
+// Bus the device hangs off, from the subsystem directories in its sysfs path
+static const char* get_transport(const DeviceBackend* backend, const char* device_name,
+                                 const char* device_type) {
+    char* path = backend->sysfs_path ? backend->sysfs_path(device_name, backend->ctx) : NULL;
+    const char* transport;
+    if (!path) {
+        transport = strcmp(device_type, "unknown") == 0 ? "unknown" : device_type;
+    } else if (strstr(path, "/usb")) {
+        transport = "usb";
+    } else if (strstr(path, "/nvme")) {
+        transport = "nvme";
+    } else if (strstr(path, "/mmc")) {
+        transport = "mmc";
+    } else if (strstr(path, "/virtio")) {
+        transport = "virtio";
+    } else if (strstr(path, "/ata")) {
+        transport = "sata";
+    } else if (strstr(path, "/host")) {
+        transport = "scsi";
+    } else {
+        transport = "unknown";
+    }
+    g_free(path);
+    return transport;
+}
+
+static FlValue* probe_basic(const DeviceBackend* backend, const char* device_name) {
+    FlValue* group = fl_value_new_map();
+    char device_path[512];
+    snprintf(device_path, sizeof(device_path), "/dev/%s", device_name);
+    fl_value_set_string_take(group, "devicePath", fl_value_new_string(device_path));
+    fl_value_set_string_take(group, "deviceName", fl_value_new_string(device_name));
+
+    const char* dev_type = get_device_type(backend, device_name);
+    fl_value_set_string_take(group, "deviceType", fl_value_new_string(dev_type));
+    fl_value_set_string_take(group, "transport",
+                             fl_value_new_string(get_transport(backend, device_name, dev_type)));
+
+    uint64_t sectors = 0;
+    device_backend_read_u64(backend, device_name, "size", &sectors);
+    // sysfs size is in 512-byte units
+    fl_value_set_string_take(group, "totalBytes", fl_value_new_int((int64_t)sectors * 512));
+
+    uint64_t flag = 0;
+    fl_value_set_string_take(group, "removable", fl_value_new_bool(
+        device_backend_read_u64(backend, device_name, "removable", &flag) && flag));
+    flag = 0;
+    fl_value_set_string_take(group, "rotational", fl_value_new_bool(
+        device_backend_read_u64(backend, device_name, "queue/rotational", &flag) && flag));
+
+    // The kernel's copy of the identify strings; IDENTITY replaces them
+    // with what the drive reports
+    char text[256];
+    fl_value_set_string_take(group, "modelName", fl_value_new_string(
+        read_text_attr(backend, device_name, "device/model", text, sizeof(text)) ? text : "Unknown"));
+    fl_value_set_string_take(group, "serialNumber", fl_value_new_string(
+        read_text_attr(backend, device_name, "device/serial", text, sizeof(text)) ? text : "Unknown"));
+
+    // UUID (placeholder)
+    fl_value_set_string_take(group, "uuid", fl_value_new_string(""));
+    return group;
+}
+
+static FlValue* probe_geometry(const DeviceBackend* backend, const char* device_name,
+                               FlValue* basic) {
+    uint64_t logical = 512, physical = 0;
+    if (!device_backend_read_u64(backend, device_name, "queue/logical_block_size", &logical) ||
+        logical == 0) {
+        logical = 512;
+    }
+    if (!device_backend_read_u64(backend, device_name, "queue/physical_block_size", &physical) ||
+        physical < logical) {
+        physical = logical;
+    }
+    int64_t total_bytes = fl_value_get_int(fl_value_lookup_string(basic, "totalBytes"));
+
+    FlValue* geometry = fl_value_new_map();
+    fl_value_set_string_take(geometry, "logicalSectorSize", fl_value_new_int((int64_t)logical));
+    fl_value_set_string_take(geometry, "physicalSectorSize", fl_value_new_int((int64_t)physical));
+    fl_value_set_string_take(geometry, "userAddressableSectors",
+                             fl_value_new_int(total_bytes / (int64_t)logical));
+
+    FlValue* group = fl_value_new_map();
+    fl_value_set_string_take(group, "geometry", geometry);
+    return group;
+}
+
+static FlValue* probe_discard(const DeviceBackend* backend, const char* device_name) {
+    FlValue* group = fl_value_new_map();
+    DiscardCapabilities discard_caps;
+    if (discard_get_capabilities_from(backend, device_name, &discard_caps)) {
+        fl_value_set_string_take(group, "discard", discard_capabilities_to_fl_value(&discard_caps));
+    }
+    return group;
+}
+
+// Empty map when the drive did not answer IDENTIFY
+static FlValue* probe_identity(const DeviceBackend* backend, const char* device_name,
+                               const char* dev_type, GPtrArray* nvme_controllers) {
+    char device_path[512];
+    snprintf(device_path, sizeof(device_path), "/dev/%s", device_name);
+
+    const char* key = NULL;
+    FlValue* identity = NULL;
+    if (strcmp(dev_type, "nvme") == 0) {
+        NvmeController* controller = nvme_controllers ?
+            nvme_topology_find(nvme_controllers, device_name) : NULL;
+        if (controller && controller->probed) {
+            uint32_t nsid = nvme_device_nsid(backend, device_name);
+            identity = nvme_identity_to_fl_value(
+                controller->identify,
+                g_hash_table_lookup(controller->namespaces, GUINT_TO_POINTER(nsid)));
+            fl_value_set_string_take(identity, "controllerName", fl_value_new_string(controller->name));
+            fl_value_set_string_take(identity, "namespaceId", fl_value_new_int(nsid));
+        } else {
+            // Controller node not accessible: ask the namespace node
+            identity = get_nvme_identity(backend, device_path, NULL);
+        }
+        key = "nvmeIdentity";
+    } else if (strcmp(dev_type, "sata") == 0) {
+        identity = get_ata_identity(backend, device_path, NULL);
+        key = "ataIdentity";
+    }
+
+    FlValue* group = fl_value_new_map();
+    if (identity) {
+        FlValue* model = fl_value_lookup_string(identity, "modelName");
+        FlValue* serial = fl_value_lookup_string(identity, "serialNumber");
+        if (model && fl_value_get_string(model)[0]) {
+            fl_value_set_string(group, "modelName", model);
+        }
+        if (serial && fl_value_get_string(serial)[0]) {
+            fl_value_set_string(group, "serialNumber", serial);
+        }
+        fl_value_set_string_take(group, key, identity);
+    }
+    return group;
+}
+
+// Derived from the IDENTITY group; drives that did not answer report nothing
+static FlValue* probe_security(FlValue* identity_group) {
+    gboolean supported = FALSE, enabled = FALSE, locked = FALSE, frozen = FALSE, enhanced = FALSE;
+    FlValue* methods = fl_value_new_list();
+
+    FlValue* ata = fl_value_lookup_string(identity_group, "ataIdentity");
+    FlValue* nvme = fl_value_lookup_string(identity_group, "nvmeIdentity");
+    if (ata) {
+        FlValue* ata_security = fl_value_lookup_string(ata, "security");
+        supported = fl_value_get_bool(fl_value_lookup_string(ata_security, "isSecuritySupported"));
+        enabled = fl_value_get_bool(fl_value_lookup_string(ata_security, "isSecurityEnabled"));
+        locked = fl_value_get_bool(fl_value_lookup_string(ata_security, "isSecurityLocked"));
+        frozen = fl_value_get_bool(fl_value_lookup_string(ata_security, "isSecurityFrozen"));
+        enhanced = fl_value_get_bool(fl_value_lookup_string(ata_security, "isEnhancedEraseSupported"));
+        if (supported) {
+            fl_value_append_take(methods, fl_value_new_string("ata_secure_erase"));
+            if (enhanced) fl_value_append_take(methods, fl_value_new_string("ata_enhanced_secure_erase"));
+        }
+    } else if (nvme) {
+        FlValue* sanitize = fl_value_lookup_string(nvme, "supportedSanitizationMethods");
+        for (size_t i = 0; sanitize && i < fl_value_get_length(sanitize); i++) {
+            fl_value_append(methods, fl_value_get_list_value(sanitize, i));
+        }
+    }
+
+    FlValue* security = fl_value_new_map();
+    fl_value_set_string_take(security, "isSecuritySupported", fl_value_new_bool(supported));
+    fl_value_set_string_take(security, "isSecurityEnabled", fl_value_new_bool(enabled));
+    fl_value_set_string_take(security, "isSecurityLocked", fl_value_new_bool(locked));
+    fl_value_set_string_take(security, "isSecurityFrozen", fl_value_new_bool(frozen));
+    fl_value_set_string_take(security, "isEnhancedEraseSupported", fl_value_new_bool(enhanced));
+    fl_value_set_string_take(security, "supportedSanitizationMethods", methods);
+
+    FlValue* group = fl_value_new_map();
+    fl_value_set_string_take(group, "security", security);
+    return group;
+}
+
+// Partition tables are only read from real disks; simulated devices have none
+static FlValue* probe_partitions(const DeviceBackend* backend, const char* device_name) {
+    FlValue* partitions = fl_value_new_list();
+    RangeExtent* extents = NULL;
+    size_t count = 0;
+    if (backend == device_backend_linux() &&
+        range_wipe_list_partitions(NULL, device_name, &extents, &count, NULL)) {
+        for (size_t i = 0; i < count; i++) {
+            char path[128];
+            snprintf(path, sizeof(path), "/dev/%s", extents[i].name);
+            char* type = blkid_get_tag_value(NULL, "TYPE", path);
+            char* label = blkid_get_tag_value(NULL, "PARTLABEL", path);
+            if (!label) label = blkid_get_tag_value(NULL, "LABEL", path);
+
+            FlValue* partition = fl_value_new_map();
+            fl_value_set_string_take(partition, "partitionPath", fl_value_new_string(path));
+            fl_value_set_string_take(partition, "startSector", fl_value_new_int((int64_t)extents[i].start_sector));
+            fl_value_set_string_take(partition, "sizeSectors", fl_value_new_int((int64_t)extents[i].size_sectors));
+            fl_value_set_string_take(partition, "filesystemType", fl_value_new_string(type ? type : ""));
+            fl_value_set_string_take(partition, "partitionLabel", fl_value_new_string(label ? label : ""));
+            fl_value_append_take(partitions, partition);
+            free(type);
+            free(label);
+        }
+        g_free(extents);
+    }
+
+    FlValue* group = fl_value_new_map();
+    fl_value_set_string_take(group, "partitions", partitions);
+    return group;
+}
+
+static gboolean matches_any(const char* const* list, const char* value, const char* alternative) {
+    if (!list) return TRUE;
+    for (; *list; list++) {
+        if (strcmp(*list, value) == 0 || (alternative && strcmp(*list, alternative) == 0)) return TRUE;
+    }
+    return FALSE;
+}
+
+static gboolean matches_query(const DeviceQuery* query, const char* device_name, FlValue* basic) {
+    return matches_any(query->paths, device_name,
+                       fl_value_get_string(fl_value_lookup_string(basic, "devicePath"))) &&
+           matches_any(query->types,
+                       fl_value_get_string(fl_value_lookup_string(basic, "deviceType")), NULL) &&
+           matches_any(query->transports,
+                       fl_value_get_string(fl_value_lookup_string(basic, "transport")), NULL);
+}
+
+typedef struct {
+    char* name;
+    DeviceEntry groups;     // references held by this query
+    guint probed;           // groups computed by this query, 1 << group
+} QueryDevice;
+
+static void query_device_clear(gpointer data) {
+    QueryDevice* device = data;
+    g_free(device->name);
+    for (int group = 0; group < GROUP_COUNT; group++) {
+        if (device->groups.groups[group]) fl_value_unref(device->groups.groups[group]);
+    }
+}
+
+static void query_device_set(QueryDevice* device, int group, FlValue* value) {
+    device->groups.groups[group] = value;
+    device->probed |= 1u << group;
+}
+
+FlValue* device_registry_query(const DeviceBackend* backend,
+                               DeviceRegistryCache* cache,
+                               const DeviceQuery* query,
+                               GError** error) {
+    char** names = backend->list_devices(backend->ctx);
+    if (!names) {
         g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
                     "Failed to open /sys/block");
-        return devices;
+        return NULL;
     }
-    
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
-        // Skip . and ..
-        if (entry->d_name[0] == '.') continue;
-        
-        // Skip loop devices and ram devices
-        if (strncmp(entry->d_name, "loop", 4) == 0 ||
-            strncmp(entry->d_name, "ram", 3) == 0) {
+
+    GArray* selected = g_array_new(FALSE, TRUE, sizeof(QueryDevice));
+    g_array_set_clear_func(selected, query_device_clear);
+
+    // Take references to what is memoized, so probing runs unlocked
+    guint64 generation = 0;
+    if (cache) {
+        g_mutex_lock(&cache->lock);
+        generation = cache->generation;
+    }
+    for (char** name = names; *name; name++) {
+        const char* device_name = *name;
+
+        // Skip loop devices, ram devices and hidden NVMe multipath paths
+        if (strncmp(device_name, "loop", 4) == 0 ||
+            strncmp(device_name, "ram", 3) == 0 ||
+            (strncmp(device_name, "nvme", 4) == 0 && !is_nvme_namespace(device_name))) {
             continue;
         }
-        
-        char device_path[512];
-        snprintf(device_path, sizeof(device_path), "/dev/%s", entry->d_name);
-        
-        // Get device information
-        FlValue* device = fl_value_new_map();
-        
-        // Device path and name
-        fl_value_set_string_take(device, "devicePath", fl_value_new_string(device_path));
-        fl_value_set_string_take(device, "deviceName", fl_value_new_string(entry->d_name));
-        
-        // Device type
-        const char* dev_type = get_device_type(entry->d_name);
-        fl_value_set_string_take(device, "deviceType", fl_value_new_string(dev_type));
-        
-        // Get size from sysfs
-        char size_path[512];
-        snprintf(size_path, sizeof(size_path), "/sys/block/%s/size", entry->d_name);
-        char* size_str = read_sysfs_attr(size_path);
-        int64_t total_bytes = 0;
-        if (size_str) {
-            int64_t sectors = atoll(size_str);
-            total_bytes = sectors * 512;  // Assuming 512-byte sectors
-            free(size_str);
+
+        QueryDevice device = { .name = g_strdup(device_name) };
+        DeviceEntry* entry = cache && !query->refresh ?
+            g_hash_table_lookup(cache->entries, device_name) : NULL;
+        for (int group = 0; entry && group < GROUP_COUNT; group++) {
+            if (entry->groups[group]) device.groups.groups[group] = fl_value_ref(entry->groups[group]);
+        }
+        g_array_append_val(selected, device);
+    }
+    if (cache) {
+        // Devices that are gone take their entries with them
+        GHashTableIter iter;
+        gpointer key;
+        g_hash_table_iter_init(&iter, cache->entries);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            if (!g_strv_contains((const char* const*)names, key)) g_hash_table_iter_remove(&iter);
+        }
+        g_mutex_unlock(&cache->lock);
+    }
+    g_strfreev(names);
+
+    // The filter only needs the basic fields
+    for (guint i = 0; i < selected->len;) {
+        QueryDevice* device = &g_array_index(selected, QueryDevice, i);
+        if (!device->groups.groups[GROUP_BASIC]) {
+            query_device_set(device, GROUP_BASIC, probe_basic(backend, device->name));
+        }
+        if (matches_query(query, device->name, device->groups.groups[GROUP_BASIC])) {
+            i++;
+        } else {
+            g_array_remove_index(selected, i);
+        }
+    }
+
+    // Security is read from the identify data
+    guint fields = query->fields;
+    gboolean need_identity = (fields & (DEVICE_FIELD_IDENTITY | DEVICE_FIELD_SECURITY)) != 0;
+
+    // One pass over the NVMe controllers for every namespace still unidentified
+    GPtrArray* nvme_controllers = NULL;
+    if (need_identity) {
+        GPtrArray* nvme_names = g_ptr_array_new();
+        for (guint i = 0; i < selected->len; i++) {
+            QueryDevice* device = &g_array_index(selected, QueryDevice, i);
+            if (!device->groups.groups[GROUP_IDENTITY] && is_nvme_namespace(device->name)) {
+                g_ptr_array_add(nvme_names, device->name);
+            }
+        }
+        if (nvme_names->len > 0) {
+            g_ptr_array_add(nvme_names, NULL);
+            nvme_controllers = nvme_topology_probe(backend, (char**)nvme_names->pdata);
+        }
+        g_ptr_array_free(nvme_names, TRUE);
+    }
+
+    FlValue* devices = fl_value_new_list();
+    for (guint i = 0; i < selected->len; i++) {
+        QueryDevice* device = &g_array_index(selected, QueryDevice, i);
+        FlValue** groups = device->groups.groups;
+        FlValue* basic = groups[GROUP_BASIC];
+        const char* dev_type = fl_value_get_string(fl_value_lookup_string(basic, "deviceType"));
+
+        if ((fields & DEVICE_FIELD_GEOMETRY) && !groups[GROUP_GEOMETRY]) {
+            query_device_set(device, GROUP_GEOMETRY, probe_geometry(backend, device->name, basic));
+        }
+        if ((fields & DEVICE_FIELD_DISCARD) && !groups[GROUP_DISCARD]) {
+            query_device_set(device, GROUP_DISCARD, probe_discard(backend, device->name));
+        }
+        if (need_identity && !groups[GROUP_IDENTITY]) {
+            query_device_set(device, GROUP_IDENTITY,
+                             probe_identity(backend, device->name, dev_type, nvme_controllers));
         }
-        fl_value_set_string_take(device, "totalBytes", fl_value_new_int(total_bytes));
-        
-        // Try to get detailed identity information
-        if (strcmp(dev_type, "nvme") == 0) {
-            FlValue* nvme_id = device_registry_get_nvme_identity(device_path, NULL);
-            if (nvme_id) {
-                fl_value_set_string_take(device, "nvmeIdentity", nvme_id);
+        if ((fields & DEVICE_FIELD_SECURITY) && !groups[GROUP_SECURITY]) {
+            query_device_set(device, GROUP_SECURITY, probe_security(groups[GROUP_IDENTITY]));
+        }
+        if ((fields & DEVICE_FIELD_PARTITIONS) && !groups[GROUP_PARTITIONS]) {
+            query_device_set(device, GROUP_PARTITIONS, probe_partitions(backend, device->name));
+        }
+
+        // Later groups override the basic model and serial
+        FlValue* map = fl_value_new_map();
+        for (int group = 0; group < GROUP_COUNT; group++) {
+            if (group != GROUP_BASIC && !(fields & GROUP_BIT(group))) continue;
+            FlValue* values = groups[group];
+            for (size_t k = 0; k < fl_value_get_length(values); k++) {
+                fl_value_set(map, fl_value_get_map_key(values, k), fl_value_get_map_value(values, k));
             }
-        } else if (strcmp(dev_type, "sata") == 0) {
-            FlValue* ata_id = device_registry_get_ata_identity(device_path, NULL);
-            if (ata_id) {
-                fl_value_set_string_take(device, "ataIdentity", ata_id);
+        }
+        fl_value_append_take(devices, map);
+    }
+
+    // Store the new groups unless an invalidation raced with the probes
+    if (cache) {
+        g_mutex_lock(&cache->lock);
+        if (cache->generation == generation) {
+            for (guint i = 0; i < selected->len; i++) {
+                QueryDevice* device = &g_array_index(selected, QueryDevice, i);
+                if (!device->probed) continue;
+                DeviceEntry* entry = g_hash_table_lookup(cache->entries, device->name);
+                if (!entry) {
+                    entry = g_new0(DeviceEntry, 1);
+                    g_hash_table_insert(cache->entries, g_strdup(device->name), entry);
+                }
+                for (int group = 0; group < GROUP_COUNT; group++) {
+                    if (!(device->probed & (1u << group))) continue;
+                    if (entry->groups[group]) fl_value_unref(entry->groups[group]);
+                    entry->groups[group] = fl_value_ref(device->groups.groups[group]);
+                }
             }
         }
-        
-        // Add basic geometry
-        FlValue* geometry = fl_value_new_map();
-        fl_value_set_string_take(geometry, "logicalSectorSize", fl_value_new_int(512));
-        fl_value_set_string_take(geometry, "physicalSectorSize", fl_value_new_int(512));
-        fl_value_set_string_take(geometry, "userAddressableSectors", fl_value_new_int(total_bytes / 512));
-        fl_value_set_string_take(device, "geometry", geometry);
-        
-        // Add basic security (will be populated from identity data)
-        FlValue* security = fl_value_new_map();
-        fl_value_set_string_take(security, "isSecuritySupported", fl_value_new_bool(false));
-        fl_value_set_string_take(security, "isSecurityEnabled", fl_value_new_bool(false));
-        fl_value_set_string_take(security, "isSecurityLocked", fl_value_new_bool(false));
-        fl_value_set_string_take(security, "isSecurityFrozen", fl_value_new_bool(false));
-        fl_value_set_string_take(security, "isEnhancedEraseSupported", fl_value_new_bool(false));
-        fl_value_set_string_take(security, "supportedSanitizationMethods", fl_value_new_list());
-        fl_value_set_string_take(device, "security", security);
-        
-        // Add empty partitions list (will be populated separately)
-        fl_value_set_string_take(device, "partitions", fl_value_new_list());
-        
-        // UUID (placeholder)
-        fl_value_set_string_take(device, "uuid", fl_value_new_string(""));
-        
-        // Model and serial (placeholders, will be from identity)
-        fl_value_set_string_take(device, "modelName", fl_value_new_string("Unknown"));
-        fl_value_set_string_take(device, "serialNumber", fl_value_new_string("Unknown"));
-        
-        fl_value_append_take(devices, device);
+        g_mutex_unlock(&cache->lock);
     }
-    
-    closedir(dir);
+
+    if (nvme_controllers) g_ptr_array_free(nvme_controllers, TRUE);
+    g_array_free(selected, TRUE);
     return devices;
 }
@@ -2,6 +2,8 @@
 #define DEVICE_REGISTRY_H
 
 #include <flutter_linux/flutter_linux.h>
+#include "device_backend.h"
+#include "uevent_monitor.h"
 
 G_BEGIN_DECLS
 
@@ -14,6 +16,103 @@ G_BEGIN_DECLS
  */
 FlValue* device_registry_enumerate_all_devices(GError** error);
 
+/**
+ * device_registry_enumerate_devices:
+ * @backend: where device names, sysfs attributes and identity data come from
+ *
+ * Same as device_registry_enumerate_all_devices() through @backend, so the
+ * probing path can run against simulated devices.
+ *
+ * Returns: (transfer full): A FlValue containing a list of device information maps
+ */
+FlValue* device_registry_enumerate_devices(const DeviceBackend* backend, GError** error);
+
+/*
+ * Optional field groups of a device map. The basic fields (devicePath,
+ * deviceName, deviceType, transport, totalBytes, removable, rotational,
+ * modelName, serialNumber, uuid) come from sysfs attributes alone and are
+ * always present; each group below costs more and is probed only when asked
+ * for. IDENTITY and SECURITY send IDENTIFY to the drive, which spins up a
+ * sleeping disk; PARTITIONS reads the partition nodes.
+ */
+typedef enum {
+    DEVICE_FIELD_GEOMETRY   = 1 << 0,  // "geometry": sector sizes from queue/
+    DEVICE_FIELD_DISCARD    = 1 << 1,  // "discard": offload limits
+    DEVICE_FIELD_IDENTITY   = 1 << 2,  // "ataIdentity" / "nvmeIdentity", identified model and serial
+    DEVICE_FIELD_SECURITY   = 1 << 3,  // "security": lock state and sanitize methods
+    DEVICE_FIELD_PARTITIONS = 1 << 4,  // "partitions": extents and filesystem tags
+} DeviceFields;
+
+#define DEVICE_FIELDS_NONE 0
+#define DEVICE_FIELDS_ALL  0x1F
+
+/**
+ * device_fields_from_name:
+ * @name: a group name as it appears in the device map ("geometry",
+ *   "discard", "identity", "security", "partitions") or "all"
+ *
+ * Returns: the group bit, or 0 for an unknown name
+ */
+guint device_fields_from_name(const char* name);
+
+/**
+ * DeviceQuery:
+ * @fields: groups to include on top of the basic fields
+ * @paths: (nullable): only these devices, as "/dev/sda" or "sda"
+ * @types: (nullable): only these deviceType values ("sata", "nvme", ...)
+ * @transports: (nullable): only these transport values ("nvme", "sata",
+ *   "usb", "mmc", "virtio", "scsi")
+ * @refresh: ignore memoized results and probe again
+ *
+ * The filter lists are NULL-terminated; a NULL list matches everything.
+ */
+typedef struct {
+    guint fields;
+    const char* const* paths;
+    const char* const* types;
+    const char* const* transports;
+    gboolean refresh;
+} DeviceQuery;
+
+/*
+ * Memoized per-device field groups. Entries are dropped by uevents for the
+ * device (and for its partitions, which drop the disk's partition list), so
+ * repeated queries touch the drive only after something changed.
+ */
+typedef struct DeviceRegistryCache DeviceRegistryCache;
+
+DeviceRegistryCache* device_registry_cache_new(void);
+void device_registry_cache_free(DeviceRegistryCache* cache);
+
+// Drops the memoized groups of @device_name, or of every device when NULL
+void device_registry_cache_invalidate(DeviceRegistryCache* cache, const char* device_name);
+
+/**
+ * device_registry_cache_apply_uevent:
+ * @event: (nullable): a block uevent, or NULL after lost events
+ *
+ * Invalidates what @event may have changed; NULL invalidates everything.
+ * Usable directly as a UeventCallback with the cache as user data.
+ */
+void device_registry_cache_apply_uevent(const Uevent* event, void* cache);
+
+/**
+ * device_registry_query:
+ * @backend: where device names, sysfs attributes and identity data come from
+ * @cache: (nullable): memoized groups to reuse and fill, NULL to probe everything
+ * @query: the groups and devices wanted
+ *
+ * Like device_registry_enumerate_devices() but runs only the probes the
+ * requested groups need, for the devices that pass the filter. NVMe
+ * controllers are probed once for all namespaces that need identity.
+ *
+ * Returns: (transfer full): a list of device maps, or NULL with @error set
+ */
+FlValue* device_registry_query(const DeviceBackend* backend,
+                               DeviceRegistryCache* cache,
+                               const DeviceQuery* query,
+                               GError** error);
+
 /**
  * device_registry_get_ata_identity:
  * @device_path: Path to the device (e.g., "/dev/sda")
@@ -34,6 +133,21 @@ FlValue* device_registry_get_ata_identity(const char* device_path, GError** erro
  */
 FlValue* device_registry_get_nvme_identity(const char* device_path, GError** error);
 
+/**
+ * device_registry_get_nvme_controllers:
+ * @backend: where device names, sysfs attributes and identity data come from
+ *
+ * Lists the NVMe controllers behind the namespace block devices. Each
+ * controller is asked once for Identify Controller and the Active
+ * Namespace ID List, then for Identify Namespace of every active
+ * namespace, so N namespaces cost N + 2 admin commands.
+ *
+ * Returns: (transfer full): a list of maps with the controller "name",
+ *   "devicePath", identity fields, "adminCommands" issued and its
+ *   "namespaces" (ID, block device, size), or NULL with @error set
+ */
+FlValue* device_registry_get_nvme_controllers(const DeviceBackend* backend, GError** error);
+
 G_END_DECLS
 
 #endif // DEVICE_REGISTRY_H
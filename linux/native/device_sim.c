@@ -0,0 +1,757 @@
+#define _GNU_SOURCE
+#include "device_sim.h"
+#include "identify_decode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <endian.h>
+#include <linux/fs.h>
+
+// Simulated descriptors live far above anything the process will open, so
+// one handed to a real syscall by mistake fails with EBADF
+#define DEVICE_SIM_FD_BASE (1 << 24)
+// Controller nodes get descriptors of their own, numbered after the
+// namespace that answers Identify Controller for them
+#define DEVICE_SIM_CONTROLLER_FD_BASE (DEVICE_SIM_FD_BASE + DEVICE_SIM_MAX_DEVICES)
+// Granularity of retained data
+#define DEVICE_SIM_PAGE_SIZE (64 * 1024)
+
+typedef struct {
+    DeviceSimSpec spec;
+    pthread_mutex_t lock;     // guards pages and stats
+    GHashTable* pages;        // page index -> DEVICE_SIM_PAGE_SIZE bytes
+    DeviceSimStats stats;
+    guint in_flight;          // atomic
+    gint forced;              // atomic: -1 follow hotplug timing, 0 absent, 1 present
+} SimDevice;
+
+struct DeviceSim {
+    DeviceBackend backend;
+    double time_scale;
+    gint64 created_us;
+    SimDevice* devices[DEVICE_SIM_MAX_DEVICES];
+    guint count;
+};
+
+static gboolean is_present(const DeviceSim* sim, SimDevice* device) {
+    gint forced = __atomic_load_n(&device->forced, __ATOMIC_RELAXED);
+    if (forced >= 0) return forced;
+
+    gint64 elapsed_ms = (g_get_monotonic_time() - sim->created_us) / 1000;
+    return elapsed_ms >= device->spec.appear_after_ms &&
+           (device->spec.remove_after_ms == 0 || elapsed_ms < device->spec.remove_after_ms);
+}
+
+static SimDevice* find_by_name(DeviceSim* sim, const char* name) {
+    for (guint i = 0; i < sim->count; i++) {
+        if (strcmp(sim->devices[i]->spec.name, name) == 0) return sim->devices[i];
+    }
+    return NULL;
+}
+
+// Resolves a simulated descriptor, failing like a yanked device once removed
+static SimDevice* find_by_fd(DeviceSim* sim, int fd) {
+    guint index = (guint)(fd - DEVICE_SIM_FD_BASE);
+    if (fd < DEVICE_SIM_FD_BASE || index >= sim->count) {
+        errno = EBADF;
+        return NULL;
+    }
+    if (!is_present(sim, sim->devices[index])) {
+        errno = ENODEV;
+        return NULL;
+    }
+    return sim->devices[index];
+}
+
+// First present namespace of @controller, or NULL
+static SimDevice* find_controller(DeviceSim* sim, const char* controller, guint* index) {
+    for (guint i = 0; i < sim->count; i++) {
+        SimDevice* device = sim->devices[i];
+        if (device->spec.kind == DEVICE_SIM_NVME && strcmp(device->spec.controller, controller) == 0 &&
+            is_present(sim, device)) {
+            if (index) *index = i;
+            return device;
+        }
+    }
+    return NULL;
+}
+
+// Present namespace @nsid behind @controller, or NULL
+static SimDevice* find_namespace(DeviceSim* sim, const char* controller, uint32_t nsid) {
+    for (guint i = 0; i < sim->count; i++) {
+        SimDevice* device = sim->devices[i];
+        if (device->spec.kind == DEVICE_SIM_NVME && device->spec.nsid == nsid &&
+            strcmp(device->spec.controller, controller) == 0 && is_present(sim, device)) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+static void sleep_us(gint64 us) {
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+}
+
+// Backend: enumeration and sysfs
+
+static char** sim_list_devices(void* ctx) {
+    DeviceSim* sim = ctx;
+    char** names = g_new0(char*, sim->count + 1);
+    guint count = 0;
+    for (guint i = 0; i < sim->count; i++) {
+        if (is_present(sim, sim->devices[i])) names[count++] = g_strdup(sim->devices[i]->spec.name);
+    }
+    return names;
+}
+
+static gssize sim_read_attr(const char* name, const char* attr,
+                            char* buffer, size_t size, void* ctx) {
+    DeviceSim* sim = ctx;
+    SimDevice* device = find_by_name(sim, name);
+    if (!device || !is_present(sim, device)) {
+        errno = ENOENT;
+        return -1;
+    }
+    const DeviceSimSpec* spec = &device->spec;
+
+    char value[64];
+    if (strcmp(attr, "size") == 0) {
+        snprintf(value, sizeof(value), "%llu", (unsigned long long)(spec->capacity_bytes / 512));
+    } else if (strcmp(attr, "device/type") == 0 && spec->kind != DEVICE_SIM_NVME) {
+        g_strlcpy(value, "0", sizeof(value));
+    } else if (strcmp(attr, "nsid") == 0 && spec->kind == DEVICE_SIM_NVME) {
+        snprintf(value, sizeof(value), "%u", spec->nsid);
+    } else if (strcmp(attr, "device/model") == 0) {
+        g_strlcpy(value, spec->model, sizeof(value));
+    } else if (strcmp(attr, "queue/rotational") == 0) {
+        g_strlcpy(value, spec->kind == DEVICE_SIM_HDD ? "1" : "0", sizeof(value));
+    } else if (strcmp(attr, "queue/logical_block_size") == 0 ||
+               strcmp(attr, "queue/hw_sector_size") == 0) {
+        snprintf(value, sizeof(value), "%u", spec->logical_block_size);
+    } else if (strcmp(attr, "queue/physical_block_size") == 0) {
+        snprintf(value, sizeof(value), "%u", spec->physical_block_size);
+    } else if ((strcmp(attr, "queue/max_hw_sectors_kb") == 0 ||
+                strcmp(attr, "queue/max_sectors_kb") == 0) && spec->max_transfer_kb) {
+        snprintf(value, sizeof(value), "%u", spec->max_transfer_kb);
+    } else if (strcmp(attr, "queue/optimal_io_size") == 0) {
+        snprintf(value, sizeof(value), "%u", spec->optimal_io_size);
+    } else if (strcmp(attr, "queue/discard_max_bytes") == 0) {
+        // Flash trims in 2 GiB requests; disks cannot discard
+        g_strlcpy(value, spec->kind == DEVICE_SIM_HDD ? "0" : "2147483648", sizeof(value));
+    } else if (strcmp(attr, "queue/discard_granularity") == 0) {
+        snprintf(value, sizeof(value), "%u", spec->kind == DEVICE_SIM_HDD ? 0 : spec->physical_block_size);
+    } else if (strcmp(attr, "queue/write_zeroes_max_bytes") == 0) {
+        g_strlcpy(value, spec->kind == DEVICE_SIM_NVME ? "2147483648" : "0", sizeof(value));
+    } else if (strcmp(attr, "removable") == 0 || strcmp(attr, "ro") == 0 ||
+               strcmp(attr, "queue/discard_zeroes_data") == 0) {
+        g_strlcpy(value, "0", sizeof(value));
+    } else {
+        errno = ENOENT;
+        return -1;
+    }
+    g_strlcpy(buffer, value, size);
+    return (gssize)strlen(buffer);
+}
+
+// Backend: descriptors and identity
+
+static char* sim_nvme_controller(const char* name, void* ctx) {
+    DeviceSim* sim = ctx;
+    SimDevice* device = find_by_name(sim, name);
+    if (!device || device->spec.kind != DEVICE_SIM_NVME || !is_present(sim, device)) return NULL;
+    return g_strdup(device->spec.controller);
+}
+
+// Bus paths shaped like the kernel's, so transport detection sees the same
+static char* sim_sysfs_path(const char* name, void* ctx) {
+    DeviceSim* sim = ctx;
+    SimDevice* device = find_by_name(sim, name);
+    if (!device || !is_present(sim, device)) return NULL;
+    if (device->spec.kind == DEVICE_SIM_NVME) {
+        return g_strdup_printf("/devices/pci0000:00/0000:00:01.0/nvme/%s/%s",
+                               device->spec.controller, name);
+    }
+    return g_strdup_printf("/devices/pci0000:00/0000:00:17.0/ata1/host0/target0:0:0/0:0:0:0/block/%s",
+                           name);
+}
+
+static int sim_open_device(const char* path, int flags, void* ctx) {
+    DeviceSim* sim = ctx;
+    const char* name = g_str_has_prefix(path, "/dev/") ? path + 5 : path;
+    for (guint i = 0; i < sim->count; i++) {
+        if (strcmp(sim->devices[i]->spec.name, name) == 0 && is_present(sim, sim->devices[i])) {
+            return DEVICE_SIM_FD_BASE + (int)i;
+        }
+    }
+    guint index;
+    if (find_controller(sim, name, &index)) {
+        return DEVICE_SIM_CONTROLLER_FD_BASE + (int)index;
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+static void sim_close_device(int fd, void* ctx) {
+}
+
+static int sim_ata_identify(int fd, struct hd_driveid* id, void* ctx) {
+    SimDevice* device = find_by_fd(ctx, fd);
+    if (!device) return -1;
+    const DeviceSimSpec* spec = &device->spec;
+    if (spec->kind == DEVICE_SIM_NVME) {
+        errno = ENOTTY;
+        return -1;
+    }
+
+    const IdentifyField* f = identify_ata_table.fields;
+    uint8_t page[IDENTIFY_ATA_SIZE] = {0};
+    uint64_t sectors = spec->capacity_bytes / 512;
+    identify_write_text(&f[ID_ATA_MODEL], page, spec->model);
+    identify_write_text(&f[ID_ATA_SERIAL], page, spec->serial);
+    identify_write_text(&f[ID_ATA_FIRMWARE], page, spec->firmware);
+    identify_write(&f[ID_ATA_CAP_DMA], page, 1);
+    identify_write(&f[ID_ATA_CAP_LBA], page, 1);
+    identify_write(&f[ID_ATA_VALID_64_70], page, 1);
+    identify_write(&f[ID_ATA_VALID_88], page, 1);
+    identify_write(&f[ID_ATA_LBA28_SECTORS], page, MIN(sectors, 0x0FFFFFFFu));
+    identify_write(&f[ID_ATA_UDMA_SUPPORTED], page, 0x7F);
+    identify_write(&f[ID_ATA_UDMA_SELECTED], page, 0x40);
+    identify_write(&f[ID_ATA_SECURITY_FEATURE], page, (spec->ata_security & 0x1) != 0);
+    identify_write(&f[ID_ATA_LBA48], page, 1);
+    identify_write(&f[ID_ATA_LBA48_SECTORS], page, sectors);
+    identify_write(&f[ID_ATA_ERASE_TIME], page, 60);       // 2-minute units
+    identify_write(&f[ID_ATA_ENH_ERASE_TIME], page, 2);
+    identify_write(&f[ID_ATA_SECTOR_SIZE_VALID], page, 1); // 01b: word 106 is valid
+    if (spec->physical_block_size > 512) {
+        identify_write(&f[ID_ATA_MULTI_LOGICAL], page, 1);
+        identify_write(&f[ID_ATA_LOG_PER_PHYS], page, g_bit_storage(spec->physical_block_size / 512) - 1);
+    }
+    identify_write(&f[ID_ATA_SECURITY_STATUS], page, spec->ata_security);
+    identify_write(&f[ID_ATA_ROTATION_RATE], page, spec->kind == DEVICE_SIM_HDD ? 7200 : 1);
+    identify_write(&f[ID_ATA_TRIM], page, spec->kind == DEVICE_SIM_SATA_SSD);
+    identify_ata_seal(page);
+
+    // HDIO_GET_IDENTITY returns host-order words
+    uint16_t* words = (uint16_t*)id;
+    for (guint i = 0; i < IDENTIFY_ATA_SIZE / 2; i++) {
+        uint16_t word;
+        memcpy(&word, page + i * 2, 2);
+        words[i] = le16toh(word);
+    }
+    return 0;
+}
+
+static void sim_identify_controller(const DeviceSimSpec* spec, uint8_t* page) {
+    const IdentifyField* f = identify_nvme_controller_table.fields;
+    identify_write(&f[ID_CTRL_VID], page, spec->vendor_id);
+    identify_write(&f[ID_CTRL_SSVID], page, spec->vendor_id);
+    identify_write_text(&f[ID_CTRL_SN], page, spec->serial);
+    identify_write_text(&f[ID_CTRL_MN], page, spec->model);
+    identify_write_text(&f[ID_CTRL_FR], page, spec->firmware);
+    identify_write(&f[ID_CTRL_CNTLID], page, 1);
+    identify_write(&f[ID_CTRL_VER], page, 0x00010400);     // 1.4.0
+    identify_write(&f[ID_CTRL_OACS_FORMAT], page, 1);
+    identify_write(&f[ID_CTRL_OACS_FIRMWARE], page, 1);
+    identify_write(&f[ID_CTRL_FRMW_SLOTS], page, 1);
+    identify_write(&f[ID_CTRL_LPA], page, 0x2);
+    identify_write(&f[ID_CTRL_WCTEMP], page, 343);         // Kelvin
+    identify_write(&f[ID_CTRL_CCTEMP], page, 358);
+    identify_write(&f[ID_CTRL_TNVMCAP], page, spec->capacity_bytes);
+    identify_write(&f[ID_CTRL_SANICAP], page, spec->sanitize_caps);
+    identify_write(&f[ID_CTRL_SQES_MIN], page, 6);
+    identify_write(&f[ID_CTRL_SQES_MAX], page, 6);
+    identify_write(&f[ID_CTRL_CQES_MIN], page, 4);
+    identify_write(&f[ID_CTRL_CQES_MAX], page, 4);
+    identify_write(&f[ID_CTRL_NN], page, 1);
+    identify_write(&f[ID_CTRL_ONCS_DSM], page, 1);
+    identify_write(&f[ID_CTRL_ONCS_WRITE_ZEROES], page, 1);
+    identify_write(&f[ID_CTRL_FNA_CRYPTO], page, (spec->sanitize_caps & 0x1) != 0);
+    identify_write(&f[ID_CTRL_VWC_PRESENT], page, 1);
+    identify_write_text(&f[ID_CTRL_SUBNQN], page, "nqn.2014.08.org.nvmexpress:uuid:simulated");
+
+    // One power state: 8.00 W, entry and exit in 0 us
+    const IdentifyField* psd = identify_nvme_power_state_table.fields;
+    identify_write(&psd[ID_PSD_MP], page + IDENTIFY_PSD_OFFSET, 800);
+}
+
+static void sim_identify_namespace(const DeviceSimSpec* spec, uint8_t* page) {
+    const IdentifyField* f = identify_nvme_namespace_table.fields;
+    uint64_t blocks = spec->capacity_bytes / spec->logical_block_size;
+    identify_write(&f[ID_NS_NSZE], page, blocks);
+    identify_write(&f[ID_NS_NCAP], page, blocks);
+    identify_write(&f[ID_NS_NUSE], page, blocks);
+    identify_write(&f[ID_NS_NVMCAP], page, spec->capacity_bytes);
+    if (spec->physical_block_size > spec->logical_block_size) {
+        // Preferred write granularity, zero-based in logical blocks
+        identify_write(&f[ID_NS_NSFEAT_OPTPERF], page, 1);
+        identify_write(&f[ID_NS_NPWG], page, spec->physical_block_size / spec->logical_block_size - 1);
+    }
+
+    // A single LBA format
+    const IdentifyField* lbaf = identify_nvme_lba_format_table.fields;
+    identify_write(&lbaf[ID_LBAF_LBADS], page + IDENTIFY_LBAF_OFFSET,
+                   g_bit_storage(spec->logical_block_size - 1));
+}
+
+// Active Namespace ID List: IDs above @after in increasing order
+static void sim_active_namespaces(DeviceSim* sim, const char* controller, uint32_t after,
+                                  uint8_t* page) {
+    uint32_t previous = after;
+    for (guint slot = 0; slot < IDENTIFY_NVME_SIZE / 4; slot++) {
+        uint32_t next = 0;
+        for (guint i = 0; i < sim->count; i++) {
+            const DeviceSimSpec* spec = &sim->devices[i]->spec;
+            if (spec->kind == DEVICE_SIM_NVME && strcmp(spec->controller, controller) == 0 &&
+                spec->nsid > previous && (next == 0 || spec->nsid < next) &&
+                is_present(sim, sim->devices[i])) {
+                next = spec->nsid;
+            }
+        }
+        if (next == 0) break;
+        page[slot * 4] = (uint8_t)next;
+        page[slot * 4 + 1] = (uint8_t)(next >> 8);
+        page[slot * 4 + 2] = (uint8_t)(next >> 16);
+        page[slot * 4 + 3] = (uint8_t)(next >> 24);
+        previous = next;
+    }
+}
+
+static int sim_nvme_admin(int fd, struct nvme_admin_cmd* cmd, void* ctx) {
+    DeviceSim* sim = ctx;
+    gboolean on_controller = fd >= DEVICE_SIM_CONTROLLER_FD_BASE;
+    SimDevice* device = find_by_fd(sim, on_controller ? fd - DEVICE_SIM_MAX_DEVICES : fd);
+    if (!device) return -1;
+    const DeviceSimSpec* spec = &device->spec;
+    if (spec->kind != DEVICE_SIM_NVME) {
+        errno = ENOTTY;
+        return -1;
+    }
+
+    pthread_mutex_lock(&device->lock);
+    device->stats.admin_commands++;
+    pthread_mutex_unlock(&device->lock);
+
+    uint8_t page[4096] = {0};
+    guint cns = cmd->cdw10 & 0xff;
+    guint log_id = cmd->cdw10 & 0xff;
+    if (cmd->opcode == 0x06 && cns == 1) {
+        sim_identify_controller(spec, page);
+    } else if (cmd->opcode == 0x06 && cns == 0) {
+        // A namespace node answers for itself; the controller node looks
+        // the ID up and, like a real controller, zero-fills inactive ones
+        SimDevice* target = on_controller ? find_namespace(sim, spec->controller, cmd->nsid) : device;
+        if (target) sim_identify_namespace(&target->spec, page);
+    } else if (cmd->opcode == 0x06 && cns == 2) {
+        sim_active_namespaces(sim, spec->controller, cmd->nsid, page);
+    } else if (cmd->opcode == 0x02 && log_id == 0x02) {
+        // SMART / Health log: 40 C, nothing else to report
+        page[1] = 313 & 0xFF;
+        page[2] = 313 >> 8;
+        page[3] = 100;
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy((void*)(uintptr_t)cmd->addr, page, MIN(cmd->data_len, sizeof(page)));
+    cmd->result = 0;
+    return 0;
+}
+
+static int sim_device_size(int fd, uint64_t* size, void* ctx) {
+    SimDevice* device = find_by_fd(ctx, fd);
+    if (!device) return -1;
+    *size = device->spec.capacity_bytes;
+    return 0;
+}
+
+static int sim_sync(int fd, void* ctx) {
+    return find_by_fd(ctx, fd) ? 0 : -1;
+}
+
+// Backend: I/O
+
+static const DeviceSimBadRegion* bad_region_for(const DeviceSimSpec* spec,
+                                                uint64_t offset, size_t size) {
+    for (guint i = 0; i < spec->bad_region_count; i++) {
+        const DeviceSimBadRegion* region = &spec->bad_regions[i];
+        if (offset < region->offset + region->length && region->offset < offset + size) {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+// Models one request: returns 0, or -1 with errno set for a failing region
+static int service(DeviceSim* sim, SimDevice* device, uint64_t offset, size_t size, gboolean write) {
+    const DeviceSimSpec* spec = &device->spec;
+    guint depth = __atomic_add_fetch(&device->in_flight, 1, __ATOMIC_RELAXED);
+
+    double bandwidth = write ? spec->write_bandwidth : spec->read_bandwidth;
+    bandwidth *= 1.0 - (1.0 - spec->inner_ratio) * ((double)offset / (double)spec->capacity_bytes);
+    uint64_t max_transfer = (uint64_t)spec->max_transfer_kb * 1024;
+    uint64_t pieces = max_transfer ? MAX((size + max_transfer - 1) / max_transfer, 1) : 1;
+    double service_us = (double)spec->latency_us * pieces +
+                        (double)size * 1e6 * MAX(depth, spec->saturation_depth) / bandwidth;
+
+    const DeviceSimBadRegion* bad = bad_region_for(spec, offset, size);
+    if (bad) service_us += bad->extra_latency_us;
+    gboolean failed = bad && bad->failure == DEVICE_SIM_FAIL_EIO;
+
+    if (sim->time_scale > 0) sleep_us((gint64)(service_us * sim->time_scale));
+    __atomic_sub_fetch(&device->in_flight, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&device->lock);
+    DeviceSimStats* stats = &device->stats;
+    stats->busy_us += (gint64)service_us;
+    stats->max_queue_depth = MAX(stats->max_queue_depth, depth);
+    if (failed) {
+        stats->errors++;
+    } else if (write) {
+        stats->writes++;
+        stats->bytes_written += size;
+    } else {
+        stats->reads++;
+        stats->bytes_read += size;
+    }
+    pthread_mutex_unlock(&device->lock);
+
+    if (failed) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+// Copies between @buffer and the retained pages; reads of unwritten data
+// return zeros
+static void transfer(SimDevice* device, uint8_t* buffer, size_t size, uint64_t offset, gboolean write) {
+    if (!device->spec.retain_data) {
+        if (!write) memset(buffer, 0, size);
+        return;
+    }
+
+    pthread_mutex_lock(&device->lock);
+    size_t done = 0;
+    while (done < size) {
+        uint64_t index = (offset + done) / DEVICE_SIM_PAGE_SIZE;
+        size_t in_page = (size_t)((offset + done) % DEVICE_SIM_PAGE_SIZE);
+        size_t chunk = MIN(size - done, DEVICE_SIM_PAGE_SIZE - in_page);
+
+        uint8_t* page = g_hash_table_lookup(device->pages, &index);
+        if (write) {
+            if (!page) {
+                uint64_t* key = g_new(uint64_t, 1);
+                *key = index;
+                page = g_malloc0(DEVICE_SIM_PAGE_SIZE);
+                g_hash_table_insert(device->pages, key, page);
+            }
+            memcpy(page + in_page, buffer + done, chunk);
+        } else if (page) {
+            memcpy(buffer + done, page + in_page, chunk);
+        } else {
+            memset(buffer + done, 0, chunk);
+        }
+        done += chunk;
+    }
+    pthread_mutex_unlock(&device->lock);
+}
+
+static ssize_t sim_pread(int fd, void* buffer, size_t size, uint64_t offset, void* ctx) {
+    DeviceSim* sim = ctx;
+    SimDevice* device = find_by_fd(sim, fd);
+    if (!device) return -1;
+    if (offset >= device->spec.capacity_bytes) return 0;
+    size = (size_t)MIN(size, device->spec.capacity_bytes - offset);
+
+    if (service(sim, device, offset, size, FALSE) < 0) return -1;
+    transfer(device, buffer, size, offset, FALSE);
+    return (ssize_t)size;
+}
+
+static ssize_t sim_pwrite(int fd, const void* buffer, size_t size, uint64_t offset, void* ctx) {
+    DeviceSim* sim = ctx;
+    SimDevice* device = find_by_fd(sim, fd);
+    if (!device) return -1;
+    if (offset >= device->spec.capacity_bytes) {
+        errno = ENOSPC;
+        return -1;
+    }
+    size = (size_t)MIN(size, device->spec.capacity_bytes - offset);
+
+    if (service(sim, device, offset, size, TRUE) < 0) return -1;
+    transfer(device, (uint8_t*)buffer, size, offset, TRUE);
+    return (ssize_t)size;
+}
+
+// Zeros the retained pages overlapping the range; absent pages already
+// read back as zeros
+static void zero_range(SimDevice* device, uint64_t offset, uint64_t length) {
+    if (!device->spec.retain_data || length == 0) return;
+
+    pthread_mutex_lock(&device->lock);
+    for (uint64_t index = offset / DEVICE_SIM_PAGE_SIZE;
+         index <= (offset + length - 1) / DEVICE_SIM_PAGE_SIZE; index++) {
+        uint8_t* page = g_hash_table_lookup(device->pages, &index);
+        if (!page) continue;
+        uint64_t page_start = index * DEVICE_SIM_PAGE_SIZE;
+        uint64_t from = MAX(offset, page_start);
+        uint64_t to = MIN(offset + length, page_start + DEVICE_SIM_PAGE_SIZE);
+        memset(page + (from - page_start), 0, (size_t)(to - from));
+    }
+    pthread_mutex_unlock(&device->lock);
+}
+
+// Flash discards without touching the data (discard_zeroes_data is 0);
+// disks, secure discard and FAIL_NO_DISCARD regions are unsupported.
+// Zero-out is offloaded on NVMe and written out like the kernel does
+// elsewhere
+static int sim_discard(int fd, unsigned long request, uint64_t offset, uint64_t length, void* ctx) {
+    DeviceSim* sim = ctx;
+    SimDevice* device = find_by_fd(sim, fd);
+    if (!device) return -1;
+    const DeviceSimSpec* spec = &device->spec;
+    if (offset % spec->logical_block_size || length % spec->logical_block_size ||
+        offset > spec->capacity_bytes || length > spec->capacity_bytes - offset) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (request == BLKDISCARD) {
+        const DeviceSimBadRegion* bad = bad_region_for(spec, offset, length);
+        if (spec->kind == DEVICE_SIM_HDD || (bad && bad->failure == DEVICE_SIM_FAIL_NO_DISCARD)) {
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+        pthread_mutex_lock(&device->lock);
+        device->stats.bytes_discarded += length;
+        pthread_mutex_unlock(&device->lock);
+        return 0;
+    }
+    if (request == BLKZEROOUT) {
+        if (spec->kind != DEVICE_SIM_NVME && service(sim, device, offset, length, TRUE) < 0) return -1;
+        zero_range(device, offset, length);
+        pthread_mutex_lock(&device->lock);
+        device->stats.bytes_zeroed += length;
+        pthread_mutex_unlock(&device->lock);
+        return 0;
+    }
+    errno = request == BLKSECDISCARD ? EOPNOTSUPP : ENOTTY;
+    return -1;
+}
+
+// Public API
+
+void device_sim_spec_preset(DeviceSimSpec* spec,
+                            DeviceSimKind kind,
+                            const char* name,
+                            uint64_t capacity_bytes) {
+    memset(spec, 0, sizeof(*spec));
+    g_strlcpy(spec->name, name, sizeof(spec->name));
+    spec->kind = kind;
+    spec->capacity_bytes = capacity_bytes;
+    spec->logical_block_size = 512;
+    spec->physical_block_size = 4096;
+    spec->inner_ratio = 1.0;
+    snprintf(spec->serial, sizeof(spec->serial), "SIM-%s", name);
+    g_strlcpy(spec->firmware, "SIM1.0", sizeof(spec->firmware));
+
+    switch (kind) {
+    case DEVICE_SIM_HDD:
+        g_strlcpy(spec->model, "Simulated HDD 7200rpm", sizeof(spec->model));
+        spec->read_bandwidth = 200e6;
+        spec->write_bandwidth = 190e6;
+        spec->inner_ratio = 0.5;
+        spec->latency_us = 4000;
+        spec->saturation_depth = 1;
+        spec->max_transfer_kb = 32767;
+        spec->ata_security = 0x0021;  // supported, enhanced erase supported
+        break;
+    case DEVICE_SIM_SATA_SSD:
+        g_strlcpy(spec->model, "Simulated SATA SSD", sizeof(spec->model));
+        spec->read_bandwidth = 550e6;
+        spec->write_bandwidth = 520e6;
+        spec->latency_us = 60;
+        spec->saturation_depth = 2;
+        spec->max_transfer_kb = 32767;
+        spec->ata_security = 0x0021;
+        break;
+    case DEVICE_SIM_NVME:
+        g_strlcpy(spec->model, "Simulated NVMe SSD", sizeof(spec->model));
+        spec->read_bandwidth = 3500e6;
+        spec->write_bandwidth = 3000e6;
+        spec->latency_us = 20;
+        spec->saturation_depth = 4;
+        spec->max_transfer_kb = 512;
+        spec->vendor_id = 0x1b36;
+        spec->sanitize_caps = 0x7;    // crypto erase, block erase, overwrite
+        break;
+    }
+}
+
+DeviceSim* device_sim_new(double time_scale) {
+    DeviceSim* sim = g_new0(DeviceSim, 1);
+    sim->time_scale = time_scale;
+    sim->created_us = g_get_monotonic_time();
+    sim->backend = (DeviceBackend){
+        .list_devices = sim_list_devices,
+        .read_attr = sim_read_attr,
+        .nvme_controller = sim_nvme_controller,
+        .sysfs_path = sim_sysfs_path,
+        .open_device = sim_open_device,
+        .close_device = sim_close_device,
+        .ata_identify = sim_ata_identify,
+        .nvme_admin = sim_nvme_admin,
+        .device_size = sim_device_size,
+        .pread = sim_pread,
+        .pwrite = sim_pwrite,
+        .sync = sim_sync,
+        .discard = sim_discard,
+        .ctx = sim,
+    };
+    return sim;
+}
+
+void device_sim_free(DeviceSim* sim) {
+    if (!sim) return;
+    for (guint i = 0; i < sim->count; i++) {
+        SimDevice* device = sim->devices[i];
+        g_hash_table_destroy(device->pages);
+        pthread_mutex_destroy(&device->lock);
+        g_free(device);
+    }
+    g_free(sim);
+}
+
+gboolean device_sim_add(DeviceSim* sim, const DeviceSimSpec* spec, GError** error) {
+    if (sim->count >= DEVICE_SIM_MAX_DEVICES) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                    "At most %d simulated devices", DEVICE_SIM_MAX_DEVICES);
+        return FALSE;
+    }
+    if (spec->name[0] == '\0' || find_by_name(sim, spec->name)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_EXISTS,
+                    "Simulated device name \"%s\" is empty or taken", spec->name);
+        return FALSE;
+    }
+    if (spec->capacity_bytes == 0 || spec->logical_block_size == 0 ||
+        spec->read_bandwidth <= 0 || spec->write_bandwidth <= 0 || spec->saturation_depth == 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "Simulated device %s needs a capacity, block size, bandwidth and depth",
+                    spec->name);
+        return FALSE;
+    }
+
+    SimDevice* device = g_new0(SimDevice, 1);
+    device->spec = *spec;
+    if (spec->kind == DEVICE_SIM_NVME) {
+        unsigned int controller = 0, nsid = 0;
+        gboolean named = sscanf(spec->name, "nvme%un%u", &controller, &nsid) == 2;
+        if (device->spec.controller[0] == '\0') {
+            if (named) {
+                snprintf(device->spec.controller, sizeof(device->spec.controller), "nvme%u", controller);
+            } else {
+                snprintf(device->spec.controller, sizeof(device->spec.controller), "%.26s-ctrl", spec->name);
+            }
+        }
+        if (device->spec.nsid == 0) device->spec.nsid = named && nsid > 0 ? nsid : 1;
+    }
+    device->forced = -1;
+    pthread_mutex_init(&device->lock, NULL);
+    device->pages = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+    sim->devices[sim->count++] = device;
+    return TRUE;
+}
+
+static gboolean parse_size(const char* text, uint64_t* size) {
+    char* end = NULL;
+    double value = g_ascii_strtod(text, &end);
+    if (end == text || value <= 0) return FALSE;
+
+    // Decimal units, as drive capacities are quoted
+    switch (g_ascii_toupper(*end)) {
+    case '\0': break;
+    case 'K': value *= 1e3; break;
+    case 'M': value *= 1e6; break;
+    case 'G': value *= 1e9; break;
+    case 'T': value *= 1e12; break;
+    default: return FALSE;
+    }
+    // Whole logical blocks
+    *size = (uint64_t)value / 4096 * 4096;
+    return *size > 0;
+}
+
+DeviceSim* device_sim_new_from_string(const char* description,
+                                      double time_scale,
+                                      GError** error) {
+    DeviceSim* sim = device_sim_new(time_scale);
+    gchar** entries = g_strsplit(description, ",", -1);
+    guint disks = 0;
+    guint controllers = 0;
+    gboolean ok = TRUE;
+
+    for (gchar** entry = entries; ok && *entry; entry++) {
+        gchar** fields = g_strsplit(g_strstrip(*entry), ":", 3);
+        DeviceSimKind kind = DEVICE_SIM_HDD;
+        uint64_t size = 0;
+        if (!fields[0] || !fields[1] || !parse_size(fields[1], &size)) {
+            ok = FALSE;
+        } else if (strcmp(fields[0], "hdd") == 0) {
+            kind = DEVICE_SIM_HDD;
+        } else if (strcmp(fields[0], "ssd") == 0) {
+            kind = DEVICE_SIM_SATA_SSD;
+        } else if (strcmp(fields[0], "nvme") == 0) {
+            kind = DEVICE_SIM_NVME;
+        } else {
+            ok = FALSE;
+        }
+
+        if (ok) {
+            char name[32];
+            if (fields[2]) {
+                g_strlcpy(name, fields[2], sizeof(name));
+            } else if (kind == DEVICE_SIM_NVME) {
+                snprintf(name, sizeof(name), "nvme%un1", controllers++);
+            } else {
+                snprintf(name, sizeof(name), "sd%c", 'a' + (disks++ % 26));
+            }
+            DeviceSimSpec spec;
+            device_sim_spec_preset(&spec, kind, name, size);
+            ok = device_sim_add(sim, &spec, error);
+        } else {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                        "Bad simulated device \"%s\", expected kind:size[:name]", *entry);
+        }
+        g_strfreev(fields);
+    }
+    g_strfreev(entries);
+
+    if (!ok) {
+        device_sim_free(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+void device_sim_set_present(DeviceSim* sim, const char* name, gboolean present) {
+    SimDevice* device = find_by_name(sim, name);
+    if (device) __atomic_store_n(&device->forced, present ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+const DeviceBackend* device_sim_backend(DeviceSim* sim) {
+    return &sim->backend;
+}
+
+gboolean device_sim_get_stats(DeviceSim* sim, const char* name, DeviceSimStats* stats) {
+    SimDevice* device = find_by_name(sim, name);
+    if (!device) return FALSE;
+    pthread_mutex_lock(&device->lock);
+    *stats = device->stats;
+    pthread_mutex_unlock(&device->lock);
+    return TRUE;
+}
@@ -0,0 +1,146 @@
+#ifndef DEVICE_SIM_H
+#define DEVICE_SIM_H
+
+#include <glib.h>
+#include <stdint.h>
+#include "device_backend.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Simulated block devices behind the DeviceBackend interface.
+ *
+ * Each device answers enumeration, sysfs and identity queries from its spec
+ * and services reads and writes with a simple performance model:
+ *
+ *   service_us = latency_us * pieces + bytes * max(in_flight, saturation_depth) / bandwidth(offset)
+ *
+ * so a single request gets 1/saturation_depth of the bandwidth, deeper
+ * queues scale linearly until the device saturates, and bandwidth falls
+ * linearly towards inner_ratio at the last LBA like the zones of a disk.
+ * Requests above max_transfer_kb are split into that many pieces, each
+ * paying the fixed cost, as the block layer does with max_hw_sectors_kb.
+ * With a time scale of 1 requests take that long in real time; with 0 they
+ * complete at once and only the modelled time is accounted.
+ */
+
+#define DEVICE_SIM_MAX_DEVICES 64
+#define DEVICE_SIM_MAX_BAD_REGIONS 16
+
+typedef enum {
+    DEVICE_SIM_HDD = 0,       // SATA, rotational
+    DEVICE_SIM_SATA_SSD,
+    DEVICE_SIM_NVME,
+} DeviceSimKind;
+
+typedef enum {
+    DEVICE_SIM_FAIL_EIO = 0,  // requests touching the region fail with EIO
+    DEVICE_SIM_FAIL_SLOW,     // requests succeed after extra_latency_us
+    DEVICE_SIM_FAIL_NO_DISCARD,  // discards touching the region fail with EOPNOTSUPP, I/O succeeds
+} DeviceSimFailure;
+
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+    DeviceSimFailure failure;
+    guint extra_latency_us;
+} DeviceSimBadRegion;
+
+typedef struct {
+    char name[32];            // kernel name; the node is /dev/<name>
+    DeviceSimKind kind;
+    uint64_t capacity_bytes;
+    guint logical_block_size;
+    guint physical_block_size;
+
+    // Identity
+    char model[41];
+    char serial[21];
+    char firmware[9];
+    uint16_t vendor_id;       // NVMe PCI vendor
+    // NVMe controller serving this namespace and the namespace ID; taken
+    // from an nvme<C>n<N> name when left empty / 0. Namespaces that share a
+    // controller answer admin commands on /dev/<controller> together
+    char controller[32];
+    uint32_t nsid;
+    uint32_t sanitize_caps;   // NVMe SANICAP
+    uint16_t ata_security;    // ATA security status, IDENTIFY word 128
+
+    // Performance model
+    double read_bandwidth;    // bytes/s at LBA 0 once saturated
+    double write_bandwidth;
+    double inner_ratio;       // bandwidth at the last LBA relative to LBA 0
+    guint latency_us;         // fixed cost of every request
+    guint saturation_depth;   // queue depth that reaches full bandwidth
+    guint max_transfer_kb;    // queue/max_hw_sectors_kb, 0 = unlimited
+    guint optimal_io_size;    // queue/optimal_io_size in bytes, 0 = not reported
+
+    DeviceSimBadRegion bad_regions[DEVICE_SIM_MAX_BAD_REGIONS];
+    guint bad_region_count;
+
+    // Hotplug, relative to device_sim_new(); 0 = present from the start / never removed
+    guint appear_after_ms;
+    guint remove_after_ms;
+
+    gboolean retain_data;     // keep written data so it can be read back
+} DeviceSimSpec;
+
+typedef struct {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t errors;
+    gint64 busy_us;           // sum of modelled service times
+    guint max_queue_depth;
+    uint64_t admin_commands;  // NVMe admin commands, counted on the namespace they resolved to
+    uint64_t bytes_discarded; // accepted BLKDISCARD ranges
+    uint64_t bytes_zeroed;    // accepted BLKZEROOUT ranges
+} DeviceSimStats;
+
+typedef struct DeviceSim DeviceSim;
+
+/**
+ * device_sim_spec_preset:
+ *
+ * Fills @spec with typical values for @kind: a 7200 rpm disk, a SATA SSD
+ * or a PCIe 3.0 x4 NVMe drive.
+ */
+void device_sim_spec_preset(DeviceSimSpec* spec,
+                            DeviceSimKind kind,
+                            const char* name,
+                            uint64_t capacity_bytes);
+
+/**
+ * device_sim_new:
+ * @time_scale: real time spent per modelled microsecond; 0 never sleeps
+ */
+DeviceSim* device_sim_new(double time_scale);
+void device_sim_free(DeviceSim* sim);
+
+gboolean device_sim_add(DeviceSim* sim, const DeviceSimSpec* spec, GError** error);
+
+/**
+ * device_sim_new_from_string:
+ * @description: comma-separated "kind:size[:name]" entries, kind being
+ *   "hdd", "ssd" or "nvme" and size taking a K/M/G/T suffix, e.g.
+ *   "nvme:512G,hdd:2T:sdb"
+ *
+ * Returns: (transfer full): a simulator with preset devices, or NULL with
+ *   @error set
+ */
+DeviceSim* device_sim_new_from_string(const char* description,
+                                      double time_scale,
+                                      GError** error);
+
+// Forces a device in or out of the device list, overriding its hotplug timing
+void device_sim_set_present(DeviceSim* sim, const char* name, gboolean present);
+
+// The backend to hand to probing and I/O code; valid while @sim lives
+const DeviceBackend* device_sim_backend(DeviceSim* sim);
+
+gboolean device_sim_get_stats(DeviceSim* sim, const char* name, DeviceSimStats* stats);
+
+G_END_DECLS
+
+#endif // DEVICE_SIM_H
@@ -0,0 +1,306 @@
+#define _GNU_SOURCE
+#include "discard.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#include <linux/falloc.h>
+
+// Upper bound on a single request so progress and cancel stay responsive
+#define DISCARD_MAX_CHUNK (1ull << 30)
+// Chunk used for BLKZEROOUT when the device has no write-zeroes offload
+// and the kernel falls back to submitting zero pages itself
+#define DISCARD_EMULATED_ZEROOUT_CHUNK (64ull * 1024 * 1024)
+
+static gint64 monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Kernel name of the whole disk holding block device @dev: the component
+// after "/block/" in its sysfs path, ".../block/sda" or ".../block/sda/sda1"
+static gboolean disk_name_for_dev(dev_t dev, char* name, size_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u", major(dev), minor(dev));
+    char* target = g_file_read_link(path, NULL);
+    if (!target) return FALSE;
+
+    char* disk = NULL;
+    for (char* p = strstr(target, "/block/"); p; p = strstr(p + 1, "/block/")) {
+        disk = p + strlen("/block/");
+    }
+    gboolean ok = disk != NULL && *disk != '\0';
+    if (ok) {
+        disk[strcspn(disk, "/")] = '\0';
+        snprintf(name, size, "%s", disk);
+    }
+    g_free(target);
+    return ok;
+}
+
+gboolean discard_get_capabilities(const char* device_name, DiscardCapabilities* caps) {
+    // Whole disks go through the cached queue/ descriptors
+    return discard_get_capabilities_from(device_backend_linux(), device_name, caps);
+}
+
+gboolean discard_get_capabilities_from(const DeviceBackend* backend,
+                                       const char* device_name,
+                                       DiscardCapabilities* caps) {
+    memset(caps, 0, sizeof(*caps));
+
+    uint64_t value = 0;
+    if (!device_backend_read_u64(backend, device_name, "queue/discard_max_bytes", &caps->discard_max_bytes)) {
+        return FALSE;
+    }
+    device_backend_read_u64(backend, device_name, "queue/discard_granularity", &caps->discard_granularity);
+    device_backend_read_u64(backend, device_name, "queue/write_zeroes_max_bytes", &caps->write_zeroes_max_bytes);
+    if (device_backend_read_u64(backend, device_name, "queue/discard_zeroes_data", &value)) {
+        caps->discard_zeroes_data = value != 0;
+    }
+    caps->logical_block_size = 512;
+    if (device_backend_read_u64(backend, device_name, "queue/logical_block_size", &value) && value) {
+        caps->logical_block_size = (guint)value;
+    }
+    return TRUE;
+}
+
+gboolean discard_get_capabilities_for_fd(int fd, DiscardCapabilities* caps) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) return FALSE;
+
+    if (S_ISREG(st.st_mode)) {
+        // Punch-hole deallocates in filesystem blocks and reads back zeros
+        memset(caps, 0, sizeof(*caps));
+        caps->discard_granularity = (uint64_t)st.st_blksize;
+        caps->discard_max_bytes = DISCARD_MAX_CHUNK;
+        caps->write_zeroes_max_bytes = DISCARD_MAX_CHUNK;
+        caps->discard_zeroes_data = TRUE;
+        caps->logical_block_size = 512;
+        return TRUE;
+    }
+    if (!S_ISBLK(st.st_mode)) return FALSE;
+
+    // Partitions share the queue of their disk
+    char disk[64];
+    if (!disk_name_for_dev(st.st_rdev, disk, sizeof(disk))) return FALSE;
+    return discard_get_capabilities_from(device_backend_linux(), disk, caps);
+}
+
+FlValue* discard_capabilities_to_fl_value(const DiscardCapabilities* caps) {
+    FlValue* result = fl_value_new_map();
+    fl_value_set_string_take(result, "isDiscardSupported", fl_value_new_bool(caps->discard_max_bytes > 0));
+    fl_value_set_string_take(result, "discardGranularity", fl_value_new_int((int64_t)caps->discard_granularity));
+    fl_value_set_string_take(result, "discardMaxBytes", fl_value_new_int((int64_t)caps->discard_max_bytes));
+    fl_value_set_string_take(result, "isWriteZeroesOffloaded", fl_value_new_bool(caps->write_zeroes_max_bytes > 0));
+    fl_value_set_string_take(result, "writeZeroesMaxBytes", fl_value_new_int((int64_t)caps->write_zeroes_max_bytes));
+    fl_value_set_string_take(result, "discardZeroesData", fl_value_new_bool(caps->discard_zeroes_data));
+    return result;
+}
+
+// Largest request for @mode, aligned down to the discard granularity
+static uint64_t chunk_size_for(const DiscardCapabilities* caps, DiscardMode mode) {
+    uint64_t chunk;
+    if (mode == DISCARD_MODE_ZEROOUT) {
+        chunk = caps->write_zeroes_max_bytes ? caps->write_zeroes_max_bytes
+                                             : DISCARD_EMULATED_ZEROOUT_CHUNK;
+    } else {
+        chunk = caps->discard_max_bytes;
+    }
+    if (chunk > DISCARD_MAX_CHUNK) chunk = DISCARD_MAX_CHUNK;
+
+    uint64_t align = caps->discard_granularity > caps->logical_block_size
+        ? caps->discard_granularity : caps->logical_block_size;
+    if (align && chunk > align) chunk -= chunk % align;
+    return chunk;
+}
+
+static int issue_block(const DeviceBackend* backend, int fd, DiscardMode mode,
+                       uint64_t offset, uint64_t length) {
+    switch (mode) {
+        case DISCARD_MODE_DISCARD:
+            return backend->discard(fd, BLKDISCARD, offset, length, backend->ctx);
+        case DISCARD_MODE_SECURE_DISCARD:
+            return backend->discard(fd, BLKSECDISCARD, offset, length, backend->ctx);
+        case DISCARD_MODE_ZEROOUT:
+            return backend->discard(fd, BLKZEROOUT, offset, length, backend->ctx);
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+static int issue_file(int fd, DiscardMode mode, uint64_t offset, uint64_t length) {
+    switch (mode) {
+        case DISCARD_MODE_DISCARD:
+            return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                             (off_t)offset, (off_t)length);
+        case DISCARD_MODE_ZEROOUT:
+            if (fallocate(fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+                          (off_t)offset, (off_t)length) == 0) {
+                return 0;
+            }
+            if (errno != EOPNOTSUPP) return -1;
+            return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                             (off_t)offset, (off_t)length);
+        case DISCARD_MODE_SECURE_DISCARD:
+            // No filesystem guarantees the old blocks are erased
+            errno = EOPNOTSUPP;
+            return -1;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+static gboolean is_unsupported_errno(int err) {
+    return err == EOPNOTSUPP || err == ENOTTY || err == ENOSYS;
+}
+
+// Reports the overwrite of the remainder as progress through the whole
+// range, after the bytes discarded before the device gave up
+typedef struct {
+    const DiscardOptions* options;
+    uint64_t discarded;
+    gint64 elapsed_us;
+} FallbackProgress;
+
+static void fallback_progress(const BulkProgress* progress, void* user_data) {
+    const FallbackProgress* fallback = user_data;
+    BulkProgress whole = *progress;
+    whole.bytes_done += fallback->discarded;
+    whole.bytes_total = fallback->options->length;
+    whole.elapsed_us += fallback->elapsed_us;
+    fallback->options->progress(&whole, fallback->options->user_data);
+}
+
+gboolean discard_range(int fd,
+                       const DiscardOptions* options,
+                       DiscardResult* result,
+                       GError** error) {
+    gint64 start_us = monotonic_us();
+    DiscardResult local;
+    memset(&local, 0, sizeof(local));
+
+    const DeviceBackend* backend = options->backend ? options->backend : device_backend_linux();
+    gboolean is_file = FALSE;
+    DiscardCapabilities caps;
+    gboolean have_caps;
+    if (backend == device_backend_linux()) {
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "fstat failed: %s", strerror(errno));
+            return FALSE;
+        }
+        is_file = S_ISREG(st.st_mode);
+        have_caps = discard_get_capabilities_for_fd(fd, &caps);
+    } else {
+        // Simulated descriptors cannot be stat'ed; the caller names the disk
+        have_caps = options->device && discard_get_capabilities_from(backend, options->device, &caps);
+    }
+    if (!have_caps) {
+        memset(&caps, 0, sizeof(caps));
+        caps.logical_block_size = 512;
+    }
+
+    if (options->offset % caps.logical_block_size || options->length % caps.logical_block_size) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "Range must be aligned to the %u byte logical block size",
+                    caps.logical_block_size);
+        return FALSE;
+    }
+
+    uint64_t chunk = chunk_size_for(&caps, options->mode);
+    uint64_t end = options->offset + options->length;
+    uint64_t offset = options->offset;
+    int failed_errno = chunk ? 0 : EOPNOTSUPP;
+    gint64 last_progress_us = start_us;
+
+    while (chunk && offset < end) {
+        if (options->cancel && *options->cancel) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Discard cancelled");
+            local.elapsed_us = monotonic_us() - start_us;
+            if (result) *result = local;
+            return FALSE;
+        }
+
+        uint64_t length = end - offset < chunk ? end - offset : chunk;
+        int rc = is_file ? issue_file(fd, options->mode, offset, length)
+                         : issue_block(backend, fd, options->mode, offset, length);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            failed_errno = errno;
+            break;
+        }
+
+        offset += length;
+        local.bytes_done += length;
+
+        gint64 now = monotonic_us();
+        if (options->progress && (now - last_progress_us >= 200000 || offset == end)) {
+            BulkProgress progress = {
+                .bytes_done = local.bytes_done,
+                .bytes_total = options->length,
+                .elapsed_us = now - start_us,
+                .throttle = NULL,
+            };
+            options->progress(&progress, options->user_data);
+            last_progress_us = now;
+        }
+    }
+
+    if (offset < end) {
+        if (!is_unsupported_errno(failed_errno) || !options->fallback_to_overwrite) {
+            g_set_error(error, G_IO_ERROR,
+                        is_unsupported_errno(failed_errno) ? G_IO_ERROR_NOT_SUPPORTED : G_IO_ERROR_FAILED,
+                        "Discard failed at offset %llu: %s",
+                        (unsigned long long)offset, strerror(failed_errno));
+            local.elapsed_us = monotonic_us() - start_us;
+            if (result) *result = local;
+            return FALSE;
+        }
+
+        // Device does not implement the offload: overwrite the remainder
+        BulkWriteOptions write_options;
+        bulk_io_default_options(&write_options);
+        write_options.offset = offset;
+        write_options.length = end - offset;
+        write_options.pattern = BULK_PATTERN_ZEROS;
+        FallbackProgress fallback = {
+            .options = options,
+            .discarded = local.bytes_done,
+            .elapsed_us = monotonic_us() - start_us,
+        };
+        write_options.progress = options->progress ? fallback_progress : NULL;
+        write_options.user_data = &fallback;
+        write_options.cancel = options->cancel;
+        write_options.backend = options->backend;
+
+        BulkWriteResult write_result;
+        gboolean ok = bulk_io_write(fd, &write_options, &write_result, error);
+        local.bytes_done += write_result.bytes_written;
+        local.used_fallback = TRUE;
+        local.elapsed_us = monotonic_us() - start_us;
+        if (!ok) {
+            if (result) *result = local;
+            return FALSE;
+        }
+        if (backend->sync(fd, backend->ctx) < 0) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "fdatasync failed: %s", strerror(errno));
+            if (result) *result = local;
+            return FALSE;
+        }
+    }
+
+    local.reads_zero = local.used_fallback ||
+                       options->mode == DISCARD_MODE_ZEROOUT ||
+                       caps.discard_zeroes_data;
+    local.elapsed_us = monotonic_us() - start_us;
+    if (result) *result = local;
+    return TRUE;
+}
@@ -0,0 +1,89 @@
+#ifndef DISCARD_H
+#define DISCARD_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdint.h>
+#include "bulk_io.h"
+
+G_BEGIN_DECLS
+
+typedef struct {
+    uint64_t discard_granularity;     // queue/discard_granularity
+    uint64_t discard_max_bytes;       // queue/discard_max_bytes, 0 = no discard
+    uint64_t write_zeroes_max_bytes;  // queue/write_zeroes_max_bytes, 0 = emulated
+    gboolean discard_zeroes_data;     // queue/discard_zeroes_data
+    guint logical_block_size;         // queue/logical_block_size
+} DiscardCapabilities;
+
+typedef enum {
+    DISCARD_MODE_DISCARD,         // BLKDISCARD / punch hole
+    DISCARD_MODE_SECURE_DISCARD,  // BLKSECDISCARD
+    DISCARD_MODE_ZEROOUT,         // BLKZEROOUT / zero range
+} DiscardMode;
+
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+    DiscardMode mode;
+    gboolean fallback_to_overwrite;   // overwrite with zeros when unsupported
+    BulkProgressCallback progress;
+    void* user_data;
+    const volatile gint* cancel;
+    const DeviceBackend* backend;     // optional, NULL goes through the kernel
+    const char* device;               // kernel name of the disk, for the queue limits of @backend
+} DiscardOptions;
+
+typedef struct {
+    uint64_t bytes_done;
+    gint64 elapsed_us;
+    gboolean used_fallback;           // range was finished by overwriting
+    gboolean reads_zero;              // discarded range is known to read back as zeros
+} DiscardResult;
+
+/**
+ * discard_get_capabilities:
+ * @device_name: block device name (e.g. "sda")
+ *
+ * Reads discard and write-zeroes limits from /sys/block/X/queue.
+ *
+ * Returns: TRUE when the queue attributes could be read
+ */
+gboolean discard_get_capabilities(const char* device_name, DiscardCapabilities* caps);
+
+// Same as discard_get_capabilities(), reading the queue through @backend
+gboolean discard_get_capabilities_from(const DeviceBackend* backend,
+                                       const char* device_name,
+                                       DiscardCapabilities* caps);
+
+/**
+ * discard_get_capabilities_for_fd:
+ *
+ * Same as discard_get_capabilities() for an open block device or partition.
+ * Regular files report punch-hole support as discard.
+ */
+gboolean discard_get_capabilities_for_fd(int fd, DiscardCapabilities* caps);
+
+FlValue* discard_capabilities_to_fl_value(const DiscardCapabilities* caps);
+
+/**
+ * discard_range:
+ * @fd: writable block device or regular file
+ *
+ * Issues BLKDISCARD, BLKSECDISCARD or BLKZEROOUT (fallocate punch-hole or
+ * zero-range on regular files) over the range in chunks sized from the
+ * queue limits, reporting progress between chunks. When the device rejects
+ * the operation and @fallback_to_overwrite is set, the rest of the range is
+ * overwritten with zeros through bulk_io_write(), with progress continuing
+ * from the bytes already discarded. With a simulated @backend, @fd comes
+ * from it and the limits are read for @device.
+ *
+ * Returns: TRUE when the whole range was processed
+ */
+gboolean discard_range(int fd,
+                       const DiscardOptions* options,
+                       DiscardResult* result,
+                       GError** error);
+
+G_END_DECLS
+
+#endif // DISCARD_H
@@ -0,0 +1,441 @@
+#define _GNU_SOURCE
+#include "diskstats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#define DISKSTATS_DEFAULT_PATH "/proc/diskstats"
+#define DISKSTATS_INITIAL_BUFFER (64 * 1024)
+#define DISKSTATS_INITIAL_ENTRIES 64
+#define DISKSTATS_SECTOR_SIZE 512
+
+// Counter columns after the name: 11 on every kernel, 15 with discard
+// (4.18+), 17 with flush (5.5+)
+#define DISKSTATS_MIN_FIELDS 11
+#define DISKSTATS_MAX_FIELDS 17
+
+// Parser
+
+static inline const char* skip_blanks(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+static inline const char* parse_number(const char* p, const char* end, uint64_t* value) {
+    uint64_t result = 0;
+    const char* start = p;
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        result = result * 10 + (uint64_t)(*p - '0');
+        p++;
+    }
+    *value = result;
+    return p == start ? NULL : p;
+}
+
+static gboolean parse_line(const char* p, const char* end, DiskStatsEntry* entry) {
+    uint64_t major, minor;
+
+    p = skip_blanks(p, end);
+    if (!(p = parse_number(p, end, &major))) return FALSE;
+    p = skip_blanks(p, end);
+    if (!(p = parse_number(p, end, &minor))) return FALSE;
+    p = skip_blanks(p, end);
+
+    const char* name = p;
+    while (p < end && *p != ' ' && *p != '\t') p++;
+    size_t name_len = (size_t)(p - name);
+    if (name_len == 0) return FALSE;
+    if (name_len >= DISKSTATS_NAME_MAX) name_len = DISKSTATS_NAME_MAX - 1;
+
+    uint64_t fields[DISKSTATS_MAX_FIELDS] = {0};
+    int count = 0;
+    while (count < DISKSTATS_MAX_FIELDS) {
+        p = skip_blanks(p, end);
+        if (p >= end) break;
+        const char* next = parse_number(p, end, &fields[count]);
+        if (!next) return FALSE;
+        p = next;
+        count++;
+    }
+    if (count < DISKSTATS_MIN_FIELDS) return FALSE;
+
+    memcpy(entry->name, name, name_len);
+    entry->name[name_len] = '\0';
+    entry->major = (guint)major;
+    entry->minor = (guint)minor;
+    entry->reads_completed = fields[0];
+    entry->reads_merged = fields[1];
+    entry->sectors_read = fields[2];
+    entry->read_ms = fields[3];
+    entry->writes_completed = fields[4];
+    entry->writes_merged = fields[5];
+    entry->sectors_written = fields[6];
+    entry->write_ms = fields[7];
+    entry->in_flight = fields[8];
+    entry->io_ms = fields[9];
+    entry->weighted_io_ms = fields[10];
+    entry->discards_completed = fields[11];
+    entry->discards_merged = fields[12];
+    entry->sectors_discarded = fields[13];
+    entry->discard_ms = fields[14];
+    entry->flushes_completed = fields[15];
+    entry->flush_ms = fields[16];
+    return TRUE;
+}
+
+size_t diskstats_parse(const char* buffer, size_t length,
+                       DiskStatsEntry* entries, size_t max_entries) {
+    const char* p = buffer;
+    const char* end = buffer + length;
+    size_t count = 0;
+
+    while (p < end) {
+        const char* eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+
+        DiskStatsEntry scratch;
+        DiskStatsEntry* entry = count < max_entries ? &entries[count] : &scratch;
+        if (parse_line(p, eol, entry)) count++;
+
+        p = eol + 1;
+    }
+    return count;
+}
+
+// Rates
+
+static inline uint64_t counter_delta(uint64_t previous, uint64_t current) {
+    return current >= previous ? current - previous : 0;
+}
+
+void diskstats_compute_rates(const DiskStatsEntry* previous,
+                             const DiskStatsEntry* current,
+                             gint64 elapsed_us,
+                             DiskIoRates* rates) {
+    memset(rates, 0, sizeof(*rates));
+    memcpy(rates->name, current->name, sizeof(rates->name));
+    rates->major = current->major;
+    rates->minor = current->minor;
+    rates->in_flight = current->in_flight;
+    if (!previous || elapsed_us <= 0) return;
+
+    double seconds = (double)elapsed_us / 1e6;
+    double elapsed_ms = (double)elapsed_us / 1e3;
+
+    uint64_t reads = counter_delta(previous->reads_completed, current->reads_completed);
+    uint64_t writes = counter_delta(previous->writes_completed, current->writes_completed);
+    uint64_t read_ms = counter_delta(previous->read_ms, current->read_ms);
+    uint64_t write_ms = counter_delta(previous->write_ms, current->write_ms);
+    uint64_t io_ms = counter_delta(previous->io_ms, current->io_ms);
+    uint64_t weighted_ms = counter_delta(previous->weighted_io_ms, current->weighted_io_ms);
+
+    rates->read_bytes_per_sec = (double)counter_delta(previous->sectors_read, current->sectors_read) *
+                                DISKSTATS_SECTOR_SIZE / seconds;
+    rates->write_bytes_per_sec = (double)counter_delta(previous->sectors_written,
+                                                       current->sectors_written) *
+                                 DISKSTATS_SECTOR_SIZE / seconds;
+    rates->read_iops = (double)reads / seconds;
+    rates->write_iops = (double)writes / seconds;
+    rates->read_await_ms = reads > 0 ? (double)read_ms / (double)reads : 0.0;
+    rates->write_await_ms = writes > 0 ? (double)write_ms / (double)writes : 0.0;
+    rates->service_time_ms = reads + writes > 0 ? (double)io_ms / (double)(reads + writes) : 0.0;
+    rates->queue_depth = (double)weighted_ms / elapsed_ms;
+    rates->utilization = MIN(100.0, (double)io_ms * 100.0 / elapsed_ms);
+}
+
+// Sampler
+
+struct DiskStatsSampler {
+    int fd;
+    char* buffer;
+    size_t buffer_size;
+
+    // Guards everything below
+    pthread_mutex_t lock;
+    DiskStatsEntry* previous;
+    DiskStatsEntry* current;
+    size_t previous_count;
+    size_t current_count;
+    size_t entry_capacity;
+    gint64 previous_us;
+    gint64 current_us;
+    DiskIoRates* rates;
+    size_t rate_count;
+
+    pthread_cond_t wake;
+    pthread_t thread;
+    gboolean running;
+    guint interval_ms;
+    DiskStatsCallback callback;
+    void* user_data;
+};
+
+DiskStatsSampler* diskstats_sampler_new(const char* path, guint interval_ms, GError** error) {
+    if (!path) path = DISKSTATS_DEFAULT_PATH;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        int saved = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Cannot open %s: %s", path, g_strerror(saved));
+        return NULL;
+    }
+
+    DiskStatsSampler* sampler = g_new0(DiskStatsSampler, 1);
+    sampler->fd = fd;
+    sampler->buffer_size = DISKSTATS_INITIAL_BUFFER;
+    sampler->buffer = g_malloc(sampler->buffer_size);
+    sampler->entry_capacity = DISKSTATS_INITIAL_ENTRIES;
+    sampler->previous = g_new0(DiskStatsEntry, sampler->entry_capacity);
+    sampler->current = g_new0(DiskStatsEntry, sampler->entry_capacity);
+    sampler->rates = g_new0(DiskIoRates, sampler->entry_capacity);
+    sampler->interval_ms = interval_ms > 0 ? interval_ms : 1000;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sampler->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&sampler->lock, NULL);
+
+    return sampler;
+}
+
+void diskstats_sampler_free(DiskStatsSampler* sampler) {
+    if (!sampler) return;
+    diskstats_sampler_stop(sampler);
+    close(sampler->fd);
+    pthread_cond_destroy(&sampler->wake);
+    pthread_mutex_destroy(&sampler->lock);
+    g_free(sampler->buffer);
+    g_free(sampler->previous);
+    g_free(sampler->current);
+    g_free(sampler->rates);
+    g_free(sampler);
+}
+
+void diskstats_sampler_set_interval(DiskStatsSampler* sampler, guint interval_ms) {
+    pthread_mutex_lock(&sampler->lock);
+    sampler->interval_ms = interval_ms > 0 ? interval_ms : 1000;
+    pthread_cond_signal(&sampler->wake);
+    pthread_mutex_unlock(&sampler->lock);
+}
+
+// Called with the lock held. The file is regenerated on every read from
+// offset 0; a read that fills the buffer may be truncated, so grow and retry.
+static ssize_t read_stats(DiskStatsSampler* sampler) {
+    for (;;) {
+        ssize_t n = pread(sampler->fd, sampler->buffer, sampler->buffer_size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 || (size_t)n < sampler->buffer_size) return n;
+
+        sampler->buffer_size *= 2;
+        sampler->buffer = g_realloc(sampler->buffer, sampler->buffer_size);
+    }
+}
+
+static void grow_entries(DiskStatsSampler* sampler, size_t needed) {
+    size_t capacity = sampler->entry_capacity;
+    while (capacity < needed) capacity *= 2;
+
+    sampler->previous = g_realloc(sampler->previous, capacity * sizeof(DiskStatsEntry));
+    sampler->current = g_realloc(sampler->current, capacity * sizeof(DiskStatsEntry));
+    sampler->rates = g_realloc(sampler->rates, capacity * sizeof(DiskIoRates));
+    sampler->entry_capacity = capacity;
+}
+
+// Lines keep their order between reads, so the entry at the same index is
+// almost always the match; fall back to a scan when devices come and go
+static const DiskStatsEntry* find_previous(const DiskStatsSampler* sampler, size_t index,
+                                           const DiskStatsEntry* entry) {
+    if (index < sampler->previous_count) {
+        const DiskStatsEntry* candidate = &sampler->previous[index];
+        if (candidate->major == entry->major && candidate->minor == entry->minor &&
+            strcmp(candidate->name, entry->name) == 0) {
+            return candidate;
+        }
+    }
+    for (size_t i = 0; i < sampler->previous_count; i++) {
+        const DiskStatsEntry* candidate = &sampler->previous[i];
+        if (candidate->major == entry->major && candidate->minor == entry->minor &&
+            strcmp(candidate->name, entry->name) == 0) {
+            return candidate;
+        }
+    }
+    return NULL;
+}
+
+gboolean diskstats_sampler_tick(DiskStatsSampler* sampler, GError** error) {
+    pthread_mutex_lock(&sampler->lock);
+
+    ssize_t length = read_stats(sampler);
+    if (length < 0) {
+        int saved = errno;
+        pthread_mutex_unlock(&sampler->lock);
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Cannot read disk statistics: %s", g_strerror(saved));
+        return FALSE;
+    }
+    gint64 now = g_get_monotonic_time();
+
+    // Swap so the last tick becomes the baseline, then parse into the other array
+    DiskStatsEntry* swap = sampler->previous;
+    sampler->previous = sampler->current;
+    sampler->current = swap;
+    sampler->previous_count = sampler->current_count;
+    sampler->previous_us = sampler->current_us;
+
+    size_t count = diskstats_parse(sampler->buffer, (size_t)length,
+                                   sampler->current, sampler->entry_capacity);
+    if (count > sampler->entry_capacity) {
+        grow_entries(sampler, count);
+        count = diskstats_parse(sampler->buffer, (size_t)length,
+                                sampler->current, sampler->entry_capacity);
+    }
+    sampler->current_count = count;
+    sampler->current_us = now;
+
+    if (sampler->previous_us == 0) {
+        sampler->rate_count = 0;
+    } else {
+        gint64 elapsed = now - sampler->previous_us;
+        for (size_t i = 0; i < count; i++) {
+            const DiskStatsEntry* entry = &sampler->current[i];
+            diskstats_compute_rates(find_previous(sampler, i, entry), entry, elapsed,
+                                    &sampler->rates[i]);
+        }
+        sampler->rate_count = count;
+    }
+
+    pthread_mutex_unlock(&sampler->lock);
+    return TRUE;
+}
+
+static void* sampler_thread_func(void* data) {
+    DiskStatsSampler* sampler = data;
+
+    pthread_mutex_lock(&sampler->lock);
+    while (sampler->running) {
+        pthread_mutex_unlock(&sampler->lock);
+
+        g_autoptr(GError) error = NULL;
+        gboolean ok = diskstats_sampler_tick(sampler, &error);
+        pthread_mutex_lock(&sampler->lock);
+        size_t rate_count = sampler->rate_count;
+        pthread_mutex_unlock(&sampler->lock);
+        if (!ok) {
+            g_warning("%s", error->message);
+        } else if (sampler->callback && rate_count > 0) {
+            // The baseline tick has nothing to report
+            sampler->callback(sampler, sampler->user_data);
+        }
+
+        pthread_mutex_lock(&sampler->lock);
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += sampler->interval_ms / 1000;
+        deadline.tv_nsec += (long)(sampler->interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        guint interval_ms = sampler->interval_ms;
+        while (sampler->running && sampler->interval_ms == interval_ms &&
+               pthread_cond_timedwait(&sampler->wake, &sampler->lock, &deadline) != ETIMEDOUT) {
+        }
+    }
+    pthread_mutex_unlock(&sampler->lock);
+    return NULL;
+}
+
+gboolean diskstats_sampler_start(DiskStatsSampler* sampler,
+                                 DiskStatsCallback callback,
+                                 void* user_data) {
+    pthread_mutex_lock(&sampler->lock);
+    if (sampler->running) {
+        pthread_mutex_unlock(&sampler->lock);
+        return TRUE;
+    }
+    sampler->callback = callback;
+    sampler->user_data = user_data;
+    sampler->running = TRUE;
+    pthread_mutex_unlock(&sampler->lock);
+
+    if (pthread_create(&sampler->thread, NULL, sampler_thread_func, sampler) != 0) {
+        pthread_mutex_lock(&sampler->lock);
+        sampler->running = FALSE;
+        pthread_mutex_unlock(&sampler->lock);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void diskstats_sampler_stop(DiskStatsSampler* sampler) {
+    pthread_mutex_lock(&sampler->lock);
+    if (!sampler->running) {
+        pthread_mutex_unlock(&sampler->lock);
+        return;
+    }
+    sampler->running = FALSE;
+    pthread_cond_signal(&sampler->wake);
+    pthread_mutex_unlock(&sampler->lock);
+
+    pthread_join(sampler->thread, NULL);
+}
+
+gboolean diskstats_sampler_get(DiskStatsSampler* sampler, const char* name, DiskIoRates* rates) {
+    gboolean found = FALSE;
+    pthread_mutex_lock(&sampler->lock);
+    for (size_t i = 0; i < sampler->rate_count; i++) {
+        if (strcmp(sampler->rates[i].name, name) == 0) {
+            *rates = sampler->rates[i];
+            found = TRUE;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sampler->lock);
+    return found;
+}
+
+void diskstats_sampler_foreach(DiskStatsSampler* sampler, DiskIoRatesFunc func, void* user_data) {
+    pthread_mutex_lock(&sampler->lock);
+    for (size_t i = 0; i < sampler->rate_count; i++) {
+        func(&sampler->rates[i], user_data);
+    }
+    pthread_mutex_unlock(&sampler->lock);
+}
+
+// FlValue conversion
+
+static FlValue* rates_to_fl_value(const DiskIoRates* rates) {
+    FlValue* map = fl_value_new_map();
+    fl_value_set_string_take(map, "name", fl_value_new_string(rates->name));
+    fl_value_set_string_take(map, "major", fl_value_new_int(rates->major));
+    fl_value_set_string_take(map, "minor", fl_value_new_int(rates->minor));
+    fl_value_set_string_take(map, "readBytesPerSec", fl_value_new_float(rates->read_bytes_per_sec));
+    fl_value_set_string_take(map, "writeBytesPerSec", fl_value_new_float(rates->write_bytes_per_sec));
+    fl_value_set_string_take(map, "readIops", fl_value_new_float(rates->read_iops));
+    fl_value_set_string_take(map, "writeIops", fl_value_new_float(rates->write_iops));
+    fl_value_set_string_take(map, "readAwaitMs", fl_value_new_float(rates->read_await_ms));
+    fl_value_set_string_take(map, "writeAwaitMs", fl_value_new_float(rates->write_await_ms));
+    fl_value_set_string_take(map, "serviceTimeMs", fl_value_new_float(rates->service_time_ms));
+    fl_value_set_string_take(map, "queueDepth", fl_value_new_float(rates->queue_depth));
+    fl_value_set_string_take(map, "utilization", fl_value_new_float(rates->utilization));
+    fl_value_set_string_take(map, "inFlight", fl_value_new_int((int64_t)rates->in_flight));
+    return map;
+}
+
+FlValue* diskstats_sampler_rates(DiskStatsSampler* sampler) {
+    FlValue* list = fl_value_new_list();
+    pthread_mutex_lock(&sampler->lock);
+    for (size_t i = 0; i < sampler->rate_count; i++) {
+        fl_value_append_take(list, rates_to_fl_value(&sampler->rates[i]));
+    }
+    pthread_mutex_unlock(&sampler->lock);
+    return list;
+}
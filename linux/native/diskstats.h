@@ -0,0 +1,155 @@
+#ifndef DISKSTATS_H
+#define DISKSTATS_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stddef.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+#define DISKSTATS_NAME_MAX 32
+
+/**
+ * DiskStatsEntry:
+ *
+ * One line of /proc/diskstats. Counters are cumulative since boot; the
+ * discard and flush groups are zero on kernels that do not report them.
+ */
+typedef struct {
+    char name[DISKSTATS_NAME_MAX];
+    guint major;
+    guint minor;
+    uint64_t reads_completed;
+    uint64_t reads_merged;
+    uint64_t sectors_read;
+    uint64_t read_ms;
+    uint64_t writes_completed;
+    uint64_t writes_merged;
+    uint64_t sectors_written;
+    uint64_t write_ms;
+    uint64_t in_flight;
+    uint64_t io_ms;
+    uint64_t weighted_io_ms;
+    uint64_t discards_completed;
+    uint64_t discards_merged;
+    uint64_t sectors_discarded;
+    uint64_t discard_ms;
+    uint64_t flushes_completed;
+    uint64_t flush_ms;
+} DiskStatsEntry;
+
+/**
+ * diskstats_parse:
+ * @buffer: contents of /proc/diskstats (need not be NUL-terminated)
+ * @entries: (out caller-allocates): receives up to @max_entries lines
+ *
+ * Parses without allocating. Malformed lines are skipped, names longer than
+ * DISKSTATS_NAME_MAX - 1 are truncated.
+ *
+ * Returns: number of lines in @buffer that parsed; may exceed @max_entries,
+ * in which case only the first @max_entries were stored
+ */
+size_t diskstats_parse(const char* buffer, size_t length,
+                       DiskStatsEntry* entries, size_t max_entries);
+
+/**
+ * DiskIoRates:
+ *
+ * Per-device rates over the interval between two samples, in the units
+ * iostat -x reports.
+ */
+typedef struct {
+    char name[DISKSTATS_NAME_MAX];
+    guint major;
+    guint minor;
+    double read_bytes_per_sec;
+    double write_bytes_per_sec;
+    double read_iops;
+    double write_iops;
+    double read_await_ms;             // average time per completed read
+    double write_await_ms;
+    double service_time_ms;           // busy time per completed request
+    double queue_depth;               // average requests outstanding
+    double utilization;               // percent of the interval with I/O in flight
+    uint64_t in_flight;               // requests outstanding at the sample
+} DiskIoRates;
+
+/**
+ * diskstats_compute_rates:
+ * @elapsed_us: time between the samples
+ *
+ * Counters that went backwards (device re-registered) yield zero rates.
+ */
+void diskstats_compute_rates(const DiskStatsEntry* previous,
+                             const DiskStatsEntry* current,
+                             gint64 elapsed_us,
+                             DiskIoRates* rates);
+
+/*
+ * Sampler
+ *
+ * Keeps /proc/diskstats open and reads it with a single pread() per tick into
+ * a buffer that only grows when the device count does. Two entry arrays are
+ * swapped between ticks, so a steady-state tick does not allocate.
+ */
+
+typedef struct DiskStatsSampler DiskStatsSampler;
+
+/**
+ * DiskStatsCallback:
+ *
+ * Invoked from the sampler thread after every tick that produced rates. Use
+ * diskstats_sampler_rates() or diskstats_sampler_get() to read them.
+ */
+typedef void (*DiskStatsCallback)(DiskStatsSampler* sampler, void* user_data);
+
+/**
+ * diskstats_sampler_new:
+ * @path: (nullable): stats file, NULL for /proc/diskstats
+ * @interval_ms: period between ticks of the sampler thread
+ *
+ * Returns: (transfer full): the sampler, or NULL with @error set
+ */
+DiskStatsSampler* diskstats_sampler_new(const char* path, guint interval_ms, GError** error);
+void diskstats_sampler_free(DiskStatsSampler* sampler);
+
+// Takes effect at the next tick
+void diskstats_sampler_set_interval(DiskStatsSampler* sampler, guint interval_ms);
+
+/**
+ * diskstats_sampler_tick:
+ *
+ * Reads and parses the file once and recomputes the rates against the
+ * previous tick. The first tick only establishes the baseline.
+ */
+gboolean diskstats_sampler_tick(DiskStatsSampler* sampler, GError** error);
+
+gboolean diskstats_sampler_start(DiskStatsSampler* sampler,
+                                 DiskStatsCallback callback,
+                                 void* user_data);
+void diskstats_sampler_stop(DiskStatsSampler* sampler);
+
+// Returns: TRUE if @name was present in the last two ticks
+gboolean diskstats_sampler_get(DiskStatsSampler* sampler, const char* name, DiskIoRates* rates);
+
+typedef void (*DiskIoRatesFunc)(const DiskIoRates* rates, void* user_data);
+
+/**
+ * diskstats_sampler_foreach:
+ *
+ * Calls @func for every device of the last tick, with the sampler locked;
+ * @func must not call back into the sampler.
+ */
+void diskstats_sampler_foreach(DiskStatsSampler* sampler, DiskIoRatesFunc func, void* user_data);
+
+/**
+ * diskstats_sampler_rates:
+ *
+ * Returns: (transfer full): a list with one map per device from the last
+ * tick, empty until two ticks have run
+ */
+FlValue* diskstats_sampler_rates(DiskStatsSampler* sampler);
+
+G_END_DECLS
+
+#endif // DISKSTATS_H
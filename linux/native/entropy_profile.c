@@ -0,0 +1,400 @@
+#include "entropy_profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#define ENTROPY_PROFILE_PROGRESS_INTERVAL_US 500000
+// How often the calling thread checks whether the workers are done
+#define ENTROPY_PROFILE_POLL_US 10000
+#define ENTROPY_PROFILE_DEFAULT_WORKERS 8
+// 95% normal quantile
+#define ENTROPY_PROFILE_Z 1.96
+
+// Class of a sample a cancelled or failed run never read
+#define NOT_SAMPLED 0xFF
+
+// Word access to sample buffers without breaking strict aliasing
+typedef uint64_t __attribute__((may_alias)) AliasU64;
+
+typedef struct {
+    int fd;
+    const EntropyProfileOptions* options;
+    const DeviceBackend* backend;
+    size_t block_size;
+    uint64_t* offsets;          // ascending sample offsets
+    guint* sample_region;
+    guint count;
+    uint8_t* classes;           // per sample, NOT_SAMPLED until read
+    float* entropies;           // per sample
+
+    guint next;                 // atomic
+    guint done;                 // atomic
+    gint running;               // atomic
+    gint failed;                // atomic
+    int failed_errno;
+    uint64_t failed_offset;
+    pthread_mutex_t lock;
+} ProfileJob;
+
+static gint64 monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_us(gint64 us) {
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+static uint64_t next_random(uint64_t* state) {
+    // xorshift64*
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+static gboolean is_stopped(const ProfileJob* job) {
+    return (job->options->cancel && *job->options->cancel) ||
+           __atomic_load_n(&job->failed, __ATOMIC_RELAXED);
+}
+
+static void fail(ProfileJob* job, int error_number, uint64_t offset) {
+    pthread_mutex_lock(&job->lock);
+    if (!job->failed) {
+        job->failed_errno = error_number;
+        job->failed_offset = offset;
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+EntropyClass entropy_classify_block(const uint8_t* data, size_t size, double* entropy) {
+    const AliasU64* words = (const AliasU64*)data;
+    size_t count = size / 8;
+
+    // Branch-free OR of differences; the compiler turns this into vector code
+    uint64_t pattern = 0x0101010101010101ull * data[0];
+    uint64_t diff = 0;
+    for (size_t i = 0; i < count; i++) {
+        diff |= words[i] ^ pattern;
+    }
+    if (diff == 0) {
+        if (entropy) *entropy = 0.0;
+        if (data[0] == 0x00) return ENTROPY_CLASS_ZERO;
+        if (data[0] == 0xFF) return ENTROPY_CLASS_ONES;
+        return ENTROPY_CLASS_CONSTANT;
+    }
+
+    // Four interleaved tables so consecutive equal bytes do not serialize on
+    // one counter
+    uint32_t tables[4][256];
+    memset(tables, 0, sizeof(tables));
+    for (size_t i = 0; i < count; i++) {
+        uint64_t w = words[i];
+        tables[0][w & 0xFF]++;
+        tables[1][(w >> 8) & 0xFF]++;
+        tables[2][(w >> 16) & 0xFF]++;
+        tables[3][(w >> 24) & 0xFF]++;
+        tables[0][(w >> 32) & 0xFF]++;
+        tables[1][(w >> 40) & 0xFF]++;
+        tables[2][(w >> 48) & 0xFF]++;
+        tables[3][w >> 56]++;
+    }
+
+    // H = log2(n) - sum(c * log2(c)) / n
+    double n = (double)(count * 8);
+    double sum = 0.0;
+    for (int b = 0; b < 256; b++) {
+        uint32_t c = tables[0][b] + tables[1][b] + tables[2][b] + tables[3][b];
+        if (c > 1) sum += c * log2((double)c);
+    }
+    double h = log2(n) - sum / n;
+    if (entropy) *entropy = h;
+
+    // Uniform bytes estimate about 8 - 255 / (2 n ln 2) bits; allow four
+    // times that bias before calling a block structured
+    double bias = 255.0 / (2.0 * n * M_LN2);
+    return h >= 8.0 - 4.0 * bias ? ENTROPY_CLASS_RANDOM : ENTROPY_CLASS_STRUCTURED;
+}
+
+static gboolean is_media_error(int error_number) {
+    return error_number == EIO || error_number == ENODATA || error_number == EILSEQ;
+}
+
+static void* worker_func(void* data) {
+    ProfileJob* job = data;
+    uint8_t* buffer = NULL;
+    if (posix_memalign((void**)&buffer, 4096, job->block_size) != 0) {
+        fail(job, ENOMEM, 0);
+        goto out;
+    }
+
+    while (!is_stopped(job)) {
+        guint index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (index >= job->count) break;
+
+        uint64_t offset = job->offsets[index];
+        size_t done = 0;
+        int read_errno = 0;
+        while (done < job->block_size) {
+            ssize_t n = job->backend->pread(job->fd, buffer + done, job->block_size - done,
+                                            offset + done, job->backend->ctx);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                read_errno = n < 0 ? errno : ENXIO;
+                break;
+            }
+            done += (size_t)n;
+        }
+
+        if (done == job->block_size) {
+            double entropy = 0.0;
+            job->classes[index] = (uint8_t)entropy_classify_block(buffer, job->block_size, &entropy);
+            job->entropies[index] = (float)entropy;
+        } else if (is_media_error(read_errno)) {
+            job->classes[index] = ENTROPY_CLASS_UNREADABLE;
+        } else {
+            fail(job, read_errno, offset + done);
+            break;
+        }
+        __atomic_add_fetch(&job->done, 1, __ATOMIC_RELAXED);
+    }
+
+out:
+    free(buffer);
+    __atomic_sub_fetch(&job->running, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void report_progress(ProfileJob* job, gint64 elapsed_us) {
+    const EntropyProfileOptions* options = job->options;
+    if (!options->progress) return;
+
+    BulkProgress progress = {
+        .bytes_done = (uint64_t)__atomic_load_n(&job->done, __ATOMIC_RELAXED) * job->block_size,
+        .bytes_total = (uint64_t)job->count * job->block_size,
+        .elapsed_us = elapsed_us,
+        .throttle = NULL,
+    };
+    options->progress(&progress, options->user_data);
+}
+
+void entropy_profile_default_options(EntropyProfileOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->block_size = ENTROPY_PROFILE_DEFAULT_BLOCK_SIZE;
+    options->regions = ENTROPY_PROFILE_DEFAULT_REGIONS;
+    options->margin = ENTROPY_PROFILE_DEFAULT_MARGIN;
+    options->workers = ENTROPY_PROFILE_DEFAULT_WORKERS;
+}
+
+gboolean entropy_profile_run(int fd,
+                             const EntropyProfileOptions* options,
+                             EntropyProfileResult* result,
+                             GError** error) {
+    memset(result, 0, sizeof(*result));
+
+    ProfileJob job;
+    memset(&job, 0, sizeof(job));
+    job.fd = fd;
+    job.options = options;
+    job.backend = options->backend ? options->backend : device_backend_linux();
+    job.block_size = options->block_size ? options->block_size : ENTROPY_PROFILE_DEFAULT_BLOCK_SIZE;
+    if (job.block_size % 4096 != 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "Sample block size must be a multiple of 4096");
+        return FALSE;
+    }
+
+    uint64_t device_size = 0;
+    if (job.backend->device_size(fd, &device_size, job.backend->ctx) < 0) {
+        int saved = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Failed to get device size: %s", g_strerror(saved));
+        return FALSE;
+    }
+    uint64_t start = options->offset;
+    uint64_t end = options->length ? options->offset + options->length : device_size;
+    if (start % 4096 != 0 || end > device_size || start >= end || end - start < job.block_size) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "Sample range must be 4096-byte aligned, inside the device and "
+                    "at least one block long");
+        return FALSE;
+    }
+
+    // Strata of whole blocks
+    uint64_t total_blocks = (end - start) / job.block_size;
+    guint region_count = options->regions ? options->regions : ENTROPY_PROFILE_DEFAULT_REGIONS;
+    region_count = (guint)MIN(MIN(region_count, ENTROPY_PROFILE_MAX_REGIONS), total_blocks);
+    uint64_t region_blocks = (total_blocks + region_count - 1) / region_count;
+    region_count = (guint)((total_blocks + region_blocks - 1) / region_blocks);
+
+    // A proportion estimated from n samples is within z * sqrt(p(1-p)/n),
+    // at most z / (2 sqrt(n)) at p = 0.5
+    guint wanted = options->samples;
+    if (wanted == 0) {
+        double margin = options->margin > 0 ? options->margin : ENTROPY_PROFILE_DEFAULT_MARGIN;
+        wanted = (guint)ceil(ENTROPY_PROFILE_Z * ENTROPY_PROFILE_Z / (4.0 * margin * margin));
+    }
+    uint64_t per_region = MAX((wanted + region_count - 1) / region_count, 1);
+
+    job.offsets = g_new(uint64_t, (size_t)MIN(per_region * region_count, total_blocks));
+    job.sample_region = g_new(guint, (size_t)MIN(per_region * region_count, total_blocks));
+    uint64_t seed = options->seed ? options->seed : (uint64_t)g_get_real_time() | 1;
+
+    // Jittered sampling: each stratum is cut into per_region slices and one
+    // random block is taken from each, so samples never repeat
+    for (guint r = 0; r < region_count; r++) {
+        uint64_t first = r * region_blocks;
+        uint64_t blocks = MIN(region_blocks, total_blocks - first);
+        uint64_t slices = MIN(per_region, blocks);
+        for (uint64_t s = 0; s < slices; s++) {
+            uint64_t slice_start = blocks * s / slices;
+            uint64_t slice_end = blocks * (s + 1) / slices;
+            uint64_t block = first + slice_start + next_random(&seed) % (slice_end - slice_start);
+            job.sample_region[job.count] = r;
+            job.offsets[job.count++] = start + block * job.block_size;
+        }
+    }
+    job.classes = g_malloc(MAX(job.count, 1));
+    memset(job.classes, NOT_SAMPLED, job.count);
+    job.entropies = g_new0(float, job.count);
+    pthread_mutex_init(&job.lock, NULL);
+
+    guint worker_count = options->workers ? options->workers : ENTROPY_PROFILE_DEFAULT_WORKERS;
+    worker_count = MIN(MIN(worker_count, ENTROPY_PROFILE_MAX_WORKERS), job.count);
+    pthread_t threads[ENTROPY_PROFILE_MAX_WORKERS];
+    guint started = 0;
+    gint64 start_us = monotonic_us();
+    job.running = (gint)worker_count;
+    for (guint i = 0; i < worker_count; i++) {
+        if (pthread_create(&threads[i], NULL, worker_func, &job) != 0) break;
+        started++;
+    }
+    __atomic_sub_fetch(&job.running, (gint)(worker_count - started), __ATOMIC_RELAXED);
+    if (started == 0) fail(&job, EAGAIN, start);
+
+    gint64 last_progress_us = start_us;
+    while (__atomic_load_n(&job.running, __ATOMIC_ACQUIRE) > 0) {
+        sleep_us(ENTROPY_PROFILE_POLL_US);
+        gint64 now = monotonic_us();
+        if (now - last_progress_us >= ENTROPY_PROFILE_PROGRESS_INTERVAL_US) {
+            report_progress(&job, now - start_us);
+            last_progress_us = now;
+        }
+    }
+    for (guint i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    result->elapsed_us = monotonic_us() - start_us;
+    report_progress(&job, result->elapsed_us);
+
+    result->offset = start;
+    result->length = end - start;
+    result->block_size = job.block_size;
+    result->region_size = region_blocks * job.block_size;
+    result->region_count = region_count;
+    result->regions = g_new0(EntropyRegion, region_count);
+
+    double entropy_sum = 0.0;
+    guint readable = 0;
+    for (guint i = 0; i < job.count; i++) {
+        if (job.classes[i] == NOT_SAMPLED) continue;
+        EntropyRegion* region = &result->regions[job.sample_region[i]];
+        EntropyClass cls = job.classes[i];
+        region->samples++;
+        region->counts[cls]++;
+        result->counts[cls]++;
+        result->samples++;
+        if (cls != ENTROPY_CLASS_UNREADABLE) {
+            region->entropy_sum += job.entropies[i];
+            entropy_sum += job.entropies[i];
+            readable++;
+        }
+    }
+    result->bytes_read = (uint64_t)result->samples * job.block_size;
+    result->mean_entropy = readable > 0 ? entropy_sum / readable : 0.0;
+    result->margin = result->samples > 0
+        ? ENTROPY_PROFILE_Z / (2.0 * sqrt((double)result->samples)) : 1.0;
+
+    g_free(job.offsets);
+    g_free(job.sample_region);
+    g_free(job.classes);
+    g_free(job.entropies);
+    pthread_mutex_destroy(&job.lock);
+
+    if (job.failed) {
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(job.failed_errno),
+                    "Read failed at offset %llu: %s",
+                    (unsigned long long)job.failed_offset, g_strerror(job.failed_errno));
+        return FALSE;
+    }
+    if (options->cancel && *options->cancel) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Profiling cancelled");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void entropy_profile_result_clear(EntropyProfileResult* result) {
+    g_clear_pointer(&result->regions, g_free);
+    result->region_count = 0;
+}
+
+const char* entropy_class_name(EntropyClass cls) {
+    switch (cls) {
+        case ENTROPY_CLASS_ZERO: return "zero";
+        case ENTROPY_CLASS_ONES: return "ones";
+        case ENTROPY_CLASS_CONSTANT: return "constant";
+        case ENTROPY_CLASS_STRUCTURED: return "structured";
+        case ENTROPY_CLASS_RANDOM: return "random";
+        case ENTROPY_CLASS_UNREADABLE: return "unreadable";
+        default: return "unknown";
+    }
+}
+
+FlValue* entropy_profile_result_to_fl_value(const EntropyProfileResult* result) {
+    FlValue* value = fl_value_new_map();
+    fl_value_set_string_take(value, "offset", fl_value_new_int((int64_t)result->offset));
+    fl_value_set_string_take(value, "length", fl_value_new_int((int64_t)result->length));
+    fl_value_set_string_take(value, "blockSize", fl_value_new_int((int64_t)result->block_size));
+    fl_value_set_string_take(value, "samples", fl_value_new_int(result->samples));
+    fl_value_set_string_take(value, "bytesRead", fl_value_new_int((int64_t)result->bytes_read));
+    fl_value_set_string_take(value, "elapsedUs", fl_value_new_int(result->elapsed_us));
+    fl_value_set_string_take(value, "meanEntropy", fl_value_new_float(result->mean_entropy));
+    fl_value_set_string_take(value, "margin", fl_value_new_float(result->margin));
+
+    FlValue* counts = fl_value_new_map();
+    for (int c = 0; c < ENTROPY_CLASS_COUNT; c++) {
+        fl_value_set_string_take(counts, entropy_class_name(c), fl_value_new_int(result->counts[c]));
+    }
+    fl_value_set_string_take(value, "counts", counts);
+
+    // Occupancy map: the most frequent class of each region (255 when it got
+    // no samples) and its mean entropy
+    uint8_t* classes = g_new(uint8_t, MAX(result->region_count, 1));
+    double* entropies = g_new(double, MAX(result->region_count, 1));
+    for (guint r = 0; r < result->region_count; r++) {
+        const EntropyRegion* region = &result->regions[r];
+        guint best = 0;
+        for (int c = 1; c < ENTROPY_CLASS_COUNT; c++) {
+            if (region->counts[c] > region->counts[best]) best = c;
+        }
+        guint readable = region->samples - region->counts[ENTROPY_CLASS_UNREADABLE];
+        classes[r] = region->samples > 0 ? (uint8_t)best : 0xFF;
+        entropies[r] = readable > 0 ? region->entropy_sum / readable : 0.0;
+    }
+    fl_value_set_string_take(value, "regionSize", fl_value_new_int((int64_t)result->region_size));
+    fl_value_set_string_take(value, "regionClasses", fl_value_new_uint8_list(classes, result->region_count));
+    fl_value_set_string_take(value, "regionEntropy", fl_value_new_float_list(entropies, result->region_count));
+    g_free(classes);
+    g_free(entropies);
+    return value;
+}
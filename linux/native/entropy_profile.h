@@ -0,0 +1,99 @@
+#ifndef ENTROPY_PROFILE_H
+#define ENTROPY_PROFILE_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdint.h>
+#include "bulk_io.h"
+
+G_BEGIN_DECLS
+
+#define ENTROPY_PROFILE_DEFAULT_BLOCK_SIZE (64u * 1024)
+#define ENTROPY_PROFILE_DEFAULT_REGIONS 256
+#define ENTROPY_PROFILE_MAX_REGIONS 4096
+#define ENTROPY_PROFILE_DEFAULT_MARGIN 0.02
+#define ENTROPY_PROFILE_MAX_WORKERS 64
+
+typedef enum {
+    ENTROPY_CLASS_ZERO = 0,
+    ENTROPY_CLASS_ONES,           // every byte 0xFF
+    ENTROPY_CLASS_CONSTANT,       // one repeated byte other than 0x00/0xFF
+    ENTROPY_CLASS_STRUCTURED,     // file systems, text, executables...
+    ENTROPY_CLASS_RANDOM,         // encrypted, compressed or random fill
+    ENTROPY_CLASS_UNREADABLE,
+    ENTROPY_CLASS_COUNT,
+} EntropyClass;
+
+typedef struct {
+    uint64_t offset;
+    uint64_t length;                  // 0 = to the end of the device
+    size_t block_size;                // bytes per sample, a multiple of 4096
+    guint regions;                    // strata; each gets its share of the samples
+    guint samples;                    // total samples, 0 = derived from @margin
+    double margin;                    // wanted 95% half-width of class fractions
+    guint workers;                    // concurrent reads, 0 = 8
+    uint64_t seed;                    // 0 = time based
+    const DeviceBackend* backend;     // optional, NULL reads through the kernel
+    BulkProgressCallback progress;    // bytes are the sampled bytes
+    void* user_data;
+    const volatile gint* cancel;
+} EntropyProfileOptions;
+
+typedef struct {
+    guint samples;
+    guint counts[ENTROPY_CLASS_COUNT];
+    double entropy_sum;               // bits per byte, summed over readable samples
+} EntropyRegion;
+
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+    size_t block_size;
+    guint samples;
+    uint64_t bytes_read;
+    gint64 elapsed_us;
+    guint counts[ENTROPY_CLASS_COUNT];
+    double mean_entropy;
+    double margin;                    // achieved 95% half-width of the class fractions
+    EntropyRegion* regions;
+    guint region_count;
+    uint64_t region_size;
+} EntropyProfileResult;
+
+void entropy_profile_default_options(EntropyProfileOptions* options);
+
+/**
+ * entropy_classify_block:
+ * @entropy: (out) (optional): Shannon entropy of the byte distribution in
+ *   bits per byte; 0 for constant blocks
+ *
+ * Returns: the class of @size bytes at @data, @size a multiple of 8
+ */
+EntropyClass entropy_classify_block(const uint8_t* data, size_t size, double* entropy);
+
+/**
+ * entropy_profile_run:
+ * @fd: device opened for reading, preferably O_DIRECT
+ * @result: (out): release with entropy_profile_result_clear()
+ *
+ * Reads a stratified random sample of blocks: the range is cut into
+ * @regions equal strata and each stratum gets the same number of blocks at
+ * random aligned positions. Reads are issued in ascending offset order by
+ * @workers threads so a rotational disk sweeps once.
+ *
+ * Returns: TRUE unless the range is invalid, the run is cancelled or the
+ *   device goes away; unreadable samples are only counted
+ */
+gboolean entropy_profile_run(int fd,
+                             const EntropyProfileOptions* options,
+                             EntropyProfileResult* result,
+                             GError** error);
+
+void entropy_profile_result_clear(EntropyProfileResult* result);
+
+const char* entropy_class_name(EntropyClass cls);
+
+FlValue* entropy_profile_result_to_fl_value(const EntropyProfileResult* result);
+
+G_END_DECLS
+
+#endif // ENTROPY_PROFILE_H
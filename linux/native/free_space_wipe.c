@@ -0,0 +1,344 @@
+#define _GNU_SOURCE
+#include "free_space_wipe.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+
+// Fill files are sized in whole MiB so every request stays O_DIRECT aligned;
+// less than this much budget left counts as full
+#define FREE_SPACE_WIPE_GRANULE (1ull * 1024 * 1024)
+// Latency budget per request while sharing the disk with foreground I/O
+#define FREE_SPACE_WIPE_LATENCY_TARGET_MS 50.0
+#define FREE_SPACE_WIPE_DEFAULT_WORKERS 4
+
+typedef struct {
+    const FreeSpaceWipeOptions* options;
+    int dir_fd;
+    uint64_t base;               // bytes written by earlier files
+    uint64_t total;              // budget measured at the start
+    gint stop;                   // cancel flag handed to bulk_io_write
+    gboolean margin_hit;
+} FillState;
+
+static gint64 monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static gboolean available_bytes(int dir_fd, uint64_t* available) {
+    struct statvfs st;
+    if (fstatvfs(dir_fd, &st) != 0) return FALSE;
+    *available = (uint64_t)st.f_bavail * st.f_frsize;
+    return TRUE;
+}
+
+static gboolean user_cancelled(const FreeSpaceWipeOptions* options) {
+    return options->cancel && __atomic_load_n(options->cancel, __ATOMIC_RELAXED);
+}
+
+// Runs once per throttle window on the calling thread: forwards progress
+// over the whole fill and stops the current file when the user cancels or
+// other writers push available space under the margin.
+static void fill_progress_cb(const BulkProgress* progress, void* user_data) {
+    FillState* state = (FillState*)user_data;
+    const FreeSpaceWipeOptions* options = state->options;
+
+    uint64_t available = 0;
+    if (available_bytes(state->dir_fd, &available) && available < options->min_free_bytes) {
+        state->margin_hit = TRUE;
+        __atomic_store_n(&state->stop, 1, __ATOMIC_RELAXED);
+    }
+    if (user_cancelled(options)) {
+        __atomic_store_n(&state->stop, 1, __ATOMIC_RELAXED);
+    }
+
+    if (options->progress) {
+        BulkProgress total = *progress;
+        total.bytes_done = state->base + progress->bytes_done;
+        total.bytes_total = MAX(state->total, total.bytes_done);
+        options->progress(&total, options->user_data);
+    }
+}
+
+// Creates a fill file that has no name, so the kernel frees it on close or
+// when the process dies. O_TMPFILE is tried first; file systems without it
+// get a uniquely named file that is unlinked before any space is claimed.
+static int open_fill_file(int dir_fd, guint index,
+                          gboolean* unnamed, gboolean* direct) {
+    const int flags[2] = { O_RDWR | O_CLOEXEC | O_DIRECT, O_RDWR | O_CLOEXEC };
+    for (int i = 0; i < 2; i++) {
+        int fd = openat(dir_fd, ".", flags[i] | O_TMPFILE, 0600);
+        if (fd >= 0) {
+            *unnamed = TRUE;
+            *direct = i == 0;
+            return fd;
+        }
+        if (errno == EINVAL && i == 0) continue;
+        if (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL) return -1;
+
+        char name[64];
+        snprintf(name, sizeof(name), ".swip-fill-%d-%u", (int)getpid(), index);
+        fd = openat(dir_fd, name, flags[i] | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno == EINVAL && i == 0) continue;
+        if (fd < 0) return -1;
+        if (unlinkat(dir_fd, name, 0) != 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        *unnamed = FALSE;
+        *direct = i == 0;
+        return fd;
+    }
+    return -1;
+}
+
+// Whether the file system sits on a non-rotational device. Partitions keep
+// their queue attributes on the parent disk. Unknown counts as solid state
+// so FITRIM is attempted and its own error decides.
+static gboolean backed_by_ssd(int dir_fd) {
+    struct stat st;
+    if (fstat(dir_fd, &st) != 0) return TRUE;
+    const char* suffixes[2] = { "queue/rotational", "../queue/rotational" };
+    for (int i = 0; i < 2; i++) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/%s",
+                 major(st.st_dev), minor(st.st_dev), suffixes[i]);
+        FILE* file = fopen(path, "r");
+        if (!file) continue;
+        int rotational = 1;
+        if (fscanf(file, "%d", &rotational) != 1) rotational = 0;
+        fclose(file);
+        return rotational == 0;
+    }
+    return TRUE;
+}
+
+void free_space_wipe_default_options(FreeSpaceWipeOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->min_free_bytes = FREE_SPACE_WIPE_DEFAULT_MIN_FREE;
+    options->file_size = FREE_SPACE_WIPE_DEFAULT_FILE_SIZE;
+    options->pattern = BULK_PATTERN_RANDOM;
+    options->max_workers = FREE_SPACE_WIPE_DEFAULT_WORKERS;
+    options->latency_target_ms = FREE_SPACE_WIPE_LATENCY_TARGET_MS;
+    options->trim = -1;
+}
+
+gboolean free_space_wipe_run(const char* mount_point,
+                             const FreeSpaceWipeOptions* options,
+                             FreeSpaceWipeResult* result,
+                             GError** error) {
+    memset(result, 0, sizeof(*result));
+    result->unnamed_files = TRUE;
+    result->direct_io = TRUE;
+    gint64 start_us = monotonic_us();
+
+    int dir_fd = open(mount_point, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) {
+        int saved = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Failed to open %s: %s", mount_point, g_strerror(saved));
+        return FALSE;
+    }
+
+    uint64_t available = 0;
+    if (!available_bytes(dir_fd, &available)) {
+        int saved = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Failed to stat %s: %s", mount_point, g_strerror(saved));
+        close(dir_fd);
+        return FALSE;
+    }
+    result->available_before = available;
+
+    uint64_t budget = available > options->min_free_bytes ? available - options->min_free_bytes : 0;
+    // Grow the files on large file systems so the open descriptors stay bounded
+    uint64_t file_size = options->file_size ? options->file_size : FREE_SPACE_WIPE_DEFAULT_FILE_SIZE;
+    file_size = MAX(file_size, budget / FREE_SPACE_WIPE_MAX_FILES + 1);
+    file_size = (file_size + FREE_SPACE_WIPE_GRANULE - 1) / FREE_SPACE_WIPE_GRANULE * FREE_SPACE_WIPE_GRANULE;
+
+    IoThrottleConfig config;
+    io_throttle_default_config(&config);
+    config.latency_target_ms = options->latency_target_ms > 0
+        ? options->latency_target_ms : FREE_SPACE_WIPE_LATENCY_TARGET_MS;
+    config.max_rate_bps = options->max_rate_bps;
+    config.max_queue_depth = options->max_workers ? options->max_workers : FREE_SPACE_WIPE_DEFAULT_WORKERS;
+    if (config.min_rate_bps > config.max_rate_bps && config.max_rate_bps > 0) {
+        config.min_rate_bps = config.max_rate_bps;
+    }
+    IoThrottle* throttle = io_throttle_new(&config);
+
+    FillState state = {
+        .options = options,
+        .dir_fd = dir_fd,
+        .total = budget,
+    };
+
+    int fds[FREE_SPACE_WIPE_MAX_FILES];
+    guint file_count = 0;
+    gboolean ok = TRUE;
+
+    while (file_count < FREE_SPACE_WIPE_MAX_FILES) {
+        if (user_cancelled(options)) {
+            state.stop = 1;
+            break;
+        }
+        if (!available_bytes(dir_fd, &available)) break;
+        if (available < options->min_free_bytes) {
+            state.margin_hit = TRUE;
+            break;
+        }
+        uint64_t length = MIN(file_size, available - options->min_free_bytes);
+        length = length / FREE_SPACE_WIPE_GRANULE * FREE_SPACE_WIPE_GRANULE;
+        if (length == 0) break;
+
+        gboolean unnamed = FALSE, direct = FALSE;
+        int fd = open_fill_file(dir_fd, file_count, &unnamed, &direct);
+        if (fd < 0) {
+            int saved = errno;
+            g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                        "Failed to create fill file in %s: %s", mount_point, g_strerror(saved));
+            ok = FALSE;
+            break;
+        }
+        fds[file_count++] = fd;
+        result->unnamed_files &= unnamed;
+        result->direct_io &= direct;
+
+        // Reserve first: running out here costs nothing. File systems without
+        // fallocate claim blocks as the writes land instead.
+        if (fallocate(fd, 0, 0, (off_t)length) != 0 && errno != EOPNOTSUPP) {
+            if (errno == ENOSPC) break;
+            int saved = errno;
+            g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                        "Failed to reserve %llu bytes: %s",
+                        (unsigned long long)length, g_strerror(saved));
+            ok = FALSE;
+            break;
+        }
+
+        BulkWriteOptions bulk;
+        bulk_io_default_options(&bulk);
+        bulk.length = length;
+        bulk.chunk_size = options->chunk_size;
+        bulk.pattern = options->pattern;
+        bulk.max_workers = config.max_queue_depth;
+        bulk.throttle = throttle;
+        bulk.progress = fill_progress_cb;
+        bulk.user_data = &state;
+        bulk.cancel = &state.stop;
+
+        BulkWriteResult written;
+        GError* write_error = NULL;
+        gboolean complete = bulk_io_write(fd, &bulk, &written, &write_error);
+        state.base += written.bytes_written;
+        result->bytes_written += written.bytes_written;
+
+        // Unnamed files drop their dirty pages on close, and the device may
+        // still hold the rest in its cache
+        if (fdatasync(fd) != 0 && complete) {
+            int saved = errno;
+            g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                        "Failed to flush fill file: %s", g_strerror(saved));
+            ok = FALSE;
+            break;
+        }
+        if (state.stop) {
+            g_clear_error(&write_error);
+            break;
+        }
+        if (!complete) {
+            // Without a reservation the file system can fill up mid-file
+            uint64_t now_available = 0;
+            if (available_bytes(dir_fd, &now_available) &&
+                now_available < options->min_free_bytes + FREE_SPACE_WIPE_GRANULE) {
+                g_clear_error(&write_error);
+                break;
+            }
+            g_propagate_error(error, write_error);
+            ok = FALSE;
+            break;
+        }
+    }
+    io_throttle_free(throttle);
+    result->files = file_count;
+
+    // Give the space back newest first until the margin holds again; what
+    // remains was overwritten and is released at the end either way
+    while (state.margin_hit && file_count > 0) {
+        if (available_bytes(dir_fd, &available) && available >= options->min_free_bytes) break;
+        close(fds[--file_count]);
+    }
+    while (file_count > 0) {
+        close(fds[--file_count]);
+    }
+
+    if (user_cancelled(options)) {
+        result->stop_reason = FREE_SPACE_STOP_CANCELLED;
+    } else if (state.margin_hit) {
+        result->stop_reason = FREE_SPACE_STOP_MARGIN;
+    } else {
+        result->stop_reason = FREE_SPACE_STOP_FILLED;
+    }
+
+    // The blocks just overwritten are free again; tell the SSD before its
+    // garbage collection copies them around
+    if (ok && result->stop_reason != FREE_SPACE_STOP_CANCELLED &&
+        (options->trim > 0 || (options->trim < 0 && backed_by_ssd(dir_fd)))) {
+        struct fstrim_range range = { .start = 0, .len = UINT64_MAX, .minlen = 0 };
+        if (ioctl(dir_fd, FITRIM, &range) == 0) {
+            result->trimmed = TRUE;
+            result->trimmed_bytes = range.len;
+        } else if (options->trim > 0) {
+            g_warning("FITRIM on %s failed: %s", mount_point, g_strerror(errno));
+        }
+    }
+    close(dir_fd);
+    result->elapsed_us = monotonic_us() - start_us;
+
+    if (!ok) return FALSE;
+    if (result->stop_reason == FREE_SPACE_STOP_CANCELLED) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Free space wipe cancelled");
+        return FALSE;
+    }
+    if (result->bytes_written == 0 && budget > 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                    "No free space could be claimed on %s", mount_point);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static const char* stop_reason_name(FreeSpaceStopReason reason) {
+    switch (reason) {
+    case FREE_SPACE_STOP_FILLED: return "filled";
+    case FREE_SPACE_STOP_MARGIN: return "margin";
+    case FREE_SPACE_STOP_CANCELLED: return "cancelled";
+    }
+    return "unknown";
+}
+
+FlValue* free_space_wipe_result_to_fl_value(const FreeSpaceWipeResult* result) {
+    FlValue* value = fl_value_new_map();
+    fl_value_set_string_take(value, "availableBefore", fl_value_new_int((int64_t)result->available_before));
+    fl_value_set_string_take(value, "bytesWritten", fl_value_new_int((int64_t)result->bytes_written));
+    fl_value_set_string_take(value, "files", fl_value_new_int(result->files));
+    fl_value_set_string_take(value, "unnamedFiles", fl_value_new_bool(result->unnamed_files));
+    fl_value_set_string_take(value, "directIo", fl_value_new_bool(result->direct_io));
+    fl_value_set_string_take(value, "trimmed", fl_value_new_bool(result->trimmed));
+    fl_value_set_string_take(value, "trimmedBytes", fl_value_new_int((int64_t)result->trimmed_bytes));
+    fl_value_set_string_take(value, "stopReason", fl_value_new_string(stop_reason_name(result->stop_reason)));
+    fl_value_set_string_take(value, "elapsedUs", fl_value_new_int(result->elapsed_us));
+    return value;
+}
@@ -0,0 +1,75 @@
+#ifndef FREE_SPACE_WIPE_H
+#define FREE_SPACE_WIPE_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdint.h>
+#include "bulk_io.h"
+
+G_BEGIN_DECLS
+
+#define FREE_SPACE_WIPE_DEFAULT_FILE_SIZE (1ull * 1024 * 1024 * 1024)
+#define FREE_SPACE_WIPE_DEFAULT_MIN_FREE (256ull * 1024 * 1024)
+#define FREE_SPACE_WIPE_MAX_FILES 512           // fill files grow to stay under this many open fds
+
+typedef enum {
+    FREE_SPACE_STOP_FILLED = 0,       // free space down to the margin
+    FREE_SPACE_STOP_MARGIN,           // other writers ate into the margin; backed off
+    FREE_SPACE_STOP_CANCELLED,
+} FreeSpaceStopReason;
+
+typedef struct {
+    uint64_t min_free_bytes;          // never let available space drop below this
+    uint64_t file_size;               // size of each fill file, 0 for the default
+    size_t chunk_size;                // bytes per write request, 0 for the bulk default
+    BulkPattern pattern;              // random defeats compressing file systems
+    guint max_workers;                // concurrent write requests per file
+    double latency_target_ms;         // throttle when our writes take longer, 0 = default
+    uint64_t max_rate_bps;            // 0 = unlimited
+    int trim;                         // -1 = when the file system supports FITRIM, 0 = never, 1 = always
+    BulkProgressCallback progress;
+    void* user_data;
+    const volatile gint* cancel;
+} FreeSpaceWipeOptions;
+
+typedef struct {
+    uint64_t available_before;
+    uint64_t bytes_written;
+    guint files;
+    gboolean unnamed_files;           // O_TMPFILE; otherwise created and unlinked at once
+    gboolean direct_io;
+    gboolean trimmed;
+    uint64_t trimmed_bytes;           // as reported by FITRIM
+    FreeSpaceStopReason stop_reason;
+    gint64 elapsed_us;
+} FreeSpaceWipeResult;
+
+void free_space_wipe_default_options(FreeSpaceWipeOptions* options);
+
+/**
+ * free_space_wipe_run:
+ * @mount_point: directory of the mounted file system to scrub
+ *
+ * Overwrites the file system's free space while it stays mounted and in
+ * use. Free space is claimed one fill file at a time: each is reserved with
+ * fallocate() so ENOSPC shows up before anything is written, then
+ * overwritten with @pattern through bulk_io_write() under an IoThrottle that
+ * backs off when request latency rises because of foreground I/O.
+ * Available space is polled during the fill; if other writers push it below
+ * @min_free_bytes the newest file is released and the fill stops.
+ *
+ * Fill files have no name (O_TMPFILE, or unlinked right after creation) so
+ * closing them frees the space and a crash leaves nothing behind. After the
+ * files are released, FITRIM tells an SSD that the scrubbed blocks are free.
+ *
+ * Returns: TRUE unless nothing could be written or the run was cancelled
+ */
+gboolean free_space_wipe_run(const char* mount_point,
+                             const FreeSpaceWipeOptions* options,
+                             FreeSpaceWipeResult* result,
+                             GError** error);
+
+FlValue* free_space_wipe_result_to_fl_value(const FreeSpaceWipeResult* result);
+
+G_END_DECLS
+
+#endif // FREE_SPACE_WIPE_H
@@ -0,0 +1,558 @@
+#include "health_sampler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/hdreg.h>
+#include <endian.h>
+
+// NVMe Get Log Page
+#define NVME_ADMIN_GET_LOG_PAGE 0x02
+#define NVME_LOG_SMART 0x02
+#define NVME_NSID_ALL 0xFFFFFFFF
+
+// ATA SMART READ DATA through HDIO_DRIVE_CMD
+#define ATA_CMD_SMART 0xB0
+#define ATA_SMART_READ_VALUES 0xD0
+
+// ATA SMART attribute table: 30 entries of 12 bytes starting at offset 2
+#define ATA_SMART_ATTR_OFFSET 2
+#define ATA_SMART_ATTR_SIZE 12
+#define ATA_SMART_ATTR_COUNT 30
+
+#define ATA_ATTR_REALLOCATED 5
+#define ATA_ATTR_POWER_ON_HOURS 9
+#define ATA_ATTR_UNSAFE_SHUTDOWNS 192
+#define ATA_ATTR_AIRFLOW_TEMPERATURE 190
+#define ATA_ATTR_TEMPERATURE 194
+#define ATA_ATTR_PENDING 197
+#define ATA_ATTR_UNCORRECTABLE 198
+
+typedef struct {
+    char* path;
+    HealthDeviceKind kind;
+    int fd;                       // -1 while a batch is using it
+    // History ring
+    HealthSample* history;
+    guint head;
+    guint count;
+    uint64_t failures;
+} HealthDevice;
+
+// One device's part of a batch, worked on without the sampler lock. Slots
+// are reused by every batch, the path copy only grows for a longer path.
+typedef struct {
+    char* path;
+    size_t path_capacity;
+    HealthDeviceKind kind;
+    int fd;
+    bool ok;
+    HealthSample sample;
+    // Command buffer, reused by every batch
+    uint8_t buffer[HEALTH_ATA_CMD_SIZE];
+} HealthJob;
+
+struct _HealthSampler {
+    HealthIoctlBackend backend;
+    guint interval_ms;
+    guint history_length;
+
+    // Serializes batches; held across the ioctls, which can take seconds
+    // on a drive spinning up
+    pthread_mutex_t batch_lock;
+    HealthJob* jobs;
+    size_t job_capacity;
+
+    // Guards the devices and their history; never held across an ioctl
+    pthread_mutex_t lock;
+    HealthDevice* devices;
+    size_t device_count;
+    size_t device_capacity;
+
+    pthread_t thread;
+    bool running;
+    pthread_cond_t wake;
+    HealthBatchCallback callback;
+    void* user_data;
+};
+
+// Linux backend
+
+static int linux_open_device(const char* path, void* ctx) {
+    return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+static int linux_nvme_admin(int fd, struct nvme_admin_cmd* cmd, void* ctx) {
+    return ioctl(fd, NVME_IOCTL_ADMIN_CMD, cmd);
+}
+
+static int linux_ata_drive_cmd(int fd, uint8_t* args, void* ctx) {
+    return ioctl(fd, HDIO_DRIVE_CMD, args);
+}
+
+static void linux_close_device(int fd, void* ctx) {
+    close(fd);
+}
+
+static const HealthIoctlBackend linux_backend = {
+    .open_device = linux_open_device,
+    .nvme_admin = linux_nvme_admin,
+    .ata_drive_cmd = linux_ata_drive_cmd,
+    .close_device = linux_close_device,
+    .ctx = NULL,
+};
+
+const HealthIoctlBackend* health_sampler_linux_backend(void) {
+    return &linux_backend;
+}
+
+// Parsers
+
+static uint64_t read_le64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return le64toh(v);
+}
+
+static uint16_t read_le16(const uint8_t* p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return le16toh(v);
+}
+
+void health_parse_nvme_log(const uint8_t* log, HealthSample* sample) {
+    sample->critical_warning = log[0];
+    // Composite temperature is reported in Kelvin
+    uint16_t kelvin = read_le16(log + 1);
+    sample->temperature_celsius = kelvin ? (int)kelvin - 273 : HEALTH_TEMPERATURE_UNKNOWN;
+    sample->available_spare = log[3];
+    sample->percentage_used = log[5];
+    // 128-bit counters; the upper half is never populated in practice
+    sample->data_units_written = read_le64(log + 48);
+    sample->power_on_hours = read_le64(log + 128);
+    sample->unsafe_shutdowns = read_le64(log + 144);
+    sample->media_errors = read_le64(log + 160);
+    sample->error_log_entries = read_le64(log + 176);
+}
+
+static uint64_t ata_attr_raw(const uint8_t* attr) {
+    // 48-bit little-endian raw value at bytes 5..10
+    uint64_t raw = 0;
+    for (int i = 5; i >= 0; i--) {
+        raw = (raw << 8) | attr[5 + i];
+    }
+    return raw;
+}
+
+void health_parse_ata_smart(const uint8_t* data, HealthSample* sample) {
+    int airflow_temperature = HEALTH_TEMPERATURE_UNKNOWN;
+    sample->temperature_celsius = HEALTH_TEMPERATURE_UNKNOWN;
+
+    for (int i = 0; i < ATA_SMART_ATTR_COUNT; i++) {
+        const uint8_t* attr = data + ATA_SMART_ATTR_OFFSET + i * ATA_SMART_ATTR_SIZE;
+        uint64_t raw = ata_attr_raw(attr);
+
+        switch (attr[0]) {
+            case 0:
+                break;
+            case ATA_ATTR_REALLOCATED:
+                sample->reallocated_sectors = raw;
+                break;
+            case ATA_ATTR_POWER_ON_HOURS:
+                sample->power_on_hours = raw & 0xFFFFFFFF;
+                break;
+            case ATA_ATTR_UNSAFE_SHUTDOWNS:
+                sample->unsafe_shutdowns = raw;
+                break;
+            case ATA_ATTR_AIRFLOW_TEMPERATURE:
+                airflow_temperature = (int)(raw & 0xFF);
+                break;
+            case ATA_ATTR_TEMPERATURE:
+                // Low byte is the current temperature, the rest min/max
+                sample->temperature_celsius = (int)(raw & 0xFF);
+                break;
+            case ATA_ATTR_PENDING:
+                sample->pending_sectors = raw;
+                break;
+            case ATA_ATTR_UNCORRECTABLE:
+                sample->uncorrectable_sectors = raw;
+                break;
+        }
+    }
+
+    if (sample->temperature_celsius == HEALTH_TEMPERATURE_UNKNOWN) {
+        sample->temperature_celsius = airflow_temperature;
+    }
+}
+
+// Sampling
+
+static HealthDevice* find_device(HealthSampler* sampler, const char* path) {
+    for (size_t i = 0; i < sampler->device_count; i++) {
+        if (strcmp(sampler->devices[i].path, path) == 0) {
+            return &sampler->devices[i];
+        }
+    }
+    return NULL;
+}
+
+// Runs without the sampler lock; the job owns its fd until it is handed back
+static bool sample_device(HealthSampler* sampler, HealthJob* job) {
+    const HealthIoctlBackend* backend = &sampler->backend;
+
+    if (job->fd < 0) {
+        job->fd = backend->open_device(job->path, backend->ctx);
+        if (job->fd < 0) return false;
+    }
+
+    if (job->kind == HEALTH_DEVICE_NVME) {
+        struct nvme_admin_cmd cmd = {
+            .opcode = NVME_ADMIN_GET_LOG_PAGE,
+            .nsid = NVME_NSID_ALL,
+            .addr = (uint64_t)(uintptr_t)job->buffer,
+            .data_len = HEALTH_NVME_LOG_SIZE,
+            // NUMDL (dwords - 1) in bits 31:16, log identifier in bits 7:0
+            .cdw10 = ((HEALTH_NVME_LOG_SIZE / 4 - 1) << 16) | NVME_LOG_SMART,
+        };
+        if (backend->nvme_admin(job->fd, &cmd, backend->ctx) < 0) return false;
+        health_parse_nvme_log(job->buffer, &job->sample);
+    } else {
+        memset(job->buffer, 0, 4);
+        job->buffer[0] = ATA_CMD_SMART;
+        job->buffer[2] = ATA_SMART_READ_VALUES;
+        job->buffer[3] = 1;
+        if (backend->ata_drive_cmd(job->fd, job->buffer, backend->ctx) < 0) return false;
+        health_parse_ata_smart(job->buffer + 4, &job->sample);
+    }
+
+    return true;
+}
+
+void health_sampler_sample_all(HealthSampler* sampler) {
+    pthread_mutex_lock(&sampler->batch_lock);
+
+    // Take the device list and open handles; readers of the history are
+    // not held up by the ioctls below
+    pthread_mutex_lock(&sampler->lock);
+    size_t job_count = sampler->device_count;
+    if (job_count > sampler->job_capacity) {
+        HealthJob* jobs = realloc(sampler->jobs, job_count * sizeof(HealthJob));
+        if (!jobs) {
+            pthread_mutex_unlock(&sampler->lock);
+            pthread_mutex_unlock(&sampler->batch_lock);
+            return;
+        }
+        memset(jobs + sampler->job_capacity, 0,
+               (job_count - sampler->job_capacity) * sizeof(HealthJob));
+        sampler->jobs = jobs;
+        sampler->job_capacity = job_count;
+    }
+    for (size_t i = 0; i < job_count; i++) {
+        HealthDevice* device = &sampler->devices[i];
+        HealthJob* job = &sampler->jobs[i];
+        size_t length = strlen(device->path) + 1;
+        if (length > job->path_capacity) {
+            char* path = realloc(job->path, length);
+            if (path) {
+                job->path = path;
+                job->path_capacity = length;
+            }
+        }
+        job->ok = length <= job->path_capacity;
+        if (job->ok) {
+            memcpy(job->path, device->path, length);
+        } else if (job->path_capacity) {
+            // Matches no device, so the batch records nothing for it
+            job->path[0] = '\0';
+        }
+        job->kind = device->kind;
+        job->fd = device->fd;
+        device->fd = -1;
+    }
+    pthread_mutex_unlock(&sampler->lock);
+
+    gint64 now = g_get_real_time();
+    for (size_t i = 0; i < job_count; i++) {
+        HealthJob* job = &sampler->jobs[i];
+        memset(&job->sample, 0, sizeof(job->sample));
+        job->sample.timestamp_us = now;
+        // A slot whose path could not be copied skips this batch
+        job->ok = job->ok && sample_device(sampler, job);
+        if (!job->ok && job->fd >= 0) {
+            // Reopen on the next tick in case the device was reset
+            sampler->backend.close_device(job->fd, sampler->backend.ctx);
+            job->fd = -1;
+        }
+    }
+
+    pthread_mutex_lock(&sampler->lock);
+    for (size_t i = 0; i < job_count; i++) {
+        HealthJob* job = &sampler->jobs[i];
+        HealthDevice* device = job->path_capacity ? find_device(sampler, job->path) : NULL;
+        if (!device) {
+            // Removed while the batch ran
+            if (job->fd >= 0) sampler->backend.close_device(job->fd, sampler->backend.ctx);
+        } else if (!job->ok) {
+            device->failures++;
+        } else {
+            device->fd = job->fd;
+            guint slot = (device->head + device->count) % sampler->history_length;
+            device->history[slot] = job->sample;
+            if (device->count < sampler->history_length) {
+                device->count++;
+            } else {
+                device->head = (device->head + 1) % sampler->history_length;
+            }
+        }
+    }
+    pthread_mutex_unlock(&sampler->lock);
+
+    pthread_mutex_unlock(&sampler->batch_lock);
+}
+
+static void* sampler_thread_func(void* data) {
+    HealthSampler* sampler = data;
+
+    pthread_mutex_lock(&sampler->lock);
+    while (sampler->running) {
+        pthread_mutex_unlock(&sampler->lock);
+
+        health_sampler_sample_all(sampler);
+        if (sampler->callback) {
+            sampler->callback(sampler, sampler->user_data);
+        }
+
+        pthread_mutex_lock(&sampler->lock);
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += sampler->interval_ms / 1000;
+        deadline.tv_nsec += (long)(sampler->interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (sampler->running &&
+               pthread_cond_timedwait(&sampler->wake, &sampler->lock, &deadline) != ETIMEDOUT) {
+        }
+    }
+    pthread_mutex_unlock(&sampler->lock);
+    return NULL;
+}
+
+HealthSampler* health_sampler_new(const HealthIoctlBackend* backend,
+                                  guint interval_ms,
+                                  guint history_length) {
+    HealthSampler* sampler = calloc(1, sizeof(HealthSampler));
+    if (!sampler) return NULL;
+
+    sampler->backend = backend ? *backend : linux_backend;
+    sampler->interval_ms = interval_ms > 0 ? interval_ms : 1000;
+    sampler->history_length = history_length > 0 ? history_length : 1;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sampler->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&sampler->lock, NULL);
+    pthread_mutex_init(&sampler->batch_lock, NULL);
+
+    return sampler;
+}
+
+void health_sampler_free(HealthSampler* sampler) {
+    if (!sampler) return;
+
+    health_sampler_stop(sampler);
+
+    for (size_t i = 0; i < sampler->device_count; i++) {
+        HealthDevice* device = &sampler->devices[i];
+        if (device->fd >= 0) {
+            sampler->backend.close_device(device->fd, sampler->backend.ctx);
+        }
+        free(device->path);
+        free(device->history);
+    }
+    free(sampler->devices);
+
+    for (size_t i = 0; i < sampler->job_capacity; i++) {
+        free(sampler->jobs[i].path);
+    }
+    free(sampler->jobs);
+
+    pthread_cond_destroy(&sampler->wake);
+    pthread_mutex_destroy(&sampler->lock);
+    pthread_mutex_destroy(&sampler->batch_lock);
+    free(sampler);
+}
+
+gboolean health_sampler_add_device(HealthSampler* sampler,
+                                   const char* device_path,
+                                   HealthDeviceKind kind) {
+    gboolean ok = TRUE;
+    pthread_mutex_lock(&sampler->lock);
+
+    if (find_device(sampler, device_path)) {
+        goto out;
+    }
+
+    if (sampler->device_count == sampler->device_capacity) {
+        size_t capacity = sampler->device_capacity ? sampler->device_capacity * 2 : 8;
+        HealthDevice* devices = realloc(sampler->devices, capacity * sizeof(HealthDevice));
+        if (!devices) {
+            ok = FALSE;
+            goto out;
+        }
+        sampler->devices = devices;
+        sampler->device_capacity = capacity;
+    }
+
+    HealthDevice* device = &sampler->devices[sampler->device_count];
+    memset(device, 0, sizeof(*device));
+    device->path = strdup(device_path);
+    device->history = calloc(sampler->history_length, sizeof(HealthSample));
+    if (!device->path || !device->history) {
+        free(device->path);
+        free(device->history);
+        ok = FALSE;
+        goto out;
+    }
+    device->kind = kind;
+    device->fd = -1;
+    sampler->device_count++;
+
+out:
+    pthread_mutex_unlock(&sampler->lock);
+    return ok;
+}
+
+void health_sampler_remove_device(HealthSampler* sampler, const char* device_path) {
+    pthread_mutex_lock(&sampler->lock);
+
+    HealthDevice* device = find_device(sampler, device_path);
+    if (device) {
+        if (device->fd >= 0) {
+            sampler->backend.close_device(device->fd, sampler->backend.ctx);
+        }
+        free(device->path);
+        free(device->history);
+
+        size_t index = device - sampler->devices;
+        memmove(device, device + 1, (sampler->device_count - index - 1) * sizeof(HealthDevice));
+        sampler->device_count--;
+    }
+
+    pthread_mutex_unlock(&sampler->lock);
+}
+
+gboolean health_sampler_start(HealthSampler* sampler,
+                              HealthBatchCallback callback,
+                              void* user_data) {
+    pthread_mutex_lock(&sampler->lock);
+    if (sampler->running) {
+        pthread_mutex_unlock(&sampler->lock);
+        return TRUE;
+    }
+    sampler->callback = callback;
+    sampler->user_data = user_data;
+    sampler->running = true;
+    pthread_mutex_unlock(&sampler->lock);
+
+    if (pthread_create(&sampler->thread, NULL, sampler_thread_func, sampler) != 0) {
+        pthread_mutex_lock(&sampler->lock);
+        sampler->running = false;
+        pthread_mutex_unlock(&sampler->lock);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void health_sampler_stop(HealthSampler* sampler) {
+    pthread_mutex_lock(&sampler->lock);
+    if (!sampler->running) {
+        pthread_mutex_unlock(&sampler->lock);
+        return;
+    }
+    sampler->running = false;
+    pthread_cond_signal(&sampler->wake);
+    pthread_mutex_unlock(&sampler->lock);
+
+    pthread_join(sampler->thread, NULL);
+}
+
+// FlValue conversion
+
+static FlValue* sample_to_fl_value(const char* device_path, const HealthSample* sample) {
+    FlValue* result = fl_value_new_map();
+    fl_value_set_string_take(result, "devicePath", fl_value_new_string(device_path));
+    fl_value_set_string_take(result, "timestampUs", fl_value_new_int(sample->timestamp_us));
+    if (sample->temperature_celsius != HEALTH_TEMPERATURE_UNKNOWN) {
+        fl_value_set_string_take(result, "temperatureCelsius", fl_value_new_int(sample->temperature_celsius));
+    }
+    fl_value_set_string_take(result, "criticalWarning", fl_value_new_int(sample->critical_warning));
+    fl_value_set_string_take(result, "availableSpare", fl_value_new_int(sample->available_spare));
+    fl_value_set_string_take(result, "percentageUsed", fl_value_new_int(sample->percentage_used));
+    fl_value_set_string_take(result, "dataUnitsWritten", fl_value_new_int((int64_t)sample->data_units_written));
+    fl_value_set_string_take(result, "powerOnHours", fl_value_new_int((int64_t)sample->power_on_hours));
+    fl_value_set_string_take(result, "unsafeShutdowns", fl_value_new_int((int64_t)sample->unsafe_shutdowns));
+    fl_value_set_string_take(result, "mediaErrors", fl_value_new_int((int64_t)sample->media_errors));
+    fl_value_set_string_take(result, "errorLogEntries", fl_value_new_int((int64_t)sample->error_log_entries));
+    fl_value_set_string_take(result, "reallocatedSectors", fl_value_new_int((int64_t)sample->reallocated_sectors));
+    fl_value_set_string_take(result, "pendingSectors", fl_value_new_int((int64_t)sample->pending_sectors));
+    fl_value_set_string_take(result, "uncorrectableSectors", fl_value_new_int((int64_t)sample->uncorrectable_sectors));
+    return result;
+}
+
+FlValue* health_sampler_latest(HealthSampler* sampler) {
+    FlValue* list = fl_value_new_list();
+
+    pthread_mutex_lock(&sampler->lock);
+    for (size_t i = 0; i < sampler->device_count; i++) {
+        HealthDevice* device = &sampler->devices[i];
+        if (device->count == 0) continue;
+        guint last = (device->head + device->count - 1) % sampler->history_length;
+        fl_value_append_take(list, sample_to_fl_value(device->path, &device->history[last]));
+    }
+    pthread_mutex_unlock(&sampler->lock);
+
+    return list;
+}
+
+FlValue* health_sampler_get_history(HealthSampler* sampler, const char* device_path) {
+    FlValue* list = NULL;
+
+    pthread_mutex_lock(&sampler->lock);
+    HealthDevice* device = find_device(sampler, device_path);
+    if (device) {
+        list = fl_value_new_list();
+        for (guint i = 0; i < device->count; i++) {
+            guint slot = (device->head + i) % sampler->history_length;
+            fl_value_append_take(list, sample_to_fl_value(device->path, &device->history[slot]));
+        }
+    }
+    pthread_mutex_unlock(&sampler->lock);
+
+    return list;
+}
+
+gboolean health_sampler_get_sample(HealthSampler* sampler,
+                                   const char* device_path,
+                                   HealthSample* out) {
+    gboolean found = FALSE;
+
+    pthread_mutex_lock(&sampler->lock);
+    HealthDevice* device = find_device(sampler, device_path);
+    if (device && device->count > 0) {
+        guint last = (device->head + device->count - 1) % sampler->history_length;
+        *out = device->history[last];
+        found = TRUE;
+    }
+    pthread_mutex_unlock(&sampler->lock);
+
+    return found;
+}
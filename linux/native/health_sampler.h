@@ -0,0 +1,150 @@
+#ifndef HEALTH_SAMPLER_H
+#define HEALTH_SAMPLER_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdint.h>
+#include <linux/nvme_ioctl.h>
+
+G_BEGIN_DECLS
+
+// Size of the NVMe SMART / Health Information log page (Log Identifier 0x02)
+#define HEALTH_NVME_LOG_SIZE 512
+// HDIO_DRIVE_CMD argument header followed by one 512-byte SMART sector
+#define HEALTH_ATA_CMD_SIZE (4 + 512)
+
+typedef enum {
+    HEALTH_DEVICE_NVME,
+    HEALTH_DEVICE_ATA,
+} HealthDeviceKind;
+
+// One health reading. Fields a protocol does not report are left at 0,
+// temperature is HEALTH_TEMPERATURE_UNKNOWN when the drive did not report it.
+#define HEALTH_TEMPERATURE_UNKNOWN (-274)
+
+typedef struct {
+    gint64 timestamp_us;          // g_get_real_time() at sampling
+    int temperature_celsius;
+    uint8_t critical_warning;     // NVMe critical warning bitmap
+    uint8_t available_spare;      // NVMe, percent
+    uint8_t percentage_used;      // NVMe endurance estimate, percent
+    uint64_t data_units_written;  // NVMe, units of 512000 bytes
+    uint64_t power_on_hours;
+    uint64_t unsafe_shutdowns;
+    uint64_t media_errors;        // NVMe media/data integrity errors
+    uint64_t error_log_entries;
+    uint64_t reallocated_sectors; // ATA attribute 5
+    uint64_t pending_sectors;     // ATA attribute 197
+    uint64_t uncorrectable_sectors; // ATA attribute 198
+} HealthSample;
+
+/**
+ * HealthIoctlBackend:
+ *
+ * Indirection over the syscalls the sampler issues so the sampling loop can
+ * be driven by a fake device in tests. Every callback receives @ctx.
+ * Return values follow the syscall they replace (-1 on error).
+ */
+typedef struct {
+    int (*open_device)(const char* path, void* ctx);
+    int (*nvme_admin)(int fd, struct nvme_admin_cmd* cmd, void* ctx);
+    int (*ata_drive_cmd)(int fd, uint8_t* args, void* ctx);
+    void (*close_device)(int fd, void* ctx);
+    void* ctx;
+} HealthIoctlBackend;
+
+typedef struct _HealthSampler HealthSampler;
+
+/**
+ * HealthBatchCallback:
+ *
+ * Invoked from the sampler thread after every batch of samples has been
+ * collected. Use health_sampler_latest() to read the new values.
+ */
+typedef void (*HealthBatchCallback)(HealthSampler* sampler, void* user_data);
+
+/**
+ * health_sampler_linux_backend:
+ *
+ * Returns: the backend issuing real open/ioctl calls.
+ */
+const HealthIoctlBackend* health_sampler_linux_backend(void);
+
+/**
+ * health_sampler_new:
+ * @backend: ioctl backend, usually health_sampler_linux_backend()
+ * @interval_ms: period between sampling batches
+ * @history_length: number of samples kept per device
+ *
+ * Returns: (transfer full): a new sampler, free with health_sampler_free()
+ */
+HealthSampler* health_sampler_new(const HealthIoctlBackend* backend,
+                                  guint interval_ms,
+                                  guint history_length);
+
+void health_sampler_free(HealthSampler* sampler);
+
+/**
+ * health_sampler_add_device:
+ * @device_path: block device node (e.g. "/dev/nvme0n1" or "/dev/sda")
+ *
+ * Registers a device and pre-allocates its log buffer and history ring.
+ * Adding an already known device is a no-op.
+ */
+gboolean health_sampler_add_device(HealthSampler* sampler,
+                                   const char* device_path,
+                                   HealthDeviceKind kind);
+
+void health_sampler_remove_device(HealthSampler* sampler, const char* device_path);
+
+/**
+ * health_sampler_sample_all:
+ *
+ * Collects one batch synchronously: a Get Log Page for every NVMe device and
+ * a SMART READ DATA for every ATA device. Device handles stay open between
+ * batches so a tick costs one ioctl per device.
+ */
+void health_sampler_sample_all(HealthSampler* sampler);
+
+gboolean health_sampler_start(HealthSampler* sampler,
+                              HealthBatchCallback callback,
+                              void* user_data);
+void health_sampler_stop(HealthSampler* sampler);
+
+/**
+ * health_sampler_latest:
+ *
+ * Returns: (transfer full): a list of maps with the most recent sample of
+ * every device that has produced one
+ */
+FlValue* health_sampler_latest(HealthSampler* sampler);
+
+/**
+ * health_sampler_get_history:
+ *
+ * Returns: (transfer full): the device's samples, oldest first, or NULL when
+ * the device is unknown
+ */
+FlValue* health_sampler_get_history(HealthSampler* sampler, const char* device_path);
+
+/**
+ * health_sampler_get_sample:
+ *
+ * Copies the most recent sample of a device into @out.
+ *
+ * Returns: TRUE when the device has at least one sample
+ */
+gboolean health_sampler_get_sample(HealthSampler* sampler,
+                                   const char* device_path,
+                                   HealthSample* out);
+
+/**
+ * health_parse_nvme_log / health_parse_ata_smart:
+ *
+ * Decode a raw NVMe SMART log page or an ATA SMART READ DATA sector.
+ */
+void health_parse_nvme_log(const uint8_t* log, HealthSample* sample);
+void health_parse_ata_smart(const uint8_t* data, HealthSample* sample);
+
+G_END_DECLS
+
+#endif // HEALTH_SAMPLER_H
@@ -0,0 +1,458 @@
+#include "identify_decode.h"
+#include <string.h>
+
+#define IDENTIFY_FIELD_ENTRY(id, field_name, field_kind, field_offset, field_width, field_shift, field_bits) \
+    [id] = { .name = field_name, .offset = field_offset, .width = field_width, \
+             .kind = field_kind, .shift = field_shift, .bits = field_bits },
+
+// Reject descriptors that leave their structure, have a numeric width the
+// decoder cannot hold, or a bit field wider than its value
+#define IDENTIFY_FIELD_CHECK(size, id, kind, offset, width, shift, bits) \
+    G_STATIC_ASSERT((offset) + (width) <= (size)); \
+    G_STATIC_ASSERT((kind) != IDF_UINT || ((width) >= 1 && (width) <= 8)); \
+    G_STATIC_ASSERT((kind) != IDF_FLAG || ((width) <= 8 && (bits) == 1)); \
+    G_STATIC_ASSERT((kind) != IDF_U128 || (width) == 16); \
+    G_STATIC_ASSERT((kind) != IDF_WORDS_BE || ((width) % 2 == 0 && (width) <= 8)); \
+    G_STATIC_ASSERT((width) < IDENTIFY_TEXT_MAX); \
+    G_STATIC_ASSERT((shift) + (bits) <= (width) * 8);
+
+#define CHECK_CONTROLLER(id, name, kind, offset, width, shift, bits) \
+    IDENTIFY_FIELD_CHECK(IDENTIFY_NVME_SIZE, id, kind, offset, width, shift, bits)
+#define CHECK_POWER_STATE(id, name, kind, offset, width, shift, bits) \
+    IDENTIFY_FIELD_CHECK(32, id, kind, offset, width, shift, bits)
+#define CHECK_NAMESPACE(id, name, kind, offset, width, shift, bits) \
+    IDENTIFY_FIELD_CHECK(IDENTIFY_LBAF_OFFSET, id, kind, offset, width, shift, bits)
+#define CHECK_LBA_FORMAT(id, name, kind, offset, width, shift, bits) \
+    IDENTIFY_FIELD_CHECK(4, id, kind, offset, width, shift, bits)
+#define CHECK_ATA(id, name, kind, offset, width, shift, bits) \
+    IDENTIFY_FIELD_CHECK(IDENTIFY_ATA_SIZE, id, kind, offset, width, shift, bits)
+
+IDENTIFY_CONTROLLER_FIELDS(CHECK_CONTROLLER)
+IDENTIFY_POWER_STATE_FIELDS(CHECK_POWER_STATE)
+IDENTIFY_NAMESPACE_FIELDS(CHECK_NAMESPACE)
+IDENTIFY_LBA_FORMAT_FIELDS(CHECK_LBA_FORMAT)
+IDENTIFY_ATA_FIELDS(CHECK_ATA)
+
+G_STATIC_ASSERT(IDENTIFY_PSD_OFFSET + IDENTIFY_PSD_MAX * 32 <= IDENTIFY_NVME_SIZE);
+G_STATIC_ASSERT(IDENTIFY_LBAF_OFFSET + IDENTIFY_LBAF_MAX * 4 <= IDENTIFY_NVME_SIZE);
+
+static const IdentifyField controller_fields[] = {
+    IDENTIFY_CONTROLLER_FIELDS(IDENTIFY_FIELD_ENTRY)
+};
+
+static const IdentifyField power_state_fields[] = {
+    IDENTIFY_POWER_STATE_FIELDS(IDENTIFY_FIELD_ENTRY)
+};
+
+static const IdentifyField namespace_fields[] = {
+    IDENTIFY_NAMESPACE_FIELDS(IDENTIFY_FIELD_ENTRY)
+};
+
+static const IdentifyField lba_format_fields[] = {
+    IDENTIFY_LBA_FORMAT_FIELDS(IDENTIFY_FIELD_ENTRY)
+};
+
+static const IdentifyField ata_fields[] = {
+    IDENTIFY_ATA_FIELDS(IDENTIFY_FIELD_ENTRY)
+};
+
+const IdentifyTable identify_nvme_power_state_table = {
+    .name = "powerState",
+    .size = 32,
+    .fields = power_state_fields,
+    .field_count = G_N_ELEMENTS(power_state_fields),
+};
+
+const IdentifyTable identify_nvme_lba_format_table = {
+    .name = "lbaFormat",
+    .size = 4,
+    .fields = lba_format_fields,
+    .field_count = G_N_ELEMENTS(lba_format_fields),
+};
+
+static const IdentifyArray controller_arrays[] = {
+    {
+        .name = "powerStates",
+        .offset = IDENTIFY_PSD_OFFSET,
+        .stride = 32,
+        .max_count = IDENTIFY_PSD_MAX,
+        .count_offset = 263,        // NPSS
+        .element = &identify_nvme_power_state_table,
+    },
+};
+
+static const IdentifyArray namespace_arrays[] = {
+    {
+        .name = "lbaFormats",
+        .offset = IDENTIFY_LBAF_OFFSET,
+        .stride = 4,
+        .max_count = IDENTIFY_LBAF_MAX,
+        .count_offset = 25,         // NLBAF
+        .element = &identify_nvme_lba_format_table,
+    },
+};
+
+const IdentifyTable identify_nvme_controller_table = {
+    .name = "controller",
+    .size = IDENTIFY_NVME_SIZE,
+    .fields = controller_fields,
+    .field_count = G_N_ELEMENTS(controller_fields),
+    .arrays = controller_arrays,
+    .array_count = G_N_ELEMENTS(controller_arrays),
+};
+
+const IdentifyTable identify_nvme_namespace_table = {
+    .name = "namespace",
+    .size = IDENTIFY_NVME_SIZE,
+    .fields = namespace_fields,
+    .field_count = G_N_ELEMENTS(namespace_fields),
+    .arrays = namespace_arrays,
+    .array_count = G_N_ELEMENTS(namespace_arrays),
+};
+
+const IdentifyTable identify_ata_table = {
+    .name = "ata",
+    .size = IDENTIFY_ATA_SIZE,
+    .fields = ata_fields,
+    .field_count = G_N_ELEMENTS(ata_fields),
+};
+
+static uint64_t read_le(const uint8_t* p, guint width) {
+    uint64_t value = 0;
+    for (guint i = width; i > 0; i--) {
+        value = (value << 8) | p[i - 1];
+    }
+    return value;
+}
+
+static void write_le(uint8_t* p, guint width, uint64_t value) {
+    for (guint i = 0; i < width; i++) {
+        p[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static uint64_t bit_mask(guint bits) {
+    return bits >= 64 ? UINT64_MAX : (((uint64_t)1 << bits) - 1);
+}
+
+uint64_t identify_read(const IdentifyField* field, const uint8_t* data) {
+    const uint8_t* p = data + field->offset;
+    uint64_t value;
+
+    switch (field->kind) {
+    case IDF_UINT:
+    case IDF_FLAG:
+        value = read_le(p, field->width);
+        break;
+    case IDF_U128:
+        return read_le(p, 8);
+    case IDF_WORDS_BE:
+        value = 0;
+        for (guint i = 0; i < field->width; i += 2) {
+            value = (value << 16) | read_le(p + i, 2);
+        }
+        return value;
+    default:
+        return 0;
+    }
+
+    if (field->bits) {
+        value = (value >> field->shift) & bit_mask(field->bits);
+    }
+    return value;
+}
+
+static size_t trim_text(char* buffer, size_t length) {
+    while (length > 0 && (buffer[length - 1] == ' ' || buffer[length - 1] == '\0')) {
+        length--;
+    }
+    size_t start = 0;
+    while (start < length && buffer[start] == ' ') {
+        start++;
+    }
+    if (start > 0) {
+        memmove(buffer, buffer + start, length - start);
+        length -= start;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+size_t identify_read_text(const IdentifyField* field, const uint8_t* data,
+                          char* buffer, size_t size) {
+    static const char hex[] = "0123456789abcdef";
+    const uint8_t* p = data + field->offset;
+    size_t length = 0;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    switch (field->kind) {
+    case IDF_ASCII:
+        length = MIN((size_t)field->width, size - 1);
+        memcpy(buffer, p, length);
+        break;
+    case IDF_UTF8Z:
+        while (length < field->width && length < size - 1 && p[length] != '\0') {
+            buffer[length] = (char)p[length];
+            length++;
+        }
+        break;
+    case IDF_ATA_STRING:
+        // The first character of each pair is the word's high byte
+        for (guint i = 0; i + 1 < field->width && length + 2 < size; i += 2) {
+            buffer[length++] = (char)p[i + 1];
+            buffer[length++] = (char)p[i];
+        }
+        break;
+    case IDF_HEX:
+        for (guint i = 0; i < field->width && length + 2 < size; i++) {
+            buffer[length++] = hex[p[i] >> 4];
+            buffer[length++] = hex[p[i] & 0xF];
+        }
+        buffer[length] = '\0';
+        return length;
+    default:
+        buffer[0] = '\0';
+        return 0;
+    }
+
+    // Firmware pads with spaces, but NULs and stray control bytes occur too
+    for (size_t i = 0; i < length; i++) {
+        if ((uint8_t)buffer[i] < 0x20 || (uint8_t)buffer[i] == 0x7F) {
+            buffer[i] = field->kind == IDF_UTF8Z ? '?' : ' ';
+        }
+    }
+    return trim_text(buffer, length);
+}
+
+static gboolean is_text_kind(guint kind) {
+    return kind == IDF_ASCII || kind == IDF_UTF8Z || kind == IDF_ATA_STRING || kind == IDF_HEX;
+}
+
+static void decode_fields(const IdentifyTable* table, const uint8_t* data,
+                          const IdentifyVisitor* visitor, void* ctx) {
+    char text[IDENTIFY_TEXT_MAX];
+
+    for (guint i = 0; i < table->field_count; i++) {
+        const IdentifyField* field = &table->fields[i];
+        IdentifyValue value = { .field = field };
+
+        if (is_text_kind(field->kind)) {
+            value.length = identify_read_text(field, data, text, sizeof(text));
+            value.text = text;
+        } else {
+            value.value = identify_read(field, data);
+            if (field->kind == IDF_U128) {
+                value.high = read_le(data + field->offset + 8, 8);
+            }
+        }
+        visitor->field(&value, ctx);
+    }
+}
+
+gboolean identify_decode(const IdentifyTable* table, const uint8_t* data, size_t size,
+                         const IdentifyVisitor* visitor, void* ctx) {
+    if (data == NULL || size < table->size) {
+        return FALSE;
+    }
+
+    decode_fields(table, data, visitor, ctx);
+
+    for (guint a = 0; a < table->array_count; a++) {
+        const IdentifyArray* array = &table->arrays[a];
+        guint count = MIN((guint)data[array->count_offset] + 1, (guint)array->max_count);
+
+        if (visitor->array_begin) {
+            visitor->array_begin(array, count, ctx);
+        }
+        for (guint i = 0; i < count; i++) {
+            if (visitor->element_begin) {
+                visitor->element_begin(i, ctx);
+            }
+            decode_fields(array->element, data + array->offset + (size_t)i * array->stride,
+                          visitor, ctx);
+            if (visitor->element_end) {
+                visitor->element_end(ctx);
+            }
+        }
+        if (visitor->array_end) {
+            visitor->array_end(ctx);
+        }
+    }
+    return TRUE;
+}
+
+// FlValue serializer: the innermost open map receives fields, and arrays
+// nest one level deep
+typedef struct {
+    FlValue* root;
+    FlValue* list;
+    FlValue* element;
+} FlBuilder;
+
+static FlValue* u128_to_fl_value(uint64_t low, uint64_t high) {
+    if (high == 0 && low <= (uint64_t)G_MAXINT64) {
+        return fl_value_new_int((int64_t)low);
+    }
+
+    // Decimal string, built from the least significant digit
+    unsigned __int128 value = ((unsigned __int128)high << 64) | low;
+    char digits[40];
+    size_t pos = sizeof(digits) - 1;
+    digits[pos] = '\0';
+    do {
+        digits[--pos] = (char)('0' + (int)(value % 10));
+        value /= 10;
+    } while (value != 0);
+    return fl_value_new_string(digits + pos);
+}
+
+static void fl_builder_field(const IdentifyValue* value, void* ctx) {
+    FlBuilder* builder = ctx;
+    FlValue* map = builder->element ? builder->element : builder->root;
+    FlValue* item;
+
+    switch (value->field->kind) {
+    case IDF_FLAG:
+        item = fl_value_new_bool(value->value != 0);
+        break;
+    case IDF_U128:
+        item = u128_to_fl_value(value->value, value->high);
+        break;
+    case IDF_UINT:
+    case IDF_WORDS_BE:
+        item = fl_value_new_int((int64_t)value->value);
+        break;
+    default:
+        item = fl_value_new_string(value->text);
+        break;
+    }
+    fl_value_set_string_take(map, value->field->name, item);
+}
+
+static void fl_builder_array_begin(const IdentifyArray* array, guint count, void* ctx) {
+    FlBuilder* builder = ctx;
+    (void)count;
+    builder->list = fl_value_new_list();
+    fl_value_set_string_take(builder->root, array->name, builder->list);
+}
+
+static void fl_builder_element_begin(guint index, void* ctx) {
+    FlBuilder* builder = ctx;
+    builder->element = fl_value_new_map();
+    fl_value_set_string_take(builder->element, "index", fl_value_new_int(index));
+}
+
+static void fl_builder_element_end(void* ctx) {
+    FlBuilder* builder = ctx;
+    fl_value_append_take(builder->list, builder->element);
+    builder->element = NULL;
+}
+
+static void fl_builder_array_end(void* ctx) {
+    FlBuilder* builder = ctx;
+    builder->list = NULL;
+}
+
+static const IdentifyVisitor fl_builder_visitor = {
+    .field = fl_builder_field,
+    .array_begin = fl_builder_array_begin,
+    .element_begin = fl_builder_element_begin,
+    .element_end = fl_builder_element_end,
+    .array_end = fl_builder_array_end,
+};
+
+FlValue* identify_to_fl_value(const IdentifyTable* table, const uint8_t* data, size_t size) {
+    FlBuilder builder = { .root = fl_value_new_map() };
+
+    if (!identify_decode(table, data, size, &fl_builder_visitor, &builder)) {
+        fl_value_unref(builder.root);
+        return NULL;
+    }
+    return builder.root;
+}
+
+void identify_write(const IdentifyField* field, uint8_t* data, uint64_t value) {
+    uint8_t* p = data + field->offset;
+
+    switch (field->kind) {
+    case IDF_UINT:
+    case IDF_FLAG:
+        if (field->bits) {
+            uint64_t mask = bit_mask(field->bits) << field->shift;
+            uint64_t word = read_le(p, field->width);
+            value = (word & ~mask) | ((value << field->shift) & mask);
+        }
+        write_le(p, field->width, value);
+        break;
+    case IDF_U128:
+        write_le(p, 8, value);
+        memset(p + 8, 0, 8);
+        break;
+    case IDF_WORDS_BE:
+        for (guint i = field->width; i >= 2; i -= 2) {
+            write_le(p + i - 2, 2, value & 0xFFFF);
+            value >>= 16;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void identify_write_text(const IdentifyField* field, uint8_t* data, const char* text) {
+    uint8_t* p = data + field->offset;
+    size_t length = text ? strlen(text) : 0;
+
+    switch (field->kind) {
+    case IDF_ASCII:
+        memset(p, ' ', field->width);
+        memcpy(p, text, MIN(length, (size_t)field->width));
+        break;
+    case IDF_UTF8Z:
+        memset(p, 0, field->width);
+        memcpy(p, text, MIN(length, (size_t)field->width - 1));
+        break;
+    case IDF_ATA_STRING:
+        for (guint i = 0; i < field->width; i += 2) {
+            p[i + 1] = i < length ? (uint8_t)text[i] : ' ';
+            p[i] = i + 1 < length ? (uint8_t)text[i + 1] : ' ';
+        }
+        break;
+    case IDF_HEX:
+        memset(p, 0, field->width);
+        for (guint i = 0; i < field->width && 2 * i + 1 < length; i++) {
+            int hi = g_ascii_xdigit_value(text[2 * i]);
+            int lo = g_ascii_xdigit_value(text[2 * i + 1]);
+            if (hi < 0 || lo < 0) {
+                break;
+            }
+            p[i] = (uint8_t)(hi << 4 | lo);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+gboolean identify_ata_checksum_valid(const uint8_t* data) {
+    if (data[510] != 0xA5) {
+        return TRUE;
+    }
+    uint8_t sum = 0;
+    for (guint i = 0; i < IDENTIFY_ATA_SIZE; i++) {
+        sum += data[i];
+    }
+    return sum == 0;
+}
+
+void identify_ata_seal(uint8_t* data) {
+    uint8_t sum = 0xA5;
+    data[510] = 0xA5;
+    for (guint i = 0; i < IDENTIFY_ATA_SIZE - 2; i++) {
+        sum += data[i];
+    }
+    data[511] = (uint8_t)(0x100 - sum);
+}
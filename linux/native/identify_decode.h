@@ -0,0 +1,511 @@
+#ifndef IDENTIFY_DECODE_H
+#define IDENTIFY_DECODE_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stddef.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Table-driven decoding of the identify data structures:
+ *
+ *   NVMe Identify Controller (CNS 01h), 4096 bytes
+ *   NVMe Identify Namespace, NVM command set (CNS 00h), 4096 bytes
+ *   ATA IDENTIFY DEVICE, 256 little-endian words
+ *
+ * Every field is described once below as X(ID, name, kind, offset, width,
+ * shift, bits): byte offset and width into the structure, and for bit fields
+ * the first bit and bit count within that value. The lists expand into the
+ * ID_* enums and into static const descriptor tables; one decoder walks a
+ * table, reading bytes explicitly so alignment and host byte order never
+ * matter, and the same descriptors encode values back into a buffer.
+ * Reserved and obsolete ranges are left out; repeated structures (power
+ * state descriptors, LBA formats) are described by IdentifyArray entries.
+ */
+
+typedef enum {
+    IDF_UINT,           // little-endian unsigned, 1 to 8 bytes, optionally a bit field
+    IDF_FLAG,           // one bit, decoded as a boolean
+    IDF_U128,           // little-endian 128-bit unsigned (capacities)
+    IDF_ASCII,          // space-padded ASCII (NVMe)
+    IDF_UTF8Z,          // NUL-terminated UTF-8 (NQNs)
+    IDF_ATA_STRING,     // ASCII with the bytes of each word swapped
+    IDF_HEX,            // identifier bytes in stored order (EUI-64, NGUID)
+    IDF_WORDS_BE,       // 16-bit words, most significant word first (ATA WWN)
+} IdentifyKind;
+
+#define ATA_WORD(n) ((n) * 2)
+
+// clang-format off
+#define IDENTIFY_CONTROLLER_FIELDS(X) \
+    X(ID_CTRL_VID,              "vid",                      IDF_UINT,   0,    2, 0, 0) \
+    X(ID_CTRL_SSVID,            "ssvid",                    IDF_UINT,   2,    2, 0, 0) \
+    X(ID_CTRL_SN,               "sn",                       IDF_ASCII,  4,   20, 0, 0) \
+    X(ID_CTRL_MN,               "mn",                       IDF_ASCII,  24,  40, 0, 0) \
+    X(ID_CTRL_FR,               "fr",                       IDF_ASCII,  64,   8, 0, 0) \
+    X(ID_CTRL_RAB,              "rab",                      IDF_UINT,   72,   1, 0, 0) \
+    X(ID_CTRL_IEEE,             "ieee",                     IDF_UINT,   73,   3, 0, 0) \
+    X(ID_CTRL_CMIC,             "cmic",                     IDF_UINT,   76,   1, 0, 0) \
+    X(ID_CTRL_CMIC_MULTI_PORT,  "cmicMultiPort",            IDF_FLAG,   76,   1, 0, 1) \
+    X(ID_CTRL_CMIC_MULTI_CTRL,  "cmicMultiController",      IDF_FLAG,   76,   1, 1, 1) \
+    X(ID_CTRL_CMIC_SRIOV,       "cmicSrIov",                IDF_FLAG,   76,   1, 2, 1) \
+    X(ID_CTRL_CMIC_ANA,         "cmicAnaReporting",         IDF_FLAG,   76,   1, 3, 1) \
+    X(ID_CTRL_MDTS,             "mdts",                     IDF_UINT,   77,   1, 0, 0) \
+    X(ID_CTRL_CNTLID,           "cntlid",                   IDF_UINT,   78,   2, 0, 0) \
+    X(ID_CTRL_VER,              "ver",                      IDF_UINT,   80,   4, 0, 0) \
+    X(ID_CTRL_VER_MAJOR,        "verMajor",                 IDF_UINT,   80,   4, 16, 16) \
+    X(ID_CTRL_VER_MINOR,        "verMinor",                 IDF_UINT,   80,   4, 8, 8) \
+    X(ID_CTRL_VER_TERTIARY,     "verTertiary",              IDF_UINT,   80,   4, 0, 8) \
+    X(ID_CTRL_RTD3R,            "rtd3r",                    IDF_UINT,   84,   4, 0, 0) \
+    X(ID_CTRL_RTD3E,            "rtd3e",                    IDF_UINT,   88,   4, 0, 0) \
+    X(ID_CTRL_OAES,             "oaes",                     IDF_UINT,   92,   4, 0, 0) \
+    X(ID_CTRL_CTRATT,           "ctratt",                   IDF_UINT,   96,   4, 0, 0) \
+    X(ID_CTRL_CTRATT_HOSTID128, "ctrattHostId128",          IDF_FLAG,   96,   4, 0, 1) \
+    X(ID_CTRL_CTRATT_NVM_SETS,  "ctrattNvmSets",            IDF_FLAG,   96,   4, 2, 1) \
+    X(ID_CTRL_CTRATT_ENDGRPS,   "ctrattEnduranceGroups",    IDF_FLAG,   96,   4, 4, 1) \
+    X(ID_CTRL_CTRATT_PLM,       "ctrattPredictableLatency", IDF_FLAG,   96,   4, 5, 1) \
+    X(ID_CTRL_CTRATT_UUID_LIST, "ctrattUuidList",           IDF_FLAG,   96,   4, 9, 1) \
+    X(ID_CTRL_RRLS,             "rrls",                     IDF_UINT,   100,  2, 0, 0) \
+    X(ID_CTRL_CNTRLTYPE,        "cntrltype",                IDF_UINT,   111,  1, 0, 0) \
+    X(ID_CTRL_FGUID,            "fguid",                    IDF_HEX,    112, 16, 0, 0) \
+    X(ID_CTRL_CRDT1,            "crdt1",                    IDF_UINT,   128,  2, 0, 0) \
+    X(ID_CTRL_CRDT2,            "crdt2",                    IDF_UINT,   130,  2, 0, 0) \
+    X(ID_CTRL_CRDT3,            "crdt3",                    IDF_UINT,   132,  2, 0, 0) \
+    X(ID_CTRL_NVMSR,            "nvmsr",                    IDF_UINT,   253,  1, 0, 0) \
+    X(ID_CTRL_VWCI,             "vwci",                     IDF_UINT,   254,  1, 0, 0) \
+    X(ID_CTRL_MEC,              "mec",                      IDF_UINT,   255,  1, 0, 0) \
+    X(ID_CTRL_OACS,             "oacs",                     IDF_UINT,   256,  2, 0, 0) \
+    X(ID_CTRL_OACS_SECURITY,    "oacsSecuritySendReceive",  IDF_FLAG,   256,  2, 0, 1) \
+    X(ID_CTRL_OACS_FORMAT,      "oacsFormatNvm",            IDF_FLAG,   256,  2, 1, 1) \
+    X(ID_CTRL_OACS_FIRMWARE,    "oacsFirmware",             IDF_FLAG,   256,  2, 2, 1) \
+    X(ID_CTRL_OACS_NS_MGMT,     "oacsNamespaceManagement",  IDF_FLAG,   256,  2, 3, 1) \
+    X(ID_CTRL_OACS_SELF_TEST,   "oacsDeviceSelfTest",       IDF_FLAG,   256,  2, 4, 1) \
+    X(ID_CTRL_OACS_DIRECTIVES,  "oacsDirectives",           IDF_FLAG,   256,  2, 5, 1) \
+    X(ID_CTRL_OACS_NVME_MI,     "oacsNvmeMi",               IDF_FLAG,   256,  2, 6, 1) \
+    X(ID_CTRL_OACS_VIRT_MGMT,   "oacsVirtualization",       IDF_FLAG,   256,  2, 7, 1) \
+    X(ID_CTRL_OACS_DBBUF,       "oacsDoorbellBuffer",       IDF_FLAG,   256,  2, 8, 1) \
+    X(ID_CTRL_OACS_LBA_STATUS,  "oacsGetLbaStatus",         IDF_FLAG,   256,  2, 9, 1) \
+    X(ID_CTRL_OACS_LOCKDOWN,    "oacsLockdown",             IDF_FLAG,   256,  2, 10, 1) \
+    X(ID_CTRL_ACL,              "acl",                      IDF_UINT,   258,  1, 0, 0) \
+    X(ID_CTRL_AERL,             "aerl",                     IDF_UINT,   259,  1, 0, 0) \
+    X(ID_CTRL_FRMW,             "frmw",                     IDF_UINT,   260,  1, 0, 0) \
+    X(ID_CTRL_FRMW_SLOT1_RO,    "frmwSlot1ReadOnly",        IDF_FLAG,   260,  1, 0, 1) \
+    X(ID_CTRL_FRMW_SLOTS,       "frmwSlots",                IDF_UINT,   260,  1, 1, 3) \
+    X(ID_CTRL_FRMW_NO_RESET,    "frmwActivateWithoutReset", IDF_FLAG,   260,  1, 4, 1) \
+    X(ID_CTRL_LPA,              "lpa",                      IDF_UINT,   261,  1, 0, 0) \
+    X(ID_CTRL_ELPE,             "elpe",                     IDF_UINT,   262,  1, 0, 0) \
+    X(ID_CTRL_NPSS,             "npss",                     IDF_UINT,   263,  1, 0, 0) \
+    X(ID_CTRL_AVSCC,            "avscc",                    IDF_UINT,   264,  1, 0, 0) \
+    X(ID_CTRL_APSTA,            "apsta",                    IDF_FLAG,   265,  1, 0, 1) \
+    X(ID_CTRL_WCTEMP,           "wctemp",                   IDF_UINT,   266,  2, 0, 0) \
+    X(ID_CTRL_CCTEMP,           "cctemp",                   IDF_UINT,   268,  2, 0, 0) \
+    X(ID_CTRL_MTFA,             "mtfa",                     IDF_UINT,   270,  2, 0, 0) \
+    X(ID_CTRL_HMPRE,            "hmpre",                    IDF_UINT,   272,  4, 0, 0) \
+    X(ID_CTRL_HMMIN,            "hmmin",                    IDF_UINT,   276,  4, 0, 0) \
+    X(ID_CTRL_TNVMCAP,          "tnvmcap",                  IDF_U128,   280, 16, 0, 0) \
+    X(ID_CTRL_UNVMCAP,          "unvmcap",                  IDF_U128,   296, 16, 0, 0) \
+    X(ID_CTRL_RPMBS,            "rpmbs",                    IDF_UINT,   312,  4, 0, 0) \
+    X(ID_CTRL_EDSTT,            "edstt",                    IDF_UINT,   316,  2, 0, 0) \
+    X(ID_CTRL_DSTO,             "dsto",                     IDF_UINT,   318,  1, 0, 0) \
+    X(ID_CTRL_FWUG,             "fwug",                     IDF_UINT,   319,  1, 0, 0) \
+    X(ID_CTRL_KAS,              "kas",                      IDF_UINT,   320,  2, 0, 0) \
+    X(ID_CTRL_HCTMA,            "hctma",                    IDF_UINT,   322,  2, 0, 0) \
+    X(ID_CTRL_MNTMT,            "mntmt",                    IDF_UINT,   324,  2, 0, 0) \
+    X(ID_CTRL_MXTMT,            "mxtmt",                    IDF_UINT,   326,  2, 0, 0) \
+    X(ID_CTRL_SANICAP,          "sanicap",                  IDF_UINT,   328,  4, 0, 0) \
+    X(ID_CTRL_SANICAP_CRYPTO,   "sanicapCryptoErase",       IDF_FLAG,   328,  4, 0, 1) \
+    X(ID_CTRL_SANICAP_BLOCK,    "sanicapBlockErase",        IDF_FLAG,   328,  4, 1, 1) \
+    X(ID_CTRL_SANICAP_OVERWRITE,"sanicapOverwrite",         IDF_FLAG,   328,  4, 2, 1) \
+    X(ID_CTRL_SANICAP_NDI,      "sanicapNoDeallocInhibited",IDF_FLAG,   328,  4, 29, 1) \
+    X(ID_CTRL_SANICAP_NODMMAS,  "sanicapNodmmas",           IDF_UINT,   328,  4, 30, 2) \
+    X(ID_CTRL_HMMINDS,          "hmminds",                  IDF_UINT,   332,  4, 0, 0) \
+    X(ID_CTRL_HMMAXD,           "hmmaxd",                   IDF_UINT,   336,  2, 0, 0) \
+    X(ID_CTRL_NSETIDMAX,        "nsetidmax",                IDF_UINT,   338,  2, 0, 0) \
+    X(ID_CTRL_ENDGIDMAX,        "endgidmax",                IDF_UINT,   340,  2, 0, 0) \
+    X(ID_CTRL_ANATT,            "anatt",                    IDF_UINT,   342,  1, 0, 0) \
+    X(ID_CTRL_ANACAP,           "anacap",                   IDF_UINT,   343,  1, 0, 0) \
+    X(ID_CTRL_ANAGRPMAX,        "anagrpmax",                IDF_UINT,   344,  4, 0, 0) \
+    X(ID_CTRL_NANAGRPID,        "nanagrpid",                IDF_UINT,   348,  4, 0, 0) \
+    X(ID_CTRL_PELS,             "pels",                     IDF_UINT,   352,  4, 0, 0) \
+    X(ID_CTRL_DOMAINID,         "domainid",                 IDF_UINT,   356,  2, 0, 0) \
+    X(ID_CTRL_MEGCAP,           "megcap",                   IDF_U128,   368, 16, 0, 0) \
+    X(ID_CTRL_SQES_MIN,         "sqesRequired",             IDF_UINT,   512,  1, 0, 4) \
+    X(ID_CTRL_SQES_MAX,         "sqesMaximum",              IDF_UINT,   512,  1, 4, 4) \
+    X(ID_CTRL_CQES_MIN,         "cqesRequired",             IDF_UINT,   513,  1, 0, 4) \
+    X(ID_CTRL_CQES_MAX,         "cqesMaximum",              IDF_UINT,   513,  1, 4, 4) \
+    X(ID_CTRL_MAXCMD,           "maxcmd",                   IDF_UINT,   514,  2, 0, 0) \
+    X(ID_CTRL_NN,               "nn",                       IDF_UINT,   516,  4, 0, 0) \
+    X(ID_CTRL_ONCS,             "oncs",                     IDF_UINT,   520,  2, 0, 0) \
+    X(ID_CTRL_ONCS_COMPARE,     "oncsCompare",              IDF_FLAG,   520,  2, 0, 1) \
+    X(ID_CTRL_ONCS_WRITE_UNC,   "oncsWriteUncorrectable",   IDF_FLAG,   520,  2, 1, 1) \
+    X(ID_CTRL_ONCS_DSM,         "oncsDatasetManagement",    IDF_FLAG,   520,  2, 2, 1) \
+    X(ID_CTRL_ONCS_WRITE_ZEROES,"oncsWriteZeroes",          IDF_FLAG,   520,  2, 3, 1) \
+    X(ID_CTRL_ONCS_SAVE_SELECT, "oncsSaveSelect",           IDF_FLAG,   520,  2, 4, 1) \
+    X(ID_CTRL_ONCS_RESERVATIONS,"oncsReservations",         IDF_FLAG,   520,  2, 5, 1) \
+    X(ID_CTRL_ONCS_TIMESTAMP,   "oncsTimestamp",            IDF_FLAG,   520,  2, 6, 1) \
+    X(ID_CTRL_ONCS_VERIFY,      "oncsVerify",               IDF_FLAG,   520,  2, 7, 1) \
+    X(ID_CTRL_ONCS_COPY,        "oncsCopy",                 IDF_FLAG,   520,  2, 8, 1) \
+    X(ID_CTRL_FUSES,            "fuses",                    IDF_UINT,   522,  2, 0, 0) \
+    X(ID_CTRL_FNA,              "fna",                      IDF_UINT,   524,  1, 0, 0) \
+    X(ID_CTRL_FNA_FORMAT_ALL,   "fnaFormatAllNamespaces",   IDF_FLAG,   524,  1, 0, 1) \
+    X(ID_CTRL_FNA_ERASE_ALL,    "fnaSecureEraseAllNamespaces", IDF_FLAG, 524, 1, 1, 1) \
+    X(ID_CTRL_FNA_CRYPTO,       "fnaCryptoErase",           IDF_FLAG,   524,  1, 2, 1) \
+    X(ID_CTRL_VWC_PRESENT,      "vwcPresent",               IDF_FLAG,   525,  1, 0, 1) \
+    X(ID_CTRL_VWC_FLUSH,        "vwcFlushBehavior",         IDF_UINT,   525,  1, 1, 2) \
+    X(ID_CTRL_AWUN,             "awun",                     IDF_UINT,   526,  2, 0, 0) \
+    X(ID_CTRL_AWUPF,            "awupf",                    IDF_UINT,   528,  2, 0, 0) \
+    X(ID_CTRL_ICSVSCC,          "icsvscc",                  IDF_UINT,   530,  1, 0, 0) \
+    X(ID_CTRL_NWPC,             "nwpc",                     IDF_UINT,   531,  1, 0, 0) \
+    X(ID_CTRL_ACWU,             "acwu",                     IDF_UINT,   532,  2, 0, 0) \
+    X(ID_CTRL_OCFS,             "ocfs",                     IDF_UINT,   534,  2, 0, 0) \
+    X(ID_CTRL_SGLS,             "sgls",                     IDF_UINT,   536,  4, 0, 0) \
+    X(ID_CTRL_SGLS_SUPPORT,     "sglsSupport",              IDF_UINT,   536,  4, 0, 2) \
+    X(ID_CTRL_MNAN,             "mnan",                     IDF_UINT,   540,  4, 0, 0) \
+    X(ID_CTRL_MAXDNA,           "maxdna",                   IDF_U128,   544, 16, 0, 0) \
+    X(ID_CTRL_MAXCNA,           "maxcna",                   IDF_UINT,   560,  4, 0, 0) \
+    X(ID_CTRL_SUBNQN,           "subnqn",                   IDF_UTF8Z,  768, 256, 0, 0) \
+    X(ID_CTRL_IOCCSZ,           "ioccsz",                   IDF_UINT,   1792, 4, 0, 0) \
+    X(ID_CTRL_IORCSZ,           "iorcsz",                   IDF_UINT,   1796, 4, 0, 0) \
+    X(ID_CTRL_ICDOFF,           "icdoff",                   IDF_UINT,   1800, 2, 0, 0) \
+    X(ID_CTRL_FCATT,            "fcatt",                    IDF_UINT,   1802, 1, 0, 0) \
+    X(ID_CTRL_MSDBD,            "msdbd",                    IDF_UINT,   1803, 1, 0, 0) \
+    X(ID_CTRL_OFCS,             "ofcs",                     IDF_UINT,   1804, 2, 0, 0)
+
+// Power State Descriptor, 32 bytes each from offset 2048, NPSS + 1 of them
+#define IDENTIFY_POWER_STATE_FIELDS(X) \
+    X(ID_PSD_MP,                "mp",                       IDF_UINT,   0,    2, 0, 0) \
+    X(ID_PSD_MXPS,              "mxps",                     IDF_FLAG,   3,    1, 0, 1) \
+    X(ID_PSD_NOPS,              "nops",                     IDF_FLAG,   3,    1, 1, 1) \
+    X(ID_PSD_ENLAT,             "enlat",                    IDF_UINT,   4,    4, 0, 0) \
+    X(ID_PSD_EXLAT,             "exlat",                    IDF_UINT,   8,    4, 0, 0) \
+    X(ID_PSD_RRT,               "rrt",                      IDF_UINT,   12,   1, 0, 5) \
+    X(ID_PSD_RRL,               "rrl",                      IDF_UINT,   13,   1, 0, 5) \
+    X(ID_PSD_RWT,               "rwt",                      IDF_UINT,   14,   1, 0, 5) \
+    X(ID_PSD_RWL,               "rwl",                      IDF_UINT,   15,   1, 0, 5) \
+    X(ID_PSD_IDLP,              "idlp",                     IDF_UINT,   16,   2, 0, 0) \
+    X(ID_PSD_IPS,               "ips",                      IDF_UINT,   18,   1, 6, 2) \
+    X(ID_PSD_ACTP,              "actp",                     IDF_UINT,   20,   2, 0, 0) \
+    X(ID_PSD_APW,               "apw",                      IDF_UINT,   22,   1, 0, 3) \
+    X(ID_PSD_APS,               "aps",                      IDF_UINT,   22,   1, 6, 2)
+
+#define IDENTIFY_NAMESPACE_FIELDS(X) \
+    X(ID_NS_NSZE,               "nsze",                     IDF_UINT,   0,    8, 0, 0) \
+    X(ID_NS_NCAP,               "ncap",                     IDF_UINT,   8,    8, 0, 0) \
+    X(ID_NS_NUSE,               "nuse",                     IDF_UINT,   16,   8, 0, 0) \
+    X(ID_NS_NSFEAT,             "nsfeat",                   IDF_UINT,   24,   1, 0, 0) \
+    X(ID_NS_NSFEAT_THIN,        "nsfeatThinProvisioning",   IDF_FLAG,   24,   1, 0, 1) \
+    X(ID_NS_NSFEAT_NSABP,       "nsfeatAtomicBoundaries",   IDF_FLAG,   24,   1, 1, 1) \
+    X(ID_NS_NSFEAT_DAE,         "nsfeatDeallocErrors",      IDF_FLAG,   24,   1, 2, 1) \
+    X(ID_NS_NSFEAT_OPTPERF,     "nsfeatOptimalPerformance", IDF_FLAG,   24,   1, 4, 1) \
+    X(ID_NS_NLBAF,              "nlbaf",                    IDF_UINT,   25,   1, 0, 0) \
+    X(ID_NS_FLBAS_INDEX_LO,     "flbasIndex",               IDF_UINT,   26,   1, 0, 4) \
+    X(ID_NS_FLBAS_EXTENDED,     "flbasExtendedLba",         IDF_FLAG,   26,   1, 4, 1) \
+    X(ID_NS_FLBAS_INDEX_HI,     "flbasIndexHigh",           IDF_UINT,   26,   1, 5, 2) \
+    X(ID_NS_MC,                 "mc",                       IDF_UINT,   27,   1, 0, 0) \
+    X(ID_NS_DPC,                "dpc",                      IDF_UINT,   28,   1, 0, 0) \
+    X(ID_NS_DPS_TYPE,           "dpsType",                  IDF_UINT,   29,   1, 0, 3) \
+    X(ID_NS_DPS_FIRST,          "dpsFirstEightBytes",       IDF_FLAG,   29,   1, 3, 1) \
+    X(ID_NS_NMIC_SHARED,        "nmicShared",               IDF_FLAG,   30,   1, 0, 1) \
+    X(ID_NS_RESCAP,             "rescap",                   IDF_UINT,   31,   1, 0, 0) \
+    X(ID_NS_FPI_PERCENT,        "fpiRemainingPercent",      IDF_UINT,   32,   1, 0, 7) \
+    X(ID_NS_FPI_SUPPORTED,      "fpiSupported",             IDF_FLAG,   32,   1, 7, 1) \
+    X(ID_NS_DLFEAT_READ,        "dlfeatReadBehavior",       IDF_UINT,   33,   1, 0, 3) \
+    X(ID_NS_DLFEAT_WRITE_ZEROES,"dlfeatWriteZeroesDealloc", IDF_FLAG,   33,   1, 3, 1) \
+    X(ID_NS_DLFEAT_GUARD_CRC,   "dlfeatGuardCrc",           IDF_FLAG,   33,   1, 4, 1) \
+    X(ID_NS_NAWUN,              "nawun",                    IDF_UINT,   34,   2, 0, 0) \
+    X(ID_NS_NAWUPF,             "nawupf",                   IDF_UINT,   36,   2, 0, 0) \
+    X(ID_NS_NACWU,              "nacwu",                    IDF_UINT,   38,   2, 0, 0) \
+    X(ID_NS_NABSN,              "nabsn",                    IDF_UINT,   40,   2, 0, 0) \
+    X(ID_NS_NABO,               "nabo",                     IDF_UINT,   42,   2, 0, 0) \
+    X(ID_NS_NABSPF,             "nabspf",                   IDF_UINT,   44,   2, 0, 0) \
+    X(ID_NS_NOIOB,              "noiob",                    IDF_UINT,   46,   2, 0, 0) \
+    X(ID_NS_NVMCAP,             "nvmcap",                   IDF_U128,   48,  16, 0, 0) \
+    X(ID_NS_NPWG,               "npwg",                     IDF_UINT,   64,   2, 0, 0) \
+    X(ID_NS_NPWA,               "npwa",                     IDF_UINT,   66,   2, 0, 0) \
+    X(ID_NS_NPDG,               "npdg",                     IDF_UINT,   68,   2, 0, 0) \
+    X(ID_NS_NPDA,               "npda",                     IDF_UINT,   70,   2, 0, 0) \
+    X(ID_NS_NOWS,               "nows",                     IDF_UINT,   72,   2, 0, 0) \
+    X(ID_NS_MSSRL,              "mssrl",                    IDF_UINT,   74,   2, 0, 0) \
+    X(ID_NS_MCL,                "mcl",                      IDF_UINT,   76,   4, 0, 0) \
+    X(ID_NS_MSRC,               "msrc",                     IDF_UINT,   80,   1, 0, 0) \
+    X(ID_NS_NULBAF,             "nulbaf",                   IDF_UINT,   82,   1, 0, 0) \
+    X(ID_NS_ANAGRPID,           "anagrpid",                 IDF_UINT,   92,   4, 0, 0) \
+    X(ID_NS_NSATTR_WP,          "nsattrWriteProtected",     IDF_FLAG,   99,   1, 0, 1) \
+    X(ID_NS_NVMSETID,           "nvmsetid",                 IDF_UINT,   100,  2, 0, 0) \
+    X(ID_NS_ENDGID,             "endgid",                   IDF_UINT,   102,  2, 0, 0) \
+    X(ID_NS_NGUID,              "nguid",                    IDF_HEX,    104, 16, 0, 0) \
+    X(ID_NS_EUI64,              "eui64",                    IDF_HEX,    120,  8, 0, 0)
+
+// LBA Format, 4 bytes each from offset 128, NLBAF + 1 of them
+#define IDENTIFY_LBA_FORMAT_FIELDS(X) \
+    X(ID_LBAF_MS,               "ms",                       IDF_UINT,   0,    4, 0, 16) \
+    X(ID_LBAF_LBADS,            "lbads",                    IDF_UINT,   0,    4, 16, 8) \
+    X(ID_LBAF_RP,               "rp",                       IDF_UINT,   0,    4, 24, 2)
+
+#define IDENTIFY_ATA_FIELDS(X) \
+    X(ID_ATA_GENERAL_CONFIG,    "generalConfiguration",     IDF_UINT,   ATA_WORD(0),   2, 0, 0) \
+    X(ID_ATA_NOT_ATA_DEVICE,    "notAtaDevice",             IDF_FLAG,   ATA_WORD(0),   2, 15, 1) \
+    X(ID_ATA_REMOVABLE_MEDIA,   "removableMedia",           IDF_FLAG,   ATA_WORD(0),   2, 7, 1) \
+    X(ID_ATA_SPECIFIC_CONFIG,   "specificConfiguration",    IDF_UINT,   ATA_WORD(2),   2, 0, 0) \
+    X(ID_ATA_SERIAL,            "serialNumber",             IDF_ATA_STRING, ATA_WORD(10), 20, 0, 0) \
+    X(ID_ATA_FIRMWARE,          "firmwareRevision",         IDF_ATA_STRING, ATA_WORD(23),  8, 0, 0) \
+    X(ID_ATA_MODEL,             "modelNumber",              IDF_ATA_STRING, ATA_WORD(27), 40, 0, 0) \
+    X(ID_ATA_MAX_MULTIPLE,      "maxSectorsPerDrq",         IDF_UINT,   ATA_WORD(47),  2, 0, 8) \
+    X(ID_ATA_TRUSTED_COMPUTING, "trustedComputing",         IDF_FLAG,   ATA_WORD(48),  2, 0, 1) \
+    X(ID_ATA_CAP_DMA,           "dmaSupported",             IDF_FLAG,   ATA_WORD(49),  2, 8, 1) \
+    X(ID_ATA_CAP_LBA,           "lbaSupported",             IDF_FLAG,   ATA_WORD(49),  2, 9, 1) \
+    X(ID_ATA_CAP_IORDY,         "iordySupported",           IDF_FLAG,   ATA_WORD(49),  2, 11, 1) \
+    X(ID_ATA_CAP_STANDBY_TIMER, "standbyTimerStandard",     IDF_FLAG,   ATA_WORD(49),  2, 13, 1) \
+    X(ID_ATA_CAP_MIN_STANDBY,   "minimumStandbyVendor",     IDF_FLAG,   ATA_WORD(50),  2, 0, 1) \
+    X(ID_ATA_VALID_64_70,       "words64To70Valid",         IDF_FLAG,   ATA_WORD(53),  2, 1, 1) \
+    X(ID_ATA_VALID_88,          "word88Valid",              IDF_FLAG,   ATA_WORD(53),  2, 2, 1) \
+    X(ID_ATA_FREE_FALL,         "freeFallSensitivity",      IDF_UINT,   ATA_WORD(53),  2, 8, 8) \
+    X(ID_ATA_CURRENT_MULTIPLE,  "currentSectorsPerDrq",     IDF_UINT,   ATA_WORD(59),  2, 0, 8) \
+    X(ID_ATA_MULTIPLE_VALID,    "multipleSettingValid",     IDF_FLAG,   ATA_WORD(59),  2, 8, 1) \
+    X(ID_ATA_SANITIZE,          "sanitizeSupported",        IDF_FLAG,   ATA_WORD(59),  2, 12, 1) \
+    X(ID_ATA_SANITIZE_CRYPTO,   "sanitizeCryptoScramble",   IDF_FLAG,   ATA_WORD(59),  2, 13, 1) \
+    X(ID_ATA_SANITIZE_OVERWRITE,"sanitizeOverwrite",        IDF_FLAG,   ATA_WORD(59),  2, 14, 1) \
+    X(ID_ATA_SANITIZE_BLOCK,    "sanitizeBlockErase",       IDF_FLAG,   ATA_WORD(59),  2, 15, 1) \
+    X(ID_ATA_LBA28_SECTORS,     "lba28Sectors",             IDF_UINT,   ATA_WORD(60),  4, 0, 0) \
+    X(ID_ATA_MWDMA_SUPPORTED,   "multiwordDmaSupported",    IDF_UINT,   ATA_WORD(63),  2, 0, 3) \
+    X(ID_ATA_MWDMA_SELECTED,    "multiwordDmaSelected",     IDF_UINT,   ATA_WORD(63),  2, 8, 3) \
+    X(ID_ATA_PIO_MODES,         "pioModesSupported",        IDF_UINT,   ATA_WORD(64),  2, 0, 8) \
+    X(ID_ATA_MWDMA_MIN_CYCLE,   "multiwordDmaMinCycleNs",   IDF_UINT,   ATA_WORD(65),  2, 0, 0) \
+    X(ID_ATA_MWDMA_REC_CYCLE,   "multiwordDmaRecCycleNs",   IDF_UINT,   ATA_WORD(66),  2, 0, 0) \
+    X(ID_ATA_PIO_MIN_CYCLE,     "pioMinCycleNs",            IDF_UINT,   ATA_WORD(67),  2, 0, 0) \
+    X(ID_ATA_PIO_IORDY_CYCLE,   "pioIordyMinCycleNs",       IDF_UINT,   ATA_WORD(68),  2, 0, 0) \
+    X(ID_ATA_ADDITIONAL,        "additionalSupported",      IDF_UINT,   ATA_WORD(69),  2, 0, 0) \
+    X(ID_ATA_EXTENDED_SECTORS_SUPPORTED, "extendedSectorsSupported", IDF_FLAG, ATA_WORD(69), 2, 3, 1) \
+    X(ID_ATA_TRIM_RZAT,         "trimReturnsZeroes",        IDF_FLAG,   ATA_WORD(69),  2, 5, 1) \
+    X(ID_ATA_TRIM_DRAT,         "trimDeterministic",        IDF_FLAG,   ATA_WORD(69),  2, 14, 1) \
+    X(ID_ATA_QUEUE_DEPTH,       "queueDepthMinusOne",       IDF_UINT,   ATA_WORD(75),  2, 0, 5) \
+    X(ID_ATA_SATA_CAPS,         "sataCapabilities",         IDF_UINT,   ATA_WORD(76),  2, 0, 0) \
+    X(ID_ATA_SATA_GEN1,         "sataGen1",                 IDF_FLAG,   ATA_WORD(76),  2, 1, 1) \
+    X(ID_ATA_SATA_GEN2,         "sataGen2",                 IDF_FLAG,   ATA_WORD(76),  2, 2, 1) \
+    X(ID_ATA_SATA_GEN3,         "sataGen3",                 IDF_FLAG,   ATA_WORD(76),  2, 3, 1) \
+    X(ID_ATA_NCQ,               "ncqSupported",             IDF_FLAG,   ATA_WORD(76),  2, 8, 1) \
+    X(ID_ATA_SATA_CAPS2,        "sataAdditionalCapabilities", IDF_UINT, ATA_WORD(77),  2, 0, 0) \
+    X(ID_ATA_SATA_SPEED,        "sataCurrentSpeed",         IDF_UINT,   ATA_WORD(77),  2, 1, 3) \
+    X(ID_ATA_SATA_FEATURES,     "sataFeaturesSupported",    IDF_UINT,   ATA_WORD(78),  2, 0, 0) \
+    X(ID_ATA_SATA_ENABLED,      "sataFeaturesEnabled",      IDF_UINT,   ATA_WORD(79),  2, 0, 0) \
+    X(ID_ATA_MAJOR_VERSION,     "majorVersion",             IDF_UINT,   ATA_WORD(80),  2, 0, 0) \
+    X(ID_ATA_MINOR_VERSION,     "minorVersion",             IDF_UINT,   ATA_WORD(81),  2, 0, 0) \
+    X(ID_ATA_CMDSET_82,         "commandSet82",             IDF_UINT,   ATA_WORD(82),  2, 0, 0) \
+    X(ID_ATA_SMART,             "smartSupported",           IDF_FLAG,   ATA_WORD(82),  2, 0, 1) \
+    X(ID_ATA_SECURITY_FEATURE,  "securityFeatureSupported", IDF_FLAG,   ATA_WORD(82),  2, 1, 1) \
+    X(ID_ATA_WRITE_CACHE,       "writeCacheSupported",      IDF_FLAG,   ATA_WORD(82),  2, 5, 1) \
+    X(ID_ATA_LOOK_AHEAD,        "lookAheadSupported",       IDF_FLAG,   ATA_WORD(82),  2, 6, 1) \
+    X(ID_ATA_CMDSET_83,         "commandSet83",             IDF_UINT,   ATA_WORD(83),  2, 0, 0) \
+    X(ID_ATA_LBA48,             "lba48Supported",           IDF_FLAG,   ATA_WORD(83),  2, 10, 1) \
+    X(ID_ATA_FLUSH_EXT,         "flushCacheExtSupported",   IDF_FLAG,   ATA_WORD(83),  2, 13, 1) \
+    X(ID_ATA_CMDSET_84,         "commandSet84",             IDF_UINT,   ATA_WORD(84),  2, 0, 0) \
+    X(ID_ATA_WWN_SUPPORTED,     "wwnSupported",             IDF_FLAG,   ATA_WORD(84),  2, 8, 1) \
+    X(ID_ATA_CMDSET_85,         "commandSet85",             IDF_UINT,   ATA_WORD(85),  2, 0, 0) \
+    X(ID_ATA_WRITE_CACHE_ON,    "writeCacheEnabled",        IDF_FLAG,   ATA_WORD(85),  2, 5, 1) \
+    X(ID_ATA_CMDSET_86,         "commandSet86",             IDF_UINT,   ATA_WORD(86),  2, 0, 0) \
+    X(ID_ATA_CMDSET_87,         "commandSet87",             IDF_UINT,   ATA_WORD(87),  2, 0, 0) \
+    X(ID_ATA_UDMA_SUPPORTED,    "ultraDmaSupported",        IDF_UINT,   ATA_WORD(88),  2, 0, 7) \
+    X(ID_ATA_UDMA_SELECTED,     "ultraDmaSelected",         IDF_UINT,   ATA_WORD(88),  2, 8, 7) \
+    X(ID_ATA_ERASE_TIME,        "securityEraseTime",        IDF_UINT,   ATA_WORD(89),  2, 0, 15) \
+    X(ID_ATA_ERASE_TIME_EXT,    "securityEraseTimeExtended",IDF_FLAG,   ATA_WORD(89),  2, 15, 1) \
+    X(ID_ATA_ENH_ERASE_TIME,    "enhancedEraseTime",        IDF_UINT,   ATA_WORD(90),  2, 0, 15) \
+    X(ID_ATA_ENH_ERASE_TIME_EXT,"enhancedEraseTimeExtended",IDF_FLAG,   ATA_WORD(90),  2, 15, 1) \
+    X(ID_ATA_APM_LEVEL,         "apmLevel",                 IDF_UINT,   ATA_WORD(91),  2, 0, 8) \
+    X(ID_ATA_MASTER_PASSWORD_ID,"masterPasswordId",         IDF_UINT,   ATA_WORD(92),  2, 0, 0) \
+    X(ID_ATA_RESET_RESULT,      "hardwareResetResult",      IDF_UINT,   ATA_WORD(93),  2, 0, 0) \
+    X(ID_ATA_STREAM_MIN,        "streamMinRequestSize",     IDF_UINT,   ATA_WORD(95),  2, 0, 0) \
+    X(ID_ATA_STREAM_DMA_TIME,   "streamDmaTime",            IDF_UINT,   ATA_WORD(96),  2, 0, 0) \
+    X(ID_ATA_STREAM_LATENCY,    "streamLatency",            IDF_UINT,   ATA_WORD(97),  2, 0, 0) \
+    X(ID_ATA_STREAM_GRANULARITY,"streamPerformanceGranularity", IDF_UINT, ATA_WORD(98), 4, 0, 0) \
+    X(ID_ATA_LBA48_SECTORS,     "lba48Sectors",             IDF_UINT,   ATA_WORD(100), 8, 0, 0) \
+    X(ID_ATA_STREAM_PIO_TIME,   "streamPioTime",            IDF_UINT,   ATA_WORD(104), 2, 0, 0) \
+    X(ID_ATA_DSM_MAX_BLOCKS,    "dsmMaxBlocks",             IDF_UINT,   ATA_WORD(105), 2, 0, 0) \
+    X(ID_ATA_SECTOR_SIZE,       "sectorSizeInfo",           IDF_UINT,   ATA_WORD(106), 2, 0, 0) \
+    X(ID_ATA_LOG_PER_PHYS,      "logicalPerPhysicalLog2",   IDF_UINT,   ATA_WORD(106), 2, 0, 4) \
+    X(ID_ATA_LONG_LOGICAL,      "logicalSectorLong",        IDF_FLAG,   ATA_WORD(106), 2, 12, 1) \
+    X(ID_ATA_MULTI_LOGICAL,     "multipleLogicalPerPhysical", IDF_FLAG, ATA_WORD(106), 2, 13, 1) \
+    X(ID_ATA_SECTOR_SIZE_VALID, "sectorSizeInfoValid",      IDF_UINT,   ATA_WORD(106), 2, 14, 2) \
+    X(ID_ATA_INTER_SEEK_DELAY,  "interSeekDelay",           IDF_UINT,   ATA_WORD(107), 2, 0, 0) \
+    X(ID_ATA_WWN,               "worldWideName",            IDF_WORDS_BE, ATA_WORD(108), 8, 0, 0) \
+    X(ID_ATA_LOGICAL_SECTOR_WORDS, "logicalSectorWords",    IDF_UINT,   ATA_WORD(117), 4, 0, 0) \
+    X(ID_ATA_CMDSET_119,        "commandSet119",            IDF_UINT,   ATA_WORD(119), 2, 0, 0) \
+    X(ID_ATA_CMDSET_120,        "commandSet120",            IDF_UINT,   ATA_WORD(120), 2, 0, 0) \
+    X(ID_ATA_SECURITY_STATUS,   "securityStatus",           IDF_UINT,   ATA_WORD(128), 2, 0, 0) \
+    X(ID_ATA_SEC_SUPPORTED,     "securitySupported",        IDF_FLAG,   ATA_WORD(128), 2, 0, 1) \
+    X(ID_ATA_SEC_ENABLED,       "securityEnabled",          IDF_FLAG,   ATA_WORD(128), 2, 1, 1) \
+    X(ID_ATA_SEC_LOCKED,        "securityLocked",           IDF_FLAG,   ATA_WORD(128), 2, 2, 1) \
+    X(ID_ATA_SEC_FROZEN,        "securityFrozen",           IDF_FLAG,   ATA_WORD(128), 2, 3, 1) \
+    X(ID_ATA_SEC_COUNT_EXPIRED, "securityCountExpired",     IDF_FLAG,   ATA_WORD(128), 2, 4, 1) \
+    X(ID_ATA_SEC_ENHANCED,      "securityEnhancedErase",    IDF_FLAG,   ATA_WORD(128), 2, 5, 1) \
+    X(ID_ATA_SEC_LEVEL_MAX,     "securityLevelMaximum",     IDF_FLAG,   ATA_WORD(128), 2, 8, 1) \
+    X(ID_ATA_CFA_POWER,         "cfaPowerMode",             IDF_UINT,   ATA_WORD(160), 2, 0, 0) \
+    X(ID_ATA_FORM_FACTOR,       "formFactor",               IDF_UINT,   ATA_WORD(168), 2, 0, 4) \
+    X(ID_ATA_TRIM,              "trimSupported",            IDF_FLAG,   ATA_WORD(169), 2, 0, 1) \
+    X(ID_ATA_ADDITIONAL_PRODUCT,"additionalProductId",      IDF_ATA_STRING, ATA_WORD(170), 8, 0, 0) \
+    X(ID_ATA_MEDIA_SERIAL,      "mediaSerialNumber",        IDF_ATA_STRING, ATA_WORD(176), 60, 0, 0) \
+    X(ID_ATA_SCT,               "sctCommandTransport",      IDF_UINT,   ATA_WORD(206), 2, 0, 0) \
+    X(ID_ATA_ALIGNMENT,         "logicalAlignment",         IDF_UINT,   ATA_WORD(209), 2, 0, 14) \
+    X(ID_ATA_WRV_COUNT_MODE3,   "wrvSectorsMode3",          IDF_UINT,   ATA_WORD(210), 4, 0, 0) \
+    X(ID_ATA_WRV_COUNT_MODE2,   "wrvSectorsMode2",          IDF_UINT,   ATA_WORD(212), 4, 0, 0) \
+    X(ID_ATA_ROTATION_RATE,     "rotationRate",             IDF_UINT,   ATA_WORD(217), 2, 0, 0) \
+    X(ID_ATA_WRV_MODE,          "wrvMode",                  IDF_UINT,   ATA_WORD(220), 2, 0, 8) \
+    X(ID_ATA_TRANSPORT_MAJOR,   "transportMajorVersion",    IDF_UINT,   ATA_WORD(222), 2, 0, 0) \
+    X(ID_ATA_TRANSPORT_MINOR,   "transportMinorVersion",    IDF_UINT,   ATA_WORD(223), 2, 0, 0) \
+    X(ID_ATA_EXTENDED_SECTORS,  "extendedSectors",          IDF_UINT,   ATA_WORD(230), 8, 0, 0) \
+    X(ID_ATA_MICROCODE_MIN,     "microcodeMinBlocks",       IDF_UINT,   ATA_WORD(234), 2, 0, 0) \
+    X(ID_ATA_MICROCODE_MAX,     "microcodeMaxBlocks",       IDF_UINT,   ATA_WORD(235), 2, 0, 0) \
+    X(ID_ATA_SIGNATURE,         "integritySignature",       IDF_UINT,   ATA_WORD(255), 2, 0, 8) \
+    X(ID_ATA_CHECKSUM,          "integrityChecksum",        IDF_UINT,   ATA_WORD(255), 2, 8, 8)
+// clang-format on
+
+#define IDENTIFY_FIELD_ENUM(id, name, kind, offset, width, shift, bits) id,
+typedef enum { IDENTIFY_CONTROLLER_FIELDS(IDENTIFY_FIELD_ENUM) ID_CTRL_FIELD_COUNT } IdentifyControllerField;
+typedef enum { IDENTIFY_POWER_STATE_FIELDS(IDENTIFY_FIELD_ENUM) ID_PSD_FIELD_COUNT } IdentifyPowerStateField;
+typedef enum { IDENTIFY_NAMESPACE_FIELDS(IDENTIFY_FIELD_ENUM) ID_NS_FIELD_COUNT } IdentifyNamespaceField;
+typedef enum { IDENTIFY_LBA_FORMAT_FIELDS(IDENTIFY_FIELD_ENUM) ID_LBAF_FIELD_COUNT } IdentifyLbaFormatField;
+typedef enum { IDENTIFY_ATA_FIELDS(IDENTIFY_FIELD_ENUM) ID_ATA_FIELD_COUNT } IdentifyAtaField;
+#undef IDENTIFY_FIELD_ENUM
+
+#define IDENTIFY_NVME_SIZE 4096
+#define IDENTIFY_ATA_SIZE 512
+#define IDENTIFY_PSD_OFFSET 2048
+#define IDENTIFY_PSD_MAX 32
+#define IDENTIFY_LBAF_OFFSET 128
+#define IDENTIFY_LBAF_MAX 64
+// Longest text field (SUBNQN) plus its terminator
+#define IDENTIFY_TEXT_MAX 257
+
+typedef struct {
+    const char* name;
+    uint16_t offset;
+    uint16_t width;             // bytes
+    uint8_t kind;               // IdentifyKind
+    uint8_t shift;              // bit field: first bit within the value
+    uint8_t bits;               // bit field width, 0 for the whole value
+} IdentifyField;
+
+typedef struct _IdentifyTable IdentifyTable;
+
+// A run of equally sized structures whose count is stored zero-based in
+// the byte at @count_offset of the enclosing structure
+typedef struct {
+    const char* name;
+    uint16_t offset;
+    uint16_t stride;
+    uint16_t max_count;
+    uint16_t count_offset;
+    const IdentifyTable* element;
+} IdentifyArray;
+
+struct _IdentifyTable {
+    const char* name;
+    size_t size;                // bytes the fields are drawn from
+    const IdentifyField* fields;
+    guint field_count;
+    const IdentifyArray* arrays;
+    guint array_count;
+};
+
+extern const IdentifyTable identify_nvme_controller_table;
+extern const IdentifyTable identify_nvme_power_state_table;
+extern const IdentifyTable identify_nvme_namespace_table;
+extern const IdentifyTable identify_nvme_lba_format_table;
+extern const IdentifyTable identify_ata_table;
+
+typedef struct {
+    const IdentifyField* field;
+    uint64_t value;             // IDF_UINT, IDF_FLAG, IDF_WORDS_BE; low half of IDF_U128
+    uint64_t high;              // upper half of IDF_U128
+    const char* text;           // text kinds; only valid during the callback
+    size_t length;
+} IdentifyValue;
+
+/**
+ * IdentifyVisitor:
+ *
+ * Receives decoded fields in table order. Array callbacks are optional and
+ * bracket the fields of each element.
+ */
+typedef struct {
+    void (*field)(const IdentifyValue* value, void* ctx);
+    void (*array_begin)(const IdentifyArray* array, guint count, void* ctx);
+    void (*element_begin)(guint index, void* ctx);
+    void (*element_end)(void* ctx);
+    void (*array_end)(void* ctx);
+} IdentifyVisitor;
+
+/**
+ * identify_read:
+ *
+ * Value of a numeric field (IDF_UINT, IDF_FLAG, IDF_WORDS_BE, or the low
+ * 64 bits of IDF_U128) in @data, which holds at least offset + width bytes.
+ */
+uint64_t identify_read(const IdentifyField* field, const uint8_t* data);
+
+/**
+ * identify_read_text:
+ * @buffer: receives the text, at least IDENTIFY_TEXT_MAX bytes for any field
+ *
+ * Text of a string field with padding trimmed, or hex digits for IDF_HEX.
+ *
+ * Returns: the length written, excluding the terminator
+ */
+size_t identify_read_text(const IdentifyField* field, const uint8_t* data,
+                          char* buffer, size_t size);
+
+/**
+ * identify_decode:
+ *
+ * Walks @table over @data (@size bytes, at least table->size) and reports
+ * every field to @visitor. Decoding itself allocates nothing.
+ *
+ * Returns: FALSE when @data is too short
+ */
+gboolean identify_decode(const IdentifyTable* table, const uint8_t* data, size_t size,
+                         const IdentifyVisitor* visitor, void* ctx);
+
+/**
+ * identify_to_fl_value:
+ *
+ * Decodes @data into a map keyed by field name; arrays become lists of
+ * maps. 128-bit values that do not fit an int become decimal strings.
+ *
+ * Returns: (transfer full): the map, or NULL when @data is too short
+ */
+FlValue* identify_to_fl_value(const IdentifyTable* table, const uint8_t* data, size_t size);
+
+/**
+ * identify_write:
+ *
+ * Stores @value into the field in @data, leaving the other bits of a bit
+ * field untouched. The inverse of identify_read().
+ */
+void identify_write(const IdentifyField* field, uint8_t* data, uint64_t value);
+
+/**
+ * identify_write_text:
+ *
+ * Stores @text padded the way the field's kind expects (spaces, NULs, or
+ * byte-swapped words for ATA strings).
+ */
+void identify_write_text(const IdentifyField* field, uint8_t* data, const char* text);
+
+/**
+ * identify_ata_checksum_valid:
+ *
+ * Whether word 255 carries the A5h signature and a checksum that makes the
+ * 512 bytes sum to zero. Devices without the signature count as valid.
+ */
+gboolean identify_ata_checksum_valid(const uint8_t* data);
+
+/**
+ * identify_ata_seal:
+ *
+ * Writes the A5h signature and checksum into word 255.
+ */
+void identify_ata_seal(uint8_t* data);
+
+G_END_DECLS
+
+#endif // IDENTIFY_DECODE_H
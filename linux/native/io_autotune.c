@@ -0,0 +1,480 @@
+#define _GNU_SOURCE
+#include "io_autotune.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define IO_AUTOTUNE_MAX_SIZES 12
+#define IO_AUTOTUNE_DEFAULT_AREA (1ull << 30)
+// A deeper queue has to beat the shallower one by this much to continue
+#define IO_AUTOTUNE_DEPTH_GAIN 1.05
+
+typedef struct {
+    int fd;
+    const IoAutotuneOptions* options;
+    const DeviceBackend* backend;
+    uint64_t area_offset;
+    uint64_t area_length;
+    uint64_t cursor;          // bytes into the area where the next step starts
+
+    // One step
+    size_t block_size;
+    uint64_t slots;           // whole blocks in the area
+    uint64_t next_block;      // atomic, counts from the step's first block
+    uint64_t first_block;
+    uint64_t budget_blocks;
+    gint64 deadline_us;
+    uint64_t bytes;           // atomic
+    uint64_t latency_sum_us;  // atomic
+    uint64_t requests;        // atomic
+    gint failed;              // atomic
+    int failed_errno;
+} AutotuneJob;
+
+static gint64 monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static gboolean is_cancelled(const AutotuneJob* job) {
+    return (job->options->cancel && *job->options->cancel) ||
+           __atomic_load_n(&job->failed, __ATOMIC_RELAXED);
+}
+
+void io_autotune_default_options(IoAutotuneOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->mode = IO_AUTOTUNE_READ;
+    options->min_block_size = IO_AUTOTUNE_MIN_BLOCK_SIZE;
+    options->max_block_size = IO_AUTOTUNE_MAX_BLOCK_SIZE;
+    options->max_queue_depth = IO_AUTOTUNE_MAX_QUEUE_DEPTH;
+    options->step_us = IO_AUTOTUNE_STEP_US;
+    options->step_bytes = IO_AUTOTUNE_STEP_BYTES;
+    options->budget_us = IO_AUTOTUNE_BUDGET_US;
+    options->knee_fraction = IO_AUTOTUNE_KNEE_FRACTION;
+}
+
+static void* step_func(void* data) {
+    AutotuneJob* job = data;
+    const DeviceBackend* backend = job->backend;
+    gboolean write = job->options->mode == IO_AUTOTUNE_WRITE;
+
+    uint8_t* buffer = NULL;
+    if (posix_memalign((void**)&buffer, 4096, job->block_size) != 0) {
+        job->failed_errno = ENOMEM;
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    memset(buffer, 0, job->block_size);
+
+    while (!is_cancelled(job) && monotonic_us() < job->deadline_us) {
+        uint64_t n = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED);
+        if (n >= job->budget_blocks) break;
+        // Sequential through the area, wrapping at its end
+        uint64_t offset = job->area_offset + ((job->first_block + n) % job->slots) * job->block_size;
+
+        gint64 start = monotonic_us();
+        ssize_t done = write
+            ? backend->pwrite(job->fd, buffer, job->block_size, offset, backend->ctx)
+            : backend->pread(job->fd, buffer, job->block_size, offset, backend->ctx);
+        if (done != (ssize_t)job->block_size) {
+            job->failed_errno = done < 0 ? errno : EIO;
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        __atomic_fetch_add(&job->latency_sum_us, (uint64_t)(monotonic_us() - start), __ATOMIC_RELAXED);
+        __atomic_fetch_add(&job->requests, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&job->bytes, job->block_size, __ATOMIC_RELAXED);
+    }
+    free(buffer);
+    return NULL;
+}
+
+// Runs one candidate; FALSE when cancelled or the I/O failed
+static gboolean measure(AutotuneJob* job, size_t block_size, guint depth, IoAutotuneSample* sample) {
+    const IoAutotuneOptions* options = job->options;
+    job->block_size = block_size;
+    job->slots = job->area_length / block_size;
+    job->first_block = job->cursor / block_size;
+    job->next_block = 0;
+    job->budget_blocks = MAX(options->step_bytes / block_size, depth);
+    job->bytes = 0;
+    job->latency_sum_us = 0;
+    job->requests = 0;
+
+    pthread_t threads[IO_AUTOTUNE_MAX_QUEUE_DEPTH];
+    guint started = 0;
+    gint64 start_us = monotonic_us();
+    job->deadline_us = start_us + options->step_us;
+    for (guint i = 0; i < depth; i++) {
+        if (pthread_create(&threads[i], NULL, step_func, job) != 0) break;
+        started++;
+    }
+    for (guint i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    gint64 elapsed_us = MAX(monotonic_us() - start_us, 1);
+
+    uint64_t issued = MIN(job->next_block, job->budget_blocks);
+    job->cursor = ((job->first_block + issued) % job->slots) * block_size;
+
+    sample->block_size = block_size;
+    sample->queue_depth = started;
+    sample->bytes_per_second = (double)job->bytes * 1e6 / (double)elapsed_us;
+    sample->mean_latency_us = job->requests ? (guint)(job->latency_sum_us / job->requests) : 0;
+    if (started == 0 && !job->failed) {
+        job->failed_errno = EAGAIN;
+        job->failed = 1;
+    }
+    return !is_cancelled(job);
+}
+
+static void add_size(size_t* sizes, guint* count, size_t size) {
+    for (guint i = 0; i < *count; i++) {
+        if (sizes[i] == size) return;
+    }
+    if (*count < IO_AUTOTUNE_MAX_SIZES) sizes[(*count)++] = size;
+}
+
+static int compare_size(const void* a, const void* b) {
+    size_t x = *(const size_t*)a, y = *(const size_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Candidate transfer sizes between the bounds and within the queue limits
+static guint candidate_sizes(const IoAutotuneOptions* options, size_t logical_block,
+                             size_t max_transfer, size_t optimal_io_size,
+                             uint64_t area_length, size_t* sizes) {
+    size_t low = MAX(options->min_block_size ? options->min_block_size : IO_AUTOTUNE_MIN_BLOCK_SIZE,
+                     logical_block);
+    size_t high = options->max_block_size ? options->max_block_size : IO_AUTOTUNE_MAX_BLOCK_SIZE;
+    // Larger requests are split by the block layer and gain nothing
+    if (max_transfer) high = MIN(high, max_transfer);
+    high = MIN(high, (size_t)MIN(area_length, (uint64_t)SIZE_MAX));
+    high -= high % logical_block;
+    low = MIN(low, high);
+
+    guint count = 0;
+    if (optimal_io_size && optimal_io_size % logical_block == 0 && optimal_io_size <= high) {
+        // Striped devices want whole stripes
+        for (size_t size = optimal_io_size; size <= high; size *= 2) {
+            add_size(sizes, &count, size);
+        }
+    } else {
+        size_t size = logical_block;
+        while (size < low) size *= 2;
+        for (; size <= high; size *= 2) {
+            add_size(sizes, &count, size);
+        }
+        // A limit such as 120 KiB on USB bridges is a candidate of its own
+        if (high >= low) add_size(sizes, &count, high);
+    }
+    qsort(sizes, count, sizeof(*sizes), compare_size);
+    return count;
+}
+
+gboolean io_autotune_run(int fd,
+                         const char* device,
+                         const IoAutotuneOptions* options,
+                         IoAutotuneResult* result,
+                         GError** error) {
+    memset(result, 0, sizeof(*result));
+    result->mode = options->mode;
+    const DeviceBackend* backend = options->backend ? options->backend : device_backend_linux();
+
+    uint64_t logical_block = 512;
+    uint64_t value = 0;
+    if (device) {
+        if (device_backend_read_u64(backend, device, "queue/logical_block_size", &value) && value) {
+            logical_block = value;
+        }
+        if (device_backend_read_u64(backend, device, "queue/max_hw_sectors_kb", &value)) {
+            result->max_transfer = (size_t)value * 1024;
+        }
+        if (device_backend_read_u64(backend, device, "queue/optimal_io_size", &value)) {
+            result->optimal_io_size = (size_t)value;
+        }
+    }
+    // O_DIRECT buffers are page aligned; keep sizes multiples of a page too
+    logical_block = MAX(logical_block, 4096);
+
+    uint64_t device_size = 0;
+    if (backend->device_size(fd, &device_size, backend->ctx) < 0 || device_size <= options->offset) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "Probe area starts beyond the end of the device");
+        return FALSE;
+    }
+
+    AutotuneJob job;
+    memset(&job, 0, sizeof(job));
+    job.fd = fd;
+    job.options = options;
+    job.backend = backend;
+    job.area_offset = options->offset;
+    job.area_length = MIN(options->length ? options->length : IO_AUTOTUNE_DEFAULT_AREA,
+                          device_size - options->offset);
+    if (job.area_length < logical_block) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "Probe area is smaller than one block");
+        return FALSE;
+    }
+
+    // Fill in the defaults for fields left at 0
+    IoAutotuneOptions effective = *options;
+    if (!effective.max_queue_depth) effective.max_queue_depth = IO_AUTOTUNE_MAX_QUEUE_DEPTH;
+    effective.max_queue_depth = MIN(effective.max_queue_depth, IO_AUTOTUNE_MAX_QUEUE_DEPTH);
+    if (!effective.step_us) effective.step_us = IO_AUTOTUNE_STEP_US;
+    if (!effective.step_bytes) effective.step_bytes = IO_AUTOTUNE_STEP_BYTES;
+    if (!effective.budget_us) effective.budget_us = IO_AUTOTUNE_BUDGET_US;
+    if (effective.knee_fraction <= 0 || effective.knee_fraction > 1) {
+        effective.knee_fraction = IO_AUTOTUNE_KNEE_FRACTION;
+    }
+    job.options = &effective;
+
+    size_t sizes[IO_AUTOTUNE_MAX_SIZES];
+    guint size_count = candidate_sizes(&effective, (size_t)logical_block, result->max_transfer,
+                                       result->optimal_io_size, job.area_length, sizes);
+
+    gint64 start_us = monotonic_us();
+    gboolean ok = TRUE;
+    for (guint s = 0; s < size_count && ok; s++) {
+        double best_at_size = 0;
+        for (guint depth = 1; depth <= effective.max_queue_depth && ok; depth *= 2) {
+            if (result->sample_count == IO_AUTOTUNE_MAX_SAMPLES ||
+                monotonic_us() - start_us >= effective.budget_us) {
+                break;
+            }
+            IoAutotuneSample* sample = &result->samples[result->sample_count];
+            ok = measure(&job, sizes[s], depth, sample);
+            if (!ok) break;
+            result->sample_count++;
+            result->bytes_transferred += job.bytes;
+            // The device is saturated at this size
+            if (sample->bytes_per_second < best_at_size * IO_AUTOTUNE_DEPTH_GAIN) break;
+            best_at_size = sample->bytes_per_second;
+        }
+    }
+    result->elapsed_us = monotonic_us() - start_us;
+
+    if (!ok || result->sample_count == 0) {
+        if (job.failed) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                        "Autotune probe failed: %s", strerror(job.failed_errno));
+        } else if (options->cancel && *options->cancel) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Autotune cancelled");
+        } else {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                        "No block size fits the device's limits");
+        }
+        return FALSE;
+    }
+
+    // Knee: fewest bytes in flight among the candidates close to the best
+    for (guint i = 0; i < result->sample_count; i++) {
+        result->best_bytes_per_second = MAX(result->best_bytes_per_second,
+                                            result->samples[i].bytes_per_second);
+    }
+    const IoAutotuneSample* pick = NULL;
+    for (guint i = 0; i < result->sample_count; i++) {
+        const IoAutotuneSample* sample = &result->samples[i];
+        if (sample->bytes_per_second < result->best_bytes_per_second * effective.knee_fraction) continue;
+        uint64_t in_flight = (uint64_t)sample->block_size * sample->queue_depth;
+        if (!pick || in_flight < (uint64_t)pick->block_size * pick->queue_depth ||
+            (in_flight == (uint64_t)pick->block_size * pick->queue_depth &&
+             sample->bytes_per_second > pick->bytes_per_second)) {
+            pick = sample;
+        }
+    }
+    result->block_size = pick->block_size;
+    result->queue_depth = pick->queue_depth;
+    result->bytes_per_second = pick->bytes_per_second;
+    return TRUE;
+}
+
+// Cache
+
+typedef struct {
+    IoAutotuneMode mode;
+    size_t block_size;
+    guint queue_depth;
+    double bytes_per_second;
+    double best_bytes_per_second;
+    size_t max_transfer;
+    size_t optimal_io_size;
+} CacheEntry;
+
+struct IoAutotuneCache {
+    GMutex lock;
+    GHashTable* entries;      // "model\tfirmware\tmode" -> CacheEntry
+    char* path;
+};
+
+// Tabs and newlines would break the file format
+static char* cache_key(const char* model, const char* firmware, IoAutotuneMode mode) {
+    char* key = g_strdup_printf("%s\t%s\t%d", model, firmware ? firmware : "", (int)mode);
+    for (char* p = key; *p; p++) {
+        if (*p == '\n') *p = ' ';
+    }
+    return key;
+}
+
+static void cache_load(IoAutotuneCache* cache) {
+    FILE* f = fopen(cache->path, "r");
+    if (!f) return;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        // model, firmware, mode, block size, depth, rate, best rate, limits
+        gchar** fields = g_strsplit(line, "\t", 0);
+        if (g_strv_length(fields) == 9 && fields[0][0]) {
+            CacheEntry* entry = g_new0(CacheEntry, 1);
+            entry->mode = atoi(fields[2]) == IO_AUTOTUNE_WRITE ? IO_AUTOTUNE_WRITE : IO_AUTOTUNE_READ;
+            entry->block_size = (size_t)g_ascii_strtoull(fields[3], NULL, 10);
+            entry->queue_depth = (guint)g_ascii_strtoull(fields[4], NULL, 10);
+            entry->bytes_per_second = g_ascii_strtod(fields[5], NULL);
+            entry->best_bytes_per_second = g_ascii_strtod(fields[6], NULL);
+            entry->max_transfer = (size_t)g_ascii_strtoull(fields[7], NULL, 10);
+            entry->optimal_io_size = (size_t)g_ascii_strtoull(fields[8], NULL, 10);
+            if (entry->block_size && entry->queue_depth) {
+                g_hash_table_replace(cache->entries, cache_key(fields[0], fields[1], entry->mode), entry);
+            } else {
+                g_free(entry);
+            }
+        }
+        g_strfreev(fields);
+    }
+    fclose(f);
+}
+
+// Called with the lock held; written to a temporary file and renamed so a
+// crash never leaves half a cache
+static void cache_save(IoAutotuneCache* cache) {
+    char* temp = g_strdup_printf("%s.tmp", cache->path);
+    FILE* f = fopen(temp, "w");
+    if (!f) {
+        g_free(temp);
+        return;
+    }
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, cache->entries);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const CacheEntry* entry = value;
+        gchar** parts = g_strsplit(key, "\t", 3);
+        fprintf(f, "%s\t%s\t%d\t%llu\t%u\t%.0f\t%.0f\t%llu\t%llu\n",
+                parts[0], parts[1] ? parts[1] : "", (int)entry->mode,
+                (unsigned long long)entry->block_size, entry->queue_depth,
+                entry->bytes_per_second, entry->best_bytes_per_second,
+                (unsigned long long)entry->max_transfer, (unsigned long long)entry->optimal_io_size);
+        g_strfreev(parts);
+    }
+    gboolean ok = fclose(f) == 0;
+    if (!ok || rename(temp, cache->path) < 0) {
+        unlink(temp);
+    }
+    g_free(temp);
+}
+
+IoAutotuneCache* io_autotune_cache_new(const char* path) {
+    IoAutotuneCache* cache = g_new0(IoAutotuneCache, 1);
+    g_mutex_init(&cache->lock);
+    cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    if (path) {
+        cache->path = g_strdup(path);
+        cache_load(cache);
+    }
+    return cache;
+}
+
+void io_autotune_cache_free(IoAutotuneCache* cache) {
+    if (!cache) return;
+    g_hash_table_destroy(cache->entries);
+    g_mutex_clear(&cache->lock);
+    g_free(cache->path);
+    g_free(cache);
+}
+
+gboolean io_autotune_cache_lookup(IoAutotuneCache* cache,
+                                  const char* model,
+                                  const char* firmware,
+                                  IoAutotuneMode mode,
+                                  IoAutotuneResult* result) {
+    if (!cache || !model || !model[0]) return FALSE;
+    char* key = cache_key(model, firmware, mode);
+    g_mutex_lock(&cache->lock);
+    const CacheEntry* entry = g_hash_table_lookup(cache->entries, key);
+    if (entry) {
+        memset(result, 0, sizeof(*result));
+        result->mode = entry->mode;
+        result->block_size = entry->block_size;
+        result->queue_depth = entry->queue_depth;
+        result->bytes_per_second = entry->bytes_per_second;
+        result->best_bytes_per_second = entry->best_bytes_per_second;
+        result->max_transfer = entry->max_transfer;
+        result->optimal_io_size = entry->optimal_io_size;
+        result->cached = TRUE;
+    }
+    g_mutex_unlock(&cache->lock);
+    g_free(key);
+    return entry != NULL;
+}
+
+void io_autotune_cache_store(IoAutotuneCache* cache,
+                             const char* model,
+                             const char* firmware,
+                             const IoAutotuneResult* result) {
+    if (!cache || !model || !model[0] || result->cached) return;
+    CacheEntry* entry = g_new0(CacheEntry, 1);
+    entry->mode = result->mode;
+    entry->block_size = result->block_size;
+    entry->queue_depth = result->queue_depth;
+    entry->bytes_per_second = result->bytes_per_second;
+    entry->best_bytes_per_second = result->best_bytes_per_second;
+    entry->max_transfer = result->max_transfer;
+    entry->optimal_io_size = result->optimal_io_size;
+
+    g_mutex_lock(&cache->lock);
+    g_hash_table_replace(cache->entries, cache_key(model, firmware, result->mode), entry);
+    if (cache->path) cache_save(cache);
+    g_mutex_unlock(&cache->lock);
+}
+
+void io_autotune_cache_clear(IoAutotuneCache* cache) {
+    if (!cache) return;
+    g_mutex_lock(&cache->lock);
+    g_hash_table_remove_all(cache->entries);
+    if (cache->path) cache_save(cache);
+    g_mutex_unlock(&cache->lock);
+}
+
+FlValue* io_autotune_result_to_fl_value(const IoAutotuneResult* result) {
+    FlValue* map = fl_value_new_map();
+    fl_value_set_string_take(map, "mode",
+                             fl_value_new_string(result->mode == IO_AUTOTUNE_WRITE ? "write" : "read"));
+    fl_value_set_string_take(map, "blockSize", fl_value_new_int((int64_t)result->block_size));
+    fl_value_set_string_take(map, "queueDepth", fl_value_new_int(result->queue_depth));
+    fl_value_set_string_take(map, "bytesPerSecond", fl_value_new_float(result->bytes_per_second));
+    fl_value_set_string_take(map, "bestBytesPerSecond", fl_value_new_float(result->best_bytes_per_second));
+    fl_value_set_string_take(map, "maxTransfer", fl_value_new_int((int64_t)result->max_transfer));
+    fl_value_set_string_take(map, "optimalIoSize", fl_value_new_int((int64_t)result->optimal_io_size));
+    fl_value_set_string_take(map, "bytesTransferred", fl_value_new_int((int64_t)result->bytes_transferred));
+    fl_value_set_string_take(map, "elapsedUs", fl_value_new_int(result->elapsed_us));
+    fl_value_set_string_take(map, "cached", fl_value_new_bool(result->cached));
+
+    FlValue* samples = fl_value_new_list();
+    for (guint i = 0; i < result->sample_count; i++) {
+        const IoAutotuneSample* sample = &result->samples[i];
+        FlValue* item = fl_value_new_map();
+        fl_value_set_string_take(item, "blockSize", fl_value_new_int((int64_t)sample->block_size));
+        fl_value_set_string_take(item, "queueDepth", fl_value_new_int(sample->queue_depth));
+        fl_value_set_string_take(item, "bytesPerSecond", fl_value_new_float(sample->bytes_per_second));
+        fl_value_set_string_take(item, "meanLatencyUs", fl_value_new_int(sample->mean_latency_us));
+        fl_value_append_take(samples, item);
+    }
+    fl_value_set_string_take(map, "samples", samples);
+    return map;
+}
@@ -0,0 +1,130 @@
+#ifndef IO_AUTOTUNE_H
+#define IO_AUTOTUNE_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdint.h>
+#include "device_backend.h"
+
+G_BEGIN_DECLS
+
+#define IO_AUTOTUNE_MAX_SAMPLES 64
+#define IO_AUTOTUNE_MIN_BLOCK_SIZE (64u * 1024)
+#define IO_AUTOTUNE_MAX_BLOCK_SIZE (4u * 1024 * 1024)
+#define IO_AUTOTUNE_MAX_QUEUE_DEPTH 32
+// Time and bytes spent on each candidate, whichever runs out first
+#define IO_AUTOTUNE_STEP_US 60000
+#define IO_AUTOTUNE_STEP_BYTES (256ull * 1024 * 1024)
+// Candidates left when the whole probe has run this long are skipped
+#define IO_AUTOTUNE_BUDGET_US 3000000
+// The pick is the cheapest candidate within this fraction of the best
+#define IO_AUTOTUNE_KNEE_FRACTION 0.9
+
+typedef enum {
+    IO_AUTOTUNE_READ,         // read-only jobs: scans, hashing
+    IO_AUTOTUNE_WRITE,        // destructive jobs: overwrites the probe area
+} IoAutotuneMode;
+
+typedef struct {
+    size_t block_size;
+    guint queue_depth;
+    double bytes_per_second;
+    guint mean_latency_us;
+} IoAutotuneSample;
+
+typedef struct {
+    IoAutotuneMode mode;
+    uint64_t offset;                  // probe area; for writes, inside the target
+    uint64_t length;                  // 0 = up to 1 GiB from @offset
+    size_t min_block_size;            // 0 = IO_AUTOTUNE_MIN_BLOCK_SIZE
+    size_t max_block_size;            // 0 = IO_AUTOTUNE_MAX_BLOCK_SIZE
+    guint max_queue_depth;            // 0 = IO_AUTOTUNE_MAX_QUEUE_DEPTH
+    gint64 step_us;                   // 0 = IO_AUTOTUNE_STEP_US
+    uint64_t step_bytes;              // 0 = IO_AUTOTUNE_STEP_BYTES
+    gint64 budget_us;                 // 0 = IO_AUTOTUNE_BUDGET_US
+    double knee_fraction;             // 0 = IO_AUTOTUNE_KNEE_FRACTION
+    const DeviceBackend* backend;     // optional, NULL goes through the kernel
+    const volatile gint* cancel;
+} IoAutotuneOptions;
+
+typedef struct {
+    IoAutotuneMode mode;
+    size_t block_size;                // chosen transfer size
+    guint queue_depth;                // chosen number of requests in flight
+    double bytes_per_second;          // measured at the chosen point
+    double best_bytes_per_second;     // fastest candidate seen
+    size_t max_transfer;              // queue/max_hw_sectors_kb in bytes, 0 if unknown
+    size_t optimal_io_size;           // queue/optimal_io_size, 0 if not reported
+    uint64_t bytes_transferred;       // probe I/O, written bytes for IO_AUTOTUNE_WRITE
+    gint64 elapsed_us;
+    gboolean cached;                  // taken from the cache, nothing was probed
+    IoAutotuneSample samples[IO_AUTOTUNE_MAX_SAMPLES];
+    guint sample_count;
+} IoAutotuneResult;
+
+void io_autotune_default_options(IoAutotuneOptions* options);
+
+/**
+ * io_autotune_run:
+ * @fd: the device, opened O_DIRECT (and writable for IO_AUTOTUNE_WRITE)
+ *   through the options' backend
+ * @device: kernel name for the queue limits, NULL for image files
+ *
+ * Measures throughput for (block size, queue depth) pairs before a long
+ * operation. Block sizes are powers of two between the bounds, capped at
+ * the device's max_hw_sectors_kb so no request is split, plus
+ * optimal_io_size multiples when the device reports one. For each size the
+ * depth doubles until throughput stops improving by 5%. Every candidate
+ * gets @step_us or @step_bytes of sequential I/O through the probe area,
+ * which IO_AUTOTUNE_WRITE overwrites with zeros, and the sweep stops after
+ * @budget_us, so a probe costs a few seconds at most.
+ *
+ * The pick is the knee of the curve: of the candidates reaching
+ * @knee_fraction of the best throughput, the one with the fewest bytes in
+ * flight, which keeps latency and buffer memory down at little cost.
+ *
+ * Returns: TRUE with @result filled in, FALSE when cancelled or when the
+ *   probe I/O fails
+ */
+gboolean io_autotune_run(int fd,
+                         const char* device,
+                         const IoAutotuneOptions* options,
+                         IoAutotuneResult* result,
+                         GError** error);
+
+/**
+ * IoAutotuneCache:
+ *
+ * Tuning results keyed by drive model, firmware and mode, since drives of
+ * the same model and firmware behave alike. Optionally backed by a file
+ * that is rewritten on every store. Thread-safe.
+ */
+typedef struct IoAutotuneCache IoAutotuneCache;
+
+/**
+ * io_autotune_cache_new:
+ * @path: (nullable): file to load from and save to, NULL to keep the cache
+ *   in memory; a missing or unreadable file starts an empty cache
+ */
+IoAutotuneCache* io_autotune_cache_new(const char* path);
+void io_autotune_cache_free(IoAutotuneCache* cache);
+
+// Fills @result with the cached choice (samples are not kept) and sets cached
+gboolean io_autotune_cache_lookup(IoAutotuneCache* cache,
+                                  const char* model,
+                                  const char* firmware,
+                                  IoAutotuneMode mode,
+                                  IoAutotuneResult* result);
+
+// Drives without a model are not cached
+void io_autotune_cache_store(IoAutotuneCache* cache,
+                             const char* model,
+                             const char* firmware,
+                             const IoAutotuneResult* result);
+
+void io_autotune_cache_clear(IoAutotuneCache* cache);
+
+FlValue* io_autotune_result_to_fl_value(const IoAutotuneResult* result);
+
+G_END_DECLS
+
+#endif // IO_AUTOTUNE_H
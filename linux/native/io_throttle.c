@@ -0,0 +1,385 @@
+#include "io_throttle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+
+// Queue depth must improve throughput by this much to be kept
+#define QD_MIN_GAIN 0.03
+// Windows to wait on a plateau before probing a deeper queue again
+#define QD_PROBE_INTERVAL 20
+// Windows to hold after a thermal or error event before recovering
+#define ERROR_COOLDOWN_WINDOWS 5
+#define THERMAL_COOLDOWN_WINDOWS 3
+// Degrees below target before the rate limit is relaxed
+#define THERMAL_HYSTERESIS 3
+// Longest single sleep in io_throttle_acquire so cancel stays responsive
+#define ACQUIRE_SLICE_US 50000
+
+struct _IoThrottle {
+    IoThrottleConfig config;
+    pthread_mutex_t lock;
+
+    // Current control window
+    gint64 window_start_us;
+    uint64_t window_bytes;
+    uint64_t window_ios;
+    uint64_t window_errors;
+    gint64 window_latency_us;
+    int temperature;
+    int prev_temperature;
+
+    // Decision
+    guint queue_depth;
+    uint64_t rate_bps;
+
+    // Hill climbing over queue depth
+    double prev_throughput;
+    guint prev_queue_depth;
+    gboolean climbing;
+    guint plateau_windows;
+    guint cooldown_windows;
+    double thermal_ceiling_bps;     // throughput that last triggered thermal shaping
+
+    // Token bucket, may go negative ("debt") so large requests still pass
+    double tokens;
+    gint64 refill_us;
+
+    IoThrottleState state;
+};
+
+void io_throttle_default_config(IoThrottleConfig* config) {
+    config->temperature_target_celsius = 65;
+    config->temperature_critical_celsius = 75;
+    config->latency_target_ms = 250.0;
+    config->min_queue_depth = 1;
+    config->max_queue_depth = 16;
+    config->min_rate_bps = 8ull * 1024 * 1024;
+    config->max_rate_bps = 0;
+    config->window_ms = 1000;
+}
+
+static gint64 monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+IoThrottle* io_throttle_new(const IoThrottleConfig* config) {
+    IoThrottle* throttle = calloc(1, sizeof(IoThrottle));
+    if (!throttle) return NULL;
+
+    if (config) {
+        throttle->config = *config;
+    } else {
+        io_throttle_default_config(&throttle->config);
+    }
+    if (throttle->config.min_queue_depth == 0) throttle->config.min_queue_depth = 1;
+    if (throttle->config.max_queue_depth < throttle->config.min_queue_depth) {
+        throttle->config.max_queue_depth = throttle->config.min_queue_depth;
+    }
+    if (throttle->config.window_ms == 0) throttle->config.window_ms = 1000;
+
+    pthread_mutex_init(&throttle->lock, NULL);
+
+    throttle->temperature = IO_THROTTLE_TEMPERATURE_UNKNOWN;
+    throttle->prev_temperature = IO_THROTTLE_TEMPERATURE_UNKNOWN;
+    throttle->queue_depth = throttle->config.min_queue_depth;
+    throttle->rate_bps = throttle->config.max_rate_bps;
+    throttle->climbing = TRUE;
+    throttle->window_start_us = monotonic_us();
+    throttle->refill_us = throttle->window_start_us;
+
+    throttle->state.queue_depth = throttle->queue_depth;
+    throttle->state.rate_bps = throttle->rate_bps;
+    throttle->state.temperature_celsius = throttle->temperature;
+    throttle->state.reason = "initial";
+
+    return throttle;
+}
+
+void io_throttle_free(IoThrottle* throttle) {
+    if (!throttle) return;
+    pthread_mutex_destroy(&throttle->lock);
+    free(throttle);
+}
+
+void io_throttle_record_io(IoThrottle* throttle, uint64_t bytes,
+                           gint64 latency_us, gboolean failed) {
+    pthread_mutex_lock(&throttle->lock);
+    if (failed) {
+        throttle->window_errors++;
+    } else {
+        throttle->window_bytes += bytes;
+    }
+    throttle->window_ios++;
+    throttle->window_latency_us += latency_us;
+    pthread_mutex_unlock(&throttle->lock);
+}
+
+void io_throttle_set_temperature(IoThrottle* throttle, int celsius) {
+    pthread_mutex_lock(&throttle->lock);
+    throttle->temperature = celsius;
+    pthread_mutex_unlock(&throttle->lock);
+}
+
+static uint64_t clamp_rate(const IoThrottleConfig* config, double rate) {
+    if (rate < (double)config->min_rate_bps) rate = (double)config->min_rate_bps;
+    if (config->max_rate_bps && rate > (double)config->max_rate_bps) rate = (double)config->max_rate_bps;
+    return rate < 1.0 ? 1 : (uint64_t)rate;
+}
+
+// Adjust queue depth towards the knee of the throughput curve
+static const char* climb_queue_depth(IoThrottle* throttle, double throughput) {
+    const IoThrottleConfig* config = &throttle->config;
+    guint qd = throttle->queue_depth;
+
+    if (qd != throttle->prev_queue_depth && throttle->prev_throughput > 0) {
+        double gain = (throughput - throttle->prev_throughput) / throttle->prev_throughput;
+        if (qd > throttle->prev_queue_depth && gain < QD_MIN_GAIN) {
+            // Deeper queue did not pay off: go back and settle
+            throttle->queue_depth = throttle->prev_queue_depth;
+            throttle->prev_queue_depth = throttle->queue_depth;
+            throttle->prev_throughput = throughput;
+            throttle->climbing = FALSE;
+            throttle->plateau_windows = 0;
+            return "plateau";
+        }
+    }
+
+    throttle->prev_queue_depth = qd;
+    throttle->prev_throughput = throughput;
+
+    if (!throttle->climbing && ++throttle->plateau_windows >= QD_PROBE_INTERVAL) {
+        throttle->climbing = TRUE;
+    }
+
+    if (throttle->climbing && qd < config->max_queue_depth) {
+        throttle->queue_depth = qd + 1;
+        return "probe";
+    }
+    return "steady";
+}
+
+gboolean io_throttle_update(IoThrottle* throttle, gint64 now_us) {
+    const IoThrottleConfig* config = &throttle->config;
+
+    pthread_mutex_lock(&throttle->lock);
+
+    gint64 elapsed_us = now_us - throttle->window_start_us;
+    if (elapsed_us < (gint64)config->window_ms * 1000) {
+        pthread_mutex_unlock(&throttle->lock);
+        return FALSE;
+    }
+
+    double throughput = (double)throttle->window_bytes * 1e6 / (double)elapsed_us;
+    double avg_latency_ms = throttle->window_ios
+        ? (double)throttle->window_latency_us / (double)throttle->window_ios / 1000.0
+        : 0.0;
+    uint64_t errors = throttle->window_errors;
+    int temperature = throttle->temperature;
+    gboolean temperature_known = temperature != IO_THROTTLE_TEMPERATURE_UNKNOWN;
+    const char* reason;
+
+    if (errors > 0) {
+        // Enclosure resets and media errors: back off hard
+        throttle->queue_depth = MAX(config->min_queue_depth, throttle->queue_depth / 2);
+        throttle->rate_bps = clamp_rate(config, throughput * 0.5);
+        throttle->cooldown_windows = ERROR_COOLDOWN_WINDOWS;
+        throttle->climbing = FALSE;
+        throttle->prev_throughput = 0;
+        reason = "errors";
+    } else if (temperature_known && temperature >= config->temperature_critical_celsius) {
+        throttle->queue_depth = config->min_queue_depth;
+        throttle->thermal_ceiling_bps = throughput * 0.75;
+        throttle->rate_bps = clamp_rate(config, config->min_rate_bps ? 0 : throughput * 0.25);
+        throttle->cooldown_windows = THERMAL_COOLDOWN_WINDOWS;
+        throttle->climbing = FALSE;
+        throttle->prev_throughput = 0;
+        reason = "thermal-critical";
+    } else if (temperature_known && temperature >= config->temperature_target_celsius &&
+               throttle->prev_temperature != IO_THROTTLE_TEMPERATURE_UNKNOWN &&
+               temperature < throttle->prev_temperature) {
+        // Already cooling at the current rate: hold it instead of compounding
+        // the cut while the sensor lags behind
+        throttle->cooldown_windows = THERMAL_COOLDOWN_WINDOWS;
+        reason = "thermal-hold";
+    } else if (temperature_known && temperature >= config->temperature_target_celsius) {
+        // Shave 10% per degree over target off the sustained rate so the
+        // drive settles below its own throttling point
+        if (throttle->thermal_ceiling_bps == 0 || throughput < throttle->thermal_ceiling_bps) {
+            throttle->thermal_ceiling_bps = throughput;
+        }
+        double over = (double)(temperature - config->temperature_target_celsius + 1);
+        double factor = 1.0 - 0.1 * over;
+        if (factor < 0.3) factor = 0.3;
+        double base = throttle->rate_bps && throttle->rate_bps < throughput
+            ? (double)throttle->rate_bps : throughput;
+        throttle->rate_bps = clamp_rate(config, base * factor);
+        throttle->cooldown_windows = THERMAL_COOLDOWN_WINDOWS;
+        reason = "thermal";
+    } else if (throttle->cooldown_windows > 0) {
+        throttle->cooldown_windows--;
+        reason = "cooldown";
+    } else {
+        reason = NULL;
+
+        // Relax a rate limit once the drive has thermal headroom again
+        if (throttle->rate_bps != config->max_rate_bps &&
+            (!temperature_known ||
+             temperature <= config->temperature_target_celsius - THERMAL_HYSTERESIS)) {
+            // Multiplicative recovery far below the rate that last overheated
+            // the drive, additive close to it, so the controller settles just
+            // under the thermal knee instead of oscillating across it
+            double relaxed = (double)throttle->rate_bps * 1.25;
+            double ceiling = throttle->thermal_ceiling_bps;
+            if (ceiling > 0 && relaxed > ceiling * 0.9) {
+                relaxed = (double)throttle->rate_bps + ceiling * 0.02;
+                throttle->thermal_ceiling_bps = ceiling * 1.01;
+            }
+            if (!config->max_rate_bps && relaxed > throughput * 4 && throughput > 0) {
+                throttle->rate_bps = 0;
+            } else {
+                throttle->rate_bps = clamp_rate(config, relaxed);
+            }
+            reason = "recover";
+        }
+
+        if (avg_latency_ms > config->latency_target_ms &&
+            throttle->queue_depth > config->min_queue_depth) {
+            throttle->queue_depth--;
+            throttle->climbing = FALSE;
+            throttle->plateau_windows = 0;
+            throttle->prev_throughput = 0;
+            reason = "latency";
+        } else if (throttle->rate_bps == config->max_rate_bps) {
+            // Only hill-climb when the rate limit is not what bounds throughput
+            reason = climb_queue_depth(throttle, throughput);
+        } else if (!reason) {
+            reason = "steady";
+        }
+    }
+
+    throttle->prev_temperature = temperature;
+
+    throttle->state.queue_depth = throttle->queue_depth;
+    throttle->state.rate_bps = throttle->rate_bps;
+    throttle->state.throughput_bps = throughput;
+    throttle->state.avg_latency_ms = avg_latency_ms;
+    throttle->state.temperature_celsius = temperature;
+    throttle->state.errors = errors;
+    throttle->state.reason = reason;
+
+    throttle->window_start_us = now_us;
+    throttle->window_bytes = 0;
+    throttle->window_ios = 0;
+    throttle->window_errors = 0;
+    throttle->window_latency_us = 0;
+
+    pthread_mutex_unlock(&throttle->lock);
+    return TRUE;
+}
+
+gboolean io_throttle_acquire(IoThrottle* throttle, uint64_t bytes,
+                             const volatile gint* cancel) {
+    pthread_mutex_lock(&throttle->lock);
+
+    uint64_t rate = throttle->rate_bps;
+    if (rate == 0) {
+        pthread_mutex_unlock(&throttle->lock);
+        return TRUE;
+    }
+
+    // Refill, allowing at most 100ms of burst
+    gint64 now = monotonic_us();
+    double burst = (double)rate * 0.1;
+    throttle->tokens += (double)rate * (double)(now - throttle->refill_us) / 1e6;
+    if (throttle->tokens > burst) throttle->tokens = burst;
+    throttle->refill_us = now;
+
+    throttle->tokens -= (double)bytes;
+    double deficit = -throttle->tokens;
+    pthread_mutex_unlock(&throttle->lock);
+
+    if (deficit <= 0) return TRUE;
+
+    gint64 wait_us = (gint64)(deficit * 1e6 / (double)rate);
+    while (wait_us > 0) {
+        if (cancel && *cancel) return FALSE;
+        gint64 slice = wait_us < ACQUIRE_SLICE_US ? wait_us : ACQUIRE_SLICE_US;
+        struct timespec ts = { slice / 1000000, (slice % 1000000) * 1000 };
+        nanosleep(&ts, NULL);
+        wait_us -= slice;
+    }
+    return TRUE;
+}
+
+guint io_throttle_queue_depth(IoThrottle* throttle) {
+    pthread_mutex_lock(&throttle->lock);
+    guint qd = throttle->queue_depth;
+    pthread_mutex_unlock(&throttle->lock);
+    return qd;
+}
+
+void io_throttle_get_state(IoThrottle* throttle, IoThrottleState* state) {
+    pthread_mutex_lock(&throttle->lock);
+    *state = throttle->state;
+    pthread_mutex_unlock(&throttle->lock);
+}
+
+FlValue* io_throttle_state_to_fl_value(const IoThrottleState* state) {
+    FlValue* result = fl_value_new_map();
+    fl_value_set_string_take(result, "queueDepth", fl_value_new_int(state->queue_depth));
+    fl_value_set_string_take(result, "rateLimitBytesPerSecond", fl_value_new_int((int64_t)state->rate_bps));
+    fl_value_set_string_take(result, "throughputBytesPerSecond", fl_value_new_float(state->throughput_bps));
+    fl_value_set_string_take(result, "averageLatencyMs", fl_value_new_float(state->avg_latency_ms));
+    if (state->temperature_celsius != IO_THROTTLE_TEMPERATURE_UNKNOWN) {
+        fl_value_set_string_take(result, "temperatureCelsius", fl_value_new_int(state->temperature_celsius));
+    }
+    fl_value_set_string_take(result, "errors", fl_value_new_int((int64_t)state->errors));
+    fl_value_set_string_take(result, "reason", fl_value_new_string(state->reason ? state->reason : ""));
+    return result;
+}
+
+// Read temp1_input (millidegrees) from the first hwmon directory under @dir
+static int read_hwmon_dir(const char* dir_path) {
+    DIR* dir = opendir(dir_path);
+    if (!dir) return IO_THROTTLE_TEMPERATURE_UNKNOWN;
+
+    int result = IO_THROTTLE_TEMPERATURE_UNKNOWN;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "hwmon", 5) != 0 || entry->d_name[5] == '\0') continue;
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s/temp1_input", dir_path, entry->d_name);
+        FILE* f = fopen(path, "r");
+        if (!f) continue;
+
+        long millidegrees;
+        if (fscanf(f, "%ld", &millidegrees) == 1) {
+            result = (int)(millidegrees / 1000);
+        }
+        fclose(f);
+        if (result != IO_THROTTLE_TEMPERATURE_UNKNOWN) break;
+    }
+
+    closedir(dir);
+    return result;
+}
+
+int io_throttle_hwmon_temperature(void* ctx) {
+    const char* device_name = ctx;
+    char path[512];
+
+    // nvme: /sys/block/nvme0n1/device is the controller, hwmonN sits in it
+    snprintf(path, sizeof(path), "/sys/block/%s/device", device_name);
+    int temperature = read_hwmon_dir(path);
+    if (temperature != IO_THROTTLE_TEMPERATURE_UNKNOWN) return temperature;
+
+    // drivetemp: /sys/block/sda/device/hwmon/hwmonN
+    snprintf(path, sizeof(path), "/sys/block/%s/device/hwmon", device_name);
+    return read_hwmon_dir(path);
+}
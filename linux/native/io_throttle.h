@@ -0,0 +1,101 @@
+#ifndef IO_THROTTLE_H
+#define IO_THROTTLE_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+#define IO_THROTTLE_TEMPERATURE_UNKNOWN (-274)
+
+typedef struct {
+    int temperature_target_celsius;   // start shaping the rate above this
+    int temperature_critical_celsius; // drop to the minimum rate above this
+    double latency_target_ms;         // per-request completion time budget
+    guint min_queue_depth;
+    guint max_queue_depth;
+    uint64_t min_rate_bps;            // floor while throttled
+    uint64_t max_rate_bps;            // 0 = unlimited
+    guint window_ms;                  // control interval
+} IoThrottleConfig;
+
+typedef struct {
+    guint queue_depth;
+    uint64_t rate_bps;                // 0 = unlimited
+    double throughput_bps;            // measured over the last window
+    double avg_latency_ms;
+    int temperature_celsius;
+    uint64_t errors;                  // errors seen in the last window
+    const char* reason;               // static string naming the last action
+} IoThrottleState;
+
+typedef struct _IoThrottle IoThrottle;
+
+/**
+ * IoTemperatureSource:
+ *
+ * Returns the current device temperature in degrees Celsius, or
+ * IO_THROTTLE_TEMPERATURE_UNKNOWN.
+ */
+typedef int (*IoTemperatureSource)(void* ctx);
+
+void io_throttle_default_config(IoThrottleConfig* config);
+
+/**
+ * io_throttle_new:
+ *
+ * Creates a feedback controller that adjusts queue depth and write rate for
+ * one device. Queue depth is hill-climbed towards the knee of the throughput
+ * curve; thermal headroom, latency and errors pull it back.
+ *
+ * Returns: (transfer full): free with io_throttle_free()
+ */
+IoThrottle* io_throttle_new(const IoThrottleConfig* config);
+void io_throttle_free(IoThrottle* throttle);
+
+/**
+ * io_throttle_record_io:
+ *
+ * Records one completed request. Safe to call from any I/O worker.
+ */
+void io_throttle_record_io(IoThrottle* throttle, uint64_t bytes,
+                           gint64 latency_us, gboolean failed);
+
+void io_throttle_set_temperature(IoThrottle* throttle, int celsius);
+
+/**
+ * io_throttle_update:
+ * @now_us: monotonic time
+ *
+ * Closes the current control window when it has elapsed and computes the
+ * next queue depth and rate.
+ *
+ * Returns: TRUE when a window was evaluated
+ */
+gboolean io_throttle_update(IoThrottle* throttle, gint64 now_us);
+
+/**
+ * io_throttle_acquire:
+ *
+ * Blocks until @bytes may be issued under the current rate limit.
+ * Returns early with FALSE if @cancel becomes non-zero.
+ */
+gboolean io_throttle_acquire(IoThrottle* throttle, uint64_t bytes,
+                             const volatile gint* cancel);
+
+guint io_throttle_queue_depth(IoThrottle* throttle);
+void io_throttle_get_state(IoThrottle* throttle, IoThrottleState* state);
+FlValue* io_throttle_state_to_fl_value(const IoThrottleState* state);
+
+/**
+ * io_throttle_hwmon_temperature:
+ * @ctx: block device name (e.g. "nvme0n1"), passed as const char*
+ *
+ * IoTemperatureSource reading the hwmon sensor exposed under
+ * /sys/block/X/device (nvme and drivetemp drivers).
+ */
+int io_throttle_hwmon_temperature(void* ctx);
+
+G_END_DECLS
+
+#endif // IO_THROTTLE_H
@@ -0,0 +1,565 @@
+#define _GNU_SOURCE
+#include "luks_erase.h"
+#include "bulk_io.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/random.h>
+#include <linux/fs.h>
+
+#define LUKS_MAGIC_LENGTH 6
+#define LUKS_SECTOR_SIZE 512
+#define LUKS_ALIGN 4096
+#define LUKS_ERASE_BUFFER_SIZE (1024 * 1024)
+
+// LUKS1 phdr, big-endian
+#define LUKS1_PAYLOAD_OFFSET 104
+#define LUKS1_KEY_BYTES 108
+#define LUKS1_UUID 168
+#define LUKS1_KEYSLOTS 208
+#define LUKS1_KEYSLOT_SIZE 48
+#define LUKS1_NUM_KEYS 8
+#define LUKS1_HEADER_SIZE (LUKS1_KEYSLOTS + LUKS1_NUM_KEYS * LUKS1_KEYSLOT_SIZE)
+#define LUKS1_KEY_ENABLED 0x00AC71F3u
+
+// LUKS2 binary header, big-endian
+#define LUKS2_BINARY_SIZE 4096
+#define LUKS2_HDR_SIZE 8
+#define LUKS2_UUID 168
+#define LUKS2_HDR_OFFSET 256
+#define LUKS2_MIN_HDR_SIZE (16 * 1024)
+#define LUKS2_MAX_HDR_SIZE (4 * 1024 * 1024)
+#define LUKS2_MAX_KEYSLOTS 32
+
+static const uint8_t LUKS_MAGIC[LUKS_MAGIC_LENGTH] = {'L', 'U', 'K', 'S', 0xba, 0xbe};
+static const uint8_t LUKS2_SECONDARY_MAGIC[LUKS_MAGIC_LENGTH] = {'S', 'K', 'U', 'L', 0xba, 0xbe};
+
+static uint16_t be16(const uint8_t* p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t be32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint64_t be64(const uint8_t* p) {
+    return (uint64_t)be32(p) << 32 | be32(p + 4);
+}
+
+static uint64_t round_up(uint64_t value, uint64_t align) {
+    return (value + align - 1) / align * align;
+}
+
+static gboolean read_exact(int fd, void* buffer, size_t size, uint64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, (uint8_t*)buffer + done, size - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return FALSE;
+        done += (size_t)n;
+    }
+    return TRUE;
+}
+
+static void add_region(LuksLayout* layout,
+                       LuksRegionKind kind,
+                       int keyslot,
+                       uint64_t offset,
+                       uint64_t length) {
+    if (length == 0 || layout->region_count >= LUKS_MAX_REGIONS) return;
+    LuksRegion* region = &layout->regions[layout->region_count++];
+    region->kind = kind;
+    region->keyslot = keyslot;
+    region->offset = offset;
+    region->length = length;
+}
+
+static void copy_uuid(char* dest, const uint8_t* src) {
+    memcpy(dest, src, 39);
+    dest[39] = '\0';
+}
+
+// LUKS1
+
+static gboolean parse_luks1(const uint8_t* phdr, LuksLayout* layout) {
+    uint64_t payload = (uint64_t)be32(phdr + LUKS1_PAYLOAD_OFFSET) * LUKS_SECTOR_SIZE;
+    uint32_t key_bytes = be32(phdr + LUKS1_KEY_BYTES);
+    if (key_bytes == 0 || key_bytes > 512) return FALSE;
+
+    layout->version = 1;
+    layout->payload_offset = payload;
+    copy_uuid(layout->uuid, phdr + LUKS1_UUID);
+
+    // The phdr ends before the first keyslot; round it up to a page unless
+    // a keyslot starts earlier (old, sector-aligned layouts)
+    uint64_t header_end = LUKS_ALIGN;
+    for (int i = 0; i < LUKS1_NUM_KEYS; i++) {
+        const uint8_t* slot = phdr + LUKS1_KEYSLOTS + i * LUKS1_KEYSLOT_SIZE;
+        uint64_t offset = (uint64_t)be32(slot + 40) * LUKS_SECTOR_SIZE;
+        if (offset >= LUKS1_HEADER_SIZE && offset < header_end) header_end = offset;
+    }
+    add_region(layout, LUKS_REGION_HEADER, -1, 0, header_end);
+
+    // Disabled slots are erased too: a slot killed by an old or crashed
+    // tool may still hold its split key material
+    for (int i = 0; i < LUKS1_NUM_KEYS; i++) {
+        const uint8_t* slot = phdr + LUKS1_KEYSLOTS + i * LUKS1_KEYSLOT_SIZE;
+        uint32_t active = be32(slot);
+        uint64_t offset = (uint64_t)be32(slot + 40) * LUKS_SECTOR_SIZE;
+        uint32_t stripes = be32(slot + 44);
+        if (active == LUKS1_KEY_ENABLED) layout->active_keyslots++;
+        if (offset < LUKS1_HEADER_SIZE || stripes == 0 || stripes > 65536) continue;
+
+        uint64_t length = round_up((uint64_t)key_bytes * stripes, LUKS_ALIGN);
+        if (payload > offset && offset + length > payload) length = payload - offset;
+        add_region(layout, LUKS_REGION_KEYSLOT, i, offset, length);
+    }
+    return TRUE;
+}
+
+// LUKS2 JSON metadata
+//
+// A minimal recursive-descent walker: LUKS2 metadata is small, machine
+// written and only a handful of values matter, all found by their key path.
+
+#define JSON_MAX_DEPTH 16
+#define JSON_PATH_DEPTH 4
+
+typedef struct {
+    const char* p;
+    const char* end;
+    const char* keys[JSON_PATH_DEPTH];
+    size_t key_lengths[JSON_PATH_DEPTH];
+    int depth;
+    // Collected values
+    uint64_t area_offset[LUKS2_MAX_KEYSLOTS];
+    uint64_t area_size[LUKS2_MAX_KEYSLOTS];
+    gboolean keyslot_seen[LUKS2_MAX_KEYSLOTS];
+    uint64_t keyslots_size;
+    uint64_t payload_offset;
+} JsonWalk;
+
+static gboolean key_is(const JsonWalk* walk, int level, const char* name) {
+    return walk->depth > level && walk->key_lengths[level] == strlen(name) &&
+           memcmp(walk->keys[level], name, walk->key_lengths[level]) == 0;
+}
+
+// Keyslot number of keys[1] below "keyslots", or -1
+static int keyslot_index(const JsonWalk* walk) {
+    if (!key_is(walk, 0, "keyslots") || walk->depth < 2) return -1;
+    int index = 0;
+    for (size_t i = 0; i < walk->key_lengths[1]; i++) {
+        char c = walk->keys[1][i];
+        if (c < '0' || c > '9') return -1;
+        index = index * 10 + (c - '0');
+        if (index >= LUKS2_MAX_KEYSLOTS) return -1;
+    }
+    return walk->key_lengths[1] > 0 ? index : -1;
+}
+
+static gboolean parse_u64(const char* text, size_t length, uint64_t* value) {
+    uint64_t result = 0;
+    if (length == 0 || length > 19) return FALSE;
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] < '0' || text[i] > '9') return FALSE;
+        result = result * 10 + (uint64_t)(text[i] - '0');
+    }
+    *value = result;
+    return TRUE;
+}
+
+static void skip_space(JsonWalk* walk) {
+    while (walk->p < walk->end &&
+           (*walk->p == ' ' || *walk->p == '\t' || *walk->p == '\n' || *walk->p == '\r')) {
+        walk->p++;
+    }
+}
+
+// Returns the raw contents of a string; escapes are skipped, not decoded
+static gboolean json_string(JsonWalk* walk, const char** text, size_t* length) {
+    if (walk->p >= walk->end || *walk->p != '"') return FALSE;
+    const char* start = ++walk->p;
+    while (walk->p < walk->end && *walk->p != '"') {
+        if (*walk->p == '\\') walk->p++;
+        walk->p++;
+    }
+    if (walk->p >= walk->end) return FALSE;
+    *text = start;
+    *length = (size_t)(walk->p - start);
+    walk->p++;
+    return TRUE;
+}
+
+static void json_scalar(JsonWalk* walk, const char* text, size_t length) {
+    uint64_t value;
+    if (!parse_u64(text, length, &value)) return;
+
+    int slot = keyslot_index(walk);
+    if (slot >= 0 && walk->depth == 4 && key_is(walk, 2, "area")) {
+        if (key_is(walk, 3, "offset")) walk->area_offset[slot] = value;
+        if (key_is(walk, 3, "size")) walk->area_size[slot] = value;
+    } else if (walk->depth == 2 && key_is(walk, 0, "config") && key_is(walk, 1, "keyslots_size")) {
+        walk->keyslots_size = value;
+    } else if (walk->depth == 3 && key_is(walk, 0, "segments") && key_is(walk, 2, "offset")) {
+        if (walk->payload_offset == 0 || value < walk->payload_offset) walk->payload_offset = value;
+    }
+}
+
+static gboolean json_value(JsonWalk* walk, int nesting);
+
+static gboolean json_object(JsonWalk* walk, int nesting) {
+    walk->p++;
+    skip_space(walk);
+    if (walk->p < walk->end && *walk->p == '}') {
+        walk->p++;
+        return TRUE;
+    }
+    for (;;) {
+        const char* key;
+        size_t key_length;
+        skip_space(walk);
+        if (!json_string(walk, &key, &key_length)) return FALSE;
+        skip_space(walk);
+        if (walk->p >= walk->end || *walk->p != ':') return FALSE;
+        walk->p++;
+        skip_space(walk);
+
+        int saved_depth = walk->depth;
+        if (walk->depth < JSON_PATH_DEPTH) {
+            walk->keys[walk->depth] = key;
+            walk->key_lengths[walk->depth] = key_length;
+        }
+        walk->depth++;
+        int slot = keyslot_index(walk);
+        if (slot >= 0 && walk->depth == 2) walk->keyslot_seen[slot] = TRUE;
+        gboolean ok = json_value(walk, nesting + 1);
+        walk->depth = saved_depth;
+        if (!ok) return FALSE;
+
+        skip_space(walk);
+        if (walk->p >= walk->end) return FALSE;
+        if (*walk->p == '}') {
+            walk->p++;
+            return TRUE;
+        }
+        if (*walk->p != ',') return FALSE;
+        walk->p++;
+    }
+}
+
+static gboolean json_array(JsonWalk* walk, int nesting) {
+    walk->p++;
+    skip_space(walk);
+    if (walk->p < walk->end && *walk->p == ']') {
+        walk->p++;
+        return TRUE;
+    }
+    for (;;) {
+        // Array elements are not addressed by path
+        int saved_depth = walk->depth;
+        walk->depth = JSON_PATH_DEPTH + 1;
+        gboolean ok = json_value(walk, nesting + 1);
+        walk->depth = saved_depth;
+        if (!ok) return FALSE;
+
+        skip_space(walk);
+        if (walk->p >= walk->end) return FALSE;
+        if (*walk->p == ']') {
+            walk->p++;
+            return TRUE;
+        }
+        if (*walk->p != ',') return FALSE;
+        walk->p++;
+        skip_space(walk);
+    }
+}
+
+static gboolean json_value(JsonWalk* walk, int nesting) {
+    if (nesting > JSON_MAX_DEPTH || walk->p >= walk->end) return FALSE;
+    switch (*walk->p) {
+    case '{':
+        return json_object(walk, nesting);
+    case '[':
+        return json_array(walk, nesting);
+    case '"': {
+        const char* text;
+        size_t length;
+        if (!json_string(walk, &text, &length)) return FALSE;
+        json_scalar(walk, text, length);
+        return TRUE;
+    }
+    default: {
+        // Numbers, true, false, null
+        const char* start = walk->p;
+        while (walk->p < walk->end && strchr("+-.0123456789eEtrufalsn", *walk->p)) walk->p++;
+        if (walk->p == start) return FALSE;
+        json_scalar(walk, start, (size_t)(walk->p - start));
+        return TRUE;
+    }
+    }
+}
+
+// Reads the JSON area of the binary header at @offset
+static gboolean parse_luks2_json(int fd, uint64_t offset, uint64_t hdr_size, JsonWalk* walk) {
+    size_t size = (size_t)(hdr_size - LUKS2_BINARY_SIZE);
+    char* json = g_malloc(size);
+    gboolean ok = FALSE;
+    if (read_exact(fd, json, size, offset + LUKS2_BINARY_SIZE)) {
+        // The area is NUL-padded after the document
+        const char* end = memchr(json, '\0', size);
+        memset(walk, 0, sizeof(*walk));
+        walk->p = json;
+        walk->end = end ? end : json + size;
+        skip_space(walk);
+        ok = walk->p < walk->end && *walk->p == '{' && json_value(walk, 0);
+    }
+    g_free(json);
+    return ok;
+}
+
+static gboolean valid_hdr_size(uint64_t size) {
+    return size >= LUKS2_MIN_HDR_SIZE && size <= LUKS2_MAX_HDR_SIZE && (size & (size - 1)) == 0;
+}
+
+// A secondary header sits right after the primary area, at one of the
+// power-of-two offsets a hdr_size may take, and records its own offset
+static gboolean find_secondary(int fd, uint64_t* offset, uint8_t* binary) {
+    for (uint64_t candidate = LUKS2_MIN_HDR_SIZE; candidate <= LUKS2_MAX_HDR_SIZE; candidate <<= 1) {
+        if (!read_exact(fd, binary, LUKS2_BINARY_SIZE, candidate)) return FALSE;
+        if (memcmp(binary, LUKS2_SECONDARY_MAGIC, LUKS_MAGIC_LENGTH) == 0 && be16(binary + 6) == 2 &&
+            be64(binary + LUKS2_HDR_OFFSET) == candidate && be64(binary + LUKS2_HDR_SIZE) == candidate) {
+            *offset = candidate;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static gboolean parse_luks2(int fd, const uint8_t* primary, LuksLayout* layout) {
+    uint8_t* secondary = g_malloc(LUKS2_BINARY_SIZE);
+    uint64_t hdr_size = 0;
+    uint64_t secondary_offset = 0;
+    gboolean have_primary = primary != NULL && valid_hdr_size(be64(primary + LUKS2_HDR_SIZE));
+    gboolean have_secondary = FALSE;
+
+    if (have_primary) {
+        hdr_size = be64(primary + LUKS2_HDR_SIZE);
+        have_secondary = read_exact(fd, secondary, LUKS2_BINARY_SIZE, hdr_size) &&
+                         memcmp(secondary, LUKS2_SECONDARY_MAGIC, LUKS_MAGIC_LENGTH) == 0;
+        secondary_offset = hdr_size;
+    } else if (find_secondary(fd, &secondary_offset, secondary)) {
+        have_secondary = TRUE;
+        hdr_size = secondary_offset;
+    }
+    if (hdr_size == 0) {
+        g_free(secondary);
+        return FALSE;
+    }
+
+    layout->version = 2;
+    layout->header_size = hdr_size;
+    copy_uuid(layout->uuid, have_primary ? primary + LUKS2_UUID : secondary + LUKS2_UUID);
+    add_region(layout, LUKS_REGION_HEADER, -1, 0, hdr_size);
+    add_region(layout, LUKS_REGION_SECONDARY, -1, hdr_size, hdr_size);
+
+    // Either copy of the metadata will do; the primary is tried first
+    JsonWalk* walk = g_new0(JsonWalk, 1);
+    gboolean have_json = (have_primary && parse_luks2_json(fd, 0, hdr_size, walk)) ||
+                         (have_secondary && parse_luks2_json(fd, secondary_offset, hdr_size, walk));
+    if (have_json) {
+        layout->payload_offset = walk->payload_offset;
+        for (int i = 0; i < LUKS2_MAX_KEYSLOTS; i++) {
+            if (walk->keyslot_seen[i]) layout->active_keyslots++;
+            add_region(layout, LUKS_REGION_KEYSLOT, i, walk->area_offset[i], walk->area_size[i]);
+        }
+        // The area as a whole also covers slots that were removed from the
+        // metadata but never overwritten
+        add_region(layout, LUKS_REGION_KEYSLOTS, -1, 2 * hdr_size, walk->keyslots_size);
+    }
+    g_free(walk);
+    g_free(secondary);
+    return TRUE;
+}
+
+gboolean luks_read_layout(int fd, LuksLayout* layout, GError** error) {
+    memset(layout, 0, sizeof(*layout));
+
+    uint8_t* header = g_malloc(LUKS2_BINARY_SIZE);
+    gboolean found = FALSE;
+    if (read_exact(fd, header, LUKS2_BINARY_SIZE, 0)) {
+        if (memcmp(header, LUKS_MAGIC, LUKS_MAGIC_LENGTH) == 0) {
+            uint16_t version = be16(header + 6);
+            if (version == 1) {
+                found = parse_luks1(header, layout);
+            } else if (version == 2) {
+                found = parse_luks2(fd, header, layout);
+            }
+        } else {
+            // Primary LUKS2 header gone; the secondary still unlocks
+            found = parse_luks2(fd, NULL, layout);
+        }
+    }
+    g_free(header);
+
+    if (!found) {
+        memset(layout, 0, sizeof(*layout));
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No LUKS header found");
+    }
+    return found;
+}
+
+static int compare_regions(const void* a, const void* b) {
+    const LuksRegion* left = a;
+    const LuksRegion* right = b;
+    return left->offset < right->offset ? -1 : left->offset > right->offset;
+}
+
+// Sorted, merged copy of the layout so each byte is written once
+static guint plan_writes(const LuksLayout* layout, LuksRegion* plan) {
+    memcpy(plan, layout->regions, layout->region_count * sizeof(LuksRegion));
+    qsort(plan, layout->region_count, sizeof(LuksRegion), compare_regions);
+
+    guint count = 0;
+    for (guint i = 0; i < layout->region_count; i++) {
+        if (count > 0 && plan[i].offset <= plan[count - 1].offset + plan[count - 1].length) {
+            uint64_t end = plan[i].offset + plan[i].length;
+            uint64_t last_end = plan[count - 1].offset + plan[count - 1].length;
+            if (end > last_end) plan[count - 1].length = end - plan[count - 1].offset;
+        } else {
+            plan[count++] = plan[i];
+        }
+    }
+    return count;
+}
+
+static gboolean fill_random(uint8_t* buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = getrandom(buffer + done, size - done, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return FALSE;
+        done += (size_t)n;
+    }
+    return TRUE;
+}
+
+static gboolean write_region(int fd, const LuksRegion* region, uint8_t* buffer,
+                             uint64_t* written, GError** error) {
+    uint64_t done = 0;
+    while (done < region->length) {
+        size_t chunk = (size_t)MIN(region->length - done, LUKS_ERASE_BUFFER_SIZE);
+        if (!fill_random(buffer, chunk)) {
+            int saved = errno;
+            g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                        "Cannot read random data: %s", g_strerror(saved));
+            return FALSE;
+        }
+        size_t chunk_done = 0;
+        while (chunk_done < chunk) {
+            ssize_t n = pwrite(fd, buffer + chunk_done, chunk - chunk_done,
+                               (off_t)(region->offset + done + chunk_done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                int saved = n < 0 ? errno : ENOSPC;
+                g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                            "Write at offset %llu failed: %s",
+                            (unsigned long long)(region->offset + done + chunk_done),
+                            g_strerror(saved));
+                return FALSE;
+            }
+            chunk_done += (size_t)n;
+            *written += (uint64_t)n;
+        }
+        done += chunk;
+    }
+    return TRUE;
+}
+
+gboolean luks_crypto_erase(int fd, LuksEraseResult* result, GError** error) {
+    memset(result, 0, sizeof(*result));
+    gint64 start = g_get_monotonic_time();
+
+    if (!luks_read_layout(fd, &result->layout, error)) return FALSE;
+
+    uint64_t device_size = 0;
+    if (!bulk_io_device_size(fd, &device_size)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to get device size");
+        return FALSE;
+    }
+    const LuksLayout* layout = &result->layout;
+    for (guint i = 0; i < layout->region_count; i++) {
+        if (layout->regions[i].offset + layout->regions[i].length > device_size) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "LUKS region at offset %llu lies beyond the device end",
+                        (unsigned long long)layout->regions[i].offset);
+            return FALSE;
+        }
+    }
+
+    LuksRegion plan[LUKS_MAX_REGIONS];
+    guint plan_count = plan_writes(layout, plan);
+    uint8_t* buffer = g_malloc(LUKS_ERASE_BUFFER_SIZE);
+    gboolean ok = TRUE;
+    for (guint i = 0; i < plan_count && ok; i++) {
+        ok = write_region(fd, &plan[i], buffer, &result->bytes_written, error);
+    }
+    g_free(buffer);
+    if (!ok) return FALSE;
+
+    if (fdatasync(fd) < 0) {
+        int saved = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Flush failed: %s", g_strerror(saved));
+        return FALSE;
+    }
+
+    // Drop cached pages so verification reads what reached the device
+    if (ioctl(fd, BLKFLSBUF, 0) < 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    LuksLayout remaining;
+    result->verified = !luks_read_layout(fd, &remaining, NULL);
+    result->elapsed_us = g_get_monotonic_time() - start;
+
+    if (!result->verified) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                    "A LUKS header is still readable after the erase");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static const char* region_kind_name(LuksRegionKind kind) {
+    switch (kind) {
+    case LUKS_REGION_HEADER: return "header";
+    case LUKS_REGION_SECONDARY: return "secondaryHeader";
+    case LUKS_REGION_KEYSLOT: return "keyslot";
+    case LUKS_REGION_KEYSLOTS: return "keyslotsArea";
+    }
+    return "unknown";
+}
+
+FlValue* luks_layout_to_fl_value(const LuksLayout* layout) {
+    FlValue* value = fl_value_new_map();
+    fl_value_set_string_take(value, "version", fl_value_new_int(layout->version));
+    fl_value_set_string_take(value, "uuid", fl_value_new_string(layout->uuid));
+    fl_value_set_string_take(value, "headerSize", fl_value_new_int((int64_t)layout->header_size));
+    fl_value_set_string_take(value, "payloadOffset", fl_value_new_int((int64_t)layout->payload_offset));
+    fl_value_set_string_take(value, "activeKeyslots", fl_value_new_int(layout->active_keyslots));
+
+    FlValue* regions = fl_value_new_list();
+    for (guint i = 0; i < layout->region_count; i++) {
+        const LuksRegion* region = &layout->regions[i];
+        FlValue* entry = fl_value_new_map();
+        fl_value_set_string_take(entry, "kind", fl_value_new_string(region_kind_name(region->kind)));
+        fl_value_set_string_take(entry, "keyslot", fl_value_new_int(region->keyslot));
+        fl_value_set_string_take(entry, "offset", fl_value_new_int((int64_t)region->offset));
+        fl_value_set_string_take(entry, "length", fl_value_new_int((int64_t)region->length));
+        fl_value_append_take(regions, entry);
+    }
+    fl_value_set_string_take(value, "regions", regions);
+    return value;
+}
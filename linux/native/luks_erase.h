@@ -0,0 +1,81 @@
+#ifndef LUKS_ERASE_H
+#define LUKS_ERASE_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Cryptographic erase of LUKS volumes.
+ *
+ * Everything needed to recover the volume key of a LUKS device lives in its
+ * headers and keyslot areas, a few MiB at the start of the device. Destroying
+ * exactly those regions leaves the payload as ciphertext under a key that no
+ * longer exists anywhere, which takes milliseconds instead of a full-device
+ * overwrite.
+ */
+
+#define LUKS_MAX_REGIONS 48
+
+typedef enum {
+    LUKS_REGION_HEADER = 0,   // LUKS1 phdr or LUKS2 primary binary header + JSON
+    LUKS_REGION_SECONDARY,    // LUKS2 secondary binary header + JSON
+    LUKS_REGION_KEYSLOT,      // anti-forensic split key material of one keyslot
+    LUKS_REGION_KEYSLOTS,     // the whole LUKS2 keyslots area, used or not
+} LuksRegionKind;
+
+typedef struct {
+    LuksRegionKind kind;
+    int keyslot;              // keyslot number, -1 for header regions
+    uint64_t offset;          // byte offset from the start of the device
+    uint64_t length;
+} LuksRegion;
+
+typedef struct {
+    int version;              // 1 or 2
+    char uuid[40];
+    uint64_t header_size;     // LUKS2 hdr_size (binary header + JSON area)
+    uint64_t payload_offset;  // first byte of encrypted data, 0 if unknown
+    guint active_keyslots;
+    LuksRegion regions[LUKS_MAX_REGIONS];
+    guint region_count;
+} LuksLayout;
+
+typedef struct {
+    LuksLayout layout;
+    uint64_t bytes_written;
+    gint64 elapsed_us;
+    gboolean verified;        // no LUKS header parses after the erase
+} LuksEraseResult;
+
+/**
+ * luks_read_layout:
+ * @fd: open device or image file
+ *
+ * Parses the LUKS1 or LUKS2 header of @fd. For LUKS2 the secondary header
+ * is also found when the primary one is already damaged, so a partially
+ * erased volume can still be finished off.
+ *
+ * Returns: TRUE with @layout filled in, or FALSE with G_IO_ERROR_NOT_FOUND
+ *   when @fd carries no LUKS header
+ */
+gboolean luks_read_layout(int fd, LuksLayout* layout, GError** error);
+
+/**
+ * luks_crypto_erase:
+ * @fd: device opened read-write; it must not be unlocked, or the kernel
+ *   still holds the volume key
+ *
+ * Overwrites every region of the layout with random data, flushes the
+ * device and re-reads it to confirm that no LUKS header remains.
+ *
+ * Returns: TRUE when all regions were written and verified
+ */
+gboolean luks_crypto_erase(int fd, LuksEraseResult* result, GError** error);
+
+FlValue* luks_layout_to_fl_value(const LuksLayout* layout);
+
+G_END_DECLS
+
+#endif // LUKS_ERASE_H
@@ -0,0 +1,338 @@
+#define _GNU_SOURCE
+#include "main_dispatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+typedef struct {
+    gconstpointer key;
+    MainDispatchFunc func;
+    gpointer data;
+    GDestroyNotify destroy;
+} Message;
+
+// Bounded MPSC ring after Vyukov: a slot is free for the producer that
+// claims position p when its sequence equals p, and holds a message for
+// the consumer once the producer has stored p + 1
+typedef struct {
+    guint64 sequence;           // atomic
+    Message message;
+} Slot;
+
+struct _MainDispatch {
+    GSource source;
+    gpointer owner;
+    int event_fd;
+    gpointer fd_tag;
+    Slot* slots;
+    guint64 mask;
+    Message* batch;             // consumer scratch, capacity entries
+    GHashTable* newest;         // key -> index of its newest message in a batch
+
+    char pad0[64];              // keep producers' and the consumer's lines apart
+    guint64 enqueue_pos;        // atomic, producers
+    char pad1[64];
+    guint64 dequeue_pos;        // consumer_lock
+    gint wakeup_pending;        // atomic; the eventfd has been written since the last drain
+    gint overflowing;           // atomic; producers append to @overflow while set
+    gint closed;                // atomic
+
+    pthread_mutex_t overflow_lock;
+    GQueue overflow;            // Message*, FIFO
+    pthread_mutex_t consumer_lock;  // the main loop and close() both drain
+
+    MainDispatchStats stats;    // atomic counters
+};
+
+static void stat_add(guint64* counter, guint64 value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static void message_discard(MainDispatch* dispatch, Message* message) {
+    if (message->destroy) message->destroy(message->data);
+    stat_add(&dispatch->stats.discarded, 1);
+}
+
+static gboolean ring_push(MainDispatch* dispatch, const Message* message) {
+    guint64 pos = __atomic_load_n(&dispatch->enqueue_pos, __ATOMIC_RELAXED);
+    Slot* slot;
+    for (;;) {
+        slot = &dispatch->slots[pos & dispatch->mask];
+        guint64 sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        gint64 diff = (gint64)(sequence - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&dispatch->enqueue_pos, &pos, pos + 1, TRUE,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return FALSE;   // full: the consumer has not freed this lap's slot yet
+        } else {
+            pos = __atomic_load_n(&dispatch->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    slot->message = *message;
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+// Consumer side, under consumer_lock. Stops at the first slot whose
+// producer has claimed it but not finished writing; that producer wakes the
+// source again once it has.
+static gboolean ring_pop(MainDispatch* dispatch, Message* message) {
+    guint64 pos = dispatch->dequeue_pos;
+    Slot* slot = &dispatch->slots[pos & dispatch->mask];
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1) return FALSE;
+    *message = slot->message;
+    __atomic_store_n(&slot->sequence, pos + dispatch->mask + 1, __ATOMIC_RELEASE);
+    dispatch->dequeue_pos = pos + 1;
+    return TRUE;
+}
+
+static void wake(MainDispatch* dispatch) {
+    if (__atomic_exchange_n(&dispatch->wakeup_pending, 1, __ATOMIC_SEQ_CST) == 0) {
+        uint64_t one = 1;
+        ssize_t n = write(dispatch->event_fd, &one, sizeof(one));
+        (void)n;    // EAGAIN means the counter is already non-zero
+    }
+}
+
+// Destroys everything queued; used once the dispatch is closed
+static void drain_closed(MainDispatch* dispatch) {
+    pthread_mutex_lock(&dispatch->consumer_lock);
+    Message message;
+    while (ring_pop(dispatch, &message)) {
+        message_discard(dispatch, &message);
+    }
+    pthread_mutex_lock(&dispatch->overflow_lock);
+    GQueue overflow = dispatch->overflow;
+    g_queue_init(&dispatch->overflow);
+    __atomic_store_n(&dispatch->overflowing, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&dispatch->overflow_lock);
+    Message* spilled;
+    while ((spilled = g_queue_pop_head(&overflow)) != NULL) {
+        message_discard(dispatch, spilled);
+        g_free(spilled);
+    }
+    pthread_mutex_unlock(&dispatch->consumer_lock);
+}
+
+gboolean main_dispatch_post(MainDispatch* dispatch,
+                            gconstpointer key,
+                            MainDispatchFunc func,
+                            gpointer data,
+                            GDestroyNotify destroy) {
+    Message message = { key, func, data, destroy };
+    if (__atomic_load_n(&dispatch->closed, __ATOMIC_SEQ_CST)) {
+        message_discard(dispatch, &message);
+        return FALSE;
+    }
+    stat_add(&dispatch->stats.posted, 1);
+
+    // Once anything has spilled, later messages follow it into the overflow
+    // list until the consumer empties it, so per-thread order holds
+    if (__atomic_load_n(&dispatch->overflowing, __ATOMIC_ACQUIRE) || !ring_push(dispatch, &message)) {
+        pthread_mutex_lock(&dispatch->overflow_lock);
+        if (__atomic_load_n(&dispatch->overflowing, __ATOMIC_RELAXED) || !ring_push(dispatch, &message)) {
+            Message* spilled = g_new(Message, 1);
+            *spilled = message;
+            g_queue_push_tail(&dispatch->overflow, spilled);
+            __atomic_store_n(&dispatch->overflowing, 1, __ATOMIC_RELEASE);
+            stat_add(&dispatch->stats.overflowed, 1);
+        }
+        pthread_mutex_unlock(&dispatch->overflow_lock);
+    }
+
+    // close() may have drained between the check above and the push
+    if (__atomic_load_n(&dispatch->closed, __ATOMIC_SEQ_CST)) {
+        drain_closed(dispatch);
+        return FALSE;
+    }
+    wake(dispatch);
+    return TRUE;
+}
+
+// Moves up to one ring's worth of messages, then the overflow list, into
+// the batch. Returns the number collected.
+//
+// The overflow list is only taken once the ring is empty. ring_pop() stops
+// at a slot that was claimed but not written yet, and that producer's
+// message is older than anything it spilled afterwards; delivering the list
+// first would reorder them. The list stays put, producers keep appending to
+// it, and the next wakeup (the late producer's own, at the latest) retries.
+static guint collect_batch(MainDispatch* dispatch, GQueue* spilled) {
+    guint count = 0;
+    pthread_mutex_lock(&dispatch->consumer_lock);
+    while (count <= dispatch->mask && ring_pop(dispatch, &dispatch->batch[count])) {
+        count++;
+    }
+    if (__atomic_load_n(&dispatch->overflowing, __ATOMIC_ACQUIRE) && count <= dispatch->mask &&
+        dispatch->dequeue_pos == __atomic_load_n(&dispatch->enqueue_pos, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&dispatch->overflow_lock);
+        *spilled = dispatch->overflow;
+        g_queue_init(&dispatch->overflow);
+        __atomic_store_n(&dispatch->overflowing, 0, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&dispatch->overflow_lock);
+    }
+    pthread_mutex_unlock(&dispatch->consumer_lock);
+    return count;
+}
+
+static void run_message(MainDispatch* dispatch, Message* message) {
+    if (__atomic_load_n(&dispatch->closed, __ATOMIC_ACQUIRE)) {
+        message_discard(dispatch, message);
+        return;
+    }
+    message->func(dispatch->owner, message->data);
+    if (message->destroy) message->destroy(message->data);
+    stat_add(&dispatch->stats.dispatched, 1);
+}
+
+static gboolean is_superseded(MainDispatch* dispatch, const Message* message, guint index) {
+    if (message->key == NULL) return FALSE;
+    return GPOINTER_TO_UINT(g_hash_table_lookup(dispatch->newest, message->key)) != index + 1;
+}
+
+static gboolean main_dispatch_source_dispatch(GSource* source,
+                                              GSourceFunc callback,
+                                              gpointer user_data) {
+    MainDispatch* dispatch = (MainDispatch*)source;
+    if (g_source_query_unix_fd(source, dispatch->fd_tag) & G_IO_IN) {
+        uint64_t count;
+        ssize_t n = read(dispatch->event_fd, &count, sizeof(count));
+        (void)n;
+    }
+    // Re-arm before draining: a post that lands after this point writes the
+    // eventfd again, so nothing is left behind until the next post
+    __atomic_store_n(&dispatch->wakeup_pending, 0, __ATOMIC_SEQ_CST);
+
+    GQueue spilled = G_QUEUE_INIT;
+    guint count = collect_batch(dispatch, &spilled);
+    guint total = count + spilled.length;
+    if (total == 0) return G_SOURCE_CONTINUE;
+    stat_add(&dispatch->stats.batches, 1);
+
+    // A full ring means more may be waiting; come back after this batch
+    if (count > dispatch->mask) wake(dispatch);
+
+    // Newest message per key over the ring part, then the spilled part,
+    // which is younger
+    g_hash_table_remove_all(dispatch->newest);
+    for (guint i = 0; i < count; i++) {
+        if (dispatch->batch[i].key) {
+            g_hash_table_insert(dispatch->newest, (gpointer)dispatch->batch[i].key,
+                                GUINT_TO_POINTER(i + 1));
+        }
+    }
+    guint index = count;
+    for (GList* link = spilled.head; link != NULL; link = link->next, index++) {
+        const Message* message = link->data;
+        if (message->key) {
+            g_hash_table_insert(dispatch->newest, (gpointer)message->key,
+                                GUINT_TO_POINTER(index + 1));
+        }
+    }
+
+    guint superseded = 0;
+    for (guint i = 0; i < count; i++) {
+        Message* message = &dispatch->batch[i];
+        if (is_superseded(dispatch, message, i)) {
+            if (message->destroy) message->destroy(message->data);
+            superseded++;
+        } else {
+            run_message(dispatch, message);
+        }
+    }
+    index = count;
+    Message* message;
+    while ((message = g_queue_pop_head(&spilled)) != NULL) {
+        if (is_superseded(dispatch, message, index)) {
+            if (message->destroy) message->destroy(message->data);
+            superseded++;
+        } else {
+            run_message(dispatch, message);
+        }
+        g_free(message);
+        index++;
+    }
+    stat_add(&dispatch->stats.superseded, superseded);
+    return G_SOURCE_CONTINUE;
+}
+
+static void main_dispatch_source_finalize(GSource* source) {
+    MainDispatch* dispatch = (MainDispatch*)source;
+    __atomic_store_n(&dispatch->closed, 1, __ATOMIC_SEQ_CST);
+    drain_closed(dispatch);
+    close(dispatch->event_fd);
+    g_hash_table_destroy(dispatch->newest);
+    g_free(dispatch->batch);
+    g_free(dispatch->slots);
+    pthread_mutex_destroy(&dispatch->overflow_lock);
+    pthread_mutex_destroy(&dispatch->consumer_lock);
+}
+
+static GSourceFuncs main_dispatch_source_funcs = {
+    NULL,
+    NULL,
+    main_dispatch_source_dispatch,
+    main_dispatch_source_finalize,
+    NULL,
+    NULL,
+};
+
+MainDispatch* main_dispatch_new(GMainContext* context, guint capacity, gpointer owner) {
+    int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0) {
+        g_error("eventfd failed: %s", g_strerror(errno));
+    }
+
+    guint64 slots = 1;
+    while (slots < (capacity ? capacity : MAIN_DISPATCH_DEFAULT_CAPACITY)) slots <<= 1;
+
+    GSource* source = g_source_new(&main_dispatch_source_funcs, sizeof(MainDispatch));
+    MainDispatch* dispatch = (MainDispatch*)source;
+    dispatch->owner = owner;
+    dispatch->event_fd = event_fd;
+    dispatch->mask = slots - 1;
+    dispatch->slots = g_new0(Slot, slots);
+    for (guint64 i = 0; i < slots; i++) {
+        dispatch->slots[i].sequence = i;
+    }
+    dispatch->batch = g_new(Message, slots);
+    dispatch->newest = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_queue_init(&dispatch->overflow);
+    pthread_mutex_init(&dispatch->overflow_lock, NULL);
+    pthread_mutex_init(&dispatch->consumer_lock, NULL);
+
+    // Same priority the per-event idle callbacks used to run at
+    g_source_set_priority(source, G_PRIORITY_DEFAULT_IDLE);
+    g_source_set_name(source, "main-dispatch");
+    dispatch->fd_tag = g_source_add_unix_fd(source, event_fd, G_IO_IN);
+    g_source_attach(source, context);
+    return dispatch;
+}
+
+void main_dispatch_close(MainDispatch* dispatch) {
+    if (__atomic_exchange_n(&dispatch->closed, 1, __ATOMIC_SEQ_CST)) return;
+    g_source_destroy(&dispatch->source);
+    drain_closed(dispatch);
+}
+
+void main_dispatch_free(MainDispatch* dispatch) {
+    if (!dispatch) return;
+    main_dispatch_close(dispatch);
+    g_source_unref(&dispatch->source);
+}
+
+void main_dispatch_get_stats(MainDispatch* dispatch, MainDispatchStats* stats) {
+    stats->posted = __atomic_load_n(&dispatch->stats.posted, __ATOMIC_RELAXED);
+    stats->dispatched = __atomic_load_n(&dispatch->stats.dispatched, __ATOMIC_RELAXED);
+    stats->superseded = __atomic_load_n(&dispatch->stats.superseded, __ATOMIC_RELAXED);
+    stats->discarded = __atomic_load_n(&dispatch->stats.discarded, __ATOMIC_RELAXED);
+    stats->overflowed = __atomic_load_n(&dispatch->stats.overflowed, __ATOMIC_RELAXED);
+    stats->batches = __atomic_load_n(&dispatch->stats.batches, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,84 @@
+#ifndef MAIN_DISPATCH_H
+#define MAIN_DISPATCH_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define MAIN_DISPATCH_DEFAULT_CAPACITY 256
+
+typedef struct _MainDispatch MainDispatch;
+
+/**
+ * MainDispatchFunc:
+ * @owner: the owner given to main_dispatch_new()
+ * @data: the message payload; released by its destroy notify afterwards
+ *
+ * Runs on the thread of the dispatch's main context.
+ */
+typedef void (*MainDispatchFunc)(gpointer owner, gpointer data);
+
+typedef struct {
+    guint64 posted;
+    guint64 dispatched;
+    guint64 superseded;       // dropped because a newer message had the same key
+    guint64 discarded;        // posted to or pending in a closed dispatch
+    guint64 overflowed;       // took the locked path because the ring was full
+    guint64 batches;
+} MainDispatchStats;
+
+/**
+ * main_dispatch_new:
+ * @context: (nullable): main context to deliver on, NULL for the default
+ * @capacity: ring slots, rounded up to a power of two; 0 for the default
+ * @owner: passed to every handler, typically the plugin object (not referenced)
+ *
+ * Creates a queue that background threads post to without locking and that
+ * a GSource on @context drains in batches. Producers wake the source through
+ * an eventfd only when it is not already pending, so a burst costs one
+ * wakeup. A full ring spills into a locked overflow list rather than
+ * blocking or dropping; messages from one thread are delivered in the order
+ * they were posted.
+ *
+ * Returns: (transfer full): free with main_dispatch_free()
+ */
+MainDispatch* main_dispatch_new(GMainContext* context, guint capacity, gpointer owner);
+
+/**
+ * main_dispatch_post:
+ * @key: (nullable): coalescing key; of the messages with the same non-NULL
+ *   key that are pending when the queue is drained, only the newest runs
+ * @destroy: (nullable): releases @data after @func ran, or instead of it
+ *   when the message is superseded or the dispatch is closed
+ *
+ * Queues @func(@owner, @data) from any thread.
+ *
+ * Returns: FALSE when the dispatch was closed and @data has been destroyed
+ */
+gboolean main_dispatch_post(MainDispatch* dispatch,
+                            gconstpointer key,
+                            MainDispatchFunc func,
+                            gpointer data,
+                            GDestroyNotify destroy);
+
+/**
+ * main_dispatch_close:
+ *
+ * Stops delivery: pending messages and any posted later are destroyed
+ * without running their handler, so handlers never see a disposed owner.
+ * Safe to call from a handler and more than once.
+ */
+void main_dispatch_close(MainDispatch* dispatch);
+
+/**
+ * main_dispatch_free:
+ *
+ * Closes the dispatch and drops it. Producer threads must have stopped.
+ */
+void main_dispatch_free(MainDispatch* dispatch);
+
+void main_dispatch_get_stats(MainDispatch* dispatch, MainDispatchStats* stats);
+
+G_END_DECLS
+
+#endif // MAIN_DISPATCH_H
@@ -0,0 +1,342 @@
+#include "merkle_hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define MERKLE_HASH_PROGRESS_INTERVAL_US 500000
+// How often the calling thread checks whether the workers are done
+#define MERKLE_HASH_POLL_US 10000
+
+typedef struct {
+    uint8_t* leaves;            // leaf digests of the region
+    uint64_t remaining;         // atomic: leaves not hashed yet
+} RegionSlot;
+
+typedef struct {
+    int fd;
+    const MerkleHashOptions* options;
+    const DeviceBackend* backend;
+    uint64_t start;
+    uint64_t end;
+    size_t leaf_size;
+    uint64_t leaves_per_region;
+    uint64_t leaf_count;
+    uint64_t region_count;
+
+    uint64_t next_leaf;         // atomic
+    uint64_t bytes_done;        // atomic
+    gint running;               // atomic
+    gint failed;                // atomic
+    int failed_errno;
+    uint64_t failed_offset;
+
+    pthread_mutex_t lock;       // guards slot creation and the failure fields
+    RegionSlot** slots;         // per region while it has leaves in flight
+    uint8_t* region_roots;
+} MerkleJob;
+
+static gint64 monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_us(gint64 us) {
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+static gboolean is_stopped(const MerkleJob* job) {
+    return (job->options->cancel && *job->options->cancel) ||
+           __atomic_load_n(&job->failed, __ATOMIC_RELAXED);
+}
+
+static void fail(MerkleJob* job, int error_number, uint64_t offset) {
+    pthread_mutex_lock(&job->lock);
+    if (!job->failed) {
+        job->failed_errno = error_number;
+        job->failed_offset = offset;
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void hash_leaf(const uint8_t* data, size_t length, uint8_t digest[SHA256_DIGEST_SIZE]) {
+    static const uint8_t prefix = 0x00;
+    Sha256Context ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, &prefix, 1);
+    sha256_update(&ctx, data, length);
+    sha256_final(&ctx, digest);
+}
+
+static void hash_node(const uint8_t* left, const uint8_t* right, uint8_t digest[SHA256_DIGEST_SIZE]) {
+    uint8_t input[1 + 2 * SHA256_DIGEST_SIZE];
+    input[0] = 0x01;
+    memcpy(input + 1, left, SHA256_DIGEST_SIZE);
+    memcpy(input + 1 + SHA256_DIGEST_SIZE, right, SHA256_DIGEST_SIZE);
+    sha256_digest(input, sizeof(input), digest);
+}
+
+// Folds @count digests level by level in place; the root ends up first
+static void fold(uint8_t* digests, uint64_t count) {
+    while (count > 1) {
+        uint64_t parents = 0;
+        for (uint64_t i = 0; i < count; i += 2, parents++) {
+            uint8_t* parent = digests + parents * SHA256_DIGEST_SIZE;
+            if (i + 1 < count) {
+                hash_node(digests + i * SHA256_DIGEST_SIZE,
+                          digests + (i + 1) * SHA256_DIGEST_SIZE, parent);
+            } else {
+                memmove(parent, digests + i * SHA256_DIGEST_SIZE, SHA256_DIGEST_SIZE);
+            }
+        }
+        count = parents;
+    }
+}
+
+static uint64_t region_leaf_count(const MerkleJob* job, uint64_t region) {
+    uint64_t first = region * job->leaves_per_region;
+    return MIN(job->leaves_per_region, job->leaf_count - first);
+}
+
+static RegionSlot* get_slot(MerkleJob* job, uint64_t region) {
+    pthread_mutex_lock(&job->lock);
+    RegionSlot* slot = job->slots[region];
+    if (slot == NULL) {
+        uint64_t count = region_leaf_count(job, region);
+        slot = g_new0(RegionSlot, 1);
+        slot->leaves = g_malloc(count * SHA256_DIGEST_SIZE);
+        slot->remaining = count;
+        job->slots[region] = slot;
+    }
+    pthread_mutex_unlock(&job->lock);
+    return slot;
+}
+
+static void* worker_func(void* data) {
+    MerkleJob* job = data;
+    uint8_t* buffer = NULL;
+    if (posix_memalign((void**)&buffer, 4096, job->leaf_size) != 0) {
+        fail(job, ENOMEM, job->start);
+        goto out;
+    }
+
+    while (!is_stopped(job)) {
+        uint64_t leaf = __atomic_fetch_add(&job->next_leaf, 1, __ATOMIC_RELAXED);
+        if (leaf >= job->leaf_count) break;
+
+        uint64_t offset = job->start + leaf * job->leaf_size;
+        size_t length = (size_t)MIN(job->leaf_size, job->end - offset);
+        // O_DIRECT needs whole blocks, so a short last leaf is read rounded
+        // up and the read ends early at the end of the file
+        size_t request = MIN(job->leaf_size, (length + 4095) & ~(size_t)4095);
+        size_t done = 0;
+        int read_errno = 0;
+        while (done < length) {
+            ssize_t n = job->backend->pread(job->fd, buffer + done, request - done,
+                                            offset + done, job->backend->ctx);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                // A zero-length read means the device ended before the range did
+                read_errno = n < 0 ? errno : ENXIO;
+                break;
+            }
+            done += (size_t)n;
+        }
+        if (done < length) {
+            fail(job, read_errno, offset + done);
+            break;
+        }
+
+        uint64_t region = leaf / job->leaves_per_region;
+        RegionSlot* slot = get_slot(job, region);
+        hash_leaf(buffer, length, slot->leaves + (leaf % job->leaves_per_region) * SHA256_DIGEST_SIZE);
+        __atomic_add_fetch(&job->bytes_done, length, __ATOMIC_RELAXED);
+
+        // The last leaf of a region folds it; nobody else touches the slot now
+        if (__atomic_sub_fetch(&slot->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+            fold(slot->leaves, region_leaf_count(job, region));
+            memcpy(job->region_roots + region * SHA256_DIGEST_SIZE, slot->leaves, SHA256_DIGEST_SIZE);
+            pthread_mutex_lock(&job->lock);
+            job->slots[region] = NULL;
+            pthread_mutex_unlock(&job->lock);
+            g_free(slot->leaves);
+            g_free(slot);
+        }
+    }
+
+out:
+    free(buffer);
+    __atomic_sub_fetch(&job->running, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void report_progress(MerkleJob* job, gint64 elapsed_us) {
+    const MerkleHashOptions* options = job->options;
+    if (!options->progress) return;
+
+    BulkProgress progress = {
+        .bytes_done = __atomic_load_n(&job->bytes_done, __ATOMIC_RELAXED),
+        .bytes_total = job->end - job->start,
+        .elapsed_us = elapsed_us,
+        .throttle = NULL,
+    };
+    options->progress(&progress, options->user_data);
+}
+
+void merkle_hash_default_options(MerkleHashOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->leaf_size = MERKLE_HASH_DEFAULT_LEAF_SIZE;
+    options->region_size = MERKLE_HASH_DEFAULT_REGION_SIZE;
+}
+
+gboolean merkle_hash_device(int fd,
+                            const MerkleHashOptions* options,
+                            MerkleHashResult* result,
+                            GError** error) {
+    memset(result, 0, sizeof(*result));
+
+    MerkleJob job;
+    memset(&job, 0, sizeof(job));
+    job.fd = fd;
+    job.options = options;
+    job.backend = options->backend ? options->backend : device_backend_linux();
+    job.leaf_size = options->leaf_size ? options->leaf_size : MERKLE_HASH_DEFAULT_LEAF_SIZE;
+    uint64_t region_size = options->region_size ? options->region_size : MERKLE_HASH_DEFAULT_REGION_SIZE;
+
+    if (job.leaf_size < 4096 || (job.leaf_size & (job.leaf_size - 1)) != 0 ||
+        region_size < job.leaf_size || region_size % job.leaf_size != 0 ||
+        ((region_size / job.leaf_size) & (region_size / job.leaf_size - 1)) != 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "Leaf size must be a power of two of at least 4096 and the "
+                    "region size a power-of-two multiple of it");
+        return FALSE;
+    }
+
+    uint64_t device_size = 0;
+    if (job.backend->device_size(fd, &device_size, job.backend->ctx) < 0) {
+        int saved = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Failed to get device size: %s", g_strerror(saved));
+        return FALSE;
+    }
+    job.start = options->offset;
+    job.end = options->length ? options->offset + options->length : device_size;
+    if (job.start >= job.end || job.end > device_size || job.start % 4096 != 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "Hash range must be non-empty, 4096-byte aligned and inside the device");
+        return FALSE;
+    }
+
+    uint64_t length = job.end - job.start;
+    job.leaves_per_region = region_size / job.leaf_size;
+    job.leaf_count = (length + job.leaf_size - 1) / job.leaf_size;
+    job.region_count = (job.leaf_count + job.leaves_per_region - 1) / job.leaves_per_region;
+    job.slots = g_new0(RegionSlot*, job.region_count);
+    job.region_roots = g_malloc0(job.region_count * SHA256_DIGEST_SIZE);
+    pthread_mutex_init(&job.lock, NULL);
+
+    guint worker_count = options->workers;
+    if (worker_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        // Two beyond the cores keep reads queued while every core hashes
+        worker_count = (guint)(cpus > 0 ? cpus : 1) + 2;
+    }
+    worker_count = (guint)MIN(MIN(worker_count, MERKLE_HASH_MAX_WORKERS), job.leaf_count);
+
+    pthread_t threads[MERKLE_HASH_MAX_WORKERS];
+    guint started = 0;
+    gint64 start_us = monotonic_us();
+    job.running = (gint)worker_count;
+    for (guint i = 0; i < worker_count; i++) {
+        if (pthread_create(&threads[i], NULL, worker_func, &job) != 0) break;
+        started++;
+    }
+    __atomic_sub_fetch(&job.running, (gint)(worker_count - started), __ATOMIC_RELAXED);
+    if (started == 0) fail(&job, EAGAIN, job.start);
+
+    gint64 last_progress_us = start_us;
+    while (__atomic_load_n(&job.running, __ATOMIC_ACQUIRE) > 0) {
+        sleep_us(MERKLE_HASH_POLL_US);
+        gint64 now = monotonic_us();
+        if (now - last_progress_us >= MERKLE_HASH_PROGRESS_INTERVAL_US) {
+            report_progress(&job, now - start_us);
+            last_progress_us = now;
+        }
+    }
+    for (guint i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    result->elapsed_us = monotonic_us() - start_us;
+    report_progress(&job, result->elapsed_us);
+
+    // Regions abandoned by a failure or cancel
+    for (uint64_t i = 0; i < job.region_count; i++) {
+        if (job.slots[i] != NULL) {
+            g_free(job.slots[i]->leaves);
+            g_free(job.slots[i]);
+        }
+    }
+    g_free(job.slots);
+    pthread_mutex_destroy(&job.lock);
+
+    result->offset = job.start;
+    result->length = length;
+    result->leaf_size = job.leaf_size;
+    result->region_size = region_size;
+    result->accelerated = sha256_accelerated();
+
+    if (job.failed) {
+        g_free(job.region_roots);
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(job.failed_errno),
+                    "Read failed at offset %llu: %s",
+                    (unsigned long long)job.failed_offset, g_strerror(job.failed_errno));
+        return FALSE;
+    }
+    if (options->cancel && *options->cancel) {
+        g_free(job.region_roots);
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Hashing cancelled");
+        return FALSE;
+    }
+
+    result->region_roots = job.region_roots;
+    result->region_count = job.region_count;
+    uint8_t* roots = g_malloc(job.region_count * SHA256_DIGEST_SIZE);
+    memcpy(roots, job.region_roots, job.region_count * SHA256_DIGEST_SIZE);
+    fold(roots, job.region_count);
+    memcpy(result->root, roots, SHA256_DIGEST_SIZE);
+    g_free(roots);
+    return TRUE;
+}
+
+void merkle_hash_result_clear(MerkleHashResult* result) {
+    g_clear_pointer(&result->region_roots, g_free);
+    result->region_count = 0;
+}
+
+FlValue* merkle_hash_result_to_fl_value(const MerkleHashResult* result) {
+    char hex[SHA256_DIGEST_SIZE * 2 + 1];
+    FlValue* value = fl_value_new_map();
+    fl_value_set_string_take(value, "algorithm", fl_value_new_string("sha256-merkle"));
+    sha256_to_hex(result->root, hex);
+    fl_value_set_string_take(value, "root", fl_value_new_string(hex));
+    fl_value_set_string_take(value, "offset", fl_value_new_int((int64_t)result->offset));
+    fl_value_set_string_take(value, "length", fl_value_new_int((int64_t)result->length));
+    fl_value_set_string_take(value, "leafSize", fl_value_new_int((int64_t)result->leaf_size));
+    fl_value_set_string_take(value, "regionSize", fl_value_new_int((int64_t)result->region_size));
+
+    FlValue* regions = fl_value_new_list();
+    for (uint64_t i = 0; i < result->region_count; i++) {
+        sha256_to_hex(result->region_roots + i * SHA256_DIGEST_SIZE, hex);
+        fl_value_append_take(regions, fl_value_new_string(hex));
+    }
+    fl_value_set_string_take(value, "regionRoots", regions);
+    fl_value_set_string_take(value, "elapsedUs", fl_value_new_int(result->elapsed_us));
+    fl_value_set_string_take(value, "accelerated", fl_value_new_bool(result->accelerated));
+    return value;
+}
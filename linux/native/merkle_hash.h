@@ -0,0 +1,78 @@
+#ifndef MERKLE_HASH_H
+#define MERKLE_HASH_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdint.h>
+#include "bulk_io.h"
+#include "sha256.h"
+
+G_BEGIN_DECLS
+
+/*
+ * SHA-256 Merkle tree over device content.
+ *
+ *   leaf = SHA-256(0x00 || leaf_size bytes)   (the last leaf may be shorter)
+ *   node = SHA-256(0x01 || left || right)
+ *
+ * Levels are built bottom-up pairing neighbours; an unpaired last node moves
+ * up unchanged. Regions are aligned runs of region_size / leaf_size leaves,
+ * so each region root is a node of the tree: hashing just that region later
+ * reproduces it, and the root over the region roots equals the root over all
+ * leaves.
+ */
+
+#define MERKLE_HASH_DEFAULT_LEAF_SIZE (1u * 1024 * 1024)
+#define MERKLE_HASH_DEFAULT_REGION_SIZE (1ull * 1024 * 1024 * 1024)
+#define MERKLE_HASH_MAX_WORKERS 64
+
+typedef struct {
+    uint64_t offset;                  // start of the hashed range
+    uint64_t length;                  // 0 = to the end of the device
+    size_t leaf_size;                 // power of two, at least 4096; 0 for the default
+    uint64_t region_size;             // leaf_size times a power of two; 0 for the default
+    guint workers;                    // concurrent read-and-hash threads, 0 = online CPUs + 2
+    const DeviceBackend* backend;     // optional, NULL reads through the kernel
+    BulkProgressCallback progress;
+    void* user_data;
+    const volatile gint* cancel;
+} MerkleHashOptions;
+
+typedef struct {
+    uint8_t root[SHA256_DIGEST_SIZE];
+    uint8_t* region_roots;            // region_count digests, region order
+    uint64_t region_count;
+    uint64_t offset;
+    uint64_t length;
+    size_t leaf_size;
+    uint64_t region_size;
+    gint64 elapsed_us;
+    gboolean accelerated;             // SHA instructions were used
+} MerkleHashResult;
+
+void merkle_hash_default_options(MerkleHashOptions* options);
+
+/**
+ * merkle_hash_device:
+ * @fd: device or file opened for reading (from the options' backend when
+ *   one is set); O_DIRECT keeps a full-device pass out of the page cache
+ * @result: (out): release with merkle_hash_result_clear()
+ *
+ * Hashes [offset, offset + length). Each worker claims the next leaf, reads
+ * it and hashes it, so reads stay at a queue depth of @workers and hashing
+ * runs on every core; the worker finishing the last leaf of a region folds
+ * that region's subtree.
+ *
+ * Returns: TRUE when the whole range was hashed
+ */
+gboolean merkle_hash_device(int fd,
+                            const MerkleHashOptions* options,
+                            MerkleHashResult* result,
+                            GError** error);
+
+void merkle_hash_result_clear(MerkleHashResult* result);
+
+FlValue* merkle_hash_result_to_fl_value(const MerkleHashResult* result);
+
+G_END_DECLS
+
+#endif // MERKLE_HASH_H
@@ -0,0 +1,233 @@
+#define _GNU_SOURCE
+#include "numa_placement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// From <linux/mempolicy.h>; defined here so the build does not need libnuma
+#define NUMA_MPOL_PREFERRED 1
+
+// Reserved huge pages are 2 MiB on the machines this runs on; smaller or
+// unaligned buffers are not worth a huge page
+#define NUMA_HUGE_PAGE_SIZE (2u * 1024 * 1024)
+
+static gboolean read_attr(const char* path, char* buffer, size_t size) {
+    FILE* f = fopen(path, "r");
+    if (!f) return FALSE;
+    gboolean ok = fgets(buffer, (int)size, f) != NULL;
+    fclose(f);
+    if (!ok) return FALSE;
+    buffer[strcspn(buffer, "\n")] = '\0';
+    return TRUE;
+}
+
+// Parses a kernel cpulist ("0-3,8,10-11") into @set; returns the CPU count
+static guint parse_cpu_list(const char* text, cpu_set_t* set) {
+    CPU_ZERO(set);
+    guint count = 0;
+    const char* p = text;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) break;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) break;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, set)) {
+                CPU_SET(cpu, set);
+                count++;
+            }
+        }
+        if (*p != ',') break;
+        p++;
+    }
+    return count;
+}
+
+// Formats @set back into cpulist form so results read like sysfs
+static void format_cpu_list(const cpu_set_t* set, char* out, size_t size) {
+    size_t len = 0;
+    out[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, set)) continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set)) last++;
+        int n = last > cpu
+            ? snprintf(out + len, size - len, "%s%d-%d", len ? "," : "", cpu, last)
+            : snprintf(out + len, size - len, "%s%d", len ? "," : "", cpu);
+        if (n < 0 || (size_t)n >= size - len) {
+            out[len] = '\0';
+            return;
+        }
+        len += (size_t)n;
+        cpu = last;
+    }
+}
+
+// Reads the CPUs the vectors under <dir>/msi_irqs are routed to
+static void probe_irqs(const char* root, const char* dir, NumaPlacement* placement) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/msi_irqs", dir);
+    DIR* d = opendir(path);
+    if (!d) return;
+
+    struct dirent* entry;
+    while ((entry = readdir(d))) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+        char list[NUMA_PLACEMENT_LIST_MAX];
+        snprintf(path, sizeof(path), "%s/proc/irq/%s/effective_affinity_list", root, entry->d_name);
+        if (!read_attr(path, list, sizeof(list)) || !list[0]) {
+            snprintf(path, sizeof(path), "%s/proc/irq/%s/smp_affinity_list", root, entry->d_name);
+            if (!read_attr(path, list, sizeof(list))) continue;
+        }
+        cpu_set_t vector;
+        if (parse_cpu_list(list, &vector) == 0) continue;
+        CPU_OR(&placement->irq_cpus, &placement->irq_cpus, &vector);
+        placement->irq_count++;
+    }
+    closedir(d);
+}
+
+gboolean numa_placement_probe(const char* root, const char* device, NumaPlacement* placement) {
+    memset(placement, 0, sizeof(*placement));
+    placement->numa_node = -1;
+    CPU_ZERO(&placement->cpus);
+    CPU_ZERO(&placement->irq_cpus);
+    if (!device || !*device || strchr(device, '/')) return FALSE;
+
+    const char* base = root ? root : "";
+    char path[PATH_MAX + 64];     // room for an attribute below @dir
+    char dir[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/sys/class/block/%s", base, device);
+    if (!realpath(path, dir)) return FALSE;
+
+    // Resolving the fixture root too keeps the walk inside it
+    char sys_root[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/sys", base);
+    if (!realpath(path, sys_root)) return FALSE;
+    size_t sys_len = strlen(sys_root);
+
+    // Partitions, namespaces and controllers inherit the node of the PCI
+    // function above them; virtual devices have none
+    char value[64];
+    while (strlen(dir) > sys_len && strncmp(dir, sys_root, sys_len) == 0) {
+        snprintf(path, sizeof(path), "%s/numa_node", dir);
+        if (read_attr(path, value, sizeof(value))) {
+            placement->numa_node = atoi(value);
+            probe_irqs(base, dir, placement);
+            break;
+        }
+        char* slash = strrchr(dir, '/');
+        if (!slash) break;
+        *slash = '\0';
+    }
+
+    if (placement->numa_node >= 0) {
+        char list[NUMA_PLACEMENT_LIST_MAX];
+        snprintf(path, sizeof(path), "%s/sys/devices/system/node/node%d/cpulist",
+                 base, placement->numa_node);
+        if (read_attr(path, list, sizeof(list))) {
+            parse_cpu_list(list, &placement->cpus);
+        }
+    }
+
+    if (!root && CPU_COUNT(&placement->cpus) > 0) {
+        // cgroups and taskset may exclude part of the node
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            CPU_AND(&placement->cpus, &placement->cpus, &allowed);
+        }
+    }
+
+    placement->cpu_count = (guint)CPU_COUNT(&placement->cpus);
+    format_cpu_list(&placement->cpus, placement->cpu_list, sizeof(placement->cpu_list));
+    format_cpu_list(&placement->irq_cpus, placement->irq_cpu_list, sizeof(placement->irq_cpu_list));
+    if (placement->irq_count > 0 && placement->cpu_count > 0) {
+        cpu_set_t outside;
+        CPU_XOR(&outside, &placement->irq_cpus, &placement->cpus);
+        CPU_AND(&outside, &outside, &placement->irq_cpus);
+        placement->irqs_local = CPU_COUNT(&outside) == 0;
+    }
+    return TRUE;
+}
+
+gboolean numa_placement_bind_thread(const NumaPlacement* placement, NumaPlacementStats* stats) {
+    if (stats) __atomic_fetch_add(&stats->threads, 1, __ATOMIC_RELAXED);
+    if (!placement || placement->cpu_count == 0) return FALSE;
+    if (pthread_setaffinity_np(pthread_self(), sizeof(placement->cpus), &placement->cpus) != 0) {
+        return FALSE;
+    }
+    if (stats) __atomic_fetch_add(&stats->threads_pinned, 1, __ATOMIC_RELAXED);
+    return TRUE;
+}
+
+void* numa_placement_alloc(const NumaPlacement* placement, size_t size, NumaPlacementStats* stats) {
+    if (size == 0) return NULL;
+    gboolean huge = placement && placement->huge_pages && size % NUMA_HUGE_PAGE_SIZE == 0;
+    void* buffer = MAP_FAILED;
+
+    if (huge) {
+        buffer = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (buffer != MAP_FAILED && stats) {
+            __atomic_fetch_add(&stats->buffers_hugetlb, 1, __ATOMIC_RELAXED);
+        }
+    }
+    if (buffer == MAP_FAILED) {
+        buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED) return NULL;
+        // Pool empty or not configured; THP still saves TLB misses
+        if (huge && madvise(buffer, size, MADV_HUGEPAGE) == 0 && stats) {
+            __atomic_fetch_add(&stats->buffers_thp, 1, __ATOMIC_RELAXED);
+        }
+    }
+    if (stats) __atomic_fetch_add(&stats->buffers, 1, __ATOMIC_RELAXED);
+
+    // Nothing is touched yet, so the policy applies to every page. Without
+    // mbind (seccomp, old kernels) first touch by the pinned caller places
+    // the pages on the same node.
+    if (placement && placement->numa_node >= 0 && placement->numa_node < 64) {
+        unsigned long mask = 1ul << placement->numa_node;
+        if (syscall(SYS_mbind, buffer, size, NUMA_MPOL_PREFERRED, &mask,
+                    sizeof(mask) * 8, 0) == 0 && stats) {
+            __atomic_fetch_add(&stats->buffers_bound, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return buffer;
+}
+
+void numa_placement_free(void* buffer, size_t size) {
+    if (buffer) munmap(buffer, size);
+}
+
+FlValue* numa_placement_to_fl_value(const NumaPlacement* placement, const NumaPlacementStats* stats) {
+    FlValue* map = fl_value_new_map();
+    fl_value_set_string_take(map, "numaNode", fl_value_new_int(placement->numa_node));
+    fl_value_set_string_take(map, "cpuList", fl_value_new_string(placement->cpu_list));
+    fl_value_set_string_take(map, "cpuCount", fl_value_new_int(placement->cpu_count));
+    fl_value_set_string_take(map, "irqCount", fl_value_new_int(placement->irq_count));
+    fl_value_set_string_take(map, "irqCpuList", fl_value_new_string(placement->irq_cpu_list));
+    fl_value_set_string_take(map, "irqsLocal", fl_value_new_bool(placement->irqs_local));
+    fl_value_set_string_take(map, "hugePages", fl_value_new_bool(placement->huge_pages));
+    if (stats) {
+        fl_value_set_string_take(map, "threads", fl_value_new_int(stats->threads));
+        fl_value_set_string_take(map, "threadsPinned", fl_value_new_int(stats->threads_pinned));
+        fl_value_set_string_take(map, "buffers", fl_value_new_int(stats->buffers));
+        fl_value_set_string_take(map, "buffersBound", fl_value_new_int(stats->buffers_bound));
+        fl_value_set_string_take(map, "buffersHugetlb", fl_value_new_int(stats->buffers_hugetlb));
+        fl_value_set_string_take(map, "buffersThp", fl_value_new_int(stats->buffers_thp));
+    }
+    return map;
+}
@@ -0,0 +1,96 @@
+#ifndef NUMA_PLACEMENT_H
+#define NUMA_PLACEMENT_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+#define NUMA_PLACEMENT_LIST_MAX 256
+
+/**
+ * NumaPlacement:
+ *
+ * Where the I/O for one block device should run. Drives report their NUMA
+ * node through the PCI function they hang off; on multi-socket machines
+ * DMA to buffers on the other socket crosses the interconnect, so the
+ * device's workers run on, and allocate from, its own node.
+ */
+typedef struct {
+    int numa_node;                          // -1 when the device reports none
+    cpu_set_t cpus;                         // node CPUs the workers may use
+    guint cpu_count;                        // 0 = leave threads unpinned
+    char cpu_list[NUMA_PLACEMENT_LIST_MAX]; // e.g. "16-31,48-63"
+    cpu_set_t irq_cpus;                     // where its interrupts are routed
+    guint irq_count;                        // MSI/MSI-X vectors found
+    char irq_cpu_list[NUMA_PLACEMENT_LIST_MAX];
+    gboolean irqs_local;                    // every vector targets a node CPU
+    gboolean huge_pages;                    // back buffers with huge pages
+} NumaPlacement;
+
+/**
+ * NumaPlacementStats:
+ *
+ * What an executor actually got; counters are updated atomically by its
+ * threads.
+ */
+typedef struct {
+    guint threads;
+    guint threads_pinned;
+    guint buffers;
+    guint buffers_bound;      // pages bound to the node with mbind
+    guint buffers_hugetlb;    // backed by reserved huge pages
+    guint buffers_thp;        // transparent huge pages requested
+} NumaPlacementStats;
+
+/**
+ * numa_placement_probe:
+ * @root: (nullable): directory holding "sys" and "proc", NULL for the
+ *   running system; tests point it at a fixture tree
+ * @device: kernel name of a disk or partition ("nvme0n1", "sda2")
+ *
+ * Follows /sys/class/block/@device up to the first ancestor with a
+ * numa_node attribute, reads that node's cpulist and the affinity of the
+ * MSI vectors listed under the ancestor's msi_irqs. On the running system
+ * the CPU set is limited to the CPUs this process may run on.
+ *
+ * Returns: TRUE when the device was found; @placement->cpu_count is 0
+ *   when there is nothing to pin to
+ */
+gboolean numa_placement_probe(const char* root, const char* device, NumaPlacement* placement);
+
+/**
+ * numa_placement_bind_thread:
+ * @placement: (nullable)
+ *
+ * Pins the calling thread to the placement's CPUs.
+ *
+ * Returns: TRUE when the thread was pinned
+ */
+gboolean numa_placement_bind_thread(const NumaPlacement* placement, NumaPlacementStats* stats);
+
+/**
+ * numa_placement_alloc:
+ * @placement: (nullable): NULL allocates without a policy
+ *
+ * Allocates a page-aligned I/O buffer, suitable for O_DIRECT. With a node
+ * the range is bound to it with mbind(MPOL_PREFERRED); where mbind is
+ * unavailable the pages are left untouched so the first thread to use
+ * them, normally a pinned worker, places them. Huge pages, for sizes that
+ * are a multiple of 2 MiB, come from the reserved pool when possible,
+ * otherwise from THP.
+ *
+ * Returns: (transfer full): the buffer, free with numa_placement_free(), or
+ *   NULL on failure
+ */
+void* numa_placement_alloc(const NumaPlacement* placement, size_t size, NumaPlacementStats* stats);
+void numa_placement_free(void* buffer, size_t size);
+
+// Node, CPU and IRQ lists plus the stats, for operation results
+FlValue* numa_placement_to_fl_value(const NumaPlacement* placement, const NumaPlacementStats* stats);
+
+G_END_DECLS
+
+#endif // NUMA_PLACEMENT_H
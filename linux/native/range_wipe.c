@@ -0,0 +1,629 @@
+#define _GNU_SOURCE
+#include "range_wipe.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#define RANGE_WIPE_MAX_PARALLEL 16
+#define RANGE_WIPE_PROGRESS_INTERVAL_US 500000
+// How often the temperature is polled while a throttle is attached
+#define RANGE_WIPE_THROTTLE_TICK_US 100000
+
+// Where one range is written: the descriptors are opened once by
+// range_wipe_execute() and shared by every worker writing through them
+typedef struct {
+    char path[128];
+    int fd;
+    int verify_fd;              // -1 when not verifying
+    uint64_t offset;            // byte offset of the range on @fd
+} RangeTarget;
+
+typedef struct {
+    const RangeWipeOptions* options;
+    const DeviceBackend* backend;
+    RangeExtent* extents;       // sorted copy
+    RangeTarget* targets;       // parallel to @extents
+    size_t count;
+    size_t chunk_size;
+    guint workers_per_range;
+
+    size_t next_range;          // atomic
+    uint64_t* range_done;       // atomic per range
+    uint64_t* range_verified;   // atomic per range
+    uint64_t mismatches;        // atomic
+    gint abort;                 // atomic: user cancel or first failure
+    gint running;               // atomic: pool threads still working
+
+    pthread_mutex_t lock;
+    GError* error;
+} RangeJob;
+
+typedef struct {
+    RangeJob* job;
+    size_t index;
+} RangeProgressCtx;
+
+static gint64 monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static gboolean read_sysfs_u64(const char* path, uint64_t* value) {
+    FILE* f = fopen(path, "r");
+    if (!f) return FALSE;
+    unsigned long long v;
+    gboolean ok = fscanf(f, "%llu", &v) == 1;
+    fclose(f);
+    if (ok) *value = v;
+    return ok;
+}
+
+static gboolean read_sysfs_line(const char* path, char* buffer, size_t size) {
+    FILE* f = fopen(path, "r");
+    if (!f) return FALSE;
+    gboolean ok = fgets(buffer, (int)size, f) != NULL;
+    fclose(f);
+    if (ok) buffer[strcspn(buffer, "\n")] = '\0';
+    return ok;
+}
+
+void range_wipe_default_options(RangeWipeOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->pattern = BULK_PATTERN_ZEROS;
+    options->workers_per_range = 4;
+    options->max_parallel_ranges = 4;
+    options->rotational = -1;
+    options->verify_lag = BULK_IO_DEFAULT_VERIFY_LAG;
+}
+
+static int compare_extents(const void* a, const void* b) {
+    const RangeExtent* x = a;
+    const RangeExtent* y = b;
+    if (x->start_sector < y->start_sector) return -1;
+    if (x->start_sector > y->start_sector) return 1;
+    return 0;
+}
+
+gboolean range_wipe_list_partitions(const char* root,
+                                    const char* disk_name,
+                                    RangeExtent** extents,
+                                    size_t* count,
+                                    GError** error) {
+    char dir_path[512];
+    snprintf(dir_path, sizeof(dir_path), "%s/sys/block/%s", root ? root : "", disk_name);
+
+    DIR* dir = opendir(dir_path);
+    if (!dir) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Failed to open %s", dir_path);
+        return FALSE;
+    }
+
+    size_t capacity = 8;
+    size_t n = 0;
+    RangeExtent* list = g_new0(RangeExtent, capacity);
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // Partition directories are named after the disk ("sda1", "nvme0n1p2")
+        if (strncmp(entry->d_name, disk_name, strlen(disk_name)) != 0) continue;
+        if (strlen(entry->d_name) >= sizeof(list[0].name)) continue;
+
+        char path[768];
+        uint64_t start, size;
+        snprintf(path, sizeof(path), "%s/%s/start", dir_path, entry->d_name);
+        if (!read_sysfs_u64(path, &start)) continue;
+        snprintf(path, sizeof(path), "%s/%s/size", dir_path, entry->d_name);
+        if (!read_sysfs_u64(path, &size)) continue;
+
+        if (n == capacity) {
+            capacity *= 2;
+            RangeExtent* grown = g_new0(RangeExtent, capacity);
+            memcpy(grown, list, n * sizeof(RangeExtent));
+            g_free(list);
+            list = grown;
+        }
+        snprintf(list[n].name, sizeof(list[n].name), "%s", entry->d_name);
+        list[n].start_sector = start;
+        list[n].size_sectors = size;
+        n++;
+    }
+    closedir(dir);
+
+    qsort(list, n, sizeof(RangeExtent), compare_extents);
+    *extents = list;
+    *count = n;
+    return TRUE;
+}
+
+// Collect the "major:minor" of every mounted filesystem
+static char* read_mounted_devices(const char* root) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/proc/self/mountinfo", root ? root : "");
+    FILE* f = fopen(path, "r");
+    if (!f) return NULL;
+
+    size_t length = 0;
+    size_t capacity = 1024;
+    char* result = malloc(capacity);
+    if (!result) {
+        fclose(f);
+        return NULL;
+    }
+    result[0] = '\0';
+
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        // mount-id parent-id major:minor root mount-point ...
+        unsigned int mount_id, parent_id, major_id, minor_id;
+        if (sscanf(line, "%u %u %u:%u", &mount_id, &parent_id, &major_id, &minor_id) != 4) continue;
+
+        char token[32];
+        int n = snprintf(token, sizeof(token), " %u:%u ", major_id, minor_id);
+        if (length + (size_t)n + 1 > capacity) {
+            capacity *= 2;
+            char* grown = realloc(result, capacity);
+            if (!grown) break;
+            result = grown;
+        }
+        memcpy(result + length, token, (size_t)n + 1);
+        length += (size_t)n;
+    }
+
+    fclose(f);
+    return result;
+}
+
+static gboolean is_mounted(const char* mounted, const char* sysfs_dir) {
+    char path[768];
+    char dev[32];
+    snprintf(path, sizeof(path), "%s/dev", sysfs_dir);
+    if (!read_sysfs_line(path, dev, sizeof(dev))) return FALSE;
+
+    char token[40];
+    snprintf(token, sizeof(token), " %s ", dev);
+    return strstr(mounted, token) != NULL;
+}
+
+gboolean range_wipe_validate(const char* root,
+                             const char* disk_name,
+                             uint64_t disk_sectors,
+                             const RangeExtent* extents,
+                             size_t count,
+                             GError** error) {
+    if (count == 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "No ranges selected");
+        return FALSE;
+    }
+
+    if (disk_name) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/sys/block/%s/size", root ? root : "", disk_name);
+        if (!read_sysfs_u64(path, &disk_sectors)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Unknown disk %s", disk_name);
+            return FALSE;
+        }
+    }
+
+    RangeExtent* sorted = g_new(RangeExtent, count);
+    memcpy(sorted, extents, count * sizeof(RangeExtent));
+    qsort(sorted, count, sizeof(RangeExtent), compare_extents);
+
+    gboolean ok = TRUE;
+    for (size_t i = 0; i < count && ok; i++) {
+        const RangeExtent* extent = &sorted[i];
+        if (extent->size_sectors == 0 ||
+            extent->start_sector + extent->size_sectors > disk_sectors ||
+            extent->start_sector + extent->size_sectors < extent->start_sector) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                        "Range %s at sector %llu lies outside the disk",
+                        extent->name[0] ? extent->name : "(raw)",
+                        (unsigned long long)extent->start_sector);
+            ok = FALSE;
+        } else if (i > 0 &&
+                   sorted[i - 1].start_sector + sorted[i - 1].size_sectors > extent->start_sector) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                        "Ranges at sectors %llu and %llu overlap",
+                        (unsigned long long)sorted[i - 1].start_sector,
+                        (unsigned long long)extent->start_sector);
+            ok = FALSE;
+        }
+    }
+
+    if (ok && disk_name) {
+        char* mounted = read_mounted_devices(root);
+        if (!mounted) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to read /proc/self/mountinfo");
+            ok = FALSE;
+        } else {
+            char dir_path[512];
+            snprintf(dir_path, sizeof(dir_path), "%s/sys/block/%s", root ? root : "", disk_name);
+            if (is_mounted(mounted, dir_path)) {
+                g_set_error(error, G_IO_ERROR, G_IO_ERROR_BUSY, "%s is mounted", disk_name);
+                ok = FALSE;
+            }
+
+            // A raw range must not touch any mounted partition either
+            RangeExtent* partitions = NULL;
+            size_t partition_count = 0;
+            if (ok && range_wipe_list_partitions(root, disk_name, &partitions, &partition_count, NULL)) {
+                for (size_t p = 0; p < partition_count && ok; p++) {
+                    const RangeExtent* partition = &partitions[p];
+                    for (size_t i = 0; i < count && ok; i++) {
+                        const RangeExtent* extent = &sorted[i];
+                        gboolean selected = extent->name[0]
+                            ? strcmp(extent->name, partition->name) == 0
+                            : extent->start_sector < partition->start_sector + partition->size_sectors &&
+                              partition->start_sector < extent->start_sector + extent->size_sectors;
+                        if (!selected) continue;
+
+                        char part_dir[768];
+                        snprintf(part_dir, sizeof(part_dir), "%s/%s", dir_path, partition->name);
+                        if (is_mounted(mounted, part_dir)) {
+                            g_set_error(error, G_IO_ERROR, G_IO_ERROR_BUSY,
+                                        "%s is mounted", partition->name);
+                            ok = FALSE;
+                        }
+                    }
+                }
+                g_free(partitions);
+            }
+            free(mounted);
+        }
+    }
+
+    g_free(sorted);
+    return ok;
+}
+
+static void fail_job(RangeJob* job, GError* error) {
+    pthread_mutex_lock(&job->lock);
+    if (!job->error) {
+        job->error = error;
+    } else {
+        g_error_free(error);
+    }
+    pthread_mutex_unlock(&job->lock);
+    __atomic_store_n(&job->abort, 1, __ATOMIC_RELAXED);
+}
+
+static void range_progress_cb(const BulkProgress* progress, void* user_data) {
+    RangeProgressCtx* ctx = user_data;
+    __atomic_store_n(&ctx->job->range_done[ctx->index], progress->bytes_done, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->job->range_verified[ctx->index], progress->bytes_verified, __ATOMIC_RELAXED);
+}
+
+static void wipe_one_range(RangeJob* job, size_t index) {
+    const RangeExtent* extent = &job->extents[index];
+    const RangeTarget* target = &job->targets[index];
+
+    RangeProgressCtx ctx = { job, index };
+    BulkWriteOptions options;
+    bulk_io_default_options(&options);
+    options.offset = target->offset;
+    options.length = extent->size_sectors * RANGE_WIPE_SECTOR_SIZE;
+    options.chunk_size = job->chunk_size;
+    options.pattern = job->options->pattern;
+    options.max_workers = job->workers_per_range;
+    options.progress = range_progress_cb;
+    options.user_data = &ctx;
+    options.cancel = &job->abort;
+    options.verify = job->options->verify;
+    options.verify_lag = job->options->verify_lag;
+    options.verify_fd = target->verify_fd;
+    options.placement = job->options->placement;
+    options.placement_stats = job->options->placement_stats;
+    options.throttle = job->options->throttle;
+    options.backend = job->backend;
+
+    BulkWriteResult result = { 0 };
+    GError* error = NULL;
+    if (!bulk_io_write(target->fd, &options, &result, &error)) {
+        if (!__atomic_load_n(&job->abort, __ATOMIC_RELAXED) || error->code != G_IO_ERROR_CANCELLED) {
+            fail_job(job, error);
+        } else {
+            g_error_free(error);
+        }
+    } else if (job->backend->sync(target->fd, job->backend->ctx) < 0) {
+        error = NULL;
+        g_set_error(&error, G_IO_ERROR, G_IO_ERROR_FAILED, "fdatasync %s failed: %s",
+                    target->path, strerror(errno));
+        fail_job(job, error);
+    }
+    __atomic_store_n(&job->range_done[index], result.bytes_written, __ATOMIC_RELAXED);
+    __atomic_store_n(&job->range_verified[index], result.bytes_verified, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&job->mismatches, result.verify_mismatches, __ATOMIC_RELAXED);
+}
+
+static void* range_pool_func(void* data) {
+    RangeJob* job = data;
+    while (!__atomic_load_n(&job->abort, __ATOMIC_RELAXED)) {
+        size_t index = __atomic_fetch_add(&job->next_range, 1, __ATOMIC_RELAXED);
+        if (index >= job->count) break;
+        wipe_one_range(job, index);
+    }
+    __atomic_fetch_sub(&job->running, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static int open_exclusive(const DeviceBackend* backend, const char* path, GError** error) {
+    int fd = backend->open_device(path, O_RDWR | O_EXCL, backend->ctx);
+    if (fd < 0) {
+        g_set_error(error, G_IO_ERROR, errno == EBUSY ? G_IO_ERROR_BUSY : G_IO_ERROR_FAILED,
+                    "Failed to open %s: %s", path, strerror(errno));
+    }
+    return fd;
+}
+
+// The read-back bypasses the page cache so it sees what reached the media
+static int open_verify(const DeviceBackend* backend, const char* path, GError** error) {
+    int fd = backend->open_device(path, O_RDONLY | O_DIRECT, backend->ctx);
+    if (fd < 0 && errno == EINVAL) {
+        fd = backend->open_device(path, O_RDONLY, backend->ctx);
+    }
+    if (fd < 0) {
+        int saved = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Failed to open %s: %s", path, strerror(saved));
+    }
+    return fd;
+}
+
+// Claim what the ranges are written through before any worker starts. A
+// partition cannot be claimed while its whole disk is, so either every
+// range is a named partition and each is claimed through its own node, or
+// the disk is claimed once and all ranges are written at their disk offset.
+static gboolean open_targets(RangeJob* job, const char* disk_path, GError** error) {
+    gboolean whole_disk = FALSE;
+    for (size_t i = 0; i < job->count; i++) {
+        if (!job->extents[i].name[0]) whole_disk = TRUE;
+    }
+
+    for (size_t i = 0; i < job->count; i++) {
+        job->targets[i].fd = -1;
+        job->targets[i].verify_fd = -1;
+    }
+
+    for (size_t i = 0; i < job->count; i++) {
+        const RangeExtent* extent = &job->extents[i];
+        RangeTarget* target = &job->targets[i];
+        if (whole_disk) {
+            snprintf(target->path, sizeof(target->path), "%s", disk_path);
+            target->offset = extent->start_sector * RANGE_WIPE_SECTOR_SIZE;
+            if (i > 0) {
+                target->fd = job->targets[0].fd;
+                target->verify_fd = job->targets[0].verify_fd;
+                continue;
+            }
+        } else {
+            snprintf(target->path, sizeof(target->path), "/dev/%s", extent->name);
+            target->offset = 0;
+        }
+
+        target->fd = open_exclusive(job->backend, target->path, error);
+        if (target->fd < 0) return FALSE;
+        if (job->options->verify) {
+            target->verify_fd = open_verify(job->backend, target->path, error);
+            if (target->verify_fd < 0) return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void close_targets(RangeJob* job) {
+    for (size_t i = 0; i < job->count; i++) {
+        RangeTarget* target = &job->targets[i];
+        // Shared descriptors belong to the first range that opened them
+        if (target->fd >= 0 && (i == 0 || target->fd != job->targets[0].fd)) {
+            job->backend->close_device(target->fd, job->backend->ctx);
+        }
+        if (target->verify_fd >= 0 && (i == 0 || target->verify_fd != job->targets[0].verify_fd)) {
+            job->backend->close_device(target->verify_fd, job->backend->ctx);
+        }
+    }
+}
+
+// Read queue attributes of the disk behind @disk_path; image files report none
+static void read_queue_hints(const DeviceBackend* backend, const char* disk_path,
+                             int* rotational, uint64_t* optimal_io) {
+    *optimal_io = 0;
+    if (backend != device_backend_linux()) {
+        // Simulated disks answer by kernel name
+        const char* name = strrchr(disk_path, '/') ? strrchr(disk_path, '/') + 1 : disk_path;
+        uint64_t value;
+        if (*rotational < 0) {
+            *rotational = device_backend_read_u64(backend, name, "queue/rotational", &value) && value;
+        }
+        if (device_backend_read_u64(backend, name, "queue/optimal_io_size", &value)) *optimal_io = value;
+        if (device_backend_read_u64(backend, name, "queue/physical_block_size", &value) &&
+            value > *optimal_io) {
+            *optimal_io = value;
+        }
+        return;
+    }
+
+    struct stat st;
+    if (stat(disk_path, &st) < 0 || !S_ISBLK(st.st_mode)) {
+        if (*rotational < 0) *rotational = 0;
+        return;
+    }
+
+    char path[512];
+    uint64_t value;
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/queue/rotational",
+             major(st.st_rdev), minor(st.st_rdev));
+    if (*rotational < 0) {
+        *rotational = read_sysfs_u64(path, &value) ? (value != 0) : 0;
+    }
+
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/queue/optimal_io_size",
+             major(st.st_rdev), minor(st.st_rdev));
+    if (read_sysfs_u64(path, &value)) *optimal_io = value;
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/queue/physical_block_size",
+             major(st.st_rdev), minor(st.st_rdev));
+    if (read_sysfs_u64(path, &value) && value > *optimal_io) *optimal_io = value;
+}
+
+gboolean range_wipe_execute(const char* disk_path,
+                            const RangeWipeOptions* options,
+                            RangeWipeResult* result,
+                            GError** error) {
+    gint64 start_us = monotonic_us();
+
+    const DeviceBackend* backend = options->backend ? options->backend : device_backend_linux();
+    int rotational = options->rotational;
+    uint64_t optimal_io;
+    read_queue_hints(backend, disk_path, &rotational, &optimal_io);
+
+    // Round the chunk up to whole optimal I/O units so every request stays
+    // aligned inside the range
+    size_t chunk = options->chunk_size ? options->chunk_size : BULK_IO_DEFAULT_CHUNK_SIZE;
+    if (optimal_io > 0 && chunk % optimal_io) {
+        chunk += optimal_io - chunk % optimal_io;
+    }
+
+    RangeJob job;
+    memset(&job, 0, sizeof(job));
+    job.options = options;
+    job.backend = backend;
+    job.count = options->count;
+    job.chunk_size = chunk;
+    job.extents = g_new(RangeExtent, options->count);
+    job.targets = g_new0(RangeTarget, options->count);
+    job.range_done = g_new0(uint64_t, options->count);
+    job.range_verified = g_new0(uint64_t, options->count);
+    memcpy(job.extents, options->extents, options->count * sizeof(RangeExtent));
+    qsort(job.extents, job.count, sizeof(RangeExtent), compare_extents);
+    pthread_mutex_init(&job.lock, NULL);
+
+    // One sequential stream per spindle; disjoint ranges in parallel on flash
+    guint pool_size = 1;
+    job.workers_per_range = 1;
+    if (!rotational) {
+        pool_size = options->max_parallel_ranges ? options->max_parallel_ranges : 1;
+        if (pool_size > RANGE_WIPE_MAX_PARALLEL) pool_size = RANGE_WIPE_MAX_PARALLEL;
+        if (pool_size > job.count) pool_size = (guint)job.count;
+        job.workers_per_range = options->workers_per_range ? options->workers_per_range : 1;
+    }
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < job.count; i++) {
+        total += job.extents[i].size_sectors * RANGE_WIPE_SECTOR_SIZE;
+    }
+
+    pthread_t threads[RANGE_WIPE_MAX_PARALLEL];
+    guint started = 0;
+    GError* open_error = NULL;
+    if (!open_targets(&job, disk_path, &open_error)) {
+        fail_job(&job, open_error);
+        pool_size = 0;
+    }
+    job.running = (gint)pool_size;
+    for (guint i = 0; i < pool_size; i++) {
+        if (pthread_create(&threads[i], NULL, range_pool_func, &job) != 0) break;
+        started++;
+    }
+    __atomic_fetch_sub(&job.running, (gint)(pool_size - started), __ATOMIC_RELAXED);
+    if (started == 0 && pool_size > 0) {
+        GError* start_error = NULL;
+        g_set_error(&start_error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to start range workers");
+        fail_job(&job, start_error);
+    }
+
+    // Aggregate progress across ranges, feed the throttle and forward user
+    // cancellation. The ranges' own control loops also close throttle
+    // windows; whichever gets there first evaluates it.
+    gint64 last_progress_us = 0;
+    gint64 last_tick_us = 0;
+    IoThrottleState state;
+    if (options->throttle) io_throttle_get_state(options->throttle, &state);
+    while (__atomic_load_n(&job.running, __ATOMIC_ACQUIRE) > 0) {
+        struct timespec ts = { 0, 50 * 1000000 };
+        nanosleep(&ts, NULL);
+
+        if (options->cancel && *options->cancel) {
+            __atomic_store_n(&job.abort, 1, __ATOMIC_RELAXED);
+        }
+
+        gint64 now = monotonic_us();
+        if (options->throttle && now - last_tick_us >= RANGE_WIPE_THROTTLE_TICK_US) {
+            if (options->temperature) {
+                io_throttle_set_temperature(options->throttle,
+                                            options->temperature(options->temperature_ctx));
+            }
+            io_throttle_update(options->throttle, now);
+            io_throttle_get_state(options->throttle, &state);
+            last_tick_us = now;
+        }
+
+        if (options->progress && now - last_progress_us >= RANGE_WIPE_PROGRESS_INTERVAL_US) {
+            uint64_t done = 0, verified = 0;
+            for (size_t i = 0; i < job.count; i++) {
+                done += __atomic_load_n(&job.range_done[i], __ATOMIC_RELAXED);
+                verified += __atomic_load_n(&job.range_verified[i], __ATOMIC_RELAXED);
+            }
+            BulkProgress progress = {
+                .bytes_done = done,
+                .bytes_total = total,
+                .bytes_verified = verified,
+                .elapsed_us = now - start_us,
+                .throttle = options->throttle ? &state : NULL,
+            };
+            options->progress(&progress, options->user_data);
+            last_progress_us = now;
+        }
+    }
+
+    for (guint i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    uint64_t done = 0, verified = 0;
+    for (size_t i = 0; i < job.count; i++) {
+        done += job.range_done[i];
+        verified += job.range_verified[i];
+    }
+    if (result) {
+        result->bytes_written = done;
+        result->bytes_verified = verified;
+        result->verify_mismatches = job.mismatches;
+        result->elapsed_us = monotonic_us() - start_us;
+        result->sequential = pool_size == 1;
+    }
+
+    gboolean ok = job.error == NULL;
+    if (job.error) {
+        g_propagate_error(error, job.error);
+    } else if (options->cancel && *options->cancel) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Wipe cancelled");
+        ok = FALSE;
+    }
+
+    close_targets(&job);
+    pthread_mutex_destroy(&job.lock);
+    g_free(job.extents);
+    g_free(job.targets);
+    g_free(job.range_done);
+    g_free(job.range_verified);
+    return ok;
+}
+
+FlValue* range_wipe_extents_to_fl_value(const RangeExtent* extents, size_t count) {
+    FlValue* list = fl_value_new_list();
+    for (size_t i = 0; i < count; i++) {
+        FlValue* extent = fl_value_new_map();
+        fl_value_set_string_take(extent, "name", fl_value_new_string(extents[i].name));
+        fl_value_set_string_take(extent, "startSector", fl_value_new_int((int64_t)extents[i].start_sector));
+        fl_value_set_string_take(extent, "sizeSectors", fl_value_new_int((int64_t)extents[i].size_sectors));
+        fl_value_append_take(list, extent);
+    }
+    return list;
+}
@@ -0,0 +1,115 @@
+#ifndef RANGE_WIPE_H
+#define RANGE_WIPE_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdint.h>
+#include "bulk_io.h"
+
+G_BEGIN_DECLS
+
+// sysfs reports partition start and size in 512-byte units
+#define RANGE_WIPE_SECTOR_SIZE 512
+
+typedef struct {
+    char name[64];            // partition name (e.g. "sda2"), empty for a raw range
+    uint64_t start_sector;    // offset from the start of the disk
+    uint64_t size_sectors;
+} RangeExtent;
+
+typedef struct {
+    const RangeExtent* extents;
+    size_t count;
+    BulkPattern pattern;
+    size_t chunk_size;        // 0 = derived from the queue's optimal I/O size
+    guint workers_per_range;  // concurrent requests inside one range (SSD only)
+    guint max_parallel_ranges;
+    int rotational;           // -1 = read queue/rotational, 0 = SSD, 1 = HDD
+    BulkProgressCallback progress;
+    void* user_data;
+    const volatile gint* cancel;
+    gboolean verify;          // read each range back behind its writes (see bulk_io_write())
+    guint verify_lag;         // chunks the read-back trails by
+    const NumaPlacement* placement;       // optional, passed on to bulk_io_write()
+    NumaPlacementStats* placement_stats;  // optional, summed over all ranges
+    IoThrottle* throttle;             // optional, shared by all ranges of the disk
+    IoTemperatureSource temperature;  // optional, fed into the throttle
+    void* temperature_ctx;
+    const DeviceBackend* backend;     // optional, NULL writes through the kernel
+} RangeWipeOptions;
+
+typedef struct {
+    uint64_t bytes_written;
+    uint64_t bytes_verified;
+    uint64_t verify_mismatches;  // chunks that did not read back as written
+    gint64 elapsed_us;
+    gboolean sequential;      // ranges were processed one after another
+} RangeWipeResult;
+
+void range_wipe_default_options(RangeWipeOptions* options);
+
+/**
+ * range_wipe_list_partitions:
+ * @root: (nullable): directory holding "sys", NULL for the running system
+ * @disk_name: block device name (e.g. "sda")
+ * @extents: (out) (transfer full): partition extents from
+ *   /sys/block/X/Y/{start,size}, sorted by start; free with g_free()
+ *
+ * Returns: TRUE on success
+ */
+gboolean range_wipe_list_partitions(const char* root,
+                                    const char* disk_name,
+                                    RangeExtent** extents,
+                                    size_t* count,
+                                    GError** error);
+
+/**
+ * range_wipe_validate:
+ * @root: (nullable): directory holding "sys" and "proc", NULL for the
+ *   running system; tests point it at a fixture tree
+ * @disk_name: block device name, or NULL for an image file of @disk_sectors
+ *
+ * Checks that the extents are non-empty, lie inside the disk, do not
+ * overlap, and that neither the disk nor any selected partition is mounted
+ * according to /proc/self/mountinfo.
+ *
+ * Returns: TRUE when the extents may be wiped
+ */
+gboolean range_wipe_validate(const char* root,
+                             const char* disk_name,
+                             uint64_t disk_sectors,
+                             const RangeExtent* extents,
+                             size_t count,
+                             GError** error);
+
+/**
+ * range_wipe_execute:
+ * @disk_path: whole-disk node (e.g. "/dev/sda") or a partitioned image file
+ *
+ * Overwrites every extent. The descriptors are opened once, before any
+ * write, and shared by the workers, which write with pwrite(). When every
+ * extent is a named partition, each is claimed through its own node with
+ * O_EXCL so other, mounted partitions of the disk stay usable; otherwise
+ * @disk_path itself is claimed with O_EXCL and every range is written
+ * through it at its disk offset. On rotational disks ranges are
+ * processed one at a time in LBA order with a single stream so the head
+ * never seeks between them; on SSDs up to @max_parallel_ranges run at once.
+ * With @verify, each range is read back through an O_DIRECT descriptor in
+ * the same sweep, a few chunks behind the write front.
+ *
+ * With a throttle, every range's writers follow its rate limit, and its
+ * queue depth bounds the workers of each range. The calling thread polls
+ * @temperature, runs the control loop and reports the throttle state with
+ * the aggregate progress.
+ *
+ * Returns: TRUE when all extents were written
+ */
+gboolean range_wipe_execute(const char* disk_path,
+                            const RangeWipeOptions* options,
+                            RangeWipeResult* result,
+                            GError** error);
+
+FlValue* range_wipe_extents_to_fl_value(const RangeExtent* extents, size_t count);
+
+G_END_DECLS
+
+#endif // RANGE_WIPE_H
@@ -0,0 +1,222 @@
+#include "sha256.h"
+#include <string.h>
+
+#if defined(__x86_64__) && !defined(SHA256_GENERIC_ONLY)
+#define SHA256_HAVE_SHANI 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+// FIPS 180-4 SHA-256
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_compress_generic(uint32_t state[8], const uint8_t* blocks, size_t count) {
+    while (count--) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t)blocks[i * 4] << 24 | (uint32_t)blocks[i * 4 + 1] << 16 |
+                   (uint32_t)blocks[i * 4 + 2] << 8 | (uint32_t)blocks[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        blocks += SHA256_BLOCK_SIZE;
+    }
+}
+
+#ifdef SHA256_HAVE_SHANI
+// Rounds 4i..4i+3 of the SHA extensions schedule. @cur holds message words
+// 4i..4i+3; @prev and @next are the groups before and after it in the
+// rotation of four. The conditions fold away since @i is a literal.
+#define SHANI_ROUNDS4(i, cur, prev, next)                                          \
+    do {                                                                           \
+        __m128i rounds = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i*)&K[(i) * 4])); \
+        state1 = _mm_sha256rnds2_epu32(state1, state0, rounds);                    \
+        if ((i) >= 3 && (i) <= 14) {                                               \
+            next = _mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4));            \
+            next = _mm_sha256msg2_epu32(next, cur);                                \
+        }                                                                          \
+        rounds = _mm_shuffle_epi32(rounds, 0x0E);                                  \
+        state0 = _mm_sha256rnds2_epu32(state0, state1, rounds);                    \
+        if ((i) >= 1 && (i) <= 12) prev = _mm_sha256msg1_epu32(prev, cur);        \
+    } while (0)
+
+// Intel SHA extensions: the state is kept as ABEF/CDGH for sha256rnds2
+__attribute__((target("sha,sse4.1")))
+static void sha256_compress_shani(uint32_t state[8], const uint8_t* blocks, size_t count) {
+    const __m128i byteswap = _mm_set_epi64x(0x0c0d0e0f08090a0bll, 0x0405060700010203ll);
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    while (count--) {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + 0)), byteswap);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + 16)), byteswap);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + 32)), byteswap);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + 48)), byteswap);
+
+        SHANI_ROUNDS4(0, m0, m3, m1);
+        SHANI_ROUNDS4(1, m1, m0, m2);
+        SHANI_ROUNDS4(2, m2, m1, m3);
+        SHANI_ROUNDS4(3, m3, m2, m0);
+        SHANI_ROUNDS4(4, m0, m3, m1);
+        SHANI_ROUNDS4(5, m1, m0, m2);
+        SHANI_ROUNDS4(6, m2, m1, m3);
+        SHANI_ROUNDS4(7, m3, m2, m0);
+        SHANI_ROUNDS4(8, m0, m3, m1);
+        SHANI_ROUNDS4(9, m1, m0, m2);
+        SHANI_ROUNDS4(10, m2, m1, m3);
+        SHANI_ROUNDS4(11, m3, m2, m0);
+        SHANI_ROUNDS4(12, m0, m3, m1);
+        SHANI_ROUNDS4(13, m1, m0, m2);
+        SHANI_ROUNDS4(14, m2, m1, m3);
+        SHANI_ROUNDS4(15, m3, m2, m0);
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        blocks += SHA256_BLOCK_SIZE;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, state1, 0xF0));
+    _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+static gboolean cpu_has_shani(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1)) return FALSE;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return FALSE;
+    return (ebx & (1u << 29)) != 0;
+}
+#endif
+
+typedef void (*Sha256CompressFunc)(uint32_t state[8], const uint8_t* blocks, size_t count);
+
+static Sha256CompressFunc resolve_compress(void) {
+    static Sha256CompressFunc resolved;
+    Sha256CompressFunc func = __atomic_load_n(&resolved, __ATOMIC_RELAXED);
+    if (func == NULL) {
+        func = sha256_compress_generic;
+#ifdef SHA256_HAVE_SHANI
+        if (cpu_has_shani()) func = sha256_compress_shani;
+#endif
+        __atomic_store_n(&resolved, func, __ATOMIC_RELAXED);
+    }
+    return func;
+}
+
+static void sha256_compress(uint32_t state[8], const uint8_t* blocks, size_t count) {
+    resolve_compress()(state, blocks, count);
+}
+
+gboolean sha256_accelerated(void) {
+    return resolve_compress() != sha256_compress_generic;
+}
+
+void sha256_init(Sha256Context* ctx) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->buffered = 0;
+}
+
+void sha256_update(Sha256Context* ctx, const void* data, size_t length) {
+    const uint8_t* bytes = data;
+    ctx->length += length;
+
+    if (ctx->buffered > 0) {
+        size_t take = SHA256_BLOCK_SIZE - ctx->buffered;
+        if (take > length) take = length;
+        memcpy(ctx->buffer + ctx->buffered, bytes, take);
+        ctx->buffered += take;
+        bytes += take;
+        length -= take;
+        if (ctx->buffered < SHA256_BLOCK_SIZE) return;
+        sha256_compress(ctx->state, ctx->buffer, 1);
+        ctx->buffered = 0;
+    }
+
+    // Whole blocks straight from the caller's buffer
+    size_t blocks = length / SHA256_BLOCK_SIZE;
+    if (blocks > 0) {
+        sha256_compress(ctx->state, bytes, blocks);
+        bytes += blocks * SHA256_BLOCK_SIZE;
+        length -= blocks * SHA256_BLOCK_SIZE;
+    }
+
+    memcpy(ctx->buffer, bytes, length);
+    ctx->buffered = length;
+}
+
+void sha256_final(Sha256Context* ctx, uint8_t digest[SHA256_DIGEST_SIZE]) {
+    uint64_t bits = ctx->length * 8;
+    uint8_t pad[SHA256_BLOCK_SIZE * 2] = { 0x80 };
+    size_t pad_length = (ctx->buffered < 56 ? 56 : 120) - ctx->buffered;
+    for (int i = 0; i < 8; i++) {
+        pad[pad_length + i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    sha256_update(ctx, pad, pad_length + 8);
+
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = (uint8_t)(ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)ctx->state[i];
+    }
+}
+
+void sha256_digest(const void* data, size_t length, uint8_t digest[SHA256_DIGEST_SIZE]) {
+    Sha256Context ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, length);
+    sha256_final(&ctx, digest);
+}
+
+void sha256_to_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char* hex) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0x0f];
+    }
+    hex[SHA256_DIGEST_SIZE * 2] = '\0';
+}
@@ -0,0 +1,36 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;                  // bytes hashed so far
+    uint8_t buffer[SHA256_BLOCK_SIZE];
+    size_t buffered;
+} Sha256Context;
+
+void sha256_init(Sha256Context* ctx);
+void sha256_update(Sha256Context* ctx, const void* data, size_t length);
+void sha256_final(Sha256Context* ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+// One-shot digest of @data
+void sha256_digest(const void* data, size_t length, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+// Whether blocks are compressed with the CPU's SHA instructions (x86 SHA-NI),
+// picked at first use; the digest is the same either way
+gboolean sha256_accelerated(void);
+
+// Lowercase hex into @hex, which must hold 2 * SHA256_DIGEST_SIZE + 1 bytes
+void sha256_to_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char* hex);
+
+G_END_DECLS
+
+#endif // SHA256_H
@@ -0,0 +1,49 @@
+#include "startup_timing.h"
+
+static gint64 marks[STARTUP_MARK_COUNT];
+
+static const char* mark_names[STARTUP_MARK_COUNT] = {
+    "launch",
+    "prefetchStarted",
+    "devicesReady",
+    "disksReady",
+    "engineReady",
+    "firstFrame",
+    "firstDeviceList",
+    "firstDiskInfo",
+};
+
+void startup_timing_mark(StartupMark mark) {
+    gint64 expected = 0;
+    gint64 now = g_get_monotonic_time();
+    if (!__atomic_compare_exchange_n(&marks[mark], &expected, now, FALSE,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    if (mark == STARTUP_MARK_FIRST_DEVICE_LIST) {
+        g_message("Startup: first device list after %.1f ms "
+                  "(devices ready at %.1f ms, engine ready at %.1f ms)",
+                  startup_timing_elapsed_ms(STARTUP_MARK_FIRST_DEVICE_LIST),
+                  startup_timing_elapsed_ms(STARTUP_MARK_DEVICES_READY),
+                  startup_timing_elapsed_ms(STARTUP_MARK_ENGINE_READY));
+    }
+}
+
+double startup_timing_elapsed_ms(StartupMark mark) {
+    gint64 launch = __atomic_load_n(&marks[STARTUP_MARK_LAUNCH], __ATOMIC_RELAXED);
+    gint64 at = __atomic_load_n(&marks[mark], __ATOMIC_RELAXED);
+    if (launch == 0 || at == 0) return -1;
+    return (at - launch) / 1000.0;
+}
+
+FlValue* startup_timing_to_fl_value(void) {
+    FlValue* value = fl_value_new_map();
+    for (int i = 0; i < STARTUP_MARK_COUNT; i++) {
+        double elapsed = startup_timing_elapsed_ms((StartupMark)i);
+        if (elapsed >= 0) {
+            fl_value_set_string_take(value, mark_names[i], fl_value_new_float(elapsed));
+        }
+    }
+    return value;
+}
@@ -0,0 +1,47 @@
+#ifndef STARTUP_TIMING_H
+#define STARTUP_TIMING_H
+
+#include <flutter_linux/flutter_linux.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Process-wide startup milestones, recorded once each on the monotonic
+ * clock. Used to measure how long the user waits for the first device list
+ * and how much of that the background prefetch hides behind engine boot.
+ */
+
+typedef enum {
+    STARTUP_MARK_LAUNCH = 0,        // application object created
+    STARTUP_MARK_PREFETCH_STARTED,  // enumeration threads spawned
+    STARTUP_MARK_DEVICES_READY,     // device enumeration and identity probes done
+    STARTUP_MARK_DISKS_READY,       // first disk snapshot published
+    STARTUP_MARK_ENGINE_READY,      // view realized, plugins registered
+    STARTUP_MARK_FIRST_FRAME,
+    STARTUP_MARK_FIRST_DEVICE_LIST, // first getDeviceList answered
+    STARTUP_MARK_FIRST_DISK_INFO,   // first getDiskInfo answered
+    STARTUP_MARK_COUNT,
+} StartupMark;
+
+/**
+ * startup_timing_mark:
+ *
+ * Records @mark at the current time unless it was already recorded. Safe to
+ * call from any thread. Logs a summary when the first device list is sent.
+ */
+void startup_timing_mark(StartupMark mark);
+
+// Milliseconds from launch to @mark, or -1 if it was not reached yet
+double startup_timing_elapsed_ms(StartupMark mark);
+
+/**
+ * startup_timing_to_fl_value:
+ *
+ * Returns: (transfer full): a map from milestone name to milliseconds since
+ *   launch; milestones not reached yet are omitted
+ */
+FlValue* startup_timing_to_fl_value(void);
+
+G_END_DECLS
+
+#endif // STARTUP_TIMING_H
@@ -0,0 +1,467 @@
+#include "surface_scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#define SURFACE_SCAN_PROGRESS_INTERVAL_US 500000
+// How often the calling thread checks whether the workers are done
+#define SURFACE_SCAN_POLL_US 10000
+
+typedef struct {
+    int fd;
+    const SurfaceScanOptions* options;
+    const DeviceBackend* backend;
+    size_t chunk_size;
+    guint block_size;
+    uint64_t start;
+    uint64_t end;
+    uint64_t cell_size;
+    guint cells;
+    uint8_t* heatmap;           // atomic per byte; a cell belongs to one region
+
+    uint64_t bytes_done;        // atomic
+    uint64_t bad_sectors;       // atomic
+    gint running;               // atomic
+    gint failed;                // atomic
+    int failed_errno;
+    uint64_t failed_offset;
+
+    pthread_mutex_t lock;       // guards the extent lists
+    SurfaceScanExtent* bad;
+    guint bad_count;
+    SurfaceScanExtent* slow;
+    guint slow_count;
+    uint64_t slow_reads;
+} ScanJob;
+
+typedef struct {
+    ScanJob* job;
+    SurfaceScanRegion* region;
+    uint8_t* buffer;
+    SurfaceScanExtent pending_bad;  // run of adjacent bad blocks not yet listed
+} ScanWorker;
+
+static gint64 monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_us(gint64 us) {
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+static gboolean is_stopped(const ScanJob* job) {
+    return (job->options->cancel && *job->options->cancel) ||
+           __atomic_load_n(&job->failed, __ATOMIC_RELAXED);
+}
+
+// Errors that mean "this part of the medium is unreadable" rather than
+// "the device is gone"
+static gboolean is_media_error(int error_number) {
+    return error_number == EIO || error_number == ENODATA || error_number == EILSEQ;
+}
+
+static guint latency_bucket(guint latency_us) {
+    if (latency_us < 128) return 0;
+    guint bucket = g_bit_storage(latency_us / 64) - 1;
+    return MIN(bucket, SURFACE_SCAN_HISTOGRAM_BUCKETS - 1);
+}
+
+// pread the whole buffer, retrying short reads and EINTR. Returns the bytes
+// read, less than @size only at the end of the device.
+static ssize_t pread_full(const DeviceBackend* backend, int fd,
+                          uint8_t* buffer, size_t size, uint64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = backend->pread(fd, buffer + done, size - done, offset + done, backend->ctx);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+static void fail(ScanJob* job, int error_number, uint64_t offset) {
+    pthread_mutex_lock(&job->lock);
+    if (!job->failed) {
+        job->failed_errno = error_number;
+        job->failed_offset = offset;
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void set_cell(ScanJob* job, uint64_t offset, uint8_t value) {
+    uint8_t* cell = &job->heatmap[(offset - job->start) / job->cell_size];
+    uint8_t current = __atomic_load_n(cell, __ATOMIC_RELAXED);
+    if (current != SURFACE_SCAN_CELL_UNREADABLE && (value > current)) {
+        __atomic_store_n(cell, value, __ATOMIC_RELAXED);
+    }
+}
+
+static void flush_bad(ScanWorker* worker) {
+    ScanJob* job = worker->job;
+    if (worker->pending_bad.length == 0) return;
+
+    pthread_mutex_lock(&job->lock);
+    if (job->bad_count < SURFACE_SCAN_MAX_EXTENTS) {
+        job->bad[job->bad_count++] = worker->pending_bad;
+    }
+    pthread_mutex_unlock(&job->lock);
+    worker->pending_bad.length = 0;
+}
+
+static void record_bad(ScanWorker* worker, uint64_t offset, uint64_t length) {
+    ScanJob* job = worker->job;
+    SurfaceScanExtent* pending = &worker->pending_bad;
+    if (pending->length > 0 && pending->offset + pending->length == offset) {
+        pending->length += length;
+    } else {
+        flush_bad(worker);
+        pending->offset = offset;
+        pending->length = length;
+    }
+
+    guint sectors = (guint)(length / job->block_size);
+    worker->region->bad_sectors += sectors;
+    __atomic_add_fetch(&job->bad_sectors, sectors, __ATOMIC_RELAXED);
+    set_cell(job, offset, SURFACE_SCAN_CELL_UNREADABLE);
+}
+
+static void record_read(ScanWorker* worker, uint64_t offset, size_t length, guint latency_us) {
+    ScanJob* job = worker->job;
+    SurfaceScanRegion* region = worker->region;
+    guint bucket = latency_bucket(latency_us);
+
+    region->bytes_read += length;
+    region->histogram[bucket]++;
+    region->max_latency_us = MAX(region->max_latency_us, latency_us);
+    set_cell(job, offset, (uint8_t)(bucket + 1));
+
+    guint threshold = job->options->slow_threshold_us;
+    if (threshold > 0 && latency_us >= threshold) {
+        pthread_mutex_lock(&job->lock);
+        if (job->slow_count < SURFACE_SCAN_MAX_EXTENTS) {
+            job->slow[job->slow_count++] = (SurfaceScanExtent){ offset, length, latency_us };
+        }
+        job->slow_reads++;
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+// Splits a failed read in halves until the unreadable blocks are isolated.
+// A single bad block in a 1 MiB chunk of 512-byte blocks costs 22 reads.
+static void bisect(ScanWorker* worker, uint64_t offset, size_t length) {
+    ScanJob* job = worker->job;
+    if (length <= job->block_size) {
+        record_bad(worker, offset, length);
+        return;
+    }
+
+    size_t half = MAX(length / job->block_size / 2, 1) * job->block_size;
+    size_t parts[2] = { half, length - half };
+    uint64_t part_offset = offset;
+    for (int i = 0; i < 2 && !is_stopped(job); i++) {
+        ssize_t n = pread_full(job->backend, job->fd, worker->buffer, parts[i], part_offset);
+        if (n < 0 && is_media_error(errno)) {
+            bisect(worker, part_offset, parts[i]);
+        } else if (n < 0) {
+            fail(job, errno, part_offset);
+        } else {
+            worker->region->bytes_read += (uint64_t)n;
+        }
+        part_offset += parts[i];
+    }
+}
+
+static void* worker_func(void* data) {
+    ScanWorker* worker = data;
+    ScanJob* job = worker->job;
+    SurfaceScanRegion* region = worker->region;
+    uint64_t region_end = region->offset + region->length;
+    // The buffer is untouched so far; its pages fault in on this node
+    numa_placement_bind_thread(job->options->placement, job->options->placement_stats);
+
+    uint64_t offset = region->offset;
+    while (offset < region_end && !is_stopped(job)) {
+        size_t length = (size_t)MIN(job->chunk_size, region_end - offset);
+
+        gint64 started = monotonic_us();
+        ssize_t n = pread_full(job->backend, job->fd, worker->buffer, length, offset);
+        int read_errno = errno;
+        guint latency_us = (guint)MIN(monotonic_us() - started, G_MAXUINT);
+
+        if (n < 0 && is_media_error(read_errno)) {
+            bisect(worker, offset, length);
+        } else if (n < 0) {
+            fail(job, read_errno, offset);
+            break;
+        } else {
+            record_read(worker, offset, (size_t)n, latency_us);
+            if ((size_t)n < length) {
+                // The device ended early; nothing further in this region exists
+                fail(job, ENXIO, offset + (uint64_t)n);
+                break;
+            }
+        }
+        __atomic_add_fetch(&job->bytes_done, length, __ATOMIC_RELAXED);
+        offset += length;
+    }
+
+    flush_bad(worker);
+    __atomic_sub_fetch(&job->running, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void report_progress(ScanJob* job, uint8_t* snapshot, gint64 elapsed_us) {
+    const SurfaceScanOptions* options = job->options;
+    if (!options->progress) return;
+
+    for (guint i = 0; i < job->cells; i++) {
+        snapshot[i] = __atomic_load_n(&job->heatmap[i], __ATOMIC_RELAXED);
+    }
+    SurfaceScanProgress progress = {
+        .bytes_done = __atomic_load_n(&job->bytes_done, __ATOMIC_RELAXED),
+        .bytes_total = job->end - job->start,
+        .elapsed_us = elapsed_us,
+        .bad_sectors = __atomic_load_n(&job->bad_sectors, __ATOMIC_RELAXED),
+        .heatmap = snapshot,
+        .cells = job->cells,
+        .cell_size = job->cell_size,
+    };
+    options->progress(&progress, options->user_data);
+}
+
+static int compare_extents(const void* a, const void* b) {
+    uint64_t x = ((const SurfaceScanExtent*)a)->offset;
+    uint64_t y = ((const SurfaceScanExtent*)b)->offset;
+    return x < y ? -1 : x > y;
+}
+
+// Sorts @extents and joins touching ones; returns the new count
+static guint merge_extents(SurfaceScanExtent* extents, guint count) {
+    if (count == 0) return 0;
+    qsort(extents, count, sizeof(*extents), compare_extents);
+
+    guint merged = 0;
+    for (guint i = 1; i < count; i++) {
+        SurfaceScanExtent* last = &extents[merged];
+        if (extents[i].offset <= last->offset + last->length) {
+            uint64_t end = MAX(last->offset + last->length, extents[i].offset + extents[i].length);
+            last->length = end - last->offset;
+        } else {
+            extents[++merged] = extents[i];
+        }
+    }
+    return merged + 1;
+}
+
+void surface_scan_default_options(SurfaceScanOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->chunk_size = SURFACE_SCAN_DEFAULT_CHUNK_SIZE;
+    options->block_size = 512;
+    options->regions = 1;
+    options->cells = SURFACE_SCAN_DEFAULT_CELLS;
+}
+
+gboolean surface_scan_run(int fd,
+                          const SurfaceScanOptions* options,
+                          SurfaceScanResult* result,
+                          GError** error) {
+    memset(result, 0, sizeof(*result));
+
+    ScanJob job;
+    memset(&job, 0, sizeof(job));
+    job.fd = fd;
+    job.options = options;
+    job.backend = options->backend ? options->backend : device_backend_linux();
+    job.block_size = options->block_size ? options->block_size : 512;
+
+    uint64_t device_size = 0;
+    if (job.backend->device_size(fd, &device_size, job.backend->ctx) < 0) {
+        int saved = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Failed to get device size: %s", g_strerror(saved));
+        return FALSE;
+    }
+    job.start = options->offset;
+    job.end = options->length ? options->offset + options->length : device_size;
+    if (job.start >= job.end || job.end > device_size ||
+        job.start % job.block_size != 0 || job.end % job.block_size != 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "Scan range must be non-empty, block aligned and inside the device");
+        return FALSE;
+    }
+
+    size_t chunk_size = options->chunk_size ? options->chunk_size : SURFACE_SCAN_DEFAULT_CHUNK_SIZE;
+    job.chunk_size = MAX(chunk_size / job.block_size, 1) * job.block_size;
+
+    // Whole chunks per cell so every read lands in exactly one cell
+    uint64_t length = job.end - job.start;
+    guint cells = options->cells ? options->cells : SURFACE_SCAN_DEFAULT_CELLS;
+    uint64_t cell_chunks = MAX((length + (uint64_t)cells * job.chunk_size - 1) /
+                               ((uint64_t)cells * job.chunk_size), 1);
+    job.cell_size = cell_chunks * job.chunk_size;
+    job.cells = (guint)((length + job.cell_size - 1) / job.cell_size);
+    job.heatmap = g_malloc0(job.cells);
+
+    guint region_count = options->regions ? options->regions : 1;
+    region_count = MIN(MIN(region_count, SURFACE_SCAN_MAX_REGIONS), job.cells);
+
+    pthread_mutex_init(&job.lock, NULL);
+    job.bad = g_new(SurfaceScanExtent, SURFACE_SCAN_MAX_EXTENTS);
+    job.slow = g_new(SurfaceScanExtent, SURFACE_SCAN_MAX_EXTENTS);
+
+    pthread_t threads[SURFACE_SCAN_MAX_REGIONS];
+    ScanWorker workers[SURFACE_SCAN_MAX_REGIONS];
+    guint started = 0;
+    gint64 start_us = monotonic_us();
+    job.running = (gint)region_count;
+
+    for (guint i = 0; i < region_count; i++) {
+        SurfaceScanRegion* region = &result->regions[i];
+        uint64_t first_cell = (uint64_t)job.cells * i / region_count;
+        uint64_t end_cell = (uint64_t)job.cells * (i + 1) / region_count;
+        region->offset = job.start + first_cell * job.cell_size;
+        region->length = MIN(job.start + end_cell * job.cell_size, job.end) - region->offset;
+
+        workers[i] = (ScanWorker){ .job = &job, .region = region };
+        workers[i].buffer = numa_placement_alloc(options->placement, job.chunk_size,
+                                                 options->placement_stats);
+        if (!workers[i].buffer) {
+            break;
+        }
+        if (pthread_create(&threads[i], NULL, worker_func, &workers[i]) != 0) {
+            numa_placement_free(workers[i].buffer, job.chunk_size);
+            break;
+        }
+        started++;
+    }
+    // Regions that never started are not scanned; treat that as a failure
+    if (started < region_count) {
+        __atomic_sub_fetch(&job.running, (gint)(region_count - started), __ATOMIC_RELAXED);
+        fail(&job, ENOMEM, job.start);
+    }
+
+    uint8_t* snapshot = g_malloc(job.cells);
+    gint64 last_progress_us = start_us;
+    while (__atomic_load_n(&job.running, __ATOMIC_ACQUIRE) > 0) {
+        sleep_us(SURFACE_SCAN_POLL_US);
+        gint64 now = monotonic_us();
+        if (now - last_progress_us >= SURFACE_SCAN_PROGRESS_INTERVAL_US) {
+            report_progress(&job, snapshot, now - start_us);
+            last_progress_us = now;
+        }
+    }
+
+    for (guint i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        numa_placement_free(workers[i].buffer, job.chunk_size);
+    }
+    result->elapsed_us = monotonic_us() - start_us;
+    report_progress(&job, snapshot, result->elapsed_us);
+    g_free(snapshot);
+
+    result->offset = job.start;
+    result->length = length;
+    result->region_count = started;
+    for (guint i = 0; i < started; i++) {
+        SurfaceScanRegion* region = &result->regions[i];
+        result->bytes_read += region->bytes_read;
+        for (guint b = 0; b < SURFACE_SCAN_HISTOGRAM_BUCKETS; b++) {
+            result->histogram[b] += region->histogram[b];
+        }
+    }
+    result->bad = job.bad;
+    result->bad_count = merge_extents(job.bad, job.bad_count);
+    result->bad_sectors = job.bad_sectors;
+    result->slow = job.slow;
+    result->slow_count = job.slow_count;
+    qsort(result->slow, result->slow_count, sizeof(SurfaceScanExtent), compare_extents);
+    result->slow_reads = job.slow_reads;
+    result->heatmap = job.heatmap;
+    result->cells = job.cells;
+    result->cell_size = job.cell_size;
+    pthread_mutex_destroy(&job.lock);
+
+    if (job.failed) {
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(job.failed_errno),
+                    "Read failed at offset %llu: %s",
+                    (unsigned long long)job.failed_offset, g_strerror(job.failed_errno));
+        return FALSE;
+    }
+    if (options->cancel && *options->cancel) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Surface scan cancelled");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void surface_scan_result_clear(SurfaceScanResult* result) {
+    g_clear_pointer(&result->bad, g_free);
+    g_clear_pointer(&result->slow, g_free);
+    g_clear_pointer(&result->heatmap, g_free);
+}
+
+static FlValue* histogram_to_fl_value(const uint64_t* histogram) {
+    int64_t values[SURFACE_SCAN_HISTOGRAM_BUCKETS];
+    for (guint i = 0; i < SURFACE_SCAN_HISTOGRAM_BUCKETS; i++) {
+        values[i] = (int64_t)histogram[i];
+    }
+    return fl_value_new_int64_list(values, SURFACE_SCAN_HISTOGRAM_BUCKETS);
+}
+
+static FlValue* extents_to_fl_value(const SurfaceScanExtent* extents, guint count, gboolean slow) {
+    FlValue* list = fl_value_new_list();
+    for (guint i = 0; i < count; i++) {
+        FlValue* item = fl_value_new_map();
+        fl_value_set_string_take(item, "offset", fl_value_new_int((int64_t)extents[i].offset));
+        fl_value_set_string_take(item, "length", fl_value_new_int((int64_t)extents[i].length));
+        if (slow) {
+            fl_value_set_string_take(item, "latencyUs", fl_value_new_int(extents[i].latency_us));
+        }
+        fl_value_append_take(list, item);
+    }
+    return list;
+}
+
+FlValue* surface_scan_result_to_fl_value(const SurfaceScanResult* result) {
+    FlValue* value = fl_value_new_map();
+    fl_value_set_string_take(value, "offset", fl_value_new_int((int64_t)result->offset));
+    fl_value_set_string_take(value, "length", fl_value_new_int((int64_t)result->length));
+    fl_value_set_string_take(value, "bytesRead", fl_value_new_int((int64_t)result->bytes_read));
+    fl_value_set_string_take(value, "elapsedUs", fl_value_new_int(result->elapsed_us));
+    fl_value_set_string_take(value, "histogram", histogram_to_fl_value(result->histogram));
+
+    FlValue* regions = fl_value_new_list();
+    for (guint i = 0; i < result->region_count; i++) {
+        const SurfaceScanRegion* region = &result->regions[i];
+        FlValue* item = fl_value_new_map();
+        fl_value_set_string_take(item, "offset", fl_value_new_int((int64_t)region->offset));
+        fl_value_set_string_take(item, "length", fl_value_new_int((int64_t)region->length));
+        fl_value_set_string_take(item, "bytesRead", fl_value_new_int((int64_t)region->bytes_read));
+        fl_value_set_string_take(item, "histogram", histogram_to_fl_value(region->histogram));
+        fl_value_set_string_take(item, "maxLatencyUs", fl_value_new_int(region->max_latency_us));
+        fl_value_set_string_take(item, "badSectors", fl_value_new_int(region->bad_sectors));
+        fl_value_append_take(regions, item);
+    }
+    fl_value_set_string_take(value, "regions", regions);
+
+    fl_value_set_string_take(value, "badSectors", fl_value_new_int((int64_t)result->bad_sectors));
+    fl_value_set_string_take(value, "badExtents", extents_to_fl_value(result->bad, result->bad_count, FALSE));
+    fl_value_set_string_take(value, "slowReads", fl_value_new_int((int64_t)result->slow_reads));
+    fl_value_set_string_take(value, "slowExtents", extents_to_fl_value(result->slow, result->slow_count, TRUE));
+    if (result->heatmap != NULL) {
+        fl_value_set_string_take(value, "heatmap", fl_value_new_uint8_list(result->heatmap, result->cells));
+        fl_value_set_string_take(value, "cellSize", fl_value_new_int((int64_t)result->cell_size));
+    }
+    return value;
+}
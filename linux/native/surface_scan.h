@@ -0,0 +1,126 @@
+#ifndef SURFACE_SCAN_H
+#define SURFACE_SCAN_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stdint.h>
+#include "device_backend.h"
+#include "numa_placement.h"
+
+G_BEGIN_DECLS
+
+#define SURFACE_SCAN_DEFAULT_CHUNK_SIZE (1u * 1024 * 1024)
+#define SURFACE_SCAN_MAX_REGIONS 32
+#define SURFACE_SCAN_DEFAULT_CELLS 512
+// Read latency classes: bucket 0 is < 128 us, bucket b covers
+// [64 << b, 128 << b) us and the last bucket everything from ~0.5 s up
+#define SURFACE_SCAN_HISTOGRAM_BUCKETS 14
+// Heatmap cell holding at least one unreadable sector
+#define SURFACE_SCAN_CELL_UNREADABLE 0xFF
+// Cap on recorded bad and slow extents; counts keep going past it
+#define SURFACE_SCAN_MAX_EXTENTS 1024
+
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+    guint latency_us;         // slow extents only
+} SurfaceScanExtent;
+
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t bytes_read;
+    uint64_t histogram[SURFACE_SCAN_HISTOGRAM_BUCKETS];
+    guint max_latency_us;
+    guint bad_sectors;
+} SurfaceScanRegion;
+
+typedef struct {
+    uint64_t bytes_done;
+    uint64_t bytes_total;
+    gint64 elapsed_us;
+    uint64_t bad_sectors;
+    // One byte per cell: 0 = not read yet, 1 + latency bucket of the cell's
+    // slowest read, or SURFACE_SCAN_CELL_UNREADABLE
+    const uint8_t* heatmap;
+    guint cells;
+    uint64_t cell_size;
+} SurfaceScanProgress;
+
+/**
+ * SurfaceScanProgressCallback:
+ *
+ * Invoked from the calling thread every progress interval and once at the end.
+ */
+typedef void (*SurfaceScanProgressCallback)(const SurfaceScanProgress* progress, void* user_data);
+
+typedef struct {
+    uint64_t offset;
+    uint64_t length;                  // 0 = to the end of the device
+    size_t chunk_size;                // bytes per read, 0 for the default
+    guint block_size;                 // logical block size, bisection granularity; 0 = 512
+    guint regions;                    // regions read concurrently, each sequentially; 0 = 1
+    guint cells;                      // heatmap resolution, 0 for the default
+    guint slow_threshold_us;          // reads at least this slow are listed, 0 = never
+    const DeviceBackend* backend;     // optional, NULL reads through the kernel
+    SurfaceScanProgressCallback progress;
+    void* user_data;
+    const volatile gint* cancel;
+    const NumaPlacement* placement;   // optional, pins the readers and places their buffers
+    NumaPlacementStats* placement_stats;  // optional, filled in by the readers
+} SurfaceScanOptions;
+
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t bytes_read;
+    gint64 elapsed_us;
+    uint64_t histogram[SURFACE_SCAN_HISTOGRAM_BUCKETS];
+    SurfaceScanRegion regions[SURFACE_SCAN_MAX_REGIONS];
+    guint region_count;
+
+    // Unreadable logical blocks, merged into sorted extents
+    SurfaceScanExtent* bad;
+    guint bad_count;
+    uint64_t bad_sectors;
+    // Chunks that read at or above the slow threshold, sorted
+    SurfaceScanExtent* slow;
+    guint slow_count;
+    uint64_t slow_reads;
+
+    uint8_t* heatmap;
+    guint cells;
+    uint64_t cell_size;
+} SurfaceScanResult;
+
+void surface_scan_default_options(SurfaceScanOptions* options);
+
+/**
+ * surface_scan_run:
+ * @fd: device opened for reading, preferably O_DIRECT so the page cache
+ *   neither serves nor absorbs the reads (from the options' backend when
+ *   one is set)
+ * @result: (out): filled in even when the scan fails or is cancelled;
+ *   release with surface_scan_result_clear()
+ *
+ * Reads [offset, offset + length) without writing anything. The range is
+ * split into @regions stripes of whole heatmap cells, each read front to
+ * back by its own thread, so a rotational disk sees a few sequential
+ * streams rather than random reads. A chunk that fails with a media error
+ * is bisected down to @block_size to pin down the unreadable blocks while
+ * the rest of the chunk still counts as read.
+ *
+ * Returns: TRUE when the whole range was scanned, bad blocks included.
+ *   FALSE when cancelled or when the device stops answering (e.g. ENODEV).
+ */
+gboolean surface_scan_run(int fd,
+                          const SurfaceScanOptions* options,
+                          SurfaceScanResult* result,
+                          GError** error);
+
+void surface_scan_result_clear(SurfaceScanResult* result);
+
+FlValue* surface_scan_result_to_fl_value(const SurfaceScanResult* result);
+
+G_END_DECLS
+
+#endif // SURFACE_SCAN_H
@@ -0,0 +1,272 @@
+#define _GNU_SOURCE
+#include "sysfs_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define SYSFS_NAME_MAX 64
+#define SYSFS_ATTR_MAX 48
+#define SYSFS_MAX_HOT 16
+#define SYSFS_INITIAL_BUCKETS 64
+// Descriptors (directory and attribute) the cache may keep open in total;
+// reads beyond the budget use a transient openat()
+#define SYSFS_FD_BUDGET 512
+
+typedef struct {
+    char attr[SYSFS_ATTR_MAX];
+    int fd;
+} SysfsHotAttr;
+
+typedef struct SysfsDevice {
+    struct SysfsDevice* next;
+    char name[SYSFS_NAME_MAX];
+    int dirfd;
+    guint hot_count;
+    SysfsHotAttr hot[SYSFS_MAX_HOT];
+} SysfsDevice;
+
+struct SysfsCache {
+    int root_fd;
+    pthread_mutex_t lock;
+    SysfsDevice** buckets;
+    size_t bucket_count;
+    size_t device_count;
+    size_t open_fds;
+};
+
+static uint32_t hash_name(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static gboolean is_hot_attr(const char* attr) {
+    return strcmp(attr, "size") == 0 ||
+           strcmp(attr, "stat") == 0 ||
+           strncmp(attr, "queue/", 6) == 0;
+}
+
+SysfsCache* sysfs_cache_new(const char* root) {
+    int root_fd = open(root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0) return NULL;
+
+    SysfsCache* cache = g_new0(SysfsCache, 1);
+    cache->root_fd = root_fd;
+    cache->bucket_count = SYSFS_INITIAL_BUCKETS;
+    cache->buckets = g_new0(SysfsDevice*, cache->bucket_count);
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+static void close_device(SysfsCache* cache, SysfsDevice* device) {
+    for (guint i = 0; i < device->hot_count; i++) {
+        close(device->hot[i].fd);
+    }
+    close(device->dirfd);
+    cache->open_fds -= device->hot_count + 1;
+    g_free(device);
+}
+
+void sysfs_cache_free(SysfsCache* cache) {
+    if (!cache) return;
+    for (size_t i = 0; i < cache->bucket_count; i++) {
+        SysfsDevice* device = cache->buckets[i];
+        while (device) {
+            SysfsDevice* next = device->next;
+            close_device(cache, device);
+            device = next;
+        }
+    }
+    g_free(cache->buckets);
+    pthread_mutex_destroy(&cache->lock);
+    close(cache->root_fd);
+    g_free(cache);
+}
+
+static SysfsCache* default_cache;
+
+static void create_default_cache(void) {
+    default_cache = sysfs_cache_new("/sys/block");
+}
+
+SysfsCache* sysfs_cache_default(void) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, create_default_cache);
+    return default_cache;
+}
+
+static void grow_buckets(SysfsCache* cache) {
+    size_t count = cache->bucket_count * 2;
+    SysfsDevice** buckets = g_new0(SysfsDevice*, count);
+    for (size_t i = 0; i < cache->bucket_count; i++) {
+        SysfsDevice* device = cache->buckets[i];
+        while (device) {
+            SysfsDevice* next = device->next;
+            size_t slot = hash_name(device->name) & (count - 1);
+            device->next = buckets[slot];
+            buckets[slot] = device;
+            device = next;
+        }
+    }
+    g_free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_count = count;
+}
+
+// Called with the lock held
+static SysfsDevice* lookup_device(SysfsCache* cache, const char* name, gboolean create) {
+    size_t slot = hash_name(name) & (cache->bucket_count - 1);
+    for (SysfsDevice* device = cache->buckets[slot]; device; device = device->next) {
+        if (strcmp(device->name, name) == 0) return device;
+    }
+    if (!create || strlen(name) >= SYSFS_NAME_MAX || cache->open_fds >= SYSFS_FD_BUDGET) return NULL;
+
+    int dirfd = openat(cache->root_fd, name, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) return NULL;
+
+    SysfsDevice* device = g_new0(SysfsDevice, 1);
+    snprintf(device->name, sizeof(device->name), "%s", name);
+    device->dirfd = dirfd;
+
+    if (cache->device_count + 1 > cache->bucket_count) {
+        grow_buckets(cache);
+        slot = hash_name(name) & (cache->bucket_count - 1);
+    }
+    device->next = cache->buckets[slot];
+    cache->buckets[slot] = device;
+    cache->device_count++;
+    cache->open_fds++;
+    return device;
+}
+
+// Called with the lock held
+static void remove_device(SysfsCache* cache, const char* name) {
+    size_t slot = hash_name(name) & (cache->bucket_count - 1);
+    for (SysfsDevice** link = &cache->buckets[slot]; *link; link = &(*link)->next) {
+        if (strcmp((*link)->name, name) == 0) {
+            SysfsDevice* device = *link;
+            *link = device->next;
+            close_device(cache, device);
+            cache->device_count--;
+            return;
+        }
+    }
+}
+
+static ssize_t pread_value(int fd, char* buffer, size_t size) {
+    ssize_t n;
+    do {
+        n = pread(fd, buffer, size - 1, 0);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+static ssize_t read_transient(int dirfd, const char* path, char* buffer, size_t size) {
+    int fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = pread_value(fd, buffer, size);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return n;
+}
+
+// A missing attribute is normal; only a directory that no longer matches
+// the root entry means the cached descriptors are dead
+static gboolean device_is_stale(SysfsCache* cache, SysfsDevice* device) {
+    struct stat cached, current;
+    if (fstatat(device->dirfd, "", &cached, AT_EMPTY_PATH) < 0) return TRUE;
+    if (fstatat(cache->root_fd, device->name, &current, 0) < 0) return TRUE;
+    return cached.st_ino != current.st_ino || cached.st_dev != current.st_dev;
+}
+
+// Called with the lock held. Returns -1 with errno set on failure.
+static ssize_t read_attr_locked(SysfsCache* cache, SysfsDevice* device, const char* attr,
+                                char* buffer, size_t size) {
+    if (is_hot_attr(attr) && strlen(attr) < SYSFS_ATTR_MAX) {
+        for (guint i = 0; i < device->hot_count; i++) {
+            if (strcmp(device->hot[i].attr, attr) == 0) {
+                return pread_value(device->hot[i].fd, buffer, size);
+            }
+        }
+
+        if (device->hot_count < SYSFS_MAX_HOT && cache->open_fds < SYSFS_FD_BUDGET) {
+            int fd = openat(device->dirfd, attr, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return -1;
+            SysfsHotAttr* hot = &device->hot[device->hot_count++];
+            snprintf(hot->attr, sizeof(hot->attr), "%s", attr);
+            hot->fd = fd;
+            cache->open_fds++;
+            return pread_value(fd, buffer, size);
+        }
+    }
+
+    return read_transient(device->dirfd, attr, buffer, size);
+}
+
+gssize sysfs_cache_read(SysfsCache* cache, const char* device_name, const char* attr,
+                        char* buffer, size_t size) {
+    if (!cache || size < 2) return -1;
+
+    pthread_mutex_lock(&cache->lock);
+    ssize_t n = -1;
+    for (int attempt = 0; attempt < 2 && n < 0; attempt++) {
+        SysfsDevice* device = lookup_device(cache, device_name, TRUE);
+        if (!device) {
+            // Over the descriptor budget (or no such device)
+            char path[SYSFS_NAME_MAX + SYSFS_ATTR_MAX + 2];
+            snprintf(path, sizeof(path), "%s/%s", device_name, attr);
+            n = read_transient(cache->root_fd, path, buffer, size);
+            break;
+        }
+
+        n = read_attr_locked(cache, device, attr, buffer, size);
+        if (n >= 0 || attempt > 0 || !device_is_stale(cache, device)) break;
+
+        // The device was removed (and maybe re-added under the same name);
+        // drop the old descriptors and retry against the current node
+        remove_device(cache, device_name);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (n < 0) return -1;
+    while (n > 0 && (buffer[n - 1] == '\n' || buffer[n - 1] == ' ')) n--;
+    buffer[n] = '\0';
+    return n;
+}
+
+gboolean sysfs_parse_u64(const char* text, const char** end, uint64_t* value) {
+    while (*text == ' ' || *text == '\t') text++;
+    if (*text < '0' || *text > '9') return FALSE;
+
+    uint64_t result = 0;
+    while (*text >= '0' && *text <= '9') {
+        result = result * 10 + (uint64_t)(*text - '0');
+        text++;
+    }
+    *value = result;
+    if (end) *end = text;
+    return TRUE;
+}
+
+gboolean sysfs_cache_read_u64(SysfsCache* cache, const char* device, const char* attr,
+                              uint64_t* value) {
+    char buffer[32];
+    if (sysfs_cache_read(cache, device, attr, buffer, sizeof(buffer)) < 0) return FALSE;
+    return sysfs_parse_u64(buffer, NULL, value);
+}
+
+void sysfs_cache_forget(SysfsCache* cache, const char* device) {
+    if (!cache) return;
+    pthread_mutex_lock(&cache->lock);
+    remove_device(cache, device);
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,63 @@
+#ifndef SYSFS_CACHE_H
+#define SYSFS_CACHE_H
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/*
+ * sysfs attribute reader with persistent descriptors.
+ *
+ * Keeps an O_PATH directory fd per device below the root (normally
+ * /sys/block) and resolves attributes with openat(). Hot attributes ("size",
+ * "stat" and everything under "queue/") keep their fd open and are refreshed
+ * with pread() at offset 0, which makes the kernel regenerate the value.
+ * Reads go into caller-provided buffers; nothing is allocated per read.
+ */
+
+typedef struct SysfsCache SysfsCache;
+
+/**
+ * sysfs_cache_new:
+ * @root: directory holding one entry per device (e.g. "/sys/block")
+ *
+ * Returns: (transfer full): the cache, or NULL if @root cannot be opened
+ */
+SysfsCache* sysfs_cache_new(const char* root);
+void sysfs_cache_free(SysfsCache* cache);
+
+// Process-wide cache on /sys/block, created on first use
+SysfsCache* sysfs_cache_default(void);
+
+/**
+ * sysfs_cache_read:
+ * @device: entry below the root (e.g. "sda")
+ * @attr: attribute path relative to the device (e.g. "queue/rotational")
+ * @buffer: receives the value, NUL-terminated, trailing newline removed
+ *
+ * Returns: length of the value, or -1 if the attribute cannot be read
+ */
+gssize sysfs_cache_read(SysfsCache* cache, const char* device, const char* attr,
+                        char* buffer, size_t size);
+
+gboolean sysfs_cache_read_u64(SysfsCache* cache, const char* device, const char* attr,
+                              uint64_t* value);
+
+// Close every descriptor held for @device (call when it disappears)
+void sysfs_cache_forget(SysfsCache* cache, const char* device);
+
+/**
+ * sysfs_parse_u64:
+ * @end: (out) (optional): first character after the number
+ *
+ * Parses a decimal number after optional leading blanks.
+ *
+ * Returns: FALSE when no digit was found
+ */
+gboolean sysfs_parse_u64(const char* text, const char** end, uint64_t* value);
+
+G_END_DECLS
+
+#endif // SYSFS_CACHE_H
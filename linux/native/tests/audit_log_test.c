@@ -0,0 +1,239 @@
+#define _GNU_SOURCE
+#include "../audit_log.h"
+#include <fcntl.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SERIALS 5
+
+typedef struct {
+    char* dir;
+    char* path;
+    char* index_path;
+} Fixture;
+
+static void fixture_setup(Fixture* fixture, gconstpointer data) {
+    fixture->dir = g_dir_make_tmp("audit-XXXXXX", NULL);
+    g_assert_nonnull(fixture->dir);
+    fixture->path = g_build_filename(fixture->dir, "audit.log", NULL);
+    fixture->index_path = g_strdup_printf("%s.idx", fixture->path);
+}
+
+static void fixture_teardown(Fixture* fixture, gconstpointer data) {
+    unlink(fixture->index_path);
+    unlink(fixture->path);
+    rmdir(fixture->dir);
+    g_free(fixture->index_path);
+    g_free(fixture->path);
+    g_free(fixture->dir);
+}
+
+// Record @i of a run: serials rotate so every one has several records
+static void make_record(guint i, AuditRecord* record) {
+    memset(record, 0, sizeof(*record));
+    snprintf(record->device_path, sizeof(record->device_path), "/dev/sd%c", 'a' + i % SERIALS);
+    snprintf(record->serial, sizeof(record->serial), "SER-%u", i % SERIALS);
+    snprintf(record->model, sizeof(record->model), "Model %u", i % SERIALS);
+    snprintf(record->firmware, sizeof(record->firmware), "FW1");
+    record->capacity_bytes = 1000204886016ull;
+    snprintf(record->method, sizeof(record->method), "wipeDevice");
+    snprintf(record->status, sizeof(record->status), i % 7 == 3 ? "failed" : "completed");
+    if (i % 7 == 3) snprintf(record->message, sizeof(record->message), "Write failed at %u", i);
+    record->started_us = 1700000000000000ll + (gint64)i * 1000000;
+    record->finished_us = record->started_us + 500000;
+    record->pass_count = 1 + i % 3;
+    for (guint p = 0; p < record->pass_count; p++) {
+        AuditPass* pass = &record->passes[p];
+        snprintf(pass->pattern, sizeof(pass->pattern), p == 0 ? "zeros" : "random");
+        pass->started_us = record->started_us;
+        pass->finished_us = record->finished_us;
+        pass->bytes = record->capacity_bytes;
+        pass->throughput_bps = 200000000;
+        pass->verify = p == 0 ? AUDIT_VERIFY_PASSED : AUDIT_VERIFY_NONE;
+    }
+}
+
+static void append_records(const char* path, guint first, guint count) {
+    GError* error = NULL;
+    AuditLog* log = audit_log_open(path, &error);
+    g_assert_no_error(error);
+    g_assert_nonnull(log);
+    for (guint i = first; i < first + count; i++) {
+        AuditRecord record;
+        make_record(i, &record);
+        audit_log_append(log, &record);
+    }
+    g_assert_true(audit_log_flush(log, &error));
+    g_assert_no_error(error);
+    audit_log_close(log);
+}
+
+static void assert_intact(const char* path, uint64_t expected) {
+    uint64_t records = 0;
+    GError* error = NULL;
+    g_assert_true(audit_log_verify(path, &records, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(records, ==, expected);
+}
+
+static void assert_broken(const char* path, uint64_t intact) {
+    uint64_t records = 0;
+    GError* error = NULL;
+    g_assert_false(audit_log_verify(path, &records, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+    g_clear_error(&error);
+    g_assert_cmpuint(records, ==, intact);
+}
+
+static gchar* read_log(const char* path, gsize* length) {
+    gchar* contents = NULL;
+    g_assert_true(g_file_get_contents(path, &contents, length, NULL));
+    return contents;
+}
+
+static void write_log(const char* path, const gchar* contents, gsize length) {
+    g_assert_true(g_file_set_contents(path, contents, (gssize)length, NULL));
+}
+
+// Byte offsets of the records, walked by the length in front of each
+static guint record_offsets(const gchar* contents, gsize length, gsize* offsets, guint max) {
+    guint count = 0;
+    gsize offset = 16;
+    while (offset + 8 <= length && count < max) {
+        uint32_t record_length;
+        memcpy(&record_length, contents + offset + 4, sizeof(record_length));
+        offsets[count++] = offset;
+        offset += record_length;
+    }
+    return count;
+}
+
+// The chain continues across reopening the log
+static void test_chain(Fixture* fixture, gconstpointer data) {
+    append_records(fixture->path, 0, 40);
+    assert_intact(fixture->path, 40);
+    append_records(fixture->path, 40, 10);
+    assert_intact(fixture->path, 50);
+
+    GError* error = NULL;
+    AuditReader* reader = audit_reader_open(fixture->path, &error);
+    g_assert_no_error(error);
+    g_assert_cmpuint(audit_reader_count(reader), ==, 50);
+    FlValue* recent = audit_reader_recent(reader, 3);
+    g_assert_cmpuint(fl_value_get_length(recent), ==, 3);
+    for (guint i = 0; i < 3; i++) {
+        FlValue* value = fl_value_get_list_value(recent, i);
+        g_assert_cmpint(fl_value_get_int(fl_value_lookup_string(value, "sequence")), ==, 49 - i);
+    }
+    FlValue* newest = fl_value_get_list_value(recent, 0);
+    g_assert_cmpstr(fl_value_get_string(fl_value_lookup_string(newest, "serialNumber")), ==, "SER-4");
+    g_assert_cmpuint(fl_value_get_length(fl_value_lookup_string(newest, "passes")), ==, 2);
+    fl_value_unref(recent);
+    audit_reader_free(reader);
+}
+
+// Editing, removing or reordering records is caught at the first record
+// that no longer links up
+static void test_tamper(Fixture* fixture, gconstpointer data) {
+    append_records(fixture->path, 0, 10);
+    gsize length;
+    gchar* original = read_log(fixture->path, &length);
+    gsize offsets[16];
+    g_assert_cmpuint(record_offsets(original, length, offsets, G_N_ELEMENTS(offsets)), ==, 10);
+
+    // An edited byte in the payload of record 3
+    gchar* edited = g_memdup2(original, length);
+    edited[offsets[3] + 60] ^= 0x01;
+    write_log(fixture->path, edited, length);
+    assert_broken(fixture->path, 3);
+    g_free(edited);
+
+    // Record 3 cut out: record 4 follows 2 with the wrong link
+    gchar* removed = g_malloc(length);
+    gsize cut = offsets[4] - offsets[3];
+    memcpy(removed, original, offsets[3]);
+    memcpy(removed + offsets[3], original + offsets[4], length - offsets[4]);
+    write_log(fixture->path, removed, length - cut);
+    assert_broken(fixture->path, 3);
+    g_free(removed);
+
+    // Records 5 and 6 swapped
+    gchar* swapped = g_memdup2(original, length);
+    gsize five = offsets[6] - offsets[5];
+    gsize six = offsets[7] - offsets[6];
+    memcpy(swapped + offsets[5], original + offsets[6], six);
+    memcpy(swapped + offsets[5] + six, original + offsets[5], five);
+    write_log(fixture->path, swapped, length);
+    assert_broken(fixture->path, 5);
+    g_free(swapped);
+
+    // A torn final record is a crash, not tampering: reopening drops it
+    gchar* torn = g_malloc(length + 40);
+    memcpy(torn, original, length);
+    memcpy(torn + length, original + offsets[9], 40);
+    write_log(fixture->path, torn, length + 40);
+    assert_broken(fixture->path, 10);
+    append_records(fixture->path, 10, 1);
+    assert_intact(fixture->path, 11);
+    g_free(torn);
+    g_free(original);
+}
+
+static void assert_serial(AuditReader* reader, const char* serial, guint limit, guint expected) {
+    FlValue* list = audit_reader_find_serial(reader, serial, limit);
+    g_assert_cmpuint(fl_value_get_length(list), ==, expected);
+    int64_t previous = G_MAXINT64;
+    for (guint i = 0; i < expected; i++) {
+        FlValue* value = fl_value_get_list_value(list, i);
+        g_assert_cmpstr(fl_value_get_string(fl_value_lookup_string(value, "serialNumber")), ==, serial);
+        int64_t sequence = fl_value_get_int(fl_value_lookup_string(value, "sequence"));
+        g_assert_cmpint(sequence, <, previous);
+        previous = sequence;
+    }
+    fl_value_unref(list);
+}
+
+// Lookups by serial, newest first, through the index, through records the
+// index has not caught up with, and with the index gone
+static void test_serial_index(Fixture* fixture, gconstpointer data) {
+    append_records(fixture->path, 0, 100);
+    GError* error = NULL;
+    AuditReader* reader = audit_reader_open(fixture->path, &error);
+    g_assert_no_error(error);
+    assert_serial(reader, "SER-2", 1000, 100 / SERIALS);
+    assert_serial(reader, "SER-2", 3, 3);
+    assert_serial(reader, "SER-9", 1000, 0);
+
+    append_records(fixture->path, 100, 10);
+    g_assert_true(audit_reader_refresh(reader, &error));
+    g_assert_cmpuint(audit_reader_count(reader), ==, 110);
+    assert_serial(reader, "SER-2", 1000, 110 / SERIALS);
+    audit_reader_free(reader);
+
+    // Without the index the reader scans the log itself
+    g_assert_cmpint(unlink(fixture->index_path), ==, 0);
+    reader = audit_reader_open(fixture->path, &error);
+    g_assert_no_error(error);
+    g_assert_cmpuint(audit_reader_count(reader), ==, 110);
+    assert_serial(reader, "SER-0", 1000, 110 / SERIALS);
+    audit_reader_free(reader);
+
+    // The writer rebuilds it on the next open
+    append_records(fixture->path, 110, 0);
+    g_assert_true(g_file_test(fixture->index_path, G_FILE_TEST_EXISTS));
+    reader = audit_reader_open(fixture->path, &error);
+    g_assert_no_error(error);
+    assert_serial(reader, "SER-1", 1000, 110 / SERIALS);
+    audit_reader_free(reader);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add("/audit_log/chain", Fixture, NULL, fixture_setup, test_chain, fixture_teardown);
+    g_test_add("/audit_log/tamper", Fixture, NULL, fixture_setup, test_tamper, fixture_teardown);
+    g_test_add("/audit_log/serial_index", Fixture, NULL, fixture_setup, test_serial_index,
+               fixture_teardown);
+    return g_test_run();
+}
@@ -0,0 +1,338 @@
+#define _GNU_SOURCE
+#include "../bulk_io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define KIB 1024ull
+#define MIB (1024ull * 1024)
+#define CHUNK (256 * KIB)
+// Thirty-two full chunks and a short one
+#define FILE_SIZE (32 * CHUNK + 12 * KIB)
+#define BENCH_SIZE (256 * MIB)
+#define NONE G_MAXUINT64
+
+// A regular file written through a backend that corrupts or fails chosen
+// chunks and counts the flush barriers
+typedef struct {
+    DeviceBackend backend;
+    uint64_t corrupt_offset;    // a bit of the write covering it is flipped
+    uint64_t unreadable_offset; // reads covering it fail with EIO
+    uint64_t cancel_offset;     // writes reaching it set cancel
+    volatile gint cancel;
+    gint syncs;
+} FlakyFile;
+
+typedef struct {
+    char* path;
+    int fd;
+    FlakyFile file;
+} Fixture;
+
+static gboolean covers(uint64_t mark, uint64_t offset, size_t size) {
+    return mark >= offset && mark < offset + size;
+}
+
+static ssize_t flaky_pwrite(int fd, const void* buffer, size_t size, uint64_t offset, void* ctx) {
+    FlakyFile* file = ctx;
+    if (covers(file->cancel_offset, offset, size)) file->cancel = 1;
+    if (!covers(file->corrupt_offset, offset, size)) {
+        return device_backend_linux()->pwrite(fd, buffer, size, offset, NULL);
+    }
+    guint8* copy = g_malloc(size);
+    memcpy(copy, buffer, size);
+    copy[file->corrupt_offset - offset] ^= 0x08;
+    ssize_t n = device_backend_linux()->pwrite(fd, copy, size, offset, NULL);
+    g_free(copy);
+    return n;
+}
+
+static ssize_t flaky_pread(int fd, void* buffer, size_t size, uint64_t offset, void* ctx) {
+    FlakyFile* file = ctx;
+    if (covers(file->unreadable_offset, offset, size)) {
+        errno = EIO;
+        return -1;
+    }
+    return device_backend_linux()->pread(fd, buffer, size, offset, NULL);
+}
+
+static int flaky_sync(int fd, void* ctx) {
+    FlakyFile* file = ctx;
+    __atomic_add_fetch(&file->syncs, 1, __ATOMIC_RELAXED);
+    return device_backend_linux()->sync(fd, NULL);
+}
+
+static void fixture_setup(Fixture* fixture, gconstpointer data) {
+    fixture->fd = g_file_open_tmp("bulk-XXXXXX", &fixture->path, NULL);
+    g_assert_cmpint(fixture->fd, >=, 0);
+    g_assert_cmpint(ftruncate(fixture->fd, FILE_SIZE), ==, 0);
+
+    FlakyFile* file = &fixture->file;
+    memset(file, 0, sizeof(*file));
+    file->backend = *device_backend_linux();
+    file->backend.pwrite = flaky_pwrite;
+    file->backend.pread = flaky_pread;
+    file->backend.sync = flaky_sync;
+    file->backend.ctx = file;
+    file->corrupt_offset = NONE;
+    file->unreadable_offset = NONE;
+    file->cancel_offset = NONE;
+}
+
+static void fixture_teardown(Fixture* fixture, gconstpointer data) {
+    close(fixture->fd);
+    unlink(fixture->path);
+    g_free(fixture->path);
+}
+
+static void verify_options(Fixture* fixture, BulkWriteOptions* options, BulkPattern pattern) {
+    bulk_io_default_options(options);
+    options->length = FILE_SIZE;
+    options->chunk_size = CHUNK;
+    options->pattern = pattern;
+    options->verify = TRUE;
+    options->backend = &fixture->file.backend;
+    options->cancel = &fixture->file.cancel;
+}
+
+// The second pass of the two-pass approach: reads [offset, offset + length)
+// back through O_DIRECT and compares it with a constant pattern. Returns
+// the bytes that matched; @first_mismatch is the offset of the first chunk
+// that did not, or NONE.
+static uint64_t verify_two_pass(const char* path, uint64_t offset, uint64_t length, BulkPattern pattern,
+                                uint64_t* first_mismatch) {
+    int fd = open(path, O_RDONLY | O_DIRECT | O_CLOEXEC);
+    g_assert_cmpint(fd, >=, 0);
+    void* buffer = NULL;
+    g_assert_cmpint(posix_memalign(&buffer, 4096, CHUNK), ==, 0);
+    guint8* expected = g_malloc(CHUNK);
+    uint64_t seed = 0;
+    bulk_io_fill_pattern(expected, CHUNK, pattern, &seed);
+
+    uint64_t matched = 0;
+    *first_mismatch = NONE;
+    for (uint64_t at = offset; at < offset + length; at += CHUNK) {
+        size_t size = (size_t)MIN(CHUNK, offset + length - at);
+        // O_DIRECT reads whole blocks; the file ends on one
+        ssize_t n = pread(fd, buffer, (size + 4095) & ~(size_t)4095, (off_t)at);
+        g_assert_cmpint(n, >=, (ssize_t)size);
+        if (memcmp(buffer, expected, size) == 0) {
+            matched += size;
+        } else if (*first_mismatch == NONE) {
+            *first_mismatch = at;
+        }
+    }
+    g_free(expected);
+    free(buffer);
+    close(fd);
+    return matched;
+}
+
+// Every pattern verifies in one sweep, whatever the lag and number of
+// writers, including lags longer than the range
+static void test_single_pass(Fixture* fixture, gconstpointer data) {
+    static const struct { guint workers; guint lag; } configs[] = {
+        {1, 0}, {1, 8}, {4, 2}, {4, 64},
+    };
+    static const BulkPattern patterns[] = {BULK_PATTERN_ZEROS, BULK_PATTERN_ONES, BULK_PATTERN_RANDOM};
+    for (guint p = 0; p < G_N_ELEMENTS(patterns); p++) {
+        for (guint c = 0; c < G_N_ELEMENTS(configs); c++) {
+            BulkWriteOptions options;
+            verify_options(fixture, &options, patterns[p]);
+            options.max_workers = configs[c].workers;
+            options.verify_lag = configs[c].lag;
+            BulkWriteResult result;
+            GError* error = NULL;
+            g_assert_true(bulk_io_write(fixture->fd, &options, &result, &error));
+            g_assert_no_error(error);
+            g_assert_cmpuint(result.bytes_written, ==, FILE_SIZE);
+            g_assert_cmpuint(result.bytes_verified, ==, FILE_SIZE);
+            g_assert_cmpuint(result.verify_mismatches, ==, 0);
+            g_assert_cmpuint(result.errors, ==, 0);
+
+            if (patterns[p] != BULK_PATTERN_RANDOM) {
+                uint64_t first;
+                g_assert_cmpuint(verify_two_pass(fixture->path, 0, FILE_SIZE, patterns[p], &first), ==,
+                                 FILE_SIZE);
+            }
+        }
+    }
+}
+
+// A range not starting at zero is read back where it was written
+static void test_offset(Fixture* fixture, gconstpointer data) {
+    BulkWriteOptions options;
+    verify_options(fixture, &options, BULK_PATTERN_ONES);
+    options.offset = 3 * CHUNK;
+    options.length = 10 * CHUNK + 4 * KIB;
+    BulkWriteResult result;
+    GError* error = NULL;
+    g_assert_true(bulk_io_write(fixture->fd, &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(result.bytes_verified, ==, options.length);
+
+    uint64_t first;
+    g_assert_cmpuint(verify_two_pass(fixture->path, options.offset, options.length, BULK_PATTERN_ONES, &first),
+                     ==, options.length);
+    // The file around the range is untouched
+    g_assert_cmpuint(verify_two_pass(fixture->path, 0, options.offset, BULK_PATTERN_ZEROS, &first), ==,
+                     options.offset);
+}
+
+// A write that lands corrupted is reported at its chunk, by the single
+// sweep and by a second pass alike
+static void test_mismatch(Fixture* fixture, gconstpointer data) {
+    fixture->file.corrupt_offset = 5 * CHUNK + 100;
+    BulkWriteOptions options;
+    verify_options(fixture, &options, BULK_PATTERN_ONES);
+    options.verify_lag = 2;
+    BulkWriteResult result;
+    GError* error = NULL;
+    g_assert_false(bulk_io_write(fixture->fd, &options, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_FAILED);
+    g_clear_error(&error);
+    g_assert_cmpuint(result.bytes_written, ==, FILE_SIZE);
+    g_assert_cmpuint(result.verify_mismatches, ==, 1);
+    g_assert_cmpuint(result.first_mismatch_offset, ==, 5 * CHUNK);
+    g_assert_cmpuint(result.bytes_verified, ==, FILE_SIZE - CHUNK);
+
+    uint64_t first;
+    g_assert_cmpuint(verify_two_pass(fixture->path, 0, FILE_SIZE, BULK_PATTERN_ONES, &first), ==,
+                     FILE_SIZE - CHUNK);
+    g_assert_cmpuint(first, ==, result.first_mismatch_offset);
+
+    // Random data is regenerated per chunk; the short last chunk too
+    fixture->file.corrupt_offset = FILE_SIZE - 1;
+    verify_options(fixture, &options, BULK_PATTERN_RANDOM);
+    g_assert_false(bulk_io_write(fixture->fd, &options, &result, &error));
+    g_clear_error(&error);
+    g_assert_cmpuint(result.verify_mismatches, ==, 1);
+    g_assert_cmpuint(result.first_mismatch_offset, ==, 32 * CHUNK);
+    g_assert_cmpuint(result.bytes_verified, ==, 32 * CHUNK);
+}
+
+// A chunk that cannot be read back counts as a mismatch after its retries
+static void test_unreadable(Fixture* fixture, gconstpointer data) {
+    fixture->file.unreadable_offset = 3 * CHUNK;
+    BulkWriteOptions options;
+    verify_options(fixture, &options, BULK_PATTERN_ZEROS);
+    BulkWriteResult result;
+    GError* error = NULL;
+    g_assert_false(bulk_io_write(fixture->fd, &options, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_FAILED);
+    g_clear_error(&error);
+    g_assert_cmpuint(result.verify_mismatches, ==, 1);
+    g_assert_cmpuint(result.first_mismatch_offset, ==, 3 * CHUNK);
+    g_assert_cmpuint(result.errors, >, 0);
+    g_assert_cmpuint(result.bytes_verified, ==, FILE_SIZE - CHUNK);
+}
+
+// One barrier covers everything written so far: a lag past the end needs a
+// single flush, a lag of zero one per read at most
+static void test_barriers(Fixture* fixture, gconstpointer data) {
+    BulkWriteOptions options;
+    verify_options(fixture, &options, BULK_PATTERN_ZEROS);
+    options.verify_lag = 64;
+    BulkWriteResult result;
+    g_assert_true(bulk_io_write(fixture->fd, &options, &result, NULL));
+    g_assert_cmpint(fixture->file.syncs, ==, 1);
+
+    fixture->file.syncs = 0;
+    options.verify_lag = 0;
+    options.max_workers = 1;
+    g_assert_true(bulk_io_write(fixture->fd, &options, &result, NULL));
+    g_assert_cmpint(fixture->file.syncs, >=, 1);
+    g_assert_cmpint(fixture->file.syncs, <=, 33);
+
+    // No verify, no barriers
+    fixture->file.syncs = 0;
+    options.verify = FALSE;
+    g_assert_true(bulk_io_write(fixture->fd, &options, &result, NULL));
+    g_assert_cmpint(fixture->file.syncs, ==, 0);
+    g_assert_cmpuint(result.bytes_verified, ==, 0);
+}
+
+// Cancelling mid-sweep stops both the writers and the reader without
+// reporting the chunks left unread
+static void test_cancel(Fixture* fixture, gconstpointer data) {
+    fixture->file.cancel_offset = 16 * CHUNK;
+    BulkWriteOptions options;
+    verify_options(fixture, &options, BULK_PATTERN_RANDOM);
+    options.max_workers = 2;
+    options.verify_lag = 4;
+    BulkWriteResult result;
+    GError* error = NULL;
+    g_assert_false(bulk_io_write(fixture->fd, &options, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+    g_clear_error(&error);
+    g_assert_cmpuint(result.bytes_written, <, FILE_SIZE);
+    g_assert_cmpuint(result.bytes_verified, <=, result.bytes_written);
+    g_assert_cmpuint(result.verify_mismatches, ==, 0);
+}
+
+// Write, flush and read back through O_DIRECT in two sweeps, against one
+// sweep with an O_DIRECT read-back; run with -m perf
+static void test_benchmark(void) {
+    char* path;
+    int fd = g_file_open_tmp("bulk-bench-XXXXXX", &path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    g_assert_cmpint(ftruncate(fd, BENCH_SIZE), ==, 0);
+    int direct_fd = open(path, O_RDONLY | O_DIRECT | O_CLOEXEC);
+    g_assert_cmpint(direct_fd, >=, 0);
+
+    BulkWriteOptions options;
+    bulk_io_default_options(&options);
+    options.length = BENCH_SIZE;
+    options.pattern = BULK_PATTERN_ONES;
+    options.max_workers = 1;
+    BulkWriteResult result;
+
+    g_test_timer_start();
+    g_assert_true(bulk_io_write(fd, &options, &result, NULL));
+    g_assert_cmpint(fdatasync(fd), ==, 0);
+    uint64_t first;
+    g_assert_cmpuint(verify_two_pass(path, 0, BENCH_SIZE, BULK_PATTERN_ONES, &first), ==, BENCH_SIZE);
+    double two_pass = g_test_timer_elapsed();
+
+    static const guint lags[] = {8, 32, 128};
+    double best = G_MAXDOUBLE;
+    guint best_lag = 0;
+    for (guint i = 0; i < G_N_ELEMENTS(lags); i++) {
+        options.verify = TRUE;
+        options.verify_lag = lags[i];
+        options.verify_fd = direct_fd;
+        g_test_timer_start();
+        g_assert_true(bulk_io_write(fd, &options, &result, NULL));
+        double elapsed = g_test_timer_elapsed();
+        g_assert_cmpuint(result.bytes_verified, ==, BENCH_SIZE);
+        g_test_message("single pass, lag %u: %.2f s", lags[i], elapsed);
+        if (elapsed < best) {
+            best = elapsed;
+            best_lag = lags[i];
+        }
+    }
+    g_test_minimized_result(best, "verified overwrite of %llu MiB: two-pass %.2f s, single pass %.2f s (lag %u)",
+                            BENCH_SIZE >> 20, two_pass, best, best_lag);
+
+    close(direct_fd);
+    close(fd);
+    unlink(path);
+    g_free(path);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add("/bulk_io/single_pass", Fixture, NULL, fixture_setup, test_single_pass, fixture_teardown);
+    g_test_add("/bulk_io/offset", Fixture, NULL, fixture_setup, test_offset, fixture_teardown);
+    g_test_add("/bulk_io/mismatch", Fixture, NULL, fixture_setup, test_mismatch, fixture_teardown);
+    g_test_add("/bulk_io/unreadable", Fixture, NULL, fixture_setup, test_unreadable, fixture_teardown);
+    g_test_add("/bulk_io/barriers", Fixture, NULL, fixture_setup, test_barriers, fixture_teardown);
+    g_test_add("/bulk_io/cancel", Fixture, NULL, fixture_setup, test_cancel, fixture_teardown);
+    if (g_test_perf()) {
+        g_test_add_func("/bulk_io/benchmark", test_benchmark);
+    }
+    return g_test_run();
+}
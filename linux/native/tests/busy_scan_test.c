@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include "../busy_scan.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <linux/loop.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define IMAGE_SIZE (4 * 1024 * 1024)
+
+// A loop device backed by an image in a scratch directory
+typedef struct {
+    char* dir;
+    char* image;
+    char loop_path[32];
+    int loop_fd;
+    dev_t rdev;
+} Fixture;
+
+// A child process holding descriptors, so the sweep (which skips the
+// calling process) has something to find
+typedef struct {
+    pid_t pid;
+    int fd;                   // the descriptor opened on the path
+    int release;
+} Holder;
+
+static gboolean attach_loop(Fixture* fixture, int image_fd) {
+    int control = open("/dev/loop-control", O_RDWR | O_CLOEXEC);
+    if (control < 0) return FALSE;
+    // Another test may take the free device first
+    for (int attempt = 0; attempt < 8; attempt++) {
+        int index = ioctl(control, LOOP_CTL_GET_FREE);
+        if (index < 0) break;
+        snprintf(fixture->loop_path, sizeof(fixture->loop_path), "/dev/loop%d", index);
+        int fd = open(fixture->loop_path, O_RDWR | O_CLOEXEC);
+        if (fd < 0) break;
+        if (ioctl(fd, LOOP_SET_FD, image_fd) == 0) {
+            fixture->loop_fd = fd;
+            close(control);
+            return TRUE;
+        }
+        close(fd);
+        if (errno != EBUSY) break;
+    }
+    close(control);
+    return FALSE;
+}
+
+static void fixture_setup(Fixture* fixture, gconstpointer data) {
+    memset(fixture, 0, sizeof(*fixture));
+    fixture->loop_fd = -1;
+    fixture->dir = g_dir_make_tmp("busy-XXXXXX", NULL);
+    g_assert_nonnull(fixture->dir);
+    fixture->image = g_build_filename(fixture->dir, "disk.img", NULL);
+    int image_fd = open(fixture->image, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    g_assert_cmpint(image_fd, >=, 0);
+    g_assert_cmpint(ftruncate(image_fd, IMAGE_SIZE), ==, 0);
+    gboolean attached = attach_loop(fixture, image_fd);
+    close(image_fd);
+    if (!attached) return;
+
+    struct stat st;
+    g_assert_cmpint(fstat(fixture->loop_fd, &st), ==, 0);
+    fixture->rdev = st.st_rdev;
+}
+
+static void fixture_teardown(Fixture* fixture, gconstpointer data) {
+    if (fixture->loop_fd >= 0) {
+        ioctl(fixture->loop_fd, LOOP_CLR_FD, 0);
+        close(fixture->loop_fd);
+    }
+    unlink(fixture->image);
+    rmdir(fixture->dir);
+    g_free(fixture->image);
+    g_free(fixture->dir);
+}
+
+static gboolean have_loop(Fixture* fixture) {
+    if (fixture->loop_fd >= 0) return TRUE;
+    g_test_skip("no loop device available");
+    return FALSE;
+}
+
+// Block node for the loop device outside /dev
+static char* make_node(Fixture* fixture, const char* name) {
+    char* path = g_build_filename(fixture->dir, name, NULL);
+    g_assert_cmpint(mknod(path, S_IFBLK | 0600, fixture->rdev), ==, 0);
+    return path;
+}
+
+// Forks a child that opens @path (and a socket, whose link is not a path), optionally unlinks it, and waits until released
+static Holder start_holder(const char* path, gboolean unlink_after) {
+    int ready[2], release[2];
+    g_assert_cmpint(pipe(ready), ==, 0);
+    g_assert_cmpint(pipe(release), ==, 0);
+    pid_t pid = fork();
+    g_assert_cmpint(pid, >=, 0);
+    if (pid == 0) {
+        close(ready[0]);
+        close(release[1]);
+        int fd = open(path, O_RDONLY);
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && unlink_after) unlink(path);
+        if (sock < 0) fd = -1;
+        if (write(ready[1], &fd, sizeof(fd)) != sizeof(fd)) _exit(1);
+        char byte;
+        while (read(release[0], &byte, 1) < 0) {
+        }
+        _exit(0);
+    }
+    close(ready[1]);
+    close(release[0]);
+    int fd = -1;
+    g_assert_cmpint(read(ready[0], &fd, sizeof(fd)), ==, sizeof(fd));
+    g_assert_cmpint(fd, >=, 0);
+    close(ready[0]);
+    return (Holder){.pid = pid, .fd = fd, .release = release[1]};
+}
+
+static void stop_holder(Holder* holder) {
+    close(holder->release);
+    int status;
+    g_assert_cmpint(waitpid(holder->pid, &status, 0), ==, holder->pid);
+    g_assert_true(WIFEXITED(status));
+}
+
+// Whether @report holds the descriptor the holder opened; the child also
+// inherits the fixture's own descriptor on the loop device
+static gboolean holds(const BusyReport* report, const Holder* holder, const char* device) {
+    for (size_t i = 0; i < report->count; i++) {
+        const BusyEntry* entry = &report->entries[i];
+        if (entry->kind != BUSY_PROCESS || entry->pid != holder->pid || entry->fd != holder->fd) {
+            continue;
+        }
+        g_assert_cmpuint(entry->target, ==, 0);
+        g_assert_cmpstr(entry->device, ==, device);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void scan(Fixture* fixture, BusyReport* report) {
+    const char* paths[] = {fixture->loop_path};
+    GError* error = NULL;
+    g_assert_true(busy_scan(paths, 1, 2, report, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(report->processes_scanned, >, 0);
+}
+
+static void test_dev_alias(Fixture* fixture, gconstpointer data) {
+    if (!have_loop(fixture)) return;
+    Holder holder = start_holder(fixture->loop_path, FALSE);
+    BusyReport report;
+    scan(fixture, &report);
+    g_assert_true(holds(&report, &holder, fixture->loop_path + 5));
+
+    const char* paths[] = {fixture->loop_path};
+    FlValue* value = busy_report_to_fl_value(&report, paths, 1);
+    FlValue* device = fl_value_get_list_value(fl_value_lookup_string(value, "devices"), 0);
+    g_assert_true(fl_value_get_bool(fl_value_lookup_string(device, "busy")));
+    g_assert_cmpuint(fl_value_get_length(fl_value_lookup_string(device, "processes")), >=, 1);
+    fl_value_unref(value);
+    busy_report_clear(&report);
+    stop_holder(&holder);
+}
+
+// A node made with mknod outside /dev matches no alias; its inode does
+static void test_node_outside_dev(Fixture* fixture, gconstpointer data) {
+    if (!have_loop(fixture)) return;
+    char* node = make_node(fixture, "image-node");
+    Holder holder = start_holder(node, FALSE);
+    BusyReport report;
+    scan(fixture, &report);
+    g_assert_true(holds(&report, &holder, fixture->loop_path + 5));
+    busy_report_clear(&report);
+    stop_holder(&holder);
+
+    // The image file itself is not the device
+    holder = start_holder(fixture->image, FALSE);
+    scan(fixture, &report);
+    g_assert_false(holds(&report, &holder, fixture->loop_path + 5));
+    busy_report_clear(&report);
+    stop_holder(&holder);
+    unlink(node);
+    g_free(node);
+}
+
+// The node was removed after it was opened: the link reads "... (deleted)"
+static void test_deleted_node(Fixture* fixture, gconstpointer data) {
+    if (!have_loop(fixture)) return;
+    char* node = make_node(fixture, "gone-node");
+    Holder holder = start_holder(node, TRUE);
+    g_assert_false(g_file_test(node, G_FILE_TEST_EXISTS));
+    BusyReport report;
+    scan(fixture, &report);
+    g_assert_true(holds(&report, &holder, fixture->loop_path + 5));
+    busy_report_clear(&report);
+    stop_holder(&holder);
+    g_free(node);
+}
+
+// Nothing else holds a freshly attached device
+static void test_idle(Fixture* fixture, gconstpointer data) {
+    if (!have_loop(fixture)) return;
+    Holder holder = start_holder("/dev/null", FALSE);
+    BusyReport report;
+    scan(fixture, &report);
+    g_assert_false(holds(&report, &holder, fixture->loop_path + 5));
+    g_assert_cmpuint(report.fds_scanned, >, 0);
+    busy_report_clear(&report);
+    stop_holder(&holder);
+}
+
+static void test_not_block(void) {
+    const char* paths[] = {"/dev/null"};
+    BusyReport report;
+    GError* error = NULL;
+    g_assert_false(busy_scan(paths, 1, 1, &report, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+    g_clear_error(&error);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add("/busy_scan/dev_alias", Fixture, NULL, fixture_setup, test_dev_alias, fixture_teardown);
+    g_test_add("/busy_scan/node_outside_dev", Fixture, NULL, fixture_setup, test_node_outside_dev,
+               fixture_teardown);
+    g_test_add("/busy_scan/deleted_node", Fixture, NULL, fixture_setup, test_deleted_node,
+               fixture_teardown);
+    g_test_add("/busy_scan/idle", Fixture, NULL, fixture_setup, test_idle, fixture_teardown);
+    g_test_add_func("/busy_scan/not_block", test_not_block);
+    return g_test_run();
+}
@@ -0,0 +1,439 @@
+#define _GNU_SOURCE
+#include "../device_registry.h"
+#include "../device_sim.h"
+#include "../uevent_monitor.h"
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define GIB (1024ull * 1024 * 1024)
+#define NAMESPACES 16
+
+// A controller nvme0 serving NAMESPACES namespaces of 1, 2, ... GiB, and a
+// single-namespace controller nvme1 next to it
+static DeviceSim* fake_controllers(void) {
+    DeviceSim* sim = device_sim_new(0);
+    DeviceSimSpec spec;
+    for (guint i = 1; i <= NAMESPACES; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "nvme0n%u", i);
+        device_sim_spec_preset(&spec, DEVICE_SIM_NVME, name, i * GIB);
+        g_assert_true(device_sim_add(sim, &spec, NULL));
+    }
+    device_sim_spec_preset(&spec, DEVICE_SIM_NVME, "nvme1n1", 512 * GIB);
+    g_assert_true(device_sim_add(sim, &spec, NULL));
+    return sim;
+}
+
+static uint64_t admin_commands(DeviceSim* sim, const char* controller) {
+    uint64_t total = 0;
+    for (guint i = 1; i <= NAMESPACES; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "%sn%u", controller, i);
+        DeviceSimStats stats;
+        if (device_sim_get_stats(sim, name, &stats)) total += stats.admin_commands;
+    }
+    return total;
+}
+
+static FlValue* find_controller(FlValue* controllers, const char* name) {
+    for (size_t i = 0; i < fl_value_get_length(controllers); i++) {
+        FlValue* controller = fl_value_get_list_value(controllers, i);
+        if (strcmp(fl_value_get_string(fl_value_lookup_string(controller, "name")), name) == 0) {
+            return controller;
+        }
+    }
+    return NULL;
+}
+
+static int64_t lookup_int(FlValue* map, const char* key) {
+    FlValue* value = fl_value_lookup_string(map, key);
+    g_assert_nonnull(value);
+    return fl_value_get_int(value);
+}
+
+// Checks that @controller lists namespaces 1..NAMESPACES except @missing,
+// each with its block device and size
+static void check_namespaces(FlValue* controller, guint missing) {
+    FlValue* namespaces = fl_value_lookup_string(controller, "namespaces");
+    g_assert_cmpuint(fl_value_get_length(namespaces), ==, missing ? NAMESPACES - 1 : NAMESPACES);
+
+    size_t index = 0;
+    for (guint nsid = 1; nsid <= NAMESPACES; nsid++) {
+        if (nsid == missing) continue;
+        FlValue* entry = fl_value_get_list_value(namespaces, index++);
+        char name[32];
+        snprintf(name, sizeof(name), "nvme0n%u", nsid);
+        g_assert_cmpint(lookup_int(entry, "namespaceId"), ==, nsid);
+        g_assert_cmpstr(fl_value_get_string(fl_value_lookup_string(entry, "deviceName")), ==, name);
+        g_assert_cmpint(lookup_int(entry, "blockSize"), ==, 512);
+        g_assert_cmpint(lookup_int(entry, "sizeBytes"), ==, (int64_t)(nsid * GIB));
+    }
+}
+
+// Every controller is probed once: Identify Controller, the active list,
+// then Identify Namespace per active namespace
+static void test_controller_namespaces(void) {
+    DeviceSim* sim = fake_controllers();
+    const DeviceBackend* backend = device_sim_backend(sim);
+
+    GError* error = NULL;
+    FlValue* controllers = device_registry_get_nvme_controllers(backend, &error);
+    g_assert_no_error(error);
+    g_assert_nonnull(controllers);
+    g_assert_cmpuint(fl_value_get_length(controllers), ==, 2);
+
+    FlValue* nvme0 = find_controller(controllers, "nvme0");
+    g_assert_nonnull(nvme0);
+    g_assert_cmpstr(fl_value_get_string(fl_value_lookup_string(nvme0, "devicePath")), ==, "/dev/nvme0");
+    g_assert_true(fl_value_get_bool(fl_value_lookup_string(nvme0, "probed")));
+    g_assert_cmpint(lookup_int(nvme0, "adminCommands"), ==, NAMESPACES + 2);
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, NAMESPACES + 2);
+    check_namespaces(nvme0, 0);
+
+    FlValue* nvme1 = find_controller(controllers, "nvme1");
+    g_assert_nonnull(nvme1);
+    g_assert_cmpint(lookup_int(nvme1, "adminCommands"), ==, 1 + 2);
+    FlValue* namespaces = fl_value_lookup_string(nvme1, "namespaces");
+    g_assert_cmpuint(fl_value_get_length(namespaces), ==, 1);
+    g_assert_cmpint(lookup_int(fl_value_get_list_value(namespaces, 0), "sizeBytes"), ==,
+                    (int64_t)(512 * GIB));
+
+    fl_value_unref(controllers);
+    device_sim_free(sim);
+}
+
+// A namespace that goes away drops out of the active list and costs no
+// Identify Namespace
+static void test_namespace_removed(void) {
+    DeviceSim* sim = fake_controllers();
+    const DeviceBackend* backend = device_sim_backend(sim);
+    device_sim_set_present(sim, "nvme0n5", FALSE);
+
+    GError* error = NULL;
+    FlValue* controllers = device_registry_get_nvme_controllers(backend, &error);
+    g_assert_no_error(error);
+    FlValue* nvme0 = find_controller(controllers, "nvme0");
+    g_assert_nonnull(nvme0);
+    g_assert_cmpint(lookup_int(nvme0, "adminCommands"), ==, NAMESPACES - 1 + 2);
+    check_namespaces(nvme0, 5);
+
+    fl_value_unref(controllers);
+    device_sim_free(sim);
+}
+
+// The device list carries the controller and namespace ID of every namespace
+static void test_query_identity(void) {
+    DeviceSim* sim = fake_controllers();
+    const DeviceBackend* backend = device_sim_backend(sim);
+
+    DeviceQuery query = { .fields = DEVICE_FIELD_IDENTITY };
+    GError* error = NULL;
+    FlValue* devices = device_registry_query(backend, NULL, &query, &error);
+    g_assert_no_error(error);
+    g_assert_cmpuint(fl_value_get_length(devices), ==, NAMESPACES + 1);
+
+    for (size_t i = 0; i < fl_value_get_length(devices); i++) {
+        FlValue* device = fl_value_get_list_value(devices, i);
+        const char* name = fl_value_get_string(fl_value_lookup_string(device, "deviceName"));
+        FlValue* identity = fl_value_lookup_string(device, "nvmeIdentity");
+        g_assert_nonnull(identity);
+
+        unsigned int controller, nsid;
+        g_assert_cmpint(sscanf(name, "nvme%un%u", &controller, &nsid), ==, 2);
+        char controller_name[32];
+        snprintf(controller_name, sizeof(controller_name), "nvme%u", controller);
+        g_assert_cmpstr(fl_value_get_string(fl_value_lookup_string(identity, "controllerName")), ==,
+                        controller_name);
+        g_assert_cmpint(lookup_int(identity, "namespaceId"), ==, nsid);
+    }
+    // One probe per controller for all of their namespaces
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, NAMESPACES + 2);
+
+    fl_value_unref(devices);
+    device_sim_free(sim);
+}
+
+// The fixture controllers plus a SATA SSD, for the filters
+static DeviceSim* fake_mixed(void) {
+    DeviceSim* sim = fake_controllers();
+    DeviceSimSpec spec;
+    device_sim_spec_preset(&spec, DEVICE_SIM_SATA_SSD, "sda", 256 * GIB);
+    g_assert_true(device_sim_add(sim, &spec, NULL));
+    return sim;
+}
+
+static FlValue* query_devices(const DeviceBackend* backend, DeviceRegistryCache* cache,
+                              const DeviceQuery* query) {
+    GError* error = NULL;
+    FlValue* devices = device_registry_query(backend, cache, query, &error);
+    g_assert_no_error(error);
+    g_assert_nonnull(devices);
+    return devices;
+}
+
+static FlValue* find_device(FlValue* devices, const char* name) {
+    for (size_t i = 0; i < fl_value_get_length(devices); i++) {
+        FlValue* device = fl_value_get_list_value(devices, i);
+        if (strcmp(fl_value_get_string(fl_value_lookup_string(device, "deviceName")), name) == 0) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+static Uevent block_uevent(const char* action, const char* devname, const char* devtype,
+                           const char* devpath) {
+    Uevent event;
+    memset(&event, 0, sizeof(event));
+    g_strlcpy(event.action, action, sizeof(event.action));
+    g_strlcpy(event.subsystem, "block", sizeof(event.subsystem));
+    g_strlcpy(event.devname, devname, sizeof(event.devname));
+    g_strlcpy(event.devtype, devtype, sizeof(event.devtype));
+    g_strlcpy(event.devpath, devpath, sizeof(event.devpath));
+    return event;
+}
+
+// Memoized groups cost nothing on the next query; an uncached query probes
+// again
+static void test_cache_memoized(void) {
+    DeviceSim* sim = fake_controllers();
+    const DeviceBackend* backend = device_sim_backend(sim);
+    DeviceRegistryCache* cache = device_registry_cache_new();
+    DeviceQuery query = { .fields = DEVICE_FIELDS_ALL };
+
+    FlValue* first = query_devices(backend, cache, &query);
+    uint64_t probe_cost = admin_commands(sim, "nvme0");
+    g_assert_cmpuint(probe_cost, ==, NAMESPACES + 2);
+    for (int round = 0; round < 3; round++) {
+        FlValue* again = query_devices(backend, cache, &query);
+        g_assert_true(fl_value_equal(first, again));
+        fl_value_unref(again);
+    }
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, probe_cost);
+    g_assert_cmpuint(admin_commands(sim, "nvme1"), ==, 1 + 2);
+
+    // refresh bypasses the memo and stores what it found
+    query.refresh = TRUE;
+    fl_value_unref(query_devices(backend, cache, &query));
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, 2 * probe_cost);
+    query.refresh = FALSE;
+    fl_value_unref(query_devices(backend, cache, &query));
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, 2 * probe_cost);
+
+    fl_value_unref(query_devices(backend, NULL, &query));
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, 3 * probe_cost);
+
+    fl_value_unref(first);
+    device_registry_cache_free(cache);
+    device_sim_free(sim);
+}
+
+// A uevent for one namespace re-probes that namespace's controller only;
+// other block subsystems' events and a NULL event (rescan) behave as
+// documented
+static void test_cache_uevent(void) {
+    DeviceSim* sim = fake_controllers();
+    const DeviceBackend* backend = device_sim_backend(sim);
+    DeviceRegistryCache* cache = device_registry_cache_new();
+    DeviceQuery query = { .fields = DEVICE_FIELD_IDENTITY };
+
+    fl_value_unref(query_devices(backend, cache, &query));
+    uint64_t nvme0 = admin_commands(sim, "nvme0");
+    uint64_t nvme1 = admin_commands(sim, "nvme1");
+
+    Uevent event = block_uevent("change", "nvme0n3", "disk",
+                                "/devices/pci0000:00/0000:00:01.0/nvme/nvme0/nvme0n3");
+    device_registry_cache_apply_uevent(&event, cache);
+    FlValue* devices = query_devices(backend, cache, &query);
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), >, nvme0);
+    g_assert_cmpuint(admin_commands(sim, "nvme1"), ==, nvme1);
+    FlValue* identity = fl_value_lookup_string(find_device(devices, "nvme0n3"), "nvmeIdentity");
+    g_assert_nonnull(identity);
+    g_assert_cmpint(lookup_int(identity, "namespaceId"), ==, 3);
+    fl_value_unref(devices);
+    nvme0 = admin_commands(sim, "nvme0");
+
+    // Not a block device: nothing is dropped
+    Uevent other = event;
+    g_strlcpy(other.subsystem, "net", sizeof(other.subsystem));
+    device_registry_cache_apply_uevent(&other, cache);
+    fl_value_unref(query_devices(backend, cache, &query));
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, nvme0);
+
+    device_registry_cache_apply_uevent(NULL, cache);
+    fl_value_unref(query_devices(backend, cache, &query));
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, nvme0 + NAMESPACES + 2);
+    g_assert_cmpuint(admin_commands(sim, "nvme1"), ==, 2 * nvme1);
+
+    device_registry_cache_free(cache);
+    device_sim_free(sim);
+}
+
+// A partition uevent only drops the parent disk's partition list; the
+// identify data stays memoized
+static void test_cache_partition_uevent(void) {
+    DeviceSim* sim = fake_controllers();
+    const DeviceBackend* backend = device_sim_backend(sim);
+    DeviceRegistryCache* cache = device_registry_cache_new();
+    DeviceQuery query = { .fields = DEVICE_FIELD_IDENTITY | DEVICE_FIELD_PARTITIONS };
+
+    FlValue* before = query_devices(backend, cache, &query);
+    uint64_t nvme0 = admin_commands(sim, "nvme0");
+
+    Uevent event = block_uevent("add", "nvme0n3p1", "partition",
+                                "/devices/pci0000:00/0000:00:01.0/nvme/nvme0/nvme0n3/nvme0n3p1");
+    device_registry_cache_apply_uevent(&event, cache);
+    FlValue* after = query_devices(backend, cache, &query);
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, nvme0);
+
+    // Memoized groups are shared between results; the re-read list is new
+    g_assert_true(fl_value_lookup_string(find_device(before, "nvme0n3"), "partitions") !=
+                  fl_value_lookup_string(find_device(after, "nvme0n3"), "partitions"));
+    g_assert_true(fl_value_lookup_string(find_device(before, "nvme0n4"), "partitions") ==
+                  fl_value_lookup_string(find_device(after, "nvme0n4"), "partitions"));
+    g_assert_true(fl_value_lookup_string(find_device(before, "nvme0n3"), "nvmeIdentity") ==
+                  fl_value_lookup_string(find_device(after, "nvme0n3"), "nvmeIdentity"));
+
+    fl_value_unref(before);
+    fl_value_unref(after);
+    device_registry_cache_free(cache);
+    device_sim_free(sim);
+}
+
+// Only the requested groups are probed and returned
+static void test_query_fields(void) {
+    static const char* const grouped_keys[] = {
+        "geometry", "discard", "nvmeIdentity", "ataIdentity", "security", "partitions",
+    };
+    DeviceSim* sim = fake_controllers();
+    const DeviceBackend* backend = device_sim_backend(sim);
+
+    DeviceQuery query = { .fields = DEVICE_FIELDS_NONE };
+    FlValue* devices = query_devices(backend, NULL, &query);
+    g_assert_cmpuint(fl_value_get_length(devices), ==, NAMESPACES + 1);
+    FlValue* device = find_device(devices, "nvme0n2");
+    g_assert_cmpstr(fl_value_get_string(fl_value_lookup_string(device, "devicePath")), ==, "/dev/nvme0n2");
+    g_assert_cmpstr(fl_value_get_string(fl_value_lookup_string(device, "deviceType")), ==, "nvme");
+    g_assert_cmpint(lookup_int(device, "totalBytes"), ==, (int64_t)(2 * GIB));
+    for (guint k = 0; k < G_N_ELEMENTS(grouped_keys); k++) {
+        g_assert_null(fl_value_lookup_string(device, grouped_keys[k]));
+    }
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, 0);
+    fl_value_unref(devices);
+
+    query.fields = DEVICE_FIELD_GEOMETRY;
+    devices = query_devices(backend, NULL, &query);
+    device = find_device(devices, "nvme0n2");
+    FlValue* geometry = fl_value_lookup_string(device, "geometry");
+    g_assert_nonnull(geometry);
+    g_assert_cmpint(lookup_int(geometry, "logicalSectorSize"), ==, 512);
+    g_assert_cmpint(lookup_int(geometry, "userAddressableSectors"), ==, (int64_t)(2 * GIB / 512));
+    for (guint k = 1; k < G_N_ELEMENTS(grouped_keys); k++) {
+        g_assert_null(fl_value_lookup_string(device, grouped_keys[k]));
+    }
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, 0);
+    fl_value_unref(devices);
+
+    // Security needs the identify data but does not return it
+    query.fields = DEVICE_FIELD_SECURITY;
+    devices = query_devices(backend, NULL, &query);
+    device = find_device(devices, "nvme0n2");
+    g_assert_nonnull(fl_value_lookup_string(device, "security"));
+    g_assert_null(fl_value_lookup_string(device, "nvmeIdentity"));
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, NAMESPACES + 2);
+    fl_value_unref(devices);
+
+    g_assert_cmpuint(device_fields_from_name("geometry"), ==, DEVICE_FIELD_GEOMETRY);
+    g_assert_cmpuint(device_fields_from_name("partitions"), ==, DEVICE_FIELD_PARTITIONS);
+    g_assert_cmpuint(device_fields_from_name("all"), ==, DEVICE_FIELDS_ALL);
+    g_assert_cmpuint(device_fields_from_name("nvmeIdentity"), ==, 0);
+    device_sim_free(sim);
+}
+
+// A cached query with fewer groups than memoized returns only those
+static void test_cache_projection(void) {
+    DeviceSim* sim = fake_controllers();
+    const DeviceBackend* backend = device_sim_backend(sim);
+    DeviceRegistryCache* cache = device_registry_cache_new();
+
+    DeviceQuery query = { .fields = DEVICE_FIELDS_ALL };
+    fl_value_unref(query_devices(backend, cache, &query));
+    query.fields = DEVICE_FIELD_DISCARD;
+    FlValue* devices = query_devices(backend, cache, &query);
+    FlValue* device = find_device(devices, "nvme1n1");
+    g_assert_null(fl_value_lookup_string(device, "nvmeIdentity"));
+    g_assert_null(fl_value_lookup_string(device, "geometry"));
+    // The basic model name is not overridden by an identity left out
+    g_assert_nonnull(fl_value_lookup_string(device, "modelName"));
+    fl_value_unref(devices);
+
+    device_registry_cache_free(cache);
+    device_sim_free(sim);
+}
+
+static size_t count_filtered(const DeviceBackend* backend, const DeviceQuery* query) {
+    FlValue* devices = query_devices(backend, NULL, query);
+    size_t count = fl_value_get_length(devices);
+    fl_value_unref(devices);
+    return count;
+}
+
+// Path, type and transport filters combine; each list matches any entry
+static void test_query_filters(void) {
+    DeviceSim* sim = fake_mixed();
+    const DeviceBackend* backend = device_sim_backend(sim);
+
+    DeviceQuery query = { .fields = DEVICE_FIELDS_NONE };
+    g_assert_cmpuint(count_filtered(backend, &query), ==, NAMESPACES + 2);
+
+    const char* paths[] = {"/dev/nvme0n7", "sda", "/dev/sdz", NULL};
+    query.paths = paths;
+    FlValue* devices = query_devices(backend, NULL, &query);
+    g_assert_cmpuint(fl_value_get_length(devices), ==, 2);
+    g_assert_nonnull(find_device(devices, "nvme0n7"));
+    g_assert_nonnull(find_device(devices, "sda"));
+    fl_value_unref(devices);
+
+    const char* sata[] = {"sata", NULL};
+    query.types = sata;
+    devices = query_devices(backend, NULL, &query);
+    g_assert_cmpuint(fl_value_get_length(devices), ==, 1);
+    g_assert_cmpstr(fl_value_get_string(fl_value_lookup_string(fl_value_get_list_value(devices, 0),
+                                                                "transport")), ==, "sata");
+    fl_value_unref(devices);
+
+    query.paths = NULL;
+    query.types = NULL;
+    const char* nvme[] = {"nvme", NULL};
+    query.transports = nvme;
+    g_assert_cmpuint(count_filtered(backend, &query), ==, NAMESPACES + 1);
+    query.types = sata;
+    g_assert_cmpuint(count_filtered(backend, &query), ==, 0);
+
+    const char* none[] = {NULL};
+    query.types = NULL;
+    query.transports = none;
+    g_assert_cmpuint(count_filtered(backend, &query), ==, 0);
+
+    // Filtering happens before any group is probed
+    query.transports = sata;
+    query.fields = DEVICE_FIELD_IDENTITY;
+    g_assert_cmpuint(count_filtered(backend, &query), ==, 1);
+    g_assert_cmpuint(admin_commands(sim, "nvme0"), ==, 0);
+    device_sim_free(sim);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/device_registry/controller_namespaces", test_controller_namespaces);
+    g_test_add_func("/device_registry/namespace_removed", test_namespace_removed);
+    g_test_add_func("/device_registry/query_identity", test_query_identity);
+    g_test_add_func("/device_registry/query_fields", test_query_fields);
+    g_test_add_func("/device_registry/query_filters", test_query_filters);
+    g_test_add_func("/device_registry/cache_memoized", test_cache_memoized);
+    g_test_add_func("/device_registry/cache_uevent", test_cache_uevent);
+    g_test_add_func("/device_registry/cache_partition_uevent", test_cache_partition_uevent);
+    g_test_add_func("/device_registry/cache_projection", test_cache_projection);
+    return g_test_run();
+}
@@ -0,0 +1,287 @@
+#define _GNU_SOURCE
+#include "../discard.h"
+#include "../device_sim.h"
+#include <fcntl.h>
+#include <glib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MIB (1024ull * 1024)
+#define GIB (1024ull * MIB)
+#define FILE_SIZE (8 * MIB)
+
+// Every progress report, checked to only ever move forward through the
+// whole range
+typedef struct {
+    guint reports;
+    uint64_t first_done;
+    uint64_t last_done;
+    uint64_t total;
+} ProgressLog;
+
+static void on_progress(const BulkProgress* progress, void* user_data) {
+    ProgressLog* log = user_data;
+    g_assert_cmpuint(progress->bytes_done, >=, log->last_done);
+    g_assert_cmpuint(progress->bytes_done, <=, progress->bytes_total);
+    if (log->reports == 0) log->first_done = progress->bytes_done;
+    log->reports++;
+    log->last_done = progress->bytes_done;
+    log->total = progress->bytes_total;
+}
+
+// A scratch file of FILE_SIZE bytes of 0xAB
+static int make_file(char** path) {
+    int fd = g_file_open_tmp("discard-XXXXXX", path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    guint8* data = g_malloc(FILE_SIZE);
+    memset(data, 0xAB, FILE_SIZE);
+    g_assert_cmpint(pwrite(fd, data, FILE_SIZE, 0), ==, FILE_SIZE);
+    g_free(data);
+    return fd;
+}
+
+static void close_file(int fd, char* path) {
+    close(fd);
+    unlink(path);
+    g_free(path);
+}
+
+// Bytes of @data that are not zeros over [offset, offset + length) and the
+// old 0xAB contents around it
+static uint64_t unexpected_bytes(const guint8* data, uint64_t size, uint64_t offset, uint64_t length) {
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < size; i++) {
+        guint8 expected = i >= offset && i < offset + length ? 0 : 0xAB;
+        if (data[i] != expected) count++;
+    }
+    return count;
+}
+
+static void assert_zeroed(int fd, uint64_t offset, uint64_t length) {
+    guint8* data = g_malloc(FILE_SIZE);
+    g_assert_cmpint(pread(fd, data, FILE_SIZE, 0), ==, FILE_SIZE);
+    g_assert_cmpuint(unexpected_bytes(data, FILE_SIZE, offset, length), ==, 0);
+    g_free(data);
+}
+
+static void file_options(DiscardOptions* options, DiscardMode mode, ProgressLog* log) {
+    memset(options, 0, sizeof(*options));
+    options->offset = 1 * MIB;
+    options->length = 4 * MIB;
+    options->mode = mode;
+    options->progress = on_progress;
+    options->user_data = log;
+}
+
+// Punch-hole deallocates the range, which reads back as zeros
+static void test_file_discard(void) {
+    char* path;
+    int fd = make_file(&path);
+    DiscardCapabilities caps;
+    g_assert_true(discard_get_capabilities_for_fd(fd, &caps));
+    g_assert_cmpuint(caps.discard_max_bytes, >, 0);
+    g_assert_true(caps.discard_zeroes_data);
+
+    ProgressLog log = { 0 };
+    DiscardOptions options;
+    file_options(&options, DISCARD_MODE_DISCARD, &log);
+    DiscardResult result;
+    GError* error = NULL;
+    g_assert_true(discard_range(fd, &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(result.bytes_done, ==, options.length);
+    g_assert_false(result.used_fallback);
+    g_assert_true(result.reads_zero);
+    g_assert_cmpuint(log.last_done, ==, options.length);
+    g_assert_cmpuint(log.total, ==, options.length);
+    assert_zeroed(fd, options.offset, options.length);
+
+    // Misaligned ranges are refused before anything is issued
+    options.offset = 100;
+    g_assert_false(discard_range(fd, &options, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+    g_clear_error(&error);
+    close_file(fd, path);
+}
+
+static void test_file_zero_range(void) {
+    char* path;
+    int fd = make_file(&path);
+    ProgressLog log = { 0 };
+    DiscardOptions options;
+    file_options(&options, DISCARD_MODE_ZEROOUT, &log);
+    DiscardResult result;
+    GError* error = NULL;
+    g_assert_true(discard_range(fd, &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(result.bytes_done, ==, options.length);
+    g_assert_true(result.reads_zero);
+    g_assert_cmpuint(log.last_done, ==, options.length);
+    assert_zeroed(fd, options.offset, options.length);
+    close_file(fd, path);
+}
+
+// No filesystem erases old blocks: secure discard is refused, or finished
+// by overwriting when allowed to
+static void test_file_fallback(void) {
+    char* path;
+    int fd = make_file(&path);
+    ProgressLog log = { 0 };
+    DiscardOptions options;
+    file_options(&options, DISCARD_MODE_SECURE_DISCARD, &log);
+    DiscardResult result;
+    GError* error = NULL;
+    g_assert_false(discard_range(fd, &options, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+    g_clear_error(&error);
+    g_assert_cmpuint(result.bytes_done, ==, 0);
+    assert_zeroed(fd, 0, 0);
+
+    options.fallback_to_overwrite = TRUE;
+    g_assert_true(discard_range(fd, &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_true(result.used_fallback);
+    g_assert_true(result.reads_zero);
+    g_assert_cmpuint(result.bytes_done, ==, options.length);
+    assert_zeroed(fd, options.offset, options.length);
+    close_file(fd, path);
+}
+
+static int sim_open(DeviceSim* sim, const char* name) {
+    const DeviceBackend* backend = device_sim_backend(sim);
+    char* path = g_strdup_printf("/dev/%s", name);
+    int fd = backend->open_device(path, O_RDWR, backend->ctx);
+    g_assert_cmpint(fd, >=, 0);
+    g_free(path);
+    return fd;
+}
+
+// A disk cannot discard: nothing is issued unless overwriting is allowed
+static void test_sim_unsupported(void) {
+    DeviceSimSpec spec;
+    DeviceSim* sim = device_sim_new(0);
+    device_sim_spec_preset(&spec, DEVICE_SIM_HDD, "sda", 1 * GIB);
+    g_assert_true(device_sim_add(sim, &spec, NULL));
+    int fd = sim_open(sim, "sda");
+
+    DiscardOptions options = {
+        .offset = 0,
+        .length = 64 * MIB,
+        .mode = DISCARD_MODE_DISCARD,
+        .backend = device_sim_backend(sim),
+        .device = "sda",
+    };
+    DiscardResult result;
+    GError* error = NULL;
+    g_assert_false(discard_range(fd, &options, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+    g_clear_error(&error);
+
+    options.fallback_to_overwrite = TRUE;
+    g_assert_true(discard_range(fd, &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_true(result.used_fallback);
+    DeviceSimStats stats;
+    g_assert_true(device_sim_get_stats(sim, "sda", &stats));
+    g_assert_cmpuint(stats.bytes_discarded, ==, 0);
+    g_assert_cmpuint(stats.bytes_written, ==, options.length);
+    device_sim_free(sim);
+}
+
+// Zero-out is offloaded on NVMe and clears the data in the range only
+static void test_sim_zeroout(void) {
+    DeviceSimSpec spec;
+    DeviceSim* sim = device_sim_new(0);
+    device_sim_spec_preset(&spec, DEVICE_SIM_NVME, "nvme0n1", 64 * MIB);
+    spec.retain_data = TRUE;
+    g_assert_true(device_sim_add(sim, &spec, NULL));
+    const DeviceBackend* backend = device_sim_backend(sim);
+    int fd = sim_open(sim, "nvme0n1");
+
+    guint8* data = g_malloc(16 * MIB);
+    memset(data, 0xAB, 16 * MIB);
+    g_assert_cmpint(backend->pwrite(fd, data, 16 * MIB, 0, backend->ctx), ==, 16 * MIB);
+
+    DiscardOptions options = {
+        .offset = 4 * MIB,
+        .length = 8 * MIB,
+        .mode = DISCARD_MODE_ZEROOUT,
+        .backend = backend,
+        .device = "nvme0n1",
+    };
+    DiscardResult result;
+    GError* error = NULL;
+    g_assert_true(discard_range(fd, &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_false(result.used_fallback);
+    g_assert_true(result.reads_zero);
+
+    g_assert_cmpint(backend->pread(fd, data, 16 * MIB, 0, backend->ctx), ==, 16 * MIB);
+    g_assert_cmpuint(unexpected_bytes(data, 16 * MIB, options.offset, options.length), ==, 0);
+    DeviceSimStats stats;
+    g_assert_true(device_sim_get_stats(sim, "nvme0n1", &stats));
+    g_assert_cmpuint(stats.bytes_zeroed, ==, options.length);
+    g_assert_cmpuint(stats.bytes_written, ==, 16 * MIB);
+    g_free(data);
+    device_sim_free(sim);
+}
+
+// The device stops discarding part way through; the overwrite of the rest
+// reports progress through the whole range, starting past what was
+// already discarded
+static void test_sim_partial_fallback(void) {
+    DeviceSimSpec spec;
+    DeviceSim* sim = device_sim_new(1);
+    device_sim_spec_preset(&spec, DEVICE_SIM_SATA_SSD, "sdb", 4 * GIB);
+    // Slow enough that the overwrite outlasts a progress interval
+    spec.write_bandwidth = 100e6;
+    spec.saturation_depth = 1;
+    spec.bad_regions[0] = (DeviceSimBadRegion){
+        .offset = 2 * GIB + 64 * MIB,
+        .length = 1 * MIB,
+        .failure = DEVICE_SIM_FAIL_NO_DISCARD,
+    };
+    spec.bad_region_count = 1;
+    g_assert_true(device_sim_add(sim, &spec, NULL));
+    int fd = sim_open(sim, "sdb");
+
+    ProgressLog log = { 0 };
+    DiscardOptions options = {
+        .offset = 0,
+        .length = 2 * GIB + 128 * MIB,
+        .mode = DISCARD_MODE_DISCARD,
+        .fallback_to_overwrite = TRUE,
+        .progress = on_progress,
+        .user_data = &log,
+        .backend = device_sim_backend(sim),
+        .device = "sdb",
+    };
+    DiscardResult result;
+    GError* error = NULL;
+    g_assert_true(discard_range(fd, &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_true(result.used_fallback);
+    g_assert_cmpuint(result.bytes_done, ==, options.length);
+
+    // Two full requests went through before the third hit the region
+    DeviceSimStats stats;
+    g_assert_true(device_sim_get_stats(sim, "sdb", &stats));
+    g_assert_cmpuint(stats.bytes_discarded, ==, 2 * GIB);
+    g_assert_cmpuint(stats.bytes_written, ==, 128 * MIB);
+
+    g_assert_cmpuint(log.reports, >, 0);
+    g_assert_cmpuint(log.first_done, >, 2 * GIB);
+    g_assert_cmpuint(log.total, ==, options.length);
+    device_sim_free(sim);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/discard/file_discard", test_file_discard);
+    g_test_add_func("/discard/file_zero_range", test_file_zero_range);
+    g_test_add_func("/discard/file_fallback", test_file_fallback);
+    g_test_add_func("/discard/sim_unsupported", test_sim_unsupported);
+    g_test_add_func("/discard/sim_zeroout", test_sim_zeroout);
+    g_test_add_func("/discard/sim_partial_fallback", test_sim_partial_fallback);
+    return g_test_run();
+}
@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include "../diskstats.h"
+#include <fcntl.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_LINES 4096
+
+// Lines as the kernel formats them: 11 fields before 4.18, 15 with the
+// discard group, 17 with the flush group from 5.5
+#define LINE_11 "   8       0 sda 224813 71291 12440474 118210 161742 120877 11356208 592301 0 206324 710512\n"
+#define LINE_15 "   8      16 sdb 100 2 800 500 40 1 320 80 1 300 580 6 0 4096 12\n"
+#define LINE_17 " 259       0 nvme0n1 523 0 41728 96 88 11 2048 17 0 104 113 4 0 8192 2 9 3\n"
+
+typedef struct {
+    char* path;
+    DiskStatsSampler* sampler;
+} Fixture;
+
+// Writes in place, as procfs regenerates the file behind the open descriptor
+static void write_stats(const char* path, const char* contents) {
+    int fd = open(path, O_WRONLY | O_TRUNC | O_CLOEXEC);
+    g_assert_cmpint(fd, >=, 0);
+    g_assert_cmpint(write(fd, contents, strlen(contents)), ==, (gssize)strlen(contents));
+    close(fd);
+}
+
+static void fixture_setup(Fixture* fixture, gconstpointer data) {
+    int fd = g_file_open_tmp("diskstats-XXXXXX", &fixture->path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+    write_stats(fixture->path, LINE_11 LINE_15);
+    GError* error = NULL;
+    fixture->sampler = diskstats_sampler_new(fixture->path, 5, &error);
+    g_assert_no_error(error);
+    g_assert_nonnull(fixture->sampler);
+}
+
+static void fixture_teardown(Fixture* fixture, gconstpointer data) {
+    diskstats_sampler_free(fixture->sampler);
+    unlink(fixture->path);
+    g_free(fixture->path);
+}
+
+// Ticks far enough apart that the interval is never zero
+static void tick(Fixture* fixture) {
+    GError* error = NULL;
+    usleep(2000);
+    g_assert_true(diskstats_sampler_tick(fixture->sampler, &error));
+    g_assert_no_error(error);
+}
+
+static void test_parse_fields(void) {
+    static const char stats[] = LINE_11 LINE_15 LINE_17;
+    DiskStatsEntry entries[4];
+    memset(entries, 0xFF, sizeof(entries));
+    g_assert_cmpuint(diskstats_parse(stats, strlen(stats), entries, G_N_ELEMENTS(entries)), ==, 3);
+
+    g_assert_cmpstr(entries[0].name, ==, "sda");
+    g_assert_cmpuint(entries[0].major, ==, 8);
+    g_assert_cmpuint(entries[0].minor, ==, 0);
+    g_assert_cmpuint(entries[0].reads_completed, ==, 224813);
+    g_assert_cmpuint(entries[0].sectors_written, ==, 11356208);
+    g_assert_cmpuint(entries[0].weighted_io_ms, ==, 710512);
+    // Groups the kernel did not report read as zero
+    g_assert_cmpuint(entries[0].sectors_discarded, ==, 0);
+    g_assert_cmpuint(entries[0].flushes_completed, ==, 0);
+
+    g_assert_cmpstr(entries[1].name, ==, "sdb");
+    g_assert_cmpuint(entries[1].in_flight, ==, 1);
+    g_assert_cmpuint(entries[1].discards_completed, ==, 6);
+    g_assert_cmpuint(entries[1].sectors_discarded, ==, 4096);
+    g_assert_cmpuint(entries[1].discard_ms, ==, 12);
+    g_assert_cmpuint(entries[1].flush_ms, ==, 0);
+
+    g_assert_cmpstr(entries[2].name, ==, "nvme0n1");
+    g_assert_cmpuint(entries[2].major, ==, 259);
+    g_assert_cmpuint(entries[2].sectors_discarded, ==, 8192);
+    g_assert_cmpuint(entries[2].flushes_completed, ==, 9);
+    g_assert_cmpuint(entries[2].flush_ms, ==, 3);
+
+    // Without a trailing newline the last line still counts
+    g_assert_cmpuint(diskstats_parse(stats, strlen(stats) - 1, entries, G_N_ELEMENTS(entries)), ==, 3);
+    g_assert_cmpuint(entries[2].flush_ms, ==, 3);
+}
+
+static void test_parse_malformed(void) {
+    static const char stats[] =
+        "\n"
+        "   8 0 short 1 2 3 4 5 6 7 8 9 10\n"
+        "   8 1 word 1 2 3 4 five 6 7 8 9 10 11\n"
+        "   x 2 sdc 1 2 3 4 5 6 7 8 9 10 11\n"
+        "   8 3\n"
+        "   8 4 averyveryverylongdevicenamethatdoesnotfit 1 2 3 4 5 6 7 8 9 10 11\n"
+        "\t8\t5\tsdf\t1 2 3 4 5 6 7 8 9 10 11  \n";
+    DiskStatsEntry entries[4];
+    g_assert_cmpuint(diskstats_parse(stats, strlen(stats), entries, G_N_ELEMENTS(entries)), ==, 2);
+    g_assert_cmpuint(strlen(entries[0].name), ==, DISKSTATS_NAME_MAX - 1);
+    g_assert_true(g_str_has_prefix("averyveryverylongdevicenamethatdoesnotfit", entries[0].name));
+    g_assert_cmpuint(entries[0].weighted_io_ms, ==, 11);
+    g_assert_cmpstr(entries[1].name, ==, "sdf");
+    g_assert_cmpuint(entries[1].minor, ==, 5);
+
+    // More lines than room: all are counted, the first ones stored
+    static const char three[] = LINE_11 LINE_15 LINE_17;
+    memset(entries, 0, sizeof(entries));
+    g_assert_cmpuint(diskstats_parse(three, strlen(three), entries, 1), ==, 3);
+    g_assert_cmpstr(entries[0].name, ==, "sda");
+    g_assert_cmpstr(entries[1].name, ==, "");
+}
+
+static void test_rates(void) {
+    DiskStatsEntry previous = { .name = "sdb", .major = 8, .minor = 16 };
+    previous.reads_completed = 1000;
+    previous.sectors_read = 80000;
+    previous.read_ms = 2000;
+    previous.writes_completed = 500;
+    previous.sectors_written = 40000;
+    previous.write_ms = 1500;
+    previous.io_ms = 10000;
+    previous.weighted_io_ms = 20000;
+
+    DiskStatsEntry current = previous;
+    current.reads_completed += 200;
+    current.sectors_read += 16000;
+    current.read_ms += 400;
+    current.writes_completed += 50;
+    current.sectors_written += 8000;
+    current.write_ms += 500;
+    current.io_ms += 500;
+    current.weighted_io_ms += 1500;
+    current.in_flight = 3;
+
+    DiskIoRates rates;
+    diskstats_compute_rates(&previous, &current, 2000000, &rates);
+    g_assert_cmpstr(rates.name, ==, "sdb");
+    g_assert_cmpuint(rates.minor, ==, 16);
+    g_assert_cmpfloat_with_epsilon(rates.read_bytes_per_sec, 16000.0 * 512 / 2, 1e-6);
+    g_assert_cmpfloat_with_epsilon(rates.write_bytes_per_sec, 8000.0 * 512 / 2, 1e-6);
+    g_assert_cmpfloat_with_epsilon(rates.read_iops, 100.0, 1e-9);
+    g_assert_cmpfloat_with_epsilon(rates.write_iops, 25.0, 1e-9);
+    g_assert_cmpfloat_with_epsilon(rates.read_await_ms, 2.0, 1e-9);
+    g_assert_cmpfloat_with_epsilon(rates.write_await_ms, 10.0, 1e-9);
+    g_assert_cmpfloat_with_epsilon(rates.service_time_ms, 2.0, 1e-9);
+    g_assert_cmpfloat_with_epsilon(rates.queue_depth, 0.75, 1e-9);
+    g_assert_cmpfloat_with_epsilon(rates.utilization, 25.0, 1e-9);
+    g_assert_cmpuint(rates.in_flight, ==, 3);
+
+    // Busy time beyond the interval is capped at 100 percent
+    current.io_ms = previous.io_ms + 5000;
+    diskstats_compute_rates(&previous, &current, 2000000, &rates);
+    g_assert_cmpfloat(rates.utilization, ==, 100.0);
+
+    // No baseline or no time: identity only
+    diskstats_compute_rates(NULL, &current, 2000000, &rates);
+    g_assert_cmpstr(rates.name, ==, "sdb");
+    g_assert_cmpfloat(rates.read_iops, ==, 0.0);
+    diskstats_compute_rates(&previous, &current, 0, &rates);
+    g_assert_cmpfloat(rates.read_bytes_per_sec, ==, 0.0);
+}
+
+// Counters that went backwards (a device re-registered, or a 32-bit
+// counter wrapped) give zero for that counter, never a huge rate
+static void test_counter_wrap(void) {
+    DiskStatsEntry previous = { .name = "sda", .major = 8, .minor = 0 };
+    previous.reads_completed = G_MAXUINT32 - 10;
+    previous.sectors_read = G_MAXUINT32 - 100;
+    previous.read_ms = 4000;
+    previous.writes_completed = 10;
+    previous.sectors_written = 80;
+
+    DiskStatsEntry current = previous;
+    current.reads_completed = 5;
+    current.sectors_read = 40;
+    current.read_ms = 4100;
+    current.writes_completed = 20;
+    current.sectors_written = 160;
+
+    DiskIoRates rates;
+    diskstats_compute_rates(&previous, &current, 1000000, &rates);
+    g_assert_cmpfloat(rates.read_iops, ==, 0.0);
+    g_assert_cmpfloat(rates.read_bytes_per_sec, ==, 0.0);
+    g_assert_cmpfloat(rates.read_await_ms, ==, 0.0);
+    g_assert_cmpfloat_with_epsilon(rates.write_iops, 10.0, 1e-9);
+    g_assert_cmpfloat_with_epsilon(rates.write_bytes_per_sec, 80.0 * 512, 1e-6);
+}
+
+// Ratios of the rates do not depend on the measured interval
+static void assert_sdb_rates(const DiskIoRates* rates) {
+    g_assert_cmpstr(rates->name, ==, "sdb");
+    g_assert_cmpfloat(rates->read_iops, >, 0.0);
+    g_assert_cmpfloat_with_epsilon(rates->read_bytes_per_sec / rates->read_iops, 4096.0, 1e-6);
+    g_assert_cmpfloat_with_epsilon(rates->read_await_ms, 5.0, 1e-9);
+}
+
+static void test_sampler(Fixture* fixture, gconstpointer data) {
+    FlValue* list = diskstats_sampler_rates(fixture->sampler);
+    g_assert_cmpuint(fl_value_get_length(list), ==, 0);
+    fl_value_unref(list);
+
+    tick(fixture);
+    DiskIoRates rates;
+    g_assert_false(diskstats_sampler_get(fixture->sampler, "sda", &rates));
+
+    // sdb: 100 reads of 8 sectors at 5 ms each
+    write_stats(fixture->path, LINE_11 "   8      16 sdb 200 2 1600 1000 40 1 320 80 1 300 580 6 0 4096 12\n");
+    tick(fixture);
+    g_assert_true(diskstats_sampler_get(fixture->sampler, "sda", &rates));
+    g_assert_cmpfloat(rates.read_iops, ==, 0.0);
+    g_assert_cmpfloat(rates.utilization, ==, 0.0);
+    g_assert_true(diskstats_sampler_get(fixture->sampler, "sdb", &rates));
+    assert_sdb_rates(&rates);
+    g_assert_false(diskstats_sampler_get(fixture->sampler, "nvme0n1", &rates));
+
+    list = diskstats_sampler_rates(fixture->sampler);
+    g_assert_cmpuint(fl_value_get_length(list), ==, 2);
+    fl_value_unref(list);
+}
+
+// A device appearing ahead of the others shifts every index; each device
+// is still paired with its own previous line, and the newcomer has no
+// baseline yet
+static void test_index_mismatch(Fixture* fixture, gconstpointer data) {
+    tick(fixture);
+    write_stats(fixture->path,
+                "   7       0 loop0 9000000 0 72000000 9000000 0 0 0 0 0 9000000 9000000\n"
+                LINE_11
+                "   8      16 sdb 200 2 1600 1000 40 1 320 80 1 300 580 6 0 4096 12\n");
+    tick(fixture);
+
+    DiskIoRates rates;
+    g_assert_true(diskstats_sampler_get(fixture->sampler, "loop0", &rates));
+    g_assert_cmpfloat(rates.read_iops, ==, 0.0);
+    g_assert_cmpfloat(rates.utilization, ==, 0.0);
+    g_assert_true(diskstats_sampler_get(fixture->sampler, "sda", &rates));
+    g_assert_cmpfloat(rates.read_iops, ==, 0.0);
+    g_assert_true(diskstats_sampler_get(fixture->sampler, "sdb", &rates));
+    assert_sdb_rates(&rates);
+
+    // Same name under a new number is a different device
+    write_stats(fixture->path,
+                "   7       0 loop0 9000000 0 72000000 9000000 0 0 0 0 0 9000000 9000000\n"
+                "   8      32 sda 224913 71291 12441274 118710 161742 120877 11356208 592301 0 206824 711012\n"
+                "   8      16 sdb 300 2 2400 1500 40 1 320 80 1 300 580 6 0 4096 12\n");
+    tick(fixture);
+    g_assert_true(diskstats_sampler_get(fixture->sampler, "sda", &rates));
+    g_assert_cmpuint(rates.minor, ==, 32);
+    g_assert_cmpfloat(rates.read_iops, ==, 0.0);
+    g_assert_true(diskstats_sampler_get(fixture->sampler, "sdb", &rates));
+    assert_sdb_rates(&rates);
+
+    // Removed devices drop out
+    write_stats(fixture->path, "   8      16 sdb 400 2 3200 2000 40 1 320 80 1 300 580 6 0 4096 12\n");
+    tick(fixture);
+    g_assert_false(diskstats_sampler_get(fixture->sampler, "loop0", &rates));
+    g_assert_true(diskstats_sampler_get(fixture->sampler, "sdb", &rates));
+    assert_sdb_rates(&rates);
+}
+
+static void on_tick(DiskStatsSampler* sampler, void* user_data) {
+    guint* ticks = user_data;
+    DiskIoRates rates;
+    g_assert_true(diskstats_sampler_get(sampler, "sda", &rates));
+    __atomic_add_fetch(ticks, 1, __ATOMIC_RELAXED);
+}
+
+// The callback only runs once there are rates to read
+static void test_thread(Fixture* fixture, gconstpointer data) {
+    guint ticks = 0;
+    g_assert_true(diskstats_sampler_start(fixture->sampler, on_tick, &ticks));
+    while (__atomic_load_n(&ticks, __ATOMIC_RELAXED) < 3) {
+        usleep(1000);
+    }
+    diskstats_sampler_stop(fixture->sampler);
+    guint stopped = ticks;
+    usleep(20000);
+    g_assert_cmpuint(ticks, ==, stopped);
+}
+
+// @lines devices in the 17-field format, numbered from @first
+static char* make_stats(guint lines, guint first, size_t* length) {
+    size_t capacity = (size_t)lines * 128;
+    char* stats = g_malloc(capacity);
+    size_t used = 0;
+    for (guint i = 0; i < lines; i++) {
+        guint n = first + i;
+        used += (size_t)snprintf(stats + used, capacity - used,
+                                 " %4u %7u dev%u %u 71291 12440474 118210 161742 120877 "
+                                 "11356208 592301 0 206324 710512 6 0 4096 12 9876 543\n",
+                                 8 + n / 256, n % 256, n, 224813 + n);
+    }
+    if (length) *length = used;
+    return stats;
+}
+
+// Parse throughput and full tick cost for BENCH_LINES devices, with the
+// lines in place and with every line shifted by one; run with -m perf
+static void test_parse_benchmark(void) {
+    size_t length;
+    char* stats = make_stats(BENCH_LINES, 0, &length);
+    DiskStatsEntry* entries = g_new(DiskStatsEntry, BENCH_LINES);
+    guint rounds = 200;
+
+    g_test_timer_start();
+    for (guint r = 0; r < rounds; r++) {
+        g_assert_cmpuint(diskstats_parse(stats, length, entries, BENCH_LINES), ==, BENCH_LINES);
+    }
+    double elapsed = g_test_timer_elapsed();
+    double parse_ns = elapsed * 1e9 / ((double)rounds * BENCH_LINES);
+    double parse_mbps = (double)length * rounds / elapsed / 1e6;
+    g_test_minimized_result(parse_ns, "parse: %.1f ns per line, %.0f MB/s", parse_ns, parse_mbps);
+
+    char* path;
+    int fd = g_file_open_tmp("diskstats-bench-XXXXXX", &path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+    write_stats(path, stats);
+    GError* error = NULL;
+    DiskStatsSampler* sampler = diskstats_sampler_new(path, 1000, &error);
+    g_assert_no_error(error);
+    g_assert_true(diskstats_sampler_tick(sampler, NULL));
+
+    g_test_timer_start();
+    for (guint r = 0; r < rounds; r++) {
+        g_assert_true(diskstats_sampler_tick(sampler, NULL));
+    }
+    double steady_us = g_test_timer_elapsed() * 1e6 / rounds;
+
+    // Every device moved one line down: each match falls back to the scan
+    char* shifted = make_stats(BENCH_LINES, 1, NULL);
+    guint shifted_rounds = 10;
+    g_test_timer_start();
+    for (guint r = 0; r < shifted_rounds; r++) {
+        write_stats(path, r % 2 == 0 ? shifted : stats);
+        g_assert_true(diskstats_sampler_tick(sampler, NULL));
+    }
+    double shifted_us = g_test_timer_elapsed() * 1e6 / shifted_rounds;
+    g_test_minimized_result(steady_us, "tick of %u devices: %.0f us in order, %.0f us shifted",
+                            BENCH_LINES, steady_us, shifted_us);
+
+    diskstats_sampler_free(sampler);
+    unlink(path);
+    g_free(path);
+    g_free(shifted);
+    g_free(stats);
+    g_free(entries);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/diskstats/parse_fields", test_parse_fields);
+    g_test_add_func("/diskstats/parse_malformed", test_parse_malformed);
+    g_test_add_func("/diskstats/rates", test_rates);
+    g_test_add_func("/diskstats/counter_wrap", test_counter_wrap);
+    g_test_add("/diskstats/sampler", Fixture, NULL, fixture_setup, test_sampler, fixture_teardown);
+    g_test_add("/diskstats/index_mismatch", Fixture, NULL, fixture_setup, test_index_mismatch,
+               fixture_teardown);
+    g_test_add("/diskstats/thread", Fixture, NULL, fixture_setup, test_thread, fixture_teardown);
+    if (g_test_perf()) {
+        g_test_add_func("/diskstats/parse_benchmark", test_parse_benchmark);
+    }
+    return g_test_run();
+}
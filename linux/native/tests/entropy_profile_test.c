@@ -0,0 +1,210 @@
+#define _GNU_SOURCE
+#include "../entropy_profile.h"
+#include <fcntl.h>
+#include <glib.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MIB (1024ull * 1024)
+#define BLOCK (64 * 1024)
+#define FILE_SIZE (256 * MIB)
+
+typedef struct {
+    char* path;
+    int fd;
+} Fixture;
+
+static void fill_random(guint8* data, size_t size, uint64_t* state) {
+    for (size_t i = 0; i < size; i += 8) {
+        // xorshift64
+        uint64_t x = *state;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        *state = x;
+        memcpy(data + i, &x, 8);
+    }
+}
+
+// English-like text: letters, spaces and newlines only
+static void fill_text(guint8* data, size_t size) {
+    static const char words[] = "the quick brown fox jumps over the lazy dog\nsector ";
+    for (size_t i = 0; i < size; i++) data[i] = (guint8)words[(i * 7 + i / 13) % (sizeof(words) - 1)];
+}
+
+static void fixture_setup(Fixture* fixture, gconstpointer data) {
+    fixture->fd = g_file_open_tmp("entropy-XXXXXX", &fixture->path, NULL);
+    g_assert_cmpint(fixture->fd, >=, 0);
+    g_assert_cmpint(ftruncate(fixture->fd, FILE_SIZE), ==, 0);
+}
+
+static void fixture_teardown(Fixture* fixture, gconstpointer data) {
+    close(fixture->fd);
+    unlink(fixture->path);
+    g_free(fixture->path);
+}
+
+// Writes random data over every @stride-th MiB extent, leaving holes
+// (which read as zeros) in between
+static void write_extents(int fd, uint64_t from, uint64_t to, guint stride) {
+    guint8* data = g_malloc(MIB);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (uint64_t offset = from; offset < to; offset += MIB) {
+        if ((offset / MIB) % stride != 0) continue;
+        fill_random(data, MIB, &state);
+        g_assert_cmpint(pwrite(fd, data, MIB, (off_t)offset), ==, (gssize)MIB);
+    }
+    g_free(data);
+}
+
+static void profile(int fd, EntropyProfileOptions* options, EntropyProfileResult* result) {
+    GError* error = NULL;
+    g_assert_true(entropy_profile_run(fd, options, result, &error));
+    g_assert_no_error(error);
+}
+
+static double fraction(const EntropyProfileResult* result, EntropyClass cls) {
+    return (double)result->counts[cls] / result->samples;
+}
+
+static void test_classify(void) {
+    guint8* data = g_malloc(BLOCK);
+    double entropy;
+
+    memset(data, 0x00, BLOCK);
+    g_assert_cmpint(entropy_classify_block(data, BLOCK, &entropy), ==, ENTROPY_CLASS_ZERO);
+    g_assert_cmpfloat(entropy, ==, 0.0);
+    memset(data, 0xFF, BLOCK);
+    g_assert_cmpint(entropy_classify_block(data, BLOCK, NULL), ==, ENTROPY_CLASS_ONES);
+    memset(data, 0xE5, BLOCK);
+    g_assert_cmpint(entropy_classify_block(data, BLOCK, NULL), ==, ENTROPY_CLASS_CONSTANT);
+
+    // One differing byte at the very end is no longer constant
+    data[BLOCK - 1] = 0xE4;
+    g_assert_cmpint(entropy_classify_block(data, BLOCK, &entropy), ==, ENTROPY_CLASS_STRUCTURED);
+    g_assert_cmpfloat(entropy, <, 0.01);
+
+    uint64_t state = 42;
+    fill_random(data, BLOCK, &state);
+    g_assert_cmpint(entropy_classify_block(data, BLOCK, &entropy), ==, ENTROPY_CLASS_RANDOM);
+    g_assert_cmpfloat(entropy, >, 7.99);
+
+    // Smaller blocks carry more estimator bias; the threshold allows for it
+    g_assert_cmpint(entropy_classify_block(data, 4096, NULL), ==, ENTROPY_CLASS_RANDOM);
+
+    fill_text(data, BLOCK);
+    g_assert_cmpint(entropy_classify_block(data, BLOCK, &entropy), ==, ENTROPY_CLASS_STRUCTURED);
+    g_assert_cmpfloat(entropy, <, 5.0);
+
+    // Seven random bits per byte, as in base64 or ASCII-armoured data
+    fill_random(data, BLOCK, &state);
+    for (size_t i = 0; i < BLOCK; i++) data[i] &= 0x7F;
+    g_assert_cmpint(entropy_classify_block(data, BLOCK, &entropy), ==, ENTROPY_CLASS_STRUCTURED);
+    g_assert_cmpfloat_with_epsilon(entropy, 7.0, 0.01);
+    g_free(data);
+}
+
+// Every sample of a file filled with random data is random
+static void test_random_file(Fixture* fixture, gconstpointer data) {
+    write_extents(fixture->fd, 0, FILE_SIZE, 1);
+    EntropyProfileOptions options;
+    entropy_profile_default_options(&options);
+    options.margin = 0.05;
+    options.seed = 7;
+    EntropyProfileResult result;
+    profile(fixture->fd, &options, &result);
+
+    g_assert_cmpuint(result.samples, >=, 385);
+    g_assert_cmpuint(result.counts[ENTROPY_CLASS_RANDOM], ==, result.samples);
+    g_assert_cmpfloat(result.mean_entropy, >, 7.99);
+    g_assert_cmpfloat(result.margin, <=, 0.05);
+    g_assert_cmpuint(result.bytes_read, ==, (uint64_t)result.samples * BLOCK);
+    entropy_profile_result_clear(&result);
+}
+
+// A sparse file with random data in one MiB extent out of four: the
+// estimated fractions land within the achieved margin of the truth
+static void test_sparse_file(Fixture* fixture, gconstpointer data) {
+    write_extents(fixture->fd, 0, FILE_SIZE, 4);
+    static const uint64_t seeds[] = {1, 2, 3, 0xDEADBEEF};
+    for (guint s = 0; s < G_N_ELEMENTS(seeds); s++) {
+        EntropyProfileOptions options;
+        entropy_profile_default_options(&options);
+        options.margin = 0.05;
+        options.seed = seeds[s];
+        EntropyProfileResult result;
+        profile(fixture->fd, &options, &result);
+
+        g_assert_cmpuint(result.counts[ENTROPY_CLASS_RANDOM] + result.counts[ENTROPY_CLASS_ZERO], ==,
+                         result.samples);
+        g_assert_cmpfloat(fabs(fraction(&result, ENTROPY_CLASS_RANDOM) - 0.25), <=, result.margin);
+        g_assert_cmpfloat(fabs(fraction(&result, ENTROPY_CLASS_ZERO) - 0.75), <=, result.margin);
+        entropy_profile_result_clear(&result);
+    }
+}
+
+// Strata see their own part of the file: random first half, holes after
+static void test_regions(Fixture* fixture, gconstpointer data) {
+    write_extents(fixture->fd, 0, FILE_SIZE / 2, 1);
+    EntropyProfileOptions options;
+    entropy_profile_default_options(&options);
+    options.regions = 16;
+    options.samples = 160;
+    options.seed = 11;
+    EntropyProfileResult result;
+    profile(fixture->fd, &options, &result);
+
+    g_assert_cmpuint(result.region_count, ==, 16);
+    g_assert_cmpuint(result.region_size, ==, FILE_SIZE / 16);
+    g_assert_cmpuint(result.samples, ==, 160);
+    for (guint r = 0; r < result.region_count; r++) {
+        const EntropyRegion* region = &result.regions[r];
+        g_assert_cmpuint(region->samples, ==, 10);
+        EntropyClass expected = r < 8 ? ENTROPY_CLASS_RANDOM : ENTROPY_CLASS_ZERO;
+        g_assert_cmpuint(region->counts[expected], ==, region->samples);
+    }
+    g_assert_cmpfloat_with_epsilon(fraction(&result, ENTROPY_CLASS_RANDOM), 0.5, 1e-9);
+    entropy_profile_result_clear(&result);
+
+    // A sub-range is profiled on its own
+    options.offset = FILE_SIZE / 2;
+    options.length = FILE_SIZE / 4;
+    profile(fixture->fd, &options, &result);
+    g_assert_cmpuint(result.counts[ENTROPY_CLASS_ZERO], ==, result.samples);
+    entropy_profile_result_clear(&result);
+}
+
+// Asking for more samples than blocks reads each block once
+static void test_saturated(Fixture* fixture, gconstpointer data) {
+    write_extents(fixture->fd, 0, 4 * MIB, 1);
+    EntropyProfileOptions options;
+    entropy_profile_default_options(&options);
+    options.length = 4 * MIB;
+    options.samples = 10000;
+    options.seed = 5;
+    EntropyProfileResult result;
+    profile(fixture->fd, &options, &result);
+    g_assert_cmpuint(result.samples, ==, 4 * MIB / BLOCK);
+    g_assert_cmpuint(result.counts[ENTROPY_CLASS_RANDOM], ==, result.samples);
+    entropy_profile_result_clear(&result);
+
+    GError* error = NULL;
+    options.offset = 100;
+    g_assert_false(entropy_profile_run(fixture->fd, &options, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+    g_clear_error(&error);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/entropy_profile/classify", test_classify);
+    g_test_add("/entropy_profile/random_file", Fixture, NULL, fixture_setup, test_random_file,
+               fixture_teardown);
+    g_test_add("/entropy_profile/sparse_file", Fixture, NULL, fixture_setup, test_sparse_file,
+               fixture_teardown);
+    g_test_add("/entropy_profile/regions", Fixture, NULL, fixture_setup, test_regions, fixture_teardown);
+    g_test_add("/entropy_profile/saturated", Fixture, NULL, fixture_setup, test_saturated,
+               fixture_teardown);
+    return g_test_run();
+}
@@ -0,0 +1,311 @@
+#define _GNU_SOURCE
+#include "../free_space_wipe.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <linux/loop.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/statvfs.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MIB (1024ull * 1024)
+#define IMAGE_SIZE (64 * MIB)
+#define MARKER_SIZE (16 * MIB)
+#define MARKER_BLOCK 4096
+// Slow enough that the fill spans several throttle windows
+#define FILL_RATE (32 * MIB)
+
+// An ext4 file system in an image, mounted through a loop device
+typedef struct {
+    char* dir;
+    char* image;
+    char* mount_point;
+    int loop_fd;
+    gboolean mounted;
+} Fixture;
+
+static gboolean attach_loop(Fixture* fixture, char* loop_path, size_t size) {
+    int image_fd = open(fixture->image, O_RDWR | O_CLOEXEC);
+    int control = open("/dev/loop-control", O_RDWR | O_CLOEXEC);
+    gboolean attached = FALSE;
+    // Another test may take the free device first
+    for (int attempt = 0; control >= 0 && image_fd >= 0 && attempt < 8 && !attached; attempt++) {
+        int index = ioctl(control, LOOP_CTL_GET_FREE);
+        if (index < 0) break;
+        snprintf(loop_path, size, "/dev/loop%d", index);
+        int fd = open(loop_path, O_RDWR | O_CLOEXEC);
+        if (fd < 0) break;
+        if (ioctl(fd, LOOP_SET_FD, image_fd) == 0) {
+            fixture->loop_fd = fd;
+            attached = TRUE;
+        } else {
+            close(fd);
+            if (errno != EBUSY) break;
+        }
+    }
+    if (control >= 0) close(control);
+    if (image_fd >= 0) close(image_fd);
+    return attached;
+}
+
+static gboolean make_filesystem(const char* image) {
+    pid_t pid = fork();
+    if (pid < 0) return FALSE;
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        // 4 KiB blocks, as the marker scan assumes; no reserved blocks, so
+        // f_bavail covers every free block; and no lazy initialisation
+        // writing behind the test's back
+        execlp("mkfs.ext4", "mkfs.ext4", "-q", "-F", "-b", "4096", "-m", "0",
+               "-E", "lazy_itable_init=0,lazy_journal_init=0", image, (char*)NULL);
+        _exit(127);
+    }
+    int status = 0;
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void fixture_setup(Fixture* fixture, gconstpointer data) {
+    memset(fixture, 0, sizeof(*fixture));
+    fixture->loop_fd = -1;
+    fixture->dir = g_dir_make_tmp("free-space-XXXXXX", NULL);
+    g_assert_nonnull(fixture->dir);
+    fixture->image = g_build_filename(fixture->dir, "fs.img", NULL);
+    fixture->mount_point = g_build_filename(fixture->dir, "mnt", NULL);
+    g_assert_cmpint(g_mkdir_with_parents(fixture->mount_point, 0755), ==, 0);
+
+    int fd = open(fixture->image, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    g_assert_cmpint(fd, >=, 0);
+    g_assert_cmpint(ftruncate(fd, IMAGE_SIZE), ==, 0);
+    close(fd);
+
+    char loop_path[32];
+    if (!make_filesystem(fixture->image) || !attach_loop(fixture, loop_path, sizeof(loop_path))) return;
+    fixture->mounted = mount(loop_path, fixture->mount_point, "ext4", 0, NULL) == 0;
+}
+
+static void fixture_teardown(Fixture* fixture, gconstpointer data) {
+    if (fixture->mounted) umount(fixture->mount_point);
+    if (fixture->loop_fd >= 0) {
+        ioctl(fixture->loop_fd, LOOP_CLR_FD, 0);
+        close(fixture->loop_fd);
+    }
+    rmdir(fixture->mount_point);
+    unlink(fixture->image);
+    rmdir(fixture->dir);
+    g_free(fixture->mount_point);
+    g_free(fixture->image);
+    g_free(fixture->dir);
+}
+
+static gboolean have_filesystem(Fixture* fixture) {
+    if (fixture->mounted) return TRUE;
+    g_test_skip("cannot mount an ext4 image (needs root, loop devices and mkfs.ext4)");
+    return FALSE;
+}
+
+static uint64_t available(Fixture* fixture) {
+    struct statvfs st;
+    g_assert_cmpint(statvfs(fixture->mount_point, &st), ==, 0);
+    return (uint64_t)st.f_bavail * st.f_frsize;
+}
+
+static void sync_filesystem(Fixture* fixture) {
+    int fd = open(fixture->mount_point, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    g_assert_cmpint(fd, >=, 0);
+    g_assert_cmpint(syncfs(fd), ==, 0);
+    close(fd);
+}
+
+static void marker_block(guint8* block) {
+    static const char text[] = "FREE-SPACE-MARKER";
+    for (size_t i = 0; i < MARKER_BLOCK; i++) block[i] = (guint8)text[i % (sizeof(text) - 1)];
+}
+
+// Leaves the contents of a deleted file in the free space
+static void write_deleted_file(Fixture* fixture) {
+    char* path = g_build_filename(fixture->mount_point, "secret", NULL);
+    int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+    g_assert_cmpint(fd, >=, 0);
+    guint8 block[MARKER_BLOCK];
+    marker_block(block);
+    for (uint64_t offset = 0; offset < MARKER_SIZE; offset += MARKER_BLOCK) {
+        g_assert_cmpint(pwrite(fd, block, MARKER_BLOCK, (off_t)offset), ==, MARKER_BLOCK);
+    }
+    g_assert_cmpint(fsync(fd), ==, 0);
+    close(fd);
+    g_assert_cmpint(unlink(path), ==, 0);
+    g_free(path);
+    sync_filesystem(fixture);
+}
+
+// Marker blocks still present anywhere in the image
+static guint marker_blocks(Fixture* fixture) {
+    sync_filesystem(fixture);
+    guint8 expected[MARKER_BLOCK];
+    marker_block(expected);
+    int fd = open(fixture->image, O_RDONLY | O_CLOEXEC);
+    g_assert_cmpint(fd, >=, 0);
+    guint8* data = g_malloc(MIB);
+    guint count = 0;
+    for (uint64_t offset = 0; offset < IMAGE_SIZE; offset += MIB) {
+        g_assert_cmpint(pread(fd, data, MIB, (off_t)offset), ==, (gssize)MIB);
+        for (size_t i = 0; i < MIB; i += MARKER_BLOCK) {
+            if (memcmp(data + i, expected, MARKER_BLOCK) == 0) count++;
+        }
+    }
+    g_free(data);
+    close(fd);
+    return count;
+}
+
+static void fill_options(FreeSpaceWipeOptions* options) {
+    free_space_wipe_default_options(options);
+    options->min_free_bytes = 2 * MIB;
+    options->file_size = 4 * MIB;
+    options->trim = 0;
+}
+
+// Everything above the margin is overwritten, the space comes back once
+// the run ends, and the deleted file's blocks are gone
+static void test_fill(Fixture* fixture, gconstpointer data) {
+    if (!have_filesystem(fixture)) return;
+    write_deleted_file(fixture);
+    guint before = marker_blocks(fixture);
+    g_assert_cmpuint(before, >=, MARKER_SIZE / MARKER_BLOCK * 9 / 10);
+    uint64_t free_before = available(fixture);
+
+    FreeSpaceWipeOptions options;
+    fill_options(&options);
+    options.pattern = BULK_PATTERN_ZEROS;
+    options.trim = 1;
+    FreeSpaceWipeResult result;
+    GError* error = NULL;
+    g_assert_true(free_space_wipe_run(fixture->mount_point, &options, &result, &error));
+    g_assert_no_error(error);
+
+    g_assert_cmpint(result.stop_reason, ==, FREE_SPACE_STOP_FILLED);
+    g_assert_cmpuint(result.available_before, ==, free_before);
+    g_assert_cmpuint(result.bytes_written, <=, free_before - options.min_free_bytes);
+    g_assert_cmpuint(result.bytes_written, >=, free_before - options.min_free_bytes - 2 * MIB);
+    g_assert_cmpuint(result.files, >, 1);
+    g_assert_true(result.unnamed_files);
+    g_assert_true(result.trimmed);
+    g_assert_cmpuint(available(fixture), >=, free_before - MIB);
+
+    // Only what fits in the margin and the last partial granule survives
+    guint after = marker_blocks(fixture);
+    g_assert_cmpuint(after, <=, (options.min_free_bytes + 2 * MIB) / MARKER_BLOCK);
+    g_test_message("marker blocks: %u before, %u after", before, after);
+}
+
+// Another writer claiming space mid-fill: the fill backs off newest file
+// first until the margin holds again
+typedef struct {
+    Fixture* fixture;
+    uint64_t budget;
+    int hog_fd;
+    guint reports;
+} MarginState;
+
+static void on_margin_progress(const BulkProgress* progress, void* user_data) {
+    MarginState* state = user_data;
+    state->reports++;
+    if (state->hog_fd >= 0 || progress->bytes_done < state->budget / 2) return;
+
+    char* path = g_build_filename(state->fixture->mount_point, "hog", NULL);
+    state->hog_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    g_assert_cmpint(state->hog_fd, >=, 0);
+    uint64_t free_now = available(state->fixture);
+    g_assert_cmpint(fallocate(state->hog_fd, 0, 0, (off_t)(free_now - 256 * 1024)), ==, 0);
+    g_free(path);
+}
+
+static void test_margin(Fixture* fixture, gconstpointer data) {
+    if (!have_filesystem(fixture)) return;
+    FreeSpaceWipeOptions options;
+    fill_options(&options);
+    options.max_rate_bps = FILL_RATE;
+    MarginState state = {
+        .fixture = fixture,
+        .budget = available(fixture) - options.min_free_bytes,
+        .hog_fd = -1,
+    };
+    options.progress = on_margin_progress;
+    options.user_data = &state;
+
+    FreeSpaceWipeResult result;
+    GError* error = NULL;
+    g_assert_true(free_space_wipe_run(fixture->mount_point, &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_cmpint(state.hog_fd, >=, 0);
+    g_assert_cmpint(result.stop_reason, ==, FREE_SPACE_STOP_MARGIN);
+    g_assert_cmpuint(result.bytes_written, <, state.budget);
+    // With the other writer's file still there, the margin holds
+    g_assert_cmpuint(available(fixture), >=, options.min_free_bytes);
+    close(state.hog_fd);
+}
+
+typedef struct {
+    gint cancel;
+    guint reports;
+    uint64_t last_done;
+} CancelState;
+
+static void on_cancel_progress(const BulkProgress* progress, void* user_data) {
+    CancelState* state = user_data;
+    g_assert_cmpuint(progress->bytes_done, >=, state->last_done);
+    state->last_done = progress->bytes_done;
+    if (++state->reports == 1) __atomic_store_n(&state->cancel, 1, __ATOMIC_RELAXED);
+}
+
+// Cancelling stops within a throttle window, releases every fill file and
+// skips the trim
+static void test_cancel(Fixture* fixture, gconstpointer data) {
+    if (!have_filesystem(fixture)) return;
+    uint64_t free_before = available(fixture);
+    FreeSpaceWipeOptions options;
+    fill_options(&options);
+    options.max_rate_bps = FILL_RATE;
+    options.trim = 1;
+    CancelState state = {0};
+    options.progress = on_cancel_progress;
+    options.user_data = &state;
+    options.cancel = &state.cancel;
+
+    FreeSpaceWipeResult result;
+    GError* error = NULL;
+    g_assert_false(free_space_wipe_run(fixture->mount_point, &options, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+    g_clear_error(&error);
+    g_assert_cmpint(result.stop_reason, ==, FREE_SPACE_STOP_CANCELLED);
+    g_assert_false(result.trimmed);
+    g_assert_cmpuint(result.bytes_written, >, 0);
+    g_assert_cmpuint(result.bytes_written, <, free_before - options.min_free_bytes);
+    g_assert_cmpuint(available(fixture), >=, free_before - MIB);
+}
+
+static void test_missing(void) {
+    FreeSpaceWipeOptions options;
+    free_space_wipe_default_options(&options);
+    FreeSpaceWipeResult result;
+    GError* error = NULL;
+    g_assert_false(free_space_wipe_run("/nonexistent/mount", &options, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+    g_clear_error(&error);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add("/free_space_wipe/fill", Fixture, NULL, fixture_setup, test_fill, fixture_teardown);
+    g_test_add("/free_space_wipe/margin", Fixture, NULL, fixture_setup, test_margin, fixture_teardown);
+    g_test_add("/free_space_wipe/cancel", Fixture, NULL, fixture_setup, test_cancel, fixture_teardown);
+    g_test_add_func("/free_space_wipe/missing", test_missing);
+    return g_test_run();
+}
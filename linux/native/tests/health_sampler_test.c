@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+#include "../health_sampler.h"
+#include <glib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NVME_PATH "/dev/nvme0n1"
+#define ATA_PATH "/dev/sda"
+#define NVME_FD 100
+#define ATA_FD 101
+
+// Canned devices behind a HealthIoctlBackend: one NVMe namespace and one
+// SATA disk, counting every call the sampler makes
+typedef struct {
+    uint8_t nvme_log[HEALTH_NVME_LOG_SIZE];
+    uint8_t ata_smart[512];
+    gboolean nvme_fails;
+    guint opens;
+    guint closes;
+    guint admin_commands;
+    guint drive_commands;
+    guint batches;
+} FakeDevices;
+
+static void put_le16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_le64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+// SMART / Health Information page of a drive at 45 C
+static void canned_nvme_log(uint8_t* log) {
+    memset(log, 0, HEALTH_NVME_LOG_SIZE);
+    log[0] = 0x04;                    // reliability degraded
+    put_le16(log + 1, 318);
+    log[3] = 97;
+    log[5] = 3;
+    put_le64(log + 48, 123456);
+    put_le64(log + 128, 8760);
+    put_le64(log + 144, 12);
+    put_le64(log + 160, 2);
+    put_le64(log + 176, 5);
+}
+
+static void put_attribute(uint8_t* data, int index, uint8_t id, uint64_t raw) {
+    uint8_t* attr = data + 2 + index * 12;
+    attr[0] = id;
+    attr[3] = 100;                    // normalized value, ignored
+    for (int i = 0; i < 6; i++) attr[5 + i] = (uint8_t)(raw >> (8 * i));
+}
+
+// SMART READ DATA of a disk with a few remapped and pending sectors
+static void canned_ata_smart(uint8_t* data) {
+    memset(data, 0, 512);
+    put_attribute(data, 0, 1, 0);
+    put_attribute(data, 1, 5, 8);
+    // Power-on hours with a minutes count in the upper bytes
+    put_attribute(data, 2, 9, 0x002A00002238ull);
+    put_attribute(data, 3, 192, 31);
+    // Current 35 C with the lifetime min 20 and max 52 above it
+    put_attribute(data, 4, 194, 0x003400140023ull);
+    put_attribute(data, 5, 197, 3);
+    put_attribute(data, 6, 198, 1);
+}
+
+static int fake_open_device(const char* path, void* ctx) {
+    FakeDevices* fake = ctx;
+    fake->opens++;
+    if (strcmp(path, NVME_PATH) == 0) return NVME_FD;
+    if (strcmp(path, ATA_PATH) == 0) return ATA_FD;
+    return -1;
+}
+
+static int fake_nvme_admin(int fd, struct nvme_admin_cmd* cmd, void* ctx) {
+    FakeDevices* fake = ctx;
+    g_assert_cmpint(fd, ==, NVME_FD);
+    g_assert_cmpuint(cmd->opcode, ==, 0x02);
+    g_assert_cmpuint(cmd->cdw10 & 0xFF, ==, 0x02);
+    g_assert_cmpuint(cmd->data_len, ==, HEALTH_NVME_LOG_SIZE);
+    fake->admin_commands++;
+    if (fake->nvme_fails) return -1;
+    memcpy((void*)(uintptr_t)cmd->addr, fake->nvme_log, HEALTH_NVME_LOG_SIZE);
+    return 0;
+}
+
+static int fake_ata_drive_cmd(int fd, uint8_t* args, void* ctx) {
+    FakeDevices* fake = ctx;
+    g_assert_cmpint(fd, ==, ATA_FD);
+    g_assert_cmpuint(args[0], ==, 0xB0);
+    g_assert_cmpuint(args[2], ==, 0xD0);
+    fake->drive_commands++;
+    memcpy(args + 4, fake->ata_smart, 512);
+    return 0;
+}
+
+static void fake_close_device(int fd, void* ctx) {
+    FakeDevices* fake = ctx;
+    fake->closes++;
+}
+
+static HealthSampler* fake_sampler(FakeDevices* fake, guint interval_ms, guint history_length) {
+    memset(fake, 0, sizeof(*fake));
+    canned_nvme_log(fake->nvme_log);
+    canned_ata_smart(fake->ata_smart);
+    HealthIoctlBackend backend = {
+        .open_device = fake_open_device,
+        .nvme_admin = fake_nvme_admin,
+        .ata_drive_cmd = fake_ata_drive_cmd,
+        .close_device = fake_close_device,
+        .ctx = fake,
+    };
+    HealthSampler* sampler = health_sampler_new(&backend, interval_ms, history_length);
+    g_assert_true(health_sampler_add_device(sampler, NVME_PATH, HEALTH_DEVICE_NVME));
+    g_assert_true(health_sampler_add_device(sampler, ATA_PATH, HEALTH_DEVICE_ATA));
+    return sampler;
+}
+
+static void test_parse_nvme(void) {
+    uint8_t log[HEALTH_NVME_LOG_SIZE];
+    canned_nvme_log(log);
+    HealthSample sample = { 0 };
+    health_parse_nvme_log(log, &sample);
+    g_assert_cmpuint(sample.critical_warning, ==, 0x04);
+    g_assert_cmpint(sample.temperature_celsius, ==, 45);
+    g_assert_cmpuint(sample.available_spare, ==, 97);
+    g_assert_cmpuint(sample.percentage_used, ==, 3);
+    g_assert_cmpuint(sample.data_units_written, ==, 123456);
+    g_assert_cmpuint(sample.power_on_hours, ==, 8760);
+    g_assert_cmpuint(sample.unsafe_shutdowns, ==, 12);
+    g_assert_cmpuint(sample.media_errors, ==, 2);
+    g_assert_cmpuint(sample.error_log_entries, ==, 5);
+
+    // A drive without a composite temperature reports 0 Kelvin
+    put_le16(log + 1, 0);
+    health_parse_nvme_log(log, &sample);
+    g_assert_cmpint(sample.temperature_celsius, ==, HEALTH_TEMPERATURE_UNKNOWN);
+}
+
+static void test_parse_ata(void) {
+    uint8_t data[512];
+    canned_ata_smart(data);
+    HealthSample sample = { 0 };
+    health_parse_ata_smart(data, &sample);
+    g_assert_cmpuint(sample.reallocated_sectors, ==, 8);
+    g_assert_cmpuint(sample.power_on_hours, ==, 0x2238);
+    g_assert_cmpuint(sample.unsafe_shutdowns, ==, 31);
+    g_assert_cmpint(sample.temperature_celsius, ==, 35);
+    g_assert_cmpuint(sample.pending_sectors, ==, 3);
+    g_assert_cmpuint(sample.uncorrectable_sectors, ==, 1);
+
+    // Without attribute 194 the airflow temperature is used
+    memset(data, 0, sizeof(data));
+    put_attribute(data, 0, 190, 0x1F001B1C);
+    memset(&sample, 0, sizeof(sample));
+    health_parse_ata_smart(data, &sample);
+    g_assert_cmpint(sample.temperature_celsius, ==, 0x1C);
+
+    memset(data, 0, sizeof(data));
+    health_parse_ata_smart(data, &sample);
+    g_assert_cmpint(sample.temperature_celsius, ==, HEALTH_TEMPERATURE_UNKNOWN);
+}
+
+// Handles stay open between batches, so every tick costs one command per
+// device, and the history ring keeps the newest samples
+static void test_batches(void) {
+    FakeDevices fake;
+    HealthSampler* sampler = fake_sampler(&fake, 1000, 2);
+    for (int i = 0; i < 5; i++) {
+        health_sampler_sample_all(sampler);
+    }
+    g_assert_cmpuint(fake.opens, ==, 2);
+    g_assert_cmpuint(fake.closes, ==, 0);
+    g_assert_cmpuint(fake.admin_commands, ==, 5);
+    g_assert_cmpuint(fake.drive_commands, ==, 5);
+
+    HealthSample sample;
+    g_assert_true(health_sampler_get_sample(sampler, NVME_PATH, &sample));
+    g_assert_cmpint(sample.temperature_celsius, ==, 45);
+    g_assert_cmpuint(sample.data_units_written, ==, 123456);
+    g_assert_true(health_sampler_get_sample(sampler, ATA_PATH, &sample));
+    g_assert_cmpint(sample.temperature_celsius, ==, 35);
+    g_assert_cmpuint(sample.pending_sectors, ==, 3);
+
+    FlValue* history = health_sampler_get_history(sampler, NVME_PATH);
+    g_assert_cmpuint(fl_value_get_length(history), ==, 2);
+    fl_value_unref(history);
+    g_assert_null(health_sampler_get_history(sampler, "/dev/sdz"));
+    FlValue* latest = health_sampler_latest(sampler);
+    g_assert_cmpuint(fl_value_get_length(latest), ==, 2);
+    fl_value_unref(latest);
+
+    health_sampler_free(sampler);
+    g_assert_cmpuint(fake.closes, ==, 2);
+}
+
+// A failing command closes the handle and the next batch reopens it; the
+// last good sample is kept meanwhile
+static void test_failure_reopens(void) {
+    FakeDevices fake;
+    HealthSampler* sampler = fake_sampler(&fake, 1000, 4);
+    health_sampler_sample_all(sampler);
+
+    fake.nvme_fails = TRUE;
+    health_sampler_sample_all(sampler);
+    g_assert_cmpuint(fake.closes, ==, 1);
+    FlValue* history = health_sampler_get_history(sampler, NVME_PATH);
+    g_assert_cmpuint(fl_value_get_length(history), ==, 1);
+    fl_value_unref(history);
+    HealthSample sample;
+    g_assert_true(health_sampler_get_sample(sampler, NVME_PATH, &sample));
+    g_assert_cmpint(sample.temperature_celsius, ==, 45);
+
+    fake.nvme_fails = FALSE;
+    health_sampler_sample_all(sampler);
+    g_assert_cmpuint(fake.opens, ==, 3);
+    history = health_sampler_get_history(sampler, NVME_PATH);
+    g_assert_cmpuint(fl_value_get_length(history), ==, 2);
+    fl_value_unref(history);
+
+    // Removing a device closes its handle and ends its commands
+    health_sampler_remove_device(sampler, ATA_PATH);
+    g_assert_cmpuint(fake.closes, ==, 2);
+    health_sampler_sample_all(sampler);
+    g_assert_cmpuint(fake.drive_commands, ==, 3);
+    g_assert_false(health_sampler_get_sample(sampler, ATA_PATH, &sample));
+
+    health_sampler_free(sampler);
+}
+
+static void on_batch(HealthSampler* sampler, void* user_data) {
+    FakeDevices* fake = user_data;
+    __atomic_add_fetch(&fake->batches, 1, __ATOMIC_RELAXED);
+}
+
+static void test_thread(void) {
+    FakeDevices fake;
+    HealthSampler* sampler = fake_sampler(&fake, 5, 8);
+    g_assert_true(health_sampler_start(sampler, on_batch, &fake));
+    while (__atomic_load_n(&fake.batches, __ATOMIC_RELAXED) < 3) {
+        usleep(1000);
+    }
+    health_sampler_stop(sampler);
+    guint batches = fake.batches;
+    g_assert_cmpuint(fake.admin_commands, ==, batches);
+    g_assert_cmpuint(fake.opens, ==, 2);
+    usleep(20000);
+    g_assert_cmpuint(fake.batches, ==, batches);
+    health_sampler_free(sampler);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/health_sampler/parse_nvme", test_parse_nvme);
+    g_test_add_func("/health_sampler/parse_ata", test_parse_ata);
+    g_test_add_func("/health_sampler/batches", test_batches);
+    g_test_add_func("/health_sampler/failure_reopens", test_failure_reopens);
+    g_test_add_func("/health_sampler/thread", test_thread);
+    return g_test_run();
+}
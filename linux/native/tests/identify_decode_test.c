@@ -0,0 +1,359 @@
+#define _GNU_SOURCE
+#include "../identify_decode.h"
+#include <glib.h>
+#include <string.h>
+
+// Golden identify data, written byte by byte at the offsets the NVMe and
+// ATA specifications give rather than through identify_write(), so a wrong
+// descriptor cannot hide behind an encoder with the same mistake. The values
+// follow what a 1 TB NVMe drive and a 4 TB SATA disk report.
+typedef struct {
+    uint16_t offset;
+    uint16_t length;
+    const char* bytes;
+} GoldenPatch;
+
+static const GoldenPatch golden_controller[] = {
+    { 0, 4, "\x4d\x14\x4d\x14" },                               // vid, ssvid 144Dh
+    { 4, 20, "S4EWNX0R612345Z     " },
+    { 24, 40, "Samsung SSD 970 EVO Plus 1TB            " },
+    { 64, 8, "2B2QEXM7" },
+    { 73, 3, "\x38\x25\x00" },                                   // ieee 002538h
+    { 77, 1, "\x09" },                                           // mdts
+    { 78, 2, "\x04\x00" },                                       // cntlid
+    { 80, 4, "\x00\x03\x01\x00" },                               // ver 1.3
+    { 256, 2, "\x17\x00" },                                      // oacs
+    { 263, 1, "\x04" },                                          // npss: five states
+    { 280, 16, "\x00\x60\xdb\xe0\xe8\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00" },
+    { 516, 4, "\x01\x00\x00\x00" },                              // nn
+    { 768, 50, "nqn.2014.08.org.nvmexpress:144d144dS4EWNX0R612345Z" },
+    { 2048, 2, "\x92\x09" },                                     // psd0 mp 24.50 W
+    { 2048 + 4 * 32, 2, "\x08\x00" },                            // psd4 mp
+    { 2048 + 4 * 32 + 3, 1, "\x03" },                            // psd4 mxps, nops
+    { 2048 + 4 * 32 + 4, 4, "\xd0\x07\x00\x00" },                // psd4 enlat 2000
+    { 2048 + 4 * 32 + 8, 4, "\x10\x27\x00\x00" },                // psd4 exlat 10000
+};
+
+static const GoldenPatch golden_namespace[] = {
+    { 0, 8, "\xb0\x6d\x70\x74\x00\x00\x00\x00" },                // nsze 1953525168
+    { 8, 8, "\xb0\x6d\x70\x74\x00\x00\x00\x00" },                // ncap
+    { 16, 8, "\x00\x00\x34\x12\x00\x00\x00\x00" },               // nuse
+    { 24, 1, "\x10" },                                           // nsfeat optperf
+    { 25, 1, "\x01" },                                           // nlbaf: two formats
+    { 26, 1, "\x11" },                                           // flbas index 1, extended
+    { 48, 16, "\x00\x00\x00\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00" },
+    { 104, 16, "\x00\x25\x38\x5a\x91\xb0\x12\x34\x00\x25\x38\x5a\x91\xb0\x12\x35" },
+    { 120, 8, "\x00\x25\x38\x5a\x91\xb0\x12\x34" },
+    { 128, 4, "\x00\x00\x09\x02" },                              // lbaf0: 512, rp 2
+    { 132, 4, "\x08\x00\x0c\x00" },                              // lbaf1: 4096 + 8 metadata
+};
+
+static const GoldenPatch golden_ata[] = {
+    { ATA_WORD(0), 2, "\x5a\x04" },                              // general config 045Ah
+    // Strings with the two bytes of each word swapped
+    { ATA_WORD(10), 20, "DWW-CCN4214365 7    " },             // WD-WCC4N1234567
+    { ATA_WORD(23), 8, "280.A028" },                             // 82.00A82
+    { ATA_WORD(27), 40, "DW CDW04FEXR6-N8230N                    " },  // WDC WD40EFRX-68N32N0
+    { ATA_WORD(60), 4, "\xff\xff\xff\x0f" },                     // lba28 sectors
+    { ATA_WORD(83), 2, "\x00\x74" },                             // bit 10: 48-bit LBA
+    { ATA_WORD(84), 2, "\x63\x61" },                             // bit 8: WWN
+    { ATA_WORD(100), 8, "\xb0\xbe\xc0\xd1\x01\x00\x00\x00" },    // lba48 7814037168
+    { ATA_WORD(106), 2, "\x03\x60" },                            // 8 logical per physical
+    { ATA_WORD(108), 8, "\x01\x50\xe2\x4e\xc3\xb5\xe5\xd4" },    // WWN 50014EE2B5C3D4E5
+    { ATA_WORD(169), 2, "\x01\x00" },                            // trim
+    { ATA_WORD(217), 2, "\x18\x15" },                            // 5400 rpm
+};
+
+static void apply(uint8_t* data, const GoldenPatch* patches, guint count) {
+    for (guint i = 0; i < count; i++) {
+        memcpy(data + patches[i].offset, patches[i].bytes, patches[i].length);
+    }
+}
+
+static void golden_controller_data(uint8_t* data) {
+    memset(data, 0, IDENTIFY_NVME_SIZE);
+    apply(data, golden_controller, G_N_ELEMENTS(golden_controller));
+}
+
+static void golden_namespace_data(uint8_t* data) {
+    memset(data, 0, IDENTIFY_NVME_SIZE);
+    apply(data, golden_namespace, G_N_ELEMENTS(golden_namespace));
+}
+
+// Word 255: A5h signature and a checksum byte that makes all 512 sum to zero
+static void golden_ata_data(uint8_t* data) {
+    memset(data, 0, IDENTIFY_ATA_SIZE);
+    apply(data, golden_ata, G_N_ELEMENTS(golden_ata));
+    data[510] = 0xA5;
+    uint8_t sum = 0;
+    for (guint i = 0; i < 511; i++) sum += data[i];
+    data[511] = (uint8_t)-sum;
+}
+
+static uint64_t read_field(const IdentifyTable* table, guint id, const uint8_t* data) {
+    return identify_read(&table->fields[id], data);
+}
+
+static const char* read_text(const IdentifyTable* table, guint id, const uint8_t* data,
+                             char* buffer) {
+    identify_read_text(&table->fields[id], data, buffer, IDENTIFY_TEXT_MAX);
+    return buffer;
+}
+
+static void test_controller(void) {
+    const IdentifyTable* table = &identify_nvme_controller_table;
+    uint8_t data[IDENTIFY_NVME_SIZE];
+    golden_controller_data(data);
+    char text[IDENTIFY_TEXT_MAX];
+
+    g_assert_cmpuint(read_field(table, ID_CTRL_VID, data), ==, 0x144D);
+    g_assert_cmpuint(read_field(table, ID_CTRL_SSVID, data), ==, 0x144D);
+    g_assert_cmpstr(read_text(table, ID_CTRL_SN, data, text), ==, "S4EWNX0R612345Z");
+    g_assert_cmpstr(read_text(table, ID_CTRL_MN, data, text), ==, "Samsung SSD 970 EVO Plus 1TB");
+    g_assert_cmpstr(read_text(table, ID_CTRL_FR, data, text), ==, "2B2QEXM7");
+    g_assert_cmpuint(read_field(table, ID_CTRL_IEEE, data), ==, 0x002538);
+    g_assert_cmpuint(read_field(table, ID_CTRL_MDTS, data), ==, 9);
+    g_assert_cmpuint(read_field(table, ID_CTRL_CNTLID, data), ==, 4);
+    g_assert_cmpuint(read_field(table, ID_CTRL_VER, data), ==, 0x00010300);
+    g_assert_cmpuint(read_field(table, ID_CTRL_OACS, data), ==, 0x17);
+    g_assert_cmpuint(read_field(table, ID_CTRL_NPSS, data), ==, 4);
+    g_assert_cmpuint(read_field(table, ID_CTRL_TNVMCAP, data), ==, 1000204886016ull);
+    g_assert_cmpuint(read_field(table, ID_CTRL_NN, data), ==, 1);
+    g_assert_cmpstr(read_text(table, ID_CTRL_SUBNQN, data, text), ==,
+                    "nqn.2014.08.org.nvmexpress:144d144dS4EWNX0R612345Z");
+
+    const IdentifyTable* psd = &identify_nvme_power_state_table;
+    const uint8_t* psd0 = data + IDENTIFY_PSD_OFFSET;
+    const uint8_t* psd4 = psd0 + 4 * psd->size;
+    g_assert_cmpuint(read_field(psd, ID_PSD_MP, psd0), ==, 2450);
+    g_assert_cmpuint(read_field(psd, ID_PSD_MXPS, psd0), ==, 0);
+    g_assert_cmpuint(read_field(psd, ID_PSD_MP, psd4), ==, 8);
+    g_assert_cmpuint(read_field(psd, ID_PSD_MXPS, psd4), ==, 1);
+    g_assert_cmpuint(read_field(psd, ID_PSD_NOPS, psd4), ==, 1);
+    g_assert_cmpuint(read_field(psd, ID_PSD_ENLAT, psd4), ==, 2000);
+    g_assert_cmpuint(read_field(psd, ID_PSD_EXLAT, psd4), ==, 10000);
+}
+
+static void test_namespace(void) {
+    const IdentifyTable* table = &identify_nvme_namespace_table;
+    uint8_t data[IDENTIFY_NVME_SIZE];
+    golden_namespace_data(data);
+    char text[IDENTIFY_TEXT_MAX];
+
+    g_assert_cmpuint(read_field(table, ID_NS_NSZE, data), ==, 1953525168);
+    g_assert_cmpuint(read_field(table, ID_NS_NCAP, data), ==, 1953525168);
+    g_assert_cmpuint(read_field(table, ID_NS_NUSE, data), ==, 0x12340000);
+    g_assert_cmpuint(read_field(table, ID_NS_NSFEAT_THIN, data), ==, 0);
+    g_assert_cmpuint(read_field(table, ID_NS_NSFEAT_OPTPERF, data), ==, 1);
+    g_assert_cmpuint(read_field(table, ID_NS_NLBAF, data), ==, 1);
+    g_assert_cmpuint(read_field(table, ID_NS_FLBAS_INDEX_LO, data), ==, 1);
+    g_assert_cmpuint(read_field(table, ID_NS_FLBAS_EXTENDED, data), ==, 1);
+    g_assert_cmpuint(read_field(table, ID_NS_FLBAS_INDEX_HI, data), ==, 0);
+    g_assert_cmpstr(read_text(table, ID_NS_NGUID, data, text), ==, "0025385a91b012340025385a91b01235");
+    g_assert_cmpstr(read_text(table, ID_NS_EUI64, data, text), ==, "0025385a91b01234");
+
+    const IdentifyTable* lbaf = &identify_nvme_lba_format_table;
+    const uint8_t* lbaf0 = data + IDENTIFY_LBAF_OFFSET;
+    const uint8_t* lbaf1 = lbaf0 + lbaf->size;
+    g_assert_cmpuint(read_field(lbaf, ID_LBAF_MS, lbaf0), ==, 0);
+    g_assert_cmpuint(read_field(lbaf, ID_LBAF_LBADS, lbaf0), ==, 9);
+    g_assert_cmpuint(read_field(lbaf, ID_LBAF_RP, lbaf0), ==, 2);
+    g_assert_cmpuint(read_field(lbaf, ID_LBAF_MS, lbaf1), ==, 8);
+    g_assert_cmpuint(read_field(lbaf, ID_LBAF_LBADS, lbaf1), ==, 12);
+    g_assert_cmpuint(read_field(lbaf, ID_LBAF_RP, lbaf1), ==, 0);
+}
+
+typedef struct {
+    guint fields;
+    guint arrays;
+    guint elements;
+    guint array_count;
+    uint64_t nvmcap_low;
+    uint64_t nvmcap_high;
+} CountingVisitor;
+
+static void count_field(const IdentifyValue* value, void* ctx) {
+    CountingVisitor* counts = ctx;
+    counts->fields++;
+    if (strcmp(value->field->name, "nvmcap") == 0) {
+        counts->nvmcap_low = value->value;
+        counts->nvmcap_high = value->high;
+    }
+}
+
+static void count_array(const IdentifyArray* array, guint count, void* ctx) {
+    CountingVisitor* counts = ctx;
+    counts->arrays++;
+    counts->array_count = count;
+}
+
+static void count_element(guint index, void* ctx) {
+    ((CountingVisitor*)ctx)->elements++;
+}
+
+static const IdentifyVisitor counting_visitor = {
+    .field = count_field,
+    .array_begin = count_array,
+    .element_begin = count_element,
+};
+
+// Arrays are sized by their zero-based count byte, 128-bit values arrive in
+// two halves, and short buffers are refused
+static void test_decode_walk(void) {
+    uint8_t controller[IDENTIFY_NVME_SIZE];
+    golden_controller_data(controller);
+    CountingVisitor counts = { 0 };
+    g_assert_true(identify_decode(&identify_nvme_controller_table, controller,
+                                  sizeof(controller), &counting_visitor, &counts));
+    g_assert_cmpuint(counts.arrays, ==, 1);
+    g_assert_cmpuint(counts.array_count, ==, 5);
+    g_assert_cmpuint(counts.elements, ==, 5);
+    g_assert_cmpuint(counts.fields, ==, ID_CTRL_FIELD_COUNT + 5 * ID_PSD_FIELD_COUNT);
+
+    uint8_t ns[IDENTIFY_NVME_SIZE];
+    golden_namespace_data(ns);
+    memset(&counts, 0, sizeof(counts));
+    g_assert_true(identify_decode(&identify_nvme_namespace_table, ns, sizeof(ns),
+                                  &counting_visitor, &counts));
+    g_assert_cmpuint(counts.array_count, ==, 2);
+    g_assert_cmpuint(counts.fields, ==, ID_NS_FIELD_COUNT + 2 * ID_LBAF_FIELD_COUNT);
+    g_assert_cmpuint(counts.nvmcap_low, ==, 0);
+    g_assert_cmpuint(counts.nvmcap_high, ==, 1);
+
+    // A count byte beyond the structure is clamped to its maximum
+    ns[25] = 0xFF;
+    memset(&counts, 0, sizeof(counts));
+    g_assert_true(identify_decode(&identify_nvme_namespace_table, ns, sizeof(ns),
+                                  &counting_visitor, &counts));
+    g_assert_cmpuint(counts.array_count, ==, IDENTIFY_LBAF_MAX);
+
+    g_assert_false(identify_decode(&identify_nvme_controller_table, controller,
+                                   IDENTIFY_NVME_SIZE - 1, &counting_visitor, &counts));
+    g_assert_false(identify_decode(&identify_ata_table, NULL, IDENTIFY_ATA_SIZE,
+                                   &counting_visitor, &counts));
+}
+
+static void test_ata(void) {
+    const IdentifyTable* table = &identify_ata_table;
+    uint8_t data[IDENTIFY_ATA_SIZE];
+    golden_ata_data(data);
+    char text[IDENTIFY_TEXT_MAX];
+
+    g_assert_cmpuint(read_field(table, ID_ATA_GENERAL_CONFIG, data), ==, 0x045A);
+    g_assert_cmpuint(read_field(table, ID_ATA_NOT_ATA_DEVICE, data), ==, 0);
+    g_assert_cmpstr(read_text(table, ID_ATA_SERIAL, data, text), ==, "WD-WCC4N1234567");
+    g_assert_cmpstr(read_text(table, ID_ATA_FIRMWARE, data, text), ==, "82.00A82");
+    g_assert_cmpstr(read_text(table, ID_ATA_MODEL, data, text), ==, "WDC WD40EFRX-68N32N0");
+    g_assert_cmpuint(read_field(table, ID_ATA_LBA28_SECTORS, data), ==, 0x0FFFFFFF);
+    g_assert_cmpuint(read_field(table, ID_ATA_LBA48, data), ==, 1);
+    g_assert_cmpuint(read_field(table, ID_ATA_WWN_SUPPORTED, data), ==, 1);
+    g_assert_cmpuint(read_field(table, ID_ATA_LBA48_SECTORS, data), ==, 7814037168ull);
+    g_assert_cmpuint(read_field(table, ID_ATA_LOG_PER_PHYS, data), ==, 3);
+    g_assert_cmpuint(read_field(table, ID_ATA_SECTOR_SIZE_VALID, data), ==, 1);
+    g_assert_cmpuint(read_field(table, ID_ATA_WWN, data), ==, 0x50014EE2B5C3D4E5ull);
+    g_assert_cmpuint(read_field(table, ID_ATA_TRIM, data), ==, 1);
+    g_assert_cmpuint(read_field(table, ID_ATA_ROTATION_RATE, data), ==, 5400);
+    g_assert_cmpuint(read_field(table, ID_ATA_SIGNATURE, data), ==, 0xA5);
+
+    g_assert_true(identify_ata_checksum_valid(data));
+    data[ATA_WORD(217)] ^= 1;
+    g_assert_false(identify_ata_checksum_valid(data));
+    identify_ata_seal(data);
+    g_assert_true(identify_ata_checksum_valid(data));
+}
+
+// Writing back every decoded value reproduces the golden bytes exactly:
+// bit fields leave their neighbours alone and text keeps its padding
+static void check_round_trip(const IdentifyTable* table, const uint8_t* golden) {
+    uint8_t* copy = g_malloc(table->size);
+    memcpy(copy, golden, table->size);
+    char text[IDENTIFY_TEXT_MAX];
+    for (guint i = 0; i < table->field_count; i++) {
+        const IdentifyField* field = &table->fields[i];
+        switch (field->kind) {
+        case IDF_UINT:
+        case IDF_FLAG:
+        case IDF_WORDS_BE:
+            identify_write(field, copy, identify_read(field, golden));
+            break;
+        case IDF_U128:
+            break;
+        default:
+            // Unpopulated strings are NULs, which the encoder pads as spaces
+            if (identify_read_text(field, golden, text, sizeof(text)) > 0) {
+                identify_write_text(field, copy, text);
+            }
+            break;
+        }
+        g_assert_cmpmem(copy, table->size, golden, table->size);
+    }
+    g_free(copy);
+}
+
+static void test_round_trip(void) {
+    uint8_t data[IDENTIFY_NVME_SIZE];
+    golden_controller_data(data);
+    check_round_trip(&identify_nvme_controller_table, data);
+    check_round_trip(&identify_nvme_power_state_table, data + IDENTIFY_PSD_OFFSET + 4 * 32);
+    golden_namespace_data(data);
+    check_round_trip(&identify_nvme_namespace_table, data);
+    check_round_trip(&identify_nvme_lba_format_table, data + IDENTIFY_LBAF_OFFSET + 4);
+    golden_ata_data(data);
+    check_round_trip(&identify_ata_table, data);
+}
+
+static void sum_field(const IdentifyValue* value, void* ctx) {
+    *(uint64_t*)ctx += value->value + value->length;
+}
+
+static const IdentifyVisitor sum_visitor = { .field = sum_field };
+
+// Time per decode of all three structures through the visitor, the path the
+// device probe takes for every disk; run with -m perf
+static void test_decode_benchmark(void) {
+    uint8_t controller[IDENTIFY_NVME_SIZE];
+    uint8_t ns[IDENTIFY_NVME_SIZE];
+    uint8_t ata[IDENTIFY_ATA_SIZE];
+    golden_controller_data(controller);
+    golden_namespace_data(ns);
+    golden_ata_data(ata);
+
+    const guint rounds = 20000;
+    uint64_t sum = 0;
+    double best = G_MAXDOUBLE;
+    for (guint repeat = 0; repeat < 5; repeat++) {
+        g_test_timer_start();
+        for (guint i = 0; i < rounds; i++) {
+            identify_decode(&identify_nvme_controller_table, controller, sizeof(controller),
+                            &sum_visitor, &sum);
+            identify_decode(&identify_nvme_namespace_table, ns, sizeof(ns), &sum_visitor, &sum);
+            identify_decode(&identify_ata_table, ata, sizeof(ata), &sum_visitor, &sum);
+        }
+        best = MIN(best, g_test_timer_elapsed());
+    }
+    g_assert_cmpuint(sum, >, 0);
+    g_test_minimized_result(best * 1e9 / rounds, "controller + namespace + ATA decode: %.0f ns",
+                            best * 1e9 / rounds);
+
+    g_test_timer_start();
+    for (guint i = 0; i < rounds / 10; i++) {
+        fl_value_unref(identify_to_fl_value(&identify_nvme_controller_table, controller,
+                                            sizeof(controller)));
+    }
+    double elapsed = g_test_timer_elapsed();
+    g_test_minimized_result(elapsed * 1e9 / (rounds / 10), "controller to FlValue: %.0f ns",
+                            elapsed * 1e9 / (rounds / 10));
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/identify_decode/controller", test_controller);
+    g_test_add_func("/identify_decode/namespace", test_namespace);
+    g_test_add_func("/identify_decode/decode_walk", test_decode_walk);
+    g_test_add_func("/identify_decode/ata", test_ata);
+    g_test_add_func("/identify_decode/round_trip", test_round_trip);
+    if (g_test_perf()) {
+        g_test_add_func("/identify_decode/benchmark", test_decode_benchmark);
+    }
+    return g_test_run();
+}
@@ -0,0 +1,115 @@
+#define _GNU_SOURCE
+#include "../io_autotune.h"
+#include "../device_sim.h"
+#include <fcntl.h>
+#include <glib.h>
+
+#define MIB (1024ull * 1024)
+#define GIB (1024ull * MIB)
+#define KNEE_FRACTION 0.75
+
+// A simulated drive whose optimum is known from its performance model:
+// throughput grows linearly with depth up to @saturation_depth and the
+// fixed cost per request is small, so every candidate at or past that
+// depth is within a few percent of the device's bandwidth and the knee is
+// the smallest transfer at exactly that depth. Requests run at a quarter of
+// the modelled speed so that sleep overshoot stays small next to them.
+static DeviceSim* known_drive(guint saturation_depth, guint max_transfer_kb) {
+    DeviceSim* sim = device_sim_new(4);
+    DeviceSimSpec spec;
+    device_sim_spec_preset(&spec, DEVICE_SIM_NVME, "nvme0n1", GIB);
+    spec.read_bandwidth = 1e9;
+    spec.write_bandwidth = 1e9;
+    spec.inner_ratio = 1.0;
+    spec.latency_us = 10;
+    spec.saturation_depth = saturation_depth;
+    spec.max_transfer_kb = max_transfer_kb;
+    spec.optimal_io_size = 0;
+    g_assert_true(device_sim_add(sim, &spec, NULL));
+    return sim;
+}
+
+static void run_autotune(DeviceSim* sim, IoAutotuneMode mode, size_t min_block_size,
+                         size_t max_block_size, IoAutotuneResult* result) {
+    const DeviceBackend* backend = device_sim_backend(sim);
+    int fd = backend->open_device("/dev/nvme0n1", O_RDWR | O_DIRECT, backend->ctx);
+    g_assert_cmpint(fd, >=, 0);
+
+    IoAutotuneOptions options;
+    io_autotune_default_options(&options);
+    options.mode = mode;
+    options.offset = 64 * MIB;
+    options.length = 256 * MIB;
+    options.min_block_size = min_block_size;
+    options.max_block_size = max_block_size;
+    options.step_us = 200000;
+    options.budget_us = 10000000;
+    // Halving the depth below saturation halves throughput, so a wide
+    // margin still separates the knee from the candidates before it
+    options.knee_fraction = KNEE_FRACTION;
+    options.backend = backend;
+
+    GError* error = NULL;
+    g_assert_true(io_autotune_run(fd, "nvme0n1", &options, result, &error));
+    g_assert_no_error(error);
+    backend->close_device(fd, backend->ctx);
+
+    for (guint i = 0; i < result->sample_count; i++) {
+        const IoAutotuneSample* sample = &result->samples[i];
+        g_test_message("%zu KiB x %u: %.0f MB/s", sample->block_size / 1024, sample->queue_depth,
+                       sample->bytes_per_second / 1e6);
+    }
+}
+
+// Depth is taken up to the saturation point and no further, and no
+// candidate exceeds the transfer limit, which is a candidate of its own
+static void test_saturation_depth(void) {
+    DeviceSim* sim = known_drive(8, 384);
+    IoAutotuneResult result;
+    run_autotune(sim, IO_AUTOTUNE_WRITE, 256 * 1024, 1 * MIB, &result);
+
+    g_assert_cmpuint(result.max_transfer, ==, 384 * 1024);
+    gboolean saw_limit = FALSE;
+    for (guint i = 0; i < result.sample_count; i++) {
+        g_assert_cmpuint(result.samples[i].block_size, <=, 384 * 1024);
+        if (result.samples[i].block_size == 384 * 1024) saw_limit = TRUE;
+    }
+    g_assert_true(saw_limit);
+
+    g_assert_cmpuint(result.block_size, ==, 256 * 1024);
+    g_assert_cmpuint(result.queue_depth, ==, 8);
+    g_assert_cmpfloat(result.bytes_per_second, >=, result.best_bytes_per_second * KNEE_FRACTION);
+
+    // The probe wrote exactly what it accounted for, and never queued
+    // more than the sweep allows
+    DeviceSimStats stats;
+    g_assert_true(device_sim_get_stats(sim, "nvme0n1", &stats));
+    g_assert_cmpuint(stats.bytes_written, ==, result.bytes_transferred);
+    g_assert_cmpuint(stats.bytes_read, ==, 0);
+    g_assert_cmpuint(stats.max_queue_depth, <=, IO_AUTOTUNE_MAX_QUEUE_DEPTH);
+    device_sim_free(sim);
+}
+
+// A drive that is saturated by a single request is not queued deeper
+static void test_single_stream(void) {
+    DeviceSim* sim = known_drive(1, 0);
+    IoAutotuneResult result;
+    run_autotune(sim, IO_AUTOTUNE_READ, 1 * MIB, 4 * MIB, &result);
+
+    g_assert_cmpuint(result.max_transfer, ==, 0);
+    g_assert_cmpuint(result.block_size, ==, 1 * MIB);
+    g_assert_cmpuint(result.queue_depth, ==, 1);
+
+    DeviceSimStats stats;
+    g_assert_true(device_sim_get_stats(sim, "nvme0n1", &stats));
+    g_assert_cmpuint(stats.bytes_read, ==, result.bytes_transferred);
+    g_assert_cmpuint(stats.bytes_written, ==, 0);
+    device_sim_free(sim);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/io_autotune/saturation_depth", test_saturation_depth);
+    g_test_add_func("/io_autotune/single_stream", test_single_stream);
+    return g_test_run();
+}
@@ -0,0 +1,285 @@
+#define _GNU_SOURCE
+#include "../bulk_io.h"
+#include "../device_sim.h"
+#include "../io_throttle.h"
+#include "../range_wipe.h"
+#include <fcntl.h>
+#include <glib.h>
+#include <string.h>
+#include <time.h>
+
+#define MIB (1024ull * 1024)
+#define TARGET_CELSIUS 65
+#define CRITICAL_CELSIUS 75
+#define MIN_RATE (4 * MIB)
+
+// Temperature the simulated drive reports until @until_ms into the wipe
+typedef struct {
+    gint64 until_ms;
+    int celsius;
+} RampStep;
+
+static const RampStep ramp[] = {
+    { 400, 45 },              // cool: the controller probes queue depth
+    { 800, 70 },              // over target: the rate is shaped down
+    { 1800, 80 },             // critical: minimum rate at minimum depth
+    { 3200, 45 },             // cooled off: the rate recovers
+};
+
+typedef struct {
+    DeviceSim* sim;
+    IoThrottle* throttle;
+    gint64 start_us;
+    gint cancel;
+
+    gboolean saw_thermal;
+    gboolean saw_critical;
+    gboolean saw_recover;
+    guint critical_queue_depth;
+    uint64_t critical_rate;
+    uint64_t recovered_rate;
+
+    // Bytes that reached the device while the critical limit was in force
+    gint64 measure_start_us;
+    gint64 measure_end_us;
+    uint64_t measure_start_bytes;
+    uint64_t measure_end_bytes;
+
+    guint progress_events;
+    guint progress_with_throttle;
+    uint64_t progress_bytes;
+} RampCtx;
+
+static gint64 now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t device_bytes(RampCtx* ctx) {
+    DeviceSimStats stats;
+    g_assert_true(device_sim_get_stats(ctx->sim, "sdb", &stats));
+    return stats.bytes_written;
+}
+
+// IoTemperatureSource: follows the ramp and records what the controller did
+static int ramp_temperature(void* data) {
+    RampCtx* ctx = data;
+    gint64 elapsed_us = now_us() - ctx->start_us;
+    gint64 elapsed_ms = elapsed_us / 1000;
+
+    size_t step = 0;
+    while (step < G_N_ELEMENTS(ramp) && elapsed_ms >= ramp[step].until_ms) {
+        step++;
+    }
+    if (step == G_N_ELEMENTS(ramp)) {
+        ctx->cancel = 1;
+        return ramp[step - 1].celsius;
+    }
+
+    IoThrottleState state;
+    io_throttle_get_state(ctx->throttle, &state);
+    const char* reason = state.reason ? state.reason : "";
+    if (ramp[step].celsius >= TARGET_CELSIUS && strcmp(reason, "thermal") == 0) {
+        ctx->saw_thermal = TRUE;
+    }
+    if (ramp[step].celsius >= CRITICAL_CELSIUS && strcmp(reason, "thermal-critical") == 0) {
+        ctx->saw_critical = TRUE;
+        ctx->critical_queue_depth = state.queue_depth;
+        ctx->critical_rate = state.rate_bps;
+    }
+    if (step == G_N_ELEMENTS(ramp) - 1 && strcmp(reason, "recover") == 0) {
+        ctx->saw_recover = TRUE;
+        ctx->recovered_rate = state.rate_bps;
+    }
+
+    // Measure from the first window the critical limit applied to
+    if (ctx->saw_critical && ctx->measure_start_us == 0) {
+        ctx->measure_start_us = elapsed_us;
+        ctx->measure_start_bytes = device_bytes(ctx);
+    } else if (step == 3 && ctx->measure_end_us == 0) {
+        ctx->measure_end_us = elapsed_us;
+        ctx->measure_end_bytes = device_bytes(ctx);
+    }
+    return ramp[step].celsius;
+}
+
+static void ramp_progress(const BulkProgress* progress, void* user_data) {
+    RampCtx* ctx = user_data;
+    ctx->progress_events++;
+    if (progress->throttle) ctx->progress_with_throttle++;
+    ctx->progress_bytes = progress->bytes_done;
+}
+
+// A range wipe on a simulated SSD while the drive heats past its target and
+// critical temperatures and cools down again
+static void test_temperature_ramp(void) {
+    DeviceSim* sim = device_sim_new(1.0);
+    DeviceSimSpec spec;
+    device_sim_spec_preset(&spec, DEVICE_SIM_SATA_SSD, "sdb", 16ull * 1024 * MIB);
+    g_assert_true(device_sim_add(sim, &spec, NULL));
+
+    IoThrottleConfig config;
+    io_throttle_default_config(&config);
+    config.temperature_target_celsius = TARGET_CELSIUS;
+    config.temperature_critical_celsius = CRITICAL_CELSIUS;
+    config.min_rate_bps = MIN_RATE;
+    config.max_rate_bps = 128 * MIB;
+    config.max_queue_depth = 8;
+    config.window_ms = 100;
+
+    RampCtx ctx = { 0 };
+    ctx.sim = sim;
+    ctx.throttle = io_throttle_new(&config);
+
+    // Two ranges running side by side share the one controller
+    RangeExtent extents[2] = {
+        { "", 0, 4 * 1024 * MIB / RANGE_WIPE_SECTOR_SIZE },
+        { "", 8 * 1024 * MIB / RANGE_WIPE_SECTOR_SIZE, 4 * 1024 * MIB / RANGE_WIPE_SECTOR_SIZE },
+    };
+    RangeWipeOptions options;
+    range_wipe_default_options(&options);
+    options.extents = extents;
+    options.count = G_N_ELEMENTS(extents);
+    options.chunk_size = MIB;
+    options.max_parallel_ranges = 2;
+    options.workers_per_range = 4;
+    options.throttle = ctx.throttle;
+    options.temperature = ramp_temperature;
+    options.temperature_ctx = &ctx;
+    options.backend = device_sim_backend(sim);
+    options.progress = ramp_progress;
+    options.user_data = &ctx;
+    options.cancel = &ctx.cancel;
+
+    RangeWipeResult result;
+    GError* error = NULL;
+    ctx.start_us = now_us();
+    gboolean ok = range_wipe_execute("/dev/sdb", &options, &result, &error);
+
+    // The ramp ends by cancelling; the ranges are far larger than it lets through
+    g_assert_false(ok);
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+    g_clear_error(&error);
+    g_assert_false(result.sequential);
+    g_assert_cmpuint(result.bytes_written, ==, device_bytes(&ctx));
+
+    g_assert_true(ctx.saw_thermal);
+    g_assert_true(ctx.saw_critical);
+    g_assert_cmpuint(ctx.critical_queue_depth, ==, config.min_queue_depth);
+    g_assert_cmpuint(ctx.critical_rate, ==, MIN_RATE);
+
+    // At most the minimum rate plus one request per worker already admitted
+    g_assert_cmpint(ctx.measure_start_us, >, 0);
+    g_assert_cmpint(ctx.measure_end_us, >, ctx.measure_start_us);
+    double seconds = (double)(ctx.measure_end_us - ctx.measure_start_us) / 1e6;
+    uint64_t written = ctx.measure_end_bytes - ctx.measure_start_bytes;
+    g_test_message("critical: %.1f MiB/s", (double)written / seconds / MIB);
+    g_assert_cmpuint(written, <=, (uint64_t)(MIN_RATE * seconds) + 8 * MIB);
+
+    g_assert_true(ctx.saw_recover);
+    g_assert_cmpuint(ctx.recovered_rate, >, MIN_RATE);
+
+    g_assert_cmpuint(ctx.progress_events, >, 0);
+    g_assert_cmpuint(ctx.progress_with_throttle, ==, ctx.progress_events);
+    // Neither range finishes, so this only moves if ranges publish their
+    // progress while the wipe's own loop wins the shared throttle's windows
+    g_assert_cmpuint(ctx.progress_bytes, >, 0);
+
+    io_throttle_free(ctx.throttle);
+    device_sim_free(sim);
+}
+
+typedef struct {
+    IoThrottle* throttle;
+    guint events;
+    guint advanced;
+    uint64_t last_bytes;
+} SharedCtx;
+
+// Closes the throttle window just before the write's own control loop gets
+// to it, as another range sharing the throttle does
+static int steal_window(void* data) {
+    SharedCtx* ctx = data;
+    io_throttle_update(ctx->throttle, now_us());
+    return IO_THROTTLE_TEMPERATURE_UNKNOWN;
+}
+
+static void shared_progress(const BulkProgress* progress, void* user_data) {
+    SharedCtx* ctx = user_data;
+    g_assert_nonnull(progress->throttle);
+    ctx->events++;
+    if (progress->bytes_done > ctx->last_bytes) ctx->advanced++;
+    ctx->last_bytes = progress->bytes_done;
+}
+
+// Progress keeps flowing while someone else evaluates every window
+static void test_shared_window(void) {
+    DeviceSim* sim = device_sim_new(0);
+    DeviceSimSpec spec;
+    device_sim_spec_preset(&spec, DEVICE_SIM_SATA_SSD, "sdb", 1024 * MIB);
+    g_assert_true(device_sim_add(sim, &spec, NULL));
+    const DeviceBackend* backend = device_sim_backend(sim);
+    int fd = backend->open_device("/dev/sdb", O_RDWR, backend->ctx);
+    g_assert_cmpint(fd, >=, 0);
+
+    IoThrottleConfig config;
+    io_throttle_default_config(&config);
+    config.window_ms = 100;
+    config.max_rate_bps = 16 * MIB;
+    config.min_rate_bps = 16 * MIB;
+    SharedCtx ctx = { io_throttle_new(&config) };
+
+    BulkWriteOptions options;
+    bulk_io_default_options(&options);
+    options.length = 32 * MIB;
+    options.chunk_size = MIB;
+    options.max_workers = 2;
+    options.throttle = ctx.throttle;
+    options.temperature = steal_window;
+    options.temperature_ctx = &ctx;
+    options.progress = shared_progress;
+    options.user_data = &ctx;
+    options.backend = backend;
+
+    BulkWriteResult result;
+    GError* error = NULL;
+    g_assert_true(bulk_io_write(fd, &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(result.bytes_written, ==, options.length);
+    g_test_message("%u progress events, %u advanced", ctx.events, ctx.advanced);
+    g_assert_cmpuint(ctx.advanced, >=, 2);
+
+    backend->close_device(fd, backend->ctx);
+    io_throttle_free(ctx.throttle);
+    device_sim_free(sim);
+}
+
+// Without a temperature source the controller only hill-climbs
+static void test_unknown_temperature(void) {
+    IoThrottleConfig config;
+    io_throttle_default_config(&config);
+    config.window_ms = 100;
+    IoThrottle* throttle = io_throttle_new(&config);
+
+    gint64 now = now_us();
+    for (int i = 1; i <= 5; i++) {
+        io_throttle_record_io(throttle, 64 * MIB, 1000, FALSE);
+        g_assert_true(io_throttle_update(throttle, now + i * 100 * 1000));
+    }
+
+    IoThrottleState state;
+    io_throttle_get_state(throttle, &state);
+    g_assert_cmpint(state.temperature_celsius, ==, IO_THROTTLE_TEMPERATURE_UNKNOWN);
+    g_assert_cmpuint(state.rate_bps, ==, 0);
+    g_assert_cmpstr(state.reason, !=, "thermal");
+    io_throttle_free(throttle);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/io_throttle/temperature_ramp", test_temperature_ramp);
+    g_test_add_func("/io_throttle/unknown_temperature", test_unknown_temperature);
+    g_test_add_func("/io_throttle/shared_window", test_shared_window);
+    return g_test_run();
+}
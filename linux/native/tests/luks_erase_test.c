@@ -0,0 +1,279 @@
+#define _GNU_SOURCE
+#include "../luks_erase.h"
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Image fixtures are built here field by field, the way cryptsetup lays
+// them out, so the tests need neither cryptsetup nor loop devices
+
+#define KIB 1024ull
+#define MIB (1024ull * 1024)
+#define SECTOR 512
+#define PAYLOAD_BYTE 0x5a
+
+#define LUKS1_KEY_BYTES 64
+#define LUKS1_STRIPES 4000
+#define LUKS1_PAYLOAD (2 * MIB)
+#define LUKS1_KEY_ENABLED 0x00AC71F3u
+#define LUKS1_KEY_DISABLED 0x0000DEADu
+
+#define LUKS2_HDR_SIZE (16 * KIB)
+#define LUKS2_KEYSLOTS_SIZE (16 * MIB - 2 * LUKS2_HDR_SIZE)
+#define LUKS2_PAYLOAD (16 * MIB)
+#define LUKS2_AREA_SIZE (252 * KIB)
+
+static const char kUuid[] = "1b4e28ba-2fa1-11d2-883f-0016d3cca427";
+
+static void put_be16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put_be32(uint8_t* p, uint32_t v) {
+    put_be16(p, (uint16_t)(v >> 16));
+    put_be16(p + 2, (uint16_t)v);
+}
+
+static void put_be64(uint8_t* p, uint64_t v) {
+    put_be32(p, (uint32_t)(v >> 32));
+    put_be32(p + 4, (uint32_t)v);
+}
+
+// An image of @size bytes whose payload from @payload on holds PAYLOAD_BYTE
+static int create_image(uint64_t size, uint64_t payload, char** path) {
+    GError* error = NULL;
+    int fd = g_file_open_tmp("luks-XXXXXX.img", path, &error);
+    g_assert_no_error(error);
+    g_assert_cmpint(ftruncate(fd, (off_t)size), ==, 0);
+
+    uint8_t* buffer = g_malloc(MIB);
+    memset(buffer, PAYLOAD_BYTE, MIB);
+    for (uint64_t offset = payload; offset < size; offset += MIB) {
+        g_assert_cmpint(pwrite(fd, buffer, MIN(MIB, size - offset), (off_t)offset), >, 0);
+    }
+    g_free(buffer);
+    return fd;
+}
+
+static void destroy_image(int fd, char* path) {
+    close(fd);
+    unlink(path);
+    g_free(path);
+}
+
+static void write_at(int fd, const void* data, size_t size, uint64_t offset) {
+    g_assert_cmpint(pwrite(fd, data, size, (off_t)offset), ==, (ssize_t)size);
+}
+
+static gboolean payload_intact(int fd, uint64_t payload, uint64_t size) {
+    uint8_t buffer[4096];
+    for (uint64_t offset = payload; offset < size; offset += sizeof(buffer)) {
+        if (pread(fd, buffer, sizeof(buffer), (off_t)offset) != (ssize_t)sizeof(buffer)) return FALSE;
+        for (size_t i = 0; i < sizeof(buffer); i++) {
+            if (buffer[i] != PAYLOAD_BYTE) return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static const LuksRegion* find_region(const LuksLayout* layout, LuksRegionKind kind, int keyslot) {
+    for (guint i = 0; i < layout->region_count; i++) {
+        if (layout->regions[i].kind == kind && layout->regions[i].keyslot == keyslot) {
+            return &layout->regions[i];
+        }
+    }
+    return NULL;
+}
+
+// LUKS1 with keyslots 0 and 1 enabled and the rest disabled but laid out, as
+// luksFormat leaves them
+static int create_luks1(char** path) {
+    int fd = create_image(LUKS1_PAYLOAD + MIB, LUKS1_PAYLOAD, path);
+
+    uint8_t phdr[592] = { 'L', 'U', 'K', 'S', 0xba, 0xbe };
+    put_be16(phdr + 6, 1);
+    memcpy(phdr + 8, "aes", 3);
+    memcpy(phdr + 40, "xts-plain64", 11);
+    memcpy(phdr + 72, "sha256", 6);
+    put_be32(phdr + 104, LUKS1_PAYLOAD / SECTOR);
+    put_be32(phdr + 108, LUKS1_KEY_BYTES);
+    memcpy(phdr + 168, kUuid, sizeof(kUuid) - 1);
+    for (int i = 0; i < 8; i++) {
+        uint8_t* slot = phdr + 208 + i * 48;
+        put_be32(slot, i < 2 ? LUKS1_KEY_ENABLED : LUKS1_KEY_DISABLED);
+        put_be32(slot + 40, 8 + i * 504);  // 4 KiB aligned, 252 KiB apart
+        put_be32(slot + 44, LUKS1_STRIPES);
+    }
+    write_at(fd, phdr, sizeof(phdr), 0);
+    return fd;
+}
+
+static void write_luks2_header(int fd, uint64_t offset, gboolean secondary, const char* json) {
+    uint8_t* area = g_malloc0(LUKS2_HDR_SIZE);
+    memcpy(area, secondary ? "SKUL\xba\xbe" : "LUKS\xba\xbe", 6);
+    put_be16(area + 6, 2);
+    put_be64(area + 8, LUKS2_HDR_SIZE);
+    put_be64(area + 16, 1);
+    memcpy(area + 168, kUuid, sizeof(kUuid) - 1);
+    put_be64(area + 256, offset);
+    memcpy(area + 4096, json, strlen(json));
+    write_at(fd, area, LUKS2_HDR_SIZE, offset);
+    g_free(area);
+}
+
+// LUKS2 with two keyslots, metadata in both the primary and secondary area
+static int create_luks2(char** path) {
+    int fd = create_image(LUKS2_PAYLOAD + MIB, LUKS2_PAYLOAD, path);
+    char* json = g_strdup_printf(
+        "{\"keyslots\":{"
+        "\"0\":{\"type\":\"luks2\",\"key_size\":64,\"area\":{\"type\":\"raw\",\"offset\":\"%llu\",\"size\":\"%llu\"}},"
+        "\"1\":{\"type\":\"luks2\",\"key_size\":64,\"area\":{\"type\":\"raw\",\"offset\":\"%llu\",\"size\":\"%llu\"}}},"
+        "\"tokens\":{},"
+        "\"segments\":{\"0\":{\"type\":\"crypt\",\"offset\":\"%llu\",\"size\":\"dynamic\",\"iv_tweak\":\"0\"}},"
+        "\"digests\":{\"0\":{\"type\":\"pbkdf2\",\"keyslots\":[\"0\",\"1\"],\"segments\":[\"0\"]}},"
+        "\"config\":{\"json_size\":\"12288\",\"keyslots_size\":\"%llu\"}}",
+        (unsigned long long)(2 * LUKS2_HDR_SIZE), (unsigned long long)LUKS2_AREA_SIZE,
+        (unsigned long long)(2 * LUKS2_HDR_SIZE + LUKS2_AREA_SIZE), (unsigned long long)LUKS2_AREA_SIZE,
+        (unsigned long long)LUKS2_PAYLOAD, (unsigned long long)LUKS2_KEYSLOTS_SIZE);
+    write_luks2_header(fd, 0, FALSE, json);
+    write_luks2_header(fd, LUKS2_HDR_SIZE, TRUE, json);
+    g_free(json);
+    return fd;
+}
+
+static void check_luks2_layout(const LuksLayout* layout) {
+    g_assert_cmpint(layout->version, ==, 2);
+    g_assert_cmpstr(layout->uuid, ==, kUuid);
+    g_assert_cmpuint(layout->header_size, ==, LUKS2_HDR_SIZE);
+    g_assert_cmpuint(layout->payload_offset, ==, LUKS2_PAYLOAD);
+    g_assert_cmpuint(layout->active_keyslots, ==, 2);
+
+    const LuksRegion* region = find_region(layout, LUKS_REGION_HEADER, -1);
+    g_assert_nonnull(region);
+    g_assert_cmpuint(region->offset, ==, 0);
+    g_assert_cmpuint(region->length, ==, LUKS2_HDR_SIZE);
+    region = find_region(layout, LUKS_REGION_SECONDARY, -1);
+    g_assert_nonnull(region);
+    g_assert_cmpuint(region->offset, ==, LUKS2_HDR_SIZE);
+    region = find_region(layout, LUKS_REGION_KEYSLOT, 1);
+    g_assert_nonnull(region);
+    g_assert_cmpuint(region->offset, ==, 2 * LUKS2_HDR_SIZE + LUKS2_AREA_SIZE);
+    g_assert_cmpuint(region->length, ==, LUKS2_AREA_SIZE);
+    region = find_region(layout, LUKS_REGION_KEYSLOTS, -1);
+    g_assert_nonnull(region);
+    g_assert_cmpuint(region->offset + region->length, ==, LUKS2_PAYLOAD);
+}
+
+static void test_luks1_layout(void) {
+    char* path;
+    int fd = create_luks1(&path);
+
+    LuksLayout layout;
+    GError* error = NULL;
+    g_assert_true(luks_read_layout(fd, &layout, &error));
+    g_assert_no_error(error);
+    g_assert_cmpint(layout.version, ==, 1);
+    g_assert_cmpstr(layout.uuid, ==, kUuid);
+    g_assert_cmpuint(layout.payload_offset, ==, LUKS1_PAYLOAD);
+    g_assert_cmpuint(layout.active_keyslots, ==, 2);
+    g_assert_cmpuint(layout.region_count, ==, 9);
+
+    const LuksRegion* header = find_region(&layout, LUKS_REGION_HEADER, -1);
+    g_assert_nonnull(header);
+    g_assert_cmpuint(header->length, ==, 8 * SECTOR);
+    // Disabled slots are erased as well, each rounded up to 4 KiB
+    for (int i = 0; i < 8; i++) {
+        const LuksRegion* slot = find_region(&layout, LUKS_REGION_KEYSLOT, i);
+        g_assert_nonnull(slot);
+        g_assert_cmpuint(slot->offset, ==, (8 + i * 504) * SECTOR);
+        g_assert_cmpuint(slot->length, ==, 252 * KIB);
+    }
+    destroy_image(fd, path);
+}
+
+static void test_luks1_erase(void) {
+    char* path;
+    int fd = create_luks1(&path);
+
+    LuksEraseResult result;
+    GError* error = NULL;
+    g_assert_true(luks_crypto_erase(fd, &result, &error));
+    g_assert_no_error(error);
+    g_assert_true(result.verified);
+    g_assert_cmpuint(result.bytes_written, ==, 8 * SECTOR + 8 * 252 * KIB);
+    g_assert_true(payload_intact(fd, LUKS1_PAYLOAD, LUKS1_PAYLOAD + MIB));
+
+    LuksLayout layout;
+    g_assert_false(luks_read_layout(fd, &layout, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+    g_clear_error(&error);
+    destroy_image(fd, path);
+}
+
+static void test_luks2_layout(void) {
+    char* path;
+    int fd = create_luks2(&path);
+
+    LuksLayout layout;
+    GError* error = NULL;
+    g_assert_true(luks_read_layout(fd, &layout, &error));
+    g_assert_no_error(error);
+    check_luks2_layout(&layout);
+    destroy_image(fd, path);
+}
+
+// A primary header destroyed by an interrupted erase or a stray write: the
+// secondary header and its metadata still describe, and unlock, the volume
+static void test_luks2_primary_destroyed(void) {
+    char* path;
+    int fd = create_luks2(&path);
+    uint8_t* garbage = g_malloc(LUKS2_HDR_SIZE);
+    memset(garbage, 0xa5, LUKS2_HDR_SIZE);
+    write_at(fd, garbage, LUKS2_HDR_SIZE, 0);
+    g_free(garbage);
+
+    LuksLayout layout;
+    GError* error = NULL;
+    g_assert_true(luks_read_layout(fd, &layout, &error));
+    g_assert_no_error(error);
+    check_luks2_layout(&layout);
+
+    LuksEraseResult result;
+    g_assert_true(luks_crypto_erase(fd, &result, &error));
+    g_assert_no_error(error);
+    g_assert_true(result.verified);
+    g_assert_cmpuint(result.bytes_written, ==, LUKS2_PAYLOAD);
+    g_assert_true(payload_intact(fd, LUKS2_PAYLOAD, LUKS2_PAYLOAD + MIB));
+    destroy_image(fd, path);
+}
+
+static void test_not_luks(void) {
+    char* path;
+    int fd = create_image(LUKS2_PAYLOAD + MIB, 0, &path);
+
+    LuksLayout layout;
+    GError* error = NULL;
+    g_assert_false(luks_read_layout(fd, &layout, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+    g_clear_error(&error);
+
+    LuksEraseResult result;
+    g_assert_false(luks_crypto_erase(fd, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+    g_clear_error(&error);
+    g_assert_cmpuint(result.bytes_written, ==, 0);
+    g_assert_true(payload_intact(fd, 0, LUKS2_PAYLOAD + MIB));
+    destroy_image(fd, path);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/luks_erase/luks1_layout", test_luks1_layout);
+    g_test_add_func("/luks_erase/luks1_erase", test_luks1_erase);
+    g_test_add_func("/luks_erase/luks2_layout", test_luks2_layout);
+    g_test_add_func("/luks_erase/luks2_primary_destroyed", test_luks2_primary_destroyed);
+    g_test_add_func("/luks_erase/not_luks", test_not_luks);
+    return g_test_run();
+}
@@ -0,0 +1,141 @@
+#define _GNU_SOURCE
+#include "../main_dispatch.h"
+#include <glib.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define PRODUCERS 4
+#define MESSAGES_PER_PRODUCER 50000
+// Far below what the producers post per wakeup, so the overflow list is
+// used constantly and has to be spliced behind the ring
+#define CAPACITY 8
+
+typedef struct {
+    MainDispatch* dispatch;
+    guint producer;
+    gboolean keyed;
+} Producer;
+
+typedef struct {
+    // Next sequence number expected from each producer
+    guint next[PRODUCERS];
+    guint delivered;
+    guint out_of_order;
+} Consumer;
+
+static gpointer encode(guint producer, guint sequence) {
+    return GUINT_TO_POINTER((producer << 24) | sequence);
+}
+
+static void on_message(gpointer owner, gpointer data) {
+    Consumer* consumer = owner;
+    guint producer = GPOINTER_TO_UINT(data) >> 24;
+    guint sequence = GPOINTER_TO_UINT(data) & 0xFFFFFF;
+    g_assert_cmpuint(producer, <, PRODUCERS);
+    if (sequence != consumer->next[producer]) consumer->out_of_order++;
+    consumer->next[producer] = sequence + 1;
+    consumer->delivered++;
+}
+
+// Keyed messages may be superseded, so only require that sequence numbers
+// never go backwards
+static void on_keyed_message(gpointer owner, gpointer data) {
+    Consumer* consumer = owner;
+    guint producer = GPOINTER_TO_UINT(data) >> 24;
+    guint sequence = GPOINTER_TO_UINT(data) & 0xFFFFFF;
+    g_assert_cmpuint(producer, <, PRODUCERS);
+    if (sequence < consumer->next[producer]) consumer->out_of_order++;
+    consumer->next[producer] = sequence + 1;
+    consumer->delivered++;
+}
+
+static void* producer_func(void* data) {
+    Producer* producer = data;
+    // One key per producer; its address is all the dispatch compares
+    static const char keys[PRODUCERS];
+    for (guint i = 0; i < MESSAGES_PER_PRODUCER; i++) {
+        // Short bursts keep the consumer draining while others still post
+        if (i % 16 == 0) sched_yield();
+        if (producer->keyed) {
+            g_assert_true(main_dispatch_post(producer->dispatch, &keys[producer->producer],
+                                             on_keyed_message, encode(producer->producer, i), NULL));
+        } else {
+            g_assert_true(main_dispatch_post(producer->dispatch, NULL, on_message,
+                                             encode(producer->producer, i), NULL));
+        }
+    }
+    return NULL;
+}
+
+// Runs PRODUCERS threads against one dispatch and iterates its context
+// until every message is accounted for
+static void run_producers(gboolean keyed, Consumer* consumer, MainDispatchStats* stats) {
+    GMainContext* context = g_main_context_new();
+    MainDispatch* dispatch = main_dispatch_new(context, CAPACITY, consumer);
+
+    pthread_t threads[PRODUCERS];
+    Producer producers[PRODUCERS];
+    for (guint i = 0; i < PRODUCERS; i++) {
+        producers[i] = (Producer){ dispatch, i, keyed };
+        g_assert_cmpint(pthread_create(&threads[i], NULL, producer_func, &producers[i]), ==, 0);
+    }
+
+    guint64 total = (guint64)PRODUCERS * MESSAGES_PER_PRODUCER;
+    for (;;) {
+        main_dispatch_get_stats(dispatch, stats);
+        if (stats->dispatched + stats->superseded == total) break;
+        g_main_context_iteration(context, TRUE);
+    }
+    for (guint i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    main_dispatch_get_stats(dispatch, stats);
+    main_dispatch_free(dispatch);
+    g_main_context_unref(context);
+}
+
+// Every message arrives exactly once and in the order its thread posted it,
+// however the ring and the overflow list interleave
+static void test_per_thread_order(void) {
+    Consumer consumer = { { 0 } };
+    MainDispatchStats stats;
+    run_producers(FALSE, &consumer, &stats);
+
+    g_test_message("%" G_GUINT64_FORMAT " batches, %" G_GUINT64_FORMAT " overflowed",
+                   stats.batches, stats.overflowed);
+    g_assert_cmpuint(consumer.out_of_order, ==, 0);
+    g_assert_cmpuint(consumer.delivered, ==, PRODUCERS * MESSAGES_PER_PRODUCER);
+    for (guint i = 0; i < PRODUCERS; i++) {
+        g_assert_cmpuint(consumer.next[i], ==, MESSAGES_PER_PRODUCER);
+    }
+    g_assert_cmpuint(stats.posted, ==, PRODUCERS * MESSAGES_PER_PRODUCER);
+    g_assert_cmpuint(stats.dispatched, ==, stats.posted);
+    g_assert_cmpuint(stats.superseded, ==, 0);
+    g_assert_cmpuint(stats.discarded, ==, 0);
+    g_assert_cmpuint(stats.overflowed, >, 0);
+}
+
+// Coalescing drops older messages but never delivers one after a newer one
+// with the same key, and the last message of each producer always runs
+static void test_keyed_order(void) {
+    Consumer consumer = { { 0 } };
+    MainDispatchStats stats;
+    run_producers(TRUE, &consumer, &stats);
+
+    g_test_message("%" G_GUINT64_FORMAT " superseded", stats.superseded);
+    g_assert_cmpuint(consumer.out_of_order, ==, 0);
+    for (guint i = 0; i < PRODUCERS; i++) {
+        g_assert_cmpuint(consumer.next[i], ==, MESSAGES_PER_PRODUCER);
+    }
+    g_assert_cmpuint(consumer.delivered, ==, stats.dispatched);
+    g_assert_cmpuint(stats.dispatched + stats.superseded, ==, stats.posted);
+    g_assert_cmpuint(stats.discarded, ==, 0);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/main_dispatch/per_thread_order", test_per_thread_order);
+    g_test_add_func("/main_dispatch/keyed_order", test_keyed_order);
+    return g_test_run();
+}
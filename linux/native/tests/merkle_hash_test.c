@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+#include "../merkle_hash.h"
+#include <fcntl.h>
+#include <glib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LEAF 4096
+// Ten full leaves and a short one: regions of 4, 4 and 3 leaves
+#define FILE_SIZE (10 * LEAF + 1000)
+#define BENCH_SIZE (256ull * 1024 * 1024)
+
+static const char* const expected_root =
+    "0bf1f6a6289a33cb960a4400e163214c94be312e4aac9bf2c94272c8f4eec8c6";
+static const char* const expected_regions[] = {
+    "8cf85400017aefb102fece84a63d251373ca282b285223ac5e6a40a5a4aa05b1",
+    "6f36aeb0334354671955040bdcc4f881dea95288f1a711a7d72fbacfbfec166c",
+    "847cd3ec68db6779022082b67f21bd5438396b3ec67b9fd22f1c65d0eb236774",
+};
+
+typedef struct {
+    char* path;
+    int fd;
+} Fixture;
+
+// Same bytes as the sha256 vectors: the top byte of i times the
+// golden-ratio constant
+static void write_pattern(int fd, uint64_t size) {
+    size_t chunk = 1024 * 1024;
+    guint8* data = g_malloc(chunk);
+    for (uint64_t offset = 0; offset < size; offset += chunk) {
+        size_t length = (size_t)MIN(chunk, size - offset);
+        for (size_t i = 0; i < length; i++) {
+            data[i] = (guint8)(((uint32_t)(offset + i) * 2654435761u) >> 24);
+        }
+        g_assert_cmpint(pwrite(fd, data, length, (off_t)offset), ==, (gssize)length);
+    }
+    g_free(data);
+}
+
+static void fixture_setup(Fixture* fixture, gconstpointer data) {
+    fixture->fd = g_file_open_tmp("merkle-XXXXXX", &fixture->path, NULL);
+    g_assert_cmpint(fixture->fd, >=, 0);
+    write_pattern(fixture->fd, FILE_SIZE);
+}
+
+static void fixture_teardown(Fixture* fixture, gconstpointer data) {
+    close(fixture->fd);
+    unlink(fixture->path);
+    g_free(fixture->path);
+}
+
+static void assert_digest(const uint8_t* digest, const char* expected) {
+    char hex[2 * SHA256_DIGEST_SIZE + 1];
+    sha256_to_hex(digest, hex);
+    g_assert_cmpstr(hex, ==, expected);
+}
+
+static void hash(int fd, MerkleHashOptions* options, MerkleHashResult* result) {
+    GError* error = NULL;
+    g_assert_true(merkle_hash_device(fd, options, result, &error));
+    g_assert_no_error(error);
+}
+
+static void small_options(MerkleHashOptions* options, guint workers) {
+    merkle_hash_default_options(options);
+    options->leaf_size = LEAF;
+    options->region_size = 4 * LEAF;
+    options->workers = workers;
+}
+
+// Root and region roots match a reference tree, for any number of workers
+static void test_root(Fixture* fixture, gconstpointer data) {
+    static const guint workers[] = {1, 2, 3, 16};
+    for (guint w = 0; w < G_N_ELEMENTS(workers); w++) {
+        MerkleHashOptions options;
+        small_options(&options, workers[w]);
+        MerkleHashResult result;
+        hash(fixture->fd, &options, &result);
+        g_assert_cmpuint(result.length, ==, FILE_SIZE);
+        g_assert_cmpuint(result.region_count, ==, G_N_ELEMENTS(expected_regions));
+        assert_digest(result.root, expected_root);
+        for (guint i = 0; i < G_N_ELEMENTS(expected_regions); i++) {
+            assert_digest(result.region_roots + i * SHA256_DIGEST_SIZE, expected_regions[i]);
+        }
+        merkle_hash_result_clear(&result);
+    }
+}
+
+// Hashing one region on its own reproduces its root
+static void test_region_root(Fixture* fixture, gconstpointer data) {
+    MerkleHashOptions options;
+    small_options(&options, 2);
+    options.offset = 4 * LEAF;
+    options.length = 4 * LEAF;
+    MerkleHashResult result;
+    hash(fixture->fd, &options, &result);
+    g_assert_cmpuint(result.region_count, ==, 1);
+    assert_digest(result.root, expected_regions[1]);
+    assert_digest(result.region_roots, expected_regions[1]);
+    merkle_hash_result_clear(&result);
+
+    // The last region: two leaves paired, the short one carried up unpaired
+    options.offset = 8 * LEAF;
+    options.length = 0;
+    hash(fixture->fd, &options, &result);
+    assert_digest(result.root, expected_regions[2]);
+    merkle_hash_result_clear(&result);
+}
+
+// A lone leaf is the root: SHA-256 of 0x00 and the short leaf itself
+static void test_unpaired_leaf(Fixture* fixture, gconstpointer data) {
+    g_assert_cmpint(ftruncate(fixture->fd, 1000), ==, 0);
+    MerkleHashOptions options;
+    small_options(&options, 4);
+    MerkleHashResult result;
+    hash(fixture->fd, &options, &result);
+    g_assert_cmpuint(result.region_count, ==, 1);
+    assert_digest(result.root, "d5f6f6b3b7b23ac990f95531593cc2e841c733fbbe0c19a1f64c07f70f405e8d");
+    merkle_hash_result_clear(&result);
+}
+
+static void test_invalid(Fixture* fixture, gconstpointer data) {
+    MerkleHashOptions options;
+    small_options(&options, 1);
+    options.region_size = 3 * LEAF;
+    MerkleHashResult result;
+    GError* error = NULL;
+    g_assert_false(merkle_hash_device(fixture->fd, &options, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+    g_clear_error(&error);
+
+    small_options(&options, 1);
+    options.offset = 100;
+    g_assert_false(merkle_hash_device(fixture->fd, &options, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+    g_clear_error(&error);
+}
+
+static double bench_hash(int fd, guint workers, uint8_t root[SHA256_DIGEST_SIZE]) {
+    MerkleHashOptions options;
+    merkle_hash_default_options(&options);
+    options.region_size = 64 * 1024 * 1024;
+    options.workers = workers;
+    MerkleHashResult result;
+    g_test_timer_start();
+    hash(fd, &options, &result);
+    double mbps = BENCH_SIZE / g_test_timer_elapsed() / 1e6;
+    memcpy(root, result.root, SHA256_DIGEST_SIZE);
+    merkle_hash_result_clear(&result);
+    return mbps;
+}
+
+// A cached file hashed by one worker and by the default pool; run with
+// -m perf
+static void test_benchmark(void) {
+    char* path;
+    int fd = g_file_open_tmp("merkle-bench-XXXXXX", &path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    write_pattern(fd, BENCH_SIZE);
+
+    uint8_t single_root[SHA256_DIGEST_SIZE], pool_root[SHA256_DIGEST_SIZE];
+    bench_hash(fd, 1, single_root);
+    double single = bench_hash(fd, 1, single_root);
+    double pool = bench_hash(fd, 0, pool_root);
+    g_assert_cmpmem(single_root, SHA256_DIGEST_SIZE, pool_root, SHA256_DIGEST_SIZE);
+    g_test_maximized_result(pool, "merkle over %llu MiB: 1 worker %.0f MB/s, default pool %.0f MB/s (%.1fx)",
+                            BENCH_SIZE >> 20, single, pool, pool / single);
+
+    close(fd);
+    unlink(path);
+    g_free(path);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add("/merkle_hash/root", Fixture, NULL, fixture_setup, test_root, fixture_teardown);
+    g_test_add("/merkle_hash/region_root", Fixture, NULL, fixture_setup, test_region_root,
+               fixture_teardown);
+    g_test_add("/merkle_hash/unpaired_leaf", Fixture, NULL, fixture_setup, test_unpaired_leaf,
+               fixture_teardown);
+    g_test_add("/merkle_hash/invalid", Fixture, NULL, fixture_setup, test_invalid, fixture_teardown);
+    if (g_test_perf()) {
+        g_test_add_func("/merkle_hash/benchmark", test_benchmark);
+    }
+    return g_test_run();
+}
@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include "../numa_placement.h"
+#include <ftw.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Fixture tree shaped like a two-socket machine:
+//
+//   nvme0n1, nvme0n1p2  NVMe drive behind a root port on node 1, three MSI-X
+//                       vectors all routed to node 1 CPUs
+//   sda                 SATA disk on node 0 whose only vector targets node 1
+//   nvme1n1             NVMe drive on a machine without NUMA (numa_node -1)
+//   loop0               virtual device without any numa_node above it
+#define NVME0_FUNCTION "sys/devices/pci0000:80/0000:80:01.0/0000:81:00.0"
+#define NVME1_FUNCTION "sys/devices/pci0000:00/0000:00:1d.0/0000:3c:00.0"
+#define SATA_FUNCTION "sys/devices/pci0000:00/0000:00:17.0"
+
+typedef struct {
+    char* root;
+} Fixture;
+
+static void write_file(const char* root, const char* relative, const char* contents) {
+    char* path = g_build_filename(root, relative, NULL);
+    char* dir = g_path_get_dirname(path);
+    g_assert_cmpint(g_mkdir_with_parents(dir, 0755), ==, 0);
+    g_assert_true(g_file_set_contents(path, contents, -1, NULL));
+    g_free(dir);
+    g_free(path);
+}
+
+static void make_dir(const char* root, const char* relative) {
+    char* path = g_build_filename(root, relative, NULL);
+    g_assert_cmpint(g_mkdir_with_parents(path, 0755), ==, 0);
+    g_free(path);
+}
+
+// /sys/class/block/<name> -> ../../<target>, as the kernel links it
+static void link_block(const char* root, const char* name, const char* target) {
+    make_dir(root, target);
+    make_dir(root, "sys/class/block");
+    char* link = g_strdup_printf("%s/sys/class/block/%s", root, name);
+    char* relative = g_strdup_printf("../../../%s", target);
+    g_assert_cmpint(symlink(relative, link), ==, 0);
+    g_free(relative);
+    g_free(link);
+}
+
+static void fixture_setup(Fixture* fixture, gconstpointer data) {
+    fixture->root = g_dir_make_tmp("numa-XXXXXX", NULL);
+    g_assert_nonnull(fixture->root);
+    const char* root = fixture->root;
+
+    write_file(root, "sys/devices/system/node/node0/cpulist", "0-15,32-47\n");
+    write_file(root, "sys/devices/system/node/node1/cpulist", "16-31,48-63\n");
+
+    write_file(root, NVME0_FUNCTION "/numa_node", "1\n");
+    write_file(root, NVME0_FUNCTION "/msi_irqs/130", "msix\n");
+    write_file(root, NVME0_FUNCTION "/msi_irqs/131", "msix\n");
+    write_file(root, NVME0_FUNCTION "/msi_irqs/132", "msix\n");
+    write_file(root, "proc/irq/130/effective_affinity_list", "16\n");
+    // No effective affinity yet: the configured one is used
+    write_file(root, "proc/irq/131/effective_affinity_list", "\n");
+    write_file(root, "proc/irq/131/smp_affinity_list", "17-18\n");
+    write_file(root, "proc/irq/132/effective_affinity_list", "48\n");
+    link_block(root, "nvme0n1", NVME0_FUNCTION "/nvme/nvme0/nvme0n1");
+    link_block(root, "nvme0n1p2", NVME0_FUNCTION "/nvme/nvme0/nvme0n1/nvme0n1p2");
+
+    write_file(root, SATA_FUNCTION "/numa_node", "0\n");
+    write_file(root, SATA_FUNCTION "/msi_irqs/40", "msi\n");
+    write_file(root, "proc/irq/40/smp_affinity_list", "20\n");
+    link_block(root, "sda", SATA_FUNCTION "/ata1/host0/target0:0:0/0:0:0:0/block/sda");
+
+    write_file(root, NVME1_FUNCTION "/numa_node", "-1\n");
+    link_block(root, "nvme1n1", NVME1_FUNCTION "/nvme/nvme1/nvme1n1");
+
+    link_block(root, "loop0", "sys/devices/virtual/block/loop0");
+    // Outside /sys: the walk must stop before reaching it
+    write_file(root, "numa_node", "3\n");
+}
+
+static int remove_entry(const char* path, const struct stat* st, int flag, struct FTW* ftw) {
+    return remove(path);
+}
+
+static void fixture_teardown(Fixture* fixture, gconstpointer data) {
+    nftw(fixture->root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    g_free(fixture->root);
+}
+
+static void test_local_irqs(Fixture* fixture, gconstpointer data) {
+    NumaPlacement placement;
+    g_assert_true(numa_placement_probe(fixture->root, "nvme0n1", &placement));
+    g_assert_cmpint(placement.numa_node, ==, 1);
+    g_assert_cmpuint(placement.cpu_count, ==, 32);
+    g_assert_cmpstr(placement.cpu_list, ==, "16-31,48-63");
+    g_assert_true(CPU_ISSET(16, &placement.cpus));
+    g_assert_false(CPU_ISSET(0, &placement.cpus));
+    g_assert_cmpuint(placement.irq_count, ==, 3);
+    g_assert_cmpstr(placement.irq_cpu_list, ==, "16-18,48");
+    g_assert_true(placement.irqs_local);
+}
+
+// A partition inherits the node of its disk's PCI function
+static void test_partition(Fixture* fixture, gconstpointer data) {
+    NumaPlacement placement;
+    g_assert_true(numa_placement_probe(fixture->root, "nvme0n1p2", &placement));
+    g_assert_cmpint(placement.numa_node, ==, 1);
+    g_assert_cmpstr(placement.cpu_list, ==, "16-31,48-63");
+    g_assert_cmpuint(placement.irq_count, ==, 3);
+}
+
+static void test_remote_irqs(Fixture* fixture, gconstpointer data) {
+    NumaPlacement placement;
+    g_assert_true(numa_placement_probe(fixture->root, "sda", &placement));
+    g_assert_cmpint(placement.numa_node, ==, 0);
+    g_assert_cmpstr(placement.cpu_list, ==, "0-15,32-47");
+    g_assert_cmpuint(placement.irq_count, ==, 1);
+    g_assert_cmpstr(placement.irq_cpu_list, ==, "20");
+    g_assert_false(placement.irqs_local);
+}
+
+// Nothing to pin to: no NUMA, a virtual device, or a numa_node outside /sys
+static void test_no_node(Fixture* fixture, gconstpointer data) {
+    NumaPlacement placement;
+    g_assert_true(numa_placement_probe(fixture->root, "nvme1n1", &placement));
+    g_assert_cmpint(placement.numa_node, ==, -1);
+    g_assert_cmpuint(placement.cpu_count, ==, 0);
+    g_assert_cmpstr(placement.cpu_list, ==, "");
+
+    g_assert_true(numa_placement_probe(fixture->root, "loop0", &placement));
+    g_assert_cmpint(placement.numa_node, ==, -1);
+    g_assert_cmpuint(placement.cpu_count, ==, 0);
+    g_assert_cmpuint(placement.irq_count, ==, 0);
+
+    NumaPlacementStats stats = { 0 };
+    g_assert_false(numa_placement_bind_thread(&placement, &stats));
+    g_assert_cmpuint(stats.threads, ==, 1);
+    g_assert_cmpuint(stats.threads_pinned, ==, 0);
+}
+
+static void test_unknown_device(Fixture* fixture, gconstpointer data) {
+    NumaPlacement placement;
+    g_assert_false(numa_placement_probe(fixture->root, "sdz", &placement));
+    g_assert_cmpint(placement.numa_node, ==, -1);
+    g_assert_false(numa_placement_probe(fixture->root, "../block/sda", &placement));
+    g_assert_false(numa_placement_probe(fixture->root, "", &placement));
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add("/numa_placement/local_irqs", Fixture, NULL, fixture_setup, test_local_irqs, fixture_teardown);
+    g_test_add("/numa_placement/partition", Fixture, NULL, fixture_setup, test_partition, fixture_teardown);
+    g_test_add("/numa_placement/remote_irqs", Fixture, NULL, fixture_setup, test_remote_irqs, fixture_teardown);
+    g_test_add("/numa_placement/no_node", Fixture, NULL, fixture_setup, test_no_node, fixture_teardown);
+    g_test_add("/numa_placement/unknown_device", Fixture, NULL, fixture_setup, test_unknown_device,
+               fixture_teardown);
+    return g_test_run();
+}
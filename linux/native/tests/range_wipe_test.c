@@ -0,0 +1,363 @@
+#define _GNU_SOURCE
+#include "../range_wipe.h"
+#include "../device_sim.h"
+#include <fcntl.h>
+#include <ftw.h>
+#include <glib.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MIB (1024ull * 1024)
+#define GIB (1024ull * MIB)
+#define SECTORS(bytes) ((bytes) / RANGE_WIPE_SECTOR_SIZE)
+
+// Fixture tree for validation:
+//
+//   sda   1 GiB, sda1 unmounted, sda2 mounted at /, free space after sda2
+//   sdb   1 GiB without a partition table, mounted whole
+#define SDA1_START 2048
+#define SDA1_SIZE 524288
+#define SDA2_START 526336
+#define SDA2_SIZE 1048576
+#define DISK_SIZE 2097152
+
+typedef struct {
+    char* root;
+} Fixture;
+
+static void write_file(const char* root, const char* relative, const char* contents) {
+    char* path = g_build_filename(root, relative, NULL);
+    char* dir = g_path_get_dirname(path);
+    g_assert_cmpint(g_mkdir_with_parents(dir, 0755), ==, 0);
+    g_assert_true(g_file_set_contents(path, contents, -1, NULL));
+    g_free(dir);
+    g_free(path);
+}
+
+static void write_u64(const char* root, const char* relative, uint64_t value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%llu\n", (unsigned long long)value);
+    write_file(root, relative, text);
+}
+
+static void fixture_setup(Fixture* fixture, gconstpointer data) {
+    fixture->root = g_dir_make_tmp("range-wipe-XXXXXX", NULL);
+    g_assert_nonnull(fixture->root);
+    const char* root = fixture->root;
+
+    write_u64(root, "sys/block/sda/size", DISK_SIZE);
+    write_file(root, "sys/block/sda/dev", "8:0\n");
+    // Listed out of order: extents come back sorted by start
+    write_u64(root, "sys/block/sda/sda2/start", SDA2_START);
+    write_u64(root, "sys/block/sda/sda2/size", SDA2_SIZE);
+    write_file(root, "sys/block/sda/sda2/dev", "8:2\n");
+    write_u64(root, "sys/block/sda/sda1/start", SDA1_START);
+    write_u64(root, "sys/block/sda/sda1/size", SDA1_SIZE);
+    write_file(root, "sys/block/sda/sda1/dev", "8:1\n");
+
+    write_u64(root, "sys/block/sdb/size", DISK_SIZE);
+    write_file(root, "sys/block/sdb/dev", "8:16\n");
+
+    write_file(root, "proc/self/mountinfo",
+               "22 1 8:2 / / rw,relatime shared:1 - ext4 /dev/sda2 rw\n"
+               "30 22 8:16 / /mnt rw,relatime shared:2 - xfs /dev/sdb rw\n"
+               "31 22 0:5 / /dev rw,nosuid shared:3 - devtmpfs udev rw\n");
+}
+
+static int remove_entry(const char* path, const struct stat* st, int flag, struct FTW* ftw) {
+    return remove(path);
+}
+
+static void fixture_teardown(Fixture* fixture, gconstpointer data) {
+    nftw(fixture->root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    g_free(fixture->root);
+}
+
+static void test_list_partitions(Fixture* fixture, gconstpointer data) {
+    RangeExtent* extents = NULL;
+    size_t count = 0;
+    g_assert_true(range_wipe_list_partitions(fixture->root, "sda", &extents, &count, NULL));
+    g_assert_cmpuint(count, ==, 2);
+    g_assert_cmpstr(extents[0].name, ==, "sda1");
+    g_assert_cmpuint(extents[0].start_sector, ==, SDA1_START);
+    g_assert_cmpuint(extents[0].size_sectors, ==, SDA1_SIZE);
+    g_assert_cmpstr(extents[1].name, ==, "sda2");
+    g_assert_cmpuint(extents[1].start_sector, ==, SDA2_START);
+    g_free(extents);
+
+    g_assert_true(range_wipe_list_partitions(fixture->root, "sdb", &extents, &count, NULL));
+    g_assert_cmpuint(count, ==, 0);
+    g_free(extents);
+
+    GError* error = NULL;
+    g_assert_false(range_wipe_list_partitions(fixture->root, "sdz", &extents, &count, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+    g_clear_error(&error);
+}
+
+static void assert_invalid(const char* root, const char* disk, uint64_t disk_sectors,
+                           const RangeExtent* extents, size_t count, gint code) {
+    GError* error = NULL;
+    g_assert_false(range_wipe_validate(root, disk, disk_sectors, extents, count, &error));
+    g_assert_error(error, G_IO_ERROR, code);
+    g_clear_error(&error);
+}
+
+static void test_validate_bounds(Fixture* fixture, gconstpointer data) {
+    const char* root = fixture->root;
+    g_assert_true(range_wipe_validate(root, "sda", 0,
+                                      &(RangeExtent){ "sda1", SDA1_START, SDA1_SIZE }, 1, NULL));
+    assert_invalid(root, "sda", 0, NULL, 0, G_IO_ERROR_INVALID_ARGUMENT);
+    assert_invalid(root, "sda", 0, &(RangeExtent){ "", 100, 0 }, 1, G_IO_ERROR_INVALID_ARGUMENT);
+    assert_invalid(root, "sda", 0, &(RangeExtent){ "", DISK_SIZE - 8, 16 }, 1,
+                   G_IO_ERROR_INVALID_ARGUMENT);
+    assert_invalid(root, "sda", 0, &(RangeExtent){ "", 8, G_MAXUINT64 - 4 }, 1,
+                   G_IO_ERROR_INVALID_ARGUMENT);
+    assert_invalid(root, "sdz", 0, &(RangeExtent){ "", 0, 8 }, 1, G_IO_ERROR_NOT_FOUND);
+
+    // Overlap is found whatever order the extents come in
+    RangeExtent overlapping[] = {
+        { "", 4096, 100 },
+        { "", 0, 4097 },
+    };
+    assert_invalid(root, "sda", 0, overlapping, 2, G_IO_ERROR_INVALID_ARGUMENT);
+    overlapping[1].size_sectors = 4096;
+    g_assert_true(range_wipe_validate(root, "sda", 0, overlapping, 2, NULL));
+
+    // An image is sized by the caller and has nothing mounted
+    g_assert_true(range_wipe_validate(root, NULL, 1000, &(RangeExtent){ "", 0, 1000 }, 1, NULL));
+    assert_invalid(root, NULL, 1000, &(RangeExtent){ "", 1, 1000 }, 1, G_IO_ERROR_INVALID_ARGUMENT);
+}
+
+static void test_validate_mounted(Fixture* fixture, gconstpointer data) {
+    const char* root = fixture->root;
+    assert_invalid(root, "sda", 0, &(RangeExtent){ "sda2", SDA2_START, SDA2_SIZE }, 1, G_IO_ERROR_BUSY);
+    // A raw range is refused when it reaches into the mounted partition
+    assert_invalid(root, "sda", 0, &(RangeExtent){ "", SDA2_START - 8, 16 }, 1, G_IO_ERROR_BUSY);
+    g_assert_true(range_wipe_validate(root, "sda", 0, &(RangeExtent){ "", 0, SDA2_START }, 1, NULL));
+    g_assert_true(range_wipe_validate(root, "sda", 0,
+                                      &(RangeExtent){ "", SDA2_START + SDA2_SIZE, 1024 }, 1, NULL));
+    assert_invalid(root, "sdb", 0, &(RangeExtent){ "", 0, 8 }, 1, G_IO_ERROR_BUSY);
+}
+
+// The simulator's backend, recording what range_wipe_execute() opens and
+// writes and corrupting reads of one byte when asked to
+typedef struct {
+    DeviceBackend backend;
+    const DeviceBackend* sim;
+    pthread_mutex_t lock;
+    char opened[8][32];
+    int open_flags[8];
+    guint opens;
+    uint64_t writes[4096];
+    guint write_count;
+    uint64_t rotten_offset;   // G_MAXUINT64 for none
+} Recorder;
+
+static Recorder* recorder;
+
+static int recording_open(const char* path, int flags, void* ctx) {
+    pthread_mutex_lock(&recorder->lock);
+    if (recorder->opens < G_N_ELEMENTS(recorder->opened)) {
+        g_strlcpy(recorder->opened[recorder->opens], path, sizeof(recorder->opened[0]));
+        recorder->open_flags[recorder->opens] = flags;
+        recorder->opens++;
+    }
+    pthread_mutex_unlock(&recorder->lock);
+    return recorder->sim->open_device(path, flags, ctx);
+}
+
+static ssize_t recording_pwrite(int fd, const void* buffer, size_t size, uint64_t offset, void* ctx) {
+    pthread_mutex_lock(&recorder->lock);
+    if (recorder->write_count < G_N_ELEMENTS(recorder->writes)) {
+        recorder->writes[recorder->write_count++] = offset;
+    }
+    pthread_mutex_unlock(&recorder->lock);
+    return recorder->sim->pwrite(fd, buffer, size, offset, ctx);
+}
+
+static ssize_t corrupting_pread(int fd, void* buffer, size_t size, uint64_t offset, void* ctx) {
+    ssize_t n = recorder->sim->pread(fd, buffer, size, offset, ctx);
+    if (n > 0 && recorder->rotten_offset >= offset && recorder->rotten_offset < offset + (uint64_t)n) {
+        ((guint8*)buffer)[recorder->rotten_offset - offset] ^= 0x40;
+    }
+    return n;
+}
+
+static DeviceSim* recorded_sim(Recorder* r) {
+    DeviceSim* sim = device_sim_new(0);
+    memset(r, 0, sizeof(*r));
+    pthread_mutex_init(&r->lock, NULL);
+    r->sim = device_sim_backend(sim);
+    r->backend = *r->sim;
+    r->backend.open_device = recording_open;
+    r->backend.pwrite = recording_pwrite;
+    r->backend.pread = corrupting_pread;
+    r->rotten_offset = G_MAXUINT64;
+    recorder = r;
+    return sim;
+}
+
+static void add_device(DeviceSim* sim, DeviceSimKind kind, const char* name, uint64_t capacity) {
+    DeviceSimSpec spec;
+    device_sim_spec_preset(&spec, kind, name, capacity);
+    g_assert_true(device_sim_add(sim, &spec, NULL));
+}
+
+static uint64_t bytes_written(DeviceSim* sim, const char* name) {
+    DeviceSimStats stats;
+    g_assert_true(device_sim_get_stats(sim, name, &stats));
+    return stats.bytes_written;
+}
+
+static void wipe_options(RangeWipeOptions* options, Recorder* r, const RangeExtent* extents,
+                         size_t count) {
+    range_wipe_default_options(options);
+    options->extents = extents;
+    options->count = count;
+    options->chunk_size = MIB;
+    options->backend = &r->backend;
+}
+
+// Named partitions are each claimed through their own node, leaving the
+// disk itself alone; one raw range makes the disk the only claim
+static void test_named_extents(void) {
+    Recorder r;
+    DeviceSim* sim = recorded_sim(&r);
+    add_device(sim, DEVICE_SIM_SATA_SSD, "sdb", 1 * GIB);
+    add_device(sim, DEVICE_SIM_SATA_SSD, "sdb1", 64 * MIB);
+    add_device(sim, DEVICE_SIM_SATA_SSD, "sdb2", 64 * MIB);
+
+    RangeExtent extents[] = {
+        { "sdb2", SECTORS(128 * MIB), SECTORS(64 * MIB) },
+        { "sdb1", SECTORS(1 * MIB), SECTORS(64 * MIB) },
+    };
+    RangeWipeOptions options;
+    wipe_options(&options, &r, extents, G_N_ELEMENTS(extents));
+    RangeWipeResult result;
+    GError* error = NULL;
+    g_assert_true(range_wipe_execute("/dev/sdb", &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(result.bytes_written, ==, 128 * MIB);
+    g_assert_cmpuint(r.opens, ==, 2);
+    for (guint i = 0; i < r.opens; i++) {
+        g_assert_true(g_str_has_prefix(r.opened[i], "/dev/sdb"));
+        g_assert_cmpstr(r.opened[i], !=, "/dev/sdb");
+        g_assert_true(r.open_flags[i] & O_EXCL);
+    }
+    g_assert_cmpuint(bytes_written(sim, "sdb1"), ==, 64 * MIB);
+    g_assert_cmpuint(bytes_written(sim, "sdb2"), ==, 64 * MIB);
+    g_assert_cmpuint(bytes_written(sim, "sdb"), ==, 0);
+
+    RangeExtent mixed[] = {
+        { "sdb1", SECTORS(1 * MIB), SECTORS(64 * MIB) },
+        { "", SECTORS(512 * MIB), SECTORS(16 * MIB) },
+    };
+    r.opens = 0;
+    wipe_options(&options, &r, mixed, G_N_ELEMENTS(mixed));
+    g_assert_true(range_wipe_execute("/dev/sdb", &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(r.opens, ==, 1);
+    g_assert_cmpstr(r.opened[0], ==, "/dev/sdb");
+    g_assert_true(r.open_flags[0] & O_EXCL);
+    g_assert_cmpuint(bytes_written(sim, "sdb"), ==, 80 * MIB);
+    g_assert_cmpuint(bytes_written(sim, "sdb1"), ==, 64 * MIB);
+
+    // A partition that cannot be claimed fails before anything is written
+    device_sim_set_present(sim, "sdb2", FALSE);
+    wipe_options(&options, &r, extents, G_N_ELEMENTS(extents));
+    g_assert_false(range_wipe_execute("/dev/sdb", &options, &result, &error));
+    g_assert_nonnull(error);
+    g_clear_error(&error);
+    g_assert_cmpuint(result.bytes_written, ==, 0);
+
+    device_sim_free(sim);
+    pthread_mutex_destroy(&r.lock);
+}
+
+// A disk takes its ranges one at a time in LBA order through a single
+// stream, whatever order and parallelism were asked for; flash does not
+static void test_rotational_order(void) {
+    Recorder r;
+    DeviceSim* sim = recorded_sim(&r);
+    add_device(sim, DEVICE_SIM_HDD, "sda", 1 * GIB);
+    add_device(sim, DEVICE_SIM_SATA_SSD, "sdb", 1 * GIB);
+
+    RangeExtent extents[] = {
+        { "", SECTORS(512 * MIB), SECTORS(8 * MIB) },
+        { "", 0, SECTORS(8 * MIB) },
+        { "", SECTORS(256 * MIB), SECTORS(8 * MIB) },
+    };
+    RangeWipeOptions options;
+    wipe_options(&options, &r, extents, G_N_ELEMENTS(extents));
+    options.max_parallel_ranges = 4;
+    options.workers_per_range = 4;
+    RangeWipeResult result;
+    GError* error = NULL;
+    g_assert_true(range_wipe_execute("/dev/sda", &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_true(result.sequential);
+    g_assert_cmpuint(result.bytes_written, ==, 24 * MIB);
+    g_assert_cmpuint(r.write_count, ==, 24);
+    for (guint i = 1; i < r.write_count; i++) {
+        g_assert_cmpuint(r.writes[i], >, r.writes[i - 1]);
+    }
+    DeviceSimStats stats;
+    g_assert_true(device_sim_get_stats(sim, "sda", &stats));
+    g_assert_cmpuint(stats.max_queue_depth, ==, 1);
+
+    g_assert_true(range_wipe_execute("/dev/sdb", &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_false(result.sequential);
+    g_assert_cmpuint(bytes_written(sim, "sdb"), ==, 24 * MIB);
+
+    device_sim_free(sim);
+    pthread_mutex_destroy(&r.lock);
+}
+
+// The read-back catches one flipped byte in one range and reports it as a
+// failed wipe
+static void test_verify_mismatch(void) {
+    Recorder r;
+    DeviceSim* sim = recorded_sim(&r);
+    add_device(sim, DEVICE_SIM_NVME, "nvme0n1", 1 * GIB);
+
+    RangeExtent extents[] = {
+        { "", 0, SECTORS(16 * MIB) },
+        { "", SECTORS(64 * MIB), SECTORS(16 * MIB) },
+    };
+    RangeWipeOptions options;
+    wipe_options(&options, &r, extents, G_N_ELEMENTS(extents));
+    options.verify = TRUE;
+    RangeWipeResult result;
+    GError* error = NULL;
+    g_assert_true(range_wipe_execute("/dev/nvme0n1", &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(result.bytes_verified, ==, 32 * MIB);
+    g_assert_cmpuint(result.verify_mismatches, ==, 0);
+
+    r.rotten_offset = 64 * MIB + 5 * MIB + 100;
+    g_assert_false(range_wipe_execute("/dev/nvme0n1", &options, &result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_FAILED);
+    g_clear_error(&error);
+    g_assert_cmpuint(result.verify_mismatches, ==, 1);
+    g_assert_cmpuint(result.bytes_written, ==, 32 * MIB);
+
+    device_sim_free(sim);
+    pthread_mutex_destroy(&r.lock);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add("/range_wipe/list_partitions", Fixture, NULL, fixture_setup, test_list_partitions,
+               fixture_teardown);
+    g_test_add("/range_wipe/validate_bounds", Fixture, NULL, fixture_setup, test_validate_bounds,
+               fixture_teardown);
+    g_test_add("/range_wipe/validate_mounted", Fixture, NULL, fixture_setup, test_validate_mounted,
+               fixture_teardown);
+    g_test_add_func("/range_wipe/named_extents", test_named_extents);
+    g_test_add_func("/range_wipe/rotational_order", test_rotational_order);
+    g_test_add_func("/range_wipe/verify_mismatch", test_verify_mismatch);
+    return g_test_run();
+}
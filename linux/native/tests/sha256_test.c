@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+#include "../sha256.h"
+#include <glib.h>
+#include <string.h>
+
+#define BENCH_SIZE (64 * 1024 * 1024)
+
+// Digests of pattern() prefixes, lengths chosen around the 55/56-byte
+// padding split and the 64-byte block edges
+static const struct {
+    size_t length;
+    const char* digest;
+} vectors[] = {
+    {0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+    {1, "6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d"},
+    {3, "c3623df2fb150e8acc6f7c8031751588a1f79ca0b6bfb35af1f9f46d04242593"},
+    {55, "87a26dae81d37e91b25fae7899274e680a048ea44f82b18397b6585c2615c6b7"},
+    {56, "cd6756cdcd1cf71057f210633c6d13fce8ac4b9f97690b42c0aa28d721e2add5"},
+    {57, "b094b6fb0f9735123d38ccb6df5796f2ddc2ed4035a7be46fc669d1af4c72f76"},
+    {63, "7be910d529434dd8a31078d25667457b6040c888d64904b25d3ca95f1eae6b16"},
+    {64, "51e945469a3948debf6fc154e954fd6623ebbc21da2a3ee5e3ee0264e2cef6f2"},
+    {65, "3c3e113ec16f54924b2c563c7304d9e10ed4d9b54f266fecfbdc63978a14c9b4"},
+    {119, "c9128add91b549276c05fa0088f24600737e4a1eedf505afcc5977acbce20d17"},
+    {120, "05bb0826068da152ddc644acf1ebc99edf92eaf9bc41709d94d1f0a8a456764a"},
+    {127, "17999376576db9d8424b7e43f9d2d36e43431be6900f01c6a4e6137959846653"},
+    {128, "775ad69e0e164f428bec38443d0b19b3cef04a5304446e1a5e804e256c93a66a"},
+    {129, "99a0f1e6a2dedc5da9666076efc191eaeed2a4845bff9ee1ba02398d711a6653"},
+    {1000, "1fc5d253afbcfa513e578376426755539827de93ebb93944a6966de00daa8c2b"},
+    {4103, "fe5a75fa829badb0bd5b25823306e66e4fbcad6fb442560948678900f1b71c35"},
+};
+
+// Bytes that do not repeat within a block: the top byte of i times the
+// golden-ratio constant
+static guint8* pattern(size_t length) {
+    guint8* data = g_malloc(length + 1);
+    for (size_t i = 0; i < length; i++) data[i] = (guint8)(((uint32_t)i * 2654435761u) >> 24);
+    return data;
+}
+
+static void assert_digest(const uint8_t digest[SHA256_DIGEST_SIZE], const char* expected) {
+    char hex[2 * SHA256_DIGEST_SIZE + 1];
+    sha256_to_hex(digest, hex);
+    g_assert_cmpstr(hex, ==, expected);
+}
+
+// Built with SHA256_GENERIC_ONLY the same vectors run through the portable
+// compression function, whatever the CPU has
+static void test_dispatch(void) {
+#ifdef SHA256_GENERIC_ONLY
+    g_assert_false(sha256_accelerated());
+#endif
+    g_test_message("SHA instructions: %s", sha256_accelerated() ? "yes" : "no");
+}
+
+static void test_vectors(void) {
+    guint8* data = pattern(4103);
+    for (guint i = 0; i < G_N_ELEMENTS(vectors); i++) {
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        sha256_digest(data, vectors[i].length, digest);
+        assert_digest(digest, vectors[i].digest);
+    }
+    g_free(data);
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256_digest("abc", 3, digest);
+    assert_digest(digest, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    // FIPS 180-2 appendix B.3, a million 'a' fed 1000 bytes at a time
+    char block[1000];
+    memset(block, 'a', sizeof(block));
+    Sha256Context ctx;
+    sha256_init(&ctx);
+    for (guint i = 0; i < 1000; i++) sha256_update(&ctx, block, sizeof(block));
+    sha256_final(&ctx, digest);
+    assert_digest(digest, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+// Updates split at every offset across and between blocks, so the buffered
+// head, the run of whole blocks and the tail all get exercised
+static void test_streaming(void) {
+    guint8* data = pattern(4103);
+    static const size_t chunks[] = {1, 63, 64, 65, 7, 128, 55, 200};
+    for (guint i = 0; i < G_N_ELEMENTS(vectors); i++) {
+        for (guint start = 0; start < G_N_ELEMENTS(chunks); start++) {
+            Sha256Context ctx;
+            sha256_init(&ctx);
+            size_t offset = 0;
+            for (guint c = start; offset < vectors[i].length; c++) {
+                size_t take = MIN(chunks[c % G_N_ELEMENTS(chunks)], vectors[i].length - offset);
+                sha256_update(&ctx, data + offset, take);
+                offset += take;
+            }
+            uint8_t digest[SHA256_DIGEST_SIZE];
+            sha256_final(&ctx, digest);
+            assert_digest(digest, vectors[i].digest);
+        }
+    }
+    g_free(data);
+}
+
+// Throughput of the compression the CPU picked; run with -m perf
+static void test_benchmark(void) {
+    guint8* data = pattern(BENCH_SIZE);
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    g_test_timer_start();
+    sha256_digest(data, BENCH_SIZE, digest);
+    double elapsed = g_test_timer_elapsed();
+    g_test_maximized_result(BENCH_SIZE / elapsed / 1e6, "sha256 (%s): %.0f MB/s",
+                            sha256_accelerated() ? "SHA-NI" : "generic", BENCH_SIZE / elapsed / 1e6);
+    g_free(data);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/sha256/dispatch", test_dispatch);
+    g_test_add_func("/sha256/vectors", test_vectors);
+    g_test_add_func("/sha256/streaming", test_streaming);
+    if (g_test_perf()) {
+        g_test_add_func("/sha256/benchmark", test_benchmark);
+    }
+    return g_test_run();
+}
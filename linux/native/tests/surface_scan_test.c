@@ -0,0 +1,236 @@
+#define _GNU_SOURCE
+#include "../surface_scan.h"
+#include <errno.h>
+#include <glib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MIB (1024ull * 1024)
+#define BLOCK 512
+#define IMAGE_SIZE (32 * MIB)
+#define MAX_FAULTS 8
+
+// A regular file read through a backend that fails or delays chosen blocks,
+// standing in for a drive with pending sectors
+typedef struct {
+    DeviceBackend backend;
+    // Requests touching one of these [offset, offset + length) fail with EIO
+    struct { uint64_t offset; uint64_t length; } bad[MAX_FAULTS];
+    guint bad_count;
+    // Requests reaching past this offset fail with ENODEV; 0 = never
+    uint64_t gone_offset;
+    // Requests touching [slow_offset, slow_offset + BLOCK) take slow_us longer
+    uint64_t slow_offset;
+    guint slow_us;
+    gint reads;
+} FaultyImage;
+
+static int image_size(int fd, uint64_t* size, void* ctx) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) return -1;
+    *size = (uint64_t)st.st_size;
+    return 0;
+}
+
+static ssize_t image_pread(int fd, void* buffer, size_t size, uint64_t offset, void* ctx) {
+    FaultyImage* image = ctx;
+    __atomic_add_fetch(&image->reads, 1, __ATOMIC_RELAXED);
+    uint64_t end = offset + size;
+    for (guint i = 0; i < image->bad_count; i++) {
+        if (offset < image->bad[i].offset + image->bad[i].length && image->bad[i].offset < end) {
+            errno = EIO;
+            return -1;
+        }
+    }
+    if (image->gone_offset && end > image->gone_offset) {
+        errno = ENODEV;
+        return -1;
+    }
+    if (image->slow_us && offset <= image->slow_offset && image->slow_offset < end) {
+        g_usleep(image->slow_us);
+    }
+    return pread(fd, buffer, size, (off_t)offset);
+}
+
+static void faulty_image_init(FaultyImage* image) {
+    memset(image, 0, sizeof(*image));
+    image->backend = *device_backend_linux();
+    image->backend.device_size = image_size;
+    image->backend.pread = image_pread;
+    image->backend.ctx = image;
+}
+
+static void add_bad(FaultyImage* image, uint64_t offset, uint64_t length) {
+    g_assert_cmpuint(image->bad_count, <, MAX_FAULTS);
+    image->bad[image->bad_count].offset = offset;
+    image->bad[image->bad_count].length = length;
+    image->bad_count++;
+}
+
+static int create_image(char** path) {
+    GError* error = NULL;
+    int fd = g_file_open_tmp("surface-XXXXXX.img", path, &error);
+    g_assert_no_error(error);
+    uint8_t* buffer = g_malloc(MIB);
+    for (uint64_t offset = 0; offset < IMAGE_SIZE; offset += MIB) {
+        memset(buffer, (int)(offset / MIB), MIB);
+        g_assert_cmpint(pwrite(fd, buffer, MIB, (off_t)offset), ==, (ssize_t)MIB);
+    }
+    g_free(buffer);
+    return fd;
+}
+
+static void destroy_image(int fd, char* path) {
+    close(fd);
+    unlink(path);
+    g_free(path);
+}
+
+// One cell per 1 MiB chunk, four regions of 8 MiB each
+static void scan_options(SurfaceScanOptions* options, FaultyImage* image) {
+    surface_scan_default_options(options);
+    options->chunk_size = MIB;
+    options->block_size = BLOCK;
+    options->regions = 4;
+    options->cells = IMAGE_SIZE / MIB;
+    options->backend = &image->backend;
+}
+
+static gboolean cell_is_bad(const SurfaceScanResult* result, guint cell) {
+    return result->heatmap[cell] == SURFACE_SCAN_CELL_UNREADABLE;
+}
+
+static void test_clean(void) {
+    char* path;
+    int fd = create_image(&path);
+    FaultyImage image;
+    faulty_image_init(&image);
+    SurfaceScanOptions options;
+    scan_options(&options, &image);
+
+    SurfaceScanResult result;
+    GError* error = NULL;
+    g_assert_true(surface_scan_run(fd, &options, &result, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(result.length, ==, IMAGE_SIZE);
+    g_assert_cmpuint(result.bytes_read, ==, IMAGE_SIZE);
+    g_assert_cmpuint(result.region_count, ==, 4);
+    g_assert_cmpuint(result.bad_count, ==, 0);
+    g_assert_cmpuint(result.bad_sectors, ==, 0);
+    g_assert_cmpint(image.reads, ==, IMAGE_SIZE / MIB);
+    g_assert_cmpuint(result.cells, ==, IMAGE_SIZE / MIB);
+    for (guint i = 0; i < result.cells; i++) {
+        g_assert_cmpuint(result.heatmap[i], >=, 1);
+        g_assert_cmpuint(result.heatmap[i], <=, SURFACE_SCAN_HISTOGRAM_BUCKETS);
+    }
+
+    surface_scan_result_clear(&result);
+    destroy_image(fd, path);
+}
+
+// Unreadable blocks are isolated by bisection and merged across chunk and
+// region boundaries; the rest of each failing chunk still counts as read
+static void test_bad_blocks(void) {
+    char* path;
+    int fd = create_image(&path);
+    FaultyImage image;
+    faulty_image_init(&image);
+    add_bad(&image, 5 * MIB + 4096, BLOCK);
+    add_bad(&image, 16 * MIB - BLOCK, 2 * BLOCK);      // region 1 into region 2
+    add_bad(&image, 20 * MIB - BLOCK, 3 * BLOCK);      // across a chunk boundary
+    SurfaceScanOptions options;
+    scan_options(&options, &image);
+
+    SurfaceScanResult result;
+    GError* error = NULL;
+    g_assert_true(surface_scan_run(fd, &options, &result, &error));
+    g_assert_no_error(error);
+
+    g_assert_cmpuint(result.bad_sectors, ==, 6);
+    g_assert_cmpuint(result.bytes_read, ==, IMAGE_SIZE - 6 * BLOCK);
+    g_assert_cmpuint(result.bad_count, ==, 3);
+    g_assert_cmpuint(result.bad[0].offset, ==, 5 * MIB + 4096);
+    g_assert_cmpuint(result.bad[0].length, ==, BLOCK);
+    g_assert_cmpuint(result.bad[1].offset, ==, 16 * MIB - BLOCK);
+    g_assert_cmpuint(result.bad[1].length, ==, 2 * BLOCK);
+    g_assert_cmpuint(result.bad[2].offset, ==, 20 * MIB - BLOCK);
+    g_assert_cmpuint(result.bad[2].length, ==, 3 * BLOCK);
+    g_assert_cmpuint(result.regions[1].bad_sectors, ==, 1);
+    g_assert_cmpuint(result.regions[2].bad_sectors, ==, 3 + 1);
+
+    for (guint i = 0; i < result.cells; i++) {
+        gboolean bad = i == 5 || i == 15 || i == 16 || i == 19 || i == 20;
+        g_assert_cmpint(cell_is_bad(&result, i), ==, bad);
+    }
+
+    surface_scan_result_clear(&result);
+    destroy_image(fd, path);
+}
+
+// A device that stops answering ends the scan instead of being bisected
+static void test_device_gone(void) {
+    char* path;
+    int fd = create_image(&path);
+    FaultyImage image;
+    faulty_image_init(&image);
+    image.gone_offset = 12 * MIB;
+    SurfaceScanOptions options;
+    scan_options(&options, &image);
+    options.regions = 1;
+
+    SurfaceScanResult result;
+    GError* error = NULL;
+    g_assert_false(surface_scan_run(fd, &options, &result, &error));
+    g_assert_nonnull(error);
+    g_assert_nonnull(strstr(error->message, "offset 12582912"));
+    g_clear_error(&error);
+    g_assert_cmpuint(result.bytes_read, ==, 12 * MIB);
+    g_assert_cmpuint(result.bad_sectors, ==, 0);
+    g_assert_cmpint(image.reads, ==, 13);
+
+    surface_scan_result_clear(&result);
+    destroy_image(fd, path);
+}
+
+static void test_slow_chunk(void) {
+    char* path;
+    int fd = create_image(&path);
+    FaultyImage image;
+    faulty_image_init(&image);
+    image.slow_offset = 7 * MIB + 8192;
+    image.slow_us = 50 * 1000;
+    SurfaceScanOptions options;
+    scan_options(&options, &image);
+    options.slow_threshold_us = 40 * 1000;
+
+    SurfaceScanResult result;
+    GError* error = NULL;
+    g_assert_true(surface_scan_run(fd, &options, &result, &error));
+    g_assert_no_error(error);
+    // Other chunks may be slow too on a loaded machine; the delayed one must be
+    g_assert_cmpuint(result.slow_reads, >=, 1);
+    g_assert_cmpuint(result.slow_count, ==, result.slow_reads);
+    gboolean found = FALSE;
+    for (guint i = 0; i < result.slow_count; i++) {
+        if (result.slow[i].offset == 7 * MIB) {
+            g_assert_cmpuint(result.slow[i].length, ==, MIB);
+            g_assert_cmpuint(result.slow[i].latency_us, >=, image.slow_us);
+            found = TRUE;
+        }
+    }
+    g_assert_true(found);
+    g_assert_cmpuint(result.regions[0].max_latency_us, >=, image.slow_us);
+
+    surface_scan_result_clear(&result);
+    destroy_image(fd, path);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/surface_scan/clean", test_clean);
+    g_test_add_func("/surface_scan/bad_blocks", test_bad_blocks);
+    g_test_add_func("/surface_scan/device_gone", test_device_gone);
+    g_test_add_func("/surface_scan/slow_chunk", test_slow_chunk);
+    return g_test_run();
+}
@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include "../sysfs_cache.h"
+#include <fcntl.h>
+#include <ftw.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_DEVICES 1000
+
+// Attributes device enumeration reads for every disk
+static const char* enumeration_attrs[] = {
+    "size", "stat", "queue/rotational", "queue/logical_block_size", "removable", "ro",
+};
+
+typedef struct {
+    char* root;
+} Fixture;
+
+// Writes in place, as sysfs regenerates a value behind an open descriptor
+static void write_attr(const char* root, const char* device, const char* attr, const char* value) {
+    char* path = g_strdup_printf("%s/%s/%s", root, device, attr);
+    char* dir = g_path_get_dirname(path);
+    g_assert_cmpint(g_mkdir_with_parents(dir, 0755), ==, 0);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    g_assert_cmpint(fd, >=, 0);
+    g_assert_cmpint(write(fd, value, strlen(value)), ==, (gssize)strlen(value));
+    close(fd);
+    g_free(dir);
+    g_free(path);
+}
+
+static void add_device(const char* root, const char* device, uint64_t sectors) {
+    char value[64];
+    snprintf(value, sizeof(value), "%llu\n", (unsigned long long)sectors);
+    write_attr(root, device, "size", value);
+    write_attr(root, device, "stat",
+               "  224813    71291 12440474   118210   161742   120877 11356208   592301        0   206324   710512\n");
+    write_attr(root, device, "queue/rotational", "0\n");
+    write_attr(root, device, "queue/logical_block_size", "512\n");
+    write_attr(root, device, "removable", "0\n");
+    write_attr(root, device, "ro", "0\n");
+}
+
+static int remove_entry(const char* path, const struct stat* st, int flag, struct FTW* ftw) {
+    return remove(path);
+}
+
+static void remove_tree(const char* path) {
+    nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static void fixture_setup(Fixture* fixture, gconstpointer data) {
+    fixture->root = g_dir_make_tmp("sysfs-XXXXXX", NULL);
+    g_assert_nonnull(fixture->root);
+    add_device(fixture->root, "sda", 1953525168);
+    add_device(fixture->root, "nvme0n1", 1000215216);
+}
+
+static void fixture_teardown(Fixture* fixture, gconstpointer data) {
+    remove_tree(fixture->root);
+    g_free(fixture->root);
+}
+
+static void test_read(Fixture* fixture, gconstpointer data) {
+    SysfsCache* cache = sysfs_cache_new(fixture->root);
+    g_assert_nonnull(cache);
+
+    char buffer[128];
+    g_assert_cmpint(sysfs_cache_read(cache, "sda", "size", buffer, sizeof(buffer)), ==, 10);
+    g_assert_cmpstr(buffer, ==, "1953525168");
+    uint64_t value;
+    g_assert_true(sysfs_cache_read_u64(cache, "nvme0n1", "queue/logical_block_size", &value));
+    g_assert_cmpuint(value, ==, 512);
+
+    // A value longer than the buffer is cut, still terminated
+    g_assert_cmpint(sysfs_cache_read(cache, "sda", "stat", buffer, 8), ==, 7);
+    g_assert_cmpstr(buffer, ==, "  22481");
+
+    g_assert_cmpint(sysfs_cache_read(cache, "sda", "queue/nr_requests", buffer, sizeof(buffer)), ==, -1);
+    g_assert_cmpint(sysfs_cache_read(cache, "sdz", "size", buffer, sizeof(buffer)), ==, -1);
+    g_assert_false(sysfs_cache_read_u64(cache, "sda", "missing", &value));
+    sysfs_cache_free(cache);
+
+    g_assert_null(sysfs_cache_new("/nonexistent/sys/block"));
+}
+
+// Held descriptors see the value as it is now; a device that was removed
+// and added again under the same name is read from its new node
+static void test_refresh(Fixture* fixture, gconstpointer data) {
+    SysfsCache* cache = sysfs_cache_new(fixture->root);
+    uint64_t value;
+    g_assert_true(sysfs_cache_read_u64(cache, "sda", "size", &value));
+    g_assert_cmpuint(value, ==, 1953525168);
+    write_attr(fixture->root, "sda", "size", "0\n");
+    g_assert_true(sysfs_cache_read_u64(cache, "sda", "size", &value));
+    g_assert_cmpuint(value, ==, 0);
+
+    g_assert_true(sysfs_cache_read_u64(cache, "sda", "removable", &value));
+    g_assert_cmpuint(value, ==, 0);
+    char* dir = g_build_filename(fixture->root, "sda", NULL);
+    remove_tree(dir);
+    g_free(dir);
+    add_device(fixture->root, "sda", 7814037168);
+    write_attr(fixture->root, "sda", "removable", "1\n");
+    g_assert_true(sysfs_cache_read_u64(cache, "sda", "removable", &value));
+    g_assert_cmpuint(value, ==, 1);
+
+    // Hot attributes of the new node are picked up once forgotten
+    sysfs_cache_forget(cache, "sda");
+    g_assert_true(sysfs_cache_read_u64(cache, "sda", "size", &value));
+    g_assert_cmpuint(value, ==, 7814037168);
+    sysfs_cache_free(cache);
+}
+
+static void test_parse(void) {
+    uint64_t value;
+    const char* end;
+    g_assert_true(sysfs_parse_u64("  \t42 17", &end, &value));
+    g_assert_cmpuint(value, ==, 42);
+    g_assert_cmpstr(end, ==, " 17");
+    g_assert_true(sysfs_parse_u64("18446744073709551615", NULL, &value));
+    g_assert_cmpuint(value, ==, G_MAXUINT64);
+    g_assert_false(sysfs_parse_u64("", NULL, &value));
+    g_assert_false(sysfs_parse_u64("-1", NULL, &value));
+    g_assert_false(sysfs_parse_u64("none", NULL, &value));
+}
+
+static char* make_tree(guint devices) {
+    char* root = g_dir_make_tmp("sysfs-bench-XXXXXX", NULL);
+    g_assert_nonnull(root);
+    for (guint i = 0; i < devices; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "sd%u", i);
+        add_device(root, name, 1953525168 + i);
+    }
+    return root;
+}
+
+// The reader the cache replaced: fopen, fgets into a fresh allocation, fclose
+static char* read_sysfs_attr(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return NULL;
+    char* buffer = malloc(256);
+    if (!buffer) {
+        fclose(f);
+        return NULL;
+    }
+    if (fgets(buffer, 256, f) == NULL) {
+        free(buffer);
+        fclose(f);
+        return NULL;
+    }
+    size_t len = strlen(buffer);
+    if (len > 0 && buffer[len - 1] == '\n') buffer[len - 1] = '\0';
+    fclose(f);
+    return buffer;
+}
+
+// Every enumeration attribute of every device, @rounds times over; the
+// cache keeps descriptors for as many devices as its budget allows and
+// reads the rest transiently
+static void bench_tree(const char* root, guint devices, guint rounds) {
+    guint reads = devices * G_N_ELEMENTS(enumeration_attrs) * rounds;
+    uint64_t sum = 0;
+
+    g_test_timer_start();
+    for (guint r = 0; r < rounds; r++) {
+        for (guint i = 0; i < devices; i++) {
+            for (guint a = 0; a < G_N_ELEMENTS(enumeration_attrs); a++) {
+                char path[512];
+                snprintf(path, sizeof(path), "%s/sd%u/%s", root, i, enumeration_attrs[a]);
+                char* value = read_sysfs_attr(path);
+                g_assert_nonnull(value);
+                sum += strtoull(value, NULL, 10);
+                free(value);
+            }
+        }
+    }
+    double baseline_ns = g_test_timer_elapsed() * 1e9 / reads;
+
+    SysfsCache* cache = sysfs_cache_new(root);
+    g_test_timer_start();
+    for (guint r = 0; r < rounds; r++) {
+        for (guint i = 0; i < devices; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "sd%u", i);
+            for (guint a = 0; a < G_N_ELEMENTS(enumeration_attrs); a++) {
+                uint64_t value;
+                g_assert_true(sysfs_cache_read_u64(cache, name, enumeration_attrs[a], &value));
+                sum -= value;
+            }
+        }
+    }
+    double cache_ns = g_test_timer_elapsed() * 1e9 / reads;
+    sysfs_cache_free(cache);
+
+    g_assert_cmpuint(sum, ==, 0);
+    g_test_minimized_result(cache_ns, "%u devices: read_sysfs_attr %.0f ns, sysfs_cache %.0f ns per read",
+                            devices, baseline_ns, cache_ns);
+}
+
+// Enumeration cost against a fake tree of BENCH_DEVICES disks and one that
+// fits the descriptor budget; run with -m perf
+static void test_enumeration_benchmark(void) {
+    char* root = make_tree(BENCH_DEVICES);
+    bench_tree(root, BENCH_DEVICES, 5);
+    bench_tree(root, 60, 50);
+    remove_tree(root);
+    g_free(root);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add("/sysfs_cache/read", Fixture, NULL, fixture_setup, test_read, fixture_teardown);
+    g_test_add("/sysfs_cache/refresh", Fixture, NULL, fixture_setup, test_refresh, fixture_teardown);
+    g_test_add_func("/sysfs_cache/parse", test_parse);
+    if (g_test_perf()) {
+        g_test_add_func("/sysfs_cache/enumeration_benchmark", test_enumeration_benchmark);
+    }
+    return g_test_run();
+}
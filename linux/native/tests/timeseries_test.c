@@ -0,0 +1,244 @@
+#define _GNU_SOURCE
+#include "../timeseries.h"
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+
+#define DEVICES 300
+#define METRICS 6
+#define BASE_MS 1700000000000ll
+
+static const char* metric_names[METRICS] = {
+    "readBytesPerSec", "writeBytesPerSec", "readIops", "writeIops", "utilization", "usedBytes",
+};
+
+// Deterministic noise, so failures and timings reproduce
+static double noise(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (double)(*state >> 11) / (double)(1ull << 53);
+}
+
+static const TimeSeriesBucket* bucket_at(GArray* buckets, guint i) {
+    return &g_array_index(buckets, TimeSeriesBucket, i);
+}
+
+// Lossless values come back bit for bit, through idle stretches, sampler
+// jitter, gaps too long for the delta buckets and block boundaries
+static void test_round_trip(void) {
+    TimeSeriesOptions options;
+    time_series_default_options(&options);
+    options.mantissa_bits = 52;
+    options.block_bytes = 128;
+    options.retention_ms = 24ll * 60 * 60 * 1000;
+    TimeSeriesStore* store = time_series_store_new(&options);
+
+    const guint count = 5000;
+    gint64* slots = g_new(gint64, count);
+    double* values = g_new(double, count);
+    uint64_t state = 1;
+    gint64 t = BASE_MS;
+    guint kept = 0;
+    for (guint i = 0; i < count; i++) {
+        t += i % 500 == 0 ? 3600 * 1000 : 1000 + (i % 7 == 0 ? (gint64)(noise(&state) * 400) - 200 : 0);
+        double value = (i / 100) % 4 == 0 ? 0.0 : noise(&state) * 1e9 - 1e8;
+        // Jitter can round two samples into one slot; the later one is dropped
+        gint64 slot = (t + options.resolution_ms / 2) / options.resolution_ms * options.resolution_ms;
+        gboolean expected = kept == 0 || slot > slots[kept - 1];
+        g_assert_cmpint(time_series_store_append(store, "sda", "readBytesPerSec", t, value), ==, expected);
+        if (expected) {
+            slots[kept] = slot;
+            values[kept] = value;
+            kept++;
+        }
+    }
+    g_assert_cmpuint(kept, >, count * 9 / 10);
+
+    GArray* buckets = time_series_store_query(store, "sda", "readBytesPerSec", BASE_MS,
+                                              slots[kept - 1], options.resolution_ms);
+    g_assert_nonnull(buckets);
+    g_assert_cmpuint(buckets->len, ==, kept);
+    for (guint i = 0; i < kept; i++) {
+        const TimeSeriesBucket* bucket = bucket_at(buckets, i);
+        g_assert_cmpint(bucket->start_ms, ==, slots[i]);
+        g_assert_cmpuint(bucket->count, ==, 1);
+        g_assert_true(bucket->min == values[i]);
+    }
+    g_array_free(buckets, TRUE);
+
+    // A sample in a slot that is already taken is dropped
+    g_assert_false(time_series_store_append(store, "sda", "readBytesPerSec", t, 1.0));
+    g_assert_null(time_series_store_query(store, "sda", "writeBytesPerSec", BASE_MS, t, 1000));
+
+    g_free(slots);
+    g_free(values);
+    time_series_store_free(store);
+}
+
+// The default mantissa keeps the documented relative error
+static void test_quantized(void) {
+    TimeSeriesStore* store = time_series_store_new(NULL);
+    uint64_t state = 7;
+    const guint count = 2000;
+    double* values = g_new(double, count);
+    for (guint i = 0; i < count; i++) {
+        values[i] = 1.0 + noise(&state) * 1e10;
+        g_assert_true(time_series_store_append(store, "nvme0n1", "readIops", BASE_MS + 1000ll * i,
+                                               values[i]));
+    }
+
+    GArray* buckets = time_series_store_query(store, "nvme0n1", "readIops", BASE_MS,
+                                              BASE_MS + 1000ll * count, 1000);
+    g_assert_cmpuint(buckets->len, ==, count);
+    for (guint i = 0; i < count; i++) {
+        g_assert_cmpfloat(fabs(bucket_at(buckets, i)->avg - values[i]) / values[i], <, 4e-6);
+    }
+    g_array_free(buckets, TRUE);
+    g_free(values);
+    time_series_store_free(store);
+}
+
+// Six hours fit TIME_SERIES_MAX_POINTS buckets with min, max and average
+// reduced over each one
+static void test_buckets(void) {
+    TimeSeriesStore* store = time_series_store_new(NULL);
+    const gint64 span_ms = TIME_SERIES_RETENTION_MS;
+    for (gint64 t = 0; t < span_ms; t += 1000) {
+        g_assert_true(time_series_store_append(store, "sda", "utilization", BASE_MS + t,
+                                               (double)(t / 1000 % 24)));
+    }
+
+    gint64 bucket_ms = time_series_store_bucket_ms(store, BASE_MS, BASE_MS + span_ms - 1,
+                                                   TIME_SERIES_MAX_POINTS);
+    g_assert_cmpint(bucket_ms, ==, span_ms / TIME_SERIES_MAX_POINTS);
+    GArray* buckets = time_series_store_query(store, "sda", "utilization", BASE_MS,
+                                              BASE_MS + span_ms - 1, bucket_ms);
+    g_assert_cmpuint(buckets->len, ==, TIME_SERIES_MAX_POINTS);
+    for (guint i = 0; i < buckets->len; i++) {
+        const TimeSeriesBucket* bucket = bucket_at(buckets, i);
+        g_assert_cmpint(bucket->start_ms, ==, BASE_MS + i * bucket_ms);
+        g_assert_cmpuint(bucket->count, ==, bucket_ms / 1000);
+        // Every bucket holds whole periods of the 0..23 ramp
+        g_assert_cmpfloat(bucket->min, ==, 0);
+        g_assert_cmpfloat(bucket->max, ==, 23);
+        g_assert_cmpfloat(fabs(bucket->avg - 11.5), <, 1e-3);
+    }
+    g_array_free(buckets, TRUE);
+
+    time_series_store_expire(store, BASE_MS + span_ms + TIME_SERIES_RETENTION_MS + 60 * 1000);
+    TimeSeriesStats stats;
+    time_series_store_stats(store, &stats);
+    g_assert_cmpuint(stats.devices, ==, 0);
+    g_assert_cmpuint(stats.samples, ==, 0);
+    time_series_store_free(store);
+}
+
+static char (*device_names(void))[16] {
+    static char names[DEVICES][16];
+    for (guint d = 0; d < DEVICES; d++) snprintf(names[d], sizeof(names[d]), "sd%u", d);
+    return names;
+}
+
+// One sampler tick: every metric of every device, a tenth of them busy
+static void append_tick(TimeSeriesStore* store, char names[][16], guint tick, uint64_t* state,
+                        double* used) {
+    gint64 t = BASE_MS + 1000ll * tick + (gint64)(noise(state) * 5);
+    for (guint d = 0; d < DEVICES; d++) {
+        gboolean busy = d < DEVICES / 10;
+        double read = busy ? 5e8 * (1 + 0.3 * sin(tick / 60.0)) * (0.9 + 0.2 * noise(state)) : 0;
+        double write = busy ? 2e8 * (0.9 + 0.2 * noise(state)) : 0;
+        if (busy && tick % 30 == 0) used[d] += write * 30;
+        double values[METRICS] = {
+            read, write, read / 131072, write / 131072,
+            busy ? 80 + 20 * noise(state) : 0, 1e11 + used[d],
+        };
+        for (guint m = 0; m < METRICS; m++) {
+            time_series_store_append(store, names[d], metric_names[m], t, values[m]);
+        }
+    }
+}
+
+// Ingest cost per sample and memory per sample for DEVICES disks sampled
+// every second for an hour; run with -m perf
+static void test_ingest_benchmark(void) {
+    char (*names)[16] = device_names();
+    double* used = g_new0(double, DEVICES);
+    uint64_t state = 3;
+    const guint ticks = 3600;
+
+    TimeSeriesStore* store = time_series_store_new(NULL);
+    g_test_timer_start();
+    for (guint tick = 0; tick < ticks; tick++) {
+        append_tick(store, names, tick, &state, used);
+    }
+    double elapsed = g_test_timer_elapsed();
+
+    TimeSeriesStats stats;
+    time_series_store_stats(store, &stats);
+    g_assert_cmpuint(stats.samples, ==, (uint64_t)ticks * DEVICES * METRICS);
+    double ns = elapsed * 1e9 / stats.samples;
+    g_test_minimized_result(ns, "append: %.1f ns/sample", ns);
+    double bits = stats.bytes * 8.0 / stats.samples;
+    g_test_minimized_result(bits, "%u series: %.2f bits/sample, %.1f MiB", stats.series, bits,
+                            stats.bytes / 1048576.0);
+
+    g_free(used);
+    time_series_store_free(store);
+}
+
+// Query latency of the chart views over six hours of one busy and one idle
+// series; run with -m perf
+static void test_query_benchmark(void) {
+    char (*names)[16] = device_names();
+    double* used = g_new0(double, DEVICES);
+    uint64_t state = 5;
+    const guint ticks = TIME_SERIES_RETENTION_MS / 1000;
+
+    TimeSeriesStore* store = time_series_store_new(NULL);
+    for (guint tick = 0; tick < ticks; tick++) {
+        append_tick(store, names, tick, &state, used);
+    }
+    gint64 to = BASE_MS + 1000ll * (ticks - 1);
+    gint64 bucket_ms = time_series_store_bucket_ms(store, BASE_MS, to, TIME_SERIES_MAX_POINTS);
+
+    const struct {
+        const char* label;
+        const char* device;
+        gint64 from;
+        gint64 bucket_ms;
+    } views[] = {
+        { "six hours, busy", names[0], BASE_MS, bucket_ms },
+        { "six hours, idle", names[DEVICES - 1], BASE_MS, bucket_ms },
+        { "last ten minutes, busy", names[0], to - 600 * 1000, 1000 },
+    };
+    const guint rounds = 50;
+    for (guint v = 0; v < G_N_ELEMENTS(views); v++) {
+        guint points = 0;
+        g_test_timer_start();
+        for (guint i = 0; i < rounds; i++) {
+            GArray* buckets = time_series_store_query(store, views[v].device, "readBytesPerSec",
+                                                      views[v].from, to, views[v].bucket_ms);
+            points = buckets->len;
+            g_array_free(buckets, TRUE);
+        }
+        double us = g_test_timer_elapsed() * 1e6 / rounds;
+        g_assert_cmpuint(points, >, 0);
+        g_test_minimized_result(us, "query %s, %u points: %.0f us", views[v].label, points, us);
+    }
+
+    g_free(used);
+    time_series_store_free(store);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/timeseries/round_trip", test_round_trip);
+    g_test_add_func("/timeseries/quantized", test_quantized);
+    g_test_add_func("/timeseries/buckets", test_buckets);
+    if (g_test_perf()) {
+        g_test_add_func("/timeseries/ingest_benchmark", test_ingest_benchmark);
+        g_test_add_func("/timeseries/query_benchmark", test_query_benchmark);
+    }
+    return g_test_run();
+}
@@ -0,0 +1,586 @@
+#define _GNU_SOURCE
+#include "timeseries.h"
+#include <string.h>
+
+// Room for the worst case sample: flushing a pending run, then a 5-bit
+// escape plus a 10-byte varint for the timestamp and 2 + 5 + 6 control bits
+// plus 64 bits for the value
+#define TIME_SERIES_MAX_SAMPLE_BITS (85 + 85 + 77)
+// Shorter runs of repeated samples are cheaper written out, two bits each
+#define TIME_SERIES_MIN_RUN 8
+// A block spans at most this fraction of the retention, so expiry frees
+// memory in steps even for series that compress to almost nothing
+#define TIME_SERIES_BLOCKS_PER_RETENTION 16
+#define TIME_SERIES_INITIAL_BLOCK_BYTES 32
+#define TIME_SERIES_MIN_BLOCK_BYTES 64
+#define TIME_SERIES_NO_WINDOW 64
+
+typedef struct {
+    gint64 first_slot;
+    gint64 last_slot;
+    gint64 last_delta;
+    uint64_t first_bits;
+    uint64_t last_bits;
+    guint count;              // samples, including @run
+    guint run;                // repeats of the last sample not written yet
+    guint8 leading;           // XOR window of the last explicit value
+    guint8 trailing;
+    size_t bit_length;
+    size_t capacity;          // bytes allocated at @data
+    uint8_t* data;
+} Block;
+
+typedef struct {
+    GPtrArray* blocks;        // oldest first; only the last one is appended to
+} Series;
+
+struct TimeSeriesStore {
+    TimeSeriesOptions options;
+    gint64 retention_slots;
+    gint64 block_span_slots;
+
+    // Guards everything below
+    GMutex lock;
+    GHashTable* devices;      // name -> GHashTable of metric name -> Series
+};
+
+void time_series_default_options(TimeSeriesOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->resolution_ms = TIME_SERIES_RESOLUTION_MS;
+    options->retention_ms = TIME_SERIES_RETENTION_MS;
+    options->mantissa_bits = TIME_SERIES_MANTISSA_BITS;
+    options->block_bytes = TIME_SERIES_BLOCK_BYTES;
+}
+
+static Block* block_new(gint64 slot, uint64_t bits) {
+    Block* block = g_new0(Block, 1);
+    block->first_slot = slot;
+    block->last_slot = slot;
+    block->first_bits = bits;
+    block->last_bits = bits;
+    block->count = 1;
+    block->leading = TIME_SERIES_NO_WINDOW;
+    return block;
+}
+
+static void block_free(gpointer data) {
+    Block* block = data;
+    g_free(block->data);
+    g_free(block);
+}
+
+static void series_free(gpointer data) {
+    Series* series = data;
+    g_ptr_array_free(series->blocks, TRUE);
+    g_free(series);
+}
+
+static void metrics_free(gpointer data) {
+    g_hash_table_destroy(data);
+}
+
+TimeSeriesStore* time_series_store_new(const TimeSeriesOptions* options) {
+    TimeSeriesStore* store = g_new0(TimeSeriesStore, 1);
+    time_series_default_options(&store->options);
+    if (options) {
+        if (options->resolution_ms > 0) store->options.resolution_ms = options->resolution_ms;
+        if (options->retention_ms > 0) store->options.retention_ms = options->retention_ms;
+        if (options->mantissa_bits > 0) store->options.mantissa_bits = MIN(options->mantissa_bits, 52u);
+        if (options->block_bytes > 0) {
+            store->options.block_bytes = MAX(options->block_bytes, (size_t)TIME_SERIES_MIN_BLOCK_BYTES);
+        }
+    }
+    store->retention_slots = store->options.retention_ms / store->options.resolution_ms;
+    store->block_span_slots = MAX(store->retention_slots / TIME_SERIES_BLOCKS_PER_RETENTION, (gint64)1);
+    g_mutex_init(&store->lock);
+    store->devices = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, metrics_free);
+    return store;
+}
+
+void time_series_store_free(TimeSeriesStore* store) {
+    if (!store) return;
+    g_hash_table_destroy(store->devices);
+    g_mutex_clear(&store->lock);
+    g_free(store);
+}
+
+void time_series_store_options(TimeSeriesStore* store, TimeSeriesOptions* options) {
+    *options = store->options;
+}
+
+// Bit stream, most significant bit first
+
+static void put_bits(Block* block, uint64_t value, guint bits) {
+    while (bits > 0) {
+        size_t byte = block->bit_length >> 3;
+        guint used = block->bit_length & 7;
+        guint room = 8 - used;
+        guint take = MIN(bits, room);
+        uint8_t chunk = (uint8_t)((value >> (bits - take)) & ((1u << take) - 1));
+        if (used == 0) block->data[byte] = 0;
+        block->data[byte] |= (uint8_t)(chunk << (room - take));
+        block->bit_length += take;
+        bits -= take;
+    }
+}
+
+static inline uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void put_varint(Block* block, uint64_t value) {
+    do {
+        uint64_t group = value & 0x7f;
+        value >>= 7;
+        put_bits(block, (value ? 0x80 : 0) | group, 8);
+    } while (value);
+}
+
+// Idle devices repeat the same value on schedule for hours; a run of such
+// samples is kept as a count and written as one code when it ends
+static void flush_run(Block* block) {
+    if (block->run == 0) return;
+    if (block->run < TIME_SERIES_MIN_RUN) {
+        for (guint i = 0; i < block->run; i++) put_bits(block, 0, 2);
+    } else {
+        put_bits(block, 0x1f, 5);
+        put_varint(block, block->run);
+    }
+    block->run = 0;
+}
+
+static void put_timestamp(Block* block, gint64 slot) {
+    gint64 delta = slot - block->last_slot;
+    gint64 dod = delta - block->last_delta;
+    if (dod == 0) {
+        put_bits(block, 0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+        put_bits(block, 0x2, 2);
+        put_bits(block, (uint64_t)(dod + 63), 7);
+    } else if (dod >= -255 && dod <= 256) {
+        put_bits(block, 0x6, 3);
+        put_bits(block, (uint64_t)(dod + 255), 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+        put_bits(block, 0xe, 4);
+        put_bits(block, (uint64_t)(dod + 2047), 12);
+    } else {
+        // Gaps after suspend or a clock change; 11111 starts a run instead
+        put_bits(block, 0x1e, 5);
+        put_varint(block, zigzag(dod));
+    }
+    block->last_delta = delta;
+    block->last_slot = slot;
+}
+
+static void put_value(Block* block, uint64_t bits) {
+    uint64_t xor = bits ^ block->last_bits;
+    block->last_bits = bits;
+    if (xor == 0) {
+        put_bits(block, 0, 1);
+        return;
+    }
+    guint leading = MIN((guint)__builtin_clzll(xor), 31u);
+    guint trailing = (guint)__builtin_ctzll(xor);
+    if (block->leading != TIME_SERIES_NO_WINDOW &&
+        leading >= block->leading && trailing >= block->trailing) {
+        // Fits the previous window: no need to repeat its bounds
+        put_bits(block, 0x2, 2);
+        put_bits(block, xor >> block->trailing, 64 - block->leading - block->trailing);
+        return;
+    }
+    guint significant = 64 - leading - trailing;
+    put_bits(block, 0x3, 2);
+    put_bits(block, leading, 5);
+    put_bits(block, significant - 1, 6);
+    put_bits(block, xor >> trailing, significant);
+    block->leading = (guint8)leading;
+    block->trailing = (guint8)trailing;
+}
+
+// Makes room for one more sample, growing the block geometrically.
+// Returns FALSE when the block is full.
+static gboolean block_reserve(const TimeSeriesStore* store, Block* block) {
+    size_t needed = (block->bit_length + TIME_SERIES_MAX_SAMPLE_BITS + 7) / 8;
+    if (needed <= block->capacity) return TRUE;
+    if (needed > store->options.block_bytes) return FALSE;
+    size_t capacity = MAX(block->capacity, (size_t)TIME_SERIES_INITIAL_BLOCK_BYTES);
+    while (capacity < needed) capacity *= 2;
+    block->capacity = MIN(capacity, store->options.block_bytes);
+    block->data = g_realloc(block->data, block->capacity);
+    return TRUE;
+}
+
+// Blocks are never appended to once a new one is started
+static void block_seal(Block* block) {
+    size_t used = (block->bit_length + 7) / 8;
+    if (used == block->capacity) return;
+    block->capacity = used;
+    block->data = g_realloc(block->data, used);
+}
+
+// Rounds away the mantissa bits beyond the configured precision so that
+// consecutive XORs have long runs of trailing zeros
+static uint64_t quantize(const TimeSeriesStore* store, double value) {
+    if (value == 0.0) return 0;         // folds -0.0 into 0.0
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    guint drop = 52 - store->options.mantissa_bits;
+    if (drop == 0 || ((bits >> 52) & 0x7ff) == 0x7ff) return bits;
+    bits += 1ull << (drop - 1);
+    return bits & ~((1ull << drop) - 1);
+}
+
+static gint64 slot_of(const TimeSeriesStore* store, gint64 timestamp_ms) {
+    gint64 resolution = store->options.resolution_ms;
+    gint64 rounded = timestamp_ms + resolution / 2;
+    return rounded >= 0 ? rounded / resolution : -((-rounded + resolution - 1) / resolution);
+}
+
+// Called with the lock held
+static Series* find_series(TimeSeriesStore* store, const char* device, const char* metric,
+                           gboolean create) {
+    GHashTable* metrics = g_hash_table_lookup(store->devices, device);
+    if (!metrics) {
+        if (!create) return NULL;
+        metrics = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, series_free);
+        g_hash_table_insert(store->devices, g_strdup(device), metrics);
+    }
+    Series* series = g_hash_table_lookup(metrics, metric);
+    if (!series && create) {
+        series = g_new0(Series, 1);
+        series->blocks = g_ptr_array_new_with_free_func(block_free);
+        g_hash_table_insert(metrics, g_strdup(metric), series);
+    }
+    return series;
+}
+
+// Drops whole blocks that end before @cutoff_slot; with @keep_tail the
+// block being appended to stays even when it is stale
+static void series_expire(Series* series, gint64 cutoff_slot, gboolean keep_tail) {
+    guint limit = keep_tail && series->blocks->len > 0 ? series->blocks->len - 1 : series->blocks->len;
+    guint expired = 0;
+    while (expired < limit &&
+           ((Block*)g_ptr_array_index(series->blocks, expired))->last_slot < cutoff_slot) {
+        expired++;
+    }
+    if (expired > 0) g_ptr_array_remove_range(series->blocks, 0, expired);
+}
+
+gboolean time_series_store_append(TimeSeriesStore* store,
+                                  const char* device,
+                                  const char* metric,
+                                  gint64 timestamp_ms,
+                                  double value) {
+    gint64 slot = slot_of(store, timestamp_ms);
+    uint64_t bits = quantize(store, value);
+
+    g_mutex_lock(&store->lock);
+    Series* series = find_series(store, device, metric, TRUE);
+    Block* tail = series->blocks->len > 0
+        ? g_ptr_array_index(series->blocks, series->blocks->len - 1) : NULL;
+
+    if (tail && slot <= tail->last_slot) {
+        g_mutex_unlock(&store->lock);
+        return FALSE;
+    }
+    if (tail && slot - tail->first_slot <= store->block_span_slots && block_reserve(store, tail)) {
+        if (slot - tail->last_slot == tail->last_delta && bits == tail->last_bits) {
+            tail->last_slot = slot;
+            tail->run++;
+        } else {
+            flush_run(tail);
+            put_timestamp(tail, slot);
+            put_value(tail, bits);
+        }
+        tail->count++;
+    } else {
+        if (tail) block_seal(tail);
+        g_ptr_array_add(series->blocks, block_new(slot, bits));
+        series_expire(series, slot - store->retention_slots, TRUE);
+    }
+    g_mutex_unlock(&store->lock);
+    return TRUE;
+}
+
+void time_series_store_expire(TimeSeriesStore* store, gint64 now_ms) {
+    gint64 cutoff = slot_of(store, now_ms) - store->retention_slots;
+
+    g_mutex_lock(&store->lock);
+    GHashTableIter devices;
+    gpointer key, value;
+    g_hash_table_iter_init(&devices, store->devices);
+    while (g_hash_table_iter_next(&devices, &key, &value)) {
+        GHashTableIter metrics;
+        gpointer metric_key, metric_value;
+        g_hash_table_iter_init(&metrics, value);
+        while (g_hash_table_iter_next(&metrics, &metric_key, &metric_value)) {
+            Series* series = metric_value;
+            series_expire(series, cutoff, FALSE);
+            if (series->blocks->len == 0) g_hash_table_iter_remove(&metrics);
+        }
+        if (g_hash_table_size(value) == 0) g_hash_table_iter_remove(&devices);
+    }
+    g_mutex_unlock(&store->lock);
+}
+
+gint64 time_series_store_bucket_ms(TimeSeriesStore* store, gint64 from_ms, gint64 to_ms,
+                                   guint max_points) {
+    gint64 resolution = store->options.resolution_ms;
+    if (max_points == 0) max_points = TIME_SERIES_MAX_POINTS;
+    gint64 span = MAX(to_ms - from_ms + 1, (gint64)1);
+    gint64 bucket = (span + max_points - 1) / max_points;
+    bucket = (bucket + resolution - 1) / resolution * resolution;
+    return MAX(bucket, resolution);
+}
+
+// Decoding
+
+typedef struct {
+    const Block* block;
+    size_t bit;
+    guint index;
+    gint64 slot;
+    gint64 delta;
+    uint64_t bits;
+    guint leading;
+    guint trailing;
+    uint64_t repeats;         // left of the run being decoded
+} Cursor;
+
+static uint64_t get_bits(Cursor* cursor, guint bits) {
+    uint64_t value = 0;
+    while (bits > 0) {
+        uint8_t byte = cursor->block->data[cursor->bit >> 3];
+        guint used = cursor->bit & 7;
+        guint room = 8 - used;
+        guint take = MIN(bits, room);
+        value = (value << take) | ((byte >> (room - take)) & ((1u << take) - 1));
+        cursor->bit += take;
+        bits -= take;
+    }
+    return value;
+}
+
+// Number of leading one bits, up to @max
+static guint get_prefix(Cursor* cursor, guint max) {
+    guint ones = 0;
+    while (ones < max && get_bits(cursor, 1)) ones++;
+    return ones;
+}
+
+static uint64_t get_varint(Cursor* cursor) {
+    uint64_t value = 0;
+    guint shift = 0;
+    uint64_t group;
+    do {
+        group = get_bits(cursor, 8);
+        value |= (group & 0x7f) << shift;
+        shift += 7;
+    } while ((group & 0x80) && shift < 64);
+    return value;
+}
+
+static gboolean cursor_next(Cursor* cursor, gint64* slot, double* value) {
+    const Block* block = cursor->block;
+    if (cursor->index >= block->count) return FALSE;
+
+    if (cursor->index == 0) {
+        cursor->slot = block->first_slot;
+        cursor->bits = block->first_bits;
+    } else if (cursor->repeats > 0 || cursor->bit >= block->bit_length) {
+        // Inside a run, or the tail's pending run past the end of the stream
+        if (cursor->repeats > 0) cursor->repeats--;
+        cursor->slot += cursor->delta;
+    } else {
+        gint64 dod = 0;
+        switch (get_prefix(cursor, 4)) {
+        case 0: break;
+        case 1: dod = (gint64)get_bits(cursor, 7) - 63; break;
+        case 2: dod = (gint64)get_bits(cursor, 9) - 255; break;
+        case 3: dod = (gint64)get_bits(cursor, 12) - 2047; break;
+        default:
+            if (get_bits(cursor, 1)) {
+                cursor->repeats = get_varint(cursor) - 1;
+                cursor->slot += cursor->delta;
+                goto emit;
+            }
+            dod = unzigzag(get_varint(cursor));
+        }
+        cursor->delta += dod;
+        cursor->slot += cursor->delta;
+
+        switch (get_prefix(cursor, 2)) {
+        case 0: break;
+        case 1:
+            cursor->bits ^= get_bits(cursor, 64 - cursor->leading - cursor->trailing) << cursor->trailing;
+            break;
+        default: {
+            cursor->leading = (guint)get_bits(cursor, 5);
+            guint significant = (guint)get_bits(cursor, 6) + 1;
+            cursor->trailing = 64 - cursor->leading - significant;
+            cursor->bits ^= get_bits(cursor, significant) << cursor->trailing;
+        }
+        }
+    }
+emit:
+    cursor->index++;
+    *slot = cursor->slot;
+    memcpy(value, &cursor->bits, sizeof(*value));
+    return TRUE;
+}
+
+GArray* time_series_store_query(TimeSeriesStore* store,
+                                const char* device,
+                                const char* metric,
+                                gint64 from_ms,
+                                gint64 to_ms,
+                                gint64 bucket_ms) {
+    gint64 resolution = store->options.resolution_ms;
+    if (bucket_ms <= 0) bucket_ms = time_series_store_bucket_ms(store, from_ms, to_ms, 0);
+
+    g_mutex_lock(&store->lock);
+    Series* series = find_series(store, device, metric, FALSE);
+    if (!series) {
+        g_mutex_unlock(&store->lock);
+        return NULL;
+    }
+
+    GArray* buckets = g_array_new(FALSE, FALSE, sizeof(TimeSeriesBucket));
+    TimeSeriesBucket bucket = {0};
+    double sum = 0.0;
+    gint64 index = -1;
+
+    for (guint b = 0; b < series->blocks->len; b++) {
+        const Block* block = g_ptr_array_index(series->blocks, b);
+        if (block->last_slot * resolution < from_ms) continue;
+        if (block->first_slot * resolution > to_ms) break;
+
+        Cursor cursor = {.block = block};
+        gint64 slot;
+        double value;
+        while (cursor_next(&cursor, &slot, &value)) {
+            gint64 timestamp = slot * resolution;
+            if (timestamp < from_ms) continue;
+            if (timestamp > to_ms) break;
+
+            gint64 current = (timestamp - from_ms) / bucket_ms;
+            if (current != index) {
+                if (bucket.count > 0) {
+                    bucket.avg = sum / bucket.count;
+                    g_array_append_val(buckets, bucket);
+                }
+                index = current;
+                bucket.start_ms = from_ms + current * bucket_ms;
+                bucket.count = 0;
+                bucket.min = value;
+                bucket.max = value;
+                sum = 0.0;
+            }
+            bucket.count++;
+            bucket.min = MIN(bucket.min, value);
+            bucket.max = MAX(bucket.max, value);
+            sum += value;
+        }
+    }
+    if (bucket.count > 0) {
+        bucket.avg = sum / bucket.count;
+        g_array_append_val(buckets, bucket);
+    }
+    g_mutex_unlock(&store->lock);
+    return buckets;
+}
+
+GPtrArray* time_series_store_metrics(TimeSeriesStore* store, const char* device) {
+    g_mutex_lock(&store->lock);
+    GHashTable* metrics = g_hash_table_lookup(store->devices, device);
+    GPtrArray* names = NULL;
+    if (metrics) {
+        names = g_ptr_array_new_with_free_func(g_free);
+        GHashTableIter iter;
+        gpointer key;
+        g_hash_table_iter_init(&iter, metrics);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            g_ptr_array_add(names, g_strdup(key));
+        }
+    }
+    g_mutex_unlock(&store->lock);
+    return names;
+}
+
+void time_series_store_stats(TimeSeriesStore* store, TimeSeriesStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    g_mutex_lock(&store->lock);
+    stats->devices = g_hash_table_size(store->devices);
+    GHashTableIter devices;
+    gpointer value;
+    g_hash_table_iter_init(&devices, store->devices);
+    while (g_hash_table_iter_next(&devices, NULL, &value)) {
+        GHashTableIter metrics;
+        gpointer metric_value;
+        g_hash_table_iter_init(&metrics, value);
+        while (g_hash_table_iter_next(&metrics, NULL, &metric_value)) {
+            Series* series = metric_value;
+            stats->series++;
+            stats->bytes += sizeof(Series) + series->blocks->len * sizeof(gpointer);
+            for (guint b = 0; b < series->blocks->len; b++) {
+                const Block* block = g_ptr_array_index(series->blocks, b);
+                stats->blocks++;
+                stats->samples += block->count;
+                stats->bytes += sizeof(Block) + block->capacity;
+            }
+        }
+    }
+    g_mutex_unlock(&store->lock);
+}
+
+FlValue* time_series_buckets_to_fl_value(const GArray* buckets) {
+    guint count = buckets->len;
+    int64_t* timestamps = g_new(int64_t, MAX(count, 1u));
+    int64_t* counts = g_new(int64_t, MAX(count, 1u));
+    double* min = g_new(double, MAX(count, 1u));
+    double* max = g_new(double, MAX(count, 1u));
+    double* avg = g_new(double, MAX(count, 1u));
+    for (guint i = 0; i < count; i++) {
+        const TimeSeriesBucket* bucket = &g_array_index(buckets, TimeSeriesBucket, i);
+        timestamps[i] = bucket->start_ms;
+        counts[i] = bucket->count;
+        min[i] = bucket->min;
+        max[i] = bucket->max;
+        avg[i] = bucket->avg;
+    }
+
+    FlValue* map = fl_value_new_map();
+    fl_value_set_string_take(map, "timestamps", fl_value_new_int64_list(timestamps, count));
+    fl_value_set_string_take(map, "counts", fl_value_new_int64_list(counts, count));
+    fl_value_set_string_take(map, "min", fl_value_new_float_list(min, count));
+    fl_value_set_string_take(map, "max", fl_value_new_float_list(max, count));
+    fl_value_set_string_take(map, "avg", fl_value_new_float_list(avg, count));
+    g_free(timestamps);
+    g_free(counts);
+    g_free(min);
+    g_free(max);
+    g_free(avg);
+    return map;
+}
+
+FlValue* time_series_stats_to_fl_value(const TimeSeriesStats* stats, const TimeSeriesOptions* options) {
+    FlValue* map = fl_value_new_map();
+    fl_value_set_string_take(map, "devices", fl_value_new_int(stats->devices));
+    fl_value_set_string_take(map, "series", fl_value_new_int(stats->series));
+    fl_value_set_string_take(map, "blocks", fl_value_new_int(stats->blocks));
+    fl_value_set_string_take(map, "samples", fl_value_new_int((int64_t)stats->samples));
+    fl_value_set_string_take(map, "bytes", fl_value_new_int((int64_t)stats->bytes));
+    fl_value_set_string_take(map, "bitsPerSample",
+                             fl_value_new_float(stats->samples > 0
+                                 ? (double)stats->bytes * 8 / (double)stats->samples : 0.0));
+    if (options) {
+        fl_value_set_string_take(map, "resolutionMs", fl_value_new_int(options->resolution_ms));
+        fl_value_set_string_take(map, "retentionMs", fl_value_new_int(options->retention_ms));
+        fl_value_set_string_take(map, "mantissaBits", fl_value_new_int(options->mantissa_bits));
+    }
+    return map;
+}
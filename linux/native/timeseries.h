@@ -0,0 +1,122 @@
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include <flutter_linux/flutter_linux.h>
+#include <stddef.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+#define TIME_SERIES_RESOLUTION_MS 1000
+#define TIME_SERIES_RETENTION_MS (6ll * 60 * 60 * 1000)
+// Mantissa bits kept per value: a relative error below 4e-6, and noisy
+// rates compress to a third of their raw size
+#define TIME_SERIES_MANTISSA_BITS 18
+// Largest a block grows before it is sealed and a new one started
+#define TIME_SERIES_BLOCK_BYTES 1024
+#define TIME_SERIES_MAX_POINTS 300
+
+typedef struct {
+    guint resolution_ms;      // 0 = TIME_SERIES_RESOLUTION_MS
+    gint64 retention_ms;      // 0 = TIME_SERIES_RETENTION_MS
+    guint mantissa_bits;      // 0 = TIME_SERIES_MANTISSA_BITS, 52 = lossless
+    size_t block_bytes;       // 0 = TIME_SERIES_BLOCK_BYTES
+} TimeSeriesOptions;
+
+void time_series_default_options(TimeSeriesOptions* options);
+
+/**
+ * TimeSeriesStore:
+ *
+ * In-memory history of one value per device and metric, compressed the way
+ * Gorilla does it. Timestamps are counted in @resolution_ms slots and
+ * stored as the delta of their delta, which is a single 0 bit while samples
+ * arrive on schedule. Values are XORed with their predecessor: an unchanged
+ * value is one bit, otherwise only the bits between the leading and trailing
+ * zeros of the XOR are written. Jumps too big for the fixed buckets fall back
+ * to a zigzag varint.
+ *
+ * Each series is a ring of blocks that grow up to @block_bytes; blocks that
+ * end before the retention window are dropped whole. An idle device costs
+ * two bits per metric and sample. Thread-safe.
+ */
+typedef struct TimeSeriesStore TimeSeriesStore;
+
+typedef struct {
+    gint64 start_ms;          // bucket start, from + n * bucket_ms
+    guint count;              // samples in the bucket, never 0
+    double min;
+    double max;
+    double avg;
+} TimeSeriesBucket;
+
+typedef struct {
+    guint devices;
+    guint series;
+    guint blocks;
+    uint64_t samples;
+    size_t bytes;             // blocks and bookkeeping, not the hash tables
+} TimeSeriesStats;
+
+// @options: (nullable): NULL for the defaults
+TimeSeriesStore* time_series_store_new(const TimeSeriesOptions* options);
+void time_series_store_free(TimeSeriesStore* store);
+
+/**
+ * time_series_store_append:
+ * @timestamp_ms: wall-clock time of the sample, rounded to the resolution
+ *
+ * Returns: FALSE when the sample was dropped because its slot is not after
+ *   the last one of the series, as when sampling faster than the resolution
+ */
+gboolean time_series_store_append(TimeSeriesStore* store,
+                                  const char* device,
+                                  const char* metric,
+                                  gint64 timestamp_ms,
+                                  double value);
+
+// Drops samples older than the retention window before @now_ms, and series
+// of devices that have gone away once nothing of them is left
+void time_series_store_expire(TimeSeriesStore* store, gint64 now_ms);
+
+/**
+ * time_series_store_bucket_ms:
+ *
+ * Returns: the smallest multiple of the resolution that splits
+ *   [@from_ms, @to_ms] into at most @max_points buckets
+ */
+gint64 time_series_store_bucket_ms(TimeSeriesStore* store, gint64 from_ms, gint64 to_ms,
+                                   guint max_points);
+
+/**
+ * time_series_store_query:
+ * @bucket_ms: width of each bucket, see time_series_store_bucket_ms()
+ *
+ * Decodes the samples in [@from_ms, @to_ms] and reduces them to min, max
+ * and average per bucket. Empty buckets are left out.
+ *
+ * Returns: (transfer full) (nullable): a #GArray of #TimeSeriesBucket, or
+ *   NULL when the store has no such series
+ */
+GArray* time_series_store_query(TimeSeriesStore* store,
+                                const char* device,
+                                const char* metric,
+                                gint64 from_ms,
+                                gint64 to_ms,
+                                gint64 bucket_ms);
+
+// Returns: (transfer full) (nullable): the metric names recorded for @device
+GPtrArray* time_series_store_metrics(TimeSeriesStore* store, const char* device);
+
+void time_series_store_stats(TimeSeriesStore* store, TimeSeriesStats* stats);
+
+// Parallel typed lists: timestamps, counts, min, max, avg
+FlValue* time_series_buckets_to_fl_value(const GArray* buckets);
+FlValue* time_series_stats_to_fl_value(const TimeSeriesStats* stats, const TimeSeriesOptions* options);
+
+// The options in effect, defaults filled in
+void time_series_store_options(TimeSeriesStore* store, TimeSeriesOptions* options);
+
+G_END_DECLS
+
+#endif // TIMESERIES_H
@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+#include "uevent_monitor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <linux/netlink.h>
+
+// Kernel uevents are multicast on group 1; udevd re-broadcasts on group 2
+#define UEVENT_KERNEL_GROUP 1
+#define UEVENT_BUFFER_SIZE 8192
+// Large enough to absorb the burst of a multipath or RAID array appearing
+#define UEVENT_RCVBUF (4 * 1024 * 1024)
+#define UEVENT_MAX_LISTENERS 8
+
+typedef struct {
+    UeventCallback callback;
+    void* user_data;
+} UeventListener;
+
+struct UeventMonitor {
+    int socket_fd;
+    int stop_fd;
+    char subsystem[32];
+    UeventListener listeners[UEVENT_MAX_LISTENERS];
+    guint listener_count;
+    pthread_t thread;
+    gboolean running;
+};
+
+static void copy_value(char* dest, size_t size, const char* value, size_t length) {
+    if (length >= size) length = size - 1;
+    memcpy(dest, value, length);
+    dest[length] = '\0';
+}
+
+gboolean uevent_parse(const char* buffer, size_t length, Uevent* event) {
+    memset(event, 0, sizeof(*event));
+
+    // Header "action@devpath", then NUL-separated KEY=value pairs
+    const char* end = buffer + length;
+    const char* header_end = memchr(buffer, '\0', length);
+    if (!header_end || !memchr(buffer, '@', (size_t)(header_end - buffer))) return FALSE;
+
+    gboolean have_action = FALSE;
+    for (const char* p = header_end + 1; p < end;) {
+        const char* entry_end = memchr(p, '\0', (size_t)(end - p));
+        if (!entry_end) entry_end = end;
+        const char* equals = memchr(p, '=', (size_t)(entry_end - p));
+        if (equals) {
+            size_t key_length = (size_t)(equals - p);
+            const char* value = equals + 1;
+            size_t value_length = (size_t)(entry_end - value);
+
+#define KEY_IS(name) (key_length == sizeof(name) - 1 && memcmp(p, name, key_length) == 0)
+            if (KEY_IS("ACTION")) {
+                copy_value(event->action, sizeof(event->action), value, value_length);
+                have_action = TRUE;
+            } else if (KEY_IS("SUBSYSTEM")) {
+                copy_value(event->subsystem, sizeof(event->subsystem), value, value_length);
+            } else if (KEY_IS("DEVNAME")) {
+                copy_value(event->devname, sizeof(event->devname), value, value_length);
+            } else if (KEY_IS("DEVTYPE")) {
+                copy_value(event->devtype, sizeof(event->devtype), value, value_length);
+            } else if (KEY_IS("DEVPATH")) {
+                copy_value(event->devpath, sizeof(event->devpath), value, value_length);
+            } else if (KEY_IS("MAJOR")) {
+                event->major = (guint)strtoul(value, NULL, 10);
+            } else if (KEY_IS("MINOR")) {
+                event->minor = (guint)strtoul(value, NULL, 10);
+            } else if (KEY_IS("SEQNUM")) {
+                event->seqnum = strtoull(value, NULL, 10);
+            }
+#undef KEY_IS
+        }
+        p = entry_end + 1;
+    }
+
+    // DEVNAME may carry a directory for nodes like "mapper/x"; the kernel
+    // name is the last DEVPATH component
+    if (event->devname[0] == '\0' || strchr(event->devname, '/')) {
+        const char* slash = strrchr(event->devpath, '/');
+        if (slash) copy_value(event->devname, sizeof(event->devname), slash + 1, strlen(slash + 1));
+    }
+    return have_action;
+}
+
+UeventMonitor* uevent_monitor_new(const char* subsystem, GError** error) {
+    int socket_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                           NETLINK_KOBJECT_UEVENT);
+    if (socket_fd < 0) {
+        int saved = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Cannot open uevent socket: %s", g_strerror(saved));
+        return NULL;
+    }
+
+    int rcvbuf = UEVENT_RCVBUF;
+    // SO_RCVBUFFORCE ignores rmem_max when we are privileged
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+
+    struct sockaddr_nl address = {
+        .nl_family = AF_NETLINK,
+        .nl_groups = UEVENT_KERNEL_GROUP,
+    };
+    if (bind(socket_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        int saved = errno;
+        close(socket_fd);
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Cannot bind uevent socket: %s", g_strerror(saved));
+        return NULL;
+    }
+
+    int stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (stop_fd < 0) {
+        int saved = errno;
+        close(socket_fd);
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                    "Cannot create eventfd: %s", g_strerror(saved));
+        return NULL;
+    }
+
+    UeventMonitor* monitor = g_new0(UeventMonitor, 1);
+    monitor->socket_fd = socket_fd;
+    monitor->stop_fd = stop_fd;
+    if (subsystem) g_strlcpy(monitor->subsystem, subsystem, sizeof(monitor->subsystem));
+    return monitor;
+}
+
+void uevent_monitor_free(UeventMonitor* monitor) {
+    if (!monitor) return;
+    uevent_monitor_stop(monitor);
+    close(monitor->socket_fd);
+    close(monitor->stop_fd);
+    g_free(monitor);
+}
+
+void uevent_monitor_add_listener(UeventMonitor* monitor,
+                                 UeventCallback callback,
+                                 void* user_data) {
+    g_return_if_fail(!monitor->running && monitor->listener_count < UEVENT_MAX_LISTENERS);
+    monitor->listeners[monitor->listener_count].callback = callback;
+    monitor->listeners[monitor->listener_count].user_data = user_data;
+    monitor->listener_count++;
+}
+
+static void dispatch(UeventMonitor* monitor, const Uevent* event) {
+    for (guint i = 0; i < monitor->listener_count; i++) {
+        monitor->listeners[i].callback(event, monitor->listeners[i].user_data);
+    }
+}
+
+// Reads until the socket is drained
+static void receive_events(UeventMonitor* monitor, char* buffer) {
+    for (;;) {
+        struct sockaddr_nl sender;
+        struct iovec iov = {buffer, UEVENT_BUFFER_SIZE - 1};
+        struct msghdr message = {
+            .msg_name = &sender,
+            .msg_namelen = sizeof(sender),
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+        };
+
+        ssize_t n = recvmsg(monitor->socket_fd, &message, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS) {
+                // Events were lost; listeners must resynchronize
+                dispatch(monitor, NULL);
+                continue;
+            }
+            return;  // EAGAIN: drained
+        }
+
+        // Only the kernel (port 0) may send on this group
+        if (sender.nl_pid != 0 || (message.msg_flags & MSG_TRUNC)) continue;
+        buffer[n] = '\0';
+
+        Uevent event;
+        if (!uevent_parse(buffer, (size_t)n, &event)) continue;
+        if (monitor->subsystem[0] && strcmp(event.subsystem, monitor->subsystem) != 0) continue;
+        dispatch(monitor, &event);
+    }
+}
+
+static void* monitor_thread_func(void* data) {
+    UeventMonitor* monitor = data;
+    char* buffer = g_malloc(UEVENT_BUFFER_SIZE);
+
+    struct pollfd fds[2] = {
+        {.fd = monitor->socket_fd, .events = POLLIN},
+        {.fd = monitor->stop_fd, .events = POLLIN},
+    };
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        // An overflow shows up as POLLERR; recvmsg() then reports ENOBUFS
+        if (fds[0].revents) receive_events(monitor, buffer);
+    }
+
+    g_free(buffer);
+    return NULL;
+}
+
+gboolean uevent_monitor_start(UeventMonitor* monitor, GError** error) {
+    if (monitor->running) return TRUE;
+
+    int rc = pthread_create(&monitor->thread, NULL, monitor_thread_func, monitor);
+    if (rc != 0) {
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(rc),
+                    "Cannot start uevent thread: %s", g_strerror(rc));
+        return FALSE;
+    }
+    monitor->running = TRUE;
+    return TRUE;
+}
+
+void uevent_monitor_stop(UeventMonitor* monitor) {
+    if (!monitor->running) return;
+
+    uint64_t one = 1;
+    ssize_t written = write(monitor->stop_fd, &one, sizeof(one));
+    (void)written;
+    pthread_join(monitor->thread, NULL);
+
+    uint64_t drained;
+    ssize_t drained_bytes = read(monitor->stop_fd, &drained, sizeof(drained));
+    (void)drained_bytes;
+    monitor->running = FALSE;
+}
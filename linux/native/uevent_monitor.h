@@ -0,0 +1,75 @@
+#ifndef UEVENT_MONITOR_H
+#define UEVENT_MONITOR_H
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/**
+ * Uevent:
+ *
+ * The fields of a kernel uevent the storage code cares about. Strings are
+ * empty when the event does not carry the key.
+ */
+typedef struct {
+    char action[16];          // "add", "remove", "change", "move", ...
+    char subsystem[32];
+    char devname[64];         // kernel name, e.g. "sda1" or "dm-0"
+    char devtype[16];         // "disk" or "partition" for block devices
+    char devpath[256];        // below /sys, e.g. "/devices/.../block/sda/sda1"
+    guint major;
+    guint minor;
+    uint64_t seqnum;
+} Uevent;
+
+/**
+ * uevent_parse:
+ * @buffer: one netlink message: "action@devpath\0KEY=value\0..."
+ *
+ * Returns: TRUE if the message is a well-formed kernel uevent
+ */
+gboolean uevent_parse(const char* buffer, size_t length, Uevent* event);
+
+typedef struct UeventMonitor UeventMonitor;
+
+/**
+ * UeventCallback:
+ * @event: (nullable): the event, or NULL when the kernel dropped events
+ *   because the socket buffer overflowed; state derived from uevents must
+ *   then be rebuilt from scratch
+ *
+ * Invoked on the monitor thread.
+ */
+typedef void (*UeventCallback)(const Uevent* event, void* user_data);
+
+/**
+ * uevent_monitor_new:
+ * @subsystem: (nullable): only deliver events of this subsystem (e.g. "block")
+ *
+ * Opens a NETLINK_KOBJECT_UEVENT socket on the kernel multicast group. The
+ * kernel group is used rather than udev's so events arrive even without a
+ * udev daemon, before rules have run.
+ *
+ * Returns: (transfer full): the monitor, or NULL with @error set
+ */
+UeventMonitor* uevent_monitor_new(const char* subsystem, GError** error);
+void uevent_monitor_free(UeventMonitor* monitor);
+
+/**
+ * uevent_monitor_add_listener:
+ *
+ * Registers a callback. Listeners are called in registration order; add them
+ * before uevent_monitor_start().
+ */
+void uevent_monitor_add_listener(UeventMonitor* monitor,
+                                 UeventCallback callback,
+                                 void* user_data);
+
+gboolean uevent_monitor_start(UeventMonitor* monitor, GError** error);
+void uevent_monitor_stop(UeventMonitor* monitor);
+
+G_END_DECLS
+
+#endif // UEVENT_MONITOR_H
@@ -1,32 +1,359 @@
 #include "device_registry_plugin.h"
 #include "../native/device_registry.h"
+#include "../native/device_sim.h"
+#include "../native/block_topology.h"
+#include "../native/health_sampler.h"
+#include "../native/main_dispatch.h"
+#include "../native/startup_timing.h"
+#include "../native/sysfs_cache.h"
+#include "../native/uevent_monitor.h"
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Health sampling period and history depth (one hour at the default rate)
+#define HEALTH_SAMPLE_INTERVAL_MS 5000
+#define HEALTH_HISTORY_LENGTH 720
+
+// Replaces the real devices with simulated ones, e.g. "nvme:1T,hdd:4T"
+#define SIMULATED_DEVICES_ENV "SWIPE_SIMULATED_DEVICES"
+
+// The device list enumerated at launch answers the first getDeviceList;
+// later calls enumerate afresh
+typedef enum {
+  PREFETCH_NONE,      // never started, or already consumed
+  PREFETCH_RUNNING,
+  PREFETCH_READY,
+} PrefetchState;
 
 struct _DeviceRegistryPlugin {
   GObject parent_instance;
   FlMethodChannel* channel;
+  FlEventChannel* health_channel;
+  HealthSampler* health_sampler;
+  BlockTopology* topology;
+  UeventMonitor* uevent_monitor;
+  DeviceSim* simulator;                        // set when SWIPE_SIMULATED_DEVICES is
+  const DeviceBackend* backend;
+  DeviceRegistryCache* device_cache;           // memoized probes; NULL without uevents
+  PrefetchState prefetch_state;                // main thread only
+  FlValue* prefetched_devices;
+  guint64 prefetch_generation;                 // topology generation it reflects
+  std::vector<FlMethodCall*>* pending_calls;   // getDeviceList calls awaiting the prefetch
+  MainDispatch* dispatch;                      // background threads -> main loop
+};
+
+// Launch-time enumeration handed to the main loop
+struct PrefetchResult {
+  DeviceRegistryPlugin* self;                  // keeps the plugin alive for the thread
+  FlValue* devices;
 };
 
 G_DEFINE_TYPE(DeviceRegistryPlugin, device_registry_plugin, G_TYPE_OBJECT)
 
+// Register every NVMe and SATA device with the health sampler
+static void add_health_devices(DeviceRegistryPlugin* self) {
+  if (self->simulator != nullptr) {
+    return;  // the sampler only talks to real drives
+  }
+  // Type alone decides, so no drive is woken for identify data
+  static const char* const types[] = {"nvme", "sata", nullptr};
+  DeviceQuery query = {};
+  query.types = types;
+  g_autoptr(GError) error = nullptr;
+  FlValue* devices = device_registry_query(self->backend, self->device_cache, &query, &error);
+  if (devices == nullptr) {
+    return;
+  }
+
+  for (size_t i = 0; i < fl_value_get_length(devices); i++) {
+    FlValue* device = fl_value_get_list_value(devices, i);
+    const gchar* path =
+        fl_value_get_string(fl_value_lookup_string(device, "devicePath"));
+    const gchar* type =
+        fl_value_get_string(fl_value_lookup_string(device, "deviceType"));
+
+    if (strcmp(type, "nvme") == 0) {
+      health_sampler_add_device(self->health_sampler, path, HEALTH_DEVICE_NVME);
+    } else if (strcmp(type, "sata") == 0) {
+      health_sampler_add_device(self->health_sampler, path, HEALTH_DEVICE_ATA);
+    }
+  }
+
+  fl_value_unref(devices);
+}
+
+static void send_health_cb(gpointer owner, gpointer data) {
+  DeviceRegistryPlugin* self = DEVICE_REGISTRY_PLUGIN(owner);
+  if (self->health_channel != nullptr) {
+    fl_event_channel_send(self->health_channel, static_cast<FlValue*>(data), nullptr, nullptr);
+  }
+}
+
+// Called on the sampler thread after each batch. The history stays in the
+// sampler, so a batch the main loop has not sent yet is replaced by the next.
+static void health_batch_cb(HealthSampler* sampler, void* user_data) {
+  DeviceRegistryPlugin* self = DEVICE_REGISTRY_PLUGIN(user_data);
+  main_dispatch_post(self->dispatch, &self->health_channel, send_health_cb,
+                     health_sampler_latest(sampler), (GDestroyNotify)fl_value_unref);
+}
+
+// Takes the prefetched list unless hotplug has changed the topology since
+// it was collected
+static FlValue* take_prefetched_devices(DeviceRegistryPlugin* self) {
+  FlValue* devices = self->prefetched_devices;
+  self->prefetched_devices = nullptr;
+  self->prefetch_state = PREFETCH_NONE;
+  if (devices != nullptr &&
+      block_topology_generation(self->topology) != self->prefetch_generation) {
+    g_clear_pointer(&devices, fl_value_unref);
+  }
+  return devices;
+}
+
+// Answers with @devices, or runs @query (every field when NULL) for a fresh list
+static void respond_with_devices(DeviceRegistryPlugin* self,
+                                 FlMethodCall* method_call,
+                                 FlValue* devices,
+                                 const DeviceQuery* query = nullptr) {
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(FlMethodResponse) response = nullptr;
+  if (devices == nullptr) {
+    DeviceQuery all = {};
+    all.fields = DEVICE_FIELDS_ALL;
+    devices = device_registry_query(self->backend, self->device_cache,
+                                    query != nullptr ? query : &all, &error);
+  } else {
+    fl_value_ref(devices);
+  }
+
+  if (error != nullptr) {
+    response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "DEVICE_ENUM_ERROR",
+        error->message,
+        nullptr));
+  } else {
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(devices));
+    fl_value_unref(devices);
+  }
+
+  if (!fl_method_call_respond(method_call, response, nullptr)) {
+    g_warning("Failed to send getDeviceList response");
+  }
+  startup_timing_mark(STARTUP_MARK_FIRST_DEVICE_LIST);
+}
+
+// Runs on the main thread once the launch-time enumeration has finished
+static void prefetch_done_cb(gpointer owner, gpointer data) {
+  DeviceRegistryPlugin* self = DEVICE_REGISTRY_PLUGIN(owner);
+  auto* result = static_cast<PrefetchResult*>(data);
+  self->prefetched_devices = result->devices;
+  result->devices = nullptr;
+  self->prefetch_state = PREFETCH_READY;
+
+  // Calls that arrived early all share the same list
+  if (!self->pending_calls->empty()) {
+    FlValue* devices = take_prefetched_devices(self);
+    for (FlMethodCall* method_call : *self->pending_calls) {
+      respond_with_devices(self, method_call, devices);
+      g_object_unref(method_call);
+    }
+    self->pending_calls->clear();
+    if (devices != nullptr) {
+      fl_value_unref(devices);
+    }
+  }
+}
+
+static void prefetch_result_free(gpointer data) {
+  auto* result = static_cast<PrefetchResult*>(data);
+  if (result->devices != nullptr) {
+    fl_value_unref(result->devices);
+  }
+  g_object_unref(result->self);
+  delete result;
+}
+
+// Enumerate devices, including identity probes, on a background thread
+static void start_prefetch(DeviceRegistryPlugin* self) {
+  self->prefetch_state = PREFETCH_RUNNING;
+  self->prefetch_generation = block_topology_generation(self->topology);
+  g_object_ref(self);
+  std::thread([self]() {
+    // Also fills the memo, so later projected queries start warm
+    DeviceQuery all = {};
+    all.fields = DEVICE_FIELDS_ALL;
+    FlValue* devices = device_registry_query(self->backend, self->device_cache, &all, nullptr);
+    if (devices == nullptr) {
+      devices = fl_value_new_list();
+    }
+    startup_timing_mark(STARTUP_MARK_DEVICES_READY);
+    main_dispatch_post(self->dispatch, nullptr, prefetch_done_cb,
+                       new PrefetchResult{self, devices}, prefetch_result_free);
+  }).detach();
+}
+
+// Optional list of strings in @args; FALSE if present with another type
+static bool read_string_list(FlValue* args, const char* key,
+                             std::vector<const char*>* strings) {
+  FlValue* list = fl_value_lookup_string(args, key);
+  if (list == nullptr || fl_value_get_type(list) == FL_VALUE_TYPE_NULL) {
+    return true;
+  }
+  if (fl_value_get_type(list) != FL_VALUE_TYPE_LIST) {
+    return false;
+  }
+  for (size_t i = 0; i < fl_value_get_length(list); i++) {
+    FlValue* item = fl_value_get_list_value(list, i);
+    if (fl_value_get_type(item) != FL_VALUE_TYPE_STRING) {
+      return false;
+    }
+    strings->push_back(fl_value_get_string(item));
+  }
+  strings->push_back(nullptr);
+  return true;
+}
+
+// getDeviceList arguments: "fields" (group names, all when absent) and the
+// "paths", "types" and "transports" filters. The query points into @args
+// and @lists. Returns FALSE with @message set for malformed arguments.
+static bool parse_device_query(FlValue* args, DeviceQuery* query,
+                               std::vector<const char*> lists[3],
+                               const char** message) {
+  query->fields = DEVICE_FIELDS_ALL;
+  std::vector<const char*> fields;
+  if (!read_string_list(args, "fields", &fields)) {
+    *message = "fields must be a list of strings";
+    return false;
+  }
+  if (!fields.empty()) {
+    query->fields = DEVICE_FIELDS_NONE;
+    for (const char* name : fields) {
+      guint bit = name != nullptr ? device_fields_from_name(name) : 0;
+      if (name != nullptr && bit == 0) {
+        *message = "Unknown field group";
+        return false;
+      }
+      query->fields |= bit;
+    }
+  }
+
+  static const char* const keys[3] = {"paths", "types", "transports"};
+  for (int i = 0; i < 3; i++) {
+    if (!read_string_list(args, keys[i], &lists[i])) {
+      *message = "paths, types and transports must be lists of strings";
+      return false;
+    }
+  }
+  query->paths = lists[0].empty() ? nullptr : lists[0].data();
+  query->types = lists[1].empty() ? nullptr : lists[1].data();
+  query->transports = lists[2].empty() ? nullptr : lists[2].data();
+
+  FlValue* refresh = fl_value_lookup_string(args, "refresh");
+  query->refresh = refresh != nullptr && fl_value_get_type(refresh) == FL_VALUE_TYPE_BOOL &&
+                   fl_value_get_bool(refresh);
+  return true;
+}
+
 // Handle method calls from Dart
 static void method_call_handler(FlMethodChannel* channel,
                                 FlMethodCall* method_call,
                                 gpointer user_data) {
+  DeviceRegistryPlugin* self = DEVICE_REGISTRY_PLUGIN(user_data);
   const gchar* method = fl_method_call_get_name(method_call);
 
   g_autoptr(FlMethodResponse) response = nullptr;
 
   if (strcmp(method, "getDeviceList") == 0) {
+    // A projected or filtered query runs right away: it touches only what
+    // it asks for, so it need not wait for the launch-time enumeration
+    FlValue* args = fl_method_call_get_args(method_call);
+    if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP &&
+        fl_value_get_length(args) > 0) {
+      DeviceQuery query = {};
+      std::vector<const char*> lists[3];
+      const char* message = nullptr;
+      if (!parse_device_query(args, &query, lists, &message)) {
+        response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENT", message, nullptr));
+      } else {
+        respond_with_devices(self, method_call, nullptr, &query);
+        return;
+      }
+    } else if (self->prefetch_state == PREFETCH_RUNNING) {
+      // Still probing since launch: answer as soon as the result lands
+      self->pending_calls->push_back(FL_METHOD_CALL(g_object_ref(method_call)));
+      return;
+    } else {
+      FlValue* devices = self->prefetch_state == PREFETCH_READY
+                             ? take_prefetched_devices(self)
+                             : nullptr;
+      respond_with_devices(self, method_call, devices);
+      if (devices != nullptr) {
+        fl_value_unref(devices);
+      }
+      return;
+    }
+  } else if (strcmp(method, "getStartupTimings") == 0) {
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(
+        startup_timing_to_fl_value()));
+  } else if (strcmp(method, "getHealthHistory") == 0) {
+    FlValue* args = fl_method_call_get_args(method_call);
+    FlValue* path = args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP
+                        ? fl_value_lookup_string(args, "devicePath")
+                        : nullptr;
+
+    if (path == nullptr || fl_value_get_type(path) != FL_VALUE_TYPE_STRING) {
+      response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "INVALID_ARGUMENT", "devicePath is required", nullptr));
+    } else {
+      FlValue* history = health_sampler_get_history(self->health_sampler,
+                                                    fl_value_get_string(path));
+      response = FL_METHOD_RESPONSE(fl_method_success_response_new(
+          history != nullptr ? history : fl_value_new_list()));
+    }
+  } else if (strcmp(method, "getTopology") == 0) {
+    if (self->uevent_monitor == nullptr) {
+      block_topology_rescan(self->topology);  // no hotplug updates
+    }
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(
+        block_topology_to_fl_value(self->topology)));
+  } else if (strcmp(method, "getNvmeControllers") == 0) {
     g_autoptr(GError) error = nullptr;
-    FlValue* devices = device_registry_enumerate_all_devices(&error);
-    
-    if (error != nullptr) {
+    FlValue* controllers = device_registry_get_nvme_controllers(self->backend, &error);
+    if (controllers == nullptr) {
       response = FL_METHOD_RESPONSE(fl_method_error_response_new(
-          "DEVICE_ENUM_ERROR",
-          error->message,
-          nullptr));
+          "DEVICE_ENUM_ERROR", error->message, nullptr));
     } else {
-      response = FL_METHOD_RESPONSE(fl_method_success_response_new(devices));
+      response = FL_METHOD_RESPONSE(fl_method_success_response_new(controllers));
+      fl_value_unref(controllers);
+    }
+  } else if (strcmp(method, "getBackingDevices") == 0 ||
+             strcmp(method, "getDependents") == 0) {
+    // Accepts a kernel name or node path in "device", or a "mountPoint"
+    FlValue* args = fl_method_call_get_args(method_call);
+    bool is_map = args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP;
+    FlValue* device = is_map ? fl_value_lookup_string(args, "device") : nullptr;
+    FlValue* mount_point = is_map ? fl_value_lookup_string(args, "mountPoint") : nullptr;
+
+    char name[64] = "";
+    if (device != nullptr && fl_value_get_type(device) == FL_VALUE_TYPE_STRING) {
+      g_strlcpy(name, fl_value_get_string(device), sizeof(name));
+    } else if (mount_point != nullptr && fl_value_get_type(mount_point) == FL_VALUE_TYPE_STRING) {
+      block_topology_mount_source(self->topology, fl_value_get_string(mount_point),
+                                  name, sizeof(name));
+    }
+
+    bool backing = strcmp(method, "getBackingDevices") == 0;
+    FlValue* nodes = name[0] != '\0'
+        ? block_topology_walk(self->topology, name,
+                              backing ? TOPOLOGY_DOWN : TOPOLOGY_UP, TRUE, backing)
+        : nullptr;
+    if (nodes == nullptr) {
+      response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "DEVICE_NOT_FOUND", "No such block device or mount point", nullptr));
+    } else {
+      response = FL_METHOD_RESPONSE(fl_method_success_response_new(nodes));
     }
   } else {
     response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
@@ -38,34 +365,146 @@ static void method_call_handler(FlMethodChannel* channel,
   }
 }
 
+// Health event channel listen handler
+static FlMethodErrorResponse* health_listen_handler(FlEventChannel* channel,
+                                                    FlValue* args,
+                                                    gpointer user_data) {
+  DeviceRegistryPlugin* self = DEVICE_REGISTRY_PLUGIN(user_data);
+  add_health_devices(self);
+  health_sampler_start(self->health_sampler, health_batch_cb, self);
+  return nullptr;
+}
+
+// Health event channel cancel handler
+static FlMethodErrorResponse* health_cancel_handler(FlEventChannel* channel,
+                                                    FlValue* args,
+                                                    gpointer user_data) {
+  DeviceRegistryPlugin* self = DEVICE_REGISTRY_PLUGIN(user_data);
+  health_sampler_stop(self->health_sampler);
+  return nullptr;
+}
+
+// Runs on the uevent monitor thread
+static void device_cache_apply_uevent(const Uevent* event, void* user_data) {
+  DeviceRegistryPlugin* self = DEVICE_REGISTRY_PLUGIN(user_data);
+  device_registry_cache_apply_uevent(event, self->device_cache);
+  // A name that comes back may be a different disk; drop its sysfs fds
+  if (event != nullptr && strcmp(event->action, "remove") == 0 &&
+      self->backend == device_backend_linux()) {
+    sysfs_cache_forget(sysfs_cache_default(), event->devname);
+  }
+}
+
 static void device_registry_plugin_dispose(GObject* object) {
   DeviceRegistryPlugin* self = DEVICE_REGISTRY_PLUGIN(object);
+  g_clear_pointer(&self->health_sampler, health_sampler_free);
+  // Queued events never reach a disposed plugin
+  main_dispatch_close(self->dispatch);
+  // Stop delivering uevents before the graph they update goes away
+  g_clear_pointer(&self->uevent_monitor, uevent_monitor_free);
+  g_clear_pointer(&self->topology, block_topology_free);
+  g_clear_pointer(&self->prefetched_devices, fl_value_unref);
+  g_clear_pointer(&self->simulator, device_sim_free);
   g_clear_object(&self->channel);
+  g_clear_object(&self->health_channel);
   G_OBJECT_CLASS(device_registry_plugin_parent_class)->dispose(object);
 }
 
+static void device_registry_plugin_finalize(GObject* object) {
+  DeviceRegistryPlugin* self = DEVICE_REGISTRY_PLUGIN(object);
+  main_dispatch_free(self->dispatch);
+  // The prefetch thread holds a reference, so nothing queries it any more
+  device_registry_cache_free(self->device_cache);
+  delete self->pending_calls;
+  G_OBJECT_CLASS(device_registry_plugin_parent_class)->finalize(object);
+}
+
 static void device_registry_plugin_class_init(DeviceRegistryPluginClass* klass) {
   G_OBJECT_CLASS(klass)->dispose = device_registry_plugin_dispose;
+  G_OBJECT_CLASS(klass)->finalize = device_registry_plugin_finalize;
 }
 
-static void device_registry_plugin_init(DeviceRegistryPlugin* self) {}
+static void device_registry_plugin_init(DeviceRegistryPlugin* self) {
+  self->prefetch_state = PREFETCH_NONE;
+  self->prefetched_devices = nullptr;
+  self->pending_calls = new std::vector<FlMethodCall*>();
+  self->dispatch = main_dispatch_new(nullptr, 0, self);
 
-DeviceRegistryPlugin* device_registry_plugin_new(FlBinaryMessenger* messenger) {
+  // Simulated devices make probing reproducible without hardware
+  self->backend = device_backend_linux();
+  const gchar* simulated = g_getenv(SIMULATED_DEVICES_ENV);
+  if (simulated != nullptr && simulated[0] != '\0') {
+    g_autoptr(GError) sim_error = nullptr;
+    self->simulator = device_sim_new_from_string(simulated, 1.0, &sim_error);
+    if (self->simulator != nullptr) {
+      self->backend = device_sim_backend(self->simulator);
+    } else {
+      g_warning("Ignoring %s: %s", SIMULATED_DEVICES_ENV, sim_error->message);
+    }
+  }
+  self->health_sampler = health_sampler_new(health_sampler_linux_backend(),
+                                            HEALTH_SAMPLE_INTERVAL_MS,
+                                            HEALTH_HISTORY_LENGTH);
+
+  // The topology graph is built once and then follows block uevents, as
+  // do the memoized device probes
+  self->topology = block_topology_new(nullptr);
+  self->device_cache = device_registry_cache_new();
+  g_autoptr(GError) error = nullptr;
+  self->uevent_monitor = uevent_monitor_new("block", &error);
+  if (self->uevent_monitor != nullptr) {
+    uevent_monitor_add_listener(self->uevent_monitor, block_topology_apply_uevent,
+                                self->topology);
+    uevent_monitor_add_listener(self->uevent_monitor, device_cache_apply_uevent, self);
+    if (!uevent_monitor_start(self->uevent_monitor, &error)) {
+      g_clear_pointer(&self->uevent_monitor, uevent_monitor_free);
+    }
+  }
+  if (self->uevent_monitor == nullptr) {
+    g_warning("Block topology will not follow hotplug: %s", error->message);
+    // Nothing would tell the memo that a device changed
+    g_clear_pointer(&self->device_cache, device_registry_cache_free);
+  }
+}
+
+DeviceRegistryPlugin* device_registry_plugin_new_prefetching() {
   DeviceRegistryPlugin* self = DEVICE_REGISTRY_PLUGIN(
       g_object_new(device_registry_plugin_get_type(), nullptr));
+  start_prefetch(self);
+  return self;
+}
 
+void device_registry_plugin_register(DeviceRegistryPlugin* self,
+                                     FlBinaryMessenger* messenger) {
   // Create method channel
   g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
   self->channel = fl_method_channel_new(
       messenger,
       "com.swipe.device/registry",
       FL_METHOD_CODEC(codec));
-  
+
   fl_method_channel_set_method_call_handler(
       self->channel,
       method_call_handler,
       self,
       nullptr);
 
+  // Create health event channel
+  g_autoptr(FlStandardMethodCodec) health_codec = fl_standard_method_codec_new();
+  self->health_channel = fl_event_channel_new(
+      messenger,
+      "com.swipe.device/health",
+      FL_METHOD_CODEC(health_codec));
+  fl_event_channel_set_stream_handlers(
+      self->health_channel,
+      health_listen_handler,
+      health_cancel_handler,
+      self,
+      nullptr);
+}
+
+DeviceRegistryPlugin* device_registry_plugin_new(FlBinaryMessenger* messenger) {
+  DeviceRegistryPlugin* self = device_registry_plugin_new_prefetching();
+  device_registry_plugin_register(self, messenger);
   return self;
 }
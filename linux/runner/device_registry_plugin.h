@@ -9,6 +9,13 @@ G_DECLARE_FINAL_TYPE(DeviceRegistryPlugin, device_registry_plugin, DEVICE_REGIST
 
 DeviceRegistryPlugin* device_registry_plugin_new(FlBinaryMessenger* messenger);
 
+// Creates the plugin before the engine exists and starts enumerating
+// devices in the background; the first getDeviceList is answered from that
+// result. Channels are created by device_registry_plugin_register().
+DeviceRegistryPlugin* device_registry_plugin_new_prefetching();
+void device_registry_plugin_register(DeviceRegistryPlugin* self,
+                                     FlBinaryMessenger* messenger);
+
 G_END_DECLS
 
 #endif  // DEVICE_REGISTRY_PLUGIN_H_
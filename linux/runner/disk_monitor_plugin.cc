@@ -1,4 +1,8 @@
 #include "disk_monitor_plugin.h"
+#include "../native/diskstats.h"
+#include "../native/main_dispatch.h"
+#include "../native/startup_timing.h"
+#include "../native/timeseries.h"
 #include <cstring>
 #include <sstream>
 #include <vector>
@@ -8,6 +12,49 @@
 #include <chrono>
 #include <thread>
 
+// Cheap fingerprint of the disk layout; the full snapshot is only rebuilt
+// when it changes
+static const char* kStateCommand =
+    "lsblk -b -o NAME,SIZE,MOUNTPOINT,TYPE,FSTYPE --noheadings 2>/dev/null && "
+    "df -B1 --output=source,size,used,avail,pcent,target 2>/dev/null | tail -n +2";
+
+// Default period of the I/O rate stream; listeners may pass intervalMs
+static const guint kIoStatsIntervalMs = 1000;
+static const guint kIoStatsMinIntervalMs = 100;
+
+// History is recorded at 1 Hz whether or not anyone listens; while a
+// listener asks for a faster stream only the first tick of each second is
+// kept. Devices that went away are dropped once a minute.
+static const guint kHistoryIntervalMs = 1000;
+static const gint64 kHistoryExpireMs = 60000;
+static const guint kHistoryMaxPoints = 300;
+
+// Runs on the main thread; the message's destroy notify drops the value
+static void release_disks_cb(gpointer owner, gpointer data) {}
+
+// Immutable result of one collection pass. Published through an atomic
+// shared_ptr so readers never block the collector. FlValue reference counts
+// are not atomic, so the value is only referenced and released on the main
+// thread: whichever thread drops the last reference to the snapshot hands
+// the value to @dispatch.
+struct DiskSnapshot {
+  FlValue* disks;
+  MainDispatch* dispatch;
+  std::string state;
+  std::atomic<gint64> checked_us;  // last time @state was confirmed current
+  // Used bytes per device, so every check can record them without walking
+  // @disks off the main thread
+  std::vector<std::pair<std::string, double>> used_bytes;
+
+  DiskSnapshot(FlValue* disks, MainDispatch* dispatch, std::string state, gint64 checked_us)
+      : disks(disks), dispatch(dispatch), state(std::move(state)), checked_us(checked_us) {}
+  ~DiskSnapshot() {
+    main_dispatch_post(dispatch, nullptr, release_disks_cb, disks, (GDestroyNotify)fl_value_unref);
+  }
+};
+
+typedef std::shared_ptr<DiskSnapshot> DiskSnapshotPtr;
+
 struct _DiskMonitorPlugin {
   GObject parent_instance;
   FlBinaryMessenger* messenger;
@@ -15,6 +62,15 @@ struct _DiskMonitorPlugin {
   FlMethodChannel* method_channel;
   std::thread* monitor_thread;
   std::atomic<bool> monitoring;
+  DiskSnapshotPtr* snapshot;                   // accessed with std::atomic_load/store
+  std::atomic<bool> refreshing;
+  std::vector<FlMethodCall*>* pending_calls;   // main thread only
+  FlEventChannel* iostats_channel;
+  DiskStatsSampler* diskstats;                 // runs from registration on
+  std::atomic<bool> iostats_listening;
+  TimeSeriesStore* history;                    // per device and metric
+  gint64 history_expired_ms;                   // sampler thread only
+  MainDispatch* dispatch;                      // background threads -> main loop
 };
 
 G_DEFINE_TYPE(DiskMonitorPlugin, disk_monitor_plugin, G_TYPE_OBJECT)
@@ -220,17 +276,205 @@ static FlValue* get_disk_info() {
   return disk_list;
 }
 
+// Reads back the used bytes get_disk_info() stored as strings
+static std::vector<std::pair<std::string, double>> collect_used_bytes(FlValue* disks) {
+  std::vector<std::pair<std::string, double>> used_bytes;
+  for (size_t i = 0; i < fl_value_get_length(disks); i++) {
+    FlValue* disk = fl_value_get_list_value(disks, i);
+    FlValue* name = fl_value_lookup_string(disk, "name");
+    FlValue* used = fl_value_lookup_string(disk, "used");
+    if (name == nullptr || used == nullptr) continue;
+    used_bytes.emplace_back(fl_value_get_string(name),
+                            g_ascii_strtod(fl_value_get_string(used), nullptr));
+  }
+  return used_bytes;
+}
+
+static void record_used_bytes(DiskMonitorPlugin* self, const DiskSnapshotPtr& snapshot) {
+  gint64 now_ms = g_get_real_time() / 1000;
+  for (const auto& entry : snapshot->used_bytes) {
+    time_series_store_append(self->history, entry.first.c_str(), "usedBytes", now_ms,
+                             entry.second);
+  }
+}
+
+// Collect the current state and publish a new snapshot if it changed.
+// Returns the new snapshot, or nullptr when the published one is still current.
+static DiskSnapshotPtr refresh_snapshot(DiskMonitorPlugin* self) {
+  DiskSnapshotPtr current = std::atomic_load(self->snapshot);
+  std::string state = exec_command(kStateCommand);
+  gint64 now = g_get_monotonic_time();
+
+  if (current && current->state == state) {
+    current->checked_us.store(now);
+    record_used_bytes(self, current);
+    return nullptr;
+  }
+
+  DiskSnapshotPtr next = std::make_shared<DiskSnapshot>(get_disk_info(), self->dispatch,
+                                                       std::move(state), now);
+  next->used_bytes = collect_used_bytes(next->disks);
+  record_used_bytes(self, next);
+  std::atomic_store(self->snapshot, next);
+  startup_timing_mark(STARTUP_MARK_DISKS_READY);
+  return next;
+}
+
+static void respond_with_snapshot(FlMethodCall* method_call, const DiskSnapshotPtr& snapshot) {
+  g_autoptr(FlMethodResponse) response = nullptr;
+  if (snapshot) {
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(snapshot->disks));
+  } else {
+    response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "UNAVAILABLE", "Disk information could not be collected", nullptr));
+  }
+  fl_method_call_respond(method_call, response, nullptr);
+  startup_timing_mark(STARTUP_MARK_FIRST_DISK_INFO);
+}
+
+// Runs on the main thread when an async refresh has finished
+static void refresh_done_cb(gpointer owner, gpointer data) {
+  DiskMonitorPlugin* self = DISK_MONITOR_PLUGIN(owner);
+  self->refreshing.store(false);
+
+  DiskSnapshotPtr snapshot = std::atomic_load(self->snapshot);
+  for (FlMethodCall* method_call : *self->pending_calls) {
+    respond_with_snapshot(method_call, snapshot);
+    g_object_unref(method_call);
+  }
+  self->pending_calls->clear();
+}
+
+// Refresh the snapshot on a background thread unless one is already running
+static void request_refresh(DiskMonitorPlugin* self) {
+  if (self->refreshing.exchange(true)) {
+    return;
+  }
+  // The thread's reference is dropped with the message
+  g_object_ref(self);
+  std::thread([self]() {
+    refresh_snapshot(self);
+    main_dispatch_post(self->dispatch, nullptr, refresh_done_cb, self, g_object_unref);
+  }).detach();
+}
+
+// getHistory: {device, metrics?, fromMs?, toMs?, bucketMs?, maxPoints?}.
+// Defaults to every metric of the device over the whole retention window,
+// reduced to at most kHistoryMaxPoints buckets.
+static FlMethodResponse* get_history(DiskMonitorPlugin* self, FlValue* args) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENT", "device is required", nullptr));
+  }
+  FlValue* device = fl_value_lookup_string(args, "device");
+  if (device == nullptr || fl_value_get_type(device) != FL_VALUE_TYPE_STRING) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENT", "device is required", nullptr));
+  }
+  const gchar* name = fl_value_get_string(device);
+
+  TimeSeriesOptions options;
+  time_series_store_options(self->history, &options);
+  auto lookup_int = [args](const char* key, int64_t fallback) {
+    FlValue* value = fl_value_lookup_string(args, key);
+    return value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT
+        ? fl_value_get_int(value) : fallback;
+  };
+  int64_t to_ms = lookup_int("toMs", g_get_real_time() / 1000);
+  int64_t from_ms = lookup_int("fromMs", to_ms - options.retention_ms);
+  if (from_ms > to_ms) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENT", "fromMs is after toMs", nullptr));
+  }
+  int64_t bucket_ms = lookup_int("bucketMs", 0);
+  if (bucket_ms <= 0) {
+    int64_t max_points = lookup_int("maxPoints", kHistoryMaxPoints);
+    bucket_ms = time_series_store_bucket_ms(self->history, from_ms, to_ms,
+                                            static_cast<guint>(CLAMP(max_points, 1, G_MAXUINT)));
+  }
+
+  std::vector<std::string> metrics;
+  FlValue* requested = fl_value_lookup_string(args, "metrics");
+  if (requested != nullptr && fl_value_get_type(requested) == FL_VALUE_TYPE_LIST) {
+    for (size_t i = 0; i < fl_value_get_length(requested); i++) {
+      FlValue* metric = fl_value_get_list_value(requested, i);
+      if (fl_value_get_type(metric) == FL_VALUE_TYPE_STRING) {
+        metrics.emplace_back(fl_value_get_string(metric));
+      }
+    }
+  } else {
+    GPtrArray* names = time_series_store_metrics(self->history, name);
+    if (names != nullptr) {
+      for (guint i = 0; i < names->len; i++) {
+        metrics.emplace_back(static_cast<const char*>(g_ptr_array_index(names, i)));
+      }
+      g_ptr_array_free(names, TRUE);
+    }
+  }
+
+  // Metrics with nothing recorded are left out
+  FlValue* series = fl_value_new_map();
+  for (const std::string& metric : metrics) {
+    GArray* buckets = time_series_store_query(self->history, name, metric.c_str(),
+                                              from_ms, to_ms, bucket_ms);
+    if (buckets == nullptr) continue;
+    fl_value_set_string_take(series, metric.c_str(), time_series_buckets_to_fl_value(buckets));
+    g_array_free(buckets, TRUE);
+  }
+
+  g_autoptr(FlValue) result = fl_value_new_map();
+  fl_value_set_string_take(result, "device", fl_value_new_string(name));
+  fl_value_set_string_take(result, "fromMs", fl_value_new_int(from_ms));
+  fl_value_set_string_take(result, "toMs", fl_value_new_int(to_ms));
+  fl_value_set_string_take(result, "bucketMs", fl_value_new_int(bucket_ms));
+  fl_value_set_string_take(result, "series", series);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
 // Method call handler
 static void method_call_handler(FlMethodChannel* channel,
                                 FlMethodCall* method_call,
                                 gpointer user_data) {
+  DiskMonitorPlugin* self = DISK_MONITOR_PLUGIN(user_data);
   const gchar* method = fl_method_call_get_name(method_call);
+  FlValue* args = fl_method_call_get_args(method_call);
   
   g_autoptr(FlMethodResponse) response = nullptr;
   
   if (strcmp(method, "getDiskInfo") == 0) {
-    FlValue* disk_info = get_disk_info();
-    response = FL_METHOD_RESPONSE(fl_method_success_response_new(disk_info));
+    // Optional staleness bound; a stale snapshot is still returned at once
+    // and a refresh is started in the background
+    int64_t max_age_ms = -1;
+    if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+      FlValue* value = fl_value_lookup_string(args, "maxAgeMs");
+      if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+        max_age_ms = fl_value_get_int(value);
+      }
+    }
+
+    DiskSnapshotPtr snapshot = std::atomic_load(self->snapshot);
+    if (!snapshot) {
+      // Nothing collected yet: answer once the first snapshot exists
+      self->pending_calls->push_back(FL_METHOD_CALL(g_object_ref(method_call)));
+      request_refresh(self);
+      return;
+    }
+
+    gint64 age_us = g_get_monotonic_time() - snapshot->checked_us.load();
+    if (max_age_ms >= 0 && age_us > max_age_ms * 1000) {
+      request_refresh(self);
+    }
+    respond_with_snapshot(method_call, snapshot);
+    return;
+  } else if (strcmp(method, "getHistory") == 0) {
+    response = get_history(self, args);
+  } else if (strcmp(method, "getHistoryStats") == 0) {
+    TimeSeriesStats stats;
+    TimeSeriesOptions options;
+    time_series_store_stats(self->history, &stats);
+    time_series_store_options(self->history, &options);
+    g_autoptr(FlValue) result = time_series_stats_to_fl_value(&stats, &options);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(result));
   } else {
     response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
   }
@@ -256,30 +500,129 @@ static FlMethodErrorResponse* cancel_handler(FlEventChannel* channel,
   return nullptr;
 }
 
+static void send_iostats_cb(gpointer owner, gpointer data) {
+  DiskMonitorPlugin* self = DISK_MONITOR_PLUGIN(owner);
+  if (self->iostats_channel != nullptr) {
+    fl_event_channel_send(self->iostats_channel, static_cast<FlValue*>(data), nullptr, nullptr);
+  }
+}
+
+struct HistoryTick {
+  TimeSeriesStore* history;
+  gint64 now_ms;
+};
+
+static void record_rates(const DiskIoRates* rates, void* user_data) {
+  const HistoryTick* tick = static_cast<const HistoryTick*>(user_data);
+  time_series_store_append(tick->history, rates->name, "readBytesPerSec", tick->now_ms,
+                           rates->read_bytes_per_sec);
+  time_series_store_append(tick->history, rates->name, "writeBytesPerSec", tick->now_ms,
+                           rates->write_bytes_per_sec);
+  time_series_store_append(tick->history, rates->name, "readIops", tick->now_ms,
+                           rates->read_iops);
+  time_series_store_append(tick->history, rates->name, "writeIops", tick->now_ms,
+                           rates->write_iops);
+  time_series_store_append(tick->history, rates->name, "utilization", tick->now_ms,
+                           rates->utilization);
+}
+
+// Called on the sampler thread after each /proc/diskstats tick. Every tick
+// goes into the history; listeners get the rates, and rates the main loop
+// has not caught up with are replaced by the newer ones.
+static void iostats_tick_cb(DiskStatsSampler* sampler, void* user_data) {
+  DiskMonitorPlugin* self = DISK_MONITOR_PLUGIN(user_data);
+  HistoryTick tick = {self->history, g_get_real_time() / 1000};
+  diskstats_sampler_foreach(sampler, record_rates, &tick);
+  if (tick.now_ms - self->history_expired_ms >= kHistoryExpireMs) {
+    time_series_store_expire(self->history, tick.now_ms);
+    self->history_expired_ms = tick.now_ms;
+  }
+
+  if (self->iostats_listening.load()) {
+    main_dispatch_post(self->dispatch, &self->iostats_channel, send_iostats_cb,
+                       diskstats_sampler_rates(sampler), (GDestroyNotify)fl_value_unref);
+  }
+}
+
+// Starts the sampler at the history rate; the I/O stats stream speeds it up
+// while it is listened to
+static void start_history(DiskMonitorPlugin* self) {
+  g_autoptr(GError) error = nullptr;
+  self->diskstats = diskstats_sampler_new(nullptr, kHistoryIntervalMs, &error);
+  if (self->diskstats == nullptr) {
+    g_warning("Disk history unavailable: %s", error->message);
+    return;
+  }
+  diskstats_sampler_start(self->diskstats, iostats_tick_cb, self);
+}
+
+// I/O stats listen handler; args may carry {intervalMs}
+static FlMethodErrorResponse* iostats_listen_handler(FlEventChannel* channel,
+                                                     FlValue* args,
+                                                     gpointer user_data) {
+  DiskMonitorPlugin* self = DISK_MONITOR_PLUGIN(user_data);
+
+  guint interval_ms = kIoStatsIntervalMs;
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+    FlValue* value = fl_value_lookup_string(args, "intervalMs");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+      interval_ms = static_cast<guint>(MAX(fl_value_get_int(value), kIoStatsMinIntervalMs));
+    }
+  }
+
+  if (self->diskstats == nullptr) {
+    g_autoptr(GError) error = nullptr;
+    self->diskstats = diskstats_sampler_new(nullptr, interval_ms, &error);
+    if (self->diskstats == nullptr) {
+      return fl_method_error_response_new("IOSTATS_UNAVAILABLE", error->message, nullptr);
+    }
+  } else {
+    diskstats_sampler_set_interval(self->diskstats, interval_ms);
+  }
+
+  self->iostats_listening.store(true);
+  diskstats_sampler_start(self->diskstats, iostats_tick_cb, self);
+  return nullptr;
+}
+
+// I/O stats cancel handler; the sampler keeps recording history
+static FlMethodErrorResponse* iostats_cancel_handler(FlEventChannel* channel,
+                                                     FlValue* args,
+                                                     gpointer user_data) {
+  DiskMonitorPlugin* self = DISK_MONITOR_PLUGIN(user_data);
+  self->iostats_listening.store(false);
+  if (self->diskstats != nullptr) {
+    diskstats_sampler_set_interval(self->diskstats, kHistoryIntervalMs);
+  }
+  return nullptr;
+}
+
+static void send_snapshot_cb(gpointer owner, gpointer data) {
+  DiskMonitorPlugin* self = DISK_MONITOR_PLUGIN(owner);
+  fl_event_channel_send(self->event_channel, (*static_cast<DiskSnapshotPtr*>(data))->disks,
+                        nullptr, nullptr);
+}
+
+static void snapshot_ptr_free(gpointer data) {
+  delete static_cast<DiskSnapshotPtr*>(data);
+}
+
 // Monitoring thread function with udev monitoring
 static void monitor_thread_func(DiskMonitorPlugin* self) {
-  std::string last_state = "";
+  bool first = true;
   
   while (self->monitoring.load()) {
-    // Get current disk state
-    std::string current_state = exec_command(
-      "lsblk -b -o NAME,SIZE,MOUNTPOINT,TYPE,FSTYPE --noheadings 2>/dev/null && "
-      "df -B1 --output=source,size,used,avail,pcent,target 2>/dev/null | tail -n +2"
-    );
+    // Publish a new snapshot if the state changed
+    DiskSnapshotPtr snapshot = refresh_snapshot(self);
+    if (!snapshot && first) {
+      snapshot = std::atomic_load(self->snapshot);
+    }
+    first = false;
     
-    // Only send update if state changed
-    if (current_state != last_state) {
-      FlValue* disk_info = get_disk_info();
-      
-      // Send event to Flutter on main thread
-      g_idle_add([](gpointer user_data) -> gboolean {
-        auto* data = static_cast<std::pair<DiskMonitorPlugin*, FlValue*>*>(user_data);
-        fl_event_channel_send(data->first->event_channel, data->second, nullptr, nullptr);
-        delete data;
-        return G_SOURCE_REMOVE;
-      }, new std::pair<DiskMonitorPlugin*, FlValue*>(self, disk_info));
-      
-      last_state = current_state;
+    if (snapshot) {
+      // Send event to Flutter on main thread; only the newest snapshot matters
+      main_dispatch_post(self->dispatch, &self->event_channel, send_snapshot_cb,
+                         new DiskSnapshotPtr(snapshot), snapshot_ptr_free);
     }
     
     // Check every 500ms for faster response
@@ -313,27 +656,61 @@ static void disk_monitor_plugin_dispose(GObject* object) {
   DiskMonitorPlugin* self = DISK_MONITOR_PLUGIN(object);
   
   disk_monitor_plugin_stop_monitoring(self);
+  g_clear_pointer(&self->diskstats, diskstats_sampler_free);
+  // Queued events never reach a disposed plugin
+  main_dispatch_close(self->dispatch);
   
   g_clear_object(&self->messenger);
   g_clear_object(&self->event_channel);
+  g_clear_object(&self->iostats_channel);
   g_clear_object(&self->method_channel);
   
   G_OBJECT_CLASS(disk_monitor_plugin_parent_class)->dispose(object);
 }
 
+static void disk_monitor_plugin_finalize(GObject* object) {
+  DiskMonitorPlugin* self = DISK_MONITOR_PLUGIN(object);
+  
+  // The closed dispatch releases the last snapshot's value right here
+  delete self->snapshot;
+  main_dispatch_free(self->dispatch);
+  // Detached refresh threads may record usage until they drop their reference
+  time_series_store_free(self->history);
+  delete self->pending_calls;
+  
+  G_OBJECT_CLASS(disk_monitor_plugin_parent_class)->finalize(object);
+}
+
 static void disk_monitor_plugin_class_init(DiskMonitorPluginClass* klass) {
   G_OBJECT_CLASS(klass)->dispose = disk_monitor_plugin_dispose;
+  G_OBJECT_CLASS(klass)->finalize = disk_monitor_plugin_finalize;
 }
 
 static void disk_monitor_plugin_init(DiskMonitorPlugin* self) {
   self->monitor_thread = nullptr;
   self->monitoring.store(false);
+  self->snapshot = new DiskSnapshotPtr();
+  self->refreshing.store(false);
+  self->pending_calls = new std::vector<FlMethodCall*>();
+  self->iostats_channel = nullptr;
+  self->diskstats = nullptr;
+  self->iostats_listening.store(false);
+  self->history = time_series_store_new(nullptr);
+  self->history_expired_ms = 0;
+  self->dispatch = main_dispatch_new(nullptr, 0, self);
 }
 
-DiskMonitorPlugin* disk_monitor_plugin_new(FlBinaryMessenger* messenger) {
+DiskMonitorPlugin* disk_monitor_plugin_new_prefetching() {
   DiskMonitorPlugin* self = DISK_MONITOR_PLUGIN(
       g_object_new(disk_monitor_plugin_get_type(), nullptr));
   
+  // Collect the first snapshot off the main thread
+  request_refresh(self);
+  
+  return self;
+}
+
+void disk_monitor_plugin_register(DiskMonitorPlugin* self, FlBinaryMessenger* messenger) {
   self->messenger = FL_BINARY_MESSENGER(g_object_ref(messenger));
   
   // Create method channel
@@ -361,5 +738,24 @@ DiskMonitorPlugin* disk_monitor_plugin_new(FlBinaryMessenger* messenger) {
       self,
       nullptr);
   
+  // Create I/O rate event channel
+  g_autoptr(FlStandardMethodCodec) iostats_codec = fl_standard_method_codec_new();
+  self->iostats_channel = fl_event_channel_new(
+      messenger,
+      "disk_monitor/iostats",
+      FL_METHOD_CODEC(iostats_codec));
+  fl_event_channel_set_stream_handlers(
+      self->iostats_channel,
+      iostats_listen_handler,
+      iostats_cancel_handler,
+      self,
+      nullptr);
+
+  start_history(self);
+}
+
+DiskMonitorPlugin* disk_monitor_plugin_new(FlBinaryMessenger* messenger) {
+  DiskMonitorPlugin* self = disk_monitor_plugin_new_prefetching();
+  disk_monitor_plugin_register(self, messenger);
   return self;
 }
@@ -12,6 +12,11 @@ G_DECLARE_FINAL_TYPE(DiskMonitorPlugin, disk_monitor_plugin, DISK_MONITOR, PLUGI
 
 DiskMonitorPlugin* disk_monitor_plugin_new(FlBinaryMessenger* messenger);
 
+// Creates the plugin before the engine exists and starts collecting the
+// first snapshot; channels are created by disk_monitor_plugin_register()
+DiskMonitorPlugin* disk_monitor_plugin_new_prefetching();
+void disk_monitor_plugin_register(DiskMonitorPlugin* self, FlBinaryMessenger* messenger);
+
 void disk_monitor_plugin_start_monitoring(DiskMonitorPlugin* self);
 void disk_monitor_plugin_stop_monitoring(DiskMonitorPlugin* self);
 
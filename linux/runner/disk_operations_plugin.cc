@@ -0,0 +1,1169 @@
+#include "disk_operations_plugin.h"
+#include "../native/audit_log.h"
+#include "../native/busy_scan.h"
+#include "../native/discard.h"
+#include "../native/entropy_profile.h"
+#include "../native/free_space_wipe.h"
+#include "../native/health_sampler.h"
+#include "../native/io_autotune.h"
+#include "../native/luks_erase.h"
+#include "../native/main_dispatch.h"
+#include "../native/merkle_hash.h"
+#include "../native/numa_placement.h"
+#include "../native/range_wipe.h"
+#include "../native/surface_scan.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include <unistd.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Directory holding a fake "sys" and "proc" tree for NUMA placement, so
+// node and IRQ affinity lookups can be exercised on a single-node machine
+#define PLACEMENT_ROOT_ENV "SWIPE_PLACEMENT_ROOT"
+
+// How often the health log is read for the throttle when the drive has no
+// hwmon sensor
+#define TEMPERATURE_INTERVAL_MS 2000
+
+struct Operation;
+
+// Runs on the operation's worker thread. Returns the success value or NULL
+// with @error set.
+typedef FlValue* (*OperationFunc)(Operation* operation, GError** error);
+
+struct Operation {
+  DiskOperationsPlugin* plugin;
+  std::string name;
+  std::string device_path;
+  FlMethodCall* method_call;
+  FlValue* args;
+  OperationFunc func;
+  AuditRecord* audit;
+  gint cancel;
+  std::thread thread;
+  FlValue* result;
+  GError* error;
+};
+
+struct _DiskOperationsPlugin {
+  GObject parent_instance;
+  FlMethodChannel* channel;
+  FlEventChannel* progress_channel;
+  std::mutex* lock;
+  std::list<Operation*>* operations;
+  gchar* audit_path;
+  AuditLog* audit_log;
+  AuditReader* audit_reader;
+  MainDispatch* dispatch;          // worker threads -> main loop
+  IoAutotuneCache* autotune_cache; // per model and firmware
+};
+
+G_DEFINE_TYPE(DiskOperationsPlugin, disk_operations_plugin, G_TYPE_OBJECT)
+
+// Argument helpers
+
+static FlValue* lookup_arg(FlValue* args, const char* key, FlValueType type) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return nullptr;
+  }
+  FlValue* value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != type) {
+    return nullptr;
+  }
+  return value;
+}
+
+static const gchar* lookup_string(FlValue* args, const char* key) {
+  FlValue* value = lookup_arg(args, key, FL_VALUE_TYPE_STRING);
+  return value != nullptr ? fl_value_get_string(value) : nullptr;
+}
+
+static int64_t lookup_int(FlValue* args, const char* key, int64_t fallback) {
+  FlValue* value = lookup_arg(args, key, FL_VALUE_TYPE_INT);
+  return value != nullptr ? fl_value_get_int(value) : fallback;
+}
+
+static bool lookup_bool(FlValue* args, const char* key, bool fallback) {
+  FlValue* value = lookup_arg(args, key, FL_VALUE_TYPE_BOOL);
+  return value != nullptr ? fl_value_get_bool(value) : fallback;
+}
+
+static bool lookup_pattern(FlValue* args, BulkPattern* pattern) {
+  const gchar* name = lookup_string(args, "pattern");
+  if (name == nullptr || strcmp(name, "zeros") == 0) {
+    *pattern = BULK_PATTERN_ZEROS;
+  } else if (strcmp(name, "ones") == 0) {
+    *pattern = BULK_PATTERN_ONES;
+  } else if (strcmp(name, "random") == 0) {
+    *pattern = BULK_PATTERN_RANDOM;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Kernel name of a whole-disk node ("/dev/sda" -> "sda"), empty for files
+static std::string disk_name_for_path(const char* device_path) {
+  struct stat st;
+  if (stat(device_path, &st) < 0 || !S_ISBLK(st.st_mode)) {
+    return std::string();
+  }
+  const char* slash = strrchr(device_path, '/');
+  return slash != nullptr ? slash + 1 : device_path;
+}
+
+static const gchar* placement_root() {
+  const gchar* root = g_getenv(PLACEMENT_ROOT_ENV);
+  return root != nullptr && root[0] != '\0' ? root : nullptr;
+}
+
+// Where the device's I/O threads should run. FALSE for image files, when
+// the caller passed numaPlacement: false, or when there is no node to pin to.
+static bool probe_placement(FlValue* args, const char* device_path, NumaPlacement* placement) {
+  std::string name = disk_name_for_path(device_path);
+  if (name.empty() || !lookup_bool(args, "numaPlacement", true)) {
+    return false;
+  }
+  if (!numa_placement_probe(placement_root(), name.c_str(), placement)) {
+    return false;
+  }
+  placement->huge_pages = lookup_bool(args, "hugePages", false);
+  return placement->cpu_count > 0;
+}
+
+static void send_progress_cb(gpointer owner, gpointer data) {
+  DiskOperationsPlugin* self = DISK_OPERATIONS_PLUGIN(owner);
+  if (self->progress_channel != nullptr) {
+    fl_event_channel_send(self->progress_channel, static_cast<FlValue*>(data), nullptr, nullptr);
+  }
+}
+
+// Send a progress event to Flutter on the main thread. An event the main
+// loop has not sent yet is replaced by the operation's next one.
+static void send_progress(Operation* operation, FlValue* event) {
+  main_dispatch_post(operation->plugin->dispatch, operation, send_progress_cb,
+                     event, (GDestroyNotify)fl_value_unref);
+}
+
+// BulkProgressCallback shared by all operations
+static void operation_progress_cb(const BulkProgress* progress, void* user_data) {
+  Operation* operation = static_cast<Operation*>(user_data);
+
+  FlValue* event = fl_value_new_map();
+  fl_value_set_string_take(event, "operation", fl_value_new_string(operation->name.c_str()));
+  fl_value_set_string_take(event, "devicePath", fl_value_new_string(operation->device_path.c_str()));
+  fl_value_set_string_take(event, "bytesDone", fl_value_new_int((int64_t)progress->bytes_done));
+  fl_value_set_string_take(event, "bytesTotal", fl_value_new_int((int64_t)progress->bytes_total));
+  fl_value_set_string_take(event, "elapsedUs", fl_value_new_int(progress->elapsed_us));
+  if (progress->bytes_verified > 0) {
+    fl_value_set_string_take(event, "bytesVerified", fl_value_new_int((int64_t)progress->bytes_verified));
+  }
+  if (progress->throttle != nullptr) {
+    fl_value_set_string_take(event, "throttle", io_throttle_state_to_fl_value(progress->throttle));
+  }
+  send_progress(operation, event);
+}
+
+// Record one pass of @operation for the audit log
+static void add_audit_pass(Operation* operation,
+                           const char* pattern,
+                           gint64 started_us,
+                           uint64_t bytes,
+                           gint64 elapsed_us) {
+  AuditRecord* audit = operation->audit;
+  if (audit->pass_count >= AUDIT_MAX_PASSES) {
+    return;
+  }
+  AuditPass* pass = &audit->passes[audit->pass_count++];
+  g_strlcpy(pass->pattern, pattern, sizeof(pass->pattern));
+  pass->started_us = started_us;
+  pass->finished_us = started_us + elapsed_us;
+  pass->bytes = bytes;
+  pass->throughput_bps = elapsed_us > 0 ? (uint64_t)(bytes * 1000000.0 / elapsed_us) : 0;
+  pass->verify = AUDIT_VERIFY_NONE;
+}
+
+// Open a device for a destructive operation. O_EXCL on a block device fails
+// while it is mounted or otherwise claimed.
+static int open_for_write(const char* device_path, GError** error) {
+  int fd = open(device_path, O_RDWR | O_EXCL | O_CLOEXEC);
+  if (fd < 0) {
+    g_set_error(error, G_IO_ERROR,
+                errno == EBUSY ? G_IO_ERROR_BUSY : G_IO_ERROR_FAILED,
+                "Failed to open %s: %s", device_path, strerror(errno));
+  }
+  return fd;
+}
+
+// Open a device for a full read pass. O_DIRECT keeps the page cache from
+// answering (and being flushed by) the reads; files on filesystems without
+// O_DIRECT support are read buffered.
+static int open_for_read(const char* device_path, GError** error) {
+  int fd = open(device_path, O_RDONLY | O_DIRECT | O_CLOEXEC);
+  if (fd < 0 && errno == EINVAL) {
+    fd = open(device_path, O_RDONLY | O_CLOEXEC);
+  }
+  if (fd < 0) {
+    int saved = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                "Failed to open %s: %s", device_path, strerror(saved));
+  }
+  return fd;
+}
+
+// Temperature of the disk an operation writes to, for its throttle: the
+// drive's hwmon sensor when the kernel exposes one, otherwise the SMART or
+// NVMe health log, read by a sampler running for the length of the operation
+struct TemperatureSource {
+  std::string disk_name;
+  std::string device_path;
+  HealthSampler* sampler;
+};
+
+// IoTemperatureSource over a TemperatureSource
+static int operation_temperature_cb(void* data) {
+  TemperatureSource* source = static_cast<TemperatureSource*>(data);
+  if (source->sampler == nullptr) {
+    return io_throttle_hwmon_temperature(const_cast<char*>(source->disk_name.c_str()));
+  }
+  HealthSample sample;
+  if (!health_sampler_get_sample(source->sampler, source->device_path.c_str(), &sample) ||
+      sample.temperature_celsius == HEALTH_TEMPERATURE_UNKNOWN) {
+    return IO_THROTTLE_TEMPERATURE_UNKNOWN;
+  }
+  return sample.temperature_celsius;
+}
+
+// FALSE when the disk reports its temperature neither way
+static bool start_temperature_source(const char* device_path, const std::string& disk_name,
+                                     TemperatureSource* source) {
+  source->disk_name = disk_name;
+  source->device_path = device_path;
+  source->sampler = nullptr;
+  if (operation_temperature_cb(source) != IO_THROTTLE_TEMPERATURE_UNKNOWN) {
+    return true;
+  }
+
+  HealthDeviceKind kind = g_str_has_prefix(disk_name.c_str(), "nvme") ? HEALTH_DEVICE_NVME
+                                                                      : HEALTH_DEVICE_ATA;
+  source->sampler = health_sampler_new(health_sampler_linux_backend(), TEMPERATURE_INTERVAL_MS, 1);
+  health_sampler_add_device(source->sampler, device_path, kind);
+  health_sampler_sample_all(source->sampler);
+  if (operation_temperature_cb(source) == IO_THROTTLE_TEMPERATURE_UNKNOWN ||
+      !health_sampler_start(source->sampler, nullptr, nullptr)) {
+    g_clear_pointer(&source->sampler, health_sampler_free);
+    return false;
+  }
+  return true;
+}
+
+static void stop_temperature_source(TemperatureSource* source) {
+  if (source->sampler != nullptr) {
+    health_sampler_stop(source->sampler);
+    g_clear_pointer(&source->sampler, health_sampler_free);
+  }
+}
+
+// Block size and queue depth for the operation's device, from the cache
+// when a drive of the same model and firmware was tuned before. The probe
+// reads or writes [offset, offset + length) through @fd, which must be open
+// O_DIRECT. FALSE with @error set when the probe failed or was cancelled.
+static bool autotune_device(Operation* operation, int fd, IoAutotuneMode mode,
+                            uint64_t offset, uint64_t length,
+                            IoAutotuneResult* result, GError** error) {
+  IoAutotuneCache* cache = operation->plugin->autotune_cache;
+  const char* device_path = operation->device_path.c_str();
+  AuditRecord* audit = operation->audit;
+  audit_read_identity(device_path, audit);
+  if (!lookup_bool(operation->args, "autotuneRefresh", false) &&
+      io_autotune_cache_lookup(cache, audit->model, audit->firmware, mode, result)) {
+    return true;
+  }
+
+  IoAutotuneOptions options;
+  io_autotune_default_options(&options);
+  options.mode = mode;
+  options.offset = offset;
+  options.length = length;
+  options.cancel = &operation->cancel;
+  std::string disk_name = disk_name_for_path(device_path);
+  if (!io_autotune_run(fd, disk_name.empty() ? nullptr : disk_name.c_str(), &options, result, error)) {
+    return false;
+  }
+  io_autotune_cache_store(cache, audit->model, audit->firmware, result);
+  return true;
+}
+
+// Operations
+
+static FlValue* discard_operation(Operation* operation, GError** error) {
+  FlValue* args = operation->args;
+  int fd = open_for_write(operation->device_path.c_str(), error);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  uint64_t size = 0;
+  if (!bulk_io_device_size(fd, &size)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to get device size");
+    close(fd);
+    return nullptr;
+  }
+
+  DiscardOptions options = {};
+  options.offset = (uint64_t)lookup_int(args, "offset", 0);
+  options.length = (uint64_t)lookup_int(args, "length", (int64_t)(size - MIN(options.offset, size)));
+  options.fallback_to_overwrite = lookup_bool(args, "fallbackToOverwrite", false);
+  options.progress = operation_progress_cb;
+  options.user_data = operation;
+  options.cancel = &operation->cancel;
+
+  const gchar* mode = lookup_string(args, "mode");
+  if (mode == nullptr || strcmp(mode, "discard") == 0) {
+    options.mode = DISCARD_MODE_DISCARD;
+  } else if (strcmp(mode, "secureDiscard") == 0) {
+    options.mode = DISCARD_MODE_SECURE_DISCARD;
+  } else if (strcmp(mode, "zeroOut") == 0) {
+    options.mode = DISCARD_MODE_ZEROOUT;
+  } else {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Unknown mode: %s", mode);
+    close(fd);
+    return nullptr;
+  }
+
+  if (options.offset > size || options.length > size - options.offset) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Range exceeds device size");
+    close(fd);
+    return nullptr;
+  }
+
+  DiscardResult result = {};
+  gint64 started_us = g_get_real_time();
+  gboolean ok = discard_range(fd, &options, &result, error);
+  close(fd);
+  add_audit_pass(operation, result.used_fallback ? "zeros" : mode != nullptr ? mode : "discard",
+                 started_us, result.bytes_done, result.elapsed_us);
+  if (!ok) {
+    return nullptr;
+  }
+
+  FlValue* value = fl_value_new_map();
+  fl_value_set_string_take(value, "bytesDone", fl_value_new_int((int64_t)result.bytes_done));
+  fl_value_set_string_take(value, "elapsedUs", fl_value_new_int(result.elapsed_us));
+  fl_value_set_string_take(value, "usedFallback", fl_value_new_bool(result.used_fallback));
+  fl_value_set_string_take(value, "readsZero", fl_value_new_bool(result.reads_zero));
+  return value;
+}
+
+// Destroys the LUKS headers and keyslot areas. An unlocked volume is held by
+// its dm-crypt mapping, so open_for_write() refuses it while the kernel
+// still has the volume key.
+static FlValue* crypto_erase_operation(Operation* operation, GError** error) {
+  int fd = open_for_write(operation->device_path.c_str(), error);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  LuksEraseResult result;
+  gint64 started_us = g_get_real_time();
+  gboolean ok = luks_crypto_erase(fd, &result, error);
+  close(fd);
+  if (result.bytes_written > 0) {
+    AuditRecord* audit = operation->audit;
+    add_audit_pass(operation, "crypto-erase", started_us, result.bytes_written, result.elapsed_us);
+    audit->passes[audit->pass_count - 1].verify =
+        result.verified ? AUDIT_VERIFY_PASSED : AUDIT_VERIFY_FAILED;
+  }
+  if (!ok) {
+    return nullptr;
+  }
+
+  FlValue* value = fl_value_new_map();
+  fl_value_set_string_take(value, "layout", luks_layout_to_fl_value(&result.layout));
+  fl_value_set_string_take(value, "bytesWritten", fl_value_new_int((int64_t)result.bytes_written));
+  fl_value_set_string_take(value, "elapsedUs", fl_value_new_int(result.elapsed_us));
+  fl_value_set_string_take(value, "verified", fl_value_new_bool(result.verified));
+  return value;
+}
+
+// SurfaceScanProgressCallback: progress plus the heatmap, one byte per cell
+static void surface_scan_progress_cb(const SurfaceScanProgress* progress, void* user_data) {
+  Operation* operation = static_cast<Operation*>(user_data);
+
+  FlValue* event = fl_value_new_map();
+  fl_value_set_string_take(event, "operation", fl_value_new_string(operation->name.c_str()));
+  fl_value_set_string_take(event, "devicePath", fl_value_new_string(operation->device_path.c_str()));
+  fl_value_set_string_take(event, "bytesDone", fl_value_new_int((int64_t)progress->bytes_done));
+  fl_value_set_string_take(event, "bytesTotal", fl_value_new_int((int64_t)progress->bytes_total));
+  fl_value_set_string_take(event, "elapsedUs", fl_value_new_int(progress->elapsed_us));
+  fl_value_set_string_take(event, "badSectors", fl_value_new_int((int64_t)progress->bad_sectors));
+  fl_value_set_string_take(event, "heatmap", fl_value_new_uint8_list(progress->heatmap, progress->cells));
+  fl_value_set_string_take(event, "cellSize", fl_value_new_int((int64_t)progress->cell_size));
+  send_progress(operation, event);
+}
+
+// Read-only surface scan
+static FlValue* surface_scan_operation(Operation* operation, GError** error) {
+  FlValue* args = operation->args;
+  const char* device_path = operation->device_path.c_str();
+  int fd = open_for_read(device_path, error);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  SurfaceScanOptions options;
+  surface_scan_default_options(&options);
+  int block_size = 0;
+  if (ioctl(fd, BLKSSZGET, &block_size) == 0 && block_size > 0) {
+    options.block_size = (guint)block_size;
+  }
+  // Several streams keep an SSD's queue busy; a disk only gets one unless
+  // asked, since streams in different places make the head seek
+  std::string disk_name = disk_name_for_path(device_path);
+  uint64_t rotational = 0;
+  if (!disk_name.empty()) {
+    device_backend_read_u64(device_backend_linux(), disk_name.c_str(), "queue/rotational", &rotational);
+  }
+  options.regions = (guint)lookup_int(args, "regions", rotational ? 1 : 4);
+  options.offset = (uint64_t)lookup_int(args, "offset", 0);
+  options.length = (uint64_t)lookup_int(args, "length", 0);
+  options.chunk_size = (size_t)lookup_int(args, "chunkSize", (int64_t)options.chunk_size);
+  options.cells = (guint)lookup_int(args, "cells", options.cells);
+  options.slow_threshold_us = (guint)lookup_int(args, "slowThresholdUs", 0);
+  options.progress = surface_scan_progress_cb;
+  options.user_data = operation;
+  options.cancel = &operation->cancel;
+  NumaPlacement placement;
+  NumaPlacementStats placement_stats = {};
+  bool placed = probe_placement(args, device_path, &placement);
+  if (placed) {
+    options.placement = &placement;
+    options.placement_stats = &placement_stats;
+  }
+
+  // Disks keep a single stream; only the transfer size is tuned for them
+  IoAutotuneResult tuned;
+  bool autotune = lookup_bool(args, "autotune", false);
+  if (autotune) {
+    if (!autotune_device(operation, fd, IO_AUTOTUNE_READ, options.offset, 0, &tuned, error)) {
+      close(fd);
+      return nullptr;
+    }
+    if (lookup_arg(args, "chunkSize", FL_VALUE_TYPE_INT) == nullptr) {
+      options.chunk_size = tuned.block_size;
+    }
+    if (!rotational && lookup_arg(args, "regions", FL_VALUE_TYPE_INT) == nullptr) {
+      options.regions = MIN(tuned.queue_depth, (guint)SURFACE_SCAN_MAX_REGIONS);
+    }
+  }
+
+  SurfaceScanResult result;
+  gint64 started_us = g_get_real_time();
+  gboolean ok = surface_scan_run(fd, &options, &result, error);
+  close(fd);
+  if (result.bytes_read > 0) {
+    AuditRecord* audit = operation->audit;
+    add_audit_pass(operation, "surface-scan", started_us, result.bytes_read, result.elapsed_us);
+    audit->passes[audit->pass_count - 1].verify =
+        result.bad_sectors == 0 ? AUDIT_VERIFY_PASSED : AUDIT_VERIFY_FAILED;
+  }
+
+  FlValue* value = ok ? surface_scan_result_to_fl_value(&result) : nullptr;
+  if (value != nullptr && placed) {
+    fl_value_set_string_take(value, "placement",
+                             numa_placement_to_fl_value(&placement, &placement_stats));
+  }
+  if (value != nullptr && autotune) {
+    fl_value_set_string_take(value, "autotune", io_autotune_result_to_fl_value(&tuned));
+  }
+  surface_scan_result_clear(&result);
+  return value;
+}
+
+// Merkle root of the device content for sanitization certificates. Region
+// roots let a single region be re-hashed later with offset/length.
+static FlValue* hash_device_operation(Operation* operation, GError** error) {
+  FlValue* args = operation->args;
+  int fd = open_for_read(operation->device_path.c_str(), error);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  MerkleHashOptions options;
+  merkle_hash_default_options(&options);
+  options.offset = (uint64_t)lookup_int(args, "offset", 0);
+  options.length = (uint64_t)lookup_int(args, "length", 0);
+  options.leaf_size = (size_t)lookup_int(args, "leafSize", (int64_t)options.leaf_size);
+  options.region_size = (uint64_t)lookup_int(args, "regionSize", (int64_t)options.region_size);
+  options.workers = (guint)lookup_int(args, "workers", 0);
+  options.progress = operation_progress_cb;
+  options.user_data = operation;
+  options.cancel = &operation->cancel;
+
+  MerkleHashResult result;
+  gint64 started_us = g_get_real_time();
+  gboolean ok = merkle_hash_device(fd, &options, &result, error);
+  close(fd);
+  if (!ok) {
+    return nullptr;
+  }
+  add_audit_pass(operation, "sha256-merkle", started_us, result.length, result.elapsed_us);
+
+  FlValue* value = merkle_hash_result_to_fl_value(&result);
+  merkle_hash_result_clear(&result);
+  return value;
+}
+
+// Samples blocks to tell zeroed, random-filled and still-populated regions
+// apart without a full read
+static FlValue* profile_device_operation(Operation* operation, GError** error) {
+  FlValue* args = operation->args;
+  int fd = open_for_read(operation->device_path.c_str(), error);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  EntropyProfileOptions options;
+  entropy_profile_default_options(&options);
+  options.offset = (uint64_t)lookup_int(args, "offset", 0);
+  options.length = (uint64_t)lookup_int(args, "length", 0);
+  options.block_size = (size_t)lookup_int(args, "blockSize", (int64_t)options.block_size);
+  options.regions = (guint)lookup_int(args, "regions", options.regions);
+  options.samples = (guint)lookup_int(args, "samples", 0);
+  FlValue* margin = lookup_arg(args, "margin", FL_VALUE_TYPE_FLOAT);
+  if (margin != nullptr) {
+    options.margin = fl_value_get_float(margin);
+  }
+  options.progress = operation_progress_cb;
+  options.user_data = operation;
+  options.cancel = &operation->cancel;
+
+  EntropyProfileResult result;
+  gint64 started_us = g_get_real_time();
+  gboolean ok = entropy_profile_run(fd, &options, &result, error);
+  close(fd);
+  if (result.bytes_read > 0) {
+    add_audit_pass(operation, "entropy-sample", started_us, result.bytes_read, result.elapsed_us);
+  }
+
+  FlValue* value = ok ? entropy_profile_result_to_fl_value(&result) : nullptr;
+  entropy_profile_result_clear(&result);
+  return value;
+}
+
+// Overwrites the free space of a mounted file system in place. devicePath is
+// optional and only ties the run to a device for the audit log and cancel().
+static FlValue* wipe_free_space_operation(Operation* operation, GError** error) {
+  FlValue* args = operation->args;
+  const gchar* mount_point = lookup_string(args, "mountPoint");
+  if (mount_point == nullptr) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "mountPoint is required");
+    return nullptr;
+  }
+
+  FreeSpaceWipeOptions options;
+  free_space_wipe_default_options(&options);
+  if (lookup_string(args, "pattern") != nullptr && !lookup_pattern(args, &options.pattern)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Unknown pattern");
+    return nullptr;
+  }
+  options.min_free_bytes = (uint64_t)lookup_int(args, "minFreeBytes", (int64_t)options.min_free_bytes);
+  options.file_size = (uint64_t)lookup_int(args, "fileSize", (int64_t)options.file_size);
+  options.max_workers = (guint)lookup_int(args, "maxWorkers", options.max_workers);
+  options.latency_target_ms = (double)lookup_int(args, "latencyTargetMs", (int64_t)options.latency_target_ms);
+  options.max_rate_bps = (uint64_t)lookup_int(args, "maxRateBps", 0);
+  FlValue* trim = lookup_arg(args, "trim", FL_VALUE_TYPE_BOOL);
+  if (trim != nullptr) {
+    options.trim = fl_value_get_bool(trim) ? 1 : 0;
+  }
+  options.progress = operation_progress_cb;
+  options.user_data = operation;
+  options.cancel = &operation->cancel;
+
+  FreeSpaceWipeResult result;
+  gint64 started_us = g_get_real_time();
+  gboolean ok = free_space_wipe_run(mount_point, &options, &result, error);
+  if (result.bytes_written > 0) {
+    add_audit_pass(operation, "free-space", started_us, result.bytes_written, result.elapsed_us);
+  }
+  return ok ? free_space_wipe_result_to_fl_value(&result) : nullptr;
+}
+
+static FlValue* verify_audit_log_operation(Operation* operation, GError** error) {
+  uint64_t records = 0;
+  g_autoptr(GError) verify_error = nullptr;
+  gboolean valid = audit_log_verify(operation->plugin->audit_path, &records, &verify_error);
+
+  FlValue* value = fl_value_new_map();
+  fl_value_set_string_take(value, "valid", fl_value_new_bool(valid));
+  fl_value_set_string_take(value, "records", fl_value_new_int((int64_t)records));
+  if (!valid) {
+    fl_value_set_string_take(value, "error", fl_value_new_string(verify_error->message));
+  }
+  return value;
+}
+
+// Read-only: takes a devicePaths list rather than devicePath so the scan is
+// not recorded in the audit log
+static FlValue* busy_report_operation(Operation* operation, GError** error) {
+  FlValue* paths = lookup_arg(operation->args, "devicePaths", FL_VALUE_TYPE_LIST);
+  if (paths == nullptr || fl_value_get_length(paths) == 0) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "devicePaths is required");
+    return nullptr;
+  }
+
+  std::vector<const char*> device_paths;
+  for (size_t i = 0; i < fl_value_get_length(paths); i++) {
+    FlValue* path = fl_value_get_list_value(paths, i);
+    if (fl_value_get_type(path) != FL_VALUE_TYPE_STRING) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                  "devicePaths must be strings");
+      return nullptr;
+    }
+    device_paths.push_back(fl_value_get_string(path));
+  }
+
+  BusyReport report;
+  if (!busy_scan(device_paths.data(), (guint)device_paths.size(),
+                 (guint)lookup_int(operation->args, "workers", 0), &report, error)) {
+    return nullptr;
+  }
+  FlValue* value = busy_report_to_fl_value(&report, device_paths.data(),
+                                           (guint)device_paths.size());
+  busy_report_clear(&report);
+  return value;
+}
+
+static FlValue* wipe_partitions_operation(Operation* operation, GError** error) {
+  FlValue* args = operation->args;
+  const char* device_path = operation->device_path.c_str();
+  std::string disk_name = disk_name_for_path(device_path);
+
+  RangeWipeOptions options;
+  range_wipe_default_options(&options);
+  if (!lookup_pattern(args, &options.pattern)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Unknown pattern");
+    return nullptr;
+  }
+  options.chunk_size = (size_t)lookup_int(args, "chunkSize", 0);
+  options.max_parallel_ranges = (guint)lookup_int(args, "maxParallelRanges", options.max_parallel_ranges);
+  options.workers_per_range = (guint)lookup_int(args, "workersPerRange", options.workers_per_range);
+  options.verify = lookup_bool(args, "verify", false);
+  options.verify_lag = (guint)lookup_int(args, "verifyLag", options.verify_lag);
+  options.progress = operation_progress_cb;
+  options.user_data = operation;
+  options.cancel = &operation->cancel;
+  NumaPlacement placement;
+  NumaPlacementStats placement_stats = {};
+  bool placed = probe_placement(args, device_path, &placement);
+  if (placed) {
+    options.placement = &placement;
+    options.placement_stats = &placement_stats;
+  }
+
+  // Selected partitions by name, or raw sector extents
+  std::vector<RangeExtent> extents;
+  FlValue* partitions = lookup_arg(args, "partitions", FL_VALUE_TYPE_LIST);
+  FlValue* raw = lookup_arg(args, "extents", FL_VALUE_TYPE_LIST);
+  if (partitions != nullptr) {
+    RangeExtent* known = nullptr;
+    size_t known_count = 0;
+    if (disk_name.empty() ||
+        !range_wipe_list_partitions(nullptr, disk_name.c_str(), &known, &known_count, error)) {
+      if (error != nullptr && *error == nullptr) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "%s is not a partitioned block device", device_path);
+      }
+      return nullptr;
+    }
+    for (size_t i = 0; i < fl_value_get_length(partitions); i++) {
+      FlValue* item = fl_value_get_list_value(partitions, i);
+      const gchar* name = fl_value_get_type(item) == FL_VALUE_TYPE_STRING
+          ? fl_value_get_string(item) : "";
+      size_t j = 0;
+      while (j < known_count && strcmp(known[j].name, name) != 0) {
+        j++;
+      }
+      if (j == known_count) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                    "%s has no partition %s", device_path, name);
+        g_free(known);
+        return nullptr;
+      }
+      extents.push_back(known[j]);
+    }
+    g_free(known);
+  } else if (raw != nullptr) {
+    for (size_t i = 0; i < fl_value_get_length(raw); i++) {
+      FlValue* item = fl_value_get_list_value(raw, i);
+      RangeExtent extent = {};
+      extent.start_sector = (uint64_t)lookup_int(item, "startSector", 0);
+      extent.size_sectors = (uint64_t)lookup_int(item, "sizeSectors", 0);
+      extents.push_back(extent);
+    }
+  }
+
+  uint64_t disk_sectors = 0;
+  if (disk_name.empty()) {
+    int fd = open(device_path, O_RDONLY | O_CLOEXEC);
+    uint64_t size = 0;
+    if (fd < 0 || !bulk_io_device_size(fd, &size)) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to get size of %s", device_path);
+      if (fd >= 0) {
+        close(fd);
+      }
+      return nullptr;
+    }
+    close(fd);
+    disk_sectors = size / RANGE_WIPE_SECTOR_SIZE;
+  }
+
+  if (!range_wipe_validate(nullptr, disk_name.empty() ? nullptr : disk_name.c_str(),
+                           disk_sectors, extents.data(), extents.size(), error)) {
+    return nullptr;
+  }
+
+  // The probe writes zeros into the first range, which is about to be
+  // overwritten anyway. Rotational disks get one stream per range
+  // regardless, so only the transfer size is taken from it for them.
+  // It claims the range the way range_wipe_execute will: through the
+  // partition's own node when every range is a named partition, otherwise
+  // through the whole disk. Either way a mounted target fails with EBUSY
+  // before anything is written.
+  IoAutotuneResult tuned;
+  bool autotune = lookup_bool(args, "autotune", false) && !extents.empty();
+  if (autotune) {
+    bool by_partition = true;
+    for (const RangeExtent& extent : extents) {
+      if (extent.name[0] == '\0') {
+        by_partition = false;
+      }
+    }
+    std::string probe_path = by_partition ? std::string("/dev/") + extents[0].name : device_path;
+    uint64_t probe_offset = by_partition ? 0 : extents[0].start_sector * RANGE_WIPE_SECTOR_SIZE;
+    int fd = open(probe_path.c_str(), O_RDWR | O_EXCL | O_DIRECT | O_CLOEXEC);
+    if (fd < 0 && errno == EINVAL) {
+      fd = open(probe_path.c_str(), O_RDWR | O_EXCL | O_CLOEXEC);
+    }
+    if (fd < 0) {
+      int saved = errno;
+      g_set_error(error, G_IO_ERROR, saved == EBUSY ? G_IO_ERROR_BUSY : G_IO_ERROR_FAILED,
+                  "Failed to open %s: %s", probe_path.c_str(), strerror(saved));
+      return nullptr;
+    }
+    bool tuned_ok = autotune_device(operation, fd, IO_AUTOTUNE_WRITE, probe_offset,
+                                    extents[0].size_sectors * RANGE_WIPE_SECTOR_SIZE,
+                                    &tuned, error);
+    close(fd);
+    if (!tuned_ok) {
+      return nullptr;
+    }
+    if (options.chunk_size == 0) {
+      options.chunk_size = tuned.block_size;
+    }
+    if (lookup_arg(args, "workersPerRange", FL_VALUE_TYPE_INT) == nullptr) {
+      options.workers_per_range = tuned.queue_depth;
+    }
+  }
+
+  // Disks get thermal and latency feedback; image files run unthrottled.
+  // The queue depth climbs from one request per range up to workersPerRange.
+  IoThrottle* throttle = nullptr;
+  TemperatureSource temperature = {};
+  if (!disk_name.empty() && lookup_bool(args, "throttle", true)) {
+    IoThrottleConfig config;
+    io_throttle_default_config(&config);
+    config.temperature_target_celsius =
+        (int)lookup_int(args, "temperatureTargetCelsius", config.temperature_target_celsius);
+    config.temperature_critical_celsius =
+        (int)lookup_int(args, "temperatureCriticalCelsius", config.temperature_critical_celsius);
+    config.max_rate_bps = (uint64_t)lookup_int(args, "maxRateBps", 0);
+    config.max_queue_depth = MAX(options.workers_per_range, 1u);
+    if (config.min_rate_bps > config.max_rate_bps && config.max_rate_bps > 0) {
+      config.min_rate_bps = config.max_rate_bps;
+    }
+    throttle = io_throttle_new(&config);
+    options.throttle = throttle;
+    if (start_temperature_source(device_path, disk_name, &temperature)) {
+      options.temperature = operation_temperature_cb;
+      options.temperature_ctx = &temperature;
+    }
+  }
+
+  options.extents = extents.data();
+  options.count = extents.size();
+  RangeWipeResult result = {};
+  gint64 started_us = g_get_real_time();
+  gboolean ok = range_wipe_execute(device_path, &options, &result, error);
+  stop_temperature_source(&temperature);
+  IoThrottleState throttle_state = {};
+  if (throttle != nullptr) {
+    io_throttle_get_state(throttle, &throttle_state);
+    io_throttle_free(throttle);
+  }
+  const gchar* pattern = lookup_string(args, "pattern");
+  add_audit_pass(operation, pattern != nullptr ? pattern : "zeros",
+                 started_us, result.bytes_written, result.elapsed_us);
+  bool cancelled = !ok && error != nullptr &&
+                   g_error_matches(*error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  if (options.verify && result.bytes_written > 0 && !cancelled) {
+    AuditRecord* audit = operation->audit;
+    audit->passes[audit->pass_count - 1].verify =
+        ok && result.verify_mismatches == 0 ? AUDIT_VERIFY_PASSED : AUDIT_VERIFY_FAILED;
+  }
+  if (!ok) {
+    return nullptr;
+  }
+
+  FlValue* value = fl_value_new_map();
+  fl_value_set_string_take(value, "bytesWritten", fl_value_new_int((int64_t)result.bytes_written));
+  fl_value_set_string_take(value, "elapsedUs", fl_value_new_int(result.elapsed_us));
+  fl_value_set_string_take(value, "sequential", fl_value_new_bool(result.sequential));
+  if (options.verify) {
+    fl_value_set_string_take(value, "bytesVerified", fl_value_new_int((int64_t)result.bytes_verified));
+  }
+  if (placed) {
+    fl_value_set_string_take(value, "placement",
+                             numa_placement_to_fl_value(&placement, &placement_stats));
+  }
+  if (autotune) {
+    fl_value_set_string_take(value, "autotune", io_autotune_result_to_fl_value(&tuned));
+  }
+  if (throttle != nullptr) {
+    fl_value_set_string_take(value, "throttle", io_throttle_state_to_fl_value(&throttle_state));
+  }
+  return value;
+}
+
+// Read-only probe of the device's best block size and queue depth
+static FlValue* autotune_operation(Operation* operation, GError** error) {
+  FlValue* args = operation->args;
+  int fd = open_for_read(operation->device_path.c_str(), error);
+  if (fd < 0) {
+    return nullptr;
+  }
+  IoAutotuneResult result;
+  bool ok = autotune_device(operation, fd, IO_AUTOTUNE_READ,
+                            (uint64_t)lookup_int(args, "offset", 0),
+                            (uint64_t)lookup_int(args, "length", 0), &result, error);
+  close(fd);
+  return ok ? io_autotune_result_to_fl_value(&result) : nullptr;
+}
+
+// Operation lifecycle
+
+// Runs on the main thread once the worker has finished
+static void operation_complete_cb(gpointer owner, gpointer data) {
+  Operation* operation = static_cast<Operation*>(data);
+  DiskOperationsPlugin* self = operation->plugin;
+
+  operation->thread.join();
+  {
+    std::lock_guard<std::mutex> guard(*self->lock);
+    self->operations->remove(operation);
+  }
+
+  g_autoptr(GError) error = nullptr;
+  gboolean sent;
+  if (operation->error != nullptr) {
+    sent = fl_method_call_respond_error(
+        operation->method_call,
+        operation->error->code == G_IO_ERROR_CANCELLED ? "CANCELLED" : "OPERATION_FAILED",
+        operation->error->message, nullptr, &error);
+    g_error_free(operation->error);
+  } else {
+    sent = fl_method_call_respond_success(operation->method_call, operation->result, &error);
+    fl_value_unref(operation->result);
+  }
+  if (!sent) {
+    g_warning("Failed to send method call response: %s", error->message);
+  }
+
+  g_object_unref(operation->method_call);
+  fl_value_unref(operation->args);
+  g_free(operation->audit);
+  delete operation;
+  g_object_unref(self);
+}
+
+static void operation_thread_func(Operation* operation) {
+  AuditRecord* audit = operation->audit;
+  audit->started_us = g_get_real_time();
+  operation->result = operation->func(operation, &operation->error);
+  if (operation->result == nullptr && operation->error == nullptr) {
+    g_set_error(&operation->error, G_IO_ERROR, G_IO_ERROR_FAILED, "Operation failed");
+  }
+  audit->finished_us = g_get_real_time();
+
+  // Queued to the background writer; never waits for the disk
+  AuditLog* audit_log = operation->plugin->audit_log;
+  if (audit_log != nullptr && !operation->device_path.empty()) {
+    audit_read_identity(operation->device_path.c_str(), audit);
+    g_strlcpy(audit->method, operation->name.c_str(), sizeof(audit->method));
+    if (operation->error == nullptr) {
+      g_strlcpy(audit->status, "completed", sizeof(audit->status));
+    } else {
+      g_strlcpy(audit->status,
+                operation->error->code == G_IO_ERROR_CANCELLED ? "cancelled" : "failed",
+                sizeof(audit->status));
+      g_strlcpy(audit->message, operation->error->message, sizeof(audit->message));
+    }
+    audit_log_append(audit_log, audit);
+  }
+
+  // Unkeyed, so it runs after every progress event of this operation
+  main_dispatch_post(operation->plugin->dispatch, nullptr, operation_complete_cb,
+                     operation, nullptr);
+}
+
+// Start @func on a worker thread; the method call is answered when it ends.
+// Operations on a device are recorded in the audit log.
+static void start_operation(DiskOperationsPlugin* self,
+                            FlMethodCall* method_call,
+                            const char* name,
+                            OperationFunc func,
+                            bool requires_device = true) {
+  FlValue* args = fl_method_call_get_args(method_call);
+  const gchar* device_path = lookup_string(args, "devicePath");
+  if (device_path == nullptr && requires_device) {
+    fl_method_call_respond_error(method_call, "INVALID_ARGUMENT",
+                                 "devicePath is required", nullptr, nullptr);
+    return;
+  }
+
+  Operation* operation = new Operation();
+  operation->plugin = DISK_OPERATIONS_PLUGIN(g_object_ref(self));
+  operation->name = name;
+  operation->device_path = device_path != nullptr ? device_path : "";
+  operation->method_call = FL_METHOD_CALL(g_object_ref(method_call));
+  operation->args = fl_value_ref(args);
+  operation->func = func;
+  operation->audit = g_new0(AuditRecord, 1);
+  operation->cancel = 0;
+  operation->result = nullptr;
+  operation->error = nullptr;
+
+  std::lock_guard<std::mutex> guard(*self->lock);
+  self->operations->push_back(operation);
+  operation->thread = std::thread(operation_thread_func, operation);
+}
+
+static void cancel_operations(DiskOperationsPlugin* self, const gchar* device_path) {
+  std::lock_guard<std::mutex> guard(*self->lock);
+  for (Operation* operation : *self->operations) {
+    if (device_path == nullptr || operation->device_path == device_path) {
+      __atomic_store_n(&operation->cancel, 1, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+// Handle method calls from Dart
+static void method_call_handler(FlMethodChannel* channel,
+                                FlMethodCall* method_call,
+                                gpointer user_data) {
+  DiskOperationsPlugin* self = DISK_OPERATIONS_PLUGIN(user_data);
+  const gchar* method = fl_method_call_get_name(method_call);
+  FlValue* args = fl_method_call_get_args(method_call);
+
+  if (strcmp(method, "discard") == 0) {
+    start_operation(self, method_call, "discard", discard_operation);
+    return;
+  }
+  if (strcmp(method, "wipePartitions") == 0) {
+    start_operation(self, method_call, "wipePartitions", wipe_partitions_operation);
+    return;
+  }
+  if (strcmp(method, "cryptoErase") == 0) {
+    start_operation(self, method_call, "cryptoErase", crypto_erase_operation);
+    return;
+  }
+  if (strcmp(method, "surfaceScan") == 0) {
+    start_operation(self, method_call, "surfaceScan", surface_scan_operation);
+    return;
+  }
+  if (strcmp(method, "autotuneDevice") == 0) {
+    start_operation(self, method_call, "autotuneDevice", autotune_operation);
+    return;
+  }
+  if (strcmp(method, "hashDevice") == 0) {
+    start_operation(self, method_call, "hashDevice", hash_device_operation);
+    return;
+  }
+  if (strcmp(method, "profileDevice") == 0) {
+    start_operation(self, method_call, "profileDevice", profile_device_operation);
+    return;
+  }
+  if (strcmp(method, "wipeFreeSpace") == 0) {
+    start_operation(self, method_call, "wipeFreeSpace", wipe_free_space_operation, false);
+    return;
+  }
+  if (strcmp(method, "getBusyReport") == 0) {
+    start_operation(self, method_call, "getBusyReport", busy_report_operation, false);
+    return;
+  }
+  if (strcmp(method, "verifyAuditLog") == 0) {
+    start_operation(self, method_call, "verifyAuditLog", verify_audit_log_operation, false);
+    return;
+  }
+
+  g_autoptr(FlMethodResponse) response = nullptr;
+
+  if (strcmp(method, "getDiscardCapabilities") == 0) {
+    const gchar* device_path = lookup_string(args, "devicePath");
+    int fd = device_path != nullptr ? open(device_path, O_RDONLY | O_CLOEXEC) : -1;
+    DiscardCapabilities caps;
+    if (fd >= 0 && discard_get_capabilities_for_fd(fd, &caps)) {
+      response = FL_METHOD_RESPONSE(fl_method_success_response_new(
+          discard_capabilities_to_fl_value(&caps)));
+    } else {
+      response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "DEVICE_ERROR", "Failed to read discard capabilities", nullptr));
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  } else if (strcmp(method, "getIoPlacement") == 0) {
+    // What surfaceScan and wipePartitions would use for this device
+    const gchar* device_path = lookup_string(args, "devicePath");
+    std::string name = device_path != nullptr ? disk_name_for_path(device_path) : "";
+    NumaPlacement placement;
+    if (!name.empty() && numa_placement_probe(placement_root(), name.c_str(), &placement)) {
+      response = FL_METHOD_RESPONSE(fl_method_success_response_new(
+          numa_placement_to_fl_value(&placement, nullptr)));
+    } else {
+      response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "DEVICE_ERROR", "Not a block device", nullptr));
+    }
+  } else if (strcmp(method, "listPartitionExtents") == 0) {
+    const gchar* device_path = lookup_string(args, "devicePath");
+    std::string disk_name = device_path != nullptr ? disk_name_for_path(device_path) : "";
+    RangeExtent* extents = nullptr;
+    size_t count = 0;
+    g_autoptr(GError) list_error = nullptr;
+    if (!disk_name.empty() &&
+        range_wipe_list_partitions(nullptr, disk_name.c_str(), &extents, &count, &list_error)) {
+      response = FL_METHOD_RESPONSE(fl_method_success_response_new(
+          range_wipe_extents_to_fl_value(extents, count)));
+      g_free(extents);
+    } else {
+      response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "DEVICE_ERROR",
+          list_error != nullptr ? list_error->message : "Not a block device",
+          nullptr));
+    }
+  } else if (strcmp(method, "getAuditLog") == 0 ||
+             strcmp(method, "findAuditRecords") == 0) {
+    guint limit = (guint)lookup_int(args, "limit", 100);
+    const gchar* serial = lookup_string(args, "serialNumber");
+    g_autoptr(GError) audit_error = nullptr;
+    if (self->audit_reader == nullptr) {
+      self->audit_reader = audit_reader_open(self->audit_path, &audit_error);
+    } else {
+      audit_reader_refresh(self->audit_reader, &audit_error);
+    }
+
+    if (self->audit_reader == nullptr) {
+      response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "AUDIT_ERROR", audit_error->message, nullptr));
+    } else if (strcmp(method, "getAuditLog") == 0) {
+      response = FL_METHOD_RESPONSE(fl_method_success_response_new(
+          audit_reader_recent(self->audit_reader, limit)));
+    } else if (serial != nullptr) {
+      response = FL_METHOD_RESPONSE(fl_method_success_response_new(
+          audit_reader_find_serial(self->audit_reader, serial, limit)));
+    } else {
+      response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "INVALID_ARGUMENT", "serialNumber is required", nullptr));
+    }
+  } else if (strcmp(method, "cancel") == 0) {
+    cancel_operations(self, lookup_string(args, "devicePath"));
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  } else {
+    response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
+  }
+
+  g_autoptr(GError) error = nullptr;
+  if (!fl_method_call_respond(method_call, response, &error)) {
+    g_warning("Failed to send method call response: %s", error->message);
+  }
+}
+
+static void disk_operations_plugin_dispose(GObject* object) {
+  DiskOperationsPlugin* self = DISK_OPERATIONS_PLUGIN(object);
+
+  // Operations hold a reference, so none can be running at this point
+  main_dispatch_close(self->dispatch);
+  g_clear_object(&self->channel);
+  g_clear_object(&self->progress_channel);
+  g_clear_pointer(&self->audit_reader, audit_reader_free);
+  g_clear_pointer(&self->audit_log, audit_log_close);
+
+  G_OBJECT_CLASS(disk_operations_plugin_parent_class)->dispose(object);
+}
+
+static void disk_operations_plugin_finalize(GObject* object) {
+  DiskOperationsPlugin* self = DISK_OPERATIONS_PLUGIN(object);
+  main_dispatch_free(self->dispatch);
+  delete self->operations;
+  delete self->lock;
+  g_free(self->audit_path);
+  io_autotune_cache_free(self->autotune_cache);
+  G_OBJECT_CLASS(disk_operations_plugin_parent_class)->finalize(object);
+}
+
+static void disk_operations_plugin_class_init(DiskOperationsPluginClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = disk_operations_plugin_dispose;
+  G_OBJECT_CLASS(klass)->finalize = disk_operations_plugin_finalize;
+}
+
+static void disk_operations_plugin_init(DiskOperationsPlugin* self) {
+  self->lock = new std::mutex();
+  self->operations = new std::list<Operation*>();
+  self->dispatch = main_dispatch_new(nullptr, 0, self);
+}
+
+DiskOperationsPlugin* disk_operations_plugin_new(FlBinaryMessenger* messenger) {
+  DiskOperationsPlugin* self = DISK_OPERATIONS_PLUGIN(
+      g_object_new(disk_operations_plugin_get_type(), nullptr));
+
+  // Create method channel
+  g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
+  self->channel = fl_method_channel_new(
+      messenger,
+      "com.swipe.device/operations",
+      FL_METHOD_CODEC(codec));
+  fl_method_channel_set_method_call_handler(
+      self->channel,
+      method_call_handler,
+      self,
+      nullptr);
+
+  // Open the audit log under $XDG_DATA_HOME/swipe
+  g_autofree gchar* audit_dir = g_build_filename(g_get_user_data_dir(), "swipe", nullptr);
+  g_mkdir_with_parents(audit_dir, 0700);
+  self->audit_path = g_build_filename(audit_dir, "audit.log", nullptr);
+  g_autoptr(GError) audit_error = nullptr;
+  self->audit_log = audit_log_open(self->audit_path, &audit_error);
+  if (self->audit_log == nullptr) {
+    g_warning("Audit logging disabled: %s", audit_error->message);
+  }
+  g_autofree gchar* autotune_path = g_build_filename(audit_dir, "autotune.cache", nullptr);
+  self->autotune_cache = io_autotune_cache_new(autotune_path);
+
+  // Create progress event channel
+  g_autoptr(FlStandardMethodCodec) progress_codec = fl_standard_method_codec_new();
+  self->progress_channel = fl_event_channel_new(
+      messenger,
+      "com.swipe.device/operations/progress",
+      FL_METHOD_CODEC(progress_codec));
+
+  return self;
+}
@@ -0,0 +1,14 @@
+#ifndef DISK_OPERATIONS_PLUGIN_H_
+#define DISK_OPERATIONS_PLUGIN_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+G_BEGIN_DECLS
+
+G_DECLARE_FINAL_TYPE(DiskOperationsPlugin, disk_operations_plugin, DISK_OPERATIONS, PLUGIN, GObject)
+
+DiskOperationsPlugin* disk_operations_plugin_new(FlBinaryMessenger* messenger);
+
+G_END_DECLS
+
+#endif  // DISK_OPERATIONS_PLUGIN_H_
@@ -7,13 +7,16 @@
 
 #include "flutter/generated_plugin_registrant.h"
 #include "disk_monitor_plugin.h"
-// #include "device_registry_plugin.h"
+#include "device_registry_plugin.h"
+#include "disk_operations_plugin.h"
+#include "../native/startup_timing.h"
 
 struct _MyApplication {
   GtkApplication parent_instance;
   char** dart_entrypoint_arguments;
   DiskMonitorPlugin* disk_monitor_plugin;
-  // DeviceRegistryPlugin* device_registry_plugin;
+  DeviceRegistryPlugin* device_registry_plugin;
+  DiskOperationsPlugin* disk_operations_plugin;
 };
 
 G_DEFINE_TYPE(MyApplication, my_application, GTK_TYPE_APPLICATION)
@@ -21,6 +24,7 @@ G_DEFINE_TYPE(MyApplication, my_application, GTK_TYPE_APPLICATION)
 // Called when first Flutter frame received.
 static void first_frame_cb(MyApplication* self, FlView *view)
 {
+  startup_timing_mark(STARTUP_MARK_FIRST_FRAME);
   gtk_widget_show(gtk_widget_get_toplevel(GTK_WIDGET(view)));
 }
 
@@ -77,10 +81,13 @@ static void my_application_activate(GApplication* application) {
 
   fl_register_plugins(FL_PLUGIN_REGISTRY(view));
 
-  // Register plugins
+  // Register plugins. The monitor and registry were created at startup and
+  // have been enumerating devices while the engine booted.
   FlBinaryMessenger* messenger = fl_engine_get_binary_messenger(fl_view_get_engine(view));
-  self->disk_monitor_plugin = disk_monitor_plugin_new(messenger);
-  // self->device_registry_plugin = device_registry_plugin_new(messenger);
+  disk_monitor_plugin_register(self->disk_monitor_plugin, messenger);
+  device_registry_plugin_register(self->device_registry_plugin, messenger);
+  self->disk_operations_plugin = disk_operations_plugin_new(messenger);
+  startup_timing_mark(STARTUP_MARK_ENGINE_READY);
 
   gtk_widget_grab_focus(GTK_WIDGET(view));
 }
@@ -106,9 +113,13 @@ static gboolean my_application_local_command_line(GApplication* application, gch
 
 // Implements GApplication::startup.
 static void my_application_startup(GApplication* application) {
-  //MyApplication* self = MY_APPLICATION(object);
+  MyApplication* self = MY_APPLICATION(application);
 
-  // Perform any actions required at application startup.
+  // Start device enumeration and identity probes now so they run while the
+  // engine and Dart VM boot; the first method calls are answered from them.
+  startup_timing_mark(STARTUP_MARK_PREFETCH_STARTED);
+  self->disk_monitor_plugin = disk_monitor_plugin_new_prefetching();
+  self->device_registry_plugin = device_registry_plugin_new_prefetching();
 
   G_APPLICATION_CLASS(my_application_parent_class)->startup(application);
 }
@@ -127,7 +138,8 @@ static void my_application_dispose(GObject* object) {
   MyApplication* self = MY_APPLICATION(object);
   g_clear_pointer(&self->dart_entrypoint_arguments, g_strfreev);
   g_clear_object(&self->disk_monitor_plugin);
-  // g_clear_object(&self->device_registry_plugin);
+  g_clear_object(&self->device_registry_plugin);
+  g_clear_object(&self->disk_operations_plugin);
   G_OBJECT_CLASS(my_application_parent_class)->dispose(object);
 }
 
@@ -147,6 +159,7 @@ MyApplication* my_application_new() {
   // corresponding .desktop file. This ensures better integration by allowing
   // the application to be recognized beyond its binary name.
   g_set_prgname(APPLICATION_ID);
+  startup_timing_mark(STARTUP_MARK_LAUNCH);
 
   return MY_APPLICATION(g_object_new(my_application_get_type(),
                                      "application-id", APPLICATION_ID,